@@ -0,0 +1,291 @@
+#include "AllocationTracker.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+	const size_t TagCount = (size_t)AllocationTag::Count;
+
+	const char* const tagNames[TagCount] =
+	{
+		"Other",
+		"Game",
+		"Entities",
+		"Spatial",
+		"Renderer",
+		"Resources",
+		"UI",
+	};
+
+	// Just in front of every block handed out - offset takes the
+	// pointer back to what malloc returned
+	struct BlockHeader
+	{
+		size_t size;
+		uint32_t offset;
+		AllocationTag tag;
+		bool aligned;		// From AllocateAligned()
+	};
+	const size_t HeaderSize = 16;
+	static_assert(sizeof(BlockHeader) <= HeaderSize, "Block header must fit in front of a 16 byte aligned block");
+
+	std::atomic<uint64_t> allocations[TagCount];
+	std::atomic<uint64_t> frees[TagCount];
+	std::atomic<uint64_t> bytes[TagCount];
+	std::atomic<size_t> liveBytes{ 0 };
+	std::atomic<size_t> peakBytes{ 0 };
+	std::atomic<size_t> framePeakBytes{ 0 };
+
+	std::atomic<bool> steadyState{ false };
+	std::atomic<bool> assertOnAllocation{ false };
+	std::atomic<uint64_t> steadyStateAllocations{ 0 };
+	std::atomic<AllocationTag> lastSteadyStateTag{ AllocationTag::Other };
+
+	thread_local AllocationTag currentTag = AllocationTag::Other;
+
+	// Main thread only, in BeginFrame()
+	AllocationCounts previousCounts[TagCount];
+	AllocationFrameStats history[AllocationTracker::HistoryLength];
+	size_t historyNext = 0;
+	size_t historyCount = 0;
+	uint64_t frameIndex = 0;
+	const AllocationFrameStats emptyFrame;
+
+	void* AllocateAligned(size_t size, size_t alignment)
+	{
+#ifdef _MSC_VER
+		return _aligned_malloc(size, alignment);
+#else
+		return aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+#endif
+	}
+
+	void FreeAligned(void* memory)
+	{
+#ifdef _MSC_VER
+		_aligned_free(memory);
+#else
+		free(memory);
+#endif
+	}
+
+	void RaiseToAtLeast(std::atomic<size_t>& value, size_t candidate)
+	{
+		size_t current = value.load(std::memory_order_relaxed);
+		while (current < candidate && !value.compare_exchange_weak(current, candidate, std::memory_order_relaxed))
+		{
+		}
+	}
+}
+
+void* AllocationTracker::Allocate(size_t size, size_t alignment)
+{
+	AllocationTag tag = currentTag;
+	size_t offset = (std::max)(alignment, HeaderSize);
+	bool aligned = alignment > alignof(std::max_align_t);
+	uint8_t* block = static_cast<uint8_t*>(aligned ? AllocateAligned(size + offset, alignment) : malloc(size + offset));
+	if (!block)
+		return nullptr;
+
+	uint8_t* memory = block + offset;
+	BlockHeader* header = reinterpret_cast<BlockHeader*>(memory - HeaderSize);
+	header->size = size;
+	header->offset = (uint32_t)offset;
+	header->tag = tag;
+	header->aligned = aligned;
+
+	allocations[(size_t)tag].fetch_add(1, std::memory_order_relaxed);
+	bytes[(size_t)tag].fetch_add(size, std::memory_order_relaxed);
+	size_t live = liveBytes.fetch_add(size, std::memory_order_relaxed) + size;
+	RaiseToAtLeast(framePeakBytes, live);
+	RaiseToAtLeast(peakBytes, live);
+
+	if (steadyState.load(std::memory_order_relaxed))
+	{
+		steadyStateAllocations.fetch_add(1, std::memory_order_relaxed);
+		lastSteadyStateTag.store(tag, std::memory_order_relaxed);
+		assert(!assertOnAllocation.load(std::memory_order_relaxed) && "Heap allocation in a steady state frame");
+	}
+	return memory;
+}
+
+void AllocationTracker::Free(void* memory)
+{
+	if (!memory)
+		return;
+
+	const BlockHeader* header = reinterpret_cast<const BlockHeader*>(static_cast<uint8_t*>(memory) - HeaderSize);
+	frees[(size_t)header->tag].fetch_add(1, std::memory_order_relaxed);
+	liveBytes.fetch_sub(header->size, std::memory_order_relaxed);
+
+	void* block = static_cast<uint8_t*>(memory) - header->offset;
+	if (header->aligned)
+		FreeAligned(block);
+	else
+		free(block);
+}
+
+AllocationTag AllocationTracker::GetTag() { return currentTag; }
+void AllocationTracker::SetTag(AllocationTag tag) { currentTag = tag; }
+
+const char* AllocationTracker::GetTagName(AllocationTag tag)
+{
+	return (size_t)tag < TagCount ? tagNames[(size_t)tag] : "?";
+}
+
+// --------------------------------------------------------
+// Everything counted since the last call is the frame that
+// just ended
+// --------------------------------------------------------
+void AllocationTracker::BeginFrame()
+{
+	AllocationFrameStats& stats = history[historyNext];
+	stats = AllocationFrameStats();
+	stats.frame = frameIndex++;
+
+	for (size_t t = 0; t < TagCount; t++)
+	{
+		AllocationCounts current;
+		current.allocations = allocations[t].load(std::memory_order_relaxed);
+		current.frees = frees[t].load(std::memory_order_relaxed);
+		current.bytes = bytes[t].load(std::memory_order_relaxed);
+
+		AllocationCounts& frame = stats.tags[t];
+		frame.allocations = current.allocations - previousCounts[t].allocations;
+		frame.frees = current.frees - previousCounts[t].frees;
+		frame.bytes = current.bytes - previousCounts[t].bytes;
+		previousCounts[t] = current;
+
+		stats.total.allocations += frame.allocations;
+		stats.total.frees += frame.frees;
+		stats.total.bytes += frame.bytes;
+	}
+
+	stats.liveBytes = liveBytes.load(std::memory_order_relaxed);
+	stats.peakBytes = (std::max)(framePeakBytes.exchange(stats.liveBytes, std::memory_order_relaxed), stats.liveBytes);
+
+	historyNext = (historyNext + 1) % HistoryLength;
+	historyCount = (std::min)(historyCount + 1, HistoryLength);
+}
+
+const AllocationFrameStats& AllocationTracker::GetLastFrame()
+{
+	return historyCount > 0 ? GetHistory(historyCount - 1) : emptyFrame;
+}
+
+size_t AllocationTracker::GetHistoryCount() { return historyCount; }
+
+const AllocationFrameStats& AllocationTracker::GetHistory(size_t index)
+{
+	return history[(historyNext + HistoryLength - historyCount + index) % HistoryLength];
+}
+
+AllocationCounts AllocationTracker::GetTotals()
+{
+	AllocationCounts totals;
+	for (size_t t = 0; t < TagCount; t++)
+	{
+		totals.allocations += allocations[t].load(std::memory_order_relaxed);
+		totals.frees += frees[t].load(std::memory_order_relaxed);
+		totals.bytes += bytes[t].load(std::memory_order_relaxed);
+	}
+	return totals;
+}
+
+size_t AllocationTracker::GetLiveBytes() { return liveBytes.load(std::memory_order_relaxed); }
+size_t AllocationTracker::GetPeakBytes() { return peakBytes.load(std::memory_order_relaxed); }
+
+void AllocationTracker::SetSteadyState(bool enabled)
+{
+	if (enabled && !steadyState.load(std::memory_order_relaxed))
+	{
+		steadyStateAllocations.store(0, std::memory_order_relaxed);
+		lastSteadyStateTag.store(AllocationTag::Other, std::memory_order_relaxed);
+	}
+	steadyState.store(enabled, std::memory_order_relaxed);
+}
+
+bool AllocationTracker::IsSteadyState() { return steadyState.load(std::memory_order_relaxed); }
+void AllocationTracker::SetAssertOnAllocation(bool enabled) { assertOnAllocation.store(enabled, std::memory_order_relaxed); }
+bool AllocationTracker::IsAssertOnAllocation() { return assertOnAllocation.load(std::memory_order_relaxed); }
+uint64_t AllocationTracker::GetSteadyStateAllocations() { return steadyStateAllocations.load(std::memory_order_relaxed); }
+AllocationTag AllocationTracker::GetLastSteadyStateTag() { return lastSteadyStateTag.load(std::memory_order_relaxed); }
+
+bool AllocationTracker::WriteCsv(const char* path)
+{
+	FILE* file = nullptr;
+#ifdef _MSC_VER
+	if (fopen_s(&file, path, "w") != 0)
+		file = nullptr;
+#else
+	file = fopen(path, "w");
+#endif
+	if (!file)
+		return false;
+
+	fprintf(file, "frame,allocations,frees,bytes,live bytes,peak bytes");
+	for (size_t t = 0; t < TagCount; t++)
+		fprintf(file, ",%s allocations,%s bytes", tagNames[t], tagNames[t]);
+	fprintf(file, "\n");
+
+	for (size_t i = 0; i < historyCount; i++)
+	{
+		const AllocationFrameStats& stats = GetHistory(i);
+		fprintf(file, "%llu,%llu,%llu,%llu,%zu,%zu",
+			(unsigned long long)stats.frame,
+			(unsigned long long)stats.total.allocations,
+			(unsigned long long)stats.total.frees,
+			(unsigned long long)stats.total.bytes,
+			stats.liveBytes,
+			stats.peakBytes);
+		for (size_t t = 0; t < TagCount; t++)
+			fprintf(file, ",%llu,%llu", (unsigned long long)stats.tags[t].allocations, (unsigned long long)stats.tags[t].bytes);
+		fprintf(file, "\n");
+	}
+
+	return fclose(file) == 0;
+}
+
+// --------------------------------------------------------
+// Every global operator new and delete in the program
+// --------------------------------------------------------
+void* operator new(size_t size)
+{
+	void* memory = AllocationTracker::Allocate(size, alignof(std::max_align_t));
+	if (!memory)
+		throw std::bad_alloc();
+	return memory;
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+	void* memory = AllocationTracker::Allocate(size, (size_t)alignment);
+	if (!memory)
+		throw std::bad_alloc();
+	return memory;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return AllocationTracker::Allocate(size, alignof(std::max_align_t)); }
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return AllocationTracker::Allocate(size, (size_t)alignment); }
+void* operator new[](size_t size) { return operator new(size); }
+void* operator new[](size_t size, std::align_val_t alignment) { return operator new(size, alignment); }
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept { return operator new(size, tag); }
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t& tag) noexcept { return operator new(size, alignment, tag); }
+
+void operator delete(void* memory) noexcept { AllocationTracker::Free(memory); }
+void operator delete(void* memory, size_t) noexcept { AllocationTracker::Free(memory); }
+void operator delete(void* memory, const std::nothrow_t&) noexcept { AllocationTracker::Free(memory); }
+void operator delete(void* memory, std::align_val_t) noexcept { AllocationTracker::Free(memory); }
+void operator delete(void* memory, size_t, std::align_val_t) noexcept { AllocationTracker::Free(memory); }
+void operator delete(void* memory, std::align_val_t, const std::nothrow_t&) noexcept { AllocationTracker::Free(memory); }
+void operator delete[](void* memory) noexcept { AllocationTracker::Free(memory); }
+void operator delete[](void* memory, size_t) noexcept { AllocationTracker::Free(memory); }
+void operator delete[](void* memory, const std::nothrow_t&) noexcept { AllocationTracker::Free(memory); }
+void operator delete[](void* memory, std::align_val_t) noexcept { AllocationTracker::Free(memory); }
+void operator delete[](void* memory, size_t, std::align_val_t) noexcept { AllocationTracker::Free(memory); }
+void operator delete[](void* memory, std::align_val_t, const std::nothrow_t&) noexcept { AllocationTracker::Free(memory); }
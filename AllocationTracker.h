@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// --------------------------------------------------------
+// What an allocation is charged to.  Each thread has a current
+// tag, set with AllocationScope; jobs run under the tag of the
+// thread that started them.
+// --------------------------------------------------------
+enum class AllocationTag : uint8_t
+{
+	Other,
+	Game,
+	Entities,
+	Spatial,		// BVH, hash grid, picking
+	Renderer,
+	Resources,
+	UI,
+	Count
+};
+
+struct AllocationCounts
+{
+	uint64_t allocations = 0;
+	uint64_t frees = 0;
+	uint64_t bytes = 0;			// Allocated, not live
+};
+
+struct AllocationFrameStats
+{
+	uint64_t frame = 0;
+	AllocationCounts total;
+	AllocationCounts tags[(size_t)AllocationTag::Count];
+	size_t liveBytes = 0;		// When the frame ended
+	size_t peakBytes = 0;		// Most live at once during it
+};
+
+// --------------------------------------------------------
+// Counts every heap allocation the program makes.
+//
+// AllocationTracker.cpp replaces the global operator new and
+// delete, and ImGui is pointed at Allocate() and Free(), so
+// nothing allocates behind its back except the C runtime and
+// the driver.  Each block carries a small header with its size
+// and tag, so frees are charged to whoever allocated.
+//
+// BeginFrame() closes the numbers for the frame just finished
+// and keeps the last HistoryLength frames for the UI and
+// WriteCsv().
+//
+// Steady state mode is for frames that should never touch the
+// heap: every allocation made while it's on is counted as a
+// violation, and asserts too if SetAssertOnAllocation() is on,
+// so the debugger stops on the call stack that allocated.
+// --------------------------------------------------------
+namespace AllocationTracker
+{
+	const size_t HistoryLength = 240;
+
+	void* Allocate(size_t size, size_t alignment);		// Null if out of memory
+	void Free(void* memory);
+
+	// The calling thread's
+	AllocationTag GetTag();
+	void SetTag(AllocationTag tag);
+	const char* GetTagName(AllocationTag tag);
+
+	// Called once a frame, from the main thread
+	void BeginFrame();
+	const AllocationFrameStats& GetLastFrame();
+	size_t GetHistoryCount();
+	const AllocationFrameStats& GetHistory(size_t index);		// 0 is the oldest
+
+	AllocationCounts GetTotals();		// Since the program started
+	size_t GetLiveBytes();
+	size_t GetPeakBytes();
+
+	// Enabling starts the violation count over
+	void SetSteadyState(bool enabled);
+	bool IsSteadyState();
+	void SetAssertOnAllocation(bool enabled);
+	bool IsAssertOnAllocation();
+	uint64_t GetSteadyStateAllocations();
+	AllocationTag GetLastSteadyStateTag();
+
+	// One row per frame of history, oldest first
+	bool WriteCsv(const char* path);
+}
+
+// --------------------------------------------------------
+// Charges the calling thread's allocations to a tag until it
+// goes out of scope
+// --------------------------------------------------------
+class AllocationScope
+{
+public:
+	explicit AllocationScope(AllocationTag tag) : previous(AllocationTracker::GetTag()) { AllocationTracker::SetTag(tag); }
+	~AllocationScope() { AllocationTracker::SetTag(previous); }
+
+	AllocationScope(const AllocationScope&) = delete;
+	AllocationScope& operator=(const AllocationScope&) = delete;
+
+private:
+	AllocationTag previous;
+};
@@ -0,0 +1,128 @@
+#include "AllocationTrackerTests.h"
+#include "HeadlessTests.h"
+#include "JobSystem.h"
+#include "AllocationTracker.h"
+
+#include <cstdio>
+#include <vector>
+
+using namespace DirectX;
+
+int RunAllocationTrackerChecks()
+{
+	printf("Allocation tracker checks\n");
+	int failures = 0;
+	char detail[256];
+	const size_t Resources = (size_t)AllocationTag::Resources;
+
+	// Frees are charged to whoever allocated
+	{
+		AllocationTracker::BeginFrame();
+		std::vector<int>* values;
+		{
+			AllocationScope scope(AllocationTag::Resources);
+			values = new std::vector<int>(1000);
+		}
+		delete values;
+		AllocationTracker::BeginFrame();
+		const AllocationCounts& counts = AllocationTracker::GetLastFrame().tags[Resources];
+		snprintf(detail, sizeof(detail), "%llu allocations, %llu bytes, %llu frees",
+			(unsigned long long)counts.allocations, (unsigned long long)counts.bytes, (unsigned long long)counts.frees);
+		failures += ReportCheck("a scope's allocations and their frees go to its tag",
+			counts.allocations == 2 && counts.frees == 2 && counts.bytes == sizeof(std::vector<int>) + 1000 * sizeof(int), detail);
+	}
+
+	// Jobs run under the tag of the thread that started them
+	{
+		JobSystem jobSystem(3);
+		std::vector<int*> blocks(64);
+		AllocationTracker::BeginFrame();
+		{
+			AllocationScope scope(AllocationTag::Resources);
+			jobSystem.ParallelFor(blocks.size(), 1, [&](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; i++)
+					blocks[i] = new int((int)i);
+			});
+		}
+		for (int* block : blocks)
+			delete block;
+		AllocationTracker::BeginFrame();
+		const AllocationCounts& counts = AllocationTracker::GetLastFrame().tags[Resources];
+		snprintf(detail, sizeof(detail), "%llu of 64 allocations on %u threads",
+			(unsigned long long)counts.allocations, jobSystem.GetThreadCount());
+		failures += ReportCheck("jobs are charged to the caller's tag", counts.allocations == 64, detail);
+	}
+
+	// Live bytes and the frame's peak
+	{
+		AllocationTracker::BeginFrame();
+		size_t liveBefore = AllocationTracker::GetLiveBytes();
+		char* big = new char[1 << 20];
+		big[0] = 1;
+		delete[] big;
+		AllocationTracker::BeginFrame();
+		const AllocationFrameStats& frame = AllocationTracker::GetLastFrame();
+		snprintf(detail, sizeof(detail), "peak %zu KB over %zu KB live", frame.peakBytes / 1024, liveBefore / 1024);
+		failures += ReportCheck("a frame's peak catches a block freed within it",
+			frame.peakBytes >= liveBefore + (1 << 20) && frame.liveBytes == liveBefore, detail);
+	}
+
+	// Over-aligned blocks
+	{
+		struct alignas(64) Line { char bytes[64]; };
+		size_t misaligned = 0;
+		for (int i = 0; i < 16; i++)
+		{
+			Line* line = new Line();
+			if ((uintptr_t)line % 64 != 0)
+				misaligned++;
+			delete line;
+		}
+		snprintf(detail, sizeof(detail), "%zu of 16 misaligned", misaligned);
+		failures += ReportCheck("over-aligned allocations keep their alignment", misaligned == 0, detail);
+	}
+
+	// Steady state counts what slips through, and nothing else
+	{
+		AllocationTracker::SetSteadyState(true);
+		std::vector<int> reserved;
+		reserved.reserve(16);
+		AllocationTag lastTag = AllocationTracker::GetLastSteadyStateTag();
+		uint64_t afterOne = AllocationTracker::GetSteadyStateAllocations();
+		for (int i = 0; i < 16; i++)
+			reserved.push_back(i);
+		uint64_t afterFill = AllocationTracker::GetSteadyStateAllocations();
+		AllocationTracker::SetSteadyState(false);
+		snprintf(detail, sizeof(detail), "%llu then %llu, last from %s",
+			(unsigned long long)afterOne, (unsigned long long)afterFill, AllocationTracker::GetTagName(lastTag));
+		failures += ReportCheck("steady state counts each allocation", afterOne == 1 && afterFill == 1, detail);
+	}
+
+	// The CSV has a row per frame of history
+	{
+		const char* path = "allocation_check.csv";
+		bool written = AllocationTracker::WriteCsv(path);
+		size_t lines = 0;
+		FILE* file = nullptr;
+#ifdef _MSC_VER
+		if (fopen_s(&file, path, "r") != 0)
+			file = nullptr;
+#else
+		file = fopen(path, "r");
+#endif
+		if (file)
+		{
+			int c;
+			while ((c = fgetc(file)) != EOF)
+				lines += c == '\n';
+			fclose(file);
+			remove(path);
+		}
+		snprintf(detail, sizeof(detail), "%zu lines for %zu frames", lines, AllocationTracker::GetHistoryCount());
+		failures += ReportCheck("the CSV has a header and a row per frame",
+			written && lines == AllocationTracker::GetHistoryCount() + 1, detail);
+	}
+
+	return ReportFailures(failures);
+}
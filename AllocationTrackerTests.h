@@ -0,0 +1,16 @@
+#pragma once
+
+// --------------------------------------------------------
+// Headless checks of the allocation tracker.
+//
+//  - a scope's allocations, and later their frees, are charged
+//    to its tag
+//  - jobs are charged to the tag of the thread that started them
+//  - a frame's peak includes blocks allocated and freed within it
+//  - over-aligned allocations keep their alignment
+//  - steady state counts every allocation made while it's on
+//  - the CSV has one row per frame of history
+//
+// Returns 0 if all checks passed.
+// --------------------------------------------------------
+int RunAllocationTrackerChecks();
@@ -0,0 +1,458 @@
+#include "AnimationClip.h"
+#include "CpuFeatures.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#if HAS_AVX2_PATHS
+#include <immintrin.h>
+#endif
+
+using namespace DirectX;
+
+namespace
+{
+	// Keys a cursor walks forward before it falls back to a search
+	const uint32_t CursorSteps = 4;
+
+	// Header and per-channel records of the binary format
+	const uint8_t LoopingFlag = 1;
+
+	struct FileHeader
+	{
+		uint32_t magic;
+		uint16_t version;
+		uint8_t flags;
+		uint8_t channelCount;
+		float duration;
+	};
+
+	struct FileChannel
+	{
+		uint8_t channel;
+		uint8_t interpolation;
+		uint16_t reserved;
+		uint32_t keyCount;
+	};
+
+	void Append(std::vector<uint8_t>& out, const void* data, size_t size)
+	{
+		size_t offset = out.size();
+		out.resize(offset + size);
+		memcpy(out.data() + offset, data, size);
+	}
+
+	void AppendKeys(std::vector<uint8_t>& out, const std::vector<XMFLOAT4>& keys, uint32_t width)
+	{
+		for (const XMFLOAT4& key : keys)
+			Append(out, &key, width * sizeof(float));
+	}
+
+	// Reads forward through the data, failing once anything would
+	// run past its end
+	struct FileReader
+	{
+		const uint8_t* data;
+		size_t size;
+		size_t offset = 0;
+
+		bool Read(void* out, size_t bytes)
+		{
+			if (bytes > size - offset)
+				return false;
+			memcpy(out, data + offset, bytes);
+			offset += bytes;
+			return true;
+		}
+
+		bool ReadKeys(std::vector<XMFLOAT4>& keys, uint32_t count, uint32_t width)
+		{
+			if ((size_t)count * width * sizeof(float) > size - offset)
+				return false;
+			keys.assign(count, XMFLOAT4(0, 0, 0, 0));
+			for (XMFLOAT4& key : keys)
+				Read(&key, width * sizeof(float));
+			return true;
+		}
+	};
+
+	XMVECTOR Blend(FXMVECTOR key, FXMVECTOR nextKey, FXMVECTOR tangent, GXMVECTOR nextTangent, const XMFLOAT4& weights)
+	{
+		XMVECTOR value = XMVectorScale(key, weights.x);
+		value = XMVectorMultiplyAdd(nextKey, XMVectorReplicate(weights.y), value);
+		value = XMVectorMultiplyAdd(tangent, XMVectorReplicate(weights.z), value);
+		return XMVectorMultiplyAdd(nextTangent, XMVectorReplicate(weights.w), value);
+	}
+
+	XMMATRIX LoadLanes(const XMFLOAT4 lanes[4])
+	{
+		XMMATRIX m;
+		for (uint32_t i = 0; i < 4; i++)
+			m.r[i] = XMLoadFloat4(&lanes[i]);
+		return m;
+	}
+
+	// CurveBatch::Evaluate() four lanes at a time
+	void EvaluateLanes(const XMFLOAT4 keys[4], const XMFLOAT4 nextKeys[4], const XMFLOAT4 tangents[4],
+		const XMFLOAT4 nextTangents[4], const XMFLOAT4 weights[4], XMFLOAT4 values[4], bool normalize)
+	{
+		// Row i of each matrix is lane i's key - transposed, row c is
+		// component c of every lane
+		XMMATRIX a = XMMatrixTranspose(LoadLanes(keys));
+		XMMATRIX b = XMMatrixTranspose(LoadLanes(nextKeys));
+		XMMATRIX ta = XMMatrixTranspose(LoadLanes(tangents));
+		XMMATRIX tb = XMMatrixTranspose(LoadLanes(nextTangents));
+		XMMATRIX w = XMMatrixTranspose(LoadLanes(weights));
+
+		XMMATRIX result;
+		for (int c = 0; c < 4; c++)
+		{
+			XMVECTOR value = XMVectorMultiply(a.r[c], w.r[0]);
+			value = XMVectorMultiplyAdd(b.r[c], w.r[1], value);
+			value = XMVectorMultiplyAdd(ta.r[c], w.r[2], value);
+			result.r[c] = XMVectorMultiplyAdd(tb.r[c], w.r[3], value);
+		}
+
+		if (normalize)
+		{
+			XMVECTOR lengthSq = XMVectorMultiply(result.r[0], result.r[0]);
+			for (int c = 1; c < 4; c++)
+				lengthSq = XMVectorMultiplyAdd(result.r[c], result.r[c], lengthSq);
+
+			// Cleared lanes stay zero rather than dividing by it
+			XMVECTOR scale = XMVectorDivide(XMVectorSplatOne(), XMVectorSqrt(lengthSq));
+			scale = XMVectorSelect(XMVectorZero(), scale, XMVectorGreater(lengthSq, XMVectorZero()));
+			for (int c = 0; c < 4; c++)
+				result.r[c] = XMVectorMultiply(result.r[c], scale);
+		}
+
+		result = XMMatrixTranspose(result);
+		for (uint32_t i = 0; i < 4; i++)
+			XMStoreFloat4(&values[i], result.r[i]);
+	}
+
+#if HAS_AVX2_PATHS
+	// Lanes i and i + 4 share register i, a lane in each half, so
+	// one 4x4 transpose of both halves leaves register c holding
+	// component c of all eight lanes, in order.  Its own inverse.
+	AVX2_FUNCTION inline void TransposeHalves(__m256 rows[4])
+	{
+		__m256 t0 = _mm256_unpacklo_ps(rows[0], rows[1]);
+		__m256 t1 = _mm256_unpacklo_ps(rows[2], rows[3]);
+		__m256 t2 = _mm256_unpackhi_ps(rows[0], rows[1]);
+		__m256 t3 = _mm256_unpackhi_ps(rows[2], rows[3]);
+		rows[0] = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(1, 0, 1, 0));
+		rows[1] = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 2, 3, 2));
+		rows[2] = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(1, 0, 1, 0));
+		rows[3] = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(3, 2, 3, 2));
+	}
+
+	AVX2_FUNCTION inline void LoadLanes8(const XMFLOAT4 lanes[8], __m256 components[4])
+	{
+		for (int i = 0; i < 4; i++)
+			components[i] = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(&lanes[i].x)), _mm_loadu_ps(&lanes[i + 4].x), 1);
+		TransposeHalves(components);
+	}
+
+	// CurveBatch::Evaluate() all eight lanes at once
+	AVX2_FUNCTION void EvaluateLanesAvx2(const XMFLOAT4 keys[8], const XMFLOAT4 nextKeys[8], const XMFLOAT4 tangents[8],
+		const XMFLOAT4 nextTangents[8], const XMFLOAT4 weights[8], XMFLOAT4 values[8], bool normalize)
+	{
+		__m256 a[4], b[4], ta[4], tb[4], w[4], result[4];
+		LoadLanes8(keys, a);
+		LoadLanes8(nextKeys, b);
+		LoadLanes8(tangents, ta);
+		LoadLanes8(nextTangents, tb);
+		LoadLanes8(weights, w);
+		for (int c = 0; c < 4; c++)
+		{
+			__m256 value = _mm256_mul_ps(a[c], w[0]);
+			value = _mm256_fmadd_ps(b[c], w[1], value);
+			value = _mm256_fmadd_ps(ta[c], w[2], value);
+			result[c] = _mm256_fmadd_ps(tb[c], w[3], value);
+		}
+
+		if (normalize)
+		{
+			__m256 lengthSq = _mm256_mul_ps(result[0], result[0]);
+			for (int c = 1; c < 4; c++)
+				lengthSq = _mm256_fmadd_ps(result[c], result[c], lengthSq);
+			__m256 scale = _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_sqrt_ps(lengthSq));
+			scale = _mm256_and_ps(scale, _mm256_cmp_ps(lengthSq, _mm256_setzero_ps(), _CMP_GT_OQ));
+			for (int c = 0; c < 4; c++)
+				result[c] = _mm256_mul_ps(result[c], scale);
+		}
+
+		TransposeHalves(result);
+		for (int i = 0; i < 4; i++)
+		{
+			_mm_storeu_ps(&values[i].x, _mm256_castps256_ps128(result[i]));
+			_mm_storeu_ps(&values[i + 4].x, _mm256_extractf128_ps(result[i], 1));
+		}
+	}
+#endif
+}
+
+uint32_t AnimationCurve::FindKey(float time, uint32_t cursor) const
+{
+	uint32_t last = (uint32_t)times.size() - 1;
+	size_t first = 0;
+	if (cursor <= last && time >= times[cursor])
+	{
+		for (uint32_t step = 0; step < CursorSteps; step++, cursor++)
+		{
+			if (cursor == last || time < times[cursor + 1])
+				return cursor;
+		}
+		first = cursor;
+	}
+
+	size_t found = std::upper_bound(times.begin() + first, times.end(), time) - times.begin();
+	return found > 0 ? (uint32_t)found - 1 : 0;
+}
+
+void AnimationCurve::GetBlend(float time, uint32_t& cursor, uint32_t& key, uint32_t& nextKey, XMFLOAT4& weights) const
+{
+	cursor = FindKey(time, cursor);
+	key = cursor;
+	nextKey = (std::min)(key + 1, (uint32_t)times.size() - 1);
+
+	float span = times[nextKey] - times[key];
+	if (span <= 0.0f || interpolation == CurveInterpolation::Step)
+	{
+		weights = XMFLOAT4(1, 0, 0, 0);
+		return;
+	}
+
+	// Before the first key holds it, like after the last
+	float u = (std::min)((std::max)((time - times[key]) / span, 0.0f), 1.0f);
+	if (interpolation == CurveInterpolation::Linear)
+	{
+		weights = XMFLOAT4(1.0f - u, u, 0, 0);
+		return;
+	}
+
+	float u2 = u * u;
+	float u3 = u2 * u;
+	weights = XMFLOAT4(
+		2.0f * u3 - 3.0f * u2 + 1.0f,
+		-2.0f * u3 + 3.0f * u2,
+		(u3 - 2.0f * u2 + u) * span,
+		(u3 - u2) * span);
+}
+
+bool AnimationClip::Finalize()
+{
+	for (size_t c = 0; c < (size_t)AnimationChannel::Count; c++)
+	{
+		AnimationCurve& curve = curves[c];
+		if (curve.IsEmpty())
+			continue;
+		if (curve.values.size() != curve.times.size() ||
+			(curve.interpolation == CurveInterpolation::Hermite && curve.tangents.size() != curve.times.size()) ||
+			(uint8_t)curve.interpolation > (uint8_t)CurveInterpolation::Hermite)
+			return false;
+		if (curve.interpolation != CurveInterpolation::Hermite)
+			curve.tangents.clear();
+
+		for (size_t k = 0; k < curve.times.size(); k++)
+		{
+			if (!std::isfinite(curve.times[k]) || (k > 0 && curve.times[k] < curve.times[k - 1]))
+				return false;
+		}
+		duration = (std::max)(duration, curve.times.back());
+
+		// q and -q are the same rotation, but only one of them is
+		// near the previous key
+		if ((AnimationChannel)c == AnimationChannel::Rotation)
+		{
+			for (size_t k = 1; k < curve.values.size(); k++)
+			{
+				XMVECTOR previous = XMLoadFloat4(&curve.values[k - 1]);
+				XMVECTOR current = XMLoadFloat4(&curve.values[k]);
+				if (XMVectorGetX(XMVector4Dot(previous, current)) >= 0.0f)
+					continue;
+				XMStoreFloat4(&curve.values[k], XMVectorNegate(current));
+				if (!curve.tangents.empty())
+					XMStoreFloat4(&curve.tangents[k], XMVectorNegate(XMLoadFloat4(&curve.tangents[k])));
+			}
+		}
+	}
+	return true;
+}
+
+float AnimationClip::WrapTime(float time) const
+{
+	if (duration <= 0.0f)
+		return 0.0f;
+	if (!looping)
+		return (std::min)((std::max)(time, 0.0f), duration);
+
+	float wrapped = fmodf(time, duration);
+	return wrapped < 0.0f ? wrapped + duration : wrapped;
+}
+
+void AnimationClip::Sample(float time, AnimationCursor& cursor, XMFLOAT3& position, XMFLOAT4& rotation, XMFLOAT3& scale) const
+{
+	for (size_t c = 0; c < (size_t)AnimationChannel::Count; c++)
+	{
+		const AnimationCurve& curve = curves[c];
+		if (curve.IsEmpty())
+			continue;
+
+		uint32_t key, nextKey;
+		XMFLOAT4 weights;
+		curve.GetBlend(time, cursor.keys[c], key, nextKey, weights);
+
+		XMVECTOR tangent = XMVectorZero();
+		XMVECTOR nextTangent = XMVectorZero();
+		if (!curve.tangents.empty())
+		{
+			tangent = XMLoadFloat4(&curve.tangents[key]);
+			nextTangent = XMLoadFloat4(&curve.tangents[nextKey]);
+		}
+		XMVECTOR value = Blend(XMLoadFloat4(&curve.values[key]), XMLoadFloat4(&curve.values[nextKey]), tangent, nextTangent, weights);
+
+		switch ((AnimationChannel)c)
+		{
+		case AnimationChannel::Position: XMStoreFloat3(&position, value); break;
+		case AnimationChannel::Rotation: XMStoreFloat4(&rotation, XMQuaternionNormalize(value)); break;
+		default: XMStoreFloat3(&scale, value); break;
+		}
+	}
+}
+
+std::vector<uint8_t> AnimationClip::Serialize() const
+{
+	std::vector<uint8_t> out;
+	FileHeader header = {};
+	header.magic = FileMagic;
+	header.version = FileVersion;
+	header.flags = looping ? LoopingFlag : 0;
+	header.duration = duration;
+	for (const AnimationCurve& curve : curves)
+		header.channelCount += curve.IsEmpty() ? 0 : 1;
+	Append(out, &header, sizeof(header));
+
+	for (size_t c = 0; c < (size_t)AnimationChannel::Count; c++)
+	{
+		const AnimationCurve& curve = curves[c];
+		if (curve.IsEmpty())
+			continue;
+
+		FileChannel channel = {};
+		channel.channel = (uint8_t)c;
+		channel.interpolation = (uint8_t)curve.interpolation;
+		channel.keyCount = (uint32_t)curve.times.size();
+		Append(out, &channel, sizeof(channel));
+
+		uint32_t width = GetChannelWidth((AnimationChannel)c);
+		Append(out, curve.times.data(), curve.times.size() * sizeof(float));
+		AppendKeys(out, curve.values, width);
+		if (curve.interpolation == CurveInterpolation::Hermite)
+			AppendKeys(out, curve.tangents, width);
+	}
+	return out;
+}
+
+bool AnimationClip::LoadFromMemory(const uint8_t* data, size_t size)
+{
+	*this = AnimationClip();
+	AnimationClip clip;
+	FileReader reader = { data, size };
+
+	FileHeader header;
+	if (!reader.Read(&header, sizeof(header)) || header.magic != FileMagic || header.version != FileVersion ||
+		header.channelCount > (uint8_t)AnimationChannel::Count || !std::isfinite(header.duration))
+		return false;
+	clip.looping = (header.flags & LoopingFlag) != 0;
+	clip.duration = (std::max)(header.duration, 0.0f);
+
+	for (uint8_t i = 0; i < header.channelCount; i++)
+	{
+		FileChannel channel;
+		if (!reader.Read(&channel, sizeof(channel)) || channel.channel >= (uint8_t)AnimationChannel::Count ||
+			channel.interpolation > (uint8_t)CurveInterpolation::Hermite || channel.keyCount == 0)
+			return false;
+
+		AnimationCurve& curve = clip.curves[channel.channel];
+		if (!curve.IsEmpty())
+			return false;
+		if ((size_t)channel.keyCount * sizeof(float) > size - reader.offset)
+			return false;
+
+		uint32_t width = GetChannelWidth((AnimationChannel)channel.channel);
+		curve.interpolation = (CurveInterpolation)channel.interpolation;
+		curve.times.resize(channel.keyCount);
+		reader.Read(curve.times.data(), channel.keyCount * sizeof(float));
+		if (!reader.ReadKeys(curve.values, channel.keyCount, width))
+			return false;
+		if (curve.interpolation == CurveInterpolation::Hermite && !reader.ReadKeys(curve.tangents, channel.keyCount, width))
+			return false;
+	}
+
+	if (reader.offset != size || !clip.Finalize())
+		return false;
+	*this = std::move(clip);
+	return true;
+}
+
+bool AnimationClip::LoadFromFile(const wchar_t* path)
+{
+	std::ifstream file(std::filesystem::path{ path }, std::ios::binary);
+	if (!file.is_open())
+	{
+		*this = AnimationClip();
+		return false;
+	}
+
+	std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	return LoadFromMemory(data.data(), data.size());
+}
+
+void CurveBatch::Set(uint32_t lane, const AnimationCurve& curve, float time, uint32_t& cursor)
+{
+	uint32_t key, nextKey;
+	curve.GetBlend(time, cursor, key, nextKey, weights[lane]);
+	keys[lane] = curve.values[key];
+	nextKeys[lane] = curve.values[nextKey];
+	if (curve.tangents.empty())
+	{
+		tangents[lane] = XMFLOAT4(0, 0, 0, 0);
+		nextTangents[lane] = XMFLOAT4(0, 0, 0, 0);
+	}
+	else
+	{
+		tangents[lane] = curve.tangents[key];
+		nextTangents[lane] = curve.tangents[nextKey];
+	}
+}
+
+void CurveBatch::Clear(uint32_t lane)
+{
+	keys[lane] = XMFLOAT4(0, 0, 0, 0);
+	nextKeys[lane] = XMFLOAT4(0, 0, 0, 0);
+	tangents[lane] = XMFLOAT4(0, 0, 0, 0);
+	nextTangents[lane] = XMFLOAT4(0, 0, 0, 0);
+	weights[lane] = XMFLOAT4(0, 0, 0, 0);
+}
+
+static_assert(CurveBatch::Width == 8, "Evaluate() runs eight lanes with AVX2, or four at a time without");
+
+void CurveBatch::Evaluate(XMFLOAT4 values[Width], bool normalize) const
+{
+#if HAS_AVX2_PATHS
+	if (CpuHasAvx2())
+	{
+		EvaluateLanesAvx2(keys, nextKeys, tangents, nextTangents, weights, values, normalize);
+		return;
+	}
+#endif
+	for (uint32_t first = 0; first < Width; first += 4)
+	{
+		EvaluateLanes(keys + first, nextKeys + first, tangents + first, nextTangents + first, weights + first,
+			values + first, normalize);
+	}
+}
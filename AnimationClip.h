@@ -0,0 +1,141 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+enum class AnimationChannel : uint8_t
+{
+	Position,
+	Rotation,		// Quaternions
+	Scale,
+	Count
+};
+
+enum class CurveInterpolation : uint8_t
+{
+	Step,			// Holds each key until the next
+	Linear,			// Rotations are normalized lerps
+	Hermite			// Cubic, through each key with its tangent
+};
+
+// --------------------------------------------------------
+// One channel's keys, in ascending time.  Values are stored four
+// floats wide whatever the channel, so every key loads as one
+// vector; position and scale leave w at zero.  Hermite curves
+// also have a tangent per key, in units per second.
+// --------------------------------------------------------
+struct AnimationCurve
+{
+	CurveInterpolation interpolation = CurveInterpolation::Linear;
+	std::vector<float> times;
+	std::vector<DirectX::XMFLOAT4> values;
+	std::vector<DirectX::XMFLOAT4> tangents;
+
+	bool IsEmpty() const { return times.empty(); }
+
+	// The last key at or before time.  The search starts from
+	// cursor - the key found last time - so sampling forward through
+	// a clip costs a step or two, not a binary search.
+	uint32_t FindKey(float time, uint32_t cursor) const;
+
+	// The key pair and blend weights for time: the value is
+	// weights.x * key + weights.y * next key + weights.z * key's
+	// tangent + weights.w * next key's tangent, whatever the
+	// interpolation.  Updates cursor.
+	void GetBlend(float time, uint32_t& cursor, uint32_t& key, uint32_t& nextKey, DirectX::XMFLOAT4& weights) const;
+};
+
+// Where each of a player's channels found its key last time
+struct AnimationCursor
+{
+	uint32_t keys[(size_t)AnimationChannel::Count] = {};
+};
+
+// --------------------------------------------------------
+// A keyframed clip: a position, rotation and scale curve, any of
+// them empty for a channel the clip leaves alone.
+//
+// Stored as a compact little-endian binary - a header, then per
+// channel its interpolation, key count, times, values at the
+// channel's own width, and Hermite tangents.  Loading checks
+// every count and offset against the data, so a bad file fails
+// to load instead of reading past it.
+// --------------------------------------------------------
+class AnimationClip
+{
+public:
+	static const uint32_t FileMagic = 0x504C4341;		// "ACLP"
+	static const uint16_t FileVersion = 1;
+
+	AnimationClip() = default;
+
+	AnimationCurve& GetCurve(AnimationChannel channel) { return curves[(size_t)channel]; }
+	const AnimationCurve& GetCurve(AnimationChannel channel) const { return curves[(size_t)channel]; }
+
+	float GetDuration() const { return duration; }
+	void SetDuration(float seconds) { duration = seconds; }
+	bool IsLooping() const { return looping; }
+	void SetLooping(bool loop) { looping = loop; }
+
+	// Checks the curves after they're filled in by hand, flips
+	// rotation keys into one hemisphere so neighbours lerp the short
+	// way, and stretches the duration to the last key.  False if a
+	// curve's times don't ascend or its arrays don't match.
+	bool Finalize();
+
+	// A playback time as a time in the clip - wrapped if it loops,
+	// held at the end if not
+	float WrapTime(float time) const;
+
+	// Samples every channel at a clip time, one at a time - the
+	// reference the batched evaluation is checked against.  Leaves
+	// the outputs of empty channels as they were.
+	void Sample(float time, AnimationCursor& cursor,
+		DirectX::XMFLOAT3& position, DirectX::XMFLOAT4& rotation, DirectX::XMFLOAT3& scale) const;
+
+	// The binary format.  Loading replaces the clip, and leaves it
+	// empty on failure.
+	std::vector<uint8_t> Serialize() const;
+	bool LoadFromMemory(const uint8_t* data, size_t size);
+	bool LoadFromFile(const wchar_t* path);
+
+	static uint32_t GetChannelWidth(AnimationChannel channel) { return channel == AnimationChannel::Rotation ? 4 : 3; }
+
+private:
+	AnimationCurve curves[(size_t)AnimationChannel::Count];
+	float duration = 0.0f;
+	bool looping = true;
+};
+
+// --------------------------------------------------------
+// Samples up to Width curves at once - typically one channel of
+// Width entities, each with its own clip.  Set() finds a lane's
+// keys with the scalar cursor search; Evaluate() then gathers
+// the lanes' keys, transposes them so each register holds one
+// component of the lanes, and blends every lane in the same few
+// multiply-adds - all eight at once with AVX2, four at a time
+// without.  Step, linear and Hermite lanes share that blend,
+// since each is just different weights.
+// --------------------------------------------------------
+class CurveBatch
+{
+public:
+	static constexpr uint32_t Width = 8;
+
+	void Set(uint32_t lane, const AnimationCurve& curve, float time, uint32_t& cursor);
+
+	// A lane with nothing to sample - evaluates to zero
+	void Clear(uint32_t lane);
+
+	// Every lane's value, normalized for rotations
+	void Evaluate(DirectX::XMFLOAT4 values[Width], bool normalize) const;
+
+private:
+	DirectX::XMFLOAT4 keys[Width];
+	DirectX::XMFLOAT4 nextKeys[Width];
+	DirectX::XMFLOAT4 tangents[Width];
+	DirectX::XMFLOAT4 nextTangents[Width];
+	DirectX::XMFLOAT4 weights[Width];
+};
@@ -0,0 +1,455 @@
+#include "AnimationClipTests.h"
+#include "HeadlessTests.h"
+#include "RecordingBackend.h"
+#include "ResourceRegistry.h"
+#include "EntitySystems.h"
+#include "EntityStore.h"
+#include "JobSystem.h"
+#include "AnimationClip.h"
+#include "CpuFeatures.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+	// A clip of random keys - the interpolation of each channel, the
+	// key count and whether it loops vary with index, and every
+	// fourth clip leaves scale alone
+	AnimationClip MakeBenchClip(std::mt19937& random, int index)
+	{
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		AnimationClip clip;
+		clip.SetLooping(index % 5 != 4);
+		for (uint32_t c = 0; c < (uint32_t)AnimationChannel::Count; c++)
+		{
+			AnimationChannel channel = (AnimationChannel)c;
+			if (channel == AnimationChannel::Scale && index % 4 == 3)
+				continue;
+
+			AnimationCurve& curve = clip.GetCurve(channel);
+			curve.interpolation = (CurveInterpolation)((index + c) % 3);
+			uint32_t keyCount = 2 + (uint32_t)(unit(random) * 60.0f);
+			float time = unit(random) * 0.1f;
+			XMVECTOR orientation = XMQuaternionRotationRollPitchYaw(unit(random) * 6.0f, unit(random) * 6.0f, unit(random) * 6.0f);
+			for (uint32_t k = 0; k < keyCount; k++)
+			{
+				curve.times.push_back(time);
+				time += 0.02f + unit(random) * 0.2f;
+
+				XMFLOAT4 value(0, 0, 0, 0);
+				if (channel == AnimationChannel::Rotation)
+				{
+					// Turning on from the last key, so keys stay fairly close
+					orientation = XMQuaternionMultiply(orientation, XMQuaternionRotationRollPitchYaw(
+						unit(random) - 0.5f, unit(random) - 0.5f, unit(random) - 0.5f));
+					XMStoreFloat4(&value, orientation);
+				}
+				else if (channel == AnimationChannel::Position)
+					value = XMFLOAT4(unit(random) * 4.0f - 2.0f, unit(random) * 4.0f - 2.0f, unit(random) * 4.0f - 2.0f, 0.0f);
+				else
+					value = XMFLOAT4(0.5f + unit(random), 0.5f + unit(random), 0.5f + unit(random), 0.0f);
+				curve.values.push_back(value);
+
+				if (curve.interpolation == CurveInterpolation::Hermite)
+				{
+					float w = channel == AnimationChannel::Rotation ? unit(random) - 0.5f : 0.0f;
+					curve.tangents.push_back(XMFLOAT4(unit(random) - 0.5f, unit(random) - 0.5f, unit(random) - 0.5f, w));
+				}
+			}
+		}
+		clip.Finalize();
+		return clip;
+	}
+
+	// Players on random clips, at random times and speeds
+	void CreateAnimationBenchEntities(EntityStore& store, const std::vector<AnimationClipHandle>& clips, size_t count, uint32_t seed)
+	{
+		std::mt19937 random(seed);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		for (size_t i = 0; i < count; i++)
+		{
+			AnimationPlayer player;
+			player.clip = clips[i % clips.size()];
+			player.time = unit(random) * 5.0f;
+			player.speed = 0.5f + unit(random) * 1.5f;
+			player.origin = XMFLOAT3(unit(random) * 100.0f - 50.0f, unit(random) * 10.0f, unit(random) * 100.0f - 50.0f);
+
+			Transform transform;
+			transform.SetPosition(player.origin);
+			store.Create(transform, player);
+		}
+	}
+
+	// PlayAnimations() one entity at a time with the scalar sampler,
+	// finding every key by binary search or from the cursor
+	void PlayAnimationsScalar(AnimationPlayerQuery& entities, const ResourceRegistry& resources, float deltaTime, bool useCursor)
+	{
+		entities.ForEach([&](EntityId, Transform& transform, AnimationPlayer& player)
+		{
+			const AnimationClip* clip = resources.Get(player.clip);
+			if (!clip)
+				return;
+			player.time = clip->WrapTime(player.time + deltaTime * player.speed);
+			if (!useCursor)
+				player.cursor = AnimationCursor{ { UINT32_MAX, UINT32_MAX, UINT32_MAX } };
+
+			XMFLOAT3 position = XMFLOAT3(0, 0, 0);
+			XMFLOAT4 rotation = XMFLOAT4(0, 0, 0, 1);
+			XMFLOAT3 scale = XMFLOAT3(1, 1, 1);
+			clip->Sample(player.time, player.cursor, position, rotation, scale);
+			if (!clip->GetCurve(AnimationChannel::Position).IsEmpty())
+				transform.SetPosition(player.origin.x + position.x, player.origin.y + position.y, player.origin.z + position.z);
+			if (!clip->GetCurve(AnimationChannel::Rotation).IsEmpty())
+				transform.SetRotationQuaternion(rotation);
+			if (!clip->GetCurve(AnimationChannel::Scale).IsEmpty())
+				transform.SetScale(scale);
+		});
+	}
+}
+
+int RunAnimationBench(const AnimationBenchSettings& settings)
+{
+	int threads = settings.threadCount > 0 ? settings.threadCount : (int)std::thread::hardware_concurrency();
+	threads = (std::max)(threads, 1);
+	JobSystem serial(0);
+	JobSystem parallel(threads - 1);
+	printf("Animation bench: %d entities, %d clips, %d frames, %u threads\n",
+		settings.entityCount, settings.clipCount, settings.frames, parallel.GetThreadCount());
+	int failures = 0;
+	char detail[256];
+
+	// The four-wide kernels, and the AVX2 ones where the CPU has them
+	const int kernelCount = CpuHasAvx2() ? 2 : 1;
+	const char* kernelNames[] = { "4-wide", "AVX2" };
+
+	RecordingBackend backend;
+	ResourceRegistry resources(backend, backend.CreateFence());
+	std::mt19937 random(2024);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	std::vector<AnimationClipHandle> clips;
+	for (int i = 0; i < (std::max)(settings.clipCount, 1); i++)
+		clips.push_back(resources.Create<AnimationClip>(MakeBenchClip(random, i)));
+
+	// Saved and loaded back, every clip samples exactly the same
+	{
+		size_t fileBytes = 0;
+		size_t memoryBytes = 0;
+		size_t differing = 0;
+		for (AnimationClipHandle handle : clips)
+		{
+			const AnimationClip& clip = *resources.Get(handle);
+			std::vector<uint8_t> data = clip.Serialize();
+			AnimationClip loaded;
+			bool ok = loaded.LoadFromMemory(data.data(), data.size());
+			fileBytes += data.size();
+			for (uint32_t c = 0; c < (uint32_t)AnimationChannel::Count; c++)
+			{
+				const AnimationCurve& curve = clip.GetCurve((AnimationChannel)c);
+				memoryBytes += curve.times.size() * sizeof(float) + (curve.values.size() + curve.tangents.size()) * sizeof(XMFLOAT4);
+			}
+
+			AnimationCursor cursors[2];
+			for (int s = 0; ok && s < 200; s++)
+			{
+				float time = clip.WrapTime(s * 0.037f);
+				XMFLOAT3 positions[2] = {}, scales[2] = {};
+				XMFLOAT4 rotations[2] = {};
+				clip.Sample(time, cursors[0], positions[0], rotations[0], scales[0]);
+				loaded.Sample(time, cursors[1], positions[1], rotations[1], scales[1]);
+				ok = memcmp(&positions[0], &positions[1], sizeof(XMFLOAT3)) == 0 &&
+					memcmp(&rotations[0], &rotations[1], sizeof(XMFLOAT4)) == 0 &&
+					memcmp(&scales[0], &scales[1], sizeof(XMFLOAT3)) == 0;
+			}
+			differing += !ok || loaded.GetDuration() != clip.GetDuration() || loaded.IsLooping() != clip.IsLooping();
+		}
+		snprintf(detail, sizeof(detail), "%zu of %zu differ, %zu bytes on disk against %zu in memory",
+			differing, clips.size(), fileBytes, memoryBytes);
+		failures += ReportCheck("clips load back as saved", differing == 0, detail);
+	}
+
+	// Anything but a whole, well formed clip fails to load
+	{
+		std::vector<uint8_t> data = resources.Get(clips[0])->Serialize();
+		AnimationClip loaded;
+		size_t truncatedLoads = 0;
+		for (size_t size = 0; size < data.size(); size++)
+			truncatedLoads += loaded.LoadFromMemory(data.data(), size);
+
+		// Header, then the first channel's record: 4 byte magic, 2 byte
+		// version, flags, channel count, duration; channel, interpolation,
+		// reserved, key count; then its first two times
+		struct Corruption { const char* name; size_t offset; std::vector<uint8_t> bytes; };
+		const Corruption corruptions[] = {
+			{ "magic", 0, { 'X' } },
+			{ "version", 4, { 9 } },
+			{ "channel count", 7, { 200 } },
+			{ "channel", 12, { 7 } },
+			{ "interpolation", 13, { 3 } },
+			{ "key count", 16, { 0xFF, 0xFF, 0xFF, 0x7F } },
+			{ "time order", 20, { 0x00, 0x00, 0x80, 0x7F } },	// An infinite first time
+		};
+		std::string accepted;
+		for (const Corruption& corruption : corruptions)
+		{
+			std::vector<uint8_t> corrupt = data;
+			memcpy(&corrupt[corruption.offset], corruption.bytes.data(), corruption.bytes.size());
+			if (loaded.LoadFromMemory(corrupt.data(), corrupt.size()))
+				accepted += std::string(accepted.empty() ? "" : ", ") + corruption.name;
+		}
+		std::vector<uint8_t> padded = data;
+		padded.push_back(0);
+		if (loaded.LoadFromMemory(padded.data(), padded.size()))
+			accepted += std::string(accepted.empty() ? "" : ", ") + "trailing byte";
+		if (loaded.LoadFromFile(L"no such clip.clip"))
+			accepted += std::string(accepted.empty() ? "" : ", ") + "missing file";
+		bool emptied = loaded.GetCurve(AnimationChannel::Position).IsEmpty() && loaded.GetDuration() == 0.0f;
+
+		snprintf(detail, sizeof(detail), "%zu of %zu truncations loaded, bad %s accepted%s", truncatedLoads, data.size(),
+			accepted.empty() ? "nothing" : accepted.c_str(), emptied ? "" : ", failed load left keys");
+		failures += ReportCheck("bad clip data is rejected", truncatedLoads == 0 && accepted.empty() && emptied, detail);
+	}
+
+	// The cursor finds the same key as a search from scratch, going
+	// forward in small and large steps, backward and wrapping
+	{
+		size_t wrong = 0;
+		size_t searched = 0;
+		for (AnimationClipHandle handle : clips)
+		{
+			const AnimationClip& clip = *resources.Get(handle);
+			const AnimationCurve& curve = clip.GetCurve(AnimationChannel::Position);
+			uint32_t cursor = 0;
+			float time = -0.5f;
+			for (int s = 0; s < 2000; s++)
+			{
+				float step = s % 100 == 99 ? -unit(random) * clip.GetDuration() : unit(random) * (s % 10 == 9 ? 1.0f : 0.05f);
+				time = time + step > clip.GetDuration() + 0.5f ? -0.5f : time + step;
+				cursor = curve.FindKey(time, cursor);
+				wrong += cursor != curve.FindKey(time, UINT32_MAX);
+				searched++;
+			}
+		}
+		snprintf(detail, sizeof(detail), "%zu of %zu keys differ", wrong, searched);
+		failures += ReportCheck("cursor search matches binary search", wrong == 0, detail);
+	}
+
+	// Each batch lane evaluates what the scalar sampler does, for
+	// every interpolation and with lanes cleared, with the four-wide
+	// kernel and the AVX2 one
+	for (int kernel = 0; kernel < kernelCount; kernel++)
+	{
+		SetAvx2Enabled(kernel == 1);
+		float worst = 0.0f;
+		size_t uncleared = 0;
+		for (int round = 0; round < 2000; round++)
+		{
+			AnimationChannel channel = (AnimationChannel)(round % (int)AnimationChannel::Count);
+			CurveBatch batch;
+			const AnimationClip* lanes[CurveBatch::Width] = {};
+			float times[CurveBatch::Width] = {};
+			for (uint32_t lane = 0; lane < CurveBatch::Width; lane++)
+			{
+				const AnimationClip* clip = resources.Get(clips[random() % clips.size()]);
+				uint32_t cursor = 0;
+				times[lane] = unit(random) * clip->GetDuration();
+				if (clip->GetCurve(channel).IsEmpty() || random() % 8 == 0)
+					batch.Clear(lane);
+				else
+				{
+					lanes[lane] = clip;
+					batch.Set(lane, clip->GetCurve(channel), times[lane], cursor);
+				}
+			}
+
+			XMFLOAT4 values[CurveBatch::Width];
+			batch.Evaluate(values, channel == AnimationChannel::Rotation);
+			for (uint32_t lane = 0; lane < CurveBatch::Width; lane++)
+			{
+				if (!lanes[lane])
+				{
+					uncleared += values[lane].x != 0.0f || values[lane].y != 0.0f || values[lane].z != 0.0f || values[lane].w != 0.0f;
+					continue;
+				}
+
+				AnimationCursor cursor;
+				XMFLOAT3 position, scale;
+				XMFLOAT4 rotation;
+				lanes[lane]->Sample(times[lane], cursor, position, rotation, scale);
+				XMFLOAT4 expected = channel == AnimationChannel::Rotation ? rotation :
+					channel == AnimationChannel::Position ? XMFLOAT4(position.x, position.y, position.z, 0.0f) : XMFLOAT4(scale.x, scale.y, scale.z, 0.0f);
+				for (int i = 0; i < 4; i++)
+					worst = (std::max)(worst, fabsf((&values[lane].x)[i] - (&expected.x)[i]));
+			}
+		}
+		char name[64];
+		snprintf(name, sizeof(name), "%s batched lanes match scalar sampling", kernelNames[kernel]);
+		snprintf(detail, sizeof(detail), "off by %.1e at worst, %zu cleared lanes not zero", worst, uncleared);
+		failures += ReportCheck(name, worst < 1e-5f && uncleared == 0, detail);
+	}
+	SetAvx2Enabled(true);
+
+	// Transforms store rotations as pitch, yaw and roll - a
+	// quaternion has to come back out as the same rotation,
+	// including looking straight up and down
+	{
+		float worst = 0.0f;
+		for (int i = 0; i < 10000; i++)
+		{
+			float pitch = i % 10 == 0 ? (i % 20 == 0 ? XM_PIDIV2 : -XM_PIDIV2) : unit(random) * XM_2PI;
+			XMVECTOR quaternion = XMQuaternionRotationRollPitchYaw(pitch, unit(random) * XM_2PI, unit(random) * XM_2PI);
+			XMFLOAT4 stored;
+			XMStoreFloat4(&stored, quaternion);
+
+			Transform transform;
+			transform.SetRotationQuaternion(stored);
+			XMFLOAT3 rotation = transform.GetPitchYawRoll();
+			worst = (std::max)(worst, QuaternionAngle(quaternion, XMQuaternionRotationRollPitchYaw(rotation.x, rotation.y, rotation.z)));
+		}
+		snprintf(detail, sizeof(detail), "%.1e radians off at worst", worst);
+		failures += ReportCheck("quaternions survive pitch, yaw and roll", worst < 1e-5f, detail);
+	}
+
+	// The whole system on every thread count against the scalar
+	// sampler, entity by entity
+	{
+		const size_t count = 5000;
+		EntityStore batched, scalar;
+		CreateAnimationBenchEntities(batched, clips, count, 77);
+		CreateAnimationBenchEntities(scalar, clips, count, 77);
+		AnimationPlayerQuery batchedPlayers(batched), scalarPlayers(scalar);
+		for (int frame = 0; frame < 120; frame++)
+		{
+			float deltaTime = frame % 30 == 29 ? 0.5f : 1.0f / 60.0f;
+			PlayAnimations(batchedPlayers, resources, frame % 2 ? parallel : serial, deltaTime);
+			PlayAnimationsScalar(scalarPlayers, resources, deltaTime, true);
+		}
+
+		float worstPosition = 0.0f, worstScale = 0.0f, worstAngle = 0.0f, worstTime = 0.0f;
+		scalarPlayers.ForEach([&](EntityId id, Transform& transform, AnimationPlayer& player)
+		{
+			Transform& other = batched.Get<Transform>(id);
+			XMFLOAT3 rotation = transform.GetPitchYawRoll();
+			XMFLOAT3 otherRotation = other.GetPitchYawRoll();
+			worstPosition = (std::max)(worstPosition, MaxDifference(transform.GetPosition(), other.GetPosition()));
+			worstScale = (std::max)(worstScale, MaxDifference(transform.GetScale(), other.GetScale()));
+			worstAngle = (std::max)(worstAngle, QuaternionAngle(XMQuaternionRotationRollPitchYaw(rotation.x, rotation.y, rotation.z),
+				XMQuaternionRotationRollPitchYaw(otherRotation.x, otherRotation.y, otherRotation.z)));
+			worstTime = (std::max)(worstTime, fabsf(player.time - batched.Get<AnimationPlayer>(id).time));
+		});
+		snprintf(detail, sizeof(detail), "off by %.1e in position, %.1e in scale, %.1e radians, %.1e s", worstPosition, worstScale, worstAngle, worstTime);
+		failures += ReportCheck("PlayAnimations() matches the scalar sampler",
+			worstPosition < 1e-4f && worstScale < 1e-5f && worstAngle < 1e-5f && worstTime == 0.0f, detail);
+	}
+
+	// What it costs: sampling and writing every transform, scalar
+	// with a binary search per key, scalar from the cursor, and
+	// batched with each kernel on one thread and on all of them
+	{
+		EntityStore store;
+		CreateAnimationBenchEntities(store, clips, settings.entityCount, 5);
+		AnimationPlayerQuery players(store);
+		const float deltaTime = 1.0f / 60.0f;
+		const int frames = (std::max)(settings.frames, 1);
+		printf("\n");
+		for (int mode = 0; mode < 2 + kernelCount * 2; mode++)
+		{
+			int kernel = mode < 2 ? 0 : (mode - 2) / 2;
+			JobSystem& jobSystem = mode % 2 == 0 ? serial : parallel;
+			SetAvx2Enabled(kernel == 1);
+			double totalMs = 0.0;
+			for (int frame = 0; frame < frames; frame++)
+			{
+				auto start = std::chrono::high_resolution_clock::now();
+				if (mode < 2)
+					PlayAnimationsScalar(players, resources, deltaTime, mode == 1);
+				else
+					PlayAnimations(players, resources, jobSystem, deltaTime);
+				totalMs += Milliseconds(std::chrono::high_resolution_clock::now() - start);
+			}
+			char name[64];
+			if (mode < 2)
+				snprintf(name, sizeof(name), "scalar, %s", mode == 0 ? "binary search" : "cursor");
+			else
+				snprintf(name, sizeof(name), "batched %s, %u thread%s", kernelNames[kernel], jobSystem.GetThreadCount(),
+					jobSystem.GetThreadCount() == 1 ? "" : "s");
+			printf("  %-28s %8.3f ms a frame, %6.1f ns an entity\n", name,
+				totalMs / frames, totalMs / frames * 1e6 / settings.entityCount);
+		}
+		SetAvx2Enabled(true);
+
+		// The same on one thread in parts: finding every player's keys
+		// and filling the batches, blending them - the only part the
+		// kernels differ in - and the rest, mostly Transform turning
+		// each quaternion into pitch, yaw and roll
+		const uint32_t channelCount = (uint32_t)AnimationChannel::Count;
+		std::vector<const AnimationClip*> playerClips;
+		std::vector<float> times;
+		std::vector<AnimationCursor> cursors;
+		players.ForEach([&](EntityId, Transform&, AnimationPlayer& player)
+		{
+			playerClips.push_back(resources.Get(player.clip));
+			times.push_back(player.time);
+			cursors.push_back(player.cursor);
+		});
+		size_t groupCount = (playerClips.size() + CurveBatch::Width - 1) / CurveBatch::Width;
+		std::vector<CurveBatch> batches(groupCount * channelCount);
+		std::vector<XMFLOAT4> values(batches.size() * CurveBatch::Width);
+
+		double setMs = 0.0;
+		double evaluateMs[2] = {};
+		for (int frame = 0; frame < frames; frame++)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			for (size_t group = 0; group < groupCount; group++)
+			{
+				for (uint32_t c = 0; c < channelCount; c++)
+				{
+					CurveBatch& batch = batches[group * channelCount + c];
+					for (uint32_t lane = 0; lane < CurveBatch::Width; lane++)
+					{
+						size_t player = group * CurveBatch::Width + lane;
+						const AnimationCurve* curve = player < playerClips.size() ? &playerClips[player]->GetCurve((AnimationChannel)c) : nullptr;
+						if (curve && !curve->IsEmpty())
+							batch.Set(lane, *curve, times[player], cursors[player].keys[c]);
+						else
+							batch.Clear(lane);
+					}
+				}
+			}
+			setMs += Milliseconds(std::chrono::high_resolution_clock::now() - start);
+
+			for (int kernel = 0; kernel < kernelCount; kernel++)
+			{
+				SetAvx2Enabled(kernel == 1);
+				start = std::chrono::high_resolution_clock::now();
+				for (size_t b = 0; b < batches.size(); b++)
+					batches[b].Evaluate(&values[b * CurveBatch::Width], b % channelCount == (uint32_t)AnimationChannel::Rotation);
+				evaluateMs[kernel] += Milliseconds(std::chrono::high_resolution_clock::now() - start);
+			}
+		}
+		SetAvx2Enabled(true);
+
+		double perEntity = 1e6 / ((double)frames * settings.entityCount);
+		printf("  of which, on one thread:\n");
+		printf("    %-26s %6.1f ns an entity\n", "finding keys, filling lanes", setMs * perEntity);
+		for (int kernel = 0; kernel < kernelCount; kernel++)
+		{
+			char name[64];
+			snprintf(name, sizeof(name), "blending, %s", kernelNames[kernel]);
+			printf("    %-26s %6.1f ns an entity\n", name, evaluateMs[kernel] * perEntity);
+		}
+		printf("\n");
+	}
+
+	return ReportFailures(failures);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+// --------------------------------------------------------
+// Headless CPU benchmark and checks of keyframe animation - no
+// GPU.
+//
+// clipCount random clips (every interpolation, 2 to 61 keys a
+// channel, some looping, some without scale) played on
+// entityCount entities at random times and speeds.  Times a
+// frame of sampling and writing every transform: scalar with a
+// binary search per key, scalar from the cursor, and
+// PlayAnimations() on one thread and on threadCount, with the
+// four-wide CurveBatch kernel and the AVX2 one if the CPU has it.
+// Then, on one thread, how much of that is finding keys and how
+// much blending them with each kernel.
+//
+// Checks:
+//  - clips saved and loaded back sample bit for bit the same
+//    (the file and in-memory sizes are printed), and truncated
+//    or corrupted data fails to load
+//  - the cursor finds the same key as a binary search, forward,
+//    backward and wrapping
+//  - every batch lane matches the scalar sampler, for each
+//    interpolation and with both kernels, and cleared lanes are
+//    zero
+//  - quaternions set on a transform come back as the same
+//    rotation, looking straight up and down too
+//  - PlayAnimations() leaves the transforms the scalar sampler
+//    does, whatever the thread count
+//
+// Returns 0 if all checks passed.
+// --------------------------------------------------------
+struct AnimationBenchSettings
+{
+	int entityCount = 100000;
+	int clipCount = 16;
+	int frames = 50;			// Per way of sampling
+	int threadCount = -1;		// Including the caller, negative = every hardware thread
+};
+
+int RunAnimationBench(const AnimationBenchSettings& settings);
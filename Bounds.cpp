@@ -0,0 +1,74 @@
+#include "Bounds.h"
+#include <cmath>
+
+using namespace DirectX;
+
+AABB AABB::FromMinMax(XMFLOAT3 min, XMFLOAT3 max)
+{
+	AABB box;
+	box.center = XMFLOAT3(
+		(min.x + max.x) * 0.5f,
+		(min.y + max.y) * 0.5f,
+		(min.z + max.z) * 0.5f);
+	box.extents = XMFLOAT3(
+		(max.x - min.x) * 0.5f,
+		(max.y - min.y) * 0.5f,
+		(max.z - min.z) * 0.5f);
+	return box;
+}
+
+// --------------------------------------------------------
+// Transforms the center as a point, then each output axis gets
+// the extents projected through the absolute value of the
+// rotation/scale part (Arvo's method)
+// --------------------------------------------------------
+AABB AABB::Transformed(const XMFLOAT4X4& m) const
+{
+	AABB box;
+	box.center = XMFLOAT3(
+		center.x * m._11 + center.y * m._21 + center.z * m._31 + m._41,
+		center.x * m._12 + center.y * m._22 + center.z * m._32 + m._42,
+		center.x * m._13 + center.y * m._23 + center.z * m._33 + m._43);
+	box.extents = XMFLOAT3(
+		extents.x * fabsf(m._11) + extents.y * fabsf(m._21) + extents.z * fabsf(m._31),
+		extents.x * fabsf(m._12) + extents.y * fabsf(m._22) + extents.z * fabsf(m._32),
+		extents.x * fabsf(m._13) + extents.y * fabsf(m._23) + extents.z * fabsf(m._33));
+	return box;
+}
+
+// --------------------------------------------------------
+// Gribb/Hartmann plane extraction.  With row vectors clip =
+// v * M, so each plane is a sum/difference of columns of M.
+// --------------------------------------------------------
+Frustum Frustum::FromViewProjection(const XMFLOAT4X4& m)
+{
+	Frustum f;
+	f.planes[0] = XMFLOAT4(m._14 + m._11, m._24 + m._21, m._34 + m._31, m._44 + m._41);	// left
+	f.planes[1] = XMFLOAT4(m._14 - m._11, m._24 - m._21, m._34 - m._31, m._44 - m._41);	// right
+	f.planes[2] = XMFLOAT4(m._14 + m._12, m._24 + m._22, m._34 + m._32, m._44 + m._42);	// bottom
+	f.planes[3] = XMFLOAT4(m._14 - m._12, m._24 - m._22, m._34 - m._32, m._44 - m._42);	// top
+	f.planes[4] = XMFLOAT4(m._13, m._23, m._33, m._43);									// near
+	f.planes[5] = XMFLOAT4(m._14 - m._13, m._24 - m._23, m._34 - m._33, m._44 - m._43);	// far
+
+	for (XMFLOAT4& p : f.planes)
+		XMStoreFloat4(&p, XMPlaneNormalize(XMLoadFloat4(&p)));
+
+	return f;
+}
+
+bool Frustum::Intersects(const AABB& box) const
+{
+	for (const XMFLOAT4& p : planes)
+	{
+		// Distance of the center vs. the box's "radius" along the normal
+		float distance = p.x * box.center.x + p.y * box.center.y + p.z * box.center.z + p.w;
+		float radius =
+			box.extents.x * fabsf(p.x) +
+			box.extents.y * fabsf(p.y) +
+			box.extents.z * fabsf(p.z);
+
+		if (distance < -radius)
+			return false;
+	}
+	return true;
+}
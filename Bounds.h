@@ -0,0 +1,32 @@
+#pragma once
+
+#include <DirectXMath.h>
+
+// --------------------------------------------------------
+// Axis-aligned box stored as center + half-size
+// --------------------------------------------------------
+struct AABB
+{
+	DirectX::XMFLOAT3 center = DirectX::XMFLOAT3(0, 0, 0);
+	DirectX::XMFLOAT3 extents = DirectX::XMFLOAT3(0, 0, 0);
+
+	static AABB FromMinMax(DirectX::XMFLOAT3 min, DirectX::XMFLOAT3 max);
+
+	// Smallest box around this one after transforming it by a
+	// (row-vector) world matrix
+	AABB Transformed(const DirectX::XMFLOAT4X4& world) const;
+};
+
+// --------------------------------------------------------
+// Six planes pulled out of a view * projection matrix.
+// Normals point inwards; the near plane is z = 0 (D3D clip space).
+// --------------------------------------------------------
+struct Frustum
+{
+	DirectX::XMFLOAT4 planes[6];
+
+	static Frustum FromViewProjection(const DirectX::XMFLOAT4X4& viewProjection);
+
+	// Conservative - a box near a corner may pass without being inside
+	bool Intersects(const AABB& box) const;
+};
@@ -1,6 +1,6 @@
 #pragma once
 #include <DirectXMath.h> 
-#include "lights.h"
+#include "Lights.h"
 
 struct VertexShaderExternalData
 {
@@ -10,8 +10,14 @@ struct VertexShaderExternalData
 	//float padding;
 	DirectX::XMFLOAT4X4 view;
 	DirectX::XMFLOAT4X4 projection;
-	DirectX::XMFLOAT4X4 lightView;
-	DirectX::XMFLOAT4X4 lightProjection;
+};
+
+// Shadow pass vertex shader data - just world/view/proj
+struct ShadowVSData
+{
+	DirectX::XMFLOAT4X4 world;
+	DirectX::XMFLOAT4X4 view;
+	DirectX::XMFLOAT4X4 proj;
 };
 
 struct PixelShaderExternalData
@@ -23,5 +29,37 @@ struct PixelShaderExternalData
 	float padding;
 	DirectX::XMFLOAT3 cameraPosition;
 	float padding2;
-	Light lights[5];
-};
\ No newline at end of file
+	int objectLightCount;		// -1 = use the light clusters
+	float padding3[3];
+	unsigned int objectLights[8];	// ObjectLightSelector::MaxLightsPerObject
+};
+
+// Per-frame constants for finding a pixel's light cluster (PixelShader b1)
+struct LightClusterShaderData
+{
+	unsigned int clusterCountX;
+	unsigned int clusterCountY;
+	unsigned int clusterCountZ;
+	unsigned int directionalLightCount;
+	DirectX::XMFLOAT2 tileScale;	// Pixels to tiles
+	float depthScale;				// slice = log(viewZ) * depthScale + depthBias
+	float depthBias;
+};
+
+// Per-frame shadow cascade constants (PixelShader b2)
+struct ShadowCascadeShaderData
+{
+	DirectX::XMFLOAT4X4 cascadeViewProjection[4];	// ShadowCascades::CascadeCount
+	DirectX::XMFLOAT4 cascadeSplits;				// Far view depth of each cascade
+	unsigned int cascadeCount;
+	float texelSize;								// 1 / shadow map resolution
+	float atlasTexelSize;							// 1 / shadow atlas size
+	float padding;
+};
+
+// One shadow atlas tile (PixelShader t9, indexed by Light::ShadowIndex - 1)
+struct ShadowTileShaderData
+{
+	DirectX::XMFLOAT4X4 viewProjection;
+	DirectX::XMFLOAT4 atlasRect;	// Scale xy and offset zw from tile to atlas UVs
+};
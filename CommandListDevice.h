@@ -0,0 +1,58 @@
+#pragma once
+
+#include <memory>
+#include "RenderBackend.h"
+
+// --------------------------------------------------------
+// Recorded commands, ready to be executed on the main thread.
+// Only the backend that made it knows what's inside.
+// --------------------------------------------------------
+class ICommandList
+{
+public:
+	virtual ~ICommandList() {}
+};
+
+// --------------------------------------------------------
+// Somewhere a pass can record into.
+//
+// Deferred contexts start every list from the default pipeline
+// state, and executing a list leaves the immediate context in
+// the default state too - so a pass must set up everything it
+// relies on (targets, viewport, layout, topology, ...) itself.
+// --------------------------------------------------------
+class IRecordingContext
+{
+public:
+	virtual ~IRecordingContext() {}
+
+	// Binds and draws for this context
+	virtual IRenderBackend& GetBackend() = 0;
+
+	// Closes the current recording.  Returns the list to execute,
+	// or nullptr for the immediate context (its commands already
+	// went to the GPU).
+	virtual std::unique_ptr<ICommandList> Finish() = 0;
+
+	// Hands back an executed list this context made, so the next
+	// Finish() can reuse it rather than allocate.  What it recorded
+	// is let go of now.
+	virtual void Recycle(std::unique_ptr<ICommandList> commandList) = 0;
+};
+
+// --------------------------------------------------------
+// Backend side of multithreaded recording
+// --------------------------------------------------------
+class ICommandListDevice
+{
+public:
+	virtual ~ICommandListDevice() {}
+
+	virtual IRecordingContext& GetImmediateContext() = 0;
+
+	// nullptr when the backend can't record off the main thread
+	virtual std::unique_ptr<IRecordingContext> CreateDeferredContext() = 0;
+
+	// Main thread only
+	virtual void Execute(ICommandList& commandList) = 0;
+};
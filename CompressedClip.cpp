@@ -0,0 +1,758 @@
+#include "CompressedClip.h"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
+
+using namespace DirectX;
+
+namespace
+{
+	const uint32_t ChannelCount = (uint32_t)AnimationChannel::Count;
+	const uint32_t Lanes = 4;
+
+	// Smallest-three: the three kept components of a unit quaternion
+	// are within this of zero once the largest is made positive
+	const float RotationRange = 0.70710678f;
+	const uint32_t MinRotationBits = 10;
+	const uint32_t MaxRotationBits = 15;		// 3 * 15 and the dropped index, 47 bits
+	const uint32_t MaxVectorBits = 16;
+
+	// Shares of a translation or scale track's bound its quantization
+	// may take, tried in turn - the rest is left for interpolation
+	const float QuantizationShares[] = { 0.05f, 0.1f, 0.2f, 0.3f, 0.4f, 0.55f, 0.7f, 0.85f };
+
+	// Keys are read 8 bytes at a time, wherever they start
+	const size_t StreamPadding = sizeof(uint64_t);
+
+	// Up to 57 bits from a bit onwards, least significant first -
+	// the order WriteBits() lays them down in on a little-endian CPU
+	uint64_t ReadBits(const uint8_t* stream, uint64_t bit, uint32_t count)
+	{
+		uint64_t word;
+		memcpy(&word, stream + (bit >> 3), sizeof(word));
+		return (word >> (bit & 7)) & ((1ull << count) - 1);
+	}
+
+	void WriteBits(std::vector<uint8_t>& stream, uint64_t& bit, uint64_t value, uint32_t count)
+	{
+		for (uint32_t i = 0; i < count; i++, bit++)
+		{
+			if ((bit >> 3) >= stream.size())
+				stream.push_back(0);
+			stream[bit >> 3] |= (uint8_t)(((value >> i) & 1) << (bit & 7));
+		}
+	}
+
+	// A segment's mask of which frames between its ends are keys,
+	// frame 1 in the lowest bit
+	uint64_t ReadMask(const uint8_t* stream, uint64_t bit, uint32_t count)
+	{
+		uint64_t mask = ReadBits(stream, bit, (std::min)(count, 32u));
+		if (count > 32)
+			mask |= ReadBits(stream, bit + 32, count - 32) << 32;
+		return mask;
+	}
+
+	float RotationStep(uint32_t bits)
+	{
+		return 2.0f * RotationRange / (float)((1u << bits) - 1);
+	}
+
+	// Three components of bits each, then the index of the dropped one
+	uint64_t EncodeRotation(FXMVECTOR quaternion, uint32_t bits)
+	{
+		XMFLOAT4 q;
+		XMStoreFloat4(&q, XMQuaternionNormalize(quaternion));
+		const float* components = &q.x;
+
+		uint32_t largest = 0;
+		for (uint32_t i = 1; i < 4; i++)
+		{
+			if (fabsf(components[i]) > fabsf(components[largest]))
+				largest = i;
+		}
+		float sign = components[largest] < 0.0f ? -1.0f : 1.0f;
+
+		long steps = (long)((1u << bits) - 1);
+		uint64_t key = 0;
+		uint32_t shift = 0;
+		for (uint32_t i = 0; i < 4; i++)
+		{
+			if (i == largest)
+				continue;
+			float normalized = (components[i] * sign + RotationRange) / (2.0f * RotationRange);
+			key |= (uint64_t)(std::min)((std::max)(lroundf(normalized * (float)steps), 0L), steps) << shift;
+			shift += bits;
+		}
+		return key | ((uint64_t)largest << shift);
+	}
+
+	// A key as SamplePose() rebuilds it, a lane at a time
+	XMVECTOR DecodeRotation(uint64_t key, uint32_t bits)
+	{
+		uint64_t mask = (1ull << bits) - 1;
+		float step = RotationStep(bits);
+		float kept[3];
+		for (uint32_t c = 0; c < 3; c++)
+			kept[c] = (float)((key >> (c * bits)) & mask) * step - RotationRange;
+		uint32_t largest = (uint32_t)(key >> (3 * bits));
+
+		float q[4];
+		float dropped = sqrtf((std::max)(0.0f, 1.0f - (kept[0] * kept[0] + kept[1] * kept[1] + kept[2] * kept[2])));
+		for (uint32_t i = 0, c = 0; i < 4; i++)
+			q[i] = i == largest ? dropped : kept[c++];
+		return XMVectorSet(q[0], q[1], q[2], q[3]);
+	}
+
+	// Both the compressor, judging what to keep, and the decoder
+	// interpolate with these, so the error measured is the error got
+	XMVECTOR InterpolateRotation(FXMVECTOR a, FXMVECTOR b, float alpha)
+	{
+		XMVECTOR closer = XMVectorSelect(b, XMVectorNegate(b), XMVectorLess(XMVector4Dot(a, b), XMVectorZero()));
+		return XMQuaternionNormalize(XMVectorLerp(a, closer, alpha));
+	}
+
+	float RotationError(FXMVECTOR a, FXMVECTOR b)
+	{
+		// The angle between, from the chord - accurate when it's tiny
+		XMVECTOR closer = XMVectorSelect(b, XMVectorNegate(b), XMVectorLess(XMVector4Dot(a, b), XMVectorZero()));
+		float chord = XMVectorGetX(XMVector4Length(XMVectorSubtract(a, closer)));
+		return 4.0f * asinf((std::min)(chord * 0.5f, 1.0f));
+	}
+
+	float VectorError(FXMVECTOR a, FXMVECTOR b)
+	{
+		XMFLOAT3 difference;
+		XMStoreFloat3(&difference, XMVectorAbs(XMVectorSubtract(a, b)));
+		return (std::max)((std::max)(difference.x, difference.y), difference.z);
+	}
+
+	// One way of packing an animated track, and what it comes to
+	struct TrackEncoding
+	{
+		uint8_t componentBits[3] = {};
+		uint32_t keyBits = 0;
+		XMFLOAT3 min = XMFLOAT3(0, 0, 0);		// Translations and scales only
+		XMFLOAT3 step = XMFLOAT3(0, 0, 0);
+		std::vector<uint64_t> keys;					// Every frame, quantized
+		std::vector<std::vector<uint8_t>> kept;		// Each segment's key frames, from its start
+		uint64_t bits = 0;							// Its share of every segment
+	};
+
+	// The frames of a segment worth keeping as keys: the ends first,
+	// then the worst frame between keys until none is off by more
+	// than the tolerance, then any key whose neighbours manage
+	// without it.  Halfway between frames counts too.  Returns the
+	// worst error halfway between neighbouring keys, which no key
+	// can help - the quantization has to leave room for how far the
+	// source bends within a frame.
+	float ReduceKeys(const XMFLOAT4* decoded, const XMFLOAT4* expected, const XMFLOAT4* halfway, uint32_t frames, bool rotation,
+		float tolerance, std::vector<uint8_t>& kept)
+	{
+		auto worstBetween = [&](uint32_t from, uint32_t to, uint32_t& worstFrame)
+		{
+			XMVECTOR a = XMLoadFloat4(&decoded[from]);
+			XMVECTOR b = XMLoadFloat4(&decoded[to]);
+			auto errorAt = [&](float at, const XMFLOAT4& expectedValue)
+			{
+				float alpha = (at - (float)from) / (float)(to - from);
+				XMVECTOR value = XMLoadFloat4(&expectedValue);
+				return rotation ? RotationError(InterpolateRotation(a, b, alpha), value) : VectorError(XMVectorLerp(a, b, alpha), value);
+			};
+
+			float worst = 0.0f;
+			for (uint32_t frame = from + 1; frame < to; frame++)
+			{
+				float error = (std::max)(errorAt((float)frame, expected[frame]), errorAt(frame - 0.5f, halfway[frame - 1]));
+				if (error > worst)
+				{
+					worst = error;
+					worstFrame = frame;
+				}
+			}
+			if (to - from > 1)
+			{
+				float error = errorAt(to - 0.5f, halfway[to - 1]);
+				if (error > worst)
+				{
+					worst = error;
+					worstFrame = to - 1;
+				}
+			}
+			return worst;
+		};
+
+		kept.assign({ (uint8_t)0, (uint8_t)(frames - 1) });
+		for (;;)
+		{
+			float worst = 0.0f;
+			uint32_t worstFrame = 0;
+			for (size_t k = 0; k + 1 < kept.size(); k++)
+			{
+				uint32_t frame = 0;
+				float error = worstBetween(kept[k], kept[k + 1], frame);
+				if (error > worst)
+				{
+					worst = error;
+					worstFrame = frame;
+				}
+			}
+			if (worst <= tolerance)
+				break;
+			kept.insert(std::upper_bound(kept.begin(), kept.end(), (uint8_t)worstFrame), (uint8_t)worstFrame);
+		}
+
+		for (size_t k = 1; k + 1 < kept.size();)
+		{
+			uint32_t frame = 0;
+			if (worstBetween(kept[k - 1], kept[k + 1], frame) <= tolerance)
+				kept.erase(kept.begin() + k);
+			else
+				k++;
+		}
+
+		float unsplit = 0.0f;
+		for (size_t k = 0; k + 1 < kept.size(); k++)
+		{
+			if (kept[k + 1] - kept[k] > 1)
+				continue;
+			XMVECTOR a = XMLoadFloat4(&decoded[kept[k]]);
+			XMVECTOR b = XMLoadFloat4(&decoded[kept[k + 1]]);
+			XMVECTOR value = XMLoadFloat4(&halfway[kept[k]]);
+			unsplit = (std::max)(unsplit, rotation ? RotationError(InterpolateRotation(a, b, 0.5f), value) : VectorError(XMVectorLerp(a, b, 0.5f), value));
+		}
+		return unsplit;
+	}
+
+	// Packs a track as rotations of bits a component, or translations
+	// or scales with share of the tolerance going to quantization,
+	// and reduces its keys.  False if the quantization leaves it
+	// outside the tolerance somewhere.
+	bool EncodeTrack(const XMFLOAT4* values, const XMFLOAT4* halfway, uint32_t frameCount, uint32_t segmentFrames, bool rotation,
+		float tolerance, uint32_t bits, float share, TrackEncoding& out)
+	{
+		std::vector<XMFLOAT4> decoded(frameCount);
+		out.keys.resize(frameCount);
+		float worst = 0.0f;
+		if (rotation)
+		{
+			for (uint8_t& componentBits : out.componentBits)
+				componentBits = (uint8_t)bits;
+			out.keyBits = 3 * bits + 2;
+			for (uint32_t frame = 0; frame < frameCount; frame++)
+			{
+				XMVECTOR value = XMLoadFloat4(&values[frame]);
+				out.keys[frame] = EncodeRotation(value, bits);
+				XMVECTOR key = DecodeRotation(out.keys[frame], bits);
+				XMStoreFloat4(&decoded[frame], key);
+				worst = (std::max)(worst, RotationError(key, value));
+			}
+		}
+		else
+		{
+			// Each component over its range, in as few bits as leave it
+			// within its share of the tolerance - none if the middle of
+			// the range is
+			XMFLOAT3 low(values[0].x, values[0].y, values[0].z);
+			XMFLOAT3 high = low;
+			for (uint32_t frame = 1; frame < frameCount; frame++)
+			{
+				XMStoreFloat3(&low, XMVectorMin(XMLoadFloat3(&low), XMLoadFloat4(&values[frame])));
+				XMStoreFloat3(&high, XMVectorMax(XMLoadFloat3(&high), XMLoadFloat4(&values[frame])));
+			}
+
+			out.keyBits = 0;
+			for (uint32_t c = 0; c < 3; c++)
+			{
+				float extent = (&high.x)[c] - (&low.x)[c];
+				float levels = ceilf(extent / (2.0f * share * tolerance)) + 1.0f;
+				uint32_t componentBits = 0;
+				while (componentBits < MaxVectorBits && (float)(1u << componentBits) < levels)
+					componentBits++;
+				out.componentBits[c] = (uint8_t)componentBits;
+				out.keyBits += componentBits;
+				(&out.min.x)[c] = componentBits ? (&low.x)[c] : (&low.x)[c] + extent * 0.5f;
+				(&out.step.x)[c] = componentBits ? extent / (float)((1u << componentBits) - 1) : 0.0f;
+			}
+
+			XMVECTOR min = XMLoadFloat3(&out.min);
+			XMVECTOR step = XMLoadFloat3(&out.step);
+			XMVECTOR toSteps = XMVectorSelect(XMVectorDivide(XMVectorSplatOne(), step), XMVectorZero(), XMVectorLessOrEqual(step, XMVectorZero()));
+			for (uint32_t frame = 0; frame < frameCount; frame++)
+			{
+				XMVECTOR value = XMLoadFloat4(&values[frame]);
+				XMFLOAT3 steps;
+				XMStoreFloat3(&steps, XMVectorRound(XMVectorMultiply(XMVectorSubtract(value, min), toSteps)));
+				uint64_t key = 0;
+				float quantized[3];
+				for (uint32_t c = 0, shift = 0; c < 3; shift += out.componentBits[c], c++)
+				{
+					uint32_t limit = (1u << out.componentBits[c]) - 1;
+					uint32_t q = (uint32_t)(std::min)((std::max)((&steps.x)[c], 0.0f), (float)limit);
+					key |= (uint64_t)q << shift;
+					quantized[c] = (float)q;
+				}
+				out.keys[frame] = key;
+				XMVECTOR decodedValue = XMVectorMultiplyAdd(XMVectorSet(quantized[0], quantized[1], quantized[2], 0.0f), step, min);
+				XMStoreFloat4(&decoded[frame], decodedValue);
+				worst = (std::max)(worst, VectorError(decodedValue, value));
+			}
+		}
+
+		uint32_t segmentCount = (frameCount - 2) / segmentFrames + 1;
+		out.kept.resize(segmentCount);
+		out.bits = 0;
+		for (uint32_t segment = 0; segment < segmentCount; segment++)
+		{
+			uint32_t firstFrame = segment * segmentFrames;
+			uint32_t frames = (std::min)(segmentFrames, frameCount - 1 - firstFrame) + 1;
+			float unsplit = ReduceKeys(&decoded[firstFrame], &values[firstFrame], &halfway[firstFrame], frames, rotation, tolerance, out.kept[segment]);
+			worst = (std::max)(worst, unsplit);
+			out.bits += (frames - 2) + out.kept[segment].size() * out.keyBits;
+		}
+		return worst <= tolerance;
+	}
+
+	typedef CompressedClipCursor::Batch KeyBatch;
+
+	XMVECTOR LoadLanes(const XMINT4& lanes)
+	{
+		return XMConvertVectorIntToFloat(XMLoadSInt4(&lanes), 0);
+	}
+
+	// How far each lane is from its first key to its second
+	XMVECTOR LaneAlphas(const KeyBatch& keys, float position)
+	{
+		XMVECTOR from = LoadLanes(keys.fromFrame);
+		XMVECTOR span = XMVectorSubtract(LoadLanes(keys.toFrame), from);
+		return XMVectorSaturate(XMVectorDivide(XMVectorSubtract(XMVectorReplicate(position), from), span));
+	}
+
+	// Four smallest-three keys back to quaternions, a component a row
+	void RebuildRotations(const XMINT4* kept, const XMINT4& largest, FXMVECTOR step, XMVECTOR q[4])
+	{
+		XMVECTOR range = XMVectorReplicate(RotationRange);
+		XMVECTOR k0 = XMVectorSubtract(XMVectorMultiply(LoadLanes(kept[0]), step), range);
+		XMVECTOR k1 = XMVectorSubtract(XMVectorMultiply(LoadLanes(kept[1]), step), range);
+		XMVECTOR k2 = XMVectorSubtract(XMVectorMultiply(LoadLanes(kept[2]), step), range);
+		XMVECTOR lengthSq = XMVectorAdd(XMVectorAdd(XMVectorMultiply(k0, k0), XMVectorMultiply(k1, k1)), XMVectorMultiply(k2, k2));
+		XMVECTOR dropped = XMVectorSqrt(XMVectorMax(XMVectorZero(), XMVectorSubtract(XMVectorSplatOne(), lengthSq)));
+
+		// The dropped component goes back where it came from, the kept
+		// ones either side of it
+		XMVECTOR index = XMLoadSInt4(&largest);
+		XMVECTOR isX = XMVectorEqualInt(index, XMVectorZero());
+		XMVECTOR isY = XMVectorEqualInt(index, XMVectorReplicateInt(1));
+		XMVECTOR isZ = XMVectorEqualInt(index, XMVectorReplicateInt(2));
+		XMVECTOR isW = XMVectorEqualInt(index, XMVectorReplicateInt(3));
+		q[0] = XMVectorSelect(k0, dropped, isX);
+		q[1] = XMVectorSelect(XMVectorSelect(k1, dropped, isY), k0, isX);
+		q[2] = XMVectorSelect(XMVectorSelect(k1, dropped, isZ), k2, isW);
+		q[3] = XMVectorSelect(k2, dropped, isW);
+	}
+
+	void DecodeRotations(const KeyBatch& keys, float position, JointPose* const* poses, uint32_t count)
+	{
+		XMVECTOR step = XMVectorDivide(XMVectorReplicate(2.0f * RotationRange), LoadLanes(keys.levels));
+		XMVECTOR a[4], b[4];
+		RebuildRotations(keys.from, keys.fromLargest, step, a);
+		RebuildRotations(keys.to, keys.toLargest, step, b);
+
+		// As InterpolateRotation(), four at a time
+		XMVECTOR dot = XMVectorZero();
+		for (uint32_t c = 0; c < 4; c++)
+			dot = XMVectorMultiplyAdd(a[c], b[c], dot);
+		XMVECTOR flip = XMVectorLess(dot, XMVectorZero());
+		XMVECTOR alpha = LaneAlphas(keys, position);
+		XMMATRIX q;
+		XMVECTOR lengthSq = XMVectorZero();
+		for (uint32_t c = 0; c < 4; c++)
+		{
+			XMVECTOR closer = XMVectorSelect(b[c], XMVectorNegate(b[c]), flip);
+			q.r[c] = XMVectorMultiplyAdd(XMVectorSubtract(closer, a[c]), alpha, a[c]);
+			lengthSq = XMVectorMultiplyAdd(q.r[c], q.r[c], lengthSq);
+		}
+		XMVECTOR scale = XMVectorDivide(XMVectorSplatOne(), XMVectorSqrt(lengthSq));
+		for (uint32_t c = 0; c < 4; c++)
+			q.r[c] = XMVectorMultiply(q.r[c], scale);
+
+		q = XMMatrixTranspose(q);
+		for (uint32_t lane = 0; lane < count; lane++)
+			XMStoreFloat4(&poses[lane]->rotation, q.r[lane]);
+	}
+
+	void DecodeVectors(const KeyBatch& keys, float position, const XMFLOAT4* range, bool translation, JointPose* const* poses, uint32_t count)
+	{
+		XMVECTOR alpha = LaneAlphas(keys, position);
+		XMMATRIX v;
+		for (uint32_t c = 0; c < 3; c++)
+		{
+			XMVECTOR min = XMLoadFloat4(&range[c]);
+			XMVECTOR step = XMLoadFloat4(&range[3 + c]);
+			XMVECTOR from = XMVectorMultiplyAdd(LoadLanes(keys.from[c]), step, min);
+			XMVECTOR to = XMVectorMultiplyAdd(LoadLanes(keys.to[c]), step, min);
+			v.r[c] = XMVectorMultiplyAdd(XMVectorSubtract(to, from), alpha, from);
+		}
+		v.r[3] = XMVectorZero();
+
+		v = XMMatrixTranspose(v);
+		for (uint32_t lane = 0; lane < count; lane++)
+			XMStoreFloat3(translation ? &poses[lane]->translation : &poses[lane]->scale, v.r[lane]);
+	}
+}
+
+bool CompressedClip::Compress(const Skeleton& skeleton, const AnimationClip* const* jointClips, const ClipCompressionSettings& settings)
+{
+	*this = CompressedClip();
+	uint32_t joints = skeleton.GetJointCount();
+	if (joints == 0 || !(settings.sampleRate > 0.0f) || settings.segmentFrames < 2 || settings.segmentFrames > MaxSegmentFrames)
+		return false;
+
+	bool loops = true;
+	bool foundClip = false;
+	float length = 0.0f;
+	for (uint32_t joint = 0; joint < joints; joint++)
+	{
+		if (!jointClips[joint])
+			continue;
+		length = (std::max)(length, jointClips[joint]->GetDuration());
+		if (!foundClip)
+			loops = jointClips[joint]->IsLooping();
+		foundClip = true;
+	}
+
+	jointCount = joints;
+	duration = length;
+	looping = loops;
+	segmentFrames = settings.segmentFrames;
+	frameCount = length > 0.0f ? (uint32_t)ceilf(length * settings.sampleRate - 1e-3f) + 1 : 1;
+	frameCount = (std::max)(frameCount, 2u);
+	frameRate = length > 0.0f ? (frameCount - 1) / length : 0.0f;
+	uint32_t segmentCount = (frameCount - 2) / segmentFrames + 1;
+
+	// Every frame of every track, and halfway to the next, each clip
+	// wrapped at its own duration - except that the last frame is a
+	// clip's end rather than its start again, as that's what the
+	// frames before it lead up to
+	std::vector<XMFLOAT4> samples((size_t)frameCount * joints * ChannelCount);
+	std::vector<XMFLOAT4> halfway(samples.size());
+	std::vector<AnimationCursor> cursors(joints);
+	const std::vector<JointPose>& bindPose = skeleton.GetBindPose();
+	for (uint32_t frame = 0; frame < frameCount; frame++)
+	{
+		for (uint32_t half = 0; half < 2 && frame + half < frameCount; half++)
+		{
+			bool last = frame == frameCount - 1;
+			float time = last ? length : (frameRate > 0.0f ? (frame + half * 0.5f) / frameRate : 0.0f);
+			std::vector<XMFLOAT4>& into = half ? halfway : samples;
+			for (uint32_t joint = 0; joint < joints; joint++)
+			{
+				JointPose pose = bindPose[joint];
+				const AnimationClip* clip = jointClips[joint];
+				if (clip)
+				{
+					float clipTime = clip->WrapTime(time);
+					if (last && clipTime <= 0.0f)
+						clipTime = clip->GetDuration();
+					clip->Sample(clipTime, cursors[joint], pose.translation, pose.rotation, pose.scale);
+				}
+
+				XMFLOAT4* track = &into[((size_t)joint * ChannelCount) * frameCount + frame];
+				track[(size_t)AnimationChannel::Position * frameCount] = XMFLOAT4(pose.translation.x, pose.translation.y, pose.translation.z, 0.0f);
+				track[(size_t)AnimationChannel::Rotation * frameCount] = pose.rotation;
+				track[(size_t)AnimationChannel::Scale * frameCount] = XMFLOAT4(pose.scale.x, pose.scale.y, pose.scale.z, 0.0f);
+			}
+		}
+	}
+
+	// Sort tracks into the bind pose, constant and animated, keeping
+	// rotations in one hemisphere frame to frame, and pack each
+	// animated one whichever way takes the fewest bits
+	const AnimationChannel channelOrder[] = { AnimationChannel::Rotation, AnimationChannel::Position, AnimationChannel::Scale };
+	std::vector<TrackEncoding> encodings;
+	std::vector<uint32_t> groupCounts;
+	for (AnimationChannel channel : channelOrder)
+	{
+		bool rotation = channel == AnimationChannel::Rotation;
+		float tolerance = rotation ? settings.rotationError :
+			channel == AnimationChannel::Position ? settings.translationError : settings.scaleError;
+		uint32_t animatedInGroup = 0;
+		for (uint32_t joint = 0; joint < joints; joint++)
+		{
+			uint32_t trackIndex = joint * ChannelCount + (uint32_t)channel;
+			XMFLOAT4* values = &samples[(size_t)trackIndex * frameCount];
+			XMFLOAT4* between = &halfway[(size_t)trackIndex * frameCount];
+			const JointPose& bind = bindPose[joint];
+			XMVECTOR bindValue = rotation ? XMLoadFloat4(&bind.rotation) :
+				XMLoadFloat3(channel == AnimationChannel::Position ? &bind.translation : &bind.scale);
+
+			float spread = 0.0f;
+			float fromBind = 0.0f;
+			for (uint32_t frame = 0; frame < frameCount; frame++)
+			{
+				XMVECTOR value = XMLoadFloat4(&values[frame]);
+				if (rotation && frame > 0 && XMVectorGetX(XMVector4Dot(value, XMLoadFloat4(&values[frame - 1]))) < 0.0f)
+					XMStoreFloat4(&values[frame], value = XMVectorNegate(value));
+
+				XMVECTOR first = XMLoadFloat4(&values[0]);
+				for (uint32_t half = 0; half < 2 && frame + half < frameCount; half++)
+				{
+					if (half)
+						value = XMLoadFloat4(&between[frame]);
+					spread = (std::max)(spread, rotation ? RotationError(value, first) : VectorError(value, first));
+					fromBind = (std::max)(fromBind, rotation ? RotationError(value, bindValue) : VectorError(value, bindValue));
+				}
+			}
+
+			if (fromBind <= tolerance)
+			{
+				stats.bindPoseTracks++;
+				continue;
+			}
+			if (spread <= tolerance)
+			{
+				constants.push_back({ trackIndex, values[0] });
+				stats.constantTracks++;
+				continue;
+			}
+
+			// Finest first, down until the quantization breaks the bound -
+			// the finest is kept regardless, for a track too big or
+			// bending too fast for even that
+			TrackEncoding best;
+			uint32_t candidates = rotation ? MaxRotationBits - MinRotationBits + 1 : (uint32_t)std::size(QuantizationShares);
+			for (uint32_t candidate = 0; candidate < candidates; candidate++)
+			{
+				TrackEncoding encoding;
+				bool fits = EncodeTrack(values, between, frameCount, segmentFrames, rotation, tolerance,
+					MaxRotationBits - candidate, QuantizationShares[rotation ? 0 : candidate], encoding);
+				if (candidate == 0 || (fits && encoding.bits < best.bits))
+					best = std::move(encoding);
+				if (!fits)
+					break;
+			}
+
+			Track track = { (uint16_t)joint, { best.componentBits[0], best.componentBits[1], best.componentBits[2] }, (uint8_t)best.keyBits };
+			tracks.push_back(track);
+			encodings.push_back(std::move(best));
+			animatedInGroup++;
+		}
+		groupCounts.push_back(animatedInGroup);
+	}
+	rotationTracks = groupCounts[0];
+	translationTracks = groupCounts[1];
+	stats.animatedTracks = (uint32_t)tracks.size();
+
+	// Translations' and scales' ranges, four tracks to a batch
+	for (uint32_t first = rotationTracks, group = 1; group < 3; first += groupCounts[group], group++)
+	{
+		for (uint32_t batch = 0; batch < groupCounts[group]; batch += Lanes)
+		{
+			XMFLOAT4 range[6] = {};
+			for (uint32_t lane = 0; lane < Lanes && batch + lane < groupCounts[group]; lane++)
+			{
+				const TrackEncoding& encoding = encodings[first + batch + lane];
+				for (uint32_t c = 0; c < 3; c++)
+				{
+					(&range[c].x)[lane] = (&encoding.min.x)[c];
+					(&range[3 + c].x)[lane] = (&encoding.step.x)[c];
+				}
+			}
+			vectorRanges.insert(vectorRanges.end(), range, range + 6);
+		}
+	}
+
+	// Each segment's bitstream, in the order SamplePose() walks it
+	for (uint32_t segment = 0; segment < segmentCount; segment++)
+	{
+		uint32_t firstFrame = segment * segmentFrames;
+		uint32_t frames = (std::min)(segmentFrames, frameCount - 1 - firstFrame) + 1;
+		size_t start = data.size();
+		segmentOffsets.push_back((uint32_t)start);
+
+		std::vector<uint8_t> stream;
+		uint64_t bit = 0;
+		for (const TrackEncoding& encoding : encodings)
+		{
+			const std::vector<uint8_t>& kept = encoding.kept[segment];
+			uint64_t mask = 0;
+			for (size_t k = 1; k + 1 < kept.size(); k++)
+				mask |= 1ull << (kept[k] - 1);
+			WriteBits(stream, bit, mask, frames - 2);
+
+			stats.sampledKeys += frames;
+			stats.keys += kept.size();
+		}
+		for (const TrackEncoding& encoding : encodings)
+		{
+			for (uint8_t frame : encoding.kept[segment])
+				WriteBits(stream, bit, encoding.keys[firstFrame + frame], encoding.keyBits);
+		}
+		data.insert(data.end(), stream.begin(), stream.end());
+		stats.largestSegmentBytes = (std::max)(stats.largestSegmentBytes, data.size() - start);
+	}
+	segmentOffsets.push_back((uint32_t)data.size());
+	data.resize(data.size() + StreamPadding, 0);
+
+	stats.frames = frameCount;
+	stats.segments = segmentCount;
+	stats.bytes = sizeof(*this) + tracks.size() * sizeof(Track) + constants.size() * sizeof(Constant) +
+		vectorRanges.size() * sizeof(XMFLOAT4) + segmentOffsets.size() * sizeof(uint32_t) + data.size();
+	return true;
+}
+
+float CompressedClip::WrapTime(float time) const
+{
+	if (duration <= 0.0f)
+		return 0.0f;
+	if (!looping)
+		return (std::min)((std::max)(time, 0.0f), duration);
+
+	float wrapped = fmodf(time, duration);
+	return wrapped < 0.0f ? wrapped + duration : wrapped;
+}
+
+void CompressedClip::SamplePose(float time, const Skeleton& skeleton, CompressedClipCursor& cursor, JointPose* localPoses) const
+{
+	if (jointCount == 0)
+		return;
+
+	std::copy_n(skeleton.GetBindPose().data(), jointCount, localPoses);
+	for (const Constant& constant : constants)
+	{
+		JointPose& pose = localPoses[constant.track / ChannelCount];
+		switch ((AnimationChannel)(constant.track % ChannelCount))
+		{
+		case AnimationChannel::Position: pose.translation = XMFLOAT3(constant.value.x, constant.value.y, constant.value.z); break;
+		case AnimationChannel::Rotation: pose.rotation = constant.value; break;
+		default: pose.scale = XMFLOAT3(constant.value.x, constant.value.y, constant.value.z); break;
+		}
+	}
+
+	// The segment holding time, and how far into it in frames
+	float position = WrapTime(time) * frameRate;
+	uint32_t segment = (std::min)((uint32_t)(position / segmentFrames), (uint32_t)segmentOffsets.size() - 2);
+	uint32_t firstFrame = segment * segmentFrames;
+	uint32_t frames = (std::min)(segmentFrames, frameCount - 1 - firstFrame) + 1;
+	float local = (std::min)(position - (float)firstFrame, (float)(frames - 1));
+	uint32_t baseFrame = (std::min)((uint32_t)local, frames - 2);
+	uint64_t below = (1ull << baseFrame) - 1;		// Mask bits of the frames up to baseFrame
+	position = (float)firstFrame + local;
+
+	// Every track's mask, then every track's keys.  Where each
+	// track's keys start is worked out once a segment.
+	const uint8_t* stream = data.data() + segmentOffsets[segment];
+	uint32_t maskBits = frames - 2;
+	if (cursor.segment != segment)
+	{
+		cursor.segment = segment;
+		cursor.keyOffsets.resize(tracks.size());
+		uint64_t bit = (uint64_t)tracks.size() * maskBits;
+		for (size_t t = 0; t < tracks.size(); t++)
+		{
+			cursor.keyOffsets[t] = (uint32_t)bit;
+			bit += (uint64_t)(std::popcount(ReadMask(stream, t * maskBits, maskBits)) + 2) * tracks[t].keyBits;
+		}
+	}
+
+	const uint32_t groupCounts[3] = { rotationTracks, translationTracks, (uint32_t)tracks.size() - rotationTracks - translationTracks };
+	size_t batchCount = 0;
+	for (uint32_t count : groupCounts)
+		batchCount += (count + Lanes - 1) / Lanes;
+	if (cursor.batches.size() != batchCount)
+	{
+		// Nothing decoded yet: every lane's keys straddle no time at
+		// all, and lanes past the last track any time
+		KeyBatch empty = {};
+		empty.levels = XMINT4(1, 1, 1, 1);
+		empty.fromFrame = XMINT4(1, 1, 1, 1);
+		cursor.batches.assign(batchCount, empty);
+		for (uint32_t group = 0, batch = 0; group < 3; batch += (groupCounts[group] + Lanes - 1) / Lanes, group++)
+		{
+			if (groupCounts[group] % Lanes == 0)
+				continue;
+			KeyBatch& last = cursor.batches[batch + groupCounts[group] / Lanes];
+			for (uint32_t lane = groupCounts[group] % Lanes; lane < Lanes; lane++)
+			{
+				(&last.fromFrame.x)[lane] = 0;
+				(&last.toFrame.x)[lane] = (int32_t)frameCount;
+			}
+		}
+	}
+
+	uint32_t t = 0;
+	const XMFLOAT4* range = vectorRanges.data();
+	KeyBatch* keys = cursor.batches.data();
+	int32_t at = (int32_t)(firstFrame + baseFrame);
+	for (uint32_t group = 0; group < 3; group++)
+	{
+		bool rotation = group == 0;
+		for (uint32_t batch = 0; batch < groupCounts[group]; batch += Lanes, keys++)
+		{
+			uint32_t count = (std::min)(Lanes, groupCounts[group] - batch);
+			JointPose* poses[Lanes];
+			for (uint32_t lane = 0; lane < count; lane++, t++)
+			{
+				const Track& track = tracks[t];
+				poses[lane] = &localPoses[track.joint];
+				if ((&keys->fromFrame.x)[lane] <= at && (&keys->toFrame.x)[lane] > at)
+					continue;
+
+				// The keys either side of local: the last set bit at or
+				// below baseFrame, and the first above
+				uint64_t mask = ReadMask(stream, (uint64_t)t * maskBits, maskBits);
+				uint64_t before = mask & below;
+				uint64_t after = mask >> baseFrame;
+				uint32_t key = (uint32_t)std::popcount(before);
+				uint32_t from = before ? 64 - (uint32_t)std::countl_zero(before) : 0;
+				uint32_t to = after ? baseFrame + 1 + (uint32_t)std::countr_zero(after) : frames - 1;
+				(&keys->fromFrame.x)[lane] = (int32_t)(firstFrame + from);
+				(&keys->toFrame.x)[lane] = (int32_t)(firstFrame + to);
+
+				uint64_t keyBit = cursor.keyOffsets[t] + (uint64_t)key * track.keyBits;
+				uint64_t fromKey = ReadBits(stream, keyBit, track.keyBits);
+				uint64_t toKey = ReadBits(stream, keyBit + track.keyBits, track.keyBits);
+				uint32_t shift = 0;
+				for (uint32_t c = 0; c < 3; c++)
+				{
+					uint64_t componentMask = (1ull << track.componentBits[c]) - 1;
+					(&keys->from[c].x)[lane] = (int32_t)((fromKey >> shift) & componentMask);
+					(&keys->to[c].x)[lane] = (int32_t)((toKey >> shift) & componentMask);
+					shift += track.componentBits[c];
+				}
+				if (rotation)
+				{
+					(&keys->fromLargest.x)[lane] = (int32_t)(fromKey >> shift);
+					(&keys->toLargest.x)[lane] = (int32_t)(toKey >> shift);
+					(&keys->levels.x)[lane] = (int32_t)((1u << track.componentBits[0]) - 1);
+				}
+			}
+
+			if (rotation)
+				DecodeRotations(*keys, position, poses, count);
+			else
+			{
+				DecodeVectors(*keys, position, range, group == 1, poses, count);
+				range += 6;
+			}
+		}
+	}
+}
+
+size_t CompressedClip::GetSourceBytes(const AnimationClip* const* jointClips, uint32_t jointCount)
+{
+	size_t bytes = 0;
+	for (uint32_t joint = 0; joint < jointCount; joint++)
+	{
+		if (!jointClips[joint])
+			continue;
+		for (uint32_t channel = 0; channel < ChannelCount; channel++)
+		{
+			const AnimationCurve& curve = jointClips[joint]->GetCurve((AnimationChannel)channel);
+			uint32_t width = AnimationClip::GetChannelWidth((AnimationChannel)channel);
+			bytes += curve.times.size() * sizeof(float) + (curve.values.size() + curve.tangents.size()) * width * sizeof(float);
+		}
+	}
+	return bytes;
+}
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <cstdint>
+#include <vector>
+#include "AnimationClip.h"
+#include "Skeleton.h"
+
+// How far a compressed clip may stray from its source
+struct ClipCompressionSettings
+{
+	float sampleRate = 30.0f;			// Frames a second the source is sampled at
+	uint32_t segmentFrames = 16;		// Frames a segment spans, at most 64
+	float rotationError = 0.0005f;		// Radians
+	float translationError = 0.0005f;	// Model units, per component
+	float scaleError = 0.0005f;			// Per component
+};
+
+struct ClipCompressionStats
+{
+	uint32_t frames = 0;
+	uint32_t segments = 0;
+	uint32_t bindPoseTracks = 0;		// Within bounds of the bind pose throughout, so not stored
+	uint32_t constantTracks = 0;		// Stored once, as floats
+	uint32_t animatedTracks = 0;
+	uint64_t sampledKeys = 0;			// Animated tracks' keys before reduction, segment ends counted in each
+	uint64_t keys = 0;					// and after
+	size_t bytes = 0;					// Everything the clip holds
+	size_t largestSegmentBytes = 0;		// The most one SamplePose() reads
+};
+
+// Where one playback of a CompressedClip last was: each track's
+// keys either side of that time, still quantized, and where the
+// segment's tracks start.  Playing on decodes only the tracks that
+// have passed a key.  A cursor follows one clip - start a new one
+// if the clip is compressed again.
+struct CompressedClipCursor
+{
+	// Four tracks' keys, a row per component, frames from the clip's start
+	struct Batch
+	{
+		DirectX::XMINT4 from[3];
+		DirectX::XMINT4 to[3];
+		DirectX::XMINT4 fromLargest;	// Rotations' dropped components
+		DirectX::XMINT4 toLargest;
+		DirectX::XMINT4 levels;			// Rotations' highest quantized value
+		DirectX::XMINT4 fromFrame;
+		DirectX::XMINT4 toFrame;
+	};
+
+	uint32_t segment = UINT32_MAX;		// The segment keyOffsets are for
+	std::vector<uint32_t> keyOffsets;	// Each track's first key in its bitstream
+	std::vector<Batch> batches;
+};
+
+// --------------------------------------------------------
+// A skeleton's clips - one per joint, as Skeleton::SamplePose()
+// takes them - sampled into a compact clip that decodes to the
+// same local poses, within set error bounds.
+//
+// Each joint has a rotation, translation and scale track.  A
+// track that stays within its bound of the bind pose the whole
+// clip isn't stored at all, and one within its bound of some
+// other value is kept once as floats.  The rest are animated,
+// each quantized as coarsely as its bound allows:
+//  - rotations smallest-three, the largest component dropped and
+//    the other three in 10 to 15 bits each, 48 bits a key at most
+//  - translations and scales in 0 to 16 bits a component, across
+//    the range the track covers over the clip
+// and cut into segments of segmentFrames frames, keeping only
+// the keys linear interpolation can't do without: the frame
+// furthest off is added until every frame is within bounds, then
+// keys that turn out not to be needed are dropped.  Each track's
+// bit rate is whichever leaves the fewest bits once its keys are
+// reduced, finer keys often needing fewer of them.
+//
+// A segment is one contiguous bitstream, track after track:
+// which frames between the segment's ends are keys, as a mask,
+// then the keys.  The ends of a segment are keys of its own, so a
+// pose at any time reads the clip's small track tables and walks
+// one segment.  Tracks are ordered rotations, then translations,
+// then scales, and decoded four at a time - the bits unpacked a
+// track at a time, then dequantized, rebuilt and interpolated
+// with the four in vector lanes.
+// --------------------------------------------------------
+class CompressedClip
+{
+public:
+	// Replaces the clip with jointClips compressed - null for a joint
+	// that holds its bind pose.  The duration is the longest clip's,
+	// and the clip loops if the first one does.  False, and the clip
+	// left empty, if there's no skeleton or the settings are unusable.
+	bool Compress(const Skeleton& skeleton, const AnimationClip* const* jointClips, const ClipCompressionSettings& settings);
+
+	// A playback time as a time in the clip, as AnimationClip::WrapTime()
+	float WrapTime(float time) const;
+
+	// Every joint's local pose at a playback time, wrapped, carrying
+	// on from where the cursor was.  The skeleton is the one
+	// compressed for, whose bind pose fills in the tracks that
+	// weren't stored.
+	void SamplePose(float time, const Skeleton& skeleton, CompressedClipCursor& cursor, JointPose* localPoses) const;
+
+	bool IsEmpty() const { return jointCount == 0; }
+	uint32_t GetJointCount() const { return jointCount; }
+	float GetDuration() const { return duration; }
+	bool IsLooping() const { return looping; }
+	const ClipCompressionStats& GetStats() const { return stats; }
+
+	// The bytes jointClips' keys take as floats - times, values and
+	// tangents - for comparing against
+	static size_t GetSourceBytes(const AnimationClip* const* jointClips, uint32_t jointCount);
+
+	static constexpr uint32_t MaxSegmentFrames = 64;
+
+private:
+	// An animated track: its joint and how its keys are packed - the
+	// bits of each component, and of the whole key
+	struct Track
+	{
+		uint16_t joint;
+		uint8_t componentBits[3];
+		uint8_t keyBits;
+	};
+
+	// A constant track: joint * 3 + channel, and its value
+	struct Constant
+	{
+		uint32_t track;
+		DirectX::XMFLOAT4 value;
+	};
+
+	std::vector<Track> tracks;					// Rotations, then translations, then scales
+	std::vector<Constant> constants;
+
+	// Four translation or scale tracks' ranges at a time, as their
+	// lanes are decoded: min x, y, z, then step x, y, z
+	std::vector<DirectX::XMFLOAT4> vectorRanges;
+
+	std::vector<uint32_t> segmentOffsets;		// Into data, plus one for the end
+	std::vector<uint8_t> data;					// Padded so a read of 8 bytes never runs off the end
+
+	uint32_t jointCount = 0;
+	uint32_t rotationTracks = 0;
+	uint32_t translationTracks = 0;
+	uint32_t frameCount = 0;
+	uint32_t segmentFrames = 0;
+	float frameRate = 0.0f;			// Frames a second, adjusted so the last lands on the duration
+	float duration = 0.0f;
+	bool looping = true;
+	ClipCompressionStats stats;
+};
@@ -0,0 +1,318 @@
+#include "CompressedClipTests.h"
+#include "HeadlessTests.h"
+#include "AnimationClip.h"
+#include "Skeleton.h"
+#include "CompressedClip.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+	// A clip per joint of skeleton, duration long, looping: each
+	// joint turns through a few periods of smooth wobble about its
+	// bind pose, at most a couple of radians a second, keyed every
+	// one to four frames at 30 a second.
+	// Some joints also move (Hermite) or scale, every seventh has
+	// no clip, and every fifth loops four times over the duration.
+	std::vector<AnimationClip> CreateCompressionClips(std::mt19937& random, const Skeleton& skeleton, float duration)
+	{
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		const float frame = 1.0f / 30.0f;
+		std::vector<AnimationClip> clips(skeleton.GetJointCount());
+		for (uint32_t joint = 0; joint < skeleton.GetJointCount(); joint++)
+		{
+			if (joint % 7 == 6)
+				continue;
+
+			const JointPose& bind = skeleton.GetBindPose()[joint];
+			float period = joint % 5 == 0 ? duration / 4.0f : duration;
+			int frames = (int)lroundf(period / frame);
+			float amplitude[3] = { unit(random) * 0.8f, unit(random) * 0.8f, unit(random) * 0.8f };
+			float phase[3] = { unit(random) * XM_2PI, unit(random) * XM_2PI, unit(random) * XM_2PI };
+			float cycles[3] = { 1.0f, 1.0f, 1.0f };
+			if (period == duration)
+			{
+				for (float& c : cycles)
+					c = (float)(1 + random() % 4);
+			}
+			auto wobble = [&](float time, int c) { return amplitude[c] * sinf(XM_2PI * cycles[c] * time / period + phase[c]); };
+
+			AnimationClip& clip = clips[joint];
+			AnimationCurve& rotation = clip.GetCurve(AnimationChannel::Rotation);
+			for (int f = 0; f <= frames; f += (std::min)(1 + (int)(random() % 4), (std::max)(frames - f, 1)))
+			{
+				float time = f == frames ? period : f * frame;
+				XMFLOAT4 q;
+				XMStoreFloat4(&q, XMQuaternionMultiply(XMQuaternionRotationRollPitchYaw(wobble(time, 0), wobble(time, 1), wobble(time, 2)),
+					XMLoadFloat4(&bind.rotation)));
+				rotation.times.push_back(time);
+				rotation.values.push_back(q);
+			}
+
+			if (joint % 4 == 0)
+			{
+				AnimationCurve& position = clip.GetCurve(AnimationChannel::Position);
+				position.interpolation = CurveInterpolation::Hermite;
+				for (int f = 0; f <= frames; f += 15)
+				{
+					float time = f * frame;
+					float angle = XM_2PI * time / period;
+					position.times.push_back(time);
+					position.values.push_back(XMFLOAT4(bind.translation.x + 0.3f * sinf(angle), bind.translation.y + 0.1f * sinf(2.0f * angle),
+						bind.translation.z, 0.0f));
+					position.tangents.push_back(XMFLOAT4(0.3f * cosf(angle) * XM_2PI / period, 0.2f * cosf(2.0f * angle) * XM_2PI / period, 0.0f, 0.0f));
+				}
+			}
+
+			if (joint % 9 == 0)
+			{
+				AnimationCurve& scale = clip.GetCurve(AnimationChannel::Scale);
+				for (int f = 0; f <= frames; f += 15)
+				{
+					float time = f * frame;
+					float s = 1.0f + 0.2f * sinf(XM_2PI * time / period);
+					scale.times.push_back(time);
+					scale.values.push_back(XMFLOAT4(s * bind.scale.x, s * bind.scale.y, bind.scale.z, 0.0f));
+				}
+			}
+			else if (joint % 9 == 1)
+			{
+				// Keyed, but never changing
+				AnimationCurve& scale = clip.GetCurve(AnimationChannel::Scale);
+				scale.times = { 0.0f, period };
+				scale.values = { XMFLOAT4(bind.scale.x, bind.scale.y, bind.scale.z, 0), XMFLOAT4(bind.scale.x, bind.scale.y, bind.scale.z, 0) };
+			}
+			clip.Finalize();
+		}
+		return clips;
+	}
+
+	// The worst rotation, translation and scale difference over
+	// every joint of two poses
+	XMFLOAT3 PoseDifference(const JointPose* a, const JointPose* b, uint32_t jointCount)
+	{
+		XMFLOAT3 worst(0, 0, 0);
+		for (uint32_t joint = 0; joint < jointCount; joint++)
+		{
+			worst.x = (std::max)(worst.x, QuaternionAngle(XMLoadFloat4(&a[joint].rotation), XMLoadFloat4(&b[joint].rotation)));
+			worst.y = (std::max)(worst.y, MaxDifference(a[joint].translation, b[joint].translation));
+			worst.z = (std::max)(worst.z, MaxDifference(a[joint].scale, b[joint].scale));
+		}
+		return worst;
+	}
+
+	XMFLOAT3 MaxOf(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		return XMFLOAT3((std::max)(a.x, b.x), (std::max)(a.y, b.y), (std::max)(a.z, b.z));
+	}
+}
+
+int RunClipCompressionBench(const ClipCompressionBenchSettings& settings)
+{
+	printf("Clip compression bench: %d joints, %.1f seconds, %d decodes\n", settings.jointCount, settings.duration, settings.decodes);
+	int failures = 0;
+	char detail[256];
+
+	std::mt19937 random(2718);
+	Skeleton skeleton = CreateRandomSkeleton(random, (uint32_t)settings.jointCount, true);
+	std::vector<AnimationClip> clips = CreateCompressionClips(random, skeleton, settings.duration);
+	std::vector<const AnimationClip*> jointClips(clips.size());
+	for (size_t joint = 0; joint < clips.size(); joint++)
+		jointClips[joint] = clips[joint].GetDuration() > 0.0f ? &clips[joint] : nullptr;
+
+	uint32_t jointCount = skeleton.GetJointCount();
+	std::vector<AnimationCursor> cursors(jointCount);
+	std::vector<JointPose> expected(jointCount);
+	std::vector<JointPose> decoded(jointCount);
+
+	ClipCompressionSettings compression;
+	compression.segmentFrames = (uint32_t)settings.segmentFrames;
+	CompressedClip compressed;
+	CompressedClipCursor playing;
+	bool compressedOk = compressed.Compress(skeleton, jointClips.data(), compression);
+	const ClipCompressionStats& stats = compressed.GetStats();
+
+	// At every frame sampled, and at random times between, against
+	// the uncompressed clips
+	{
+		XMFLOAT3 atFrames(0, 0, 0);
+		for (uint32_t frame = 0; frame + 1 < stats.frames; frame++)
+		{
+			float time = frame / compression.sampleRate;
+			skeleton.SamplePose(jointClips.data(), time, cursors.data(), expected.data());
+			compressed.SamplePose(time, skeleton, playing, decoded.data());
+			atFrames = MaxOf(atFrames, PoseDifference(expected.data(), decoded.data(), jointCount));
+		}
+		snprintf(detail, sizeof(detail), "%.1e radians, %.1e translation, %.1e scale, bounds %.0e", atFrames.x, atFrames.y, atFrames.z,
+			compression.rotationError);
+		failures += ReportCheck("every frame is within the error bounds", compressedOk &&
+			atFrames.x <= compression.rotationError * 1.01f && atFrames.y <= compression.translationError * 1.01f &&
+			atFrames.z <= compression.scaleError * 1.01f, detail);
+
+		// Between frames too: keys are reduced against the source
+		// halfway between frames as well as at them, so the bounds
+		// hold there as long as the source doesn't bend sharply within
+		// a frame.  A cursor jumping about has to decode what a new
+		// one would.
+		XMFLOAT3 between(0, 0, 0);
+		uint32_t stale = 0;
+		std::vector<JointPose> fresh(jointCount);
+		std::uniform_real_distribution<float> anyTime(0.0f, settings.duration);
+		for (int i = 0; i < 5000; i++)
+		{
+			float time = anyTime(random);
+			skeleton.SamplePose(jointClips.data(), time, cursors.data(), expected.data());
+			compressed.SamplePose(time, skeleton, playing, decoded.data());
+			between = MaxOf(between, PoseDifference(expected.data(), decoded.data(), jointCount));
+
+			CompressedClipCursor first;
+			compressed.SamplePose(time, skeleton, first, fresh.data());
+			stale += memcmp(fresh.data(), decoded.data(), jointCount * sizeof(JointPose)) != 0;
+		}
+		snprintf(detail, sizeof(detail), "%.2e radians, %.2e translation, %.2e scale", between.x, between.y, between.z);
+		failures += ReportCheck("times between frames are within bounds", between.x <= compression.rotationError * 1.01f &&
+			between.y <= compression.translationError * 1.01f && between.z <= compression.scaleError * 1.01f, detail);
+		snprintf(detail, sizeof(detail), "%u of 5000 poses differ", stale);
+		failures += ReportCheck("a cursor decodes what a new one would", stale == 0, detail);
+	}
+
+	// Joints without a clip, and channels without a curve, come back
+	// exactly as the bind pose
+	{
+		compressed.SamplePose(settings.duration * 0.37f, skeleton, playing, decoded.data());
+		uint32_t differing = 0, held = 0;
+		for (uint32_t joint = 0; joint < jointCount; joint++)
+		{
+			const JointPose& bind = skeleton.GetBindPose()[joint];
+			bool noClip = jointClips[joint] == nullptr;
+			if (noClip || jointClips[joint]->GetCurve(AnimationChannel::Position).IsEmpty())
+			{
+				held++;
+				differing += memcmp(&decoded[joint].translation, &bind.translation, sizeof(XMFLOAT3)) != 0;
+			}
+			if (noClip)
+			{
+				held++;
+				differing += memcmp(&decoded[joint].rotation, &bind.rotation, sizeof(XMFLOAT4)) != 0;
+				differing += memcmp(&decoded[joint].scale, &bind.scale, sizeof(XMFLOAT3)) != 0;
+			}
+		}
+		snprintf(detail, sizeof(detail), "%u of %u held channels differ", differing, held);
+		failures += ReportCheck("unanimated channels keep the bind pose", differing == 0, detail);
+	}
+
+	// Past the end it wraps, like the clips it came from
+	{
+		float worst = 0.0f;
+		for (int i = 0; i < 50; i++)
+		{
+			float time = settings.duration * (i + 0.5f) / 50.0f;
+			std::vector<JointPose> wrapped(jointCount);
+			compressed.SamplePose(time, skeleton, playing, decoded.data());
+			compressed.SamplePose(time + 2.0f * settings.duration, skeleton, playing, wrapped.data());
+			XMFLOAT3 difference = PoseDifference(decoded.data(), wrapped.data(), jointCount);
+			worst = (std::max)(worst, (std::max)(difference.x, (std::max)(difference.y, difference.z)));
+		}
+		snprintf(detail, sizeof(detail), "off by %.1e at worst", worst);
+		failures += ReportCheck("playback wraps at the end", compressed.IsLooping() && worst < 1e-3f, detail);
+	}
+
+	// A straight line needs only each segment's ends, and settings
+	// it can't work with are refused
+	{
+		Skeleton single;
+		single.AddJoint(Skeleton::NoParent, JointPose());
+		AnimationClip line;
+		AnimationCurve& position = line.GetCurve(AnimationChannel::Position);
+		position.times = { 0.0f, 4.0f };
+		position.values = { XMFLOAT4(0, 0, 0, 0), XMFLOAT4(2, -1, 3, 0) };
+		line.Finalize();
+		const AnimationClip* lineClip = &line;
+
+		CompressedClip straight;
+		straight.Compress(single, &lineClip, compression);
+		const ClipCompressionStats& lineStats = straight.GetStats();
+
+		ClipCompressionSettings broken = compression;
+		broken.segmentFrames = CompressedClip::MaxSegmentFrames + 1;
+		CompressedClip refused;
+		bool refusedAll = !refused.Compress(single, &lineClip, broken) && refused.IsEmpty() &&
+			!refused.Compress(Skeleton(), &lineClip, compression);
+		snprintf(detail, sizeof(detail), "%llu keys in %u segments, %u bind pose tracks, bad settings %s",
+			(unsigned long long)lineStats.keys, lineStats.segments, lineStats.bindPoseTracks, refusedAll ? "refused" : "accepted");
+		failures += ReportCheck("key reduction and settings", lineStats.animatedTracks == 1 && lineStats.bindPoseTracks == 2 &&
+			lineStats.keys == 2ull * lineStats.segments && refusedAll, detail);
+	}
+
+	// Size against the source keys and against every frame raw
+	size_t sourceBytes = CompressedClip::GetSourceBytes(jointClips.data(), jointCount);
+	size_t rawBytes = (size_t)stats.frames * jointCount * 10 * sizeof(float);
+	printf("\n  %u joints, %u frames in %u segments of %d: %u bind pose tracks, %u constant, %u animated keeping %llu of %llu keys\n",
+		jointCount, stats.frames, stats.segments, settings.segmentFrames, stats.bindPoseTracks, stats.constantTracks, stats.animatedTracks,
+		(unsigned long long)stats.keys, (unsigned long long)stats.sampledKeys);
+	printf("  %.1f KB compressed, %.1f bits a key with the key masks, %.2f : 1 against the source clips' float keys (%.1f KB), %.2f : 1 against raw frames (%.1f KB)\n",
+		stats.bytes / 1024.0, (double)(stats.largestSegmentBytes ? stats.bytes * 8.0 / (std::max)(stats.keys, (uint64_t)1) : 0.0),
+		(double)sourceBytes / stats.bytes, sourceBytes / 1024.0, (double)rawBytes / stats.bytes, rawBytes / 1024.0);
+	printf("  a pose reads %.1f KB at most (the largest segment)\n", stats.largestSegmentBytes / 1024.0);
+	failures += ReportCheck("smaller than the raw frames", (double)rawBytes / stats.bytes >= 4.0, "");
+
+	// Decode cost: playing forward at 60 frames a second, and at
+	// random times, against sampling the source clips
+	{
+		int decodes = (std::max)(settings.decodes, 1);
+		std::vector<float> randomTimes(decodes);
+		std::uniform_real_distribution<float> anyTime(0.0f, settings.duration);
+		for (float& time : randomTimes)
+			time = anyTime(random);
+
+		double perJoint = 1e6 / ((double)decodes * jointCount);
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < decodes; i++)
+			skeleton.SamplePose(jointClips.data(), i / 60.0f, cursors.data(), expected.data());
+		double sourceForward = Milliseconds(std::chrono::high_resolution_clock::now() - start);
+
+		CompressedClipCursor forward;
+		start = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < decodes; i++)
+			compressed.SamplePose(i / 60.0f, skeleton, forward, decoded.data());
+		double compressedForward = Milliseconds(std::chrono::high_resolution_clock::now() - start);
+
+		start = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < decodes; i++)
+			skeleton.SamplePose(jointClips.data(), randomTimes[i], cursors.data(), expected.data());
+		double sourceRandom = Milliseconds(std::chrono::high_resolution_clock::now() - start);
+
+		CompressedClipCursor jumping;
+		start = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < decodes; i++)
+			compressed.SamplePose(randomTimes[i], skeleton, jumping, decoded.data());
+		double compressedRandom = Milliseconds(std::chrono::high_resolution_clock::now() - start);
+
+		printf("\n  %-28s %10s %10s\n", "ns a joint", "forward", "random");
+		printf("  %-28s %10.1f %10.1f\n", "source clips", sourceForward * perJoint, sourceRandom * perJoint);
+		printf("  %-28s %10.1f %10.1f\n", "compressed", compressedForward * perJoint, compressedRandom * perJoint);
+	}
+
+	// How segment length trades size against what a pose reads
+	printf("\n  %-10s %10s %10s %14s %12s\n", "segment", "KB", "ratio", "max segment", "keys kept");
+	for (uint32_t frames : { 8u, 16u, 32u, 64u })
+	{
+		ClipCompressionSettings sweep = compression;
+		sweep.segmentFrames = frames;
+		CompressedClip clip;
+		clip.Compress(skeleton, jointClips.data(), sweep);
+		const ClipCompressionStats& sweepStats = clip.GetStats();
+		printf("  %-10u %10.1f %10.2f %11.1f KB %11.1f%%\n", frames, sweepStats.bytes / 1024.0, (double)rawBytes / sweepStats.bytes,
+			sweepStats.largestSegmentBytes / 1024.0, 100.0 * sweepStats.keys / (std::max)(sweepStats.sampledKeys, (uint64_t)1));
+	}
+
+	return ReportFailures(failures);
+}
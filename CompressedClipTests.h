@@ -0,0 +1,36 @@
+#pragma once
+
+// --------------------------------------------------------
+// Headless CPU benchmark and checks of animation clip
+// compression - no GPU.
+//
+// A random skeleton of jointCount joints with a clip each (some
+// none), smoothly turning, some moving and scaling, compressed
+// with segments of segmentFrames frames.  Prints how many tracks
+// were left to the bind pose, the compressed size against the
+// source keys and against raw frames, what a pose reads, and the
+// cost a joint of decoding poses forward and at random times next
+// to sampling the source clips, each with a cursor, then how
+// segment length trades these off.
+//
+// Checks:
+//  - every sampled frame is within the error bounds of the
+//    uncompressed clips, and so are times between frames
+//  - a cursor reused at random times decodes what a new one would
+//  - unanimated channels decode to exactly the bind pose
+//  - playback wraps past the end
+//  - a straight line keeps only its segments' ends, and
+//    unusable settings are refused
+//  - the clip is at least four times smaller than raw frames
+//
+// Returns 0 if all checks passed.
+// --------------------------------------------------------
+struct ClipCompressionBenchSettings
+{
+	int jointCount = 80;
+	float duration = 10.0f;		// Seconds
+	int segmentFrames = 16;
+	int decodes = 20000;		// Poses timed per way of decoding
+};
+
+int RunClipCompressionBench(const ClipCompressionBenchSettings& settings);
@@ -0,0 +1,187 @@
+#include "ConstantBufferRing.h"
+#include <cstring>
+
+ConstantBufferRing::ConstantBufferRing(
+	IRenderBackend& backend,
+	std::shared_ptr<IFrameFence> fence,
+	size_t initialSize)
+	: backend(backend), fence(fence),
+	allocator(initialSize, 256)
+{
+	CreateBuffer(allocator.GetCapacity());
+}
+
+ConstantBufferRing::~ConstantBufferRing()
+{
+	Unmap();
+	ReleaseRetiredBuffers();
+	backend.DestroyBuffer(buffer);
+}
+
+void ConstantBufferRing::CreateBuffer(size_t size)
+{
+	BufferDesc desc;
+	desc.type = BufferType::Constant;
+	desc.usage = BufferUsage::Dynamic;
+	desc.size = size;
+	buffer = backend.CreateBuffer(desc);
+}
+
+void ConstantBufferRing::ReleaseRetiredBuffers()
+{
+	for (BufferHandle retired : retiredBuffers)
+		backend.DestroyBuffer(retired);
+	retiredBuffers.clear();
+}
+
+// --------------------------------------------------------
+// Maps the whole ring for the frame.  When nothing is in flight
+// (first frame, or right after growing) the buffer is discarded;
+// otherwise NO_OVERWRITE is safe because the allocator will only
+// hand out ranges the fence says the GPU is done with.
+// --------------------------------------------------------
+void ConstantBufferRing::Map()
+{
+	MapMode mode = allocator.IsIdle()
+		? MapMode::WriteDiscard
+		: MapMode::WriteNoOverwrite;
+
+	mappedData = (char*)backend.Map(buffer, mode);
+}
+
+void ConstantBufferRing::BeginFrame()
+{
+	allocator.Retire(fence->GetCompletedValue());
+	Map();
+}
+
+void ConstantBufferRing::Unmap()
+{
+	if (!mappedData)
+		return;
+
+	backend.Unmap(buffer);
+	mappedData = nullptr;
+}
+
+void ConstantBufferRing::EndFrame()
+{
+	Unmap();
+
+	lastFrameBytes = allocator.GetCurrentFrameBytes();
+	allocator.FinishFrame(fence->Signal());
+
+	// The backend keeps replaced buffers alive for any commands
+	// already submitted, so the handles can go now
+	ReleaseRetiredBuffers();
+}
+
+// --------------------------------------------------------
+// Sub-allocates a slice.  Must be called while mapped (between
+// BeginFrame() and Unmap()).
+// --------------------------------------------------------
+ConstantBufferSlice ConstantBufferRing::Allocate(size_t size)
+{
+	// Not mapped, or Map() failed - nowhere to write
+	if (!mappedData)
+		return ConstantBufferSlice();
+
+	size_t offset = allocator.Allocate(size);
+	if (offset == RingAllocator::InvalidOffset)
+	{
+		Grow(size);
+		offset = allocator.Allocate(size);
+
+		// A single frame larger than MaxSize, or one the older
+		// frames' space still can't fit after waiting on them
+		if (offset == RingAllocator::InvalidOffset)
+			return ConstantBufferSlice();
+	}
+
+	ConstantBufferSlice slice;
+	slice.buffer = buffer;
+	slice.cpuAddress = mappedData + offset;
+	slice.firstConstant = (unsigned int)(offset / 16);
+	slice.numConstants = (unsigned int)(allocator.AlignUp(size) / 16);
+	return slice;
+}
+
+ConstantBufferSlice ConstantBufferRing::Push(const void* data, size_t size)
+{
+	ConstantBufferSlice slice = Allocate(size);
+	if (slice.cpuAddress)
+		memcpy(slice.cpuAddress, data, size);
+	return slice;
+}
+
+// --------------------------------------------------------
+// Piece of a block returned by Allocate().  Touches nothing but
+// the block itself, so any thread may call it while mapped.
+// --------------------------------------------------------
+ConstantBufferSlice ConstantBufferRing::SubSlice(const ConstantBufferSlice& block, size_t offset, size_t size) const
+{
+	ConstantBufferSlice slice;
+	if (!block.cpuAddress)
+		return slice;
+
+	slice.buffer = block.buffer;
+	slice.cpuAddress = (char*)block.cpuAddress + offset;
+	slice.firstConstant = block.firstConstant + (unsigned int)(offset / 16);
+	slice.numConstants = (unsigned int)(allocator.AlignUp(size) / 16);
+	return slice;
+}
+
+// --------------------------------------------------------
+// Called when the ring can't satisfy a request.  Swaps in a
+// buffer twice as large (or more) - the fresh buffer has nothing
+// in flight, so the allocator simply starts over on it.  Only
+// once the ring is MaxSize already do we fall back to waiting
+// on the GPU, which frees every older frame's space.
+// --------------------------------------------------------
+void ConstantBufferRing::Grow(size_t minimumFreeBytes)
+{
+	// A single frame larger than MaxSize - neither growing nor
+	// waiting would make room for it
+	size_t needed = allocator.GetCurrentFrameBytes() + allocator.AlignUp(minimumFreeBytes);
+	if (needed > MaxSize)
+		return;
+
+	size_t newSize = allocator.GetCapacity() * 2;
+	while (newSize < needed * 2)
+		newSize *= 2;
+
+	if (newSize > MaxSize)
+	{
+		// Room to spare is nice to have - if only the exact need
+		// fits under the limit, take the limit
+		if (allocator.GetCapacity() < MaxSize)
+			newSize = MaxSize;
+		else
+		{
+			// Too big to grow - wait for every older frame to finish
+			// and reuse the space they held
+			fence->WaitFor(fence->Signal());
+			allocator.Retire(fence->GetCompletedValue());
+			return;
+		}
+	}
+
+	Unmap();
+	retiredBuffers.push_back(buffer);
+
+	CreateBuffer(newSize);
+	allocator.Reset(newSize);
+	growCount++;
+
+	Map();
+}
+
+void ConstantBufferRing::BindVS(IRenderBackend& context, unsigned int slot, const ConstantBufferSlice& slice)
+{
+	context.SetConstantBuffer(ShaderStage::Vertex, slot, slice.buffer, slice.firstConstant, slice.numConstants);
+}
+
+void ConstantBufferRing::BindPS(IRenderBackend& context, unsigned int slot, const ConstantBufferSlice& slice)
+{
+	context.SetConstantBuffer(ShaderStage::Pixel, slot, slice.buffer, slice.firstConstant, slice.numConstants);
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "RenderBackend.h"
+#include "RingAllocator.h"
+
+// --------------------------------------------------------
+// A slice of the constant buffer ring: where the data was
+// written on the CPU and the range to bind (in 16-byte constants)
+// --------------------------------------------------------
+struct ConstantBufferSlice
+{
+	BufferHandle buffer;
+	void* cpuAddress = nullptr;
+	unsigned int firstConstant = 0;
+	unsigned int numConstants = 0;
+};
+
+// --------------------------------------------------------
+// One big dynamic constant buffer shared by every draw.
+//
+// Per frame:
+//  - BeginFrame() retires finished frames and maps the buffer ONCE
+//  - Allocate()/Push() sub-allocate 256-byte aligned slices
+//  - Unmap() before issuing any draw that reads those slices
+//  - EndFrame() signals the fence that guards this frame's range
+//
+// Slices never overlap data from frames the GPU hasn't finished.
+// If a frame needs more than the ring can give, the ring grows
+// (the old buffer stays alive until the GPU lets go of it), up to
+// MaxSize - from there it waits for the GPU to finish the older
+// frames instead.
+// --------------------------------------------------------
+class ConstantBufferRing
+{
+public:
+	ConstantBufferRing(
+		IRenderBackend& backend,
+		std::shared_ptr<IFrameFence> fence,
+		size_t initialSize = 256 * 1024);
+	~ConstantBufferRing();
+
+	void BeginFrame();
+	ConstantBufferSlice Allocate(size_t size);
+	void Unmap();
+	void EndFrame();
+
+	// Copies the data into a new slice
+	ConstantBufferSlice Push(const void* data, size_t size);
+	template<typename T> ConstantBufferSlice Push(const T& data) { return Push(&data, sizeof(T)); }
+
+	// Splitting one allocation between threads: Allocate() the total
+	// once, then each thread carves its own pieces out of that block.
+	// Offsets and sizes must be multiples of GetAlignment().
+	ConstantBufferSlice SubSlice(const ConstantBufferSlice& block, size_t offset, size_t size) const;
+	size_t GetAlignment() const { return allocator.GetAlignment(); }
+	size_t AlignUp(size_t size) const { return allocator.AlignUp(size); }
+
+	// Binding helpers - the context may be a deferred one, not
+	// necessarily the backend the ring was created on
+	static void BindVS(IRenderBackend& context, unsigned int slot, const ConstantBufferSlice& slice);
+	static void BindPS(IRenderBackend& context, unsigned int slot, const ConstantBufferSlice& slice);
+
+	// Stats
+	size_t GetCapacity() const { return allocator.GetCapacity(); }
+	size_t GetFrameBytes() const { return lastFrameBytes; }
+	size_t GetFramesInFlight() const { return allocator.GetFramesInFlight(); }
+	unsigned int GetGrowCount() const { return growCount; }
+
+	// Largest buffer we are willing to create before stalling on the GPU instead
+	static const size_t MaxSize = 64 * 1024 * 1024;
+
+private:
+	IRenderBackend& backend;
+	std::shared_ptr<IFrameFence> fence;
+
+	BufferHandle buffer;
+	RingAllocator allocator;
+	char* mappedData = nullptr;
+
+	// Buffers replaced by Grow() during the current frame; held until
+	// EndFrame() so slices pointing at them stay valid while recording
+	std::vector<BufferHandle> retiredBuffers;
+
+	size_t lastFrameBytes = 0;
+	unsigned int growCount = 0;
+
+	void CreateBuffer(size_t size);
+	void ReleaseRetiredBuffers();
+	void Map();
+	void Grow(size_t minimumFreeBytes);
+};
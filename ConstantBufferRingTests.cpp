@@ -0,0 +1,320 @@
+#include "ConstantBufferRingTests.h"
+#include "HeadlessTests.h"
+#include "RecordingBackend.h"
+#include "ConstantBufferRing.h"
+#include "RingAllocator.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace
+{
+	// --------------------------------------------------------
+	// A GPU that is only done with what it's told it's done with:
+	// Complete() moves it along, and WaitFor() jumps it straight
+	// to the value waited on, counting the stall
+	// --------------------------------------------------------
+	class FakeFence : public IFrameFence
+	{
+	public:
+		uint64_t Signal() override { return ++signaled; }
+		uint64_t GetCompletedValue() override { return completed; }
+		void WaitFor(uint64_t value) override { waits++; Complete(value); }
+
+		void Complete(uint64_t value) { completed = (std::max)(completed, (std::min)(value, signaled)); }
+		uint64_t GetSignaledValue() const { return signaled; }
+		unsigned int GetWaitCount() const { return waits; }
+
+	private:
+		uint64_t signaled = 0;
+		uint64_t completed = 0;
+		unsigned int waits = 0;
+	};
+
+	// A block the allocator handed out, and the frame it belongs to
+	struct RingBlock
+	{
+		size_t offset;
+		size_t size;
+		uint64_t fence;
+	};
+
+	// A slice written on the CPU, for the GPU to read once its
+	// frame's fence completes
+	struct WrittenSlice
+	{
+		ConstantBufferSlice slice;
+		size_t size;
+		uint8_t pattern;
+		uint64_t fence;
+	};
+
+	bool StillWritten(const WrittenSlice& written)
+	{
+		const uint8_t* bytes = static_cast<const uint8_t*>(written.slice.cpuAddress);
+		for (size_t i = 0; i < written.size; i++)
+		{
+			if (bytes[i] != (uint8_t)(written.pattern + i))
+				return false;
+		}
+		return true;
+	}
+}
+
+int RunConstantBufferRingChecks()
+{
+	printf("Constant buffer ring checks\n");
+	int failures = 0;
+	char detail[256];
+
+	// Slices start on 256 bytes and cover whole 256-byte blocks
+	{
+		RecordingBackend backend;
+		ConstantBufferRing ring(backend, std::make_shared<FakeFence>(), 64 * 1024);
+		ring.BeginFrame();
+		size_t misaligned = 0;
+		size_t tooShort = 0;
+		for (size_t size = 1; size <= 600; size += 7)
+		{
+			ConstantBufferSlice slice = ring.Allocate(size);
+			if ((slice.firstConstant * 16) % 256 != 0 || (slice.numConstants * 16) % 256 != 0)
+				misaligned++;
+			if (slice.numConstants * 16 < size)
+				tooShort++;
+		}
+		ring.EndFrame();
+		snprintf(detail, sizeof(detail), "%zu misaligned, %zu too short", misaligned, tooShort);
+		failures += ReportCheck("slices are 256-byte aligned blocks", misaligned == 0 && tooShort == 0, detail);
+	}
+
+	// 16 blocks of 256: frame 1 takes 10, frame 2 takes 4, and once
+	// frame 1 retires, 4 more don't fit in the 2 left at the end
+	{
+		RingAllocator allocator(4096);
+		allocator.Allocate(10 * 256);
+		allocator.FinishFrame(1);
+		size_t second = allocator.Allocate(4 * 256);
+		allocator.FinishFrame(2);
+		allocator.Retire(1);
+
+		size_t wrapped = allocator.Allocate(4 * 256);
+		size_t frameBytes = allocator.GetCurrentFrameBytes();
+		allocator.FinishFrame(3);
+		allocator.Retire(2);
+		size_t usedAfter = allocator.GetUsedBytes();
+
+		snprintf(detail, sizeof(detail), "at %zu after %zu, frame charged %zu bytes", wrapped, second, frameBytes);
+		failures += ReportCheck("a block that doesn't fit wraps to the start", second == 2560 && wrapped == 0 && frameBytes == 6 * 256, detail);
+		failures += ReportCheck("skipped space is released with its frame", usedAfter == 6 * 256, "");
+	}
+
+	// Oldest first, and not before the fence says so - frames
+	// with nothing in them included
+	{
+		RingAllocator allocator(4096);
+		for (uint64_t fence = 1; fence <= 3; fence++)
+		{
+			allocator.Allocate(512);
+			allocator.FinishFrame(fence);
+		}
+		allocator.FinishFrame(4);
+
+		allocator.Retire(0);
+		size_t noneDone = allocator.GetFramesInFlight();
+		allocator.Retire(2);
+		size_t twoDone = allocator.GetFramesInFlight();
+		size_t twoDoneBytes = allocator.GetUsedBytes();
+		allocator.Retire(4);
+
+		snprintf(detail, sizeof(detail), "in flight: %zu, %zu (%zu bytes), %zu", noneDone, twoDone, twoDoneBytes, allocator.GetFramesInFlight());
+		failures += ReportCheck("frames retire in order once their fence has", noneDone == 4 && twoDone == 2 && twoDoneBytes == 512 && allocator.IsIdle(), detail);
+	}
+
+	// A full ring refuses rather than reuse a frame still in flight
+	{
+		RingAllocator allocator(4096);
+		allocator.Allocate(4096);
+		allocator.FinishFrame(1);
+		size_t whileInFlight = allocator.Allocate(256);
+		allocator.Retire(1);
+		size_t afterRetire = allocator.Allocate(256);
+		failures += ReportCheck("a full ring fails until its frame retires", whileInFlight == RingAllocator::InvalidOffset && afterRetire == 0, "");
+	}
+
+	// Random frames against a GPU up to 3 frames behind: every block
+	// handed out is checked against every block not yet retired
+	{
+		std::mt19937 random(26);
+		std::uniform_int_distribution<size_t> blockCount(0, 24);
+		std::uniform_int_distribution<size_t> blockSize(1, 4096);
+		std::uniform_int_distribution<uint64_t> lag(0, 3);
+
+		const size_t capacity = 64 * 1024;
+		RingAllocator allocator(capacity);
+		std::vector<RingBlock> live;
+		size_t blocks = 0;
+		size_t refused = 0;
+		size_t overlaps = 0;
+		size_t outside = 0;
+		for (uint64_t frame = 1; frame <= 5000; frame++)
+		{
+			uint64_t completed = frame - 1 - (std::min)(frame - 1, lag(random));
+			allocator.Retire(completed);
+			live.erase(std::remove_if(live.begin(), live.end(),
+				[completed](const RingBlock& block) { return block.fence <= completed; }), live.end());
+
+			size_t count = blockCount(random);
+			for (size_t i = 0; i < count; i++)
+			{
+				size_t size = blockSize(random);
+				size_t offset = allocator.Allocate(size);
+				if (offset == RingAllocator::InvalidOffset)
+				{
+					refused++;
+					continue;
+				}
+
+				RingBlock block = { offset, allocator.AlignUp(size), frame };
+				if (block.offset + block.size > capacity)
+					outside++;
+				for (const RingBlock& other : live)
+				{
+					if (block.offset < other.offset + other.size && other.offset < block.offset + block.size)
+						overlaps++;
+				}
+				live.push_back(block);
+				blocks++;
+			}
+			allocator.FinishFrame(frame);
+		}
+		snprintf(detail, sizeof(detail), "%zu blocks, %zu refused, %zu overlapping, %zu outside", blocks, refused, overlaps, outside);
+		failures += ReportCheck("no block overlaps one still in flight", overlaps == 0 && outside == 0 && refused > 0, detail);
+	}
+
+	// The same through the ring, growing as it needs to: what each
+	// frame wrote must still be there when the GPU finishes it
+	{
+		std::mt19937 random(260);
+		std::uniform_int_distribution<size_t> sliceCount(1, 32);
+		std::uniform_int_distribution<size_t> sliceSize(16, 2048);
+		std::uniform_int_distribution<uint64_t> lag(0, 3);
+
+		RecordingBackend backend;
+		backend.SetValidationEnabled(true);
+		std::shared_ptr<FakeFence> fence = std::make_shared<FakeFence>();
+		ConstantBufferRing ring(backend, fence, 16 * 1024);
+
+		std::vector<WrittenSlice> written;
+		size_t slices = 0;
+		size_t read = 0;
+		size_t overwritten = 0;
+		for (uint64_t frame = 1; frame <= 2000; frame++)
+		{
+			// The GPU reads whatever it finishes
+			uint64_t signaled = fence->GetSignaledValue();
+			fence->Complete(signaled - (std::min)(signaled, lag(random)));
+			for (const WrittenSlice& slice : written)
+			{
+				if (slice.fence <= fence->GetCompletedValue())
+				{
+					read++;
+					if (!StillWritten(slice))
+						overwritten++;
+				}
+			}
+			written.erase(std::remove_if(written.begin(), written.end(),
+				[&fence](const WrittenSlice& slice) { return slice.fence <= fence->GetCompletedValue(); }), written.end());
+
+			unsigned int growCount = ring.GetGrowCount();
+			ring.BeginFrame();
+			size_t first = written.size();
+			size_t count = sliceCount(random);
+			for (size_t i = 0; i < count; i++)
+			{
+				size_t size = sliceSize(random);
+				WrittenSlice slice = { ring.Allocate(size), size, (uint8_t)(frame * 31 + i), 0 };
+				if (!slice.slice.cpuAddress)
+					continue;
+				for (size_t b = 0; b < size; b++)
+					static_cast<uint8_t*>(slice.slice.cpuAddress)[b] = (uint8_t)(slice.pattern + b);
+				written.push_back(slice);
+				slices++;
+			}
+
+			ring.EndFrame();
+			for (size_t i = first; i < written.size(); i++)
+				written[i].fence = fence->GetSignaledValue();
+
+			// A grown ring's old buffer is gone after EndFrame() here -
+			// a GPU would keep it for the commands using it
+			if (ring.GetGrowCount() != growCount && !written.empty())
+			{
+				BufferHandle current = written.back().slice.buffer;
+				written.erase(std::remove_if(written.begin(), written.end(),
+					[current](const WrittenSlice& slice) { return slice.slice.buffer != current; }), written.end());
+			}
+		}
+		snprintf(detail, sizeof(detail), "%zu slices, %zu read, %zu overwritten, grew %u times to %zu KB",
+			slices, read, overwritten, ring.GetGrowCount(), ring.GetCapacity() / 1024);
+		failures += ReportCheck("nothing in flight is written over", overwritten == 0 && read > 0 && backend.GetErrorCount() == 0, detail);
+	}
+
+	// Growing: 3 KB in flight in a 4 KB ring, then 2 KB more
+	{
+		RecordingBackend backend;
+		std::shared_ptr<FakeFence> fence = std::make_shared<FakeFence>();
+		ConstantBufferRing ring(backend, fence, 4096);
+		ring.BeginFrame();
+		ConstantBufferSlice before = ring.Allocate(3072);
+		ring.EndFrame();
+
+		ring.BeginFrame();
+		ConstantBufferSlice after = ring.Allocate(2048);
+		size_t liveWhileRecording = backend.GetLiveBufferCount();
+		ring.EndFrame();
+
+		snprintf(detail, sizeof(detail), "%zu bytes after %u grows, %zu then %zu buffers", ring.GetCapacity(), ring.GetGrowCount(),
+			liveWhileRecording, backend.GetLiveBufferCount());
+		failures += ReportCheck("a full ring doubles into a new buffer",
+			after.cpuAddress && after.buffer != before.buffer && ring.GetCapacity() == 8192 && ring.GetGrowCount() == 1, detail);
+		failures += ReportCheck("the old buffer is kept until the frame ends", liveWhileRecording == 2 && backend.GetLiveBufferCount() == 1, "");
+	}
+
+	// Near MaxSize: 40 MB in a 16 MB ring can't double twice, so it
+	// takes MaxSize; the next 40 MB has to wait for that frame; more
+	// than MaxSize in one frame fails without a wait
+	{
+		const size_t MB = 1024 * 1024;
+		RecordingBackend backend;
+		std::shared_ptr<FakeFence> fence = std::make_shared<FakeFence>();
+		ConstantBufferRing ring(backend, fence, 16 * MB);
+
+		ring.BeginFrame();
+		ConstantBufferSlice clamped = ring.Allocate(40 * MB);
+		ring.EndFrame();
+		snprintf(detail, sizeof(detail), "%zu MB, %u waits", ring.GetCapacity() / MB, fence->GetWaitCount());
+		failures += ReportCheck("growing past MaxSize takes MaxSize",
+			clamped.cpuAddress && ring.GetCapacity() == ConstantBufferRing::MaxSize && fence->GetWaitCount() == 0, detail);
+
+		ring.BeginFrame();
+		ConstantBufferSlice waited = ring.Allocate(40 * MB);
+		unsigned int growCount = ring.GetGrowCount();
+		ring.EndFrame();
+		snprintf(detail, sizeof(detail), "%zu MB, %u waits, %u grows", ring.GetCapacity() / MB, fence->GetWaitCount(), growCount);
+		failures += ReportCheck("a MaxSize ring waits for the older frames",
+			waited.cpuAddress && waited.firstConstant == 0 && fence->GetWaitCount() == 1 && growCount == 1, detail);
+
+		ring.BeginFrame();
+		ConstantBufferSlice tooBig = ring.Allocate(ConstantBufferRing::MaxSize + 256);
+		ring.EndFrame();
+		snprintf(detail, sizeof(detail), "%u waits", fence->GetWaitCount());
+		failures += ReportCheck("a frame over MaxSize fails without waiting", !tooBig.cpuAddress && fence->GetWaitCount() == 1, detail);
+		failures += ReportValidation(backend);
+	}
+
+	return ReportFailures(failures);
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+// --------------------------------------------------------
+// Headless checks of the constant buffer ring and its
+// RingAllocator, driven by a fake fence standing in for a GPU
+// that finishes frames late.
+//
+//  - every slice starts on 256 bytes and binds whole 256-byte
+//    blocks
+//  - a block that doesn't fit at the end of the ring wraps to
+//    the start, with the skipped space charged to its frame
+//  - frames retire oldest first, and only once their fence has
+//  - over thousands of frames of random sizes and GPU lag, no
+//    slice overlaps one the GPU hasn't finished with, and what
+//    was written there is still intact when the GPU gets to it
+//  - a full ring grows to at least twice its size, and lets go
+//    of the old buffer once the frame is over
+//  - a ring that would grow past MaxSize takes MaxSize instead,
+//    and one that is MaxSize already waits on the fence for the
+//    older frames' space
+//
+// Returns 0 if all checks passed.
+// --------------------------------------------------------
+int RunConstantBufferRingChecks();
@@ -0,0 +1,51 @@
+#include "CpuFeatures.h"
+#include <atomic>
+#if HAS_AVX2_PATHS && defined(_MSC_VER)
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+namespace
+{
+	bool DetectAvx2()
+	{
+#if !HAS_AVX2_PATHS
+		return false;
+#elif defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+			return false;
+
+		// FMA, OSXSAVE and AVX, then the OS saving xmm and ymm state
+		__cpuid(info, 1);
+		const int needed = (1 << 12) | (1 << 27) | (1 << 28);
+		if ((info[2] & needed) != needed || (_xgetbv(0) & 6) != 6)
+			return false;
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		// Checks the OS saves the registers too
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+	}
+
+	bool CpuSupportsAvx2()
+	{
+		static const bool supported = DetectAvx2();
+		return supported;
+	}
+
+	std::atomic<bool> avx2Enabled = true;
+}
+
+bool CpuHasAvx2()
+{
+	return avx2Enabled.load(std::memory_order_relaxed) && CpuSupportsAvx2();
+}
+
+void SetAvx2Enabled(bool enabled)
+{
+	avx2Enabled.store(enabled, std::memory_order_relaxed);
+}
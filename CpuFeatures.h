@@ -0,0 +1,32 @@
+#pragma once
+
+// --------------------------------------------------------
+// Wider kernels picked at run time.  x64 builds target SSE2, as
+// DirectXMath does, so the program runs anywhere; a few hot loops
+// also have an 8-wide AVX2 version, used when CpuHasAvx2() says
+// so.  Those functions are marked AVX2_FUNCTION - MSVC compiles
+// AVX2 intrinsics in any function, GCC and Clang have to be told
+// per function - so nothing else is built for AVX2.
+//
+// HAS_AVX2_PATHS is 0 off x64, where there's nothing to pick.
+// --------------------------------------------------------
+#if defined(_M_X64) || defined(__x86_64__)
+#define HAS_AVX2_PATHS 1
+#if defined(_MSC_VER) && !defined(__clang__)
+#define AVX2_FUNCTION
+#else
+#define AVX2_FUNCTION __attribute__((target("avx2,fma")))
+#endif
+#else
+#define HAS_AVX2_PATHS 0
+#define AVX2_FUNCTION
+#endif
+
+// True if the CPU has AVX2 and FMA, the OS saves the registers
+// they use, and they haven't been turned off
+bool CpuHasAvx2();
+
+// Turns the AVX2 kernels off, or back on if the CPU has them, so
+// benches and checks can run both paths.  Not for while kernels
+// are running on other threads.
+void SetAvx2Enabled(bool enabled);
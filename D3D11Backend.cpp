@@ -0,0 +1,337 @@
+#include "D3D11Backend.h"
+#include "D3D11EventFence.h"
+
+D3D11Backend::D3D11Backend(
+	Microsoft::WRL::ComPtr<ID3D11Device1> device,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext1> context)
+	: device(device), context(context),
+	resources(std::make_shared<Resources>())
+{
+}
+
+D3D11Backend::D3D11Backend(
+	const D3D11Backend& resourceOwner,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext1> context)
+	: device(resourceOwner.device), context(context),
+	resources(resourceOwner.resources)
+{
+}
+
+BufferHandle D3D11Backend::CreateBuffer(const BufferDesc& desc)
+{
+	D3D11_BUFFER_DESC bd = {};
+	bd.ByteWidth = (UINT)desc.size;
+
+	switch (desc.type)
+	{
+	case BufferType::Vertex: bd.BindFlags = D3D11_BIND_VERTEX_BUFFER; break;
+	case BufferType::Index: bd.BindFlags = D3D11_BIND_INDEX_BUFFER; break;
+	case BufferType::Constant: bd.BindFlags = D3D11_BIND_CONSTANT_BUFFER; break;
+	case BufferType::Structured:
+		bd.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+		bd.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+		bd.StructureByteStride = desc.stride;
+		break;
+	}
+
+	if (desc.usage == BufferUsage::Dynamic)
+	{
+		bd.Usage = D3D11_USAGE_DYNAMIC;
+		bd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	}
+	else
+	{
+		bd.Usage = D3D11_USAGE_IMMUTABLE;
+	}
+
+	D3D11_SUBRESOURCE_DATA initialData = {};
+	initialData.pSysMem = desc.initialData;
+
+	BufferEntry entry;
+	HRESULT hr = device->CreateBuffer(&bd, desc.initialData ? &initialData : nullptr, entry.buffer.GetAddressOf());
+	if (SUCCEEDED(hr) && desc.type == BufferType::Structured)
+	{
+		D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+		srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+		srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+		srvDesc.Buffer.FirstElement = 0;
+		srvDesc.Buffer.NumElements = desc.stride > 0 ? (UINT)(desc.size / desc.stride) : 0;
+		hr = device->CreateShaderResourceView(entry.buffer.Get(), &srvDesc, entry.srv.GetAddressOf());
+	}
+
+	if (FAILED(hr))
+	{
+		OutputDebugStringW(L"D3D11Backend: CreateBuffer FAILED\n");
+		return BufferHandle();
+	}
+
+	BufferHandle handle;
+	handle.id = resources->buffers.Add(entry);
+	if (!handle.IsValid())
+		OutputDebugStringW(L"D3D11Backend: CreateBuffer FAILED, out of handles\n");
+	return handle;
+}
+
+TextureHandle D3D11Backend::CreateTexture(const TextureDesc& desc)
+{
+	D3D11_TEXTURE2D_DESC td = {};
+	td.Width = desc.width;
+	td.Height = desc.height;
+	td.MipLevels = 1;
+	td.ArraySize = 1;
+	td.SampleDesc.Count = 1;
+	td.Usage = D3D11_USAGE_DEFAULT;
+	td.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+	UINT bytesPerPixel = 4;
+	switch (desc.format)
+	{
+	case TextureFormat::RGBA8: td.Format = DXGI_FORMAT_R8G8B8A8_UNORM; break;
+	case TextureFormat::R32Float: td.Format = DXGI_FORMAT_R32_FLOAT; break;
+	}
+
+	D3D11_SUBRESOURCE_DATA initialData = {};
+	initialData.pSysMem = desc.initialData;
+	initialData.SysMemPitch = desc.width * bytesPerPixel;
+
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> texture;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv;
+	HRESULT hr = device->CreateTexture2D(&td, desc.initialData ? &initialData : nullptr, texture.GetAddressOf());
+	if (SUCCEEDED(hr))
+		hr = device->CreateShaderResourceView(texture.Get(), nullptr, srv.GetAddressOf());
+
+	if (FAILED(hr))
+	{
+		OutputDebugStringW(L"D3D11Backend: CreateTexture FAILED\n");
+		return TextureHandle();
+	}
+
+	return ImportTexture(srv);
+}
+
+SamplerHandle D3D11Backend::CreateSampler(const SamplerDesc& desc)
+{
+	D3D11_SAMPLER_DESC sd = {};
+	D3D11_TEXTURE_ADDRESS_MODE address = desc.address == SamplerAddress::Wrap
+		? D3D11_TEXTURE_ADDRESS_WRAP
+		: D3D11_TEXTURE_ADDRESS_CLAMP;
+	sd.AddressU = address;
+	sd.AddressV = address;
+	sd.AddressW = address;
+	sd.MaxLOD = D3D11_FLOAT32_MAX;
+
+	switch (desc.filter)
+	{
+	case SamplerFilter::Point: sd.Filter = D3D11_FILTER_MIN_MAG_MIP_POINT; break;
+	case SamplerFilter::Linear: sd.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR; break;
+	case SamplerFilter::Anisotropic:
+		sd.Filter = D3D11_FILTER_ANISOTROPIC;
+		sd.MaxAnisotropy = desc.maxAnisotropy;
+		break;
+	}
+
+	Microsoft::WRL::ComPtr<ID3D11SamplerState> sampler;
+	if (FAILED(device->CreateSamplerState(&sd, sampler.GetAddressOf())))
+	{
+		OutputDebugStringW(L"D3D11Backend: CreateSampler FAILED\n");
+		return SamplerHandle();
+	}
+
+	return ImportSampler(sampler);
+}
+
+ShaderHandle D3D11Backend::CreateShader(ShaderStage stage, const void* bytecode, size_t bytecodeSize)
+{
+	HRESULT hr = E_INVALIDARG;
+	if (stage == ShaderStage::Vertex)
+	{
+		Microsoft::WRL::ComPtr<ID3D11VertexShader> vs;
+		hr = device->CreateVertexShader(bytecode, bytecodeSize, nullptr, vs.GetAddressOf());
+		if (SUCCEEDED(hr))
+			return ImportShader(vs);
+	}
+	else if (stage == ShaderStage::Pixel)
+	{
+		Microsoft::WRL::ComPtr<ID3D11PixelShader> ps;
+		hr = device->CreatePixelShader(bytecode, bytecodeSize, nullptr, ps.GetAddressOf());
+		if (SUCCEEDED(hr))
+			return ImportShader(ps);
+	}
+
+	OutputDebugStringW(L"D3D11Backend: CreateShader FAILED\n");
+	return ShaderHandle();
+}
+
+void D3D11Backend::DestroyBuffer(BufferHandle buffer) { resources->buffers.Remove(buffer.id); }
+void D3D11Backend::DestroyTexture(TextureHandle texture) { resources->textures.Remove(texture.id); }
+void D3D11Backend::DestroySampler(SamplerHandle sampler) { resources->samplers.Remove(sampler.id); }
+void D3D11Backend::DestroyShader(ShaderHandle shader) { resources->shaders.Remove(shader.id); }
+
+void* D3D11Backend::Map(BufferHandle buffer, MapMode mode)
+{
+	ID3D11Buffer* native = GetNativeBuffer(buffer);
+	if (!native)
+		return nullptr;
+
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	HRESULT hr = context->Map(
+		native,
+		0,
+		mode == MapMode::WriteDiscard ? D3D11_MAP_WRITE_DISCARD : D3D11_MAP_WRITE_NO_OVERWRITE,
+		0,
+		&mapped);
+
+	return SUCCEEDED(hr) ? mapped.pData : nullptr;
+}
+
+void D3D11Backend::Unmap(BufferHandle buffer)
+{
+	ID3D11Buffer* native = GetNativeBuffer(buffer);
+	if (native)
+		context->Unmap(native, 0);
+}
+
+void D3D11Backend::SetShader(ShaderStage stage, ShaderHandle shader)
+{
+	const ShaderEntry* entry = resources->shaders.Find(shader.id);
+
+	if (stage == ShaderStage::Vertex)
+		context->VSSetShader(entry ? entry->vs.Get() : nullptr, 0, 0);
+	else if (stage == ShaderStage::Pixel)
+		context->PSSetShader(entry ? entry->ps.Get() : nullptr, 0, 0);
+}
+
+void D3D11Backend::SetVertexBuffer(BufferHandle buffer, unsigned int stride, unsigned int offset)
+{
+	ID3D11Buffer* native = GetNativeBuffer(buffer);
+	UINT s = stride;
+	UINT o = offset;
+	context->IASetVertexBuffers(0, 1, &native, &s, &o);
+}
+
+void D3D11Backend::SetIndexBuffer(BufferHandle buffer)
+{
+	context->IASetIndexBuffer(GetNativeBuffer(buffer), DXGI_FORMAT_R32_UINT, 0);
+}
+
+void D3D11Backend::SetConstantBuffer(ShaderStage stage, unsigned int slot, BufferHandle buffer,
+	unsigned int firstConstant, unsigned int numConstants)
+{
+	ID3D11Buffer* native = GetNativeBuffer(buffer);
+	UINT first = firstConstant;
+	UINT num = numConstants;
+
+	if (stage == ShaderStage::Vertex)
+		context->VSSetConstantBuffers1(slot, 1, &native, &first, &num);
+	else if (stage == ShaderStage::Pixel)
+		context->PSSetConstantBuffers1(slot, 1, &native, &first, &num);
+}
+
+void D3D11Backend::SetTexture(ShaderStage stage, unsigned int slot, TextureHandle texture)
+{
+	ID3D11ShaderResourceView* srv = GetNativeTexture(texture);
+
+	if (stage == ShaderStage::Vertex)
+		context->VSSetShaderResources(slot, 1, &srv);
+	else if (stage == ShaderStage::Pixel)
+		context->PSSetShaderResources(slot, 1, &srv);
+}
+
+void D3D11Backend::SetShaderBuffer(ShaderStage stage, unsigned int slot, BufferHandle buffer)
+{
+	const BufferEntry* entry = resources->buffers.Find(buffer.id);
+	ID3D11ShaderResourceView* srv = entry ? entry->srv.Get() : nullptr;
+
+	if (stage == ShaderStage::Vertex)
+		context->VSSetShaderResources(slot, 1, &srv);
+	else if (stage == ShaderStage::Pixel)
+		context->PSSetShaderResources(slot, 1, &srv);
+}
+
+void D3D11Backend::SetSampler(ShaderStage stage, unsigned int slot, SamplerHandle sampler)
+{
+	const Microsoft::WRL::ComPtr<ID3D11SamplerState>* entry = resources->samplers.Find(sampler.id);
+	ID3D11SamplerState* native = entry ? entry->Get() : nullptr;
+
+	if (stage == ShaderStage::Vertex)
+		context->VSSetSamplers(slot, 1, &native);
+	else if (stage == ShaderStage::Pixel)
+		context->PSSetSamplers(slot, 1, &native);
+}
+
+void D3D11Backend::Draw(unsigned int vertexCount, unsigned int startVertex)
+{
+	context->Draw(vertexCount, startVertex);
+}
+
+void D3D11Backend::DrawIndexed(unsigned int indexCount, unsigned int startIndex, int baseVertex)
+{
+	context->DrawIndexed(indexCount, startIndex, baseVertex);
+}
+
+std::shared_ptr<IFrameFence> D3D11Backend::CreateFence()
+{
+	return std::make_shared<D3D11EventFence>(device, context);
+}
+
+TextureHandle D3D11Backend::ImportTexture(Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv)
+{
+	TextureHandle handle;
+	if (srv)
+		handle.id = resources->textures.Add(srv);
+	if (srv && !handle.IsValid())
+		OutputDebugStringW(L"D3D11Backend: ImportTexture FAILED, out of handles\n");
+	return handle;
+}
+
+SamplerHandle D3D11Backend::ImportSampler(Microsoft::WRL::ComPtr<ID3D11SamplerState> sampler)
+{
+	SamplerHandle handle;
+	if (sampler)
+		handle.id = resources->samplers.Add(sampler);
+	if (sampler && !handle.IsValid())
+		OutputDebugStringW(L"D3D11Backend: ImportSampler FAILED, out of handles\n");
+	return handle;
+}
+
+ShaderHandle D3D11Backend::ImportShader(Microsoft::WRL::ComPtr<ID3D11VertexShader> vs)
+{
+	ShaderHandle handle;
+	if (vs)
+	{
+		ShaderEntry entry;
+		entry.stage = ShaderStage::Vertex;
+		entry.vs = vs;
+		handle.id = resources->shaders.Add(entry);
+		if (!handle.IsValid())
+			OutputDebugStringW(L"D3D11Backend: ImportShader FAILED, out of handles\n");
+	}
+	return handle;
+}
+
+ShaderHandle D3D11Backend::ImportShader(Microsoft::WRL::ComPtr<ID3D11PixelShader> ps)
+{
+	ShaderHandle handle;
+	if (ps)
+	{
+		ShaderEntry entry;
+		entry.stage = ShaderStage::Pixel;
+		entry.ps = ps;
+		handle.id = resources->shaders.Add(entry);
+		if (!handle.IsValid())
+			OutputDebugStringW(L"D3D11Backend: ImportShader FAILED, out of handles\n");
+	}
+	return handle;
+}
+
+ID3D11Buffer* D3D11Backend::GetNativeBuffer(BufferHandle buffer) const
+{
+	const BufferEntry* entry = resources->buffers.Find(buffer.id);
+	return entry ? entry->buffer.Get() : nullptr;
+}
+
+ID3D11ShaderResourceView* D3D11Backend::GetNativeTexture(TextureHandle texture) const
+{
+	const Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>* entry = resources->textures.Find(texture.id);
+	return entry ? entry->Get() : nullptr;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <d3d11_1.h>
+#include <wrl/client.h>
+#include "RenderBackend.h"
+
+// --------------------------------------------------------
+// IRenderBackend on top of a D3D11 device and immediate context.
+//
+// Every call goes straight through to the context - there's no
+// state caching here, so code that still talks to D3D11 directly
+// (sky, post process, ImGui) can be freely mixed with it.
+//
+// Objects created elsewhere (WIC textures, shadow map SRVs, ...)
+// can be imported to get a handle for them.
+//
+// A second backend can be made on a deferred context that shares
+// the first one's handles, so passes recorded on worker threads
+// bind the same objects.  Create and destroy resources on the
+// main thread only - the handle tables aren't locked.
+// --------------------------------------------------------
+class D3D11Backend : public IRenderBackend
+{
+public:
+	D3D11Backend(
+		Microsoft::WRL::ComPtr<ID3D11Device1> device,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext1> context);
+
+	// Same handles as resourceOwner, commands go to another context
+	D3D11Backend(
+		const D3D11Backend& resourceOwner,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext1> context);
+
+	// IRenderBackend
+	BufferHandle CreateBuffer(const BufferDesc& desc) override;
+	TextureHandle CreateTexture(const TextureDesc& desc) override;
+	SamplerHandle CreateSampler(const SamplerDesc& desc) override;
+	ShaderHandle CreateShader(ShaderStage stage, const void* bytecode, size_t bytecodeSize) override;
+
+	void DestroyBuffer(BufferHandle buffer) override;
+	void DestroyTexture(TextureHandle texture) override;
+	void DestroySampler(SamplerHandle sampler) override;
+	void DestroyShader(ShaderHandle shader) override;
+
+	void* Map(BufferHandle buffer, MapMode mode) override;
+	void Unmap(BufferHandle buffer) override;
+
+	void SetShader(ShaderStage stage, ShaderHandle shader) override;
+	void SetVertexBuffer(BufferHandle buffer, unsigned int stride, unsigned int offset) override;
+	void SetIndexBuffer(BufferHandle buffer) override;
+	void SetConstantBuffer(ShaderStage stage, unsigned int slot, BufferHandle buffer,
+		unsigned int firstConstant, unsigned int numConstants) override;
+	void SetTexture(ShaderStage stage, unsigned int slot, TextureHandle texture) override;
+	void SetShaderBuffer(ShaderStage stage, unsigned int slot, BufferHandle buffer) override;
+	void SetSampler(ShaderStage stage, unsigned int slot, SamplerHandle sampler) override;
+
+	void Draw(unsigned int vertexCount, unsigned int startVertex) override;
+	void DrawIndexed(unsigned int indexCount, unsigned int startIndex, int baseVertex) override;
+
+	std::shared_ptr<IFrameFence> CreateFence() override;
+
+	// Wrapping existing D3D11 objects
+	TextureHandle ImportTexture(Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv);
+	SamplerHandle ImportSampler(Microsoft::WRL::ComPtr<ID3D11SamplerState> sampler);
+	ShaderHandle ImportShader(Microsoft::WRL::ComPtr<ID3D11VertexShader> vs);
+	ShaderHandle ImportShader(Microsoft::WRL::ComPtr<ID3D11PixelShader> ps);
+
+	// Access to the underlying objects for D3D11-only code paths
+	ID3D11Buffer* GetNativeBuffer(BufferHandle buffer) const;
+	ID3D11ShaderResourceView* GetNativeTexture(TextureHandle texture) const;
+	ID3D11DeviceContext1* GetNativeContext() const { return context.Get(); }
+
+private:
+	struct ShaderEntry
+	{
+		ShaderStage stage = ShaderStage::Vertex;
+		Microsoft::WRL::ComPtr<ID3D11VertexShader> vs;
+		Microsoft::WRL::ComPtr<ID3D11PixelShader> ps;
+	};
+
+	// Structured buffers also get a view to bind them with
+	struct BufferEntry
+	{
+		Microsoft::WRL::ComPtr<ID3D11Buffer> buffer;
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv;
+	};
+
+	struct Resources
+	{
+		HandleTable<BufferEntry> buffers;
+		HandleTable<Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>> textures;
+		HandleTable<Microsoft::WRL::ComPtr<ID3D11SamplerState>> samplers;
+		HandleTable<ShaderEntry> shaders;
+	};
+
+	Microsoft::WRL::ComPtr<ID3D11Device1> device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext1> context;
+
+	// Shared with backends on deferred contexts
+	std::shared_ptr<Resources> resources;
+};
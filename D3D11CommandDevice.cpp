@@ -0,0 +1,76 @@
+#include "D3D11CommandDevice.h"
+
+D3D11RecordingContext::D3D11RecordingContext(D3D11Backend& immediateBackend)
+	: backend(&immediateBackend), deferred(false)
+{
+}
+
+D3D11RecordingContext::D3D11RecordingContext(
+	const D3D11Backend& resourceOwner,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext1> deferredContext)
+	: ownedBackend(std::make_unique<D3D11Backend>(resourceOwner, deferredContext)),
+	deferred(true)
+{
+	backend = ownedBackend.get();
+}
+
+std::unique_ptr<ICommandList> D3D11RecordingContext::Finish()
+{
+	if (!deferred)
+		return nullptr;
+
+	// FALSE: don't save the deferred context's state - the next list
+	// starts from defaults, which is what the passes expect
+	Microsoft::WRL::ComPtr<ID3D11CommandList> list;
+	HRESULT hr = GetContext()->FinishCommandList(FALSE, list.GetAddressOf());
+	if (FAILED(hr))
+	{
+		OutputDebugStringW(L"D3D11RecordingContext: FinishCommandList FAILED\n");
+		return nullptr;
+	}
+
+	std::unique_ptr<D3D11CommandList> commandList = spare ? std::move(spare) : std::make_unique<D3D11CommandList>();
+	commandList->Set(list);
+	return commandList;
+}
+
+void D3D11RecordingContext::Recycle(std::unique_ptr<ICommandList> commandList)
+{
+	// Releasing the ID3D11CommandList lets go of everything it bound,
+	// back buffer included, before a resize can need it gone
+	spare.reset(static_cast<D3D11CommandList*>(commandList.release()));
+	spare->Set(nullptr);
+}
+
+D3D11CommandDevice::D3D11CommandDevice(
+	D3D11Backend& immediateBackend,
+	Microsoft::WRL::ComPtr<ID3D11Device1> device)
+	: immediateBackend(immediateBackend), device(device),
+	immediate(immediateBackend)
+{
+	D3D11_FEATURE_DATA_THREADING threading = {};
+	if (SUCCEEDED(device->CheckFeatureSupport(D3D11_FEATURE_THREADING, &threading, sizeof(threading))))
+		driverCommandLists = threading.DriverCommandLists == TRUE;
+}
+
+std::unique_ptr<IRecordingContext> D3D11CommandDevice::CreateDeferredContext()
+{
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext1> deferredContext;
+	HRESULT hr = device->CreateDeferredContext1(0, deferredContext.GetAddressOf());
+	if (FAILED(hr))
+	{
+		OutputDebugStringW(L"D3D11CommandDevice: CreateDeferredContext1 FAILED\n");
+		return nullptr;
+	}
+
+	return std::make_unique<D3D11RecordingContext>(immediateBackend, deferredContext);
+}
+
+void D3D11CommandDevice::Execute(ICommandList& commandList)
+{
+	// FALSE: the immediate context is left in the default state
+	// afterwards; every pass sets up its own state anyway
+	ID3D11CommandList* list = static_cast<D3D11CommandList&>(commandList).Get();
+	if (list)
+		immediateBackend.GetNativeContext()->ExecuteCommandList(list, FALSE);
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <d3d11_1.h>
+#include <wrl/client.h>
+#include "CommandListDevice.h"
+#include "D3D11Backend.h"
+
+// --------------------------------------------------------
+// An ID3D11CommandList from FinishCommandList()
+// --------------------------------------------------------
+class D3D11CommandList : public ICommandList
+{
+public:
+	ID3D11CommandList* Get() const { return list.Get(); }
+	void Set(Microsoft::WRL::ComPtr<ID3D11CommandList> commandList) { list = commandList; }
+
+private:
+	Microsoft::WRL::ComPtr<ID3D11CommandList> list;
+};
+
+// --------------------------------------------------------
+// A D3D11 context plus a backend that records into it.  Passes
+// that need more than the backend offers (render targets,
+// viewports, states) use GetContext() directly.
+// --------------------------------------------------------
+class D3D11RecordingContext : public IRecordingContext
+{
+public:
+	// Immediate: commands go to the GPU as they're made
+	explicit D3D11RecordingContext(D3D11Backend& immediateBackend);
+
+	// Deferred: commands are kept until Finish()
+	D3D11RecordingContext(const D3D11Backend& resourceOwner, Microsoft::WRL::ComPtr<ID3D11DeviceContext1> deferredContext);
+
+	IRenderBackend& GetBackend() override { return *backend; }
+	std::unique_ptr<ICommandList> Finish() override;
+	void Recycle(std::unique_ptr<ICommandList> commandList) override;
+
+	ID3D11DeviceContext1* GetContext() const { return backend->GetNativeContext(); }
+
+	// Every pass gets an IRecordingContext; on D3D11 it's always this one
+	static D3D11RecordingContext& From(IRecordingContext& context) { return static_cast<D3D11RecordingContext&>(context); }
+
+private:
+	std::unique_ptr<D3D11Backend> ownedBackend;	// Deferred only
+	std::unique_ptr<D3D11CommandList> spare;		// Recycled, holding no list
+	D3D11Backend* backend;
+	bool deferred;
+};
+
+// --------------------------------------------------------
+// Deferred contexts and command list execution on D3D11.
+//
+// Without driver command list support (see
+// HasDriverCommandLists()) the runtime emulates them - it still
+// works, but the driver work lands back on the main thread when
+// the list is executed.
+// --------------------------------------------------------
+class D3D11CommandDevice : public ICommandListDevice
+{
+public:
+	D3D11CommandDevice(
+		D3D11Backend& immediateBackend,
+		Microsoft::WRL::ComPtr<ID3D11Device1> device);
+
+	IRecordingContext& GetImmediateContext() override { return immediate; }
+	std::unique_ptr<IRecordingContext> CreateDeferredContext() override;
+	void Execute(ICommandList& commandList) override;
+
+	bool HasDriverCommandLists() const { return driverCommandLists; }
+
+private:
+	D3D11Backend& immediateBackend;
+	Microsoft::WRL::ComPtr<ID3D11Device1> device;
+	D3D11RecordingContext immediate;
+	bool driverCommandLists = false;
+};
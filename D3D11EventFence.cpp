@@ -0,0 +1,91 @@
+#include "D3D11EventFence.h"
+#include <algorithm>
+#include <utility>
+
+D3D11EventFence::D3D11EventFence(
+	Microsoft::WRL::ComPtr<ID3D11Device> device,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+	: device(device), context(context)
+{
+}
+
+// --------------------------------------------------------
+// Issues an event query after everything submitted so far
+// and returns the value it represents
+// --------------------------------------------------------
+uint64_t D3D11EventFence::Signal()
+{
+	Microsoft::WRL::ComPtr<ID3D11Query> query;
+	if (!freeQueries.empty())
+	{
+		query = std::move(freeQueries.back());
+		freeQueries.pop_back();
+	}
+	else
+	{
+		D3D11_QUERY_DESC desc = {};
+		desc.Query = D3D11_QUERY_EVENT;
+		device->CreateQuery(&desc, query.GetAddressOf());
+	}
+
+	context->End(query.Get());
+
+	if (pendingCount == pending.size())
+	{
+		// Unwrapped into a bigger ring, oldest first
+		std::vector<PendingQuery> grown((std::max)(pending.size() * 2, (size_t)4));
+		for (size_t i = 0; i < pendingCount; i++)
+			grown[i] = std::move(pending[(pendingFirst + i) % pending.size()]);
+		pending.swap(grown);
+		pendingFirst = 0;
+	}
+	PendingQuery& slot = pending[(pendingFirst + pendingCount) % pending.size()];
+	slot.value = nextValue;
+	slot.query = std::move(query);
+	pendingCount++;
+	return nextValue++;
+}
+
+uint64_t D3D11EventFence::GetCompletedValue()
+{
+	Poll(false);
+	return completedValue;
+}
+
+// --------------------------------------------------------
+// Spins until the requested value has retired.  The first
+// poll flushes so the query is guaranteed to make progress.
+// --------------------------------------------------------
+void D3D11EventFence::WaitFor(uint64_t value)
+{
+	bool flush = true;
+	while (completedValue < value && pendingCount > 0)
+	{
+		Poll(flush);
+		flush = false;
+	}
+}
+
+void D3D11EventFence::Poll(bool flush)
+{
+	// Queries complete in submission order, so stop at the first one
+	// that is still outstanding
+	while (pendingCount > 0)
+	{
+		PendingQuery& oldest = pending[pendingFirst];
+		BOOL done = FALSE;
+		HRESULT hr = context->GetData(
+			oldest.query.Get(),
+			&done,
+			sizeof(done),
+			flush ? 0 : D3D11_ASYNC_GETDATA_DONOTFLUSH);
+
+		if (hr != S_OK || !done)
+			break;
+
+		completedValue = oldest.value;
+		freeQueries.push_back(std::move(oldest.query));
+		pendingFirst = (pendingFirst + 1) % pending.size();
+		pendingCount--;
+	}
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <vector>
+#include "FrameFence.h"
+
+// --------------------------------------------------------
+// IFrameFence implemented with D3D11 event queries.
+//
+// D3D11 has no real fences, but an event query issued with
+// End() reports "done" once the GPU has processed every command
+// submitted before it, which is exactly what we need per frame.
+// Queries are pooled so no allocations happen once warmed up.
+// --------------------------------------------------------
+class D3D11EventFence : public IFrameFence
+{
+public:
+	D3D11EventFence(
+		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
+
+	uint64_t Signal() override;
+	uint64_t GetCompletedValue() override;
+	void WaitFor(uint64_t value) override;
+
+private:
+	struct PendingQuery
+	{
+		uint64_t value;
+		Microsoft::WRL::ComPtr<ID3D11Query> query;
+	};
+
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+
+	// Oldest first, as a ring that only grows when more queries are
+	// pending than ever before - a deque would allocate on Signal()
+	std::vector<PendingQuery> pending;
+	size_t pendingFirst = 0;
+	size_t pendingCount = 0;
+	std::vector<Microsoft::WRL::ComPtr<ID3D11Query>> freeQueries;
+
+	uint64_t nextValue = 1;
+	uint64_t completedValue = 0;
+
+	// Polls the oldest queries, optionally forcing a flush
+	void Poll(bool flush);
+};
@@ -0,0 +1,626 @@
+#include "EntityBVH.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+using namespace DirectX;
+
+namespace
+{
+	float SurfaceArea(const XMFLOAT3& min, const XMFLOAT3& max)
+	{
+		float x = max.x - min.x;
+		float y = max.y - min.y;
+		float z = max.z - min.z;
+		return 2.0f * (x * y + y * z + z * x);
+	}
+
+	void Grow(XMFLOAT3& min, XMFLOAT3& max, const XMFLOAT3& boxMin, const XMFLOAT3& boxMax)
+	{
+		min = XMFLOAT3((std::min)(min.x, boxMin.x), (std::min)(min.y, boxMin.y), (std::min)(min.z, boxMin.z));
+		max = XMFLOAT3((std::max)(max.x, boxMax.x), (std::max)(max.y, boxMax.y), (std::max)(max.z, boxMax.z));
+	}
+
+	float Component(const XMFLOAT3& v, unsigned int axis)
+	{
+		return axis == 0 ? v.x : axis == 1 ? v.y : v.z;
+	}
+
+	bool BoxesOverlap(FXMVECTOR minA, FXMVECTOR maxA, FXMVECTOR minB, GXMVECTOR maxB)
+	{
+		return XMVector3LessOrEqual(minA, maxB) && XMVector3LessOrEqual(minB, maxA);
+	}
+
+	bool SphereOverlaps(FXMVECTOR min, FXMVECTOR max, FXMVECTOR center, float radiusSquared)
+	{
+		// Distance from the center to the nearest point of the box
+		XMVECTOR outside = XMVectorMax(XMVectorMax(XMVectorSubtract(min, center), XMVectorSubtract(center, max)), XMVectorZero());
+		return XMVectorGetX(XMVector3LengthSq(outside)) <= radiusSquared;
+	}
+
+	// Ray against a box, the entry distance if it's hit within
+	// [0, maxDistance], FLT_MAX if not
+	float RayEntry(FXMVECTOR min, FXMVECTOR max, FXMVECTOR origin, GXMVECTOR inverseDirection, float maxDistance)
+	{
+		XMVECTOR t0 = XMVectorMultiply(XMVectorSubtract(min, origin), inverseDirection);
+		XMVECTOR t1 = XMVectorMultiply(XMVectorSubtract(max, origin), inverseDirection);
+		XMVECTOR nearT = XMVectorMin(t0, t1);
+		XMVECTOR farT = XMVectorMax(t0, t1);
+		float entry = (std::max)((std::max)(XMVectorGetX(nearT), XMVectorGetY(nearT)), (std::max)(XMVectorGetZ(nearT), 0.0f));
+		float exit = (std::min)((std::min)(XMVectorGetX(farT), XMVectorGetY(farT)), (std::min)(XMVectorGetZ(farT), maxDistance));
+		return entry <= exit ? entry : FLT_MAX;
+	}
+
+	// Zero components would give 0 * infinity on the slab planes, so
+	// they're nudged to something tiny instead
+	XMVECTOR InverseDirection(const XMFLOAT3& direction)
+	{
+		auto nudge = [](float v) { return fabsf(v) < 1e-20f ? 1e-20f : v; };
+		return XMVectorReciprocal(XMVectorSet(nudge(direction.x), nudge(direction.y), nudge(direction.z), 1.0f));
+	}
+}
+
+void EntityBVH::Build(const AABB* bounds, size_t count)
+{
+	boxes.assign(bounds, bounds + count);
+	boxMin.resize(count);
+	boxMax.resize(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		const AABB& box = boxes[i];
+		boxMin[i] = XMFLOAT3(box.center.x - box.extents.x, box.center.y - box.extents.y, box.center.z - box.extents.z);
+		boxMax[i] = XMFLOAT3(box.center.x + box.extents.x, box.center.y + box.extents.y, box.center.z + box.extents.z);
+	}
+
+	stats = EntityBVHStats();
+	Rebuild();
+}
+
+void EntityBVH::Update(size_t index, const AABB& bounds)
+{
+	boxes[index] = bounds;
+	boxMin[index] = XMFLOAT3(bounds.center.x - bounds.extents.x, bounds.center.y - bounds.extents.y, bounds.center.z - bounds.extents.z);
+	boxMax[index] = XMFLOAT3(bounds.center.x + bounds.extents.x, bounds.center.y + bounds.extents.y, bounds.center.z + bounds.extents.z);
+
+	uint32_t leaf = leafOf[index];
+	if (!nodeDirty[leaf])
+	{
+		nodeDirty[leaf] = 1;
+		dirtyLeaves.push_back(leaf);
+	}
+}
+
+bool EntityBVH::Refit()
+{
+	stats.refitNodes = 0;
+	if (dirtyLeaves.empty())
+		return false;
+
+	// Every marked leaf and its ancestors, stopping where another
+	// leaf's walk already went
+	refitNodes.clear();
+	for (uint32_t leaf : dirtyLeaves)
+	{
+		refitNodes.push_back(leaf);
+		for (uint32_t node = leaf; node != 0 && !nodeDirty[parents[node]];)
+		{
+			node = parents[node];
+			nodeDirty[node] = 1;
+			refitNodes.push_back(node);
+		}
+	}
+	dirtyLeaves.clear();
+
+	// Children always come after their parents
+	std::sort(refitNodes.begin(), refitNodes.end(), std::greater<uint32_t>());
+	for (uint32_t index : refitNodes)
+	{
+		Node& node = nodes[index];
+		weightedArea -= NodeWeight(node);
+		ComputeNodeBounds(node);
+		weightedArea += NodeWeight(node);
+		nodeDirty[index] = 0;
+	}
+
+	stats.refits++;
+	stats.refitNodes = refitNodes.size();
+	float rootArea = RootArea();
+	stats.cost = rootArea > 0.0f ? (float)(weightedArea / rootArea) : 0.0f;
+	if (stats.cost <= stats.buildCost * RebuildRatio)
+		return false;
+
+	stats.rebuilds++;
+	Rebuild();
+	return true;
+}
+
+void EntityBVH::Rebuild()
+{
+	size_t count = boxes.size();
+	nodes.clear();
+	parents.clear();
+	order.resize(count);
+	leafOf.resize(count);
+	dirtyLeaves.clear();
+	stats.nodes = 0;
+	stats.leaves = 0;
+	stats.depth = 0;
+	stats.refits = 0;
+	stats.refitNodes = 0;
+	stats.buildCost = 0.0f;
+	stats.cost = 0.0f;
+	weightedArea = 0.0;
+	if (count == 0)
+	{
+		nodeDirty.clear();
+		return;
+	}
+
+	buildBoxes.resize(count);
+	Node root;
+	root.first = 0;
+	root.count = (uint32_t)count;
+	root.min = XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
+	root.max = XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (size_t i = 0; i < count; i++)
+	{
+		BuildBox& box = buildBoxes[i];
+		box.index = (uint32_t)i;
+		box.min = boxMin[i];
+		box.max = boxMax[i];
+		box.centroid = XMFLOAT3(
+			(box.min.x + box.max.x) * 0.5f,
+			(box.min.y + box.max.y) * 0.5f,
+			(box.min.z + box.max.z) * 0.5f);
+		Grow(root.min, root.max, box.min, box.max);
+	}
+
+	nodes.reserve(count * 2);
+	parents.reserve(count * 2);
+	nodes.push_back(root);
+	parents.push_back(0);
+	Subdivide(0, 1);
+
+	for (size_t i = 0; i < count; i++)
+		order[i] = buildBoxes[i].index;
+
+	nodeDirty.assign(nodes.size(), 0);
+	for (uint32_t i = 0; i < (uint32_t)nodes.size(); i++)
+	{
+		const Node& node = nodes[i];
+		weightedArea += NodeWeight(node);
+		if (node.count > 0)
+		{
+			stats.leaves++;
+			for (uint32_t j = 0; j < node.count; j++)
+				leafOf[order[node.first + j]] = i;
+		}
+	}
+
+	stats.nodes = nodes.size();
+	float rootArea = RootArea();
+	stats.buildCost = rootArea > 0.0f ? (float)(weightedArea / rootArea) : 0.0f;
+	stats.cost = stats.buildCost;
+}
+
+// --------------------------------------------------------
+// Splits a node with the cheapest of BinCount - 1 planes on
+// each axis, by the surface area heuristic: a traversal step
+// costs 1, and so does testing each box.  Stays a leaf when
+// that's cheaper and it's small enough.
+// --------------------------------------------------------
+void EntityBVH::Subdivide(uint32_t index, unsigned int depth)
+{
+	stats.depth = (std::max)(stats.depth, depth);
+	uint32_t count = nodes[index].count;
+	if (count <= 1)
+		return;
+
+	// Deep enough that the traversal stack could run out - halving
+	// from here on keeps what's left within log2(count) levels
+	if (depth + 24 >= MaxDepth)
+	{
+		SplitMedian(index, depth);
+		return;
+	}
+
+	BuildBox* first = buildBoxes.data() + nodes[index].first;
+	BuildBox* last = first + count;
+	XMFLOAT3 centroidMin(FLT_MAX, FLT_MAX, FLT_MAX);
+	XMFLOAT3 centroidMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (BuildBox* box = first; box < last; box++)
+		Grow(centroidMin, centroidMax, box->centroid, box->centroid);
+
+	Bin bins[3][BinCount];
+	float scale[3];
+	for (unsigned int axis = 0; axis < 3; axis++)
+	{
+		float extent = Component(centroidMax, axis) - Component(centroidMin, axis);
+		scale[axis] = extent > 0.0f ? BinCount / extent : 0.0f;
+		for (Bin& bin : bins[axis])
+		{
+			bin.min = XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
+			bin.max = XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+			bin.count = 0;
+		}
+	}
+
+	auto binOf = [&](const BuildBox& box, unsigned int axis)
+	{
+		float offset = (Component(box.centroid, axis) - Component(centroidMin, axis)) * scale[axis];
+		return (std::min)((unsigned int)offset, BinCount - 1);
+	};
+
+	for (BuildBox* box = first; box < last; box++)
+	{
+		for (unsigned int axis = 0; axis < 3; axis++)
+		{
+			if (scale[axis] == 0.0f)
+				continue;
+			Bin& bin = bins[axis][binOf(*box, axis)];
+			Grow(bin.min, bin.max, box->min, box->max);
+			bin.count++;
+		}
+	}
+
+	// Sweep each axis both ways for the areas either side of each plane
+	float bestCost = FLT_MAX;
+	unsigned int bestAxis = 0;
+	unsigned int bestSplit = 0;
+	for (unsigned int axis = 0; axis < 3; axis++)
+	{
+		if (scale[axis] == 0.0f)
+			continue;
+
+		float leftCost[BinCount];
+		XMFLOAT3 sweepMin(FLT_MAX, FLT_MAX, FLT_MAX);
+		XMFLOAT3 sweepMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		uint32_t leftCount = 0;
+		for (unsigned int b = 0; b < BinCount - 1; b++)
+		{
+			if (bins[axis][b].count > 0)
+				Grow(sweepMin, sweepMax, bins[axis][b].min, bins[axis][b].max);
+			leftCount += bins[axis][b].count;
+			leftCost[b] = leftCount > 0 ? SurfaceArea(sweepMin, sweepMax) * leftCount : 0.0f;
+		}
+
+		sweepMin = XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
+		sweepMax = XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		uint32_t rightCount = 0;
+		for (unsigned int b = BinCount - 1; b > 0; b--)
+		{
+			if (bins[axis][b].count > 0)
+				Grow(sweepMin, sweepMax, bins[axis][b].min, bins[axis][b].max);
+			rightCount += bins[axis][b].count;
+
+			// Plane between bins b - 1 and b
+			if (rightCount == 0 || rightCount == count)
+				continue;
+			float cost = leftCost[b - 1] + SurfaceArea(sweepMin, sweepMax) * rightCount;
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = b;
+			}
+		}
+	}
+
+	// Every centroid in the same spot - nothing to bin on
+	if (bestCost == FLT_MAX)
+	{
+		if (count > MaxLeafSize)
+			SplitMedian(index, depth);
+		return;
+	}
+
+	float area = SurfaceArea(nodes[index].min, nodes[index].max);
+	float splitCost = 1.0f + (area > 0.0f ? bestCost / area : 0.0f);
+	if (count <= MaxLeafSize && (float)count <= splitCost)
+		return;
+
+	BuildBox* middle = std::partition(first, last, [&](const BuildBox& box) { return binOf(box, bestAxis) < bestSplit; });
+	uint32_t left = AddChildren(index, (uint32_t)(middle - first));
+	Subdivide(left, depth + 1);
+	Subdivide(left + 1, depth + 1);
+}
+
+// --------------------------------------------------------
+// Halves a node by count along its longest axis - for when
+// binning can't separate the centroids, or the tree is deep
+// --------------------------------------------------------
+void EntityBVH::SplitMedian(uint32_t index, unsigned int depth)
+{
+	stats.depth = (std::max)(stats.depth, depth);
+	uint32_t count = nodes[index].count;
+	if (count <= MaxLeafSize)
+		return;
+
+	XMFLOAT3 size(
+		nodes[index].max.x - nodes[index].min.x,
+		nodes[index].max.y - nodes[index].min.y,
+		nodes[index].max.z - nodes[index].min.z);
+	unsigned int axis = size.x >= size.y && size.x >= size.z ? 0 : size.y >= size.z ? 1 : 2;
+	BuildBox* first = buildBoxes.data() + nodes[index].first;
+	std::nth_element(first, first + count / 2, first + count,
+		[&](const BuildBox& a, const BuildBox& b) { return Component(a.centroid, axis) < Component(b.centroid, axis); });
+
+	uint32_t left = AddChildren(index, count / 2);
+	SplitMedian(left, depth + 1);
+	SplitMedian(left + 1, depth + 1);
+}
+
+// Turns a leaf whose boxes are partitioned into an inner node with
+// two leaf children, returning the first child
+uint32_t EntityBVH::AddChildren(uint32_t index, uint32_t leftCount)
+{
+	uint32_t first = nodes[index].first;
+	uint32_t counts[2] = { leftCount, nodes[index].count - leftCount };
+	uint32_t left = (uint32_t)nodes.size();
+	for (int child = 0; child < 2; child++)
+	{
+		Node node;
+		node.first = child == 0 ? first : first + leftCount;
+		node.count = counts[child];
+		node.min = XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
+		node.max = XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		for (uint32_t i = node.first; i < node.first + node.count; i++)
+			Grow(node.min, node.max, buildBoxes[i].min, buildBoxes[i].max);
+		nodes.push_back(node);
+		parents.push_back(index);
+	}
+
+	nodes[index].first = left;
+	nodes[index].count = 0;
+	return left;
+}
+
+void EntityBVH::ComputeNodeBounds(Node& node) const
+{
+	node.min = XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
+	node.max = XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	if (node.count > 0)
+	{
+		for (uint32_t i = node.first; i < node.first + node.count; i++)
+			Grow(node.min, node.max, boxMin[order[i]], boxMax[order[i]]);
+	}
+	else
+	{
+		Grow(node.min, node.max, nodes[node.first].min, nodes[node.first].max);
+		Grow(node.min, node.max, nodes[node.first + 1].min, nodes[node.first + 1].max);
+	}
+}
+
+// A node's share of the SAH cost, times the root's area
+double EntityBVH::NodeWeight(const Node& node) const
+{
+	return (double)SurfaceArea(node.min, node.max) * (node.count > 0 ? node.count : 1);
+}
+
+float EntityBVH::RootArea() const
+{
+	return nodes.empty() ? 0.0f : SurfaceArea(nodes[0].min, nodes[0].max);
+}
+
+void EntityBVH::QueryFrustum(const Frustum& frustum, std::vector<uint32_t>& results) const
+{
+	if (nodes.empty())
+		return;
+
+	XMVECTOR planes[6];
+	XMVECTOR positive[6];	// Which corner is farthest along each normal
+	for (int p = 0; p < 6; p++)
+	{
+		planes[p] = XMLoadFloat4(&frustum.planes[p]);
+		positive[p] = XMVectorGreaterOrEqual(planes[p], XMVectorZero());
+	}
+
+	// Bit p set while plane p still has to be tested
+	struct Entry { uint32_t node; uint32_t planeMask; };
+	Entry stack[MaxDepth];
+	unsigned int top = 0;
+	stack[top++] = { 0, 0x3F };
+	while (top > 0)
+	{
+		Entry entry = stack[--top];
+		const Node& node = nodes[entry.node];
+		XMVECTOR min = XMLoadFloat3(&node.min);
+		XMVECTOR max = XMLoadFloat3(&node.max);
+
+		uint32_t mask = entry.planeMask;
+		bool outside = false;
+		for (int p = 0; p < 6 && mask != 0; p++)
+		{
+			if (!(mask & (1u << p)))
+				continue;
+
+			XMVECTOR farCorner = XMVectorSelect(min, max, positive[p]);
+			if (XMVectorGetX(XMPlaneDotCoord(planes[p], farCorner)) < 0.0f)
+			{
+				outside = true;
+				break;
+			}
+			XMVECTOR nearCorner = XMVectorSelect(max, min, positive[p]);
+			if (XMVectorGetX(XMPlaneDotCoord(planes[p], nearCorner)) >= 0.0f)
+				mask &= ~(1u << p);
+		}
+		if (outside)
+			continue;
+
+		if (node.count == 0)
+		{
+			stack[top++] = { node.first, mask };
+			stack[top++] = { node.first + 1, mask };
+			continue;
+		}
+
+		for (uint32_t i = node.first; i < node.first + node.count; i++)
+		{
+			uint32_t box = order[i];
+			if (mask == 0 || frustum.Intersects(boxes[box]))
+				results.push_back(box);
+		}
+	}
+}
+
+void EntityBVH::QuerySphere(XMFLOAT3 center, float radius, std::vector<uint32_t>& results) const
+{
+	if (nodes.empty())
+		return;
+
+	XMVECTOR c = XMLoadFloat3(&center);
+	float radiusSquared = radius * radius;
+	uint32_t stack[MaxDepth];
+	unsigned int top = 0;
+	stack[top++] = 0;
+	while (top > 0)
+	{
+		const Node& node = nodes[stack[--top]];
+		if (!SphereOverlaps(XMLoadFloat3(&node.min), XMLoadFloat3(&node.max), c, radiusSquared))
+			continue;
+
+		if (node.count == 0)
+		{
+			stack[top++] = node.first;
+			stack[top++] = node.first + 1;
+			continue;
+		}
+
+		for (uint32_t i = node.first; i < node.first + node.count; i++)
+		{
+			uint32_t box = order[i];
+			if (SphereOverlaps(XMLoadFloat3(&boxMin[box]), XMLoadFloat3(&boxMax[box]), c, radiusSquared))
+				results.push_back(box);
+		}
+	}
+}
+
+void EntityBVH::QueryBox(const AABB& query, std::vector<uint32_t>& results) const
+{
+	if (nodes.empty())
+		return;
+
+	XMVECTOR queryMin = XMVectorSubtract(XMLoadFloat3(&query.center), XMLoadFloat3(&query.extents));
+	XMVECTOR queryMax = XMVectorAdd(XMLoadFloat3(&query.center), XMLoadFloat3(&query.extents));
+	uint32_t stack[MaxDepth];
+	unsigned int top = 0;
+	stack[top++] = 0;
+	while (top > 0)
+	{
+		const Node& node = nodes[stack[--top]];
+		if (!BoxesOverlap(XMLoadFloat3(&node.min), XMLoadFloat3(&node.max), queryMin, queryMax))
+			continue;
+
+		if (node.count == 0)
+		{
+			stack[top++] = node.first;
+			stack[top++] = node.first + 1;
+			continue;
+		}
+
+		for (uint32_t i = node.first; i < node.first + node.count; i++)
+		{
+			uint32_t box = order[i];
+			if (BoxesOverlap(XMLoadFloat3(&boxMin[box]), XMLoadFloat3(&boxMax[box]), queryMin, queryMax))
+				results.push_back(box);
+		}
+	}
+}
+
+void EntityBVH::QueryRay(XMFLOAT3 origin, XMFLOAT3 direction, float maxDistance, std::vector<uint32_t>& results) const
+{
+	if (nodes.empty())
+		return;
+
+	XMVECTOR o = XMLoadFloat3(&origin);
+	XMVECTOR inverseDirection = InverseDirection(direction);
+	uint32_t stack[MaxDepth];
+	unsigned int top = 0;
+	stack[top++] = 0;
+	while (top > 0)
+	{
+		const Node& node = nodes[stack[--top]];
+		if (RayEntry(XMLoadFloat3(&node.min), XMLoadFloat3(&node.max), o, inverseDirection, maxDistance) == FLT_MAX)
+			continue;
+
+		if (node.count == 0)
+		{
+			stack[top++] = node.first;
+			stack[top++] = node.first + 1;
+			continue;
+		}
+
+		for (uint32_t i = node.first; i < node.first + node.count; i++)
+		{
+			uint32_t box = order[i];
+			if (RayEntry(XMLoadFloat3(&boxMin[box]), XMLoadFloat3(&boxMax[box]), o, inverseDirection, maxDistance) != FLT_MAX)
+				results.push_back(box);
+		}
+	}
+}
+
+uint32_t EntityBVH::Raycast(XMFLOAT3 origin, XMFLOAT3 direction, float maxDistance,
+	const std::function<float(uint32_t index, float boxDistance)>& intersect, float* hitDistance) const
+{
+	uint32_t hit = UINT32_MAX;
+	float nearest = maxDistance;
+	if (!nodes.empty())
+	{
+		XMVECTOR o = XMLoadFloat3(&origin);
+		XMVECTOR inverseDirection = InverseDirection(direction);
+
+		struct Entry { uint32_t node; float entry; };
+		Entry stack[MaxDepth];
+		unsigned int top = 0;
+		float rootEntry = RayEntry(XMLoadFloat3(&nodes[0].min), XMLoadFloat3(&nodes[0].max), o, inverseDirection, nearest);
+		if (rootEntry != FLT_MAX)
+			stack[top++] = { 0, rootEntry };
+
+		while (top > 0)
+		{
+			Entry entry = stack[--top];
+			if (entry.entry > nearest)
+				continue;
+
+			const Node& node = nodes[entry.node];
+			if (node.count == 0)
+			{
+				// Nearer child on top, so its hits shrink the ray first
+				const Node& a = nodes[node.first];
+				const Node& b = nodes[node.first + 1];
+				float entryA = RayEntry(XMLoadFloat3(&a.min), XMLoadFloat3(&a.max), o, inverseDirection, nearest);
+				float entryB = RayEntry(XMLoadFloat3(&b.min), XMLoadFloat3(&b.max), o, inverseDirection, nearest);
+				Entry first = { node.first, entryA };
+				Entry second = { node.first + 1, entryB };
+				if (entryB < entryA)
+					std::swap(first, second);
+				if (second.entry != FLT_MAX)
+					stack[top++] = second;
+				if (first.entry != FLT_MAX)
+					stack[top++] = first;
+				continue;
+			}
+
+			for (uint32_t i = node.first; i < node.first + node.count; i++)
+			{
+				uint32_t box = order[i];
+				float boxEntry = RayEntry(XMLoadFloat3(&boxMin[box]), XMLoadFloat3(&boxMax[box]), o, inverseDirection, nearest);
+				if (boxEntry == FLT_MAX)
+					continue;
+
+				float distance = intersect ? intersect(box, boxEntry) : boxEntry;
+				if (distance == FLT_MAX)
+					continue;
+				if (distance <= nearest && (hit == UINT32_MAX || distance < nearest || box < hit))
+				{
+					nearest = distance;
+					hit = box;
+				}
+			}
+		}
+	}
+
+	if (hitDistance)
+		*hitDistance = hit == UINT32_MAX ? FLT_MAX : nearest;
+	return hit;
+}
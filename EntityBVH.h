@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include <DirectXMath.h>
+#include "Bounds.h"
+
+// --------------------------------------------------------
+// Shape of the tree, and the refits since it was built
+// --------------------------------------------------------
+struct EntityBVHStats
+{
+	size_t nodes = 0;
+	size_t leaves = 0;
+	unsigned int depth = 0;
+	float buildCost = 0.0f;		// SAH cost right after the build
+	float cost = 0.0f;			// After the refits since
+	size_t refits = 0;
+	size_t refitNodes = 0;		// Nodes recomputed by the last Refit()
+	unsigned int rebuilds = 0;	// By Refit(), since the last Build()
+};
+
+// --------------------------------------------------------
+// Bounding volume hierarchy over world space boxes - entity
+// bounds, indexed like the entity list.
+//
+// Build() is a binned SAH build (16 bins on the centroids, up
+// to 4 boxes per leaf).  Nodes are laid out depth first with
+// both children of a node next to each other, so a child's
+// index is always greater than its parent's.
+//
+// Moving a box doesn't change the tree: Update() records the
+// new bounds and marks its leaf, and Refit() recomputes the
+// marked leaves and their ancestors, children before parents.
+// The SAH cost is kept up to date through the refit, and once
+// it has grown by RebuildRatio over the cost at the last build
+// the tree is rebuilt - boxes that moved apart no longer share
+// tight nodes, and every query pays for it.
+//
+// Queries walk the tree with a fixed stack, testing each node
+// with DirectXMath vectors:
+//  - frustum: planes a node is wholly inside are dropped for
+//    its children, and a node inside all of them adds its whole
+//    subtree untested
+//  - sphere and box: overlap tests
+//  - ray: the slab test, nearer child first, and Raycast()
+//    shrinks the ray as hits are found
+// Queries are const and safe from several threads at once, but
+// not during Build(), Update() or Refit().
+// --------------------------------------------------------
+class EntityBVH
+{
+public:
+	static const unsigned int MaxLeafSize = 4;
+	static const unsigned int BinCount = 16;
+	static const unsigned int MaxDepth = 64;		// Traversal stack size
+	static constexpr float RebuildRatio = 1.5f;
+
+	void Build(const AABB* bounds, size_t count);
+
+	// Bounds of box index changed - takes effect at the next Refit()
+	void Update(size_t index, const AABB& bounds);
+
+	// Refits everything Update() touched, or rebuilds if the tree has
+	// degraded.  True if it rebuilt.
+	bool Refit();
+
+	// Each appends the indices of the boxes it touches, in no order
+	void QueryFrustum(const Frustum& frustum, std::vector<uint32_t>& results) const;
+	void QuerySphere(DirectX::XMFLOAT3 center, float radius, std::vector<uint32_t>& results) const;
+	void QueryBox(const AABB& box, std::vector<uint32_t>& results) const;
+	void QueryRay(DirectX::XMFLOAT3 origin, DirectX::XMFLOAT3 direction, float maxDistance, std::vector<uint32_t>& results) const;
+
+	// Nearest hit along the ray, distances in units of direction.
+	// intersect(index, boxDistance) is called for each box the ray
+	// enters before the nearest hit so far, and returns its own hit
+	// distance (FLT_MAX for a miss) - or leave it empty to hit the
+	// boxes themselves.  Returns UINT32_MAX if nothing was hit.
+	uint32_t Raycast(DirectX::XMFLOAT3 origin, DirectX::XMFLOAT3 direction, float maxDistance,
+		const std::function<float(uint32_t index, float boxDistance)>& intersect, float* hitDistance = nullptr) const;
+
+	size_t GetCount() const { return boxes.size(); }
+	const std::vector<AABB>& GetBounds() const { return boxes; }	// As last given, by index
+	const EntityBVHStats& GetStats() const { return stats; }
+
+private:
+	// Leaves have count > 0 and their boxes at first; inner nodes
+	// have count 0 and their children at first and first + 1
+	struct Node
+	{
+		DirectX::XMFLOAT3 min;
+		uint32_t first;
+		DirectX::XMFLOAT3 max;
+		uint32_t count;
+	};
+
+	// A box during the build, moved around with the partitions so
+	// each node's boxes are next to each other in memory
+	struct BuildBox
+	{
+		DirectX::XMFLOAT3 centroid;
+		uint32_t index;
+		DirectX::XMFLOAT3 min;
+		DirectX::XMFLOAT3 max;
+	};
+
+	struct Bin
+	{
+		DirectX::XMFLOAT3 min;
+		DirectX::XMFLOAT3 max;
+		uint32_t count;
+	};
+
+	std::vector<AABB> boxes;			// As given, by index
+	std::vector<DirectX::XMFLOAT3> boxMin;
+	std::vector<DirectX::XMFLOAT3> boxMax;
+	std::vector<Node> nodes;
+	std::vector<uint32_t> parents;		// Per node, root's is itself
+	std::vector<uint32_t> order;		// Box indices, leaves point into this
+	std::vector<uint32_t> leafOf;		// Per box
+	std::vector<uint8_t> nodeDirty;
+	std::vector<uint32_t> dirtyLeaves;
+	std::vector<uint32_t> refitNodes;	// Scratch
+	std::vector<BuildBox> buildBoxes;	// Build scratch
+
+	double weightedArea = 0.0;			// SAH cost times the root's area
+	EntityBVHStats stats;
+
+	void Rebuild();
+	void Subdivide(uint32_t node, unsigned int depth);
+	void SplitMedian(uint32_t node, unsigned int depth);
+	uint32_t AddChildren(uint32_t node, uint32_t leftCount);
+	void ComputeNodeBounds(Node& node) const;
+	double NodeWeight(const Node& node) const;
+	float RootArea() const;
+};
@@ -0,0 +1,275 @@
+#include "EntityBVHTests.h"
+#include "HeadlessTests.h"
+#include "EntityBVH.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+	// Everything the BVH queries test, one box at a time
+	struct LinearQueries
+	{
+		const std::vector<AABB>& boxes;
+
+		void InFrustum(const Frustum& frustum, std::vector<uint32_t>& results) const
+		{
+			for (uint32_t i = 0; i < (uint32_t)boxes.size(); i++)
+			{
+				if (frustum.Intersects(boxes[i]))
+					results.push_back(i);
+			}
+		}
+
+		void InSphere(XMFLOAT3 center, float radius, std::vector<uint32_t>& results) const
+		{
+			for (uint32_t i = 0; i < (uint32_t)boxes.size(); i++)
+			{
+				const AABB& box = boxes[i];
+				float dx = (std::max)(fabsf(center.x - box.center.x) - box.extents.x, 0.0f);
+				float dy = (std::max)(fabsf(center.y - box.center.y) - box.extents.y, 0.0f);
+				float dz = (std::max)(fabsf(center.z - box.center.z) - box.extents.z, 0.0f);
+				if (dx * dx + dy * dy + dz * dz <= radius * radius)
+					results.push_back(i);
+			}
+		}
+
+		void InBox(const AABB& query, std::vector<uint32_t>& results) const
+		{
+			for (uint32_t i = 0; i < (uint32_t)boxes.size(); i++)
+			{
+				const AABB& box = boxes[i];
+				if (fabsf(box.center.x - query.center.x) <= box.extents.x + query.extents.x &&
+					fabsf(box.center.y - query.center.y) <= box.extents.y + query.extents.y &&
+					fabsf(box.center.z - query.center.z) <= box.extents.z + query.extents.z)
+					results.push_back(i);
+			}
+		}
+
+		// Entry distance of every box the ray hits within maxDistance
+		void OnRay(XMFLOAT3 origin, XMFLOAT3 direction, float maxDistance, std::vector<uint32_t>& results, std::vector<float>& entries) const
+		{
+			const float o[3] = { origin.x, origin.y, origin.z };
+			const float d[3] = { direction.x, direction.y, direction.z };
+			for (uint32_t i = 0; i < (uint32_t)boxes.size(); i++)
+			{
+				const AABB& box = boxes[i];
+				const float c[3] = { box.center.x, box.center.y, box.center.z };
+				const float e[3] = { box.extents.x, box.extents.y, box.extents.z };
+				float entry = 0.0f;
+				float exit = maxDistance;
+				for (int axis = 0; axis < 3 && entry <= exit; axis++)
+				{
+					float inverse = 1.0f / (fabsf(d[axis]) < 1e-20f ? 1e-20f : d[axis]);
+					float t0 = (c[axis] - e[axis] - o[axis]) * inverse;
+					float t1 = (c[axis] + e[axis] - o[axis]) * inverse;
+					entry = (std::max)(entry, (std::min)(t0, t1));
+					exit = (std::min)(exit, (std::max)(t0, t1));
+				}
+				if (entry <= exit)
+				{
+					results.push_back(i);
+					entries.push_back(entry);
+				}
+			}
+		}
+	};
+
+	AABB RandomBenchBox(std::mt19937& rng, float worldSize)
+	{
+		std::uniform_real_distribution<float> position(-worldSize * 0.5f, worldSize * 0.5f);
+		std::uniform_real_distribution<float> extent(0.2f, 1.0f);
+		AABB box;
+		box.center = XMFLOAT3(position(rng), position(rng), position(rng));
+		box.extents = XMFLOAT3(extent(rng), extent(rng), extent(rng));
+		return box;
+	}
+}
+
+int RunBVHBench(const BVHBenchSettings& settings)
+{
+	printf("BVH bench: %d queries of each kind (%d checked linearly), %d refit frames\n",
+		settings.queries, settings.checkedQueries, settings.refitFrames);
+	int failures = 0;
+	char detail[256];
+
+	std::vector<int> sizes;
+	for (int size = 10000; size <= settings.maxEntityCount; size *= 10)
+		sizes.push_back(size);
+	if (sizes.empty() || sizes.back() != settings.maxEntityCount)
+		sizes.push_back(settings.maxEntityCount);
+
+	for (int size : sizes)
+	{
+		// One box per 10 x 10 x 10 cell on average, whatever the count
+		float worldSize = 10.0f * cbrtf((float)size);
+		std::mt19937 rng(37);
+		std::vector<AABB> boxes(size);
+		for (AABB& box : boxes)
+			box = RandomBenchBox(rng, worldSize);
+
+		EntityBVH bvh;
+		double buildMs = DBL_MAX;
+		for (int repeat = 0; repeat < (size >= 1000000 ? 1 : 3); repeat++)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			bvh.Build(boxes.data(), boxes.size());
+			buildMs = (std::min)(buildMs, Milliseconds(std::chrono::high_resolution_clock::now() - start));
+		}
+		EntityBVHStats built = bvh.GetStats();
+		printf("\n  %d boxes: build %.2f ms, %zu nodes, %zu leaves, depth %u, SAH cost %.1f\n",
+			size, buildMs, built.nodes, built.leaves, built.depth, built.buildCost);
+
+		// Queries, checked against a linear walk - run before and after
+		// the refits, reporting the timings of the second
+		LinearQueries linear = { boxes };
+		auto runQueries = [&](bool print) -> bool
+		{
+			std::mt19937 queryRng(41);
+			std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+			std::uniform_real_distribution<float> position(-worldSize * 0.5f, worldSize * 0.5f);
+
+			struct Kind { const char* name; double bvhMs; double linearMs; size_t hits; };
+			Kind kinds[4] = { { "frustum", 0, 0, 0 }, { "sphere", 0, 0, 0 }, { "box", 0, 0, 0 }, { "ray", 0, 0, 0 } };
+			bool matched = true;
+			std::vector<uint32_t> results;
+			std::vector<uint32_t> expected;
+			std::vector<float> entries;
+			for (int q = 0; q < settings.queries; q++)
+			{
+				bool check = q < settings.checkedQueries;
+				XMFLOAT3 point(position(queryRng), position(queryRng), position(queryRng));
+				XMFLOAT3 direction(unit(queryRng) * 2.0f - 1.0f, unit(queryRng) * 2.0f - 1.0f, unit(queryRng) * 2.0f - 1.0f);
+				XMStoreFloat3(&direction, XMVector3Normalize(XMLoadFloat3(&direction)));
+
+				// 60 degree view, 50 units deep
+				XMFLOAT4X4 viewProjection;
+				XMStoreFloat4x4(&viewProjection, XMMatrixMultiply(
+					XMMatrixLookToLH(XMLoadFloat3(&point), XMLoadFloat3(&direction), fabsf(direction.y) > 0.99f ? XMVectorSet(1, 0, 0, 0) : XMVectorSet(0, 1, 0, 0)),
+					XMMatrixPerspectiveFovLH(XM_PI / 3.0f, 16.0f / 9.0f, 0.1f, 50.0f)));
+				Frustum frustum = Frustum::FromViewProjection(viewProjection);
+				AABB query;
+				query.center = point;
+				query.extents = XMFLOAT3(5.0f, 5.0f, 5.0f);
+
+				for (int kind = 0; kind < 4; kind++)
+				{
+					results.clear();
+					auto start = std::chrono::high_resolution_clock::now();
+					switch (kind)
+					{
+					case 0: bvh.QueryFrustum(frustum, results); break;
+					case 1: bvh.QuerySphere(point, 5.0f, results); break;
+					case 2: bvh.QueryBox(query, results); break;
+					case 3: bvh.QueryRay(point, direction, 100.0f, results); break;
+					}
+					kinds[kind].bvhMs += Milliseconds(std::chrono::high_resolution_clock::now() - start);
+					kinds[kind].hits += results.size();
+					if (!check)
+						continue;
+
+					expected.clear();
+					entries.clear();
+					start = std::chrono::high_resolution_clock::now();
+					switch (kind)
+					{
+					case 0: linear.InFrustum(frustum, expected); break;
+					case 1: linear.InSphere(point, 5.0f, expected); break;
+					case 2: linear.InBox(query, expected); break;
+					case 3: linear.OnRay(point, direction, 100.0f, expected, entries); break;
+					}
+					kinds[kind].linearMs += Milliseconds(std::chrono::high_resolution_clock::now() - start);
+					matched &= SameIndices(results, expected);
+
+					// The nearest of them, ties to either
+					if (kind == 3)
+					{
+						float nearest = FLT_MAX;
+						for (float entry : entries)
+							nearest = (std::min)(nearest, entry);
+						float hitDistance;
+						uint32_t hit = bvh.Raycast(point, direction, 100.0f, nullptr, &hitDistance);
+						matched &= entries.empty() ? hit == UINT32_MAX : (hit != UINT32_MAX && fabsf(hitDistance - nearest) <= 1e-4f);
+					}
+				}
+			}
+
+			if (print)
+			{
+				int checked = (std::min)(settings.queries, settings.checkedQueries);
+				printf("    query      bvh us   linear us   speedup   hits each\n");
+				for (const Kind& kind : kinds)
+				{
+					double bvhUs = kind.bvhMs * 1000.0 / settings.queries;
+					double linearUs = checked > 0 ? kind.linearMs * 1000.0 / checked : 0.0;
+					printf("    %-7s %9.2f %11.1f %8.0fx %11.1f\n",
+						kind.name, bvhUs, linearUs, bvhUs > 0.0 ? linearUs / bvhUs : 0.0, (double)kind.hits / settings.queries);
+				}
+			}
+			return matched;
+		};
+
+		bool builtMatched = runQueries(false);
+
+		// A tenth of the boxes nudged by up to half a unit each frame
+		double refitMs = 0.0;
+		size_t moved = boxes.size() / 10;
+		std::uniform_real_distribution<float> nudge(-0.5f, 0.5f);
+		std::uniform_int_distribution<size_t> pick(0, boxes.size() - 1);
+		for (int frame = 0; frame < settings.refitFrames; frame++)
+		{
+			std::vector<size_t> movedIndices(moved);
+			for (size_t& index : movedIndices)
+			{
+				index = pick(rng);
+				boxes[index].center.x += nudge(rng);
+				boxes[index].center.y += nudge(rng);
+				boxes[index].center.z += nudge(rng);
+			}
+
+			auto start = std::chrono::high_resolution_clock::now();
+			for (size_t index : movedIndices)
+				bvh.Update(index, boxes[index]);
+			bvh.Refit();
+			refitMs += Milliseconds(std::chrono::high_resolution_clock::now() - start);
+		}
+		const EntityBVHStats& refitted = bvh.GetStats();
+		printf("    refit, %zu moved a frame: %.2f ms (%zu nodes), SAH cost %.1f -> %.1f, %u rebuilds\n",
+			moved, settings.refitFrames > 0 ? refitMs / settings.refitFrames : 0.0, refitted.refitNodes,
+			built.buildCost, refitted.cost, refitted.rebuilds);
+
+		bool refitMatched = runQueries(true);
+		snprintf(detail, sizeof(detail), "%d boxes", size);
+		failures += ReportCheck("queries match a linear walk after build", builtMatched, detail);
+		failures += ReportCheck("queries match a linear walk after refits", refitMatched, detail);
+
+		// Teleports wreck the tree until it's rebuilt
+		unsigned int rebuildsBefore = refitted.rebuilds;
+		int framesToRebuild = 0;
+		while (bvh.GetStats().rebuilds == rebuildsBefore && framesToRebuild < 100)
+		{
+			for (size_t i = 0; i < moved; i++)
+			{
+				size_t index = pick(rng);
+				boxes[index] = RandomBenchBox(rng, worldSize);
+				bvh.Update(index, boxes[index]);
+			}
+			bvh.Refit();
+			framesToRebuild++;
+		}
+		bool rebuilt = bvh.GetStats().rebuilds > rebuildsBefore;
+		snprintf(detail, sizeof(detail), "%d frames of %zu teleports past SAH cost %.1f, now %.1f",
+			framesToRebuild, moved, built.buildCost * EntityBVH::RebuildRatio, bvh.GetStats().cost);
+		failures += ReportCheck("degrading the tree rebuilds it", rebuilt && bvh.GetStats().cost <= built.buildCost * 1.1f, detail);
+		failures += ReportCheck("queries match a linear walk after rebuild", runQueries(false), detail);
+	}
+
+	return ReportFailures(failures);
+}
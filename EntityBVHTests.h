@@ -0,0 +1,30 @@
+#pragma once
+
+// --------------------------------------------------------
+// Headless CPU benchmark of the entity BVH - no GPU.
+//
+// Random boxes at a constant density, at 10k, 100k and 1M
+// (up to maxEntityCount).  For each size it times:
+//  - Build()
+//  - Update() + Refit() with a tenth of the boxes nudged a
+//    little every frame
+//  - frustum, sphere, box and ray queries, against a linear
+//    walk over every box
+//
+// Checks, printed per size:
+//  - every query returns exactly what the linear walk finds,
+//    before and after the refits, and Raycast() the nearest box
+//  - teleporting boxes across the world degrades the tree until
+//    Refit() rebuilds it, and the rebuilt cost is back down
+//
+// Returns 0 if all checks passed.
+// --------------------------------------------------------
+struct BVHBenchSettings
+{
+	int maxEntityCount = 1000000;
+	int queries = 1000;			// Of each kind, per size
+	int checkedQueries = 50;	// Of those, also walked linearly
+	int refitFrames = 20;
+};
+
+int RunBVHBench(const BVHBenchSettings& settings);
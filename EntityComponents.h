@@ -0,0 +1,118 @@
+#pragma once
+
+#include <climits>
+#include <cstdint>
+#include <DirectXMath.h>
+#include "AnimationClip.h"
+#include "Bounds.h"
+#include "EntityStore.h"
+#include "ResourceRegistry.h"
+#include "Transform.h"
+
+// --------------------------------------------------------
+// The components a scene entity is made of.  Transform is the
+// existing class, stored as is.
+// --------------------------------------------------------
+
+// The mesh's bounds under the transform, as of a transform
+// version - UpdateWorldBounds() keeps it current.  Reset the
+// version after swapping the mesh.
+struct WorldBounds
+{
+	AABB box;
+	unsigned int transformVersion = UINT_MAX;
+};
+
+// Handles into the ResourceRegistry - an entity whose mesh or
+// material was released still exists, but isn't drawn
+struct MeshRef
+{
+	MeshHandle mesh;
+};
+
+struct MaterialRef
+{
+	MaterialHandle material;
+};
+
+struct RenderFlags
+{
+	// Static entities are expected to (almost) never move - their
+	// shadows are cached, and moving one redraws part of the cache
+	bool isStatic = false;
+
+	// Occluders are drawn into the software depth buffer, and hide
+	// whatever is behind them from the main pass
+	bool isOccluder = false;
+};
+
+// Simple procedural motion, applied by AnimateEntities()
+enum class AnimationKind : uint8_t
+{
+	Spin,		// Roll by rate radians a second
+	Sway,		// x = origin.x + sin(time * rate) * amount
+	Pulse		// x and y scale = 1 + sin(time * rate) * amount
+};
+
+struct AnimationState
+{
+	AnimationKind kind = AnimationKind::Spin;
+	float rate = 1.0f;
+	float amount = 0.0f;
+	DirectX::XMFLOAT3 origin = DirectX::XMFLOAT3(0, 0, 0);
+
+	static AnimationState Spin(float rate) { return Make(AnimationKind::Spin, rate, 0.0f, DirectX::XMFLOAT3(0, 0, 0)); }
+	static AnimationState Sway(DirectX::XMFLOAT3 origin, float rate, float amount) { return Make(AnimationKind::Sway, rate, amount, origin); }
+	static AnimationState Pulse(float rate, float amount) { return Make(AnimationKind::Pulse, rate, amount, DirectX::XMFLOAT3(0, 0, 0)); }
+
+private:
+	static AnimationState Make(AnimationKind kind, float rate, float amount, DirectX::XMFLOAT3 origin)
+	{
+		AnimationState state;
+		state.kind = kind;
+		state.rate = rate;
+		state.amount = amount;
+		state.origin = origin;
+		return state;
+	}
+};
+
+// A keyframed clip playing on the entity, applied by
+// PlayAnimations().  The clip's positions are relative to origin;
+// channels the clip doesn't have are left to whatever else moves
+// the entity.
+struct AnimationPlayer
+{
+	AnimationClipHandle clip;
+	float time = 0.0f;			// Into the clip, in seconds
+	float speed = 1.0f;
+	DirectX::XMFLOAT3 origin = DirectX::XMFLOAT3(0, 0, 0);
+	AnimationCursor cursor;
+};
+
+// A transform as the renderer interpolates it: position,
+// orientation quaternion and scale
+struct TransformPose
+{
+	DirectX::XMFLOAT3 position = DirectX::XMFLOAT3(0, 0, 0);
+	DirectX::XMFLOAT4 orientation = DirectX::XMFLOAT4(0, 0, 0, 1);
+	DirectX::XMFLOAT3 scale = DirectX::XMFLOAT3(1, 1, 1);
+};
+
+// The transform at the end of each of the last two simulation
+// ticks, kept by RecordTickPoses(), so InterpolateTransforms()
+// can draw the entity anywhere between them.  Only entities the
+// simulation moves need one.
+struct TransformHistory
+{
+	TransformPose previous;
+	TransformPose current;
+	uint32_t ticks = 0;		// Recorded so far, up to 2
+};
+
+// What each system walks
+typedef EntityQuery<Transform, AnimationState> AnimatedQuery;
+typedef EntityQuery<Transform, AnimationPlayer> AnimationPlayerQuery;
+typedef EntityQuery<Transform, MeshRef, WorldBounds> BoundsQuery;
+typedef EntityQuery<Transform, WorldBounds, MeshRef, MaterialRef, RenderFlags> RenderQuery;
+typedef EntityQuery<Transform, TransformHistory> InterpolatedQuery;
@@ -0,0 +1,253 @@
+#include "EntityStore.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+ComponentTypes::Info ComponentTypes::infos[ComponentTypes::MaxComponents];
+std::atomic<unsigned int> ComponentTypes::count{ 0 };
+
+// Called once per type, from the first Id<T>().  The info is
+// written before the id escapes, so readers of the id see it.
+unsigned int ComponentTypes::Register(size_t size, size_t alignment)
+{
+	unsigned int id = count.fetch_add(1);
+	if (id >= MaxComponents)
+		abort();
+	infos[id] = { size, alignment };
+	return id;
+}
+
+size_t EntityStore::GetChunkCount() const
+{
+	size_t chunks = 0;
+	for (const std::unique_ptr<Archetype>& archetype : archetypes)
+		chunks += archetype->chunks.size();
+	return chunks;
+}
+
+void EntityStore::GatherChunks(uint32_t mask, std::vector<EntityChunk*>& chunks) const
+{
+	for (const std::unique_ptr<Archetype>& archetype : archetypes)
+	{
+		if ((archetype->mask & mask) != mask)
+			continue;
+		for (const std::unique_ptr<EntityChunk>& chunk : archetype->chunks)
+			chunks.push_back(chunk.get());
+	}
+}
+
+EntityId EntityStore::AllocateId()
+{
+	if (!freeIds.empty())
+	{
+		EntityId entity = freeIds.back();
+		freeIds.pop_back();
+		return entity;
+	}
+
+	records.push_back(Record());
+	return (EntityId)(records.size() - 1);
+}
+
+void EntityStore::Destroy(EntityId entity)
+{
+	if (!IsAlive(entity))
+		return;
+
+	Vacate(entity);
+	records[entity].alive = false;
+	freeIds.push_back(entity);
+}
+
+// --------------------------------------------------------
+// The archetype with exactly these components, made on first
+// use.  Its chunk layout is the entity ids and then each
+// column in component id order, every array starting on a
+// 64 byte line.
+// --------------------------------------------------------
+uint32_t EntityStore::FindArchetype(uint32_t mask)
+{
+	for (uint32_t a = 0; a < (uint32_t)archetypes.size(); a++)
+	{
+		if (archetypes[a]->mask == mask)
+			return a;
+	}
+
+	auto alignUp = [](size_t bytes) { return (bytes + 63) & ~(size_t)63; };
+	std::unique_ptr<Archetype> archetype = std::make_unique<Archetype>();
+	archetype->mask = mask;
+	size_t bytes = alignUp(sizeof(EntityId) * EntityChunk::Capacity);
+	for (unsigned int id = 0; id < ComponentTypes::MaxComponents; id++)
+	{
+		if ((mask & (1u << id)) == 0)
+			continue;
+		archetype->columnOffsets[id] = bytes;
+		bytes = alignUp(bytes + ComponentTypes::Get(id).size * EntityChunk::Capacity);
+	}
+	archetype->chunkBytes = bytes;
+	archetypes.push_back(std::move(archetype));
+	return (uint32_t)(archetypes.size() - 1);
+}
+
+// Over-allocated by a line so the arrays can start on one
+std::unique_ptr<EntityChunk> EntityStore::NewChunk(const Archetype& archetype)
+{
+	std::unique_ptr<EntityChunk> chunk = std::make_unique<EntityChunk>();
+	chunk->memory.reset(new uint8_t[archetype.chunkBytes + 63]);
+	uint8_t* base = (uint8_t*)(((uintptr_t)chunk->memory.get() + 63) & ~(uintptr_t)63);
+	chunk->entities = (EntityId*)base;
+	for (unsigned int id = 0; id < ComponentTypes::MaxComponents; id++)
+	{
+		if ((archetype.mask & (1u << id)) != 0)
+			chunk->columns[id] = base + archetype.columnOffsets[id];
+	}
+	return chunk;
+}
+
+void EntityStore::Place(EntityId entity, uint32_t archetypeIndex)
+{
+	Archetype& archetype = *archetypes[archetypeIndex];
+	if (archetype.chunks.empty() || archetype.chunks.back()->count == EntityChunk::Capacity)
+	{
+		archetype.chunks.push_back(NewChunk(archetype));
+		layoutVersion++;
+	}
+
+	EntityChunk& chunk = *archetype.chunks.back();
+	Record& record = records[entity];
+	record.archetype = archetypeIndex;
+	record.chunk = (uint32_t)(archetype.chunks.size() - 1);
+	record.row = chunk.count;
+	record.alive = true;
+	chunk.entities[chunk.count++] = entity;
+}
+
+// --------------------------------------------------------
+// Takes the entity out of its row, filling the hole with the
+// archetype's last entity so its chunks stay packed.  An
+// emptied last chunk is freed.
+// --------------------------------------------------------
+void EntityStore::Vacate(EntityId entity)
+{
+	const Record& record = records[entity];
+	Archetype& archetype = *archetypes[record.archetype];
+	EntityChunk& chunk = *archetype.chunks[record.chunk];
+	EntityChunk& last = *archetype.chunks.back();
+	uint32_t lastRow = last.count - 1;
+
+	if (&chunk != &last || record.row != lastRow)
+	{
+		EntityId moved = last.entities[lastRow];
+		chunk.entities[record.row] = moved;
+		for (unsigned int id = 0; id < ComponentTypes::MaxComponents; id++)
+		{
+			if ((archetype.mask & (1u << id)) == 0)
+				continue;
+			size_t size = ComponentTypes::Get(id).size;
+			memcpy(chunk.columns[id] + record.row * size, last.columns[id] + lastRow * size, size);
+		}
+		records[moved].chunk = record.chunk;
+		records[moved].row = record.row;
+	}
+
+	last.count--;
+	if (last.count == 0)
+	{
+		archetype.chunks.pop_back();
+		layoutVersion++;
+	}
+}
+
+// --------------------------------------------------------
+// Into the archetype for a new mask, carrying over every
+// component both have
+// --------------------------------------------------------
+void EntityStore::Move(EntityId entity, uint32_t mask)
+{
+	Record from = records[entity];
+	uint32_t target = FindArchetype(mask);
+	Archetype& source = *archetypes[from.archetype];
+	uint32_t shared = source.mask & mask;
+
+	Place(entity, target);
+	const Record& to = records[entity];
+	EntityChunk& fromChunk = *source.chunks[from.chunk];
+	EntityChunk& toChunk = *archetypes[target]->chunks[to.chunk];
+	for (unsigned int id = 0; id < ComponentTypes::MaxComponents; id++)
+	{
+		if ((shared & (1u << id)) == 0)
+			continue;
+		size_t size = ComponentTypes::Get(id).size;
+		memcpy(toChunk.columns[id] + to.row * size, fromChunk.columns[id] + from.row * size, size);
+	}
+
+	// Out of the old row - Vacate() reads the record, so point it back
+	// there for the call
+	Record placed = records[entity];
+	records[entity] = from;
+	Vacate(entity);
+	records[entity] = placed;
+}
+
+// --------------------------------------------------------
+// Archetypes are never removed, so this store's archetypes are
+// the first of source's unless it last copied another store.
+// Only chunks added or freed since the last copy change this
+// store's layout version.
+// --------------------------------------------------------
+void EntityStore::CopyFrom(const EntityStore& source, JobSystem* jobSystem)
+{
+	size_t matching = 0;
+	while (matching < archetypes.size() && matching < source.archetypes.size() &&
+		archetypes[matching]->mask == source.archetypes[matching]->mask)
+		matching++;
+	if (matching < archetypes.size())
+	{
+		archetypes.resize(matching);
+		layoutVersion++;
+	}
+
+	for (size_t a = matching; a < source.archetypes.size(); a++)
+	{
+		const Archetype& from = *source.archetypes[a];
+		std::unique_ptr<Archetype> archetype = std::make_unique<Archetype>();
+		archetype->mask = from.mask;
+		memcpy(archetype->columnOffsets, from.columnOffsets, sizeof(from.columnOffsets));
+		archetype->chunkBytes = from.chunkBytes;
+		archetypes.push_back(std::move(archetype));
+	}
+
+	for (size_t a = 0; a < archetypes.size(); a++)
+	{
+		Archetype& archetype = *archetypes[a];
+		const Archetype& from = *source.archetypes[a];
+		if (archetype.chunks.size() != from.chunks.size())
+			layoutVersion++;
+		archetype.chunks.resize((std::min)(archetype.chunks.size(), from.chunks.size()));
+		while (archetype.chunks.size() < from.chunks.size())
+			archetype.chunks.push_back(NewChunk(archetype));
+
+		auto copyChunks = [&](size_t begin, size_t end)
+		{
+			for (size_t c = begin; c < end; c++)
+			{
+				EntityChunk& chunk = *archetype.chunks[c];
+				const EntityChunk& fromChunk = *from.chunks[c];
+				chunk.count = fromChunk.count;
+				memcpy(chunk.entities, fromChunk.entities, sizeof(EntityId) * chunk.count);
+				for (unsigned int id = 0; id < ComponentTypes::MaxComponents; id++)
+				{
+					if ((archetype.mask & (1u << id)) != 0)
+						memcpy(chunk.columns[id], fromChunk.columns[id], ComponentTypes::Get(id).size * chunk.count);
+				}
+			}
+		};
+		if (jobSystem)
+			jobSystem->ParallelFor(archetype.chunks.size(), 1, copyChunks);
+		else
+			copyChunks(0, archetype.chunks.size());
+	}
+
+	records = source.records;
+	freeIds = source.freeIds;
+}
@@ -0,0 +1,278 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+#include "JobSystem.h"
+
+typedef uint32_t EntityId;
+const EntityId InvalidEntity = UINT32_MAX;
+
+// --------------------------------------------------------
+// Component type ids, handed out on first use.  Components are
+// plain data - trivially copyable and destructible - so rows
+// move between chunks with memcpy and are never destroyed.
+// --------------------------------------------------------
+class ComponentTypes
+{
+public:
+	static const unsigned int MaxComponents = 32;	// Bits in an archetype's mask
+
+	struct Info
+	{
+		size_t size;
+		size_t alignment;
+	};
+
+	template<typename T> static unsigned int Id()
+	{
+		static_assert(std::is_trivially_copyable<T>::value && std::is_trivially_destructible<T>::value,
+			"Components must be plain data");
+		static const unsigned int id = Register(sizeof(T), alignof(T));
+		return id;
+	}
+
+	template<typename... Components> static uint32_t Mask()
+	{
+		return (0u | ... | (1u << Id<Components>()));
+	}
+
+	static const Info& Get(unsigned int id) { return infos[id]; }
+
+private:
+	static Info infos[MaxComponents];
+	static std::atomic<unsigned int> count;
+
+	static unsigned int Register(size_t size, size_t alignment);
+};
+
+class EntityStore;
+
+// --------------------------------------------------------
+// Up to Capacity entities of one archetype, each component in
+// its own array.  Rows 0 to count - 1 are live, and every chunk
+// of an archetype but its last is full.
+// --------------------------------------------------------
+class EntityChunk
+{
+public:
+	static const uint32_t Capacity = 256;
+
+	uint32_t GetCount() const { return count; }
+	const EntityId* GetEntities() const { return entities; }
+
+	// The column of a component the archetype has
+	template<typename T> T* GetColumn() const
+	{
+		return reinterpret_cast<T*>(columns[ComponentTypes::Id<T>()]);
+	}
+
+	template<typename T> bool HasColumn() const { return columns[ComponentTypes::Id<T>()] != nullptr; }
+
+private:
+	friend class EntityStore;
+
+	std::unique_ptr<uint8_t[]> memory;
+	EntityId* entities = nullptr;
+	uint8_t* columns[ComponentTypes::MaxComponents] = {};
+	uint32_t count = 0;
+};
+
+// --------------------------------------------------------
+// Archetype storage for entities: every entity with the same
+// set of components lives in the same archetype, packed into
+// chunks of EntityChunk::Capacity with one array per
+// component, so a system walks exactly the columns it reads.
+//
+// Entities are ids into a table of where each one lives.  Ids
+// are handed out in order, and a destroyed entity's id is
+// reused by a later Create(), so per-entity arrays elsewhere
+// can be indexed by id and sized by GetIdCapacity().
+//
+// Destroying an entity, or moving it to another archetype by
+// adding or removing a component, moves the archetype's last
+// entity into its row.  Component pointers and references are
+// only good until the next such change, or the next Create().
+//
+// Structural changes are single threaded.  Between them, any
+// number of threads may read and write components, as long as
+// no two write the same one - each chunk to one job, like
+// EntityQuery::ParallelForEachChunk().
+// --------------------------------------------------------
+class EntityStore
+{
+public:
+	EntityStore() = default;
+	EntityStore(const EntityStore&) = delete;
+	EntityStore& operator=(const EntityStore&) = delete;
+
+	template<typename... Components> EntityId Create(const Components&... components)
+	{
+		uint32_t mask = ComponentTypes::Mask<Components...>();
+		EntityId entity = AllocateId();
+		Place(entity, FindArchetype(mask));
+		(Write(entity, components), ...);
+		return entity;
+	}
+
+	void Destroy(EntityId entity);
+	bool IsAlive(EntityId entity) const { return entity < records.size() && records[entity].alive; }
+
+	template<typename T> bool Has(EntityId entity) const
+	{
+		return IsAlive(entity) && (archetypes[records[entity].archetype]->mask & (1u << ComponentTypes::Id<T>())) != 0;
+	}
+
+	// The entity must have it
+	template<typename T> T& Get(EntityId entity) const
+	{
+		const Record& record = records[entity];
+		return archetypes[record.archetype]->chunks[record.chunk]->GetColumn<T>()[record.row];
+	}
+
+	template<typename T> T* TryGet(EntityId entity) const
+	{
+		return Has<T>(entity) ? &Get<T>(entity) : nullptr;
+	}
+
+	// Adds or replaces a component
+	template<typename T> void Add(EntityId entity, const T& component)
+	{
+		uint32_t bit = 1u << ComponentTypes::Id<T>();
+		uint32_t mask = archetypes[records[entity].archetype]->mask;
+		if ((mask & bit) == 0)
+			Move(entity, mask | bit);
+		Write(entity, component);
+	}
+
+	template<typename T> void Remove(EntityId entity)
+	{
+		uint32_t bit = 1u << ComponentTypes::Id<T>();
+		uint32_t mask = archetypes[records[entity].archetype]->mask;
+		if ((mask & bit) != 0)
+			Move(entity, mask & ~bit);
+	}
+
+	size_t GetCount() const { return records.size() - freeIds.size(); }
+	size_t GetIdCapacity() const { return records.size(); }
+	size_t GetArchetypeCount() const { return archetypes.size(); }
+	size_t GetChunkCount() const;
+
+	// Bumped whenever a chunk is added or freed, so queries know to
+	// gather their chunks again
+	uint64_t GetLayoutVersion() const { return layoutVersion; }
+
+	// Every chunk of every archetype that has all of mask's components
+	void GatherChunks(uint32_t mask, std::vector<EntityChunk*>& chunks) const;
+
+	// Makes this store a copy of source - the same ids in the same
+	// rows - so another thread can read it while source carries on
+	// changing.  Chunks and tables already here are reused, so once
+	// the layout settles a copy is just the live rows, a chunk per
+	// job if a job system is given.
+	void CopyFrom(const EntityStore& source, JobSystem* jobSystem = nullptr);
+
+private:
+	struct Archetype
+	{
+		uint32_t mask = 0;
+		size_t columnOffsets[ComponentTypes::MaxComponents] = {};
+		size_t chunkBytes = 0;
+		std::vector<std::unique_ptr<EntityChunk>> chunks;
+	};
+
+	struct Record
+	{
+		uint32_t archetype = 0;
+		uint32_t chunk = 0;
+		uint32_t row = 0;
+		bool alive = false;
+	};
+
+	std::vector<std::unique_ptr<Archetype>> archetypes;
+	std::vector<Record> records;		// By id
+	std::vector<EntityId> freeIds;
+	uint64_t layoutVersion = 0;
+
+	EntityId AllocateId();
+	uint32_t FindArchetype(uint32_t mask);
+	static std::unique_ptr<EntityChunk> NewChunk(const Archetype& archetype);
+	void Place(EntityId entity, uint32_t archetype);		// In a new last row
+	void Vacate(EntityId entity);							// Last row moves in
+	void Move(EntityId entity, uint32_t mask);
+
+	template<typename T> void Write(EntityId entity, const T& component)
+	{
+		new (&Get<T>(entity)) T(component);
+	}
+};
+
+// --------------------------------------------------------
+// Every entity that has all of Components, a chunk at a time.
+//
+// Keeps the matching chunks between calls and gathers them
+// again only when the store's layout changed.  Chunks are in
+// archetype order, so with no structural changes every walk
+// sees the entities in the same order.
+// --------------------------------------------------------
+template<typename... Components>
+class EntityQuery
+{
+public:
+	explicit EntityQuery(EntityStore& store) : store(store) {}
+
+	EntityStore& GetStore() const { return store; }
+
+	const std::vector<EntityChunk*>& GetChunks()
+	{
+		if (layoutVersion != store.GetLayoutVersion())
+		{
+			chunks.clear();
+			store.GatherChunks(ComponentTypes::Mask<Components...>(), chunks);
+			layoutVersion = store.GetLayoutVersion();
+		}
+		return chunks;
+	}
+
+	size_t GetCount()
+	{
+		size_t count = 0;
+		for (EntityChunk* chunk : GetChunks())
+			count += chunk->GetCount();
+		return count;
+	}
+
+	// function(EntityId, Components&...) for each entity
+	template<typename Function> void ForEach(Function function)
+	{
+		for (EntityChunk* chunk : GetChunks())
+		{
+			const EntityId* entities = chunk->GetEntities();
+			std::tuple<Components*...> columns(chunk->GetColumn<Components>()...);
+			for (uint32_t row = 0; row < chunk->GetCount(); row++)
+				function(entities[row], std::get<Components*>(columns)[row]...);
+		}
+	}
+
+	// function(size_t chunkIndex, EntityChunk&) for each chunk, one
+	// chunk per job
+	template<typename Function> void ParallelForEachChunk(JobSystem& jobSystem, Function function)
+	{
+		const std::vector<EntityChunk*>& matched = GetChunks();
+		jobSystem.ParallelFor(matched.size(), 1, [&](size_t begin, size_t end)
+		{
+			for (size_t c = begin; c < end; c++)
+				function(c, *matched[c]);
+		});
+	}
+
+private:
+	EntityStore& store;
+	std::vector<EntityChunk*> chunks;
+	uint64_t layoutVersion = UINT64_MAX;
+};
@@ -0,0 +1,407 @@
+#include "EntityStoreTests.h"
+#include "HeadlessTests.h"
+#include "RecordingBackend.h"
+#include "Mesh.h"
+#include "Material.h"
+#include "ResourceRegistry.h"
+#include "EntitySystems.h"
+#include "EntityStore.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+	// What a scene entity was before the entity store - GameEntity's
+	// members, plus the animation and bounds the systems now keep as
+	// components, all in one struct in one array
+	struct LegacyEntity
+	{
+		std::shared_ptr<Material> material;
+		std::shared_ptr<Mesh> mesh;
+		Transform transform;
+		bool isStatic = false;
+		bool isOccluder = false;
+		AnimationState animation;
+		AABB bounds;
+	};
+
+	// A frame's cull, per layout: how many are visible, and a sum over
+	// their meshes and materials so both layouts must read the same ones
+	struct LayoutCull
+	{
+		size_t visible = 0;
+		uint64_t checksum = 0;
+	};
+
+	uint64_t DrawChecksum(const Mesh* mesh, const Material* material)
+	{
+		return (uint64_t)mesh->GetIndexCount() + ((uint64_t)(uintptr_t)material >> 4);
+	}
+
+	void UpdateLegacy(std::vector<LegacyEntity>& entities, JobSystem& jobSystem, float deltaTime, float totalTime)
+	{
+		size_t chunkCount = JobSystem::GetChunkCount(entities.size(), EntityChunk::Capacity);
+		jobSystem.ParallelFor(chunkCount, 1, [&](size_t begin, size_t end)
+		{
+			for (size_t c = begin; c < end; c++)
+			{
+				size_t last = (std::min)((c + 1) * EntityChunk::Capacity, entities.size());
+				for (size_t i = c * EntityChunk::Capacity; i < last; i++)
+				{
+					LegacyEntity& entity = entities[i];
+					ApplyAnimation(entity.transform, entity.animation, deltaTime, totalTime);
+					entity.bounds = entity.mesh->GetLocalBounds().Transformed(entity.transform.GetWorldMatrix());
+				}
+			}
+		});
+	}
+
+	LayoutCull CullLegacy(const std::vector<LegacyEntity>& entities, JobSystem& jobSystem, const Frustum& frustum)
+	{
+		size_t chunkCount = JobSystem::GetChunkCount(entities.size(), EntityChunk::Capacity);
+		std::vector<LayoutCull> chunkCulls(chunkCount);
+		jobSystem.ParallelFor(chunkCount, 1, [&](size_t begin, size_t end)
+		{
+			for (size_t c = begin; c < end; c++)
+			{
+				size_t last = (std::min)((c + 1) * EntityChunk::Capacity, entities.size());
+				for (size_t i = c * EntityChunk::Capacity; i < last; i++)
+				{
+					const LegacyEntity& entity = entities[i];
+					if (!frustum.Intersects(entity.bounds))
+						continue;
+					chunkCulls[c].visible++;
+					chunkCulls[c].checksum += DrawChecksum(entity.mesh.get(), entity.material.get());
+				}
+			}
+		});
+
+		LayoutCull total;
+		for (const LayoutCull& cull : chunkCulls)
+		{
+			total.visible += cull.visible;
+			total.checksum += cull.checksum;
+		}
+		return total;
+	}
+
+	LayoutCull CullStore(RenderQuery& entities, const ResourceRegistry& resources, JobSystem& jobSystem, const Frustum& frustum)
+	{
+		std::vector<LayoutCull> chunkCulls(entities.GetChunks().size());
+		entities.ParallelForEachChunk(jobSystem, [&](size_t chunkIndex, EntityChunk& chunk)
+		{
+			const WorldBounds* bounds = chunk.GetColumn<WorldBounds>();
+			const MeshRef* meshes = chunk.GetColumn<MeshRef>();
+			const MaterialRef* materials = chunk.GetColumn<MaterialRef>();
+			for (uint32_t row = 0; row < chunk.GetCount(); row++)
+			{
+				if (!frustum.Intersects(bounds[row].box))
+					continue;
+				chunkCulls[chunkIndex].visible++;
+				chunkCulls[chunkIndex].checksum += DrawChecksum(resources.Get(meshes[row].mesh), resources.Get(materials[row].material));
+			}
+		});
+
+		LayoutCull total;
+		for (const LayoutCull& cull : chunkCulls)
+		{
+			total.visible += cull.visible;
+			total.checksum += cull.checksum;
+		}
+		return total;
+	}
+
+	// Components for the store checks, unrelated to the scene's
+	struct CheckA { int value; };
+	struct CheckB { float value; };
+	struct CheckC { uint64_t value; };
+
+	// What the store should hold, by id
+	struct ReferenceEntity
+	{
+		bool alive = false;
+		bool hasB = false;
+		bool hasC = false;
+		int a = 0;
+		float b = 0.0f;
+		uint64_t c = 0;
+	};
+
+	// Random creates, destroys, adds and removes against a plain
+	// array of what each id should hold
+	int RunEntityStoreChecks()
+	{
+		int failures = 0;
+		char detail[256];
+		EntityStore store;
+		EntityQuery<CheckA> all(store);
+		EntityQuery<CheckA, CheckB> withB(store);
+		EntityQuery<CheckA, CheckB, CheckC> withBoth(store);
+		std::vector<ReferenceEntity> reference;
+		std::mt19937 rng(61);
+		std::uniform_int_distribution<int> operation(0, 9);
+
+		size_t mismatches = 0;
+		size_t reuseMisses = 0;
+		size_t queryMisses = 0;
+		const int steps = 50000;
+		for (int step = 0; step < steps; step++)
+		{
+			// Grow early, then hover around a steady count
+			int op = operation(rng);
+			if (op >= 8 || (op >= 2 && step < steps / 4))
+			{
+				size_t freeBefore = store.GetIdCapacity() - store.GetCount();
+				EntityId entity;
+				ReferenceEntity ref;
+				ref.alive = true;
+				ref.a = step;
+				if (op % 2 == 0)
+				{
+					ref.hasB = true;
+					ref.b = step * 0.5f;
+					entity = store.Create(CheckA{ ref.a }, CheckB{ ref.b });
+				}
+				else
+				{
+					entity = store.Create(CheckA{ ref.a });
+				}
+
+				// A free id must be reused before the ids grow
+				if (freeBefore > 0 && entity >= reference.size())
+					reuseMisses++;
+				if (entity >= reference.size())
+					reference.resize(entity + 1);
+				if (reference[entity].alive)
+					mismatches++;
+				reference[entity] = ref;
+				continue;
+			}
+
+			if (store.GetCount() == 0)
+				continue;
+			EntityId entity;
+			do
+			{
+				entity = std::uniform_int_distribution<EntityId>(0, (EntityId)reference.size() - 1)(rng);
+			} while (!reference[entity].alive);
+
+			ReferenceEntity& ref = reference[entity];
+			switch (op)
+			{
+			case 0:
+			case 1:
+				store.Destroy(entity);
+				ref = ReferenceEntity();
+				break;
+			case 2:
+				store.Add(entity, CheckC{ (uint64_t)step * 3 });
+				ref.hasC = true;
+				ref.c = (uint64_t)step * 3;
+				break;
+			case 3:
+			case 4:
+				store.Remove<CheckB>(entity);
+				ref.hasB = false;
+				break;
+			default:
+				store.Add(entity, CheckB{ step * 0.25f });
+				ref.hasB = true;
+				ref.b = step * 0.25f;
+				break;
+			}
+
+			// Every so often, everything against the reference
+			if (step % 1000 != 0)
+				continue;
+			size_t aliveCount = 0, bCount = 0, bothCount = 0;
+			for (EntityId id = 0; id < reference.size(); id++)
+			{
+				const ReferenceEntity& r = reference[id];
+				if (store.IsAlive(id) != r.alive)
+				{
+					mismatches++;
+					continue;
+				}
+				if (!r.alive)
+					continue;
+				aliveCount++;
+				bCount += r.hasB ? 1 : 0;
+				bothCount += r.hasB && r.hasC ? 1 : 0;
+				if (store.Get<CheckA>(id).value != r.a ||
+					store.Has<CheckB>(id) != r.hasB || store.Has<CheckC>(id) != r.hasC ||
+					(r.hasB && store.Get<CheckB>(id).value != r.b) ||
+					(r.hasC && store.Get<CheckC>(id).value != r.c))
+					mismatches++;
+			}
+
+			// Each query visits exactly the matching ids, once each
+			std::vector<int> visits(reference.size(), 0);
+			withB.ForEach([&](EntityId id, CheckA& a, CheckB& b)
+			{
+				if (id < visits.size())
+					visits[id]++;
+				if (id >= reference.size() || a.value != reference[id].a || b.value != reference[id].b)
+					queryMisses++;
+			});
+			for (EntityId id = 0; id < reference.size(); id++)
+				queryMisses += visits[id] != (reference[id].alive && reference[id].hasB ? 1 : 0) ? 1 : 0;
+			if (store.GetCount() != aliveCount || all.GetCount() != aliveCount ||
+				withB.GetCount() != bCount || withBoth.GetCount() != bothCount)
+				queryMisses++;
+		}
+
+		snprintf(detail, sizeof(detail), "%d operations, %zu alive, %zu archetypes, %zu chunks, %zu wrong",
+			steps, store.GetCount(), store.GetArchetypeCount(), store.GetChunkCount(), mismatches);
+		failures += ReportCheck("store matches the reference", mismatches == 0, detail);
+		snprintf(detail, sizeof(detail), "%zu ids for %zu alive, %zu creates skipped a free id",
+			store.GetIdCapacity(), store.GetCount(), reuseMisses);
+		failures += ReportCheck("destroyed ids are reused", reuseMisses == 0, detail);
+		snprintf(detail, sizeof(detail), "%zu wrong", queryMisses);
+		failures += ReportCheck("queries see exactly the matching entities", queryMisses == 0, detail);
+
+		// Everything gone leaves no chunks behind
+		for (EntityId id = 0; id < reference.size(); id++)
+		{
+			if (reference[id].alive)
+				store.Destroy(id);
+		}
+		snprintf(detail, sizeof(detail), "%zu alive, %zu chunks, %zu matched", store.GetCount(), store.GetChunkCount(), all.GetCount());
+		failures += ReportCheck("destroying everything frees every chunk",
+			store.GetCount() == 0 && store.GetChunkCount() == 0 && all.GetCount() == 0, detail);
+		return failures;
+	}
+}
+
+int RunEntityLayoutBench(const EntityLayoutBenchSettings& settings)
+{
+	int threads = settings.threadCount > 0 ? settings.threadCount : (int)std::thread::hardware_concurrency();
+	threads = (std::max)(threads, 1);
+	JobSystem serial(0);
+	JobSystem parallel(threads - 1);
+	printf("Entity layout bench: %d entities, %d frames, %u threads\n",
+		settings.entityCount, settings.frames, parallel.GetThreadCount());
+	int failures = 0;
+	char detail[256];
+
+	RecordingBackend backend;
+	{
+		ResourceRegistry resources(backend, backend.CreateFence());
+		MeshHandle cube = CreateBenchCube(resources, backend);
+		ShaderHandle vs = backend.CreateShader(ShaderStage::Vertex, fakeBytecode, sizeof(fakeBytecode));
+		ShaderHandle ps = backend.CreateShader(ShaderStage::Pixel, fakeBytecode, sizeof(fakeBytecode));
+		std::vector<MaterialHandle> materials;
+		for (int i = 0; i < 8; i++)
+			materials.push_back(resources.Create<Material>(XMFLOAT4(1, 1, 1, 1), vs, ps));
+
+		// The legacy entities share the registry's objects without owning them
+		std::shared_ptr<Mesh> sharedCube(resources.Get(cube), [](Mesh*) {});
+		std::vector<std::shared_ptr<Material>> sharedMaterials;
+		for (MaterialHandle material : materials)
+			sharedMaterials.push_back(std::shared_ptr<Material>(resources.Get(material), [](Material*) {}));
+
+		// The same square grid of spinning cubes in both layouts
+		std::vector<LegacyEntity> legacy(settings.entityCount);
+		EntityStore store;
+		int side = (int)ceilf(sqrtf((float)settings.entityCount));
+		for (int i = 0; i < settings.entityCount; i++)
+		{
+			XMFLOAT3 position((float)(i % side) * 2.0f - side, 0.0f, (float)(i / side) * 2.0f - side);
+			AnimationState animation = AnimationState::Spin(0.5f + (i % 7) * 0.25f);
+
+			LegacyEntity& entity = legacy[i];
+			entity.mesh = sharedCube;
+			entity.material = sharedMaterials[i % sharedMaterials.size()];
+			entity.transform.SetPosition(position);
+			entity.animation = animation;
+
+			EntityId id = CreateRenderEntity(store, cube, materials[i % materials.size()], position);
+			store.Add(id, animation);
+		}
+		AnimatedQuery animated(store);
+		BoundsQuery bounded(store);
+		RenderQuery rendered(store);
+		printf("  %zu bytes per entity in one array, against %zu in the columns the update reads and %zu the cull reads\n\n",
+			sizeof(LegacyEntity),
+			sizeof(Transform) + sizeof(AnimationState) + sizeof(MeshRef) + sizeof(WorldBounds),
+			sizeof(WorldBounds) + sizeof(MeshRef) + sizeof(MaterialRef));
+
+		// Camera over the middle of the grid, looking across half of it
+		float extent = (float)side;
+		XMFLOAT4X4 viewProjection;
+		XMStoreFloat4x4(&viewProjection, XMMatrixMultiply(
+			XMMatrixLookToLH(XMVectorSet(0, extent * 0.25f, -extent * 0.5f, 1), XMVectorSet(0, -0.3f, 1, 0), XMVectorSet(0, 1, 0, 0)),
+			XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.1f, extent)));
+		Frustum frustum = Frustum::FromViewProjection(viewProjection);
+
+		const float deltaTime = 1.0f / 60.0f;
+		float totalTime = 0.0f;
+		size_t cullMismatches = 0;
+		size_t visible = 0;
+		for (int j = 0; j < 2; j++)
+		{
+			JobSystem& jobSystem = j == 0 ? serial : parallel;
+			double updateMs[2] = { 0.0, 0.0 };
+			double cullMs[2] = { 0.0, 0.0 };
+			for (int f = 0; f < settings.frames; f++)
+			{
+				totalTime += deltaTime;
+
+				auto start = std::chrono::high_resolution_clock::now();
+				UpdateLegacy(legacy, jobSystem, deltaTime, totalTime);
+				auto legacyUpdated = std::chrono::high_resolution_clock::now();
+				LayoutCull legacyCull = CullLegacy(legacy, jobSystem, frustum);
+				auto legacyCulled = std::chrono::high_resolution_clock::now();
+				AnimateEntities(animated, jobSystem, deltaTime, totalTime);
+				UpdateWorldBounds(bounded, resources, jobSystem);
+				auto storeUpdated = std::chrono::high_resolution_clock::now();
+				LayoutCull storeCull = CullStore(rendered, resources, jobSystem, frustum);
+				auto storeCulled = std::chrono::high_resolution_clock::now();
+
+				updateMs[0] += Milliseconds(legacyUpdated - start);
+				cullMs[0] += Milliseconds(legacyCulled - legacyUpdated);
+				updateMs[1] += Milliseconds(storeUpdated - legacyCulled);
+				cullMs[1] += Milliseconds(storeCulled - storeUpdated);
+				if (legacyCull.visible != storeCull.visible || legacyCull.checksum != storeCull.checksum)
+					cullMismatches++;
+				visible = storeCull.visible;
+			}
+
+			int frames = (std::max)(settings.frames, 1);
+			double millions = settings.entityCount / 1000000.0;
+			printf("  %u thread%s:\n", jobSystem.GetThreadCount(), jobSystem.GetThreadCount() == 1 ? "" : "s");
+			printf("    update (animate, matrices, bounds): %8.3f ms array, %8.3f ms store - %6.1f vs %6.1f M entities/s\n",
+				updateMs[0] / frames, updateMs[1] / frames,
+				millions * frames / (updateMs[0] / 1000.0), millions * frames / (updateMs[1] / 1000.0));
+			printf("    cull (bounds, mesh, material):      %8.3f ms array, %8.3f ms store - %6.1f vs %6.1f M entities/s\n",
+				cullMs[0] / frames, cullMs[1] / frames,
+				millions * frames / (cullMs[0] / 1000.0), millions * frames / (cullMs[1] / 1000.0));
+		}
+		printf("\n");
+
+		size_t boundsMismatches = 0;
+		for (int i = 0; i < settings.entityCount; i++)
+		{
+			if (memcmp(&legacy[i].bounds, &store.Get<WorldBounds>(i).box, sizeof(AABB)) != 0)
+				boundsMismatches++;
+		}
+		snprintf(detail, sizeof(detail), "%zu of %d differ", boundsMismatches, settings.entityCount);
+		failures += ReportCheck("both layouts compute the same bounds", boundsMismatches == 0, detail);
+		snprintf(detail, sizeof(detail), "%zu of %d frames differ, %zu visible on the last", cullMismatches, settings.frames * 2, visible);
+		failures += ReportCheck("both layouts cull the same entities", cullMismatches == 0 && visible > 0, detail);
+	}
+
+	failures += RunEntityStoreChecks();
+	return ReportFailures(failures);
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+// --------------------------------------------------------
+// Headless CPU benchmark of the entity store against the array
+// of entities it replaced - no GPU.
+//
+// The same grid of spinning cubes in both: one struct per
+// entity in one array (GameEntity's members, plus animation and
+// bounds), and the store's render entities with an animation.
+// Per frame, on one thread and then on threadCount, it times:
+//  - the update: animate, rebuild world matrices, bounds
+//  - the cull: frustum against the bounds, then reading each
+//    visible entity's mesh and material
+// both in chunks of EntityChunk::Capacity, one per job.
+//
+// Checks that both layouts end with the same bounds and see the
+// same entities every frame.  Then random creates, destroys,
+// adds and removes against a plain reference array: component
+// values, id reuse, what each query visits, and no chunks left
+// once everything is destroyed.
+//
+// Returns 0 if all checks passed.
+// --------------------------------------------------------
+struct EntityLayoutBenchSettings
+{
+	int entityCount = 100000;
+	int frames = 50;			// Per thread count
+	int threadCount = -1;		// Including the caller, negative = every hardware thread
+};
+
+int RunEntityLayoutBench(const EntityLayoutBenchSettings& settings);
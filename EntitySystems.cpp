@@ -0,0 +1,178 @@
+#include "EntitySystems.h"
+#include "Mesh.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace DirectX;
+
+EntityId CreateRenderEntity(EntityStore& store, MeshHandle mesh, MaterialHandle material, XMFLOAT3 position, XMFLOAT3 scale)
+{
+	Transform transform;
+	transform.SetPosition(position);
+	transform.SetScale(scale);
+
+	MeshRef meshRef;
+	meshRef.mesh = mesh;
+	MaterialRef materialRef;
+	materialRef.material = material;
+	return store.Create(transform, WorldBounds(), meshRef, materialRef, RenderFlags());
+}
+
+void ApplyAnimation(Transform& transform, const AnimationState& animation, float deltaTime, float totalTime)
+{
+	switch (animation.kind)
+	{
+	case AnimationKind::Spin:
+		transform.Rotate(0.0f, 0.0f, animation.rate * deltaTime);
+		break;
+	case AnimationKind::Sway:
+		transform.SetPosition(animation.origin.x + sinf(totalTime * animation.rate) * animation.amount,
+			animation.origin.y, animation.origin.z);
+		break;
+	case AnimationKind::Pulse:
+	{
+		float pulse = 1.0f + animation.amount * sinf(totalTime * animation.rate);
+		transform.SetScale(pulse, pulse, 1.0f);
+		break;
+	}
+	}
+}
+
+void AnimateEntities(AnimatedQuery& entities, JobSystem& jobSystem, float deltaTime, float totalTime)
+{
+	entities.ParallelForEachChunk(jobSystem, [&](size_t, EntityChunk& chunk)
+	{
+		Transform* transforms = chunk.GetColumn<Transform>();
+		const AnimationState* animations = chunk.GetColumn<AnimationState>();
+		for (uint32_t row = 0; row < chunk.GetCount(); row++)
+			ApplyAnimation(transforms[row], animations[row], deltaTime, totalTime);
+	});
+}
+
+void PlayAnimations(AnimationPlayerQuery& entities, const ResourceRegistry& resources, JobSystem& jobSystem, float deltaTime)
+{
+	const uint32_t channelCount = (uint32_t)AnimationChannel::Count;
+	entities.ParallelForEachChunk(jobSystem, [&](size_t, EntityChunk& chunk)
+	{
+		Transform* transforms = chunk.GetColumn<Transform>();
+		AnimationPlayer* players = chunk.GetColumn<AnimationPlayer>();
+		CurveBatch batches[channelCount];
+		XMFLOAT4 values[channelCount][CurveBatch::Width];
+
+		for (uint32_t first = 0; first < chunk.GetCount(); first += CurveBatch::Width)
+		{
+			uint32_t count = (std::min)(CurveBatch::Width, chunk.GetCount() - first);
+			const AnimationClip* clips[CurveBatch::Width] = {};
+			for (uint32_t lane = 0; lane < CurveBatch::Width; lane++)
+			{
+				AnimationPlayer* player = lane < count ? &players[first + lane] : nullptr;
+				const AnimationClip* clip = player ? resources.Get(player->clip) : nullptr;
+				clips[lane] = clip;
+				if (clip)
+					player->time = clip->WrapTime(player->time + deltaTime * player->speed);
+
+				for (uint32_t c = 0; c < channelCount; c++)
+				{
+					if (clip && !clip->GetCurve((AnimationChannel)c).IsEmpty())
+						batches[c].Set(lane, clip->GetCurve((AnimationChannel)c), player->time, player->cursor.keys[c]);
+					else
+						batches[c].Clear(lane);
+				}
+			}
+
+			for (uint32_t c = 0; c < channelCount; c++)
+				batches[c].Evaluate(values[c], (AnimationChannel)c == AnimationChannel::Rotation);
+
+			for (uint32_t lane = 0; lane < count; lane++)
+			{
+				const AnimationClip* clip = clips[lane];
+				if (!clip)
+					continue;
+
+				Transform& transform = transforms[first + lane];
+				const AnimationPlayer& player = players[first + lane];
+				const XMFLOAT4& position = values[(size_t)AnimationChannel::Position][lane];
+				const XMFLOAT4& scale = values[(size_t)AnimationChannel::Scale][lane];
+				if (!clip->GetCurve(AnimationChannel::Position).IsEmpty())
+					transform.SetPosition(player.origin.x + position.x, player.origin.y + position.y, player.origin.z + position.z);
+				if (!clip->GetCurve(AnimationChannel::Rotation).IsEmpty())
+					transform.SetRotationQuaternion(values[(size_t)AnimationChannel::Rotation][lane]);
+				if (!clip->GetCurve(AnimationChannel::Scale).IsEmpty())
+					transform.SetScale(scale.x, scale.y, scale.z);
+			}
+		}
+	});
+}
+
+void RecordTickPoses(InterpolatedQuery& entities, JobSystem& jobSystem)
+{
+	entities.ParallelForEachChunk(jobSystem, [&](size_t, EntityChunk& chunk)
+	{
+		Transform* transforms = chunk.GetColumn<Transform>();
+		TransformHistory* histories = chunk.GetColumn<TransformHistory>();
+		for (uint32_t row = 0; row < chunk.GetCount(); row++)
+		{
+			Transform& transform = transforms[row];
+			TransformHistory& history = histories[row];
+			XMFLOAT3 rotation = transform.GetPitchYawRoll();
+
+			history.previous = history.current;
+			history.current.position = transform.GetPosition();
+			XMStoreFloat4(&history.current.orientation, XMQuaternionRotationRollPitchYaw(rotation.x, rotation.y, rotation.z));
+			history.current.scale = transform.GetScale();
+
+			// A new entity has nothing to come from
+			if (history.ticks == 0)
+				history.previous = history.current;
+			history.ticks = (std::min)(history.ticks + 1, 2u);
+		}
+	});
+}
+
+void InterpolateTransforms(InterpolatedQuery& entities, float alpha, JobSystem& jobSystem)
+{
+	entities.ParallelForEachChunk(jobSystem, [&](size_t, EntityChunk& chunk)
+	{
+		Transform* transforms = chunk.GetColumn<Transform>();
+		const TransformHistory* histories = chunk.GetColumn<TransformHistory>();
+		for (uint32_t row = 0; row < chunk.GetCount(); row++)
+		{
+			// The transform already has the current pose's matrices
+			const TransformHistory& history = histories[row];
+			if (history.ticks < 2 || memcmp(&history.previous, &history.current, sizeof(TransformPose)) == 0)
+				continue;
+
+			XMVECTOR position = XMVectorLerp(XMLoadFloat3(&history.previous.position), XMLoadFloat3(&history.current.position), alpha);
+			XMVECTOR scale = XMVectorLerp(XMLoadFloat3(&history.previous.scale), XMLoadFloat3(&history.current.scale), alpha);
+			XMVECTOR orientation = XMQuaternionSlerp(XMLoadFloat4(&history.previous.orientation), XMLoadFloat4(&history.current.orientation), alpha);
+
+			// Scale, then rotate, then translate - as Transform builds it
+			XMMATRIX world = XMMatrixScalingFromVector(scale) * XMMatrixRotationQuaternion(orientation);
+			world.r[3] = XMVectorSetW(position, 1.0f);
+			transforms[row].SetWorldMatrix(world);
+		}
+	});
+}
+
+void UpdateWorldBounds(BoundsQuery& entities, const ResourceRegistry& resources, JobSystem& jobSystem)
+{
+	entities.ParallelForEachChunk(jobSystem, [&](size_t, EntityChunk& chunk)
+	{
+		Transform* transforms = chunk.GetColumn<Transform>();
+		const MeshRef* meshes = chunk.GetColumn<MeshRef>();
+		WorldBounds* bounds = chunk.GetColumn<WorldBounds>();
+		for (uint32_t row = 0; row < chunk.GetCount(); row++)
+		{
+			unsigned int version = transforms[row].GetVersion();
+			if (bounds[row].transformVersion == version)
+				continue;
+
+			const Mesh* mesh = resources.Get(meshes[row].mesh);
+			if (!mesh)
+				continue;
+			bounds[row].box = mesh->GetLocalBounds().Transformed(transforms[row].GetWorldMatrix());
+			bounds[row].transformVersion = version;
+		}
+	});
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include "EntityComponents.h"
+#include "JobSystem.h"
+
+// --------------------------------------------------------
+// The per-frame work on scene entities, each a walk over one
+// query's chunks on the job system - a chunk per job, so no two
+// threads touch the same entity.
+// --------------------------------------------------------
+
+// A drawable entity: transform, bounds, mesh, material, flags
+EntityId CreateRenderEntity(EntityStore& store, MeshHandle mesh, MaterialHandle material,
+	DirectX::XMFLOAT3 position = DirectX::XMFLOAT3(0, 0, 0), DirectX::XMFLOAT3 scale = DirectX::XMFLOAT3(1, 1, 1));
+
+// One entity's animation at totalTime, deltaTime after the last
+void ApplyAnimation(Transform& transform, const AnimationState& animation, float deltaTime, float totalTime);
+
+// Moves every entity with an AnimationState
+void AnimateEntities(AnimatedQuery& entities, JobSystem& jobSystem, float deltaTime, float totalTime);
+
+// Advances every AnimationPlayer by deltaTime and writes its
+// clip's pose into the transform.  Players are sampled Width at
+// a time with a CurveBatch per channel, each lane keeping its own
+// clip and cursor.  A player whose clip was released is skipped.
+void PlayAnimations(AnimationPlayerQuery& entities, const ResourceRegistry& resources, JobSystem& jobSystem, float deltaTime);
+
+// Moves each entity's current pose to previous and records its
+// transform as the new current one.  Run at the end of every
+// simulation tick.
+void RecordTickPoses(InterpolatedQuery& entities, JobSystem& jobSystem);
+
+// Sets each entity's world matrix to its pose alpha of the way
+// from the previous tick's to the current one's - position and
+// scale lerped, orientation slerped.  Meant for the renderer's
+// copy of the store: position, rotation and scale themselves
+// are left at the current tick's.  Entities that didn't move in
+// the last tick are skipped.
+void InterpolateTransforms(InterpolatedQuery& entities, float alpha, JobSystem& jobSystem);
+
+// Rebuilds the world matrices and bounds of every entity whose
+// transform changed.  Run after anything moves entities and
+// before anything reads their bounds or matrices, so the lazy
+// matrix updates all happen here, in parallel.  An entity whose
+// mesh was released keeps its last bounds.
+void UpdateWorldBounds(BoundsQuery& entities, const ResourceRegistry& resources, JobSystem& jobSystem);
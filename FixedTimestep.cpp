@@ -0,0 +1,69 @@
+#include "FixedTimestep.h"
+#include <algorithm>
+#include <cmath>
+
+FixedTimestep::FixedTimestep(double ticksPerSecond, int maxFrameTicks)
+	: tickRate(ticksPerSecond),
+	step(1.0 / ticksPerSecond),
+	maxFrameTicks((std::max)(maxFrameTicks, 1))
+{
+}
+
+void FixedTimestep::SetTickRate(double ticksPerSecond)
+{
+	if (ticksPerSecond <= 0.0 || ticksPerSecond == tickRate)
+		return;
+
+	// Start counting from here, so the time doesn't jump
+	rateStartTime = GetTime();
+	rateTicks = 0;
+
+	// What's accumulated is real time, so it stays, in new ticks
+	accumulator *= ticksPerSecond / tickRate;
+	tickRate = ticksPerSecond;
+	step = 1.0 / ticksPerSecond;
+}
+
+void FixedTimestep::SetMaxFrameTicks(int ticks)
+{
+	maxFrameTicks = (std::max)(ticks, 1);
+}
+
+void FixedTimestep::Advance(double frameSeconds)
+{
+	stats.frameTicks = 0;
+	accumulator += (std::max)(frameSeconds, 0.0) * tickRate;
+
+	// Keep maxFrameTicks ticks and the fraction of one past them
+	if (accumulator >= maxFrameTicks + 1.0)
+	{
+		double dropped = floor(accumulator) - maxFrameTicks;
+		accumulator -= dropped;
+		stats.droppedTicks += (uint64_t)dropped;
+	}
+}
+
+bool FixedTimestep::Tick()
+{
+	if (stats.frameTicks >= maxFrameTicks || accumulator < 1.0)
+		return false;
+
+	accumulator -= 1.0;
+	rateTicks++;
+	stats.ticks++;
+	stats.frameTicks++;
+	return true;
+}
+
+float FixedTimestep::GetAlpha() const
+{
+	return (float)(std::min)(accumulator, 1.0);
+}
+
+void FixedTimestep::Reset()
+{
+	accumulator = 0.0;
+	rateStartTime = 0.0;
+	rateTicks = 0;
+	stats = FixedTimestepStats();
+}
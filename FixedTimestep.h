@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+
+struct FixedTimestepStats
+{
+	uint64_t ticks = 0;			// Run since the last Reset()
+	uint64_t droppedTicks = 0;	// Skipped by the per-frame limit
+	int frameTicks = 0;			// Run for the last frame
+};
+
+// --------------------------------------------------------
+// Runs a simulation at a fixed tick rate, whatever the frame
+// rate.  Each frame adds its real time to an accumulator, and a
+// tick runs for every whole step in it.  The fraction of a step
+// left over is how far the display is past the last tick - the
+// alpha to draw at, between the last two ticks' poses.
+//
+// A frame runs at most maxFrameTicks ticks, and time past that
+// is dropped.  Otherwise a slow frame queues more ticks, which
+// make the next frame slower still.
+//
+// A tick's time is its tick count times the step, never a sum
+// of frame times, so the same ticks see the same times however
+// the frames fell.
+//
+//   timestep.Advance(deltaTime);
+//   while (timestep.Tick())
+//       Simulate(timestep.GetStep(), timestep.GetTime());
+//   Draw(timestep.GetAlpha());
+// --------------------------------------------------------
+class FixedTimestep
+{
+public:
+	explicit FixedTimestep(double ticksPerSecond = 60.0, int maxFrameTicks = 8);
+
+	// Takes effect from the next tick; the time so far is kept
+	void SetTickRate(double ticksPerSecond);
+	double GetTickRate() const { return tickRate; }
+	void SetMaxFrameTicks(int ticks);
+	int GetMaxFrameTicks() const { return maxFrameTicks; }
+
+	// Adds a frame's real time, dropping whatever would take more
+	// than maxFrameTicks ticks
+	void Advance(double frameSeconds);
+
+	// True, and moves on a step, while the frame has a tick to run
+	bool Tick();
+
+	// Seconds a tick simulates
+	float GetStep() const { return (float)step; }
+
+	// The simulation time at the end of the latest tick
+	double GetTime() const { return rateStartTime + (double)rateTicks * step; }
+
+	// How far the frame is past the latest tick, in ticks - from 0
+	// up to 1, once every tick the frame had is run
+	float GetAlpha() const;
+
+	// Back to time zero, with nothing accumulated
+	void Reset();
+
+	const FixedTimestepStats& GetStats() const { return stats; }
+
+private:
+	double tickRate;
+	double step;
+	int maxFrameTicks;
+	double accumulator = 0.0;		// Real time not yet run, in ticks - whole ones subtract exactly
+
+	// Time at the last rate change, and ticks run since
+	double rateStartTime = 0.0;
+	uint64_t rateTicks = 0;
+
+	FixedTimestepStats stats;
+};
@@ -0,0 +1,345 @@
+#include "FixedTimestepTests.h"
+#include "HeadlessTests.h"
+#include "EntitySystems.h"
+#include "EntityStore.h"
+#include "JobSystem.h"
+#include "FixedTimestep.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+	// Animated entities with every kind of motion and a history,
+	// the same ones for the same seed
+	void CreateTickCheckEntities(EntityStore& store, size_t count, uint32_t seed)
+	{
+		std::mt19937 random(seed);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		for (size_t i = 0; i < count; i++)
+		{
+			XMFLOAT3 origin(unit(random) * 100.0f - 50.0f, unit(random) * 10.0f, unit(random) * 100.0f - 50.0f);
+			float rate = 0.5f + unit(random) * 3.0f;
+			AnimationState animation;
+			switch (i % 3)
+			{
+			case 0: animation = AnimationState::Spin(rate); break;
+			case 1: animation = AnimationState::Sway(origin, rate, unit(random) * 2.0f); break;
+			default: animation = AnimationState::Pulse(rate, unit(random) * 0.5f); break;
+			}
+
+			Transform transform;
+			transform.SetPosition(origin);
+			transform.SetRotation(unit(random) * 6.0f, unit(random) * 6.0f, unit(random) * 6.0f);
+			store.Create(transform, animation, TransformHistory());
+		}
+	}
+
+	// Frame times in seconds, a pattern of them
+	enum class FramePattern { Steady60, Steady144, Jittery, Stalls };
+
+	double NextFrameTime(FramePattern pattern, std::mt19937& random, size_t frame)
+	{
+		switch (pattern)
+		{
+		case FramePattern::Steady60: return 1.0 / 60.0;
+		case FramePattern::Steady144: return 1.0 / 144.0;
+		case FramePattern::Jittery: return 0.001 + std::uniform_real_distribution<double>(0.0, 0.039)(random);
+		default: return frame % 50 == 49 ? 0.4 : 1.0 / 90.0;
+		}
+	}
+
+	// Runs frames of the pattern until the timestep has run ticks
+	// ticks, animating and recording poses each tick
+	FixedTimestepStats RunTickCheckFrames(EntityStore& store, JobSystem& jobSystem, FramePattern pattern, uint64_t ticks)
+	{
+		AnimatedQuery animated(store);
+		InterpolatedQuery interpolated(store);
+		FixedTimestep timestep(60.0, 8);
+		std::mt19937 random(7);
+		for (size_t frame = 0; timestep.GetStats().ticks < ticks; frame++)
+		{
+			timestep.Advance(NextFrameTime(pattern, random, frame));
+			while (timestep.GetStats().ticks < ticks && timestep.Tick())
+			{
+				AnimateEntities(animated, jobSystem, timestep.GetStep(), (float)timestep.GetTime());
+				RecordTickPoses(interpolated, jobSystem);
+			}
+		}
+		return timestep.GetStats();
+	}
+
+	// Every float of every entity's transform and history, by id
+	std::vector<float> TickCheckState(EntityStore& store)
+	{
+		std::vector<float> state(store.GetIdCapacity() * 29, 0.0f);
+		InterpolatedQuery(store).ForEach([&](EntityId id, Transform& transform, TransformHistory& history)
+		{
+			float* out = &state[id * 29];
+			XMFLOAT3 position = transform.GetPosition();
+			XMFLOAT3 rotation = transform.GetPitchYawRoll();
+			XMFLOAT3 scale = transform.GetScale();
+			XMFLOAT4X4 world = transform.GetWorldMatrix();
+			memcpy(out, &position, sizeof(position));
+			memcpy(out + 3, &rotation, sizeof(rotation));
+			memcpy(out + 6, &scale, sizeof(scale));
+			memcpy(out + 9, &world, 12 * sizeof(float));
+			memcpy(out + 21, &history.previous.orientation, sizeof(XMFLOAT4));
+			memcpy(out + 25, &history.current.orientation, sizeof(XMFLOAT4));
+		});
+		return state;
+	}
+
+	// The world matrix of a pose
+	XMMATRIX PoseMatrix(XMFLOAT3 position, XMFLOAT4 orientation, XMFLOAT3 scale)
+	{
+		return XMMatrixScaling(scale.x, scale.y, scale.z) *
+			XMMatrixRotationQuaternion(XMLoadFloat4(&orientation)) *
+			XMMatrixTranslation(position.x, position.y, position.z);
+	}
+
+	// Textbook slerp in doubles, the reference for the SIMD one
+	XMFLOAT4 ReferenceSlerp(const XMFLOAT4& a, XMFLOAT4 b, double t)
+	{
+		double dot = (double)a.x * b.x + (double)a.y * b.y + (double)a.z * b.z + (double)a.w * b.w;
+		if (dot < 0.0)
+		{
+			b = XMFLOAT4(-b.x, -b.y, -b.z, -b.w);
+			dot = -dot;
+		}
+
+		double wa = 1.0 - t;
+		double wb = t;
+		if (dot < 0.9999)
+		{
+			double angle = acos(dot);
+			wa = sin((1.0 - t) * angle) / sin(angle);
+			wb = sin(t * angle) / sin(angle);
+		}
+		double x = wa * a.x + wb * b.x;
+		double y = wa * a.y + wb * b.y;
+		double z = wa * a.z + wb * b.z;
+		double w = wa * a.w + wb * b.w;
+		double length = sqrt(x * x + y * y + z * z + w * w);
+		return XMFLOAT4((float)(x / length), (float)(y / length), (float)(z / length), (float)(w / length));
+	}
+
+	float MaxMatrixDifference(const XMFLOAT4X4& a, FXMMATRIX b)
+	{
+		XMFLOAT4X4 other;
+		XMStoreFloat4x4(&other, b);
+		float worst = 0.0f;
+		for (int i = 0; i < 16; i++)
+			worst = (std::max)(worst, fabsf((&a._11)[i] - (&other._11)[i]));
+		return worst;
+	}
+}
+
+int RunFixedTimestepChecks()
+{
+	printf("Fixed timestep checks\n");
+	int failures = 0;
+	char detail[256];
+
+	const size_t entityCount = 3000;
+	const uint64_t ticks = 600;
+
+	// The same ticks however the frames fall - steady, jittery, or
+	// stalling long enough for the clamp to drop time
+	std::vector<float> reference;
+	{
+		JobSystem jobSystem(3);
+		const FramePattern patterns[] = { FramePattern::Steady60, FramePattern::Steady144, FramePattern::Jittery, FramePattern::Stalls };
+		const char* names[] = { "60 Hz", "144 Hz", "jittery", "stalls" };
+		size_t differing = 0;
+		std::string summary;
+		for (size_t p = 0; p < 4; p++)
+		{
+			EntityStore store;
+			CreateTickCheckEntities(store, entityCount, 1234);
+			FixedTimestepStats stats = RunTickCheckFrames(store, jobSystem, patterns[p], ticks);
+			std::vector<float> state = TickCheckState(store);
+			if (p == 0)
+				reference = state;
+			else
+				differing += memcmp(state.data(), reference.data(), state.size() * sizeof(float)) != 0;
+
+			char run[64];
+			snprintf(run, sizeof(run), "%s%s %llu dropped", p ? ", " : "", names[p], (unsigned long long)stats.droppedTicks);
+			summary += run;
+		}
+		snprintf(detail, sizeof(detail), "%zu of 3 differ after %llu ticks (%s)", differing, (unsigned long long)ticks, summary.c_str());
+		failures += ReportCheck("ticks don't depend on frame times", differing == 0, detail);
+	}
+
+	// Nor on how many threads run them
+	{
+		size_t differing = 0;
+		for (int workers : { 0, 1, 7 })
+		{
+			JobSystem jobSystem(workers);
+			EntityStore store;
+			CreateTickCheckEntities(store, entityCount, 1234);
+			RunTickCheckFrames(store, jobSystem, FramePattern::Jittery, ticks);
+			std::vector<float> state = TickCheckState(store);
+			differing += state.size() != reference.size() || memcmp(state.data(), reference.data(), state.size() * sizeof(float)) != 0;
+		}
+		snprintf(detail, sizeof(detail), "%zu of 3 thread counts differ", differing);
+		failures += ReportCheck("ticks don't depend on thread count", differing == 0, detail);
+	}
+
+	// A long frame runs the most ticks it may and drops the rest
+	{
+		FixedTimestep timestep(60.0, 8);
+		timestep.Advance(1.0);
+		int stalledTicks = 0;
+		while (timestep.Tick())
+			stalledTicks++;
+		float stalledAlpha = timestep.GetAlpha();
+		uint64_t dropped = timestep.GetStats().droppedTicks;
+
+		timestep.Advance(1.0 / 60.0);
+		int nextTicks = 0;
+		while (timestep.Tick())
+			nextTicks++;
+
+		snprintf(detail, sizeof(detail), "%d ticks, %llu dropped, alpha %.3f, then %d", stalledTicks, (unsigned long long)dropped, stalledAlpha, nextTicks);
+		failures += ReportCheck("a stalled frame is clamped",
+			stalledTicks == 8 && dropped == 52 && stalledAlpha >= 0.0f && stalledAlpha < 1.0f && nextTicks == 1, detail);
+	}
+
+	// Ticks plus alpha account for all the time frames brought
+	{
+		FixedTimestep timestep(60.0, 8);
+		double realTime = 0.0;
+		double worst = 0.0;
+		for (int frame = 0; frame < 1000; frame++)
+		{
+			double frameTime = 1.0 / 144.0;
+			realTime += frameTime;
+			timestep.Advance(frameTime);
+			while (timestep.Tick()) {}
+			double simulated = timestep.GetTime() + timestep.GetAlpha() / timestep.GetTickRate();
+			worst = (std::max)(worst, fabs(simulated - realTime));
+		}
+		snprintf(detail, sizeof(detail), "%llu ticks for %.3f s, %.2e s off at worst",
+			(unsigned long long)timestep.GetStats().ticks, realTime, worst);
+		failures += ReportCheck("ticks keep up with real time",
+			worst < 1e-6 && timestep.GetStats().droppedTicks == 0 && timestep.GetStats().ticks == 416, detail);
+	}
+
+	// Changing the rate carries on from the time so far
+	{
+		FixedTimestep timestep(60.0, 8);
+		for (int i = 0; i < 30; i++)
+		{
+			timestep.Advance(1.0 / 60.0);
+			while (timestep.Tick()) {}
+		}
+		double before = timestep.GetTime();
+		timestep.SetTickRate(30.0);
+		for (int i = 0; i < 10; i++)
+		{
+			timestep.Advance(1.0 / 30.0);
+			while (timestep.Tick()) {}
+		}
+		double after = timestep.GetTime();
+		snprintf(detail, sizeof(detail), "%.4f s at 60 Hz, %.4f s after 10 frames at 30 Hz", before, after);
+		failures += ReportCheck("changing the tick rate keeps the time",
+			fabs(before - 0.5) < 1e-6 && fabs(after - (0.5 + 10.0 / 30.0)) < 1e-6 && timestep.GetStep() == 1.0f / 30.0f, detail);
+	}
+
+	// Alpha 0 and 1 land on the last two ticks' matrices, and in
+	// between follows the reference slerp
+	{
+		JobSystem jobSystem(3);
+		EntityStore store;
+		CreateTickCheckEntities(store, entityCount, 99);
+		AnimatedQuery animated(store);
+		InterpolatedQuery interpolated(store);
+		for (int tick = 1; tick <= 3; tick++)
+		{
+			AnimateEntities(animated, jobSystem, 1.0f / 60.0f, tick / 60.0f);
+			RecordTickPoses(interpolated, jobSystem);
+		}
+
+		EntityStore copy;
+		InterpolatedQuery copied(copy);
+		float worst[3] = {};
+		const float alphas[3] = { 0.0f, 1.0f, 0.37f };
+		for (int a = 0; a < 3; a++)
+		{
+			copy.CopyFrom(store);
+			InterpolateTransforms(copied, alphas[a], jobSystem);
+			copied.ForEach([&](EntityId, Transform& transform, TransformHistory& history)
+			{
+				const TransformPose& p0 = history.previous;
+				const TransformPose& p1 = history.current;
+				float t = alphas[a];
+				XMFLOAT3 position(p0.position.x + (p1.position.x - p0.position.x) * t,
+					p0.position.y + (p1.position.y - p0.position.y) * t,
+					p0.position.z + (p1.position.z - p0.position.z) * t);
+				XMFLOAT3 scale(p0.scale.x + (p1.scale.x - p0.scale.x) * t,
+					p0.scale.y + (p1.scale.y - p0.scale.y) * t,
+					p0.scale.z + (p1.scale.z - p0.scale.z) * t);
+				XMFLOAT4 orientation = ReferenceSlerp(p0.orientation, p1.orientation, t);
+				worst[a] = (std::max)(worst[a], MaxMatrixDifference(transform.GetWorldMatrix(), PoseMatrix(position, orientation, scale)));
+			});
+		}
+
+		// Alpha 1 is the current tick, as Transform itself builds it
+		float worstCurrent = 0.0f;
+		copy.CopyFrom(store);
+		InterpolateTransforms(copied, 1.0f, jobSystem);
+		InterpolatedQuery(store).ForEach([&](EntityId id, Transform& transform, TransformHistory&)
+		{
+			XMFLOAT4X4 world = transform.GetWorldMatrix();
+			worstCurrent = (std::max)(worstCurrent, MaxMatrixDifference(copy.Get<Transform>(id).GetWorldMatrix(), XMLoadFloat4x4(&world)));
+		});
+
+		snprintf(detail, sizeof(detail), "off by %.1e at 0, %.1e at 1, %.1e at 0.37, %.1e from the transform's own",
+			worst[0], worst[1], worst[2], worstCurrent);
+		failures += ReportCheck("interpolation matches the reference",
+			worst[0] < 1e-4f && worst[1] < 1e-4f && worst[2] < 1e-4f && worstCurrent < 1e-4f, detail);
+	}
+
+	// What the pass costs, everything moving
+	{
+		JobSystem jobSystem;
+		const size_t count = 100000;
+		EntityStore store;
+		CreateTickCheckEntities(store, count, 5);
+		AnimatedQuery animated(store);
+		InterpolatedQuery interpolated(store);
+		for (int tick = 1; tick <= 2; tick++)
+		{
+			AnimateEntities(animated, jobSystem, 1.0f / 60.0f, tick / 60.0f);
+			RecordTickPoses(interpolated, jobSystem);
+		}
+
+		EntityStore copy;
+		InterpolatedQuery copied(copy);
+		const int runs = 20;
+		double totalMs = 0.0;
+		for (int run = 0; run < runs; run++)
+		{
+			copy.CopyFrom(store, &jobSystem);
+			auto start = std::chrono::high_resolution_clock::now();
+			InterpolateTransforms(copied, (run + 0.5f) / runs, jobSystem);
+			totalMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		}
+		snprintf(detail, sizeof(detail), "%zu entities in %.3f ms on %u threads (%.1f ns each)",
+			count, totalMs / runs, jobSystem.GetThreadCount(), totalMs / runs * 1e6 / count);
+		failures += ReportCheck("interpolating every entity", true, detail);
+	}
+
+	return ReportFailures(failures);
+}
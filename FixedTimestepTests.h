@@ -0,0 +1,21 @@
+#pragma once
+
+// --------------------------------------------------------
+// Headless checks of the fixed timestep and interpolation.
+//
+//  - animated entities end up bit for bit the same after the
+//    same ticks, whatever frame times fed them (steady, jittery,
+//    or stalls the clamp drops time from) and however many
+//    threads ran them
+//  - a long frame runs no more than the tick limit, and the
+//    rest of its time is dropped
+//  - ticks and alpha add up to the real time frames brought
+//  - changing the tick rate keeps the simulation time
+//  - interpolated world matrices match a scalar lerp/slerp
+//    reference, and alpha 1 matches the transform's own
+//
+// Also prints what interpolating 100000 moving entities costs.
+//
+// Returns 0 if all checks passed.
+// --------------------------------------------------------
+int RunFixedTimestepChecks();
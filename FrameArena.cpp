@@ -0,0 +1,86 @@
+#include "FrameArena.h"
+#include <algorithm>
+#include <cstring>
+
+FrameArena::FrameArena(unsigned int frameCount, size_t capacity)
+	: frameCount((std::max)(frameCount, 1u))
+{
+	buffers = std::make_unique<Buffer[]>(this->frameCount);
+	for (unsigned int i = 0; i < this->frameCount; i++)
+	{
+		buffers[i].memory = std::make_unique<uint8_t[]>(capacity);
+		buffers[i].capacity = capacity;
+	}
+	stats.capacity = capacity;
+}
+
+// --------------------------------------------------------
+// Closes the current frame's numbers, then empties the next
+// buffer - regrown first if any frame since it was last used
+// needed more than it holds
+// --------------------------------------------------------
+void FrameArena::BeginFrame()
+{
+	Buffer& finished = buffers[current];
+	stats.frameBytes = (std::min)(finished.offset.load(std::memory_order_relaxed), finished.capacity) + finished.overflowBytes;
+	stats.overflowBytes = finished.overflowBytes;
+	stats.highWaterMark = (std::max)(stats.highWaterMark, stats.frameBytes);
+
+	current = (current + 1) % frameCount;
+	Buffer& next = buffers[current];
+	next.overflow.clear();
+	next.overflowBytes = 0;
+	next.offset.store(0, std::memory_order_relaxed);
+
+	if (next.capacity < stats.highWaterMark)
+	{
+		size_t capacity = next.capacity;
+		while (capacity < stats.highWaterMark)
+			capacity *= 2;
+		next.memory = std::make_unique<uint8_t[]>(capacity);
+		next.capacity = capacity;
+		stats.capacity = (std::max)(stats.capacity, capacity);
+		stats.growCount++;
+	}
+}
+
+void* FrameArena::Allocate(size_t size, size_t alignment)
+{
+	Buffer& buffer = buffers[current];
+	uintptr_t base = (uintptr_t)buffer.memory.get();
+
+	size_t offset = buffer.offset.load(std::memory_order_relaxed);
+	size_t aligned;
+	do
+	{
+		aligned = ((base + offset + alignment - 1) & ~(uintptr_t)(alignment - 1)) - base;
+		if (aligned + size > buffer.capacity)
+			return AllocateOverflow(buffer, size, alignment);
+	} while (!buffer.offset.compare_exchange_weak(offset, aligned + size, std::memory_order_relaxed));
+
+	return buffer.memory.get() + aligned;
+}
+
+void* FrameArena::AllocateOverflow(Buffer& buffer, size_t size, size_t alignment)
+{
+	std::lock_guard<std::mutex> lock(overflowMutex);
+	buffer.overflow.push_back(std::make_unique<uint8_t[]>(size + alignment));
+	buffer.overflowBytes += size;
+
+	uintptr_t address = (uintptr_t)buffer.overflow.back().get();
+	return (void*)((address + alignment - 1) & ~(uintptr_t)(alignment - 1));
+}
+
+const char* FrameArena::CopyString(const char* text)
+{
+	size_t length = strlen(text);
+	char* copy = Allocate<char>(length + 1);
+	memcpy(copy, text, length + 1);
+	return copy;
+}
+
+size_t FrameArena::GetFrameBytes() const
+{
+	const Buffer& buffer = buffers[current];
+	return (std::min)(buffer.offset.load(std::memory_order_relaxed), buffer.capacity) + buffer.overflowBytes;
+}
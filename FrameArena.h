@@ -0,0 +1,124 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// --------------------------------------------------------
+// The arena's numbers as of the last BeginFrame()
+// --------------------------------------------------------
+struct FrameArenaStats
+{
+	size_t capacity = 0;			// Of each frame's buffer
+	size_t frameBytes = 0;			// Used by the last finished frame
+	size_t overflowBytes = 0;		// Of those, what didn't fit in its buffer
+	size_t highWaterMark = 0;		// Most any frame has used
+	unsigned int growCount = 0;
+};
+
+// --------------------------------------------------------
+// Linear allocator for data that only lives for a frame: pass
+// lists, sort scratch, UI strings.
+//
+// Each frame in flight has its own buffer.  BeginFrame() moves
+// on to the oldest one and throws away everything in it at
+// once - nothing is freed one at a time, and nothing is
+// destroyed, so only trivially destructible objects belong
+// here.  What the previous frames allocated stays good, so a
+// frame's data can be read while the next one is built.
+//
+// Allocate() bumps an offset with a compare-and-swap, so it's
+// safe from any number of threads.  An allocation that doesn't
+// fit goes to the heap for that frame only; the buffer is
+// regrown to the high water mark the next time it comes
+// around, so a steady frame never touches the heap.
+// --------------------------------------------------------
+class FrameArena
+{
+public:
+	static const size_t DefaultCapacity = 256 * 1024;
+
+	explicit FrameArena(unsigned int frameCount = 2, size_t capacity = DefaultCapacity);
+	FrameArena(const FrameArena&) = delete;
+	FrameArena& operator=(const FrameArena&) = delete;
+
+	// Nothing may still be using the memory of the frame
+	// frameCount frames ago
+	void BeginFrame();
+
+	void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+	template<typename T> T* Allocate(size_t count) { return static_cast<T*>(Allocate(count * sizeof(T), alignof(T))); }
+
+	template<typename T, typename... Args> T* New(Args&&... args)
+	{
+		static_assert(std::is_trivially_destructible<T>::value, "Frame arena objects are never destroyed");
+		return new (Allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+	}
+
+	// A copy that lives as long as the frame
+	const char* CopyString(const char* text);
+
+	unsigned int GetFrameCount() const { return frameCount; }
+	size_t GetFrameBytes() const;		// So far this frame
+	const FrameArenaStats& GetStats() const { return stats; }
+
+private:
+	struct Buffer
+	{
+		std::unique_ptr<uint8_t[]> memory;
+		size_t capacity = 0;
+		std::atomic<size_t> offset{ 0 };
+		std::vector<std::unique_ptr<uint8_t[]>> overflow;
+		size_t overflowBytes = 0;
+	};
+
+	unsigned int frameCount;
+	std::unique_ptr<Buffer[]> buffers;
+	unsigned int current = 0;
+	std::mutex overflowMutex;
+	FrameArenaStats stats;
+
+	void* AllocateOverflow(Buffer& buffer, size_t size, size_t alignment);
+};
+
+// --------------------------------------------------------
+// Standard allocator over a FrameArena - a container's growth
+// is a pointer bump, and freeing is a no-op (the space comes
+// back with the frame).  Reserve up front where the size is
+// known, since every regrowth leaves the old block behind.
+//
+// A container kept past its frame must be replaced, not
+// cleared: clear() keeps the capacity, and that memory goes to
+// another frame once the arena comes around again.
+// --------------------------------------------------------
+template<typename T>
+class FrameAllocator
+{
+public:
+	using value_type = T;
+	using propagate_on_container_move_assignment = std::true_type;
+
+	FrameAllocator(FrameArena& arena) noexcept : arena(&arena) {}
+	template<typename U> FrameAllocator(const FrameAllocator<U>& other) noexcept : arena(other.GetArena()) {}
+
+	T* allocate(size_t count) { return arena->Allocate<T>(count); }
+	void deallocate(T*, size_t) noexcept {}
+
+	FrameArena* GetArena() const { return arena; }
+
+	template<typename U> bool operator==(const FrameAllocator<U>& other) const { return arena == other.GetArena(); }
+	template<typename U> bool operator!=(const FrameAllocator<U>& other) const { return arena != other.GetArena(); }
+
+private:
+	FrameArena* arena;
+};
+
+template<typename T> using FrameVector = std::vector<T, FrameAllocator<T>>;
+using FrameString = std::basic_string<char, std::char_traits<char>, FrameAllocator<char>>;
@@ -0,0 +1,165 @@
+#include "FrameArenaTests.h"
+#include "HeadlessTests.h"
+#include "SceneRendererTests.h"
+#include "FrameArena.h"
+#include "AllocationTracker.h"
+
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+using namespace DirectX;
+
+int RunFrameArenaChecks()
+{
+	printf("Frame arena checks\n");
+	int failures = 0;
+	char detail[256];
+
+	// Alignment, and blocks that don't overlap
+	{
+		FrameArena arena(2, 64 * 1024);
+		arena.BeginFrame();
+		const size_t alignments[] = { 1, 2, 4, 8, 16, 32, 64, 256 };
+		uint8_t* previousEnd = nullptr;
+		size_t misaligned = 0;
+		size_t overlapping = 0;
+		for (int i = 0; i < 32; i++)
+		{
+			size_t alignment = alignments[i % 8];
+			size_t size = 1 + (size_t)i * 7;
+			uint8_t* block = static_cast<uint8_t*>(arena.Allocate(size, alignment));
+			if ((uintptr_t)block % alignment != 0)
+				misaligned++;
+			if (previousEnd && block < previousEnd)
+				overlapping++;
+			previousEnd = block + size;
+		}
+		snprintf(detail, sizeof(detail), "%zu misaligned, %zu overlapping", misaligned, overlapping);
+		failures += ReportCheck("blocks are aligned and follow each other", misaligned == 0 && overlapping == 0, detail);
+	}
+
+	// Earlier frames survive until the arena comes around to them
+	{
+		FrameArena arena(2, 4096);
+		arena.BeginFrame();
+		int* first = arena.Allocate<int>(256);
+		for (int i = 0; i < 256; i++)
+			first[i] = i;
+
+		arena.BeginFrame();
+		int* second = arena.Allocate<int>(256);
+		for (int i = 0; i < 256; i++)
+			second[i] = -i;
+		bool kept = true;
+		for (int i = 0; i < 256; i++)
+			kept = kept && first[i] == i;
+
+		arena.BeginFrame();
+		int* third = arena.Allocate<int>(256);
+		failures += ReportCheck("the last frame's memory stays put while the next is built", kept && second != first, "");
+		failures += ReportCheck("the oldest frame's memory is reused whole", third == first, "");
+	}
+
+	// Overflow goes to the heap once, then the buffers grow
+	{
+		FrameArena arena(2, 1024);
+		arena.BeginFrame();
+		arena.Allocate(4000);
+		arena.Allocate(100);
+		arena.BeginFrame();
+		FrameArenaStats spilled = arena.GetStats();
+
+		arena.BeginFrame();
+		size_t heapBefore = AllocationTracker::GetTotals().allocations;
+		arena.Allocate(4000);
+		arena.Allocate(100);
+		size_t heapUsed = AllocationTracker::GetTotals().allocations - heapBefore;
+		arena.BeginFrame();
+		FrameArenaStats grown = arena.GetStats();
+
+		snprintf(detail, sizeof(detail), "%zu of %zu bytes spilled, then %zu, %zu heap allocations, %u grows to %zu",
+			spilled.overflowBytes, spilled.frameBytes, grown.overflowBytes, heapUsed, grown.growCount, grown.capacity);
+		failures += ReportCheck("a frame that outgrows the arena spills once, then fits",
+			spilled.overflowBytes == 4000 && spilled.highWaterMark >= 4100 &&
+			grown.overflowBytes == 0 && heapUsed == 0 && grown.capacity >= 4100, detail);
+	}
+
+	// Containers over the arena cost no heap allocations
+	{
+		FrameArena arena;
+		size_t heapBefore = 0;
+		size_t heapUsed = 0;
+		bool correct = true;
+		for (int frame = 0; frame < 4; frame++)
+		{
+			arena.BeginFrame();
+			if (frame == 3)
+				heapBefore = AllocationTracker::GetTotals().allocations;
+
+			FrameVector<int> values(arena);
+			for (int i = 0; i < 1000; i++)
+				values.push_back(i);
+			FrameString text(arena);
+			for (int i = 0; i < 100; i++)
+				text += "scratch ";
+			correct = correct && values[999] == 999 && text.size() == 800;
+
+			if (frame == 3)
+				heapUsed = AllocationTracker::GetTotals().allocations - heapBefore;
+		}
+		snprintf(detail, sizeof(detail), "%zu heap allocations, %.1f KB in the arena", heapUsed, arena.GetFrameBytes() / 1024.0);
+		failures += ReportCheck("vectors and strings on the arena skip the heap", correct && heapUsed == 0, detail);
+	}
+
+	// Threads allocating at once never get the same memory
+	{
+		const int threadCount = 4;
+		const int blocksPerThread = 10000;
+		FrameArena arena(2, 64 * 1024);
+		arena.BeginFrame();
+		std::vector<uint32_t*> blocks((size_t)threadCount * blocksPerThread);
+		std::vector<std::thread> threads;
+		for (int t = 0; t < threadCount; t++)
+		{
+			threads.emplace_back([&, t]()
+			{
+				for (int i = 0; i < blocksPerThread; i++)
+				{
+					uint32_t* block = arena.Allocate<uint32_t>(4);
+					for (int k = 0; k < 4; k++)
+						block[k] = (uint32_t)(t * blocksPerThread + i);
+					blocks[(size_t)t * blocksPerThread + i] = block;
+				}
+			});
+		}
+		for (std::thread& thread : threads)
+			thread.join();
+
+		size_t clobbered = 0;
+		for (size_t i = 0; i < blocks.size(); i++)
+		{
+			for (int k = 0; k < 4; k++)
+				if (blocks[i][k] != (uint32_t)i)
+				{
+					clobbered++;
+					break;
+				}
+		}
+		arena.BeginFrame();
+		snprintf(detail, sizeof(detail), "%zu of %zu blocks clobbered, %.1f KB with %.1f KB spilled",
+			clobbered, blocks.size(), arena.GetStats().frameBytes / 1024.0, arena.GetStats().overflowBytes / 1024.0);
+		failures += ReportCheck("threads allocating together get their own blocks", clobbered == 0, detail);
+	}
+
+	// The renderer's frame, immediate recording, one thread and all of them
+	printf("\n");
+	HeadlessBenchSettings settings;
+	settings.entityCount = 2000;
+	settings.frames = 12;
+	settings.scaling = true;
+	int benchResult = RunHeadlessBench(settings);
+	failures += ReportCheck("steady scene frames allocate nothing from the heap", benchResult == 0, "");
+
+	return ReportFailures(failures);
+}
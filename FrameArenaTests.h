@@ -0,0 +1,18 @@
+#pragma once
+
+// --------------------------------------------------------
+// Headless checks of the frame arena - no GPU.
+//
+//  - blocks come back aligned and in order
+//  - the previous frame's memory survives BeginFrame(), and the
+//    oldest frame's is reused from the start
+//  - a frame bigger than the arena spills to the heap once, and
+//    the same frame fits once the buffers have grown
+//  - FrameVector and FrameString grow without the heap
+//  - threads allocating at once never share a block
+// Then RunHeadlessBench() over a small scene, whose frames must
+// make no heap allocations at all once warmed up.
+//
+// Returns 0 if all checks passed.
+// --------------------------------------------------------
+int RunFrameArenaChecks();
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+
+// --------------------------------------------------------
+// Minimal GPU fence used to track when the GPU has finished
+// with a frame's worth of commands.
+//
+// - Signal() marks the end of everything submitted so far and
+//   returns a value that increases by one every call
+// - GetCompletedValue() returns the highest value the GPU has
+//   retired (never blocks)
+// - WaitFor() blocks until the given value has retired
+//
+// Kept free of any graphics API types so the code that relies
+// on it (e.g. the constant buffer ring) can be driven by a fake
+// fence without a GPU.
+// --------------------------------------------------------
+class IFrameFence
+{
+public:
+	virtual ~IFrameFence() = default;
+
+	virtual uint64_t Signal() = 0;
+	virtual uint64_t GetCompletedValue() = 0;
+	virtual void WaitFor(uint64_t value) = 0;
+};
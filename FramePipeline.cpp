@@ -0,0 +1,97 @@
+#include "FramePipeline.h"
+#include <chrono>
+
+namespace
+{
+	double Milliseconds(std::chrono::high_resolution_clock::duration d)
+	{
+		return std::chrono::duration<double, std::milli>(d).count();
+	}
+}
+
+// --------------------------------------------------------
+// Bumped after every change to the counters.  A waiter reads it
+// before checking its condition, so a change it missed leaves it
+// different and the wait returns at once.
+// --------------------------------------------------------
+void FrameHandoff::Signal()
+{
+	changes.fetch_add(1, std::memory_order_release);
+	changes.notify_all();
+}
+
+uint64_t FrameHandoff::BeginWrite()
+{
+	uint64_t frame = published.load(std::memory_order_relaxed);
+	if (frame < released.load(std::memory_order_acquire) + SlotCount)
+		return frame;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	while (true)
+	{
+		uint32_t seen = changes.load(std::memory_order_acquire);
+		if (frame < released.load(std::memory_order_acquire) + SlotCount)
+			break;
+		changes.wait(seen, std::memory_order_acquire);
+	}
+	stats.writeWaits++;
+	stats.writeWaitMs += Milliseconds(std::chrono::high_resolution_clock::now() - start);
+	return frame;
+}
+
+void FrameHandoff::Publish()
+{
+	published.fetch_add(1, std::memory_order_release);
+	Signal();
+}
+
+bool FrameHandoff::BeginRead(uint64_t& frame)
+{
+	frame = released.load(std::memory_order_relaxed);
+	if (frame < published.load(std::memory_order_acquire))
+		return true;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	while (true)
+	{
+		uint32_t seen = changes.load(std::memory_order_acquire);
+		if (frame < published.load(std::memory_order_acquire))
+			break;
+		if (closed.load(std::memory_order_acquire))
+			return false;
+		changes.wait(seen, std::memory_order_acquire);
+	}
+	stats.readWaits++;
+	stats.readWaitMs += Milliseconds(std::chrono::high_resolution_clock::now() - start);
+	return true;
+}
+
+void FrameHandoff::EndRead()
+{
+	released.fetch_add(1, std::memory_order_release);
+	Signal();
+}
+
+void FrameHandoff::WaitForReader()
+{
+	uint64_t frames = published.load(std::memory_order_relaxed);
+	if (released.load(std::memory_order_acquire) >= frames)
+		return;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	while (true)
+	{
+		uint32_t seen = changes.load(std::memory_order_acquire);
+		if (released.load(std::memory_order_acquire) >= frames)
+			break;
+		changes.wait(seen, std::memory_order_acquire);
+	}
+	stats.writeWaits++;
+	stats.writeWaitMs += Milliseconds(std::chrono::high_resolution_clock::now() - start);
+}
+
+void FrameHandoff::Close()
+{
+	closed.store(true, std::memory_order_release);
+	Signal();
+}
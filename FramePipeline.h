@@ -0,0 +1,115 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+struct FramePipelineStats
+{
+	uint64_t writeWaits = 0;		// BeginWrite() and WaitForReader() calls that had to wait for the reader
+	double writeWaitMs = 0.0;
+	uint64_t readWaits = 0;			// BeginRead() calls that had to wait for the writer
+	double readWaitMs = 0.0;
+};
+
+// --------------------------------------------------------
+// The counters behind a FramePipeline: frames published by the
+// writer and frames released by the reader.  Each side only
+// ever moves its own counter forward, so the handoff takes no
+// lock.  A side that has to wait for the other sleeps on an
+// atomic that every change bumps.
+//
+// Frame N uses slot N % SlotCount.  The writer may start frame
+// N once frame N - SlotCount is released, and the reader may
+// start frame N once it's published.
+// --------------------------------------------------------
+class FrameHandoff
+{
+public:
+	static const uint64_t SlotCount = 2;
+
+	FrameHandoff() = default;
+	FrameHandoff(const FrameHandoff&) = delete;
+	FrameHandoff& operator=(const FrameHandoff&) = delete;
+
+	// Writer.  Returns the frame to write
+	uint64_t BeginWrite();
+	void Publish();
+
+	// Reader.  False once closed with every published frame read
+	bool BeginRead(uint64_t& frame);
+	void EndRead();
+
+	// Writer.  Waits until every published frame is released -
+	// the reader then touches nothing until the next Publish()
+	void WaitForReader();
+
+	// Writer.  No more frames - wakes a waiting reader
+	void Close();
+
+	uint64_t GetPublishedFrames() const { return published.load(std::memory_order_acquire); }
+	uint64_t GetReleasedFrames() const { return released.load(std::memory_order_acquire); }
+
+	// Each side's half is only up to date on that side, or once
+	// both have stopped
+	const FramePipelineStats& GetStats() const { return stats; }
+
+private:
+	alignas(64) std::atomic<uint64_t> published{ 0 };
+	alignas(64) std::atomic<uint64_t> released{ 0 };
+	std::atomic<bool> closed{ false };
+	std::atomic<uint32_t> changes{ 0 };
+	FramePipelineStats stats;
+
+	void Signal();
+};
+
+// --------------------------------------------------------
+// Two-stage frame pipeline: the simulation writes frame N + 1
+// into one snapshot while the renderer reads frame N from the
+// other.
+//
+// The writer fills a snapshot between BeginWrite() and
+// Publish(), and never touches it again until the reader has
+// released it.  The reader has the snapshot to itself between
+// BeginRead() and EndRead() - the data is the frame's and
+// doesn't change, though queries in it may cache what they
+// find.  BeginWrite() waits until the frame before last is
+// released, so the simulation is never more than one frame
+// ahead of what's on screen.
+//
+// Snapshots are reused every other frame, so containers in
+// them keep their capacity and refilling them doesn't touch the
+// heap.
+//
+// One writer thread and one reader thread - or one thread
+// doing both in turn, writing each frame and then reading it.
+// --------------------------------------------------------
+template<typename Snapshot>
+class FramePipeline
+{
+public:
+	// The next frame's snapshot, once the reader is done with it
+	Snapshot& BeginWrite() { return snapshots[handoff.BeginWrite() % FrameHandoff::SlotCount]; }
+	void Publish() { handoff.Publish(); }
+
+	// Every published frame read and released, so the writer can
+	// change what the reader shares with it
+	void WaitForReader() { handoff.WaitForReader(); }
+
+	// The oldest unread frame, waiting until it's published.  Null
+	// once closed with nothing left to read.
+	Snapshot* BeginRead()
+	{
+		uint64_t frame;
+		return handoff.BeginRead(frame) ? &snapshots[frame % FrameHandoff::SlotCount] : nullptr;
+	}
+	void EndRead() { handoff.EndRead(); }
+
+	void Close() { handoff.Close(); }
+
+	const FrameHandoff& GetHandoff() const { return handoff; }
+
+private:
+	FrameHandoff handoff;
+	Snapshot snapshots[FrameHandoff::SlotCount];
+};
@@ -0,0 +1,718 @@
+#include "FramePipelineTests.h"
+#include "HeadlessTests.h"
+#include "RecordingBackend.h"
+#include "ConstantBufferRing.h"
+#include "SceneRenderer.h"
+#include "Mesh.h"
+#include "Material.h"
+#include "ResourceRegistry.h"
+#include "EntitySystems.h"
+#include "EntityStore.h"
+#include "JobSystem.h"
+#include "LightClusterGrid.h"
+#include "ShadowCascades.h"
+#include "FrameArena.h"
+#include "AllocationTracker.h"
+#include "FramePipeline.h"
+#include "RenderSnapshot.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+	// A frame of the handoff check - every value is the frame
+	// number, so a frame written while it's read shows up torn
+	struct HandoffCheckFrame
+	{
+		uint64_t frame = 0;
+		uint64_t values[64] = {};
+	};
+
+	// Entities, some moved between archetypes by an AnimationState,
+	// and an id's Transform position y is the id
+	void CreateCheckEntities(EntityStore& store, std::vector<EntityId>& alive, int count, std::mt19937& random)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			EntityId entity = CreateRenderEntity(store, MeshHandle(), MaterialHandle());
+			store.Get<Transform>(entity).SetPosition(0.0f, (float)entity, 0.0f);
+			if (random() % 3 == 0)
+				store.Add(entity, AnimationState::Spin(1.0f));
+			alive.push_back(entity);
+		}
+	}
+
+	// Destroys, creates and moves a few entities at random
+	void RestructureCheckEntities(EntityStore& store, std::vector<EntityId>& alive, int changes, std::mt19937& random)
+	{
+		for (int i = 0; i < changes && !alive.empty(); i++)
+		{
+			size_t index = random() % alive.size();
+			store.Destroy(alive[index]);
+			alive[index] = alive.back();
+			alive.pop_back();
+		}
+		CreateCheckEntities(store, alive, changes, random);
+		for (int i = 0; i < changes; i++)
+		{
+			EntityId entity = alive[random() % alive.size()];
+			if (store.Has<AnimationState>(entity))
+				store.Remove<AnimationState>(entity);
+			else
+				store.Add(entity, AnimationState::Sway(XMFLOAT3(0, 0, 0), 1.0f, 1.0f));
+		}
+	}
+
+	// Entities in source that the copy has differently
+	size_t CountCopyDifferences(const EntityStore& source, const EntityStore& copy)
+	{
+		size_t differences = 0;
+		if (copy.GetIdCapacity() != source.GetIdCapacity() || copy.GetCount() != source.GetCount() ||
+			copy.GetChunkCount() != source.GetChunkCount())
+			differences++;
+		for (EntityId entity = 0; entity < (EntityId)source.GetIdCapacity(); entity++)
+		{
+			if (copy.IsAlive(entity) != source.IsAlive(entity))
+			{
+				differences++;
+				continue;
+			}
+			if (!source.IsAlive(entity))
+				continue;
+
+			Transform sourceTransform = source.Get<Transform>(entity);
+			Transform copyTransform = copy.Get<Transform>(entity);
+			XMFLOAT3 a = sourceTransform.GetPosition();
+			XMFLOAT3 b = copyTransform.GetPosition();
+			if (a.x != b.x || a.y != b.y || a.z != b.z || copy.Has<AnimationState>(entity) != source.Has<AnimationState>(entity))
+				differences++;
+		}
+		return differences;
+	}
+
+	// A render snapshot, and what the simulation says is in it
+	struct PipelineCheckFrame
+	{
+		RenderSnapshot render;
+		size_t entityCount = 0;
+		uint64_t idSum = 0;
+	};
+
+	// --------------------------------------------------------
+	// Counts what in the snapshot isn't its own frame's: every
+	// stamp is the frame number, entities sit where the records
+	// say with their own id's position, and the count and ids add
+	// up to what the simulation had
+	// --------------------------------------------------------
+	size_t CountSnapshotErrors(PipelineCheckFrame& snapshot, JobSystem& jobSystem)
+	{
+		RenderSnapshot& render = snapshot.render;
+		float stamp = (float)render.frame;
+		size_t errors = 0;
+		errors += render.cameraPosition.x != stamp;
+		errors += render.lights.size() != render.frame % 5 + 1;
+		for (const Light& light : render.lights)
+			errors += light.Intensity != stamp;
+
+		std::atomic<size_t> entityErrors{ 0 };
+		std::atomic<size_t> count{ 0 };
+		std::atomic<uint64_t> idSum{ 0 };
+		render.renderEntities.ParallelForEachChunk(jobSystem, [&](size_t, EntityChunk& chunk)
+		{
+			const EntityId* entities = chunk.GetEntities();
+			Transform* transforms = chunk.GetColumn<Transform>();
+			const WorldBounds* bounds = chunk.GetColumn<WorldBounds>();
+			size_t wrong = 0;
+			uint64_t sum = 0;
+			for (uint32_t row = 0; row < chunk.GetCount(); row++)
+			{
+				XMFLOAT3 position = transforms[row].GetPosition();
+				wrong += position.x != stamp || position.y != (float)entities[row];
+				wrong += bounds[row].box.center.x != stamp;
+				wrong += &render.entities.Get<Transform>(entities[row]) != &transforms[row];
+				wrong += entities[row] >= render.entityBounds.size() || render.entityBounds[entities[row]].center.x != stamp;
+				sum += entities[row];
+			}
+			entityErrors.fetch_add(wrong, std::memory_order_relaxed);
+			count.fetch_add(chunk.GetCount(), std::memory_order_relaxed);
+			idSum.fetch_add(sum, std::memory_order_relaxed);
+		});
+		errors += entityErrors.load();
+		errors += count.load() != snapshot.entityCount || count.load() != render.entities.GetCount();
+		errors += idSum.load() != snapshot.idSum;
+		return errors;
+	}
+
+	// Stamps every entity with the frame number
+	void StampCheckEntities(RenderQuery& entities, JobSystem& jobSystem, float stamp)
+	{
+		entities.ParallelForEachChunk(jobSystem, [stamp](size_t, EntityChunk& chunk)
+		{
+			const EntityId* ids = chunk.GetEntities();
+			Transform* transforms = chunk.GetColumn<Transform>();
+			WorldBounds* bounds = chunk.GetColumn<WorldBounds>();
+			for (uint32_t row = 0; row < chunk.GetCount(); row++)
+			{
+				transforms[row].SetPosition(stamp, (float)ids[row], 0.0f);
+				transforms[row].GetWorldMatrix();
+				bounds[row].box.center.x = stamp;
+			}
+		});
+	}
+}
+
+int RunFramePipelineChecks()
+{
+	printf("Frame pipeline checks\n");
+	int failures = 0;
+	char detail[256];
+
+	// Two threads, the reader slower now and then so the writer has to wait
+	{
+		const uint64_t frames = 100000;
+		FramePipeline<HandoffCheckFrame> pipeline;
+		std::atomic<uint64_t> tornFrames{ 0 };
+		std::atomic<uint64_t> outOfOrder{ 0 };
+		std::atomic<uint64_t> tooFarAhead{ 0 };
+		std::thread reader([&]()
+		{
+			uint64_t expected = 0;
+			while (HandoffCheckFrame* frame = pipeline.BeginRead())
+			{
+				outOfOrder.fetch_add(frame->frame != expected++, std::memory_order_relaxed);
+				tooFarAhead.fetch_add(pipeline.GetHandoff().GetPublishedFrames() > frame->frame + 2, std::memory_order_relaxed);
+				if (frame->frame % 64 == 0)
+					std::this_thread::yield();
+				for (uint64_t value : frame->values)
+					tornFrames.fetch_add(value != frame->frame, std::memory_order_relaxed);
+				pipeline.EndRead();
+			}
+		});
+		for (uint64_t f = 0; f < frames; f++)
+		{
+			HandoffCheckFrame& frame = pipeline.BeginWrite();
+			tooFarAhead.fetch_add(pipeline.GetHandoff().GetReleasedFrames() + 1 < f, std::memory_order_relaxed);
+			frame.frame = f;
+			for (uint64_t& value : frame.values)
+				value = f;
+			pipeline.Publish();
+		}
+		pipeline.Close();
+		reader.join();
+
+		const FramePipelineStats& stats = pipeline.GetHandoff().GetStats();
+		snprintf(detail, sizeof(detail), "%llu torn, %llu out of order, %llu too far ahead, read %llu (writer waited %llu times, reader %llu)",
+			(unsigned long long)tornFrames.load(), (unsigned long long)outOfOrder.load(), (unsigned long long)tooFarAhead.load(),
+			(unsigned long long)pipeline.GetHandoff().GetReleasedFrames(),
+			(unsigned long long)stats.writeWaits, (unsigned long long)stats.readWaits);
+		failures += ReportCheck("frames cross in order, whole, a frame apart",
+			tornFrames.load() == 0 && outOfOrder.load() == 0 && tooFarAhead.load() == 0 &&
+			pipeline.GetHandoff().GetReleasedFrames() == frames, detail);
+	}
+
+	// One thread doing both never waits on itself
+	{
+		FramePipeline<HandoffCheckFrame> pipeline;
+		size_t wrong = 0;
+		for (uint64_t f = 0; f < 10; f++)
+		{
+			pipeline.BeginWrite().frame = f;
+			pipeline.Publish();
+			HandoffCheckFrame* frame = pipeline.BeginRead();
+			wrong += !frame || frame->frame != f;
+			pipeline.EndRead();
+		}
+		const FramePipelineStats& stats = pipeline.GetHandoff().GetStats();
+		snprintf(detail, sizeof(detail), "%zu wrong, %llu waits", wrong, (unsigned long long)(stats.writeWaits + stats.readWaits));
+		failures += ReportCheck("one thread writes then reads", wrong == 0 && stats.writeWaits + stats.readWaits == 0, detail);
+	}
+
+	// Closing wakes a reader that's waiting, after the frames already
+	// published are read
+	{
+		FramePipeline<HandoffCheckFrame> pipeline;
+		pipeline.BeginWrite().frame = 0;
+		pipeline.Publish();
+		std::atomic<int> read{ 0 };
+		std::thread reader([&]()
+		{
+			while (pipeline.BeginRead())
+			{
+				read.fetch_add(1);
+				pipeline.EndRead();
+			}
+		});
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		pipeline.Close();
+		reader.join();
+		snprintf(detail, sizeof(detail), "%d frames read", read.load());
+		failures += ReportCheck("closing wakes a waiting reader", read.load() == 1, detail);
+	}
+
+	// Waiting for a slow reader returns once it has released every
+	// frame - and it isn't in the middle of one
+	{
+		FramePipeline<HandoffCheckFrame> pipeline;
+		std::atomic<int> reading{ 0 };
+		std::thread reader([&]()
+		{
+			while (pipeline.BeginRead())
+			{
+				reading.store(1);
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+				reading.store(0);
+				pipeline.EndRead();
+			}
+		});
+		for (uint64_t f = 0; f < 2; f++)
+		{
+			pipeline.BeginWrite().frame = f;
+			pipeline.Publish();
+		}
+		pipeline.WaitForReader();
+		uint64_t released = pipeline.GetHandoff().GetReleasedFrames();
+		bool midFrame = reading.load() != 0;
+		pipeline.Close();
+		reader.join();
+		snprintf(detail, sizeof(detail), "%llu of 2 frames released%s", (unsigned long long)released, midFrame ? ", reader mid-frame" : "");
+		failures += ReportCheck("waiting for the reader drains it", released == 2 && !midFrame, detail);
+	}
+
+	// Copies of a store as it changes, and of a different store
+	{
+		std::mt19937 random(7);
+		EntityStore source;
+		EntityStore copy;
+		std::vector<EntityId> alive;
+		CreateCheckEntities(source, alive, 2000, random);
+		copy.CopyFrom(source);
+		size_t differences = CountCopyDifferences(source, copy);
+		for (int round = 0; round < 20; round++)
+		{
+			RestructureCheckEntities(source, alive, 150, random);
+			copy.CopyFrom(source);
+			differences += CountCopyDifferences(source, copy);
+		}
+		while (alive.size() > 100)
+		{
+			source.Destroy(alive.back());
+			alive.pop_back();
+		}
+		copy.CopyFrom(source);
+		differences += CountCopyDifferences(source, copy);
+
+		// Archetypes made in a different order
+		EntityStore other;
+		std::vector<EntityId> otherAlive;
+		for (int i = 0; i < 300; i++)
+			otherAlive.push_back(other.Create(Transform(), AnimationState::Pulse(1.0f, 0.5f)));
+		CreateCheckEntities(other, otherAlive, 300, random);
+		copy.CopyFrom(other);
+		differences += CountCopyDifferences(other, copy);
+		snprintf(detail, sizeof(detail), "%zu differences over 23 copies", differences);
+		failures += ReportCheck("copied stores match their source", differences == 0, detail);
+
+		// Nothing to allocate once the layout has been copied
+		copy.CopyFrom(source);
+		AllocationTracker::SetSteadyState(true);
+		copy.CopyFrom(source);
+		uint64_t allocations = AllocationTracker::GetSteadyStateAllocations();
+		AllocationTracker::SetSteadyState(false);
+		snprintf(detail, sizeof(detail), "%llu heap allocations", (unsigned long long)allocations);
+		failures += ReportCheck("copying a settled store doesn't allocate", allocations == 0, detail);
+	}
+
+	// Render snapshots while the simulation restructures and rewrites
+	// the entities every frame - including straight after publishing,
+	// so anything of the source's left in a snapshot shows up
+	{
+		const uint64_t frames = 300;
+		JobSystem jobSystem(3, 1);
+		FramePipeline<PipelineCheckFrame> pipeline;
+		std::atomic<uint64_t> badFrames{ 0 };
+		std::atomic<uint64_t> errors{ 0 };
+		std::atomic<uint64_t> tooFarAhead{ 0 };
+		std::thread renderThread([&]()
+		{
+			jobSystem.AttachThread();
+			uint64_t expected = 0;
+			while (PipelineCheckFrame* snapshot = pipeline.BeginRead())
+			{
+				tooFarAhead.fetch_add(pipeline.GetHandoff().GetPublishedFrames() > snapshot->render.frame + 2, std::memory_order_relaxed);
+				size_t frameErrors = snapshot->render.frame != expected++;
+				frameErrors += CountSnapshotErrors(*snapshot, jobSystem);
+				std::this_thread::yield();
+				frameErrors += CountSnapshotErrors(*snapshot, jobSystem);
+				errors.fetch_add(frameErrors, std::memory_order_relaxed);
+				badFrames.fetch_add(frameErrors > 0, std::memory_order_relaxed);
+				pipeline.EndRead();
+			}
+		});
+
+		std::mt19937 random(11);
+		EntityStore store;
+		RenderQuery entities(store);
+		std::vector<EntityId> alive;
+		CreateCheckEntities(store, alive, 3000, random);
+		for (uint64_t f = 0; f < frames; f++)
+		{
+			RestructureCheckEntities(store, alive, 40, random);
+			StampCheckEntities(entities, jobSystem, (float)f);
+
+			PipelineCheckFrame& snapshot = pipeline.BeginWrite();
+			RenderSnapshot& render = snapshot.render;
+			render.frame = f;
+			render.cameraPosition = XMFLOAT3((float)f, 0, 0);
+			Light light = {};
+			light.Intensity = (float)f;
+			render.lights.assign(f % 5 + 1, light);
+			render.entityBounds.assign(store.GetIdCapacity(), AABB());
+			snapshot.entityCount = 0;
+			snapshot.idSum = 0;
+			entities.ForEach([&](EntityId entity, Transform&, WorldBounds& bounds, MeshRef&, MaterialRef&, RenderFlags&)
+			{
+				render.entityBounds[entity] = bounds.box;
+				snapshot.entityCount++;
+				snapshot.idSum += entity;
+			});
+			render.entities.CopyFrom(store, &jobSystem);
+			pipeline.Publish();
+
+			StampCheckEntities(entities, jobSystem, -1.0f);
+		}
+		pipeline.Close();
+		renderThread.join();
+
+		snprintf(detail, sizeof(detail), "%llu of %llu frames wrong (%llu errors), %llu too far ahead",
+			(unsigned long long)badFrames.load(), (unsigned long long)pipeline.GetHandoff().GetReleasedFrames(),
+			(unsigned long long)errors.load(), (unsigned long long)tooFarAhead.load());
+		failures += ReportCheck("snapshots hold still under mutation",
+			errors.load() == 0 && tooFarAhead.load() == 0 && pipeline.GetHandoff().GetReleasedFrames() == frames, detail);
+	}
+
+	return ReportFailures(failures);
+}
+
+namespace
+{
+	// Keeps the synthetic loads from being optimized away
+	volatile float syntheticLoadSink = 0.0f;
+
+	// A fixed amount of dependent arithmetic
+	void SyntheticLoad(uint64_t iterations)
+	{
+		float value = syntheticLoadSink;
+		for (uint64_t i = 0; i < iterations; i++)
+			value = sqrtf(value + 1.0f);
+		syntheticLoadSink = value;
+	}
+
+	// Iterations of SyntheticLoad() in a millisecond on this machine
+	uint64_t CalibrateSyntheticLoad()
+	{
+		const uint64_t iterations = 1 << 22;
+		SyntheticLoad(iterations / 16);
+		auto start = std::chrono::high_resolution_clock::now();
+		SyntheticLoad(iterations);
+		double ms = Milliseconds(std::chrono::high_resolution_clock::now() - start);
+		return (uint64_t)(iterations / (std::max)(ms, 1e-3));
+	}
+
+	// What both stages of the pipeline bench work on
+	struct PipelineBenchScene
+	{
+		RecordingBackend& backend;
+		ConstantBufferRing& constantRing;
+		const ResourceRegistry& resources;
+		EntityStore& store;
+		const std::vector<Light>& lights;
+		ShaderHandle shadowVS;
+		float extent;
+		DirectX::XMFLOAT4X4 view;
+		DirectX::XMFLOAT4X4 projection;
+		DirectX::XMFLOAT3 cameraPosition;
+	};
+
+	struct PipelineBenchTimings
+	{
+		double frameMs = 0.0;
+		double simulateMs = 0.0;
+		double renderMs = 0.0;
+		FramePipelineStats waits;
+		uint64_t outOfOrder = 0;
+		uint64_t tooFarAhead = 0;
+		uint64_t renderedFrames = 0;
+		uint64_t steadyHeapAllocations = 0;
+	};
+
+	// --------------------------------------------------------
+	// Runs the frames through a FramePipeline - back to back on
+	// this thread, or with the render stage on a thread of its own
+	// sharing the job system - and returns per-frame averages.
+	// Each stage's time leaves out its waits on the other.
+	// --------------------------------------------------------
+	PipelineBenchTimings RunPipelineFrames(PipelineBenchScene& scene, const FramePipelineBenchSettings& settings,
+		int threadCount, uint64_t updateIterations, uint64_t drawIterations, bool threaded)
+	{
+		JobSystem jobSystem(threadCount - 1, 1);
+		FrameArena renderArena;
+		SceneRenderer sceneRenderer(scene.constantRing, jobSystem, renderArena);
+		LightClusterGrid lightClusters(scene.backend, jobSystem);
+		ShadowCascades shadowCascades(1024);
+		shadowCascades.SetShadowDistance(scene.extent);
+		BoundsQuery boundedEntities(scene.store);
+		FramePipeline<RenderSnapshot> pipeline;
+
+		PipelineBenchTimings timings;
+		uint64_t expectedFrame = 0;
+
+		// Moves everything, then copies out what the render stage reads
+		auto simulate = [&](int f)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			{
+				AllocationScope entityScope(AllocationTag::Entities);
+				boundedEntities.ParallelForEachChunk(jobSystem, [](size_t, EntityChunk& chunk)
+				{
+					Transform* transforms = chunk.GetColumn<Transform>();
+					for (uint32_t row = 0; row < chunk.GetCount(); row++)
+						transforms[row].Rotate(0.0f, 0.01f, 0.0f);
+				});
+				UpdateWorldBounds(boundedEntities, scene.resources, jobSystem);
+			}
+			SyntheticLoad(updateIterations);
+
+			double stageMs = Milliseconds(std::chrono::high_resolution_clock::now() - start);
+
+			RenderSnapshot& snapshot = pipeline.BeginWrite();
+			start = std::chrono::high_resolution_clock::now();
+			snapshot.frame = f;
+			snapshot.view = scene.view;
+			snapshot.projection = scene.projection;
+			snapshot.cameraPosition = scene.cameraPosition;
+			snapshot.ambientColor = XMFLOAT3(0.02f, 0.02f, 0.02f);
+			snapshot.lights.assign(scene.lights.begin(), scene.lights.end());
+			snapshot.entityBounds.resize(scene.store.GetIdCapacity());
+			boundedEntities.ForEach([&](EntityId entity, Transform&, MeshRef&, WorldBounds& bounds)
+			{
+				snapshot.entityBounds[entity] = bounds.box;
+			});
+			snapshot.entities.CopyFrom(scene.store, &jobSystem);
+			pipeline.Publish();
+			timings.simulateMs += stageMs + Milliseconds(std::chrono::high_resolution_clock::now() - start);
+		};
+
+		// Culls, packs and submits the oldest unread snapshot
+		auto render = [&]() -> bool
+		{
+			RenderSnapshot* snapshot = pipeline.BeginRead();
+			if (!snapshot)
+				return false;
+
+			auto start = std::chrono::high_resolution_clock::now();
+			AllocationScope rendererScope(AllocationTag::Renderer);
+			timings.outOfOrder += snapshot->frame != expectedFrame++;
+			timings.tooFarAhead += pipeline.GetHandoff().GetPublishedFrames() > snapshot->frame + 2;
+			renderArena.BeginFrame();
+			scene.backend.ResetFrame();
+
+			shadowCascades.Update(snapshot->view, snapshot->projection, snapshot->lights[0].Direction,
+				snapshot->entityBounds.data(), snapshot->entityBounds.size());
+			ShadowCascadeShaderData shadowData = shadowCascades.GetShaderData();
+			lightClusters.Build(snapshot->lights, snapshot->view, snapshot->projection);
+			lightClusters.Upload(snapshot->lights);
+			lightClusters.Bind(scene.backend, ShaderStage::Pixel, 5);
+			LightClusterShaderData clusterData = lightClusters.GetShaderData(1280.0f, 720.0f);
+
+			SceneFrameData frame = {};
+			frame.view = snapshot->view;
+			frame.projection = snapshot->projection;
+			frame.cameraPosition = snapshot->cameraPosition;
+			frame.ambientColor = snapshot->ambientColor;
+			frame.lightClusters = &clusterData;
+			frame.shadowCascades = shadowCascades.GetCascades();
+			frame.shadowCascadeCount = ShadowCascades::CascadeCount;
+			frame.shadows = &shadowData;
+
+			scene.constantRing.BeginFrame();
+			sceneRenderer.PackConstants(snapshot->renderEntities, scene.resources, frame);
+			scene.constantRing.Unmap();
+			for (unsigned int cascade = 0; cascade < ShadowCascades::CascadeCount; cascade++)
+				sceneRenderer.DrawShadowPass(scene.backend, scene.shadowVS, cascade);
+			sceneRenderer.DrawOpaquePass(scene.backend);
+			SyntheticLoad(drawIterations);
+			scene.constantRing.EndFrame();
+
+			timings.renderMs += Milliseconds(std::chrono::high_resolution_clock::now() - start);
+			timings.renderedFrames++;
+			pipeline.EndRead();
+			return true;
+		};
+
+		// The heap counts once the render stage is past the warm up too
+		auto start = std::chrono::high_resolution_clock::now();
+		if (threaded)
+		{
+			std::thread renderThread([&]()
+			{
+				jobSystem.AttachThread();
+				while (render())
+				{
+				}
+			});
+			for (int f = 0; f < settings.frames; f++)
+			{
+				AllocationTracker::SetSteadyState(f > WarmUpFrames);
+				simulate(f);
+			}
+			pipeline.Close();
+			renderThread.join();
+		}
+		else
+		{
+			for (int f = 0; f < settings.frames; f++)
+			{
+				AllocationTracker::SetSteadyState(f > WarmUpFrames);
+				simulate(f);
+				render();
+			}
+		}
+		double totalMs = Milliseconds(std::chrono::high_resolution_clock::now() - start);
+		timings.steadyHeapAllocations = AllocationTracker::GetSteadyStateAllocations();
+		AllocationTracker::SetSteadyState(false);
+
+		int count = settings.frames > 0 ? settings.frames : 1;
+		timings.frameMs = totalMs / count;
+		timings.simulateMs /= count;
+		timings.renderMs /= count;
+		timings.waits = pipeline.GetHandoff().GetStats();
+		return timings;
+	}
+}
+
+int RunFramePipelineBench(const FramePipelineBenchSettings& settings)
+{
+	// Declared first so it outlives everything holding its handles
+	RecordingBackend backend;
+	bool failed = false;
+
+	{
+		ConstantBufferRing constantRing(backend, backend.CreateFence());
+		ResourceRegistry resources(backend, backend.CreateFence());
+
+		// Scene setup - the headless bench's grid of cubes, with a
+		// spread of point lights for the clusters
+		MeshHandle cube = CreateBenchCube(resources, backend);
+		ShaderHandle vs = backend.CreateShader(ShaderStage::Vertex, fakeBytecode, sizeof(fakeBytecode));
+		ShaderHandle shadowVS = backend.CreateShader(ShaderStage::Vertex, fakeBytecode, sizeof(fakeBytecode));
+		ShaderHandle ps = backend.CreateShader(ShaderStage::Pixel, fakeBytecode, sizeof(fakeBytecode));
+
+		TextureDesc texDesc;
+		texDesc.width = 1;
+		texDesc.height = 1;
+		SamplerHandle sampler = backend.CreateSampler(SamplerDesc());
+
+		std::vector<MaterialHandle> materials;
+		for (int i = 0; i < settings.materialCount; i++)
+		{
+			materials.push_back(resources.Create<Material>(XMFLOAT4(1, 1, 1, 1), vs, ps));
+			Material* mat = resources.Get(materials.back());
+			for (unsigned int slot = 0; slot < 4; slot++)
+				mat->AddTexture(slot, backend.CreateTexture(texDesc));
+			mat->AddSampler(0, sampler);
+		}
+
+		EntityStore store;
+		int side = (int)ceilf(sqrtf((float)settings.entityCount));
+		for (int i = 0; i < settings.entityCount; i++)
+		{
+			CreateRenderEntity(store, cube, materials[i % materials.size()], XMFLOAT3(
+				(float)(i % side) * 2.0f - side,
+				0.0f,
+				(float)(i / side) * 2.0f - side));
+		}
+		float extent = (float)side;
+
+		std::mt19937 random(3);
+		std::uniform_real_distribution<float> spread(-extent, extent);
+		std::vector<Light> lights(65);
+		lights[0].Type = LIGHT_TYPE_DIRECTIONAL;
+		lights[0].Direction = XMFLOAT3(1, -1, 0);
+		lights[0].Color = XMFLOAT3(1, 1, 1);
+		lights[0].Intensity = 1.0f;
+		for (size_t i = 1; i < lights.size(); i++)
+		{
+			lights[i].Type = LIGHT_TYPE_POINT;
+			lights[i].Position = XMFLOAT3(spread(random), 2.0f, spread(random));
+			lights[i].Color = XMFLOAT3(1, 1, 1);
+			lights[i].Intensity = 1.0f;
+			lights[i].Range = 8.0f;
+		}
+
+		// The headless bench's camera, at the near edge looking across
+		XMFLOAT3 cameraPosition(0, extent * 0.25f, -extent);
+		XMFLOAT4X4 view, projection;
+		XMStoreFloat4x4(&view, XMMatrixLookToLH(XMLoadFloat3(&cameraPosition), XMVectorSet(0, -0.3f, 1, 0), XMVectorSet(0, 1, 0, 0)));
+		XMStoreFloat4x4(&projection, XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.01f, extent * 4.0f));
+		PipelineBenchScene scene = { backend, constantRing, resources, store, lights, shadowVS, extent, view, projection, cameraPosition };
+
+		int threadCount = settings.threadCount;
+		if (threadCount <= 0)
+			threadCount = (std::max)((int)std::thread::hardware_concurrency(), 1);
+		uint64_t iterationsPerMs = CalibrateSyntheticLoad();
+		uint64_t updateIterations = (uint64_t)(iterationsPerMs * settings.updateLoadMs);
+		uint64_t drawIterations = (uint64_t)(iterationsPerMs * settings.drawLoadMs);
+
+		unsigned int hardwareThreads = std::thread::hardware_concurrency();
+		printf("Frame pipeline bench: %d entities, %d frames, %.1f ms update load, %.1f ms draw load, %d job threads, %u hardware threads\n",
+			settings.entityCount, settings.frames, settings.updateLoadMs, settings.drawLoadMs, threadCount, hardwareThreads);
+		if (hardwareThreads < 2)
+			printf("  (one hardware thread - the two stages can only take turns, so pipelining can't speed anything up here)\n");
+		printf("              frame   simulate     render   simulation waited   render waited\n");
+
+		PipelineBenchTimings serial;
+		for (int threaded = 0; threaded < 2; threaded++)
+		{
+			PipelineBenchTimings timings = RunPipelineFrames(scene, settings, threadCount, updateIterations, drawIterations, threaded != 0);
+			if (!threaded)
+				serial = timings;
+			printf("  %-9s %6.2f ms  %6.2f ms  %6.2f ms  %5llu x %7.2f ms  %5llu x %7.2f ms\n",
+				threaded ? "pipelined" : "serial",
+				timings.frameMs,
+				timings.simulateMs,
+				timings.renderMs,
+				(unsigned long long)timings.waits.writeWaits, timings.waits.writeWaitMs,
+				(unsigned long long)timings.waits.readWaits, timings.waits.readWaitMs);
+
+			if (threaded)
+			{
+				// Overlapped, a frame costs its slower stage
+				double ideal = (std::max)(timings.simulateMs, timings.renderMs);
+				printf("  speedup %.2fx (%.2fx if the stages overlapped perfectly)\n",
+					timings.frameMs > 0.0 ? serial.frameMs / timings.frameMs : 0.0,
+					ideal > 0.0 ? (timings.simulateMs + timings.renderMs) / ideal : 0.0);
+			}
+
+			printf("    %llu frames rendered, %llu out of order, %llu more than a frame behind, %llu heap allocations after warm up\n",
+				(unsigned long long)timings.renderedFrames,
+				(unsigned long long)timings.outOfOrder,
+				(unsigned long long)timings.tooFarAhead,
+				(unsigned long long)timings.steadyHeapAllocations);
+			failed |= timings.renderedFrames != (uint64_t)settings.frames || timings.outOfOrder > 0 ||
+				timings.tooFarAhead > 0 || timings.steadyHeapAllocations > 0;
+		}
+	}
+
+	if (ReportValidation(backend) > 0)
+		failed = true;
+	return failed ? 1 : 0;
+}
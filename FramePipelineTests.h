@@ -0,0 +1,54 @@
+#pragma once
+
+// --------------------------------------------------------
+// Headless checks of the two-stage frame pipeline.
+//
+//  - a writer and a reader thread hand 100000 frames across in
+//    order, none skipped or torn, and the writer is never more
+//    than one frame ahead of the frame being read
+//  - one thread writing and then reading each frame never waits
+//  - closing wakes a waiting reader once every frame is read
+//  - waiting for the reader returns once it has released every
+//    published frame
+//  - a copied entity store matches its source through creates,
+//    destroys and archetype moves, and a settled one copies
+//    without allocating
+//  - render snapshots stay consistent while the simulation
+//    restructures and rewrites its entities every frame, read
+//    on a second thread sharing the job system
+//
+// Built for a sanitizer, it's the thread sanitizer's test too.
+//
+// Returns 0 if all checks passed.
+// --------------------------------------------------------
+int RunFramePipelineChecks();
+
+// --------------------------------------------------------
+// Headless benchmark of the frame pipeline: the simulation
+// (moving every entity, bounds, a synthetic update load and the
+// snapshot copy) against the render stage (shadow cascades,
+// light clusters, culling and constant packing, draw submission
+// on the RecordingBackend and a synthetic draw load).
+//
+// Runs the frames once with both stages back to back on one
+// thread, and once with the render stage on its own thread a
+// frame behind, and prints the time per frame of each.  The
+// synthetic loads are fixed amounts of arithmetic, calibrated
+// at the start, so a thread that's descheduled doesn't get
+// them done any sooner.
+//
+// Returns 0 if every frame was rendered in order, at most a
+// frame behind, with no binding errors and no heap allocations
+// after the warm up.
+// --------------------------------------------------------
+struct FramePipelineBenchSettings
+{
+	int entityCount = 20000;
+	int materialCount = 8;
+	int frames = 200;
+	float updateLoadMs = 4.0f;	// Extra simulation work a frame
+	float drawLoadMs = 4.0f;	// Extra render thread work a frame
+	int threadCount = -1;		// Job system threads besides the render thread, negative = every hardware thread
+};
+
+int RunFramePipelineBench(const FramePipelineBenchSettings& settings);
@@ -4,6 +4,7 @@
 #include "Input.h"
 #include "PathHelpers.h"
 #include "Window.h"
+#include "AllocationTracker.h"
 // This code assumes files are in "ImGui" subfolder!
 // Adjust as necessary for your own folder structure and project setup
 #include "ImGui/imgui.h"
@@ -11,6 +12,7 @@
 #include "ImGui/imgui_impl_win32.h"
 
 #include <DirectXMath.h>
+#include <chrono>
 
 // Needed for a helper function to load pre-compiled shader files
 #pragma comment(lib, "d3dcompiler.lib")
@@ -25,6 +27,11 @@ using namespace DirectX;
 // --------------------------------------------------------
 Game::Game()
 {
+	// Everything the scene renders goes through the backend, so it
+	// has to exist before any mesh, material or buffer is created
+	backend = std::make_unique<D3D11Backend>(Graphics::Device, Graphics::Context);
+	resources = std::make_unique<ResourceRegistry>(*backend, backend->CreateFence());
+
 	// Helper methods for loading shaders, creating some basic
 	// geometry to draw and some simple camera matrices.
 	//  - You'll be expanding and/or replacing these later
@@ -109,12 +116,23 @@ Game::Game()
 	//Graphics::Device->CreateBuffer(&psDesc, nullptr, psConstantBuffer.GetAddressOf());
 
 	// Create large ring buffer constant buffer
-	D3D11_BUFFER_DESC ringDesc = {};
-	ringDesc.ByteWidth = cbRingBufferSize;
-	ringDesc.Usage = D3D11_USAGE_DYNAMIC;
-	ringDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-	ringDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-	Graphics::Device->CreateBuffer(&ringDesc, nullptr, cbRingBuffer.GetAddressOf());
+	// - Event queries tell it when the GPU is done with each frame's slices
+	constantRing = std::make_unique<ConstantBufferRing>(
+		*backend,
+		backend->CreateFence(),
+		constantRingInitialSize);
+
+	// One worker per spare hardware thread, and the render thread
+	// works alongside them
+	jobSystem = std::make_unique<JobSystem>(-1, 1);
+	sceneRenderer = std::make_unique<SceneRenderer>(*constantRing, *jobSystem, renderArena);
+	lightClusters = std::make_unique<LightClusterGrid>(*backend, *jobSystem);
+	objectLights = std::make_unique<ObjectLightSelector>(*backend);
+	occlusionCuller = std::make_unique<OcclusionCuller>(*jobSystem);
+
+	// Records the frame's passes, optionally on deferred contexts
+	commandDevice = std::make_unique<D3D11CommandDevice>(*backend, Graphics::Device);
+	passScheduler = std::make_unique<PassScheduler>(*commandDevice, *jobSystem, renderArena);
 
 	// Set initial graphics API state
 	//  - These settings persist until we change them
@@ -138,7 +156,12 @@ Game::Game()
 		Graphics::Context->PSSetShader(pixelShader.Get(), 0, 0);*/
 		
 		// initialize ImGui & platform/render backends
+		// - ImGui allocates with malloc() unless told otherwise, which
+		//   the allocation tracker wouldn't see
 		IMGUI_CHECKVERSION();
+		ImGui::SetAllocatorFunctions(
+			[](size_t size, void*) { return AllocationTracker::Allocate(size, alignof(std::max_align_t)); },
+			[](void* memory, void*) { AllocationTracker::Free(memory); });
 		ImGui::CreateContext();
 		ImGui_ImplWin32_Init(Window::Handle());
 		ImGui_ImplDX11_Init(Graphics::Device.Get(), Graphics::Context.Get());
@@ -169,6 +192,19 @@ Game::Game()
 		aspectRatio));
 
 	activeCameraIndex = 0;
+
+	// The UI edits copies of what the renderer reads
+	for (MaterialHandle handle : materials)
+	{
+		const Material* material = resources->Get(handle);
+		materialSettings.push_back({ handle, material->GetColorTint(), material->GetUVScale(), material->GetUVOffset() });
+	}
+	renderSettings.cascadeSplitLambda = shadowCascades->GetSplitLambda();
+	renderSettings.shadowDistance = shadowCascades->GetShadowDistance();
+
+	// Everything exists - from here on the render thread draws the
+	// frames Update() hands it
+	renderThread = std::thread([this]() { RenderLoop(); });
 }
 
 
@@ -180,6 +216,10 @@ Game::Game()
 // --------------------------------------------------------
 Game::~Game()
 {
+	// The render thread draws whatever's left, then stops
+	framePipeline.Close();
+	renderThread.join();
+
 	// ImGui clean up
 	ImGui_ImplDX11_Shutdown();
 	ImGui_ImplWin32_Shutdown();
@@ -271,14 +311,16 @@ void Game::CreatePostProcessResources()
 // - This is a helper for running a full-screen post-process pass
 // ============================================================
 void Game::RunPostProcessPass(
+	D3D11RecordingContext& context,
 	ID3D11PixelShader* ps,
 	ID3D11ShaderResourceView* srcSRV,
 	ID3D11RenderTargetView* dstRTV,
-	void* cbData,
-	size_t cbSize)
+	const ConstantBufferSlice& cbSlice)
 {
+	ID3D11DeviceContext1* ctx = context.GetContext();
+
 	// Bind destination, no depth
-	Graphics::Context->OMSetRenderTargets(1, &dstRTV, nullptr);
+	ctx->OMSetRenderTargets(1, &dstRTV, nullptr);
 
 	// Full-window viewport
 	D3D11_VIEWPORT vp = {};
@@ -287,27 +329,27 @@ void Game::RunPostProcessPass(
 	vp.MaxDepth = 1.0f;
 	vp.TopLeftX = 0;
 	vp.TopLeftY = 0;
-	Graphics::Context->RSSetViewports(1, &vp);
+	ctx->RSSetViewports(1, &vp);
 
 	// Constant buffer (slot 0, pixel shader)
-	FillAndBindNextConstantBuffer(cbData, cbSize, false, 0);
+	ConstantBufferRing::BindPS(context.GetBackend(), 0, cbSlice);
 
 	// Shaders – no input layout for the VS_VertexID trick
-	Graphics::Context->VSSetShader(ppVS.Get(), 0, 0);
-	Graphics::Context->PSSetShader(ps, 0, 0);
-	Graphics::Context->IASetInputLayout(nullptr);
-	Graphics::Context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	ctx->VSSetShader(ppVS.Get(), 0, 0);
+	ctx->PSSetShader(ps, 0, 0);
+	ctx->IASetInputLayout(nullptr);
+	ctx->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
 	// Source texture + clamp sampler
-	Graphics::Context->PSSetShaderResources(0, 1, &srcSRV);
-	Graphics::Context->PSSetSamplers(0, 1, ppSampler.GetAddressOf());
+	ctx->PSSetShaderResources(0, 1, &srcSRV);
+	ctx->PSSetSamplers(0, 1, ppSampler.GetAddressOf());
 
 	// Draw the full-screen triangle (no VB needed)
-	Graphics::Context->Draw(3, 0);
+	ctx->Draw(3, 0);
 
 	// Unbind source so D3D doesn't complain next frame
 	ID3D11ShaderResourceView* nullSRV = nullptr;
-	Graphics::Context->PSSetShaderResources(0, 1, &nullSRV);
+	ctx->PSSetShaderResources(0, 1, &nullSRV);
 }
 
 
@@ -328,8 +370,8 @@ void Game::LoadShaders()
 	ID3DBlob* vertexShaderBlob;
 	ID3DBlob* shadowBlob;
 
-	Microsoft::WRL::ComPtr<ID3D11VertexShader> vs;
-	Microsoft::WRL::ComPtr<ID3D11PixelShader> ps;
+	ShaderHandle vs;
+	ShaderHandle ps;
 	// Loading shaders
 	//  - Visual Studio will compile our shaders at build time
 	//  - They are saved as .cso (Compiled Shader Object) files
@@ -343,24 +385,21 @@ void Game::LoadShaders()
 		D3DReadFileToBlob(FixPath(L"VertexShader.cso").c_str(), &vertexShaderBlob);
 		D3DReadFileToBlob(FixPath(L"ShadowVS.cso").c_str(), &shadowBlob);
 
-		// Create the actual Direct3D shaders on the GPU
-		Graphics::Device->CreatePixelShader(
+		// Create the actual shaders on the GPU (through the backend)
+		ps = backend->CreateShader(
+			ShaderStage::Pixel,
 			pixelShaderBlob->GetBufferPointer(),	// Pointer to blob's contents
-			pixelShaderBlob->GetBufferSize(),		// How big is that data?
-			0,										// No classes in this shader
-			ps.GetAddressOf());			// Address of the ID3D11PixelShader pointer
+			pixelShaderBlob->GetBufferSize());		// How big is that data?
 
-		Graphics::Device->CreateVertexShader(
+		vs = backend->CreateShader(
+			ShaderStage::Vertex,
 			vertexShaderBlob->GetBufferPointer(),	// Get a pointer to the blob's contents
-			vertexShaderBlob->GetBufferSize(),		// How big is that data?
-			0,										// No classes in this shader
-			vs.GetAddressOf());			// The address of the ID3D11VertexShader pointer
+			vertexShaderBlob->GetBufferSize());		// How big is that data?
 
-		Graphics::Device->CreateVertexShader(
+		shadowVertexShader = backend->CreateShader(
+			ShaderStage::Vertex,
 			shadowBlob->GetBufferPointer(),
-			shadowBlob->GetBufferSize(),
-			nullptr,
-			shadowVertexShader.GetAddressOf());
+			shadowBlob->GetBufferSize());
 
 	}
 
@@ -403,9 +442,8 @@ void Game::LoadShaders()
 		shadowBlob->Release();
 
 		// Helper lambda to load a pixel shader from a .cso file
-		auto LoadPS = [&](const wchar_t* path) -> Microsoft::WRL::ComPtr<ID3D11PixelShader>
+		auto LoadPS = [&](const wchar_t* path) -> ShaderHandle
 			{
-				Microsoft::WRL::ComPtr<ID3D11PixelShader> ps;
 				ID3DBlob* blob = nullptr;
 
 				HRESULT hr = D3DReadFileToBlob(FixPath(path).c_str(), &blob);
@@ -415,11 +453,11 @@ void Game::LoadShaders()
 					OutputDebugStringW(L"FAILED to load shader: ");
 					OutputDebugStringW(path);
 					OutputDebugStringW(L"\n");
-					return nullptr;  // return null so you get a cleaner error
+					return ShaderHandle();  // return null so you get a cleaner error
 				}
 
-				Graphics::Device->CreatePixelShader(
-					blob->GetBufferPointer(), blob->GetBufferSize(), 0, ps.GetAddressOf());
+				ShaderHandle ps = backend->CreateShader(
+					ShaderStage::Pixel, blob->GetBufferPointer(), blob->GetBufferSize());
 				blob->Release();
 				return ps;
 			};
@@ -519,52 +557,67 @@ void Game::LoadShaders()
 		sampDesc.MaxLOD = D3D11_FLOAT32_MAX;
 		Graphics::Device->CreateSamplerState(&sampDesc, samplerState.GetAddressOf());
 
+		// Hand the loaded textures to the backend so materials can refer to them
+		TextureHandle cobblestoneAlbedo = backend->ImportTexture(srvCobblestoneTexture);
+		TextureHandle cobblestoneNormals = backend->ImportTexture(srvCobblestoneNormalMap);
+		TextureHandle cobblestoneRoughness = backend->ImportTexture(srvCobblestoneRoughness);
+		TextureHandle cobblestoneMetalness = backend->ImportTexture(srvCobblestoneMetalness);
+		TextureHandle bronzeAlbedo = backend->ImportTexture(srvBronzeTexture);
+		TextureHandle bronzeNormals = backend->ImportTexture(srvBronzeNormalMap);
+		TextureHandle bronzeRoughness = backend->ImportTexture(srvBronzeRoughness);
+		TextureHandle bronzeMetalness = backend->ImportTexture(srvBronzeMetalness);
+		TextureHandle floorAlbedo = backend->ImportTexture(srvFloorTexture);
+		TextureHandle floorNormals = backend->ImportTexture(srvFloorNormalMap);
+		TextureHandle floorRoughness = backend->ImportTexture(srvFloorRoughness);
+		TextureHandle floorMetalness = backend->ImportTexture(srvFloorMetalness);
+		SamplerHandle sampler = backend->ImportSampler(samplerState);
+
 		// --- Materials ---
 		// materials[0]: color tint, textured
-		materials.push_back(std::make_shared<Material>(XMFLOAT4(1, 1, 1, 1), vs, psTextured));
+		materials.push_back(resources->Create<Material>(XMFLOAT4(1, 1, 1, 1), vs, psTextured));
 		// materials[1]: color tint, textured
-		materials.push_back(std::make_shared<Material>(XMFLOAT4(1, 0, 0, 1), vs, psTextured));
+		materials.push_back(resources->Create<Material>(XMFLOAT4(1, 0, 0, 1), vs, psTextured));
 		// materials[2]: color tint, textured
-		materials.push_back(std::make_shared<Material>(XMFLOAT4(1, 1, 1, 1), vs, psTextured));
+		materials.push_back(resources->Create<Material>(XMFLOAT4(1, 1, 1, 1), vs, psTextured));
 		// materials[3]: UV debug
-		materials.push_back(std::make_shared<Material>(XMFLOAT4(1, 1, 1, 1), vs, psUV));
+		materials.push_back(resources->Create<Material>(XMFLOAT4(1, 1, 1, 1), vs, psUV));
 		// materials[4]: Normal debug
-		materials.push_back(std::make_shared<Material>(XMFLOAT4(1, 1, 1, 1), vs, psNormal));
+		materials.push_back(resources->Create<Material>(XMFLOAT4(1, 1, 1, 1), vs, psNormal));
 		// materials[5]: Custom
-		materials.push_back(std::make_shared<Material>(XMFLOAT4(1, 1, 1, 1), vs, psCustom));
+		materials.push_back(resources->Create<Material>(XMFLOAT4(1, 1, 1, 1), vs, psCustom));
 		// materials[6]: Custom Texture
-		materials.push_back(std::make_shared<Material>(XMFLOAT4(1, 1, 1, 1), vs, psMultiTexture));
+		materials.push_back(resources->Create<Material>(XMFLOAT4(1, 1, 1, 1), vs, psMultiTexture));
 
 
 		// Assign texture1 + sampler to materials 0 and 1
-		materials[0]->AddTextureSRV(0, srvCobblestoneTexture);
-		materials[0]->AddTextureSRV(1, srvCobblestoneNormalMap);
-		materials[0]->AddTextureSRV(2, srvCobblestoneRoughness);
-		materials[0]->AddTextureSRV(3, srvCobblestoneMetalness);
-		materials[0]->AddSampler(0, samplerState);
-
-		materials[1]->AddTextureSRV(0, srvBronzeTexture);
-		materials[1]->AddTextureSRV(1, srvBronzeNormalMap);
-		materials[1]->AddTextureSRV(2, srvBronzeRoughness);
-		materials[1]->AddTextureSRV(3, srvBronzeMetalness);
-		materials[1]->AddSampler(0, samplerState);
+		resources->Get(materials[0])->AddTexture(0, cobblestoneAlbedo);
+		resources->Get(materials[0])->AddTexture(1, cobblestoneNormals);
+		resources->Get(materials[0])->AddTexture(2, cobblestoneRoughness);
+		resources->Get(materials[0])->AddTexture(3, cobblestoneMetalness);
+		resources->Get(materials[0])->AddSampler(0, sampler);
+
+		resources->Get(materials[1])->AddTexture(0, bronzeAlbedo);
+		resources->Get(materials[1])->AddTexture(1, bronzeNormals);
+		resources->Get(materials[1])->AddTexture(2, bronzeRoughness);
+		resources->Get(materials[1])->AddTexture(3, bronzeMetalness);
+		resources->Get(materials[1])->AddSampler(0, sampler);
 
 		// Assign texture2 to material 2 (also uses psTextured)
-		materials[2]->AddTextureSRV(0, srvFloorTexture);
-		materials[2]->AddTextureSRV(1, srvFloorNormalMap);
-		materials[2]->AddTextureSRV(2, srvFloorRoughness);
-		materials[2]->AddTextureSRV(3, srvFloorMetalness);
-		materials[2]->AddSampler(0, samplerState);
+		resources->Get(materials[2])->AddTexture(0, floorAlbedo);
+		resources->Get(materials[2])->AddTexture(1, floorNormals);
+		resources->Get(materials[2])->AddTexture(2, floorRoughness);
+		resources->Get(materials[2])->AddTexture(3, floorMetalness);
+		resources->Get(materials[2])->AddSampler(0, sampler);
 
 		// Materials 3-5 use debug/custom shaders, texture assignment optional
 		for (int i = 3; i <= 5; i++) {
-			materials[i]->AddTextureSRV(1, srvFloorNormalMap);
-			materials[i]->AddSampler(0, samplerState);
+			resources->Get(materials[i])->AddTexture(1, floorNormals);
+			resources->Get(materials[i])->AddSampler(0, sampler);
 		}
 		// assign both textures to the 6th material, multi-texture and sampler state
-		materials[6]->AddTextureSRV(0, srvFloorTexture);
-		materials[6]->AddTextureSRV(1, srvBronzeTexture);
-		materials[6]->AddSampler(0, samplerState);
+		resources->Get(materials[6])->AddTexture(0, floorAlbedo);
+		resources->Get(materials[6])->AddTexture(1, bronzeAlbedo);
+		resources->Get(materials[6])->AddSampler(0, sampler);
 	}
 }
 
@@ -673,70 +726,98 @@ void Game::CreateGeometry()
 	//	Graphics::Device
 	//));
 
-	// load meshes from the OBJ file
-	meshes.push_back(std::make_shared<Mesh>(FixPath(L"../../Assets/cube.obj").c_str(), Graphics::Device));
-	meshes.push_back(std::make_shared<Mesh>(FixPath(L"../../Assets/sphere.obj").c_str(), Graphics::Device));
-	meshes.push_back(std::make_shared<Mesh>(FixPath(L"../../Assets/helix.obj").c_str(), Graphics::Device));
+	// load meshes from the OBJ file, keeping their geometry for
+	// picking and the floor's occlusion
+	meshes.push_back(resources->Create<Mesh>(FixPath(L"../../Assets/cube.obj").c_str(), *backend, MeshCpuGeometry::Keep));
+	meshes.push_back(resources->Create<Mesh>(FixPath(L"../../Assets/sphere.obj").c_str(), *backend, MeshCpuGeometry::Keep));
+	meshes.push_back(resources->Create<Mesh>(FixPath(L"../../Assets/helix.obj").c_str(), *backend, MeshCpuGeometry::Keep));
+
+	// Triangle BVHs, for exact ray hits against the meshes
+	for (MeshHandle mesh : meshes)
+		resources->Get(mesh)->BuildTriangleBVH();
+
+	// and the keyframed clips - one that fails to load just plays nothing
+	clips.push_back(resources->Create<AnimationClip>());
+	resources->Get(clips[0])->LoadFromFile(FixPath(L"../../Assets/Animations/hover.clip").c_str());
 
 	// create All entitities
+	// - The first five get an AnimationState for AnimateEntities()
+	// - 7 and 8 play the hover clip, out of step with each other
 	//-----------------------------------------------------------------	
 	// entity 0: cube, left, will rotate
-	entities.push_back(GameEntity(meshes[0], materials[0]));
-	entities[0].GetTransform()->SetPosition(-2.0f, 0.0f, 0.0f);
+	EntityId entity = CreateRenderEntity(entities, meshes[0], materials[0], XMFLOAT3(-2.0f, 0.0f, 0.0f));
+	entities.Add(entity, AnimationState::Spin(1.0f));
 
 	// entity 1: sphere, center, will move in sine wave
-	entities.push_back(GameEntity(meshes[1], materials[1]));
-	entities[1].GetTransform()->SetPosition(0.0f, 0.0f, 0.0f);
+	entity = CreateRenderEntity(entities, meshes[1], materials[1], XMFLOAT3(0.0f, 0.0f, 0.0f));
+	entities.Add(entity, AnimationState::Sway(XMFLOAT3(0.0f, 0.0f, 0.0f), 2.0f, 0.005f));
 
 	// entity 2: helix, right, will scale up and down
-	//entities.push_back(GameEntity(meshes[2], materials[2]));
-	//entities[2].GetTransform()->SetPosition(4.0f, 0.0f, 0.0f);
+	//CreateRenderEntity(entities, meshes[2], materials[2], XMFLOAT3(4.0f, 0.0f, 0.0f));
 
 	//entity 3: cube, center, will move left and right
-	//entities.push_back(GameEntity(meshes[0], materials[1]));
-	//entities[2].GetTransform()->SetPosition(-4.5f, 4.0f, 0.0f);
+	//CreateRenderEntity(entities, meshes[0], materials[1], XMFLOAT3(-4.5f, 4.0f, 0.0f));
 
-	// entity 4: sphere (shared mesh), will rotate opposite direction
-	entities.push_back(GameEntity(meshes[1], materials[2]));
-	entities[2].GetTransform()->SetPosition(2.0f, 2.0f, 4.0f);
+	// entity 4: sphere (shared mesh), will scale up and down
+	entity = CreateRenderEntity(entities, meshes[1], materials[2], XMFLOAT3(2.0f, 2.0f, 4.0f));
+	entities.Add(entity, AnimationState::Pulse(3.0f, 0.3f));
 
-	// entity 5: cube, colorTint - red
-	entities.push_back(GameEntity(meshes[0], materials[0]));
-	entities[3].GetTransform()->SetPosition(0.0f, 4.0f, 0.0f);
+	// entity 5: cube, colorTint - red, will move left and right
+	entity = CreateRenderEntity(entities, meshes[0], materials[0], XMFLOAT3(0.0f, 4.0f, 0.0f));
+	entities.Add(entity, AnimationState::Sway(XMFLOAT3(0.0f, -0.5f, 0.0f), 1.0f, 0.4f));
 
-	// entity 6: helix, colorTint - blue
-	entities.push_back(GameEntity(meshes[2], materials[1]));
-	entities[4].GetTransform()->SetPosition(2.0f, 4.0f, 0.0f);
+	// entity 6: helix, colorTint - blue, will rotate opposite direction
+	entity = CreateRenderEntity(entities, meshes[2], materials[1], XMFLOAT3(2.0f, 4.0f, 0.0f));
+	entities.Add(entity, AnimationState::Spin(-0.8f));
 
 	//entity 7:cube, uv
-	entities.push_back(GameEntity(meshes[0], materials[3]));
-	entities[5].GetTransform()->SetPosition(-2.0f, 4.0f, 0.0f);
+	AnimationPlayer player;
+	player.clip = clips[0];
+	player.origin = XMFLOAT3(-2.0f, 4.0f, 0.0f);
+	entity = CreateRenderEntity(entities, meshes[0], materials[3], player.origin);
+	entities.Add(entity, player);
 	// entity 8: helix, uv
-	entities.push_back(GameEntity(meshes[2], materials[3]));
-	entities[6].GetTransform()->SetPosition(-4.0f, 4.0f, 0.0f);
+	player.origin = XMFLOAT3(-4.0f, 4.0f, 0.0f);
+	player.time = 1.0f;
+	player.speed = 0.8f;
+	entity = CreateRenderEntity(entities, meshes[2], materials[3], player.origin);
+	entities.Add(entity, player);
 
 	//entity 9:cube, normal
-	//entities.push_back(GameEntity(meshes[1], materials[4]));
-	//entities[7].GetTransform()->SetPosition(-2.0f, 6.0f, 0.0f);
+	//CreateRenderEntity(entities, meshes[1], materials[4], XMFLOAT3(-2.0f, 6.0f, 0.0f));
 	// entity 10: helix, normal
-	//entities.push_back(GameEntity(meshes[2], materials[4]));
-	//entities[8].GetTransform()->SetPosition(-4.0f, 6.0f, 0.0f);
+	//CreateRenderEntity(entities, meshes[2], materials[4], XMFLOAT3(-4.0f, 6.0f, 0.0f));
 
 	//entity 11:cube, custom
-	entities.push_back(GameEntity(meshes[0], materials[5]));
-	entities[7].GetTransform()->SetPosition(0.0f, 6.0f, 0.0f);
+	CreateRenderEntity(entities, meshes[0], materials[5], XMFLOAT3(0.0f, 6.0f, 0.0f));
 	// entity 12: helix, custom
-	entities.push_back(GameEntity(meshes[2], materials[5]));
-	entities[8].GetTransform()->SetPosition(2.0f, 6.0f, 0.0f);
+	CreateRenderEntity(entities, meshes[2], materials[5], XMFLOAT3(2.0f, 6.0f, 0.0f));
 
 	// entity 13: sphere, custom texture
-	entities.push_back(GameEntity(meshes[1], materials[6])); 
-	entities[9].GetTransform()->SetPosition(-6.0f, 0.0f, 0.0f);
+	CreateRenderEntity(entities, meshes[1], materials[6], XMFLOAT3(-6.0f, 0.0f, 0.0f));
 
 	// create the floor
-	entities.push_back(GameEntity(meshes[0], materials[2])); // use light-colored material
-	entities[10].GetTransform()->SetPosition(0.0f, -3.0f, 0.0f); // below everything
-	entities[10].GetTransform()->SetScale(20.0f, 0.5f, 20.0f);   // wide and flat
+	EntityId floor = CreateRenderEntity(entities, meshes[0], materials[2], // use light-colored material
+		XMFLOAT3(0.0f, -3.0f, 0.0f),	// below everything
+		XMFLOAT3(20.0f, 0.5f, 20.0f));	// wide and flat
+	entities.Get<RenderFlags>(floor).isOccluder = true;	// hides whatever is under it
+
+	// and the skinned tube standing on it
+	CreateTubeEntity();
+
+	// The animated ones and the skinned tube aside, nothing ever
+	// moves, so their shadows can be cached
+	RenderQuery(entities).ForEach([&](EntityId id, Transform&, WorldBounds&, MeshRef&, MaterialRef&, RenderFlags& flags)
+	{
+		flags.isStatic = !entities.Has<AnimationState>(id) && !entities.Has<AnimationPlayer>(id) && id != tubeEntity;
+	});
+
+	// and the animated ones are drawn between their last two ticks
+	std::vector<EntityId> animated;
+	animatedEntities.ForEach([&](EntityId id, Transform&, AnimationState&) { animated.push_back(id); });
+	clipPlayers.ForEach([&](EntityId id, Transform&, AnimationPlayer&) { animated.push_back(id); });
+	for (EntityId id : animated)
+		entities.Add(id, TransformHistory());
 
 	// Create the sky
 	sky = std::make_shared<Sky>(
@@ -753,30 +834,73 @@ void Game::CreateGeometry()
 	);
 }
 
-void Game::FillAndBindNextConstantBuffer(void* data, size_t dataSize,
-	bool isVertexShader, UINT slot) 
+// --------------------------------------------------------
+// A tube on a chain of joints, each joint but the root swinging
+// side to side and twisting about the tube, out of step with the
+// one below - bent and twisted enough to show linear blending
+// pinching where dual quaternions don't
+// --------------------------------------------------------
+void Game::CreateTubeEntity()
 {
-	size_t alignedSize = (dataSize + 255) & ~255;
-
-	if (cbRingBufferOffset + alignedSize > cbRingBufferSize)
-		cbRingBufferOffset = 0;
+	const uint32_t jointCount = 6;
+	const float length = 3.0f;
+	tubeSkeleton = CreateTubeSkeleton(jointCount, length);
+	skinnedTube = std::make_unique<SkinnedMesh>(CreateSkinnedTube(jointCount, length, 0.35f, 48, 24));
+
+	tubeClips.assign(jointCount, AnimationClip());
+	tubeJointClips.assign(jointCount, nullptr);
+	for (uint32_t joint = 1; joint < jointCount; joint++)
+	{
+		AnimationCurve& rotation = tubeClips[joint].GetCurve(AnimationChannel::Rotation);
+		for (int key = 0; key <= 16; key++)
+		{
+			float phase = key * XM_2PI / 16.0f;
+			XMFLOAT4 q;
+			XMStoreFloat4(&q, XMQuaternionRotationRollPitchYaw(0.0f, 0.9f * sinf(phase * 2.0f + joint), 0.25f * sinf(phase + joint * 0.7f)));
+			rotation.times.push_back(key * 0.25f);
+			rotation.values.push_back(q);
+		}
+		tubeClips[joint].Finalize();
+		tubeJointClips[joint] = &tubeClips[joint];
+	}
+	tubeCursors.assign(jointCount, AnimationCursor());
+	tubePose = tubeSkeleton.GetBindPose();
+	tubeCompressed.Compress(tubeSkeleton, tubeJointClips.data(), ClipCompressionSettings());
+	tubeCompressedCursor = CompressedClipCursor();
 
-	D3D11_MAPPED_SUBRESOURCE mapped = {};
-	Graphics::Context->Map(cbRingBuffer.Get(), 0, D3D11_MAP_WRITE_NO_OVERWRITE, 0, &mapped);
-	memcpy((char*)mapped.pData + cbRingBufferOffset, data, dataSize);
-	Graphics::Context->Unmap(cbRingBuffer.Get(), 0);
+	tubeMesh = skinnedTube->CreateOutputMesh(*resources, *backend);
+	tubeEntity = CreateRenderEntity(entities, tubeMesh, materials[1], XMFLOAT3(5.0f, -2.75f, -2.0f));
+}
 
-	UINT firstConstant = (UINT)(cbRingBufferOffset / 16);
-	UINT numConstants = (UINT)(alignedSize / 16);
+// --------------------------------------------------------
+// Poses the tube at the snapshot's time and skins it into its
+// mesh's vertex buffer.  The skinned bounds go straight into the
+// snapshot's world bounds for the tube - the mesh keeps its bind
+// pose bounds, since the game thread reads them.
+// --------------------------------------------------------
+void Game::SkinMeshes(GameSnapshot& snapshot)
+{
+	Mesh* mesh = resources->Get(tubeMesh);
+	if (!mesh || !snapshot.entities.IsAlive(tubeEntity))
+		return;
 
-	if (isVertexShader)
-		Graphics::Context->VSSetConstantBuffers1(slot, 1, cbRingBuffer.GetAddressOf(),
-			&firstConstant, &numConstants);
+	auto start = std::chrono::high_resolution_clock::now();
+	if (snapshot.settings.compressedTubeClip && !tubeCompressed.IsEmpty())
+		tubeCompressed.SamplePose(snapshot.totalTime, tubeSkeleton, tubeCompressedCursor, tubePose.data());
 	else
-		Graphics::Context->PSSetConstantBuffers1(slot, 1, cbRingBuffer.GetAddressOf(),
-			&firstConstant, &numConstants);
-
-	cbRingBufferOffset += alignedSize;
+		tubeSkeleton.SamplePose(tubeJointClips.data(), snapshot.totalTime, tubeCursors.data(), tubePose.data());
+	tubeSkeleton.ComputePalette(tubePose.data(), tubePalette);
+	tubePoseMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+	Vertex* vertices = mesh->MapVertices();
+	if (!vertices)
+		return;
+	AABB bounds;
+	skinner.Add(*skinnedTube, tubePalette, vertices, &bounds);
+	skinner.Run(*jobSystem, snapshot.settings.skinningMode);
+	mesh->UnmapVertices();
+
+	snapshot.entities.Get<WorldBounds>(tubeEntity).box = bounds.Transformed(snapshot.entities.Get<Transform>(tubeEntity).GetWorldMatrix());
 }
 
 void BuildCustomWindow(float* color, bool* showDemoMenu, int* number, bool *showHappyMeter, DirectX::XMFLOAT4* colorTint, DirectX::XMFLOAT3* offset) {
@@ -823,13 +947,15 @@ void NewWindowWithHappyMeter(int *number, std::string *happyMeterMessage) {
 	ImGui::End();
 	ImGui::PopStyleColor();
 }
-void BuildMeshStatsWindow(const std::vector<std::shared_ptr<Mesh>>& meshes) {
+void BuildMeshStatsWindow(const ResourceRegistry& resources, const std::vector<MeshHandle>& meshes) {
 	ImGui::Begin("Mesh Statistics");
 	ImGui::Text("Total Meshes: %d", (int)meshes.size());
 	ImGui::Separator();
 
 	for (size_t i = 0; i < meshes.size(); i++) {
-		const auto& mesh = meshes[i];
+		const Mesh* mesh = resources.Get(meshes[i]);
+		if (!mesh)
+			continue;
 		int vertexCount = mesh->GetVertexCount();
 		int indexCount = mesh->GetIndexCount();
 		int triangleCount = indexCount / 3;
@@ -845,6 +971,72 @@ void BuildMeshStatsWindow(const std::vector<std::shared_ptr<Mesh>>& meshes) {
 	ImGui::End();
 }
 
+// --------------------------------------------------------
+// Heap allocations per frame, by tag, from the allocation
+// tracker - with steady state mode, and a CSV of the history
+// --------------------------------------------------------
+void BuildAllocationWindow() {
+	ImGui::Begin("Allocations");
+
+	const AllocationFrameStats& last = AllocationTracker::GetLastFrame();
+	ImGui::Text("Last frame: %llu allocations (%.1f KB), %llu frees",
+		(unsigned long long)last.total.allocations,
+		last.total.bytes / 1024.0f,
+		(unsigned long long)last.total.frees);
+	ImGui::Text("Live: %.2f MB, %.2f MB peak last frame, %.2f MB peak overall",
+		last.liveBytes / (1024.0f * 1024.0f),
+		last.peakBytes / (1024.0f * 1024.0f),
+		AllocationTracker::GetPeakBytes() / (1024.0f * 1024.0f));
+
+	float counts[AllocationTracker::HistoryLength] = {};
+	size_t historyCount = AllocationTracker::GetHistoryCount();
+	for (size_t i = 0; i < historyCount; i++)
+		counts[i] = (float)AllocationTracker::GetHistory(i).total.allocations;
+	ImGui::PlotHistogram("Per frame", counts, (int)historyCount, 0, nullptr, 0.0f, FLT_MAX, ImVec2(0, 60));
+
+	ImGui::Separator();
+	for (size_t t = 0; t < (size_t)AllocationTag::Count; t++)
+	{
+		const AllocationCounts& tag = last.tags[t];
+		ImGui::Text("  %-10s %6llu allocs %9.1f KB %6llu frees",
+			AllocationTracker::GetTagName((AllocationTag)t),
+			(unsigned long long)tag.allocations,
+			tag.bytes / 1024.0f,
+			(unsigned long long)tag.frees);
+	}
+
+	// Steady state - the frame should never touch the heap
+	ImGui::Separator();
+	bool steadyState = AllocationTracker::IsSteadyState();
+	if (ImGui::Checkbox("Steady state", &steadyState))
+		AllocationTracker::SetSteadyState(steadyState);
+	ImGui::SameLine();
+	bool assertOnAllocation = AllocationTracker::IsAssertOnAllocation();
+	if (ImGui::Checkbox("Assert on allocation", &assertOnAllocation))
+		AllocationTracker::SetAssertOnAllocation(assertOnAllocation);
+	if (steadyState)
+	{
+		uint64_t violations = AllocationTracker::GetSteadyStateAllocations();
+		if (violations > 0)
+			ImGui::TextColored(ImVec4(1, 0.4f, 0.4f, 1), "%llu allocations since enabled, last from %s",
+				(unsigned long long)violations,
+				AllocationTracker::GetTagName(AllocationTracker::GetLastSteadyStateTag()));
+		else
+			ImGui::Text("No allocations since enabled");
+	}
+
+	static const char* csvResult = nullptr;
+	if (ImGui::Button("Write allocations.csv"))
+		csvResult = AllocationTracker::WriteCsv("allocations.csv") ? "Written" : "Could not write the file";
+	if (csvResult)
+	{
+		ImGui::SameLine();
+		ImGui::TextUnformatted(csvResult);
+	}
+
+	ImGui::End();
+}
+
 // --------------------------------------------------------
 // Helper function to setup ImGui
 // --------------------------------------------------------
@@ -881,9 +1073,216 @@ void Game::ImGuiFresh(float deltaTime) {
 	ImGui::Begin("Game Info");
 	ImGui::Text("fps: %.1f", ImGui::GetIO().Framerate); 
 	ImGui::Text("resolution: %d x %d", Window::Width(), Window::Height());
-	ImGui::ColorEdit4("Background", color); 
+	float tickRate = (float)fixedTimestep.GetTickRate();
+	if (ImGui::SliderFloat("Simulation ticks a second", &tickRate, 5.0f, 240.0f, "%.0f"))
+		fixedTimestep.SetTickRate(tickRate);
+	const FixedTimestepStats& tickStats = fixedTimestep.GetStats();
+	ImGui::Text("  %d ticks last frame, drawn %.2f of a tick past the last, %llu ticks run, %llu dropped",
+		tickStats.frameTicks,
+		fixedTimestep.GetAlpha(),
+		(unsigned long long)tickStats.ticks,
+		(unsigned long long)tickStats.droppedTicks);
+	ImGui::ColorEdit4("Background", renderSettings.clearColor); 
 	ImGui::Separator();
 	ImGui::ColorEdit4("Color Tint", &colorTint.x);
+
+	// The renderer's numbers are from the last frame the render
+	// thread finished
+	ImGui::Text("CB ring: %zu / %zu KB (%zu frames in flight, grew %u times)",
+		drawnStats.ringFrameBytes / 1024,
+		drawnStats.ringCapacity / 1024,
+		drawnStats.ringFramesInFlight,
+		drawnStats.ringGrowCount);
+	const SceneRenderStats& sceneStats = drawnStats.scene;
+	ImGui::Text("Entities: %zu (%zu visible, %zu shadow casters) on %u threads",
+		sceneStats.entities,
+		sceneStats.visible,
+		sceneStats.shadowCasters,
+		sceneStats.threads);
+	ImGui::Text("Resources: %zu meshes, %zu materials, %zu awaiting release, %zu entities with released ones",
+		resources->GetPool<Mesh>().GetCount(),
+		resources->GetPool<Material>().GetCount(),
+		drawnStats.pendingReleases,
+		sceneStats.staleHandles);
+	const FrameArenaStats* arenas[2] = { &frameArena.GetStats(), &drawnStats.arena };
+	const char* arenaNames[2] = { "Game", "Render" };
+	for (int i = 0; i < 2; i++)
+	{
+		ImGui::Text("%s arena: %.1f KB last frame (%.1f KB spilled to the heap), %.1f KB high water, %u x %.0f KB, grew %u times",
+			arenaNames[i],
+			arenas[i]->frameBytes / 1024.0f,
+			arenas[i]->overflowBytes / 1024.0f,
+			arenas[i]->highWaterMark / 1024.0f,
+			i == 0 ? frameArena.GetFrameCount() : drawnStats.arenaFrames,
+			arenas[i]->capacity / 1024.0f,
+			arenas[i]->growCount);
+	}
+	bool dualQuaternionSkinning = renderSettings.skinningMode == SkinningMode::DualQuaternion;
+	if (ImGui::Checkbox("Dual quaternion skinning", &dualQuaternionSkinning))
+		renderSettings.skinningMode = dualQuaternionSkinning ? SkinningMode::DualQuaternion : SkinningMode::Linear;
+	const SkinningStats& skinningStats = drawnStats.skinning;
+	ImGui::Text("  %u meshes, %llu vertices in %u chunks, %.3f ms skinning, %.3f ms posing %u joints",
+		skinningStats.meshes,
+		(unsigned long long)skinningStats.vertices,
+		skinningStats.chunks,
+		skinningStats.ms,
+		drawnStats.tubePoseMs,
+		tubeSkeleton.GetJointCount());
+	ImGui::Checkbox("Compressed tube clip", &renderSettings.compressedTubeClip);
+	const ClipCompressionStats& compressionStats = tubeCompressed.GetStats();
+	ImGui::Text("  %.1f KB from %.1f KB of keys, %llu of %llu keys kept, %u bind pose and %u constant tracks, %u segments",
+		compressionStats.bytes / 1024.0f,
+		CompressedClip::GetSourceBytes(tubeJointClips.data(), tubeSkeleton.GetJointCount()) / 1024.0f,
+		(unsigned long long)compressionStats.keys,
+		(unsigned long long)compressionStats.sampledKeys,
+		compressionStats.bindPoseTracks,
+		compressionStats.constantTracks,
+		compressionStats.segments);
+	ImGui::Checkbox("Software occlusion culling", &renderSettings.occlusionCulling);
+	if (renderSettings.occlusionCulling)
+	{
+		const OcclusionStats& occlusionStats = drawnStats.occlusion;
+		ImGui::Text("  %zu occluders (%zu off screen), %zu triangles, %.3f ms raster, %zu entities hidden",
+			occlusionStats.occluders,
+			occlusionStats.skippedOccluders,
+			occlusionStats.triangles,
+			drawnStats.occlusionMs,
+			sceneStats.occluded);
+	}
+	const EntityBVHStats& bvhStats = entityBVH.GetStats();
+	ImGui::Text("BVH: %zu nodes, depth %u, SAH %.2f (%.2f at build), %zu refitted, %u rebuilds, %.3f ms",
+		bvhStats.nodes,
+		bvhStats.depth,
+		bvhStats.cost,
+		bvhStats.buildCost,
+		bvhStats.refitNodes,
+		bvhStats.rebuilds,
+		entityBVHMs);
+	if (lastPick.IsHit())
+	{
+		ImGui::Text("Picked entity %d at %.2f, %.2f, %.2f, normal %.2f, %.2f, %.2f (%.3f ms)",
+			lastPick.entity,
+			lastPick.point.x, lastPick.point.y, lastPick.point.z,
+			lastPick.normal.x, lastPick.normal.y, lastPick.normal.z,
+			pickMs);
+	}
+	else
+	{
+		ImGui::Text("Picked nothing (%.3f ms) - left click an entity", pickMs);
+	}
+
+	const SpatialHashStats& gridStats = entityGrid.GetStats();
+	ImGui::Text("Spatial hash: %zu points in %zu of %zu buckets, %u at most, %.3f ms",
+		gridStats.count,
+		gridStats.usedBuckets,
+		gridStats.buckets,
+		gridStats.largestBucket,
+		entityGridMs);
+	ImGui::SliderFloat("Neighbour radius (cell size)", &neighbourRadius, 0.5f, 20.0f);
+	if (selectedEntity >= 0)
+	{
+		std::vector<uint32_t>& neighbours = neighbourScratch;
+		entityGrid.QueryRadius(entityPositions[selectedEntity], neighbourRadius, neighbours);
+		ImGui::Text("  %zu entities within %.1f of entity %d", neighbours.size(), neighbourRadius, selectedEntity);
+
+		// The nearest after the entity itself
+		entityGrid.QueryNearest(entityPositions[selectedEntity], 4, neighbours);
+		FrameString nearest(frameArena);
+		for (uint32_t index : neighbours)
+		{
+			char number[16];
+			snprintf(number, sizeof(number), " %u", index);
+			if ((int)index != selectedEntity)
+				nearest += number;
+		}
+		ImGui::Text("  Nearest:%s", nearest.c_str());
+	}
+
+	// Shadow cascades - split distances and how many casters each drew
+	ImGui::SliderFloat("Cascade split (uniform - log)", &renderSettings.cascadeSplitLambda, 0.0f, 1.0f);
+	ImGui::SliderFloat("Shadow distance", &renderSettings.shadowDistance, 5.0f, 100.0f);
+	ImGui::Checkbox("Snap cascades to shadow map texels", &renderSettings.shadowTexelSnapping);
+	ImGui::Checkbox("Fit cascades to casters and receivers", &renderSettings.shadowSceneFitting);
+	for (unsigned int i = 0; i < ShadowCascades::CascadeCount; i++)
+	{
+		const ShadowCascade& cascade = drawnStats.cascades[i];
+		ImGui::Text("  Cascade %u: %.2f - %.2f, %.3f units per texel, %.1f deep, %u receivers, %zu casters",
+			i,
+			cascade.nearZ,
+			cascade.farZ,
+			cascade.texelSize,
+			cascade.depthRange,
+			cascade.receivers,
+			sceneStats.cascadeCasters[i]);
+	}
+	if (ImGui::Checkbox("Cache static shadows", &renderSettings.shadowCaching) && renderSettings.shadowCaching)
+		renderSettings.invalidateShadowCache = true;
+	if (renderSettings.shadowCaching)
+	{
+		const ShadowCacheStats& cacheStats = drawnStats.shadowCache;
+		ImGui::Text("  %zu static (%zu changed), %u full redraws, %u rects, %zu casters redrawn",
+			cacheStats.staticEntities,
+			cacheStats.changedStatic,
+			cacheStats.fullRedraws,
+			cacheStats.dirtyRects,
+			sceneStats.cachedShadowCasters);
+	}
+
+	// Shadow atlas - every other shadow casting light
+	const ShadowAtlasStats& atlasStats = drawnStats.atlas;
+	ImGui::Checkbox("Refresh distant atlas lights less often", &renderSettings.shadowAtlasPeriods);
+	ImGui::Text("Atlas: %zu lights (%zu shrunk, %zu dropped), %zu tiles, %zu redrawn, %zu casters",
+		atlasStats.shadowedLights,
+		atlasStats.shrunkLights,
+		atlasStats.droppedLights,
+		atlasStats.tiles,
+		atlasStats.renderedTiles,
+		sceneStats.atlasShadowCasters);
+	ImGui::Text("  %.0f%% used, %.0f%% fragmented, %u repacks",
+		atlasStats.usedArea * 100.0f,
+		atlasStats.fragmentation * 100.0f,
+		atlasStats.repacks);
+
+	ImGui::Checkbox("Per-object lights instead of clusters", &renderSettings.perObjectLights);
+	if (renderSettings.perObjectLights)
+	{
+		const ObjectLightStats& objectStats = drawnStats.objectLights;
+		ImGui::Text("Lights: %zu, %zu picked by visible entities (up to %u each), %zu uploaded",
+			objectStats.lights,
+			objectStats.selections,
+			ObjectLightSelector::MaxLightsPerObject,
+			objectStats.uploadedLights);
+	}
+	else
+	{
+		const LightClusterStats& clusterStats = drawnStats.lightClusters;
+		ImGui::Text("Lights: %zu (%zu binned), %zu indices, %zu clusters lit, max %zu per cluster, %.3f ms",
+			clusterStats.lights,
+			clusterStats.localLights,
+			clusterStats.indices,
+			clusterStats.activeClusters,
+			clusterStats.maxLightsPerCluster,
+			drawnStats.lightClusterMs);
+	}
+
+	// Pass recording - deferred moves the driver work for each pass's
+	// draws onto a worker; the render thread just executes the lists
+	ImGui::Checkbox("Record passes on deferred contexts", &renderSettings.deferredRecording);
+	if (!commandDevice->HasDriverCommandLists())
+		ImGui::TextDisabled("(driver has no native command lists - the runtime emulates them)");
+	const PassSchedulerStats& passStats = drawnStats.passes;
+	ImGui::Text("Passes: %.2f ms wall, %.2f ms render thread, %.2f ms on workers",
+		passStats.wallMs,
+		passStats.mainThreadMs,
+		passStats.workerRecordMs);
+	for (const DrawnPassTiming& pass : drawnStats.passTimings)
+	{
+		ImGui::Text("  %-12s record %.3f ms%s, execute %.3f ms",
+			pass.name,
+			pass.timing.recordMs,
+			pass.timing.recordedOnMainThread ? " (render)" : "",
+			pass.timing.executeMs);
+	}
 	if (ImGui::Button("Toggle Demo")) 
 		showDemoMenu = !showDemoMenu; 
 	ImGui::End(); 
@@ -934,17 +1333,26 @@ void Game::ImGuiFresh(float deltaTime) {
 	// entity inspector
 	// -----------------------------------------------------------------------
 	ImGui::Begin("Entities");
-	for (int i = 0; i < (int)entities.size(); i++)
+	for (int i = 0; i < (int)entities.GetIdCapacity(); i++)
 	{
+		if (!entities.IsAlive(i))
+			continue;
+
 		// push a unique ID per entity so duplicate labels don't conflict
 		ImGui::PushID(i);
 
 		char label[32];
 		sprintf_s(label, "Entity %d", i);
 
+		// A new pick opens its entity and scrolls to it, closing the last
+		if (selectionChanged)
+			ImGui::SetNextItemOpen(i == selectedEntity);
+		if (selectionChanged && i == selectedEntity)
+			ImGui::SetScrollHereY();
+
 		if (ImGui::CollapsingHeader(label))
 		{
-			Transform* t = entities[i].GetTransform();
+			Transform* t = &entities.Get<Transform>(i);
 
 			XMFLOAT3 pos = t->GetPosition();
 			XMFLOAT3 rot = t->GetPitchYawRoll();
@@ -957,31 +1365,47 @@ void Game::ImGuiFresh(float deltaTime) {
 			if (ImGui::DragFloat3("Scale", &scl.x, 0.01f, 0.01f, 10.0f))
 				t->SetScale(scl);
 
-			ImGui::Text("Mesh indices: %d", entities[i].GetMesh()->GetIndexCount());
+			const Mesh* mesh = resources->Get(entities.Get<MeshRef>(i).mesh);
+			if (mesh)
+				ImGui::Text("Mesh indices: %d", mesh->GetIndexCount());
+			else
+				ImGui::Text("Mesh released");
+
+			RenderFlags& flags = entities.Get<RenderFlags>(i);
+			ImGui::Checkbox("Static (shadow cached)", &flags.isStatic);
 
 			// Material Details
 			ImGui::Separator();
 			ImGui::Text("Material");
 
-			auto mat = entities[i].GetMaterial();
+			// The renderer's materials are the render thread's - this
+			// edits the settings it copies onto them
+			MaterialHandle material = entities.Get<MaterialRef>(i).material;
+			MaterialSettings* mat = nullptr;
+			for (MaterialSettings& settings : materialSettings)
+			{
+				if (settings.material == material)
+					mat = &settings;
+			}
+			if (!mat || !resources->IsValid(material))
+			{
+				ImGui::Text("Released");
+				ImGui::PopID();
+				continue;
+			}
 
 			// Color Tint
-			XMFLOAT4 tint = mat->GetColorTint();
-			if (ImGui::ColorEdit4("ColorTint", &tint.x))
-				mat->SetColorTint(tint);
+			ImGui::ColorEdit4("ColorTint", &mat->colorTint.x);
 
 			//UV scale 
-			XMFLOAT2 uvScale = mat->GetUVScale();
-			if (ImGui::DragFloat2("UV Scale", &uvScale.x, 0.1f, 0.0f, 10.0f))
-				mat->SetUVScale(uvScale);
+			ImGui::DragFloat2("UV Scale", &mat->uvScale.x, 0.1f, 0.0f, 10.0f);
 
 			//UV offset
-			XMFLOAT2 uvOffset = mat->GetUVOffset();
-			if (ImGui::DragFloat2("UV Offset", &uvOffset.x, 0.01f, -5.0f, 5.0f))
-				mat->SetUVOffset(uvOffset);
+			ImGui::DragFloat2("UV Offset", &mat->uvOffset.x, 0.01f, -5.0f, 5.0f);
 		}
 		ImGui::PopID();
 	}
+	selectionChanged = false;
 	ImGui::End();
 
 	//Lights Window
@@ -989,6 +1413,32 @@ void Game::ImGuiFresh(float deltaTime) {
 
 	//Ambient color control
 	ImGui::ColorEdit3("Ambient Color", &ambientColor.x);
+
+	// Lights are clustered, so there's no fixed limit any more
+	if (ImGui::Button("Add point light at camera"))
+	{
+		Light light = {};
+		light.Type = LIGHT_TYPE_POINT;
+		light.Position = cameras[activeCameraIndex]->GetTransform().GetPosition();
+		light.Color = XMFLOAT3(1.0f, 1.0f, 1.0f);
+		light.Intensity = 1.0f;
+		light.Range = 10.0f;
+		lights.push_back(light);
+	}
+	if (ImGui::Button("Add shadowed spot light at camera"))
+	{
+		Light light = {};
+		light.Type = LIGHT_TYPE_SPOT;
+		light.Position = cameras[activeCameraIndex]->GetTransform().GetPosition();
+		light.Direction = cameras[activeCameraIndex]->GetTransform().GetForward();
+		light.Color = XMFLOAT3(1.0f, 1.0f, 1.0f);
+		light.Intensity = 2.0f;
+		light.Range = 20.0f;
+		light.SpotInnerAngle = 0.3f;
+		light.SpotOuterAngle = 0.5f;
+		light.CastsShadows = 1;
+		lights.push_back(light);
+	}
 	ImGui::Separator();
 
 	// per-light controls
@@ -1017,8 +1467,23 @@ void Game::ImGuiFresh(float deltaTime) {
 			// position (for point and spotlights)
 			if (lights[i].Type == LIGHT_TYPE_POINT || lights[i].Type == LIGHT_TYPE_SPOT) {
 				ImGui::DragFloat3("Position", &lights[i].Position.x, 0.1f);
-				ImGui::DragFloat3("Range", &lights[i].Range, 0.1f, 0.0f, 100.0f);
+				ImGui::DragFloat("Range", &lights[i].Range, 0.1f, 0.0f, 100.0f);
 			}
+
+			// Shadows: the cascades for the first directional one, atlas tiles otherwise
+			bool castsShadows = lights[i].CastsShadows != 0;
+			if (ImGui::Checkbox("Casts shadows", &castsShadows))
+				lights[i].CastsShadows = castsShadows ? 1 : 0;
+			// - Shadow indices are set on the drawn frame's copy of the
+			//   lights, so this asks what the atlas gave it
+			if (i == drawnStats.shadowCascadeLight)
+				ImGui::Text("Shadow: cascades");
+			else if (i < (int)drawnStats.lightShadows.size() && drawnStats.lightShadows[i].tileSize > 0)
+				ImGui::Text("Shadow: %u x %u%s, every %u frames",
+					drawnStats.lightShadows[i].tileSize,
+					drawnStats.lightShadows[i].tileSize,
+					lights[i].Type == LIGHT_TYPE_POINT ? " x 6" : "",
+					drawnStats.lightShadows[i].updatePeriod);
 		}
 		ImGui::PopID();
 	}
@@ -1028,18 +1493,18 @@ void Game::ImGuiFresh(float deltaTime) {
 	ImGui::Begin("Post Process");
 
 	ImGui::SeparatorText("Blur (Task 1)");
-	ImGui::Checkbox("Enable Blur", &blurEnabled);
-	if (blurEnabled)
+	ImGui::Checkbox("Enable Blur", &renderSettings.blurEnabled);
+	if (renderSettings.blurEnabled)
 	{
-		ImGui::SliderInt("Blur Radius", &blurRadius, 0, 10);
+		ImGui::SliderInt("Blur Radius", &renderSettings.blurRadius, 0, 10);
 		ImGui::TextDisabled("0 = no blur  |  cost scales with radius^2");
 	}
 
 	ImGui::SeparatorText("Chromatic Aberration (Task 2)");
-	ImGui::Checkbox("Enable Chromatic Aberration", &chromaEnabled);
-	if (chromaEnabled)
+	ImGui::Checkbox("Enable Chromatic Aberration", &renderSettings.chromaEnabled);
+	if (renderSettings.chromaEnabled)
 	{
-		ImGui::SliderFloat("Strength", &chromaStrength, 0.0f, 0.03f, "%.4f");
+		ImGui::SliderFloat("Strength", &renderSettings.chromaStrength, 0.0f, 0.03f, "%.4f");
 		ImGui::TextDisabled("0 = no effect  |  stronger at screen edges");
 	}
 
@@ -1047,7 +1512,19 @@ void Game::ImGuiFresh(float deltaTime) {
 	// -------------------------------------------------------------------
 
 	// mesh stats window
-	BuildMeshStatsWindow(meshes);
+	BuildMeshStatsWindow(*resources, meshes);
+
+	BuildAllocationWindow();
+}
+
+// --------------------------------------------------------
+// Called before the window resizes the swap chain and its own
+// size changes - the render thread finishes every frame it has
+// and sits idle until the next Update() publishes another
+// --------------------------------------------------------
+void Game::OnBeforeResize()
+{
+	framePipeline.WaitForReader();
 }
 
 // --------------------------------------------------------
@@ -1063,34 +1540,80 @@ void Game::OnResize()
 
 void Game::CreateShadowMapResources() {
 	const int SHADOW_MAP_SIZE = 1024;
+	shadowCascades = std::make_unique<ShadowCascades>(SHADOW_MAP_SIZE);
+	shadowCache = std::make_unique<ShadowCache>();
 
-	// create the shadow map texture
-	Microsoft::WRL::ComPtr<ID3D11Texture2D> shadowTexture;
+	// create the shadow map texture - one slice per cascade
 	D3D11_TEXTURE2D_DESC texDesc = {};
 	texDesc.Width = SHADOW_MAP_SIZE;
 	texDesc.Height = SHADOW_MAP_SIZE;
 	texDesc.MipLevels = 1;
-	texDesc.ArraySize = 1;
+	texDesc.ArraySize = ShadowCascades::CascadeCount;
 	texDesc.Format = DXGI_FORMAT_R32_TYPELESS; // typeless, can create both SRV and DSV
 	texDesc.SampleDesc.Count = 1;
 	texDesc.Usage = D3D11_USAGE_DEFAULT;
 	texDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE;
 	Graphics::Device->CreateTexture2D(&texDesc, nullptr, shadowTexture.GetAddressOf());
 
-	//DSV - depth stencil view
-	D3D11_DEPTH_STENCIL_VIEW_DESC dsvDesc = {};
-	dsvDesc.Format = DXGI_FORMAT_D32_FLOAT;
-	dsvDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
-	dsvDesc.Texture2D.MipSlice = 0;
-	Graphics::Device->CreateDepthStencilView(shadowTexture.Get(), &dsvDesc, shadowDSV.GetAddressOf());
+	//DSV - depth stencil view, one per cascade slice
+	for (unsigned int i = 0; i < ShadowCascades::CascadeCount; i++)
+	{
+		D3D11_DEPTH_STENCIL_VIEW_DESC dsvDesc = {};
+		dsvDesc.Format = DXGI_FORMAT_D32_FLOAT;
+		dsvDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2DARRAY;
+		dsvDesc.Texture2DArray.MipSlice = 0;
+		dsvDesc.Texture2DArray.FirstArraySlice = i;
+		dsvDesc.Texture2DArray.ArraySize = 1;
+		Graphics::Device->CreateDepthStencilView(shadowTexture.Get(), &dsvDesc, shadowDSVs[i].GetAddressOf());
+	}
+
+	// Static casters only - never sampled, just copied from
+	texDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL;
+	Graphics::Device->CreateTexture2D(&texDesc, nullptr, staticShadowTexture.GetAddressOf());
+	for (unsigned int i = 0; i < ShadowCascades::CascadeCount; i++)
+	{
+		D3D11_DEPTH_STENCIL_VIEW_DESC dsvDesc = {};
+		dsvDesc.Format = DXGI_FORMAT_D32_FLOAT;
+		dsvDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2DARRAY;
+		dsvDesc.Texture2DArray.FirstArraySlice = i;
+		dsvDesc.Texture2DArray.ArraySize = 1;
+		Graphics::Device->CreateDepthStencilView(staticShadowTexture.Get(), &dsvDesc, staticShadowDSVs[i].GetAddressOf());
+	}
 
-	//SRV - shader resource view
+	//SRV - shader resource view over every slice
 	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
 	srvDesc.Format = DXGI_FORMAT_R32_FLOAT;
-	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
-	srvDesc.Texture2D.MipLevels = 1;
-	srvDesc.Texture2D.MostDetailedMip = 0;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+	srvDesc.Texture2DArray.MipLevels = 1;
+	srvDesc.Texture2DArray.MostDetailedMip = 0;
+	srvDesc.Texture2DArray.FirstArraySlice = 0;
+	srvDesc.Texture2DArray.ArraySize = ShadowCascades::CascadeCount;
 	Graphics::Device->CreateShaderResourceView(shadowTexture.Get(), &srvDesc, shadowSRV.GetAddressOf());
+	shadowMapTexture = backend->ImportTexture(shadowSRV);
+
+	// The atlas for every other shadow casting light
+	shadowAtlas = std::make_unique<ShadowAtlas>(*backend);
+	{
+		Microsoft::WRL::ComPtr<ID3D11Texture2D> atlasTexture;
+		D3D11_TEXTURE2D_DESC atlasDesc = texDesc;
+		atlasDesc.Width = shadowAtlas->GetAtlasSize();
+		atlasDesc.Height = shadowAtlas->GetAtlasSize();
+		atlasDesc.ArraySize = 1;
+		atlasDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE;
+		Graphics::Device->CreateTexture2D(&atlasDesc, nullptr, atlasTexture.GetAddressOf());
+
+		D3D11_DEPTH_STENCIL_VIEW_DESC atlasDSVDesc = {};
+		atlasDSVDesc.Format = DXGI_FORMAT_D32_FLOAT;
+		atlasDSVDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
+		Graphics::Device->CreateDepthStencilView(atlasTexture.Get(), &atlasDSVDesc, shadowAtlasDSV.GetAddressOf());
+
+		D3D11_SHADER_RESOURCE_VIEW_DESC atlasSRVDesc = {};
+		atlasSRVDesc.Format = DXGI_FORMAT_R32_FLOAT;
+		atlasSRVDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+		atlasSRVDesc.Texture2D.MipLevels = 1;
+		Graphics::Device->CreateShaderResourceView(atlasTexture.Get(), &atlasSRVDesc, shadowAtlasSRV.GetAddressOf());
+		shadowAtlasTexture = backend->ImportTexture(shadowAtlasSRV);
+	}
 
 	//Rasterizer stater 
 	D3D11_RASTERIZER_DESC rasterDesc = {};
@@ -1102,16 +1625,16 @@ void Game::CreateShadowMapResources() {
 	rasterDesc.SlopeScaledDepthBias = 1.0f;
 	Graphics::Device->CreateRasterizerState(&rasterDesc, shadowRasterizer.GetAddressOf());
 
-	XMFLOAT3 lightDir = XMFLOAT3(1.0f, -1.0f, 0.0f);
-	XMVECTOR dir = XMVector3Normalize(XMLoadFloat3(&lightDir));
+	// Same, limited to a dirty rectangle of the static cache
+	rasterDesc.ScissorEnable = true;
+	Graphics::Device->CreateRasterizerState(&rasterDesc, shadowScissorRasterizer.GetAddressOf());
 
-	XMVECTOR lightPos = XMVectorScale(dir, -20.0f);
-
-	XMMATRIX view = XMMatrixLookAtLH(
-		lightPos,
-		XMVectorSet(0.0f, 0.0f, 0.0f, 0.0f),
-		XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
-	XMStoreFloat4x4(&lightViewMatrix, view);
+	// Clearing part of a depth buffer means drawing over it
+	D3D11_DEPTH_STENCIL_DESC clearDesc = {};
+	clearDesc.DepthEnable = true;
+	clearDesc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ALL;
+	clearDesc.DepthFunc = D3D11_COMPARISON_ALWAYS;
+	Graphics::Device->CreateDepthStencilState(&clearDesc, shadowClearDepthState.GetAddressOf());
 
 	//comparison sampler state for shadow map sampling
 	D3D11_SAMPLER_DESC sampDesc = {};
@@ -1125,59 +1648,197 @@ void Game::CreateShadowMapResources() {
 	sampDesc.BorderColor[2] = 1.0f;
 	sampDesc.BorderColor[3] = 1.0f;
 	Graphics::Device->CreateSamplerState(&sampDesc, shadowSampler.GetAddressOf());
+	shadowMapSampler = backend->ImportSampler(shadowSampler);
 
-	//orthographic projection for directional light
-	XMMATRIX proj = XMMatrixOrthographicLH(20.0f, 20.0f, 0.1f, 100.0f);
-	XMStoreFloat4x4(&lightProjectionMatrix, proj);
+	// The cascades' light matrices are fitted to the camera in Draw()
 }
 
-void Game::RenderShadowMap() {
-	// clear the shadow map depth
-	Graphics::Context->ClearDepthStencilView(shadowDSV.Get(), D3D11_CLEAR_DEPTH, 1.0f, 0);
-	Graphics::Context->OMSetRenderTargets(0, 0, shadowDSV.Get());
+void Game::RenderShadowMap(D3D11RecordingContext& context, const RenderSettings& settings) {
+	ID3D11DeviceContext1* ctx = context.GetContext();
+
 	//Apply shadow rasterizer
-	Graphics::Context->RSSetState(shadowRasterizer.Get());
+	ctx->RSSetState(shadowRasterizer.Get());
+
+	// A deferred context starts from scratch - set up the input assembler too
+	ctx->IASetInputLayout(inputLayout.Get());
+	ctx->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
 	// Set shadow map viewport to match texture size
 	D3D11_VIEWPORT vp = {};
 	vp.TopLeftX = 0.0f;
 	vp.TopLeftY = 0.0f;
-	vp.Width = 1024.0f;
-	vp.Height = 1024.0f;
+	vp.Width = (float)shadowCascades->GetResolution();
+	vp.Height = (float)shadowCascades->GetResolution();
 	vp.MinDepth = 0.0f;
 	vp.MaxDepth = 1.0f;
-	Graphics::Context->RSSetViewports(1, &vp);
+	ctx->RSSetViewports(1, &vp);
 
+	// world/view/proj for each cascade's casters were packed in Draw()
+	for (unsigned int i = 0; i < ShadowCascades::CascadeCount; i++)
+	{
+		if (settings.shadowCaching)
+		{
+			// Bring the static slice up to date, then start from a copy of it
+			// - Depth buffers can only be copied whole, but a slice copy is
+			//   cheap next to drawing the casters
+			if (shadowCache->IsFullRedraw(i))
+			{
+				ctx->ClearDepthStencilView(staticShadowDSVs[i].Get(), D3D11_CLEAR_DEPTH, 1.0f, 0);
+				ctx->OMSetRenderTargets(0, 0, staticShadowDSVs[i].Get());
+				sceneRenderer->DrawCachedShadowPass(context.GetBackend(), shadowVertexShader, i);
+			}
+			else if (shadowCache->NeedsStaticPass(i))
+			{
+				RedrawShadowRects(context, i, vp);
+			}
 
-	// shadow VS only, no pixel shader
-	Graphics::Context->VSSetShader(shadowVertexShader.Get(), 0, 0);
-	Graphics::Context->PSSetShader(0, 0, 0);
+			UINT slice = D3D11CalcSubresource(0, i, 1);
+			ctx->CopySubresourceRegion(shadowTexture.Get(), slice, 0, 0, 0, staticShadowTexture.Get(), slice, nullptr);
+		}
+		else
+		{
+			ctx->ClearDepthStencilView(shadowDSVs[i].Get(), D3D11_CLEAR_DEPTH, 1.0f, 0);
+		}
 
-	// Simple struct - just world/view/proj
-	struct ShadowVSData
-	{
-		XMFLOAT4X4 world;
-		XMFLOAT4X4 view;
-		XMFLOAT4X4 proj;
-	};
-
-	ShadowVSData vsData = {};
-	vsData.view = lightViewMatrix;
-	vsData.proj = lightProjectionMatrix;
-
-	for (auto& entity : entities) {
-		vsData.world = entity.GetTransform()->GetWorldMatrix();
-		// Use whatever cbuffer binding you have
-		FillAndBindNextConstantBuffer(&vsData, sizeof(ShadowVSData), true, 0);
-		entity.Draw(Graphics::Context);
+		ctx->OMSetRenderTargets(0, 0, shadowDSVs[i].Get());
+		sceneRenderer->DrawShadowPass(context.GetBackend(), shadowVertexShader, i);
 	}
 
+	RenderShadowAtlas(context);
+
 	// restore everything
-	Graphics::Context->OMSetRenderTargets(1, Graphics::BackBufferRTV.GetAddressOf(), Graphics::DepthBufferDSV.Get());
+	ctx->OMSetRenderTargets(1, Graphics::BackBufferRTV.GetAddressOf(), Graphics::DepthBufferDSV.Get());
 	vp.Width = (float)Window::Width();
 	vp.Height = (float)Window::Height();
-	Graphics::Context->RSSetViewports(1, &vp);
-	Graphics::Context->RSSetState(0);
+	ctx->RSSetViewports(1, &vp);
+	ctx->RSSetState(0);
+}
+
+// --------------------------------------------------------
+// Redraw the dirty rectangles of one cascade's static shadow
+// slice: clear each to the far plane, then draw the static
+// casters that touch it, scissored to it
+// --------------------------------------------------------
+void Game::RedrawShadowRects(D3D11RecordingContext& context, unsigned int cascade, const D3D11_VIEWPORT& shadowViewport)
+{
+	ID3D11DeviceContext1* ctx = context.GetContext();
+	ctx->OMSetRenderTargets(0, 0, staticShadowDSVs[cascade].Get());
+	ctx->RSSetState(shadowScissorRasterizer.Get());
+
+	for (const ShadowRect& rect : shadowCache->GetDirtyRects(cascade))
+	{
+		D3D11_RECT scissor = { rect.x0, rect.y0, rect.x1, rect.y1 };
+		ctx->RSSetScissorRects(1, &scissor);
+		ClearShadowRegion(ctx, shadowViewport);
+		sceneRenderer->DrawCachedShadowPass(context.GetBackend(), shadowVertexShader, cascade);
+	}
+
+	ctx->RSSetState(shadowRasterizer.Get());
+}
+
+// --------------------------------------------------------
+// Redraw the atlas tiles that are due this frame.  The rest
+// of the atlas keeps what it had, so each tile is cleared on
+// its own.
+// --------------------------------------------------------
+void Game::RenderShadowAtlas(D3D11RecordingContext& context)
+{
+	const std::vector<ShadowAtlasView>& views = shadowAtlas->GetRenderViews();
+	if (views.empty())
+		return;
+
+	ID3D11DeviceContext1* ctx = context.GetContext();
+	ctx->OMSetRenderTargets(0, 0, shadowAtlasDSV.Get());
+	ctx->RSSetState(shadowScissorRasterizer.Get());
+
+	for (unsigned int v = 0; v < (unsigned int)views.size(); v++)
+	{
+		const ShadowAtlasTile& tile = views[v].tile;
+		D3D11_VIEWPORT vp = {};
+		vp.TopLeftX = (float)tile.x;
+		vp.TopLeftY = (float)tile.y;
+		vp.Width = (float)tile.size;
+		vp.Height = (float)tile.size;
+		vp.MaxDepth = 1.0f;
+		D3D11_RECT scissor = { (LONG)tile.x, (LONG)tile.y, (LONG)(tile.x + tile.size), (LONG)(tile.y + tile.size) };
+		ctx->RSSetScissorRects(1, &scissor);
+
+		ClearShadowRegion(ctx, vp);
+		sceneRenderer->DrawAtlasShadowPass(context.GetBackend(), shadowVertexShader, v);
+	}
+
+	ctx->RSSetState(shadowRasterizer.Get());
+}
+
+// --------------------------------------------------------
+// Reset the scissored part of the bound depth target to the
+// far plane - the full-screen triangle squeezed onto depth 1.
+// Leaves the viewport and input layout ready for casters.
+// --------------------------------------------------------
+void Game::ClearShadowRegion(ID3D11DeviceContext1* ctx, const D3D11_VIEWPORT& viewport)
+{
+	D3D11_VIEWPORT clearViewport = viewport;
+	clearViewport.MinDepth = 1.0f;
+	clearViewport.MaxDepth = 1.0f;
+
+	ctx->RSSetViewports(1, &clearViewport);
+	ctx->OMSetDepthStencilState(shadowClearDepthState.Get(), 0);
+	ctx->IASetInputLayout(nullptr);
+	ctx->VSSetShader(ppVS.Get(), 0, 0);
+	ctx->PSSetShader(nullptr, 0, 0);
+	ctx->Draw(3, 0);
+
+	ctx->RSSetViewports(1, &viewport);
+	ctx->OMSetDepthStencilState(nullptr, 0);
+	ctx->IASetInputLayout(inputLayout.Get());
+}
+
+// --------------------------------------------------------
+// Main pass: every visible entity, then the sky, into the
+// off-screen post-process target
+// --------------------------------------------------------
+void Game::RenderScene(D3D11RecordingContext& context, const GameSnapshot& snapshot)
+{
+	ID3D11DeviceContext1* ctx = context.GetContext();
+	IRenderBackend& backend = context.GetBackend();
+
+	// restore the input layout for scene geometry
+	ctx->IASetInputLayout(inputLayout.Get());
+	ctx->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+	// redirect scene rendering to the post-process render target
+	ctx->OMSetRenderTargets(1, ppRTV.GetAddressOf(), Graphics::DepthBufferDSV.Get());
+
+	D3D11_VIEWPORT vp = {};
+	vp.Width = (float)Window::Width();
+	vp.Height = (float)Window::Height();
+	vp.MaxDepth = 1.0f;
+	ctx->RSSetViewports(1, &vp);
+
+	//bind shadowSRV and shadowSampler to the pixel shader for use in lighting calculations
+	backend.SetTexture(ShaderStage::Pixel, 4, shadowMapTexture);
+	backend.SetSampler(ShaderStage::Pixel, 1, shadowMapSampler);
+
+	// The atlas and its tile list in t8-t9, for every other light
+	backend.SetTexture(ShaderStage::Pixel, 8, shadowAtlasTexture);
+	shadowAtlas->Bind(backend, ShaderStage::Pixel, 9);
+
+	// Clustered lights in t5-t7, or the per-object lights in t5
+	if (snapshot.settings.perObjectLights)
+		objectLights->Bind(backend, ShaderStage::Pixel, 5);
+	else
+		lightClusters->Bind(backend, ShaderStage::Pixel, 5);
+
+	//A5
+	// Draw each visible entity with its own material and matrices
+	// - packets were culled and sorted in PackConstants()
+	sceneRenderer->DrawOpaquePass(backend);
+
+	ID3D11ShaderResourceView* nullSrv[16] = {};
+	ctx->PSSetShaderResources(0, 16, nullSrv);
+
+	//draw the sky
+	sky->Draw(backend, ctx, *resources, snapshot.view, snapshot.projection);
 }
 
 // --------------------------------------------------------
@@ -1185,8 +1846,15 @@ void Game::RenderShadowMap() {
 // --------------------------------------------------------
 void Game::Update(float deltaTime, float totalTime)
 {
+	AllocationTracker::BeginFrame();
+	AllocationScope gameScope(AllocationTag::Game);
+	frameArena.BeginFrame();
+
 	//call the function first to ensure it happens when a new frame has started
-	ImGuiFresh(deltaTime);
+	{
+		AllocationScope uiScope(AllocationTag::UI);
+		ImGuiFresh(deltaTime);
+	}
 	// Example input checking: Quit if the escape key is pressed
 	if (Input::KeyDown(VK_ESCAPE))
 		Window::Quit();
@@ -1194,48 +1862,229 @@ void Game::Update(float deltaTime, float totalTime)
 	// update only active camera
 	cameras[activeCameraIndex]->Update(deltaTime);
 
-	// entity 0: rotate continuously
-	entities[0].GetTransform()->Rotate(0.0f, 0.0f, 1.0f * deltaTime);
-	// entity 1: move in a horizontal sine wave
+	// Entity systems - animation moves transforms a fixed tick at a
+	// time, keeping each tick's poses for Draw() to interpolate, then
+	// bounds catch up with whatever moved before the BVH and grid
+	// read them
+	{
+		AllocationScope entityScope(AllocationTag::Entities);
+		fixedTimestep.Advance(deltaTime);
+		while (fixedTimestep.Tick())
+		{
+			AnimateEntities(animatedEntities, *jobSystem, fixedTimestep.GetStep(), (float)fixedTimestep.GetTime());
+			PlayAnimations(clipPlayers, *resources, *jobSystem, fixedTimestep.GetStep());
+			RecordTickPoses(interpolatedEntities, *jobSystem);
+		}
+		UpdateWorldBounds(boundedEntities, *resources, *jobSystem);
+	}
+
+	// The BVH and the grid read the same bounds and write nothing in
+	// common, so the BVH updates on a worker while the grid builds
+	// - the query gathers its chunks first, so neither changes it
+	AllocationScope spatialScope(AllocationTag::Spatial);
+	boundedEntities.GetChunks();
+	JobCounter spatialJobs;
+	jobSystem->Spawn(spatialJobs, [this]() { UpdateEntityBVH(); });
+	UpdateEntityGrid();
+	jobSystem->Wait(spatialJobs);
+
+	// Clicks ImGui takes aren't picks
+	if (Input::MouseLeftPress() && !ImGui::GetIO().WantCaptureMouse)
+		PickUnderMouse();
+
+	CaptureSnapshot(deltaTime, totalTime);
+}
+
+// --------------------------------------------------------
+// Copies everything Draw() reads into the next frame's
+// snapshot, and takes the numbers the render thread left in it
+// when it last drew it.  The snapshots keep their capacity, so
+// once the scene settles this is copying and nothing else.
+// --------------------------------------------------------
+void Game::CaptureSnapshot(float deltaTime, float totalTime)
+{
+	// The UI's triangles.  ImGui asks for its textures (the font
+	// atlas) to be created or updated now and then - that needs the
+	// immediate context, so the render thread finishes first.
+	ImDrawData* uiDrawData;
+	{
+		AllocationScope uiScope(AllocationTag::UI);
+		ImGui::Render();
+		uiDrawData = ImGui::GetDrawData();
+		bool textureUpdates = false;
+		if (uiDrawData->Textures)
+		{
+			for (ImTextureData* texture : *uiDrawData->Textures)
+				textureUpdates |= texture->Status != ImTextureStatus_OK;
+		}
+		if (textureUpdates)
+		{
+			framePipeline.WaitForReader();
+			for (ImTextureData* texture : *uiDrawData->Textures)
+			{
+				if (texture->Status != ImTextureStatus_OK)
+					ImGui_ImplDX11_UpdateTexture(texture);
+			}
+		}
+	}
+
+	AllocationScope snapshotScope(AllocationTag::Renderer);
+	const std::shared_ptr<Camera>& camera = cameras[activeCameraIndex];
+
+	GameSnapshot& snapshot = framePipeline.BeginWrite();
+	if (snapshot.drawn.drawn)
+		drawnStats = snapshot.drawn;
+
+	snapshot.frame = framePipeline.GetHandoff().GetPublishedFrames();
+	snapshot.deltaTime = deltaTime;
+	snapshot.totalTime = totalTime;
+	snapshot.tickAlpha = fixedTimestep.GetAlpha();
+	snapshot.view = camera->GetViewMatrix();
+	snapshot.projection = camera->GetProjectionMatrix();
+	snapshot.cameraPosition = camera->GetTransform().GetPosition();
+	snapshot.ambientColor = ambientColor;
+	snapshot.lights.assign(lights.begin(), lights.end());
+	snapshot.entityBounds.assign(entityBVH.GetBounds().begin(), entityBVH.GetBounds().end());
+	snapshot.entities.CopyFrom(entities, jobSystem.get());
+	snapshot.settings = renderSettings;
+	snapshot.materials.assign(materialSettings.begin(), materialSettings.end());
+	snapshot.ui.Capture(*uiDrawData);
+	framePipeline.Publish();
+
+	renderSettings.invalidateShadowCache = false;
+}
+
+// --------------------------------------------------------
+// The render thread: draws and presents each frame Update()
+// publishes, until the destructor closes the pipeline
+// --------------------------------------------------------
+void Game::RenderLoop()
+{
+	jobSystem->AttachThread();
+	while (GameSnapshot* snapshot = framePipeline.BeginRead())
 	{
-		float s = sinf(totalTime * 2.0f) * 0.005f;
-		entities[1].GetTransform()->SetPosition(s, 0.0f, 0.0f);
+		Draw(*snapshot);
+		framePipeline.EndRead();
 	}
-	// entity 2: pulsate scale
+}
+
+void Game::PickUnderMouse()
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	PickRay ray = PickRay::FromScreen(
+		(float)Input::GetMouseX() + 0.5f,
+		(float)Input::GetMouseY() + 0.5f,
+		(float)Window::Width(),
+		(float)Window::Height(),
+		cameras[activeCameraIndex]->GetViewMatrix(),
+		cameras[activeCameraIndex]->GetProjectionMatrix());
+	lastPick = PickEntity(entities, *resources, entityBVH, ray);
+	pickMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+	selectedEntity = lastPick.entity;
+	selectionChanged = true;
+}
+
+// --------------------------------------------------------
+// Builds the entity BVH when the entity id count changes, and
+// otherwise refits it for the entities whose world bounds have
+// changed since it last looked.  Leaves are by entity id - a
+// dead id's leaf is an empty box at the origin.
+// --------------------------------------------------------
+void Game::UpdateEntityBVH()
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	size_t idCapacity = entities.GetIdCapacity();
+	if (entityBVH.GetCount() != idCapacity)
 	{
-		float pulse = 1.0f + 0.3f * sinf(totalTime * 3.0f);
-		entities[2].GetTransform()->SetScale(pulse, pulse, 1.0f);
+		FrameVector<AABB> bounds(idCapacity, AABB(), frameArena);
+		entityBVHVersions.assign(idCapacity, UINT_MAX);
+		boundedEntities.ForEach([&](EntityId id, Transform&, MeshRef&, WorldBounds& world)
+		{
+			bounds[id] = world.box;
+			entityBVHVersions[id] = world.transformVersion;
+		});
+		entityBVH.Build(bounds.data(), bounds.size());
 	}
-	// entity 3: move left and right
+	else
 	{
-		float x = sinf(totalTime) * 0.4f;
-		entities[3].GetTransform()->SetPosition(x, -0.5f, 0.0f);
+		boundedEntities.ForEach([&](EntityId id, Transform&, MeshRef&, WorldBounds& world)
+		{
+			if (world.transformVersion == entityBVHVersions[id])
+				return;
+
+			entityBVHVersions[id] = world.transformVersion;
+			entityBVH.Update(id, world.box);
+		});
+		entityBVH.Refit();
 	}
-	// entity 4: rotate opposite direction
-	entities[4].GetTransform()->Rotate(0.0f, 0.0f, -0.8f * deltaTime);
+	entityBVHMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void Game::UpdateEntityGrid()
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	entityPositions.assign(entities.GetIdCapacity(), XMFLOAT3(0, 0, 0));
+	boundedEntities.ForEach([&](EntityId id, Transform& transform, MeshRef&, WorldBounds&)
+	{
+		entityPositions[id] = transform.GetPosition();
+	});
+	entityGrid.Build(*jobSystem, entityPositions.data(), entityPositions.size(), neighbourRadius);
+	entityGridMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
 }
 
 // --------------------------------------------------------
-// Clear the screen, redraw everything, present to the user
+// Clear the screen, redraw everything, present to the user -
+// on the render thread, from a frame Update() captured
 // --------------------------------------------------------
-void Game::Draw(float deltaTime, float totalTime)
+void Game::Draw(GameSnapshot& snapshot)
 {
+	AllocationScope rendererScope(AllocationTag::Renderer);
+	renderArena.BeginFrame();
+
+	// Nothing below reads the live entities, cameras, lights or UI
+	// settings - only the snapshot's
+	std::vector<Light>& lights = snapshot.lights;
+	RenderQuery& renderEntities = snapshot.renderEntities;
+	const RenderSettings& settings = snapshot.settings;
+	for (const MaterialSettings& materialSetting : snapshot.materials)
+	{
+		Material* material = resources->Get(materialSetting.material);
+		if (!material)
+			continue;
+		material->SetColorTint(materialSetting.colorTint);
+		material->SetUVScale(materialSetting.uvScale);
+		material->SetUVOffset(materialSetting.uvOffset);
+	}
+
+	// Moving entities go between their last two ticks and their
+	// bounds follow, then skinned meshes are posed with bounds of
+	// their own, so culling and shadows see what's drawn
+	{
+		AllocationScope entityScope(AllocationTag::Entities);
+		InterpolateTransforms(snapshot.interpolatedEntities, snapshot.tickAlpha, *jobSystem);
+		UpdateWorldBounds(snapshot.boundedEntities, *resources, *jobSystem);
+		SkinMeshes(snapshot);
+	}
+
 	// Frame START
 	// - These things should happen ONCE PER FRAME
 	// - At the beginning of Game::Draw() before drawing *anything*
 	{
+		// Whatever was released in frames the GPU has finished goes now
+		{
+			AllocationScope resourceScope(AllocationTag::Resources);
+			resources->BeginFrame();
+		}
+
 		// Clear the back buffer (erase what's on screen) and depth buffer
+		// - Pipeline state is set by each pass in RenderShadowMap(),
+		//   RenderScene() and the post process, since they may be
+		//   recorded on deferred contexts
 		//const float color[4] = { 0.4f, 0.6f, 0.75f, 0.0f };
-		Graphics::Context->ClearRenderTargetView(Graphics::BackBufferRTV.Get(),	color);
-		Graphics::Context->ClearRenderTargetView(ppRTV.Get(), color);
+		Graphics::Context->ClearRenderTargetView(Graphics::BackBufferRTV.Get(),	settings.clearColor);
+		Graphics::Context->ClearRenderTargetView(ppRTV.Get(), settings.clearColor);
 		Graphics::Context->ClearDepthStencilView(Graphics::DepthBufferDSV.Get(), D3D11_CLEAR_DEPTH, 1.0f, 0);
-
-		// restore the input layout for scene geometry
-		Graphics::Context->IASetInputLayout(inputLayout.Get());
-		Graphics::Context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-
-		// redirect scene rendering to the post-process render target
-		Graphics::Context->OMSetRenderTargets(1, ppRTV.GetAddressOf(), Graphics::DepthBufferDSV.Get());
 	}
 
 	//A4
@@ -1287,88 +2136,169 @@ void Game::Draw(float deltaTime, float totalTime)
 		}*/
 
 		//a6
-		// grab active camera matrices
-		XMFLOAT4X4 view = cameras[activeCameraIndex]->GetViewMatrix();
-		XMFLOAT4X4 projection = cameras[activeCameraIndex]->GetProjectionMatrix();
-
-		RenderShadowMap();
-
-		Graphics::Context->OMSetRenderTargets(1, ppRTV.GetAddressOf(), Graphics::DepthBufferDSV.Get());
+		// the camera as it was at the end of Update()
+		const XMFLOAT4X4& view = snapshot.view;
+		const XMFLOAT4X4& projection = snapshot.projection;
+		const XMFLOAT3& cameraPosition = snapshot.cameraPosition;
+
+		bool doBlur = settings.blurEnabled && (settings.blurRadius > 0);
+		bool doChroma = settings.chromaEnabled && (settings.chromaStrength > 0.0f);
+
+		// Pack constant data for the whole frame
+		// - The ring is mapped ONCE here and every slice this frame's
+		//   draws need is written up front, so no draw has to Map/Unmap
+		// - It must be unmapped before any draw that reads from it
+		ConstantBufferSlice blurSlice;
+		ConstantBufferSlice chromaSlice;
+
+		// Fit the shadow cascades to the camera, facing the first
+		// directional light that casts shadows
+		XMFLOAT3 shadowDirection(1.0f, -1.0f, 0.0f);
+		int cascadedLight = -1;
+		for (int i = 0; i < (int)lights.size(); i++)
+		{
+			if (lights[i].Type == LIGHT_TYPE_DIRECTIONAL && lights[i].CastsShadows)
+			{
+				shadowDirection = lights[i].Direction;
+				cascadedLight = i;
+				break;
+			}
+		}
+		snapshot.drawn.shadowCascadeLight = cascadedLight;
+		// - A cached static layer wants the cascades to move rarely, so it
+		//   snaps them in coarser steps
+		// - Fitted to the entities' bounds (the BVH's, as Update() left
+		//   them), so each cascade only covers what's in its slice and
+		//   what can shadow it
+		shadowCascades->SetSplitLambda(settings.cascadeSplitLambda);
+		shadowCascades->SetShadowDistance(settings.shadowDistance);
+		shadowCascades->SetTexelSnapping(settings.shadowTexelSnapping);
+		shadowCascades->SetSnapTexels(settings.shadowCaching ? 16 : 1);
+		const std::vector<AABB>& entityBounds = snapshot.entityBounds;
+		if (settings.shadowSceneFitting)
+			shadowCascades->Update(view, projection, shadowDirection, entityBounds.data(), entityBounds.size());
+		else
+			shadowCascades->Update(view, projection, shadowDirection);
+		ShadowCascadeShaderData shadowData = shadowCascades->GetShaderData();
+		if (settings.invalidateShadowCache)
+			shadowCache->Invalidate();
+		if (settings.shadowCaching)
+			shadowCache->Update(renderEntities, shadowCascades->GetCascades(), ShadowCascades::CascadeCount, shadowCascades->GetResolution());
+
+		// Every other shadow casting light gets atlas tiles, and each
+		// light's ShadowIndex is set before the lights are uploaded
+		shadowAtlas->SetUpdatePeriodsEnabled(settings.shadowAtlasPeriods);
+		shadowAtlas->Update(lights, view, projection, cascadedLight);
+		shadowAtlas->Upload();
+		shadowData.atlasTexelSize = 1.0f / shadowAtlas->GetAtlasSize();
+
+		// Bin the point/spot lights into clusters and upload the lists
+		// - Uses the job system, and the upload maps buffers, so it runs
+		//   here before any pass starts recording
+		// - Per-object lights are picked during PackConstants() instead
+		LightClusterShaderData clusterData = {};
+		if (settings.perObjectLights)
+		{
+			objectLights->BeginFrame(lights, snapshot.entities.GetIdCapacity());
+		}
+		else
+		{
+			auto clusterStart = std::chrono::high_resolution_clock::now();
+			lightClusters->Build(lights, view, projection);
+			lightClusters->Upload(lights);
+			clusterData = lightClusters->GetShaderData((float)Window::Width(), (float)Window::Height());
+			lightClusterMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - clusterStart).count();
+		}
 
-		//bind shadowSRV and shadowSampler to the pixel shader for use in lighting calculations
-		Graphics::Context->PSSetShaderResources(4, 1, shadowSRV.GetAddressOf());
-		Graphics::Context->PSSetSamplers(1, 1, shadowSampler.GetAddressOf());
-		Graphics::Context->OMSetRenderTargets(1, ppRTV.GetAddressOf(), Graphics::DepthBufferDSV.Get());
+		// Rasterize the occluders for the cull in PackConstants()
+		if (settings.occlusionCulling)
+		{
+			auto occlusionStart = std::chrono::high_resolution_clock::now();
+			XMFLOAT4X4 viewProjection;
+			XMStoreFloat4x4(&viewProjection, XMMatrixMultiply(XMLoadFloat4x4(&view), XMLoadFloat4x4(&projection)));
+			occlusionCuller->BeginFrame(viewProjection);
+			renderEntities.ForEach([&](EntityId, Transform& transform, WorldBounds&, MeshRef& meshRef, MaterialRef&, RenderFlags& flags)
+			{
+				const Mesh* mesh = flags.isOccluder ? resources->Get(meshRef.mesh) : nullptr;
+				if (mesh)
+					occlusionCuller->AddOccluder(*mesh, transform.GetWorldMatrix());
+			});
+			occlusionCuller->Rasterize();
+			occlusionMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - occlusionStart).count();
+		}
 
-		//A5
-		// Draw each entity with its own matrix
-		for (auto& entity : entities)
+		constantRing->BeginFrame();
 		{
-			// get the materials
-			auto mat = entity.GetMaterial();
-			// set the shaders for this entity's material
-			Graphics::Context->VSSetShader(mat->GetVertexShader().Get(), 0, 0);
-			Graphics::Context->PSSetShader(mat->GetPixelShader().Get(), 0, 0);
-
-			// Build constant buffer data for this specific entity
-			VertexShaderExternalData cbData = {};
-			cbData.world = entity.GetTransform()->GetWorldMatrix();
-			//cbData.colorTint = mat->GetColorTint();
-			cbData.worldInvTranspose = entity.GetTransform()->GetWorldInverseTransposeMatrix();
-			cbData.view = view;
-			cbData.projection = projection;
-			cbData.lightView = lightViewMatrix;
-			cbData.lightProjection = lightProjectionMatrix;
-
-			// Map, copy, unmap
-			//D3D11_MAPPED_SUBRESOURCE mapped = {};
-			//Graphics::Context->Map(vsConstantBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
-			//memcpy(mapped.pData, &cbData, sizeof(VertexShaderExternalData));
-			//Graphics::Context->Unmap(vsConstantBuffer.Get(), 0);
-
-			// builf pixel shader constant buffer data
-			PixelShaderExternalData psData = {};
-			psData.colorTint = entity.GetMaterial()->GetColorTint();
-			psData.uvScale = entity.GetMaterial()->GetUVScale();
-			psData.uvOffset = entity.GetMaterial()->GetUVOffset();
-			psData.ambientColor = ambientColor;
-			psData.cameraPosition = cameras[activeCameraIndex]->GetTransform().GetPosition();
-			entity.GetMaterial()->BindTexturesAndSamplers(Graphics::Context);
-
-			// SET LIGHTING STUFF
-			//memcpy(&psData.dirLight1, &directionalLight1, sizeof(Light)); 
-			memcpy(&psData.lights, &lights[0], sizeof(Light) * (int)lights.size());
-
-			/*D3D11_MAPPED_SUBRESOURCE psMapped = {};
-			Graphics::Context->Map(psConstantBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &psMapped);
-			memcpy(psMapped.pData, &psData, sizeof(PixelShaderExternalData));
-			Graphics::Context->Unmap(psConstantBuffer.Get(), 0);*/
-
-			/*Graphics::Context->VSSetConstantBuffers(0, 1, vsConstantBuffer.GetAddressOf());
-			Graphics::Context->PSSetConstantBuffers(0, 1, psConstantBuffer.GetAddressOf());*/
-
-			cbData.worldInvTranspose = entity.GetTransform()->GetWorldInverseTransposeMatrix();
-
-			FillAndBindNextConstantBuffer(&cbData, sizeof(VertexShaderExternalData), true, 0);
-			FillAndBindNextConstantBuffer(&psData, sizeof(PixelShaderExternalData), false, 0);
-
-			// Draw the entity (sets VB/IB and calls DrawIndexed)
-			entity.Draw(Graphics::Context);
+			SceneFrameData frame = {};
+			frame.view = view;
+			frame.projection = projection;
+			frame.cameraPosition = cameraPosition;
+			frame.ambientColor = snapshot.ambientColor;
+			if (settings.perObjectLights)
+				frame.lightSelector = objectLights.get();
+			else
+				frame.lightClusters = &clusterData;
+			frame.shadowCascades = shadowCascades->GetCascades();
+			frame.shadowCascadeCount = ShadowCascades::CascadeCount;
+			frame.shadows = &shadowData;
+			if (settings.shadowCaching)
+				frame.shadowCache = shadowCache.get();
+			frame.atlasViews = shadowAtlas->GetRenderViews().data();
+			frame.atlasViewCount = (unsigned int)shadowAtlas->GetRenderViews().size();
+			if (settings.occlusionCulling)
+				frame.occlusion = occlusionCuller.get();
+			sceneRenderer->PackConstants(renderEntities, *resources, frame);
+
+			// Post process: blur also serves as the identity copy (radius 0)
+			// when neither effect is active
+			if (doBlur || !doChroma)
+			{
+				BlurCB blurData = {};
+				blurData.blurRadius = doBlur ? settings.blurRadius : 0;
+				blurData.texelSizeX = 1.0f / (float)Window::Width();
+				blurData.texelSizeY = 1.0f / (float)Window::Height();
+				blurSlice = constantRing->Push(blurData);
+			}
+
+			if (doChroma)
+			{
+				ChromaCB chromaData = {};
+				chromaData.strength = settings.chromaStrength;
+				chromaData.texelSizeX = 1.0f / (float)Window::Width();
+				chromaData.texelSizeY = 1.0f / (float)Window::Height();
+				chromaSlice = constantRing->Push(chromaData);
+			}
 		}
+		constantRing->Unmap();
 
-		ID3D11ShaderResourceView* nullSrv[16] = {};
-		Graphics::Context->PSSetShaderResources(0, 16, nullSrv);
+		if (settings.perObjectLights)
+			objectLights->Upload();
 
-		//draw the sky
-		sky->Draw(cameras[activeCameraIndex]);
+		// Record the frame's passes
+		// - In deferred mode shadow, scene and post process are each
+		//   recorded on a worker into their own deferred context, then
+		//   executed here in dependency order
+		// - ImGui's DX11 backend only knows the immediate context, so
+		//   the UI always records in place on the render thread
+		passScheduler->Reset();
+
+		size_t shadowPass = passScheduler->AddPass("Shadow map", [&](IRecordingContext& context)
+		{
+			RenderShadowMap(D3D11RecordingContext::From(context), settings);
+		});
+
+		size_t scenePass = passScheduler->AddPass("Scene", [&](IRecordingContext& context)
+		{
+			RenderScene(D3D11RecordingContext::From(context), snapshot);
+		});
 
 		// Post-process chain -------------------------------------------------
 		// Source always starts as ppSRV (the off-screen scene).
 		// Each active pass reads from one RT and writes to the next.
 		// Final pass must write to the back buffer.
+		size_t postProcessPass = passScheduler->AddPass("Post process", [&](IRecordingContext& context)
 		{
-			bool doBlur = blurEnabled && (blurRadius > 0);
-			bool doChroma = chromaEnabled && (chromaStrength > 0.0f);
+			D3D11RecordingContext& d3dContext = D3D11RecordingContext::From(context);
 
 			// Determine routing:
 			//   blur → ping, chroma → back buffer   (both active)
@@ -1378,52 +2308,50 @@ void Game::Draw(float deltaTime, float totalTime)
 
 			if (doBlur)
 			{
-				BlurCB blurData = {};
-				blurData.blurRadius = blurRadius;
-				blurData.texelSizeX = 1.0f / (float)Window::Width();
-				blurData.texelSizeY = 1.0f / (float)Window::Height();
-
 				ID3D11RenderTargetView* dst = doChroma
 					? ppPingRTV.Get()
 					: Graphics::BackBufferRTV.Get();
 
-				RunPostProcessPass(blurPS.Get(), ppSRV.Get(), dst,
-					&blurData, sizeof(blurData));
+				RunPostProcessPass(d3dContext, blurPS.Get(), ppSRV.Get(), dst, blurSlice);
 			}
 
 			if (doChroma)
 			{
-				ChromaCB chromaData = {};
-				chromaData.strength = chromaStrength;
-				chromaData.texelSizeX = 1.0f / (float)Window::Width();
-				chromaData.texelSizeY = 1.0f / (float)Window::Height();
-
 				// Read from ping if blur ran first, else read from original scene
 				ID3D11ShaderResourceView* src = doBlur
 					? ppPingSRV.Get()
 					: ppSRV.Get();
 
-				RunPostProcessPass(chromaPS.Get(), src,
-					Graphics::BackBufferRTV.Get(),
-					&chromaData, sizeof(chromaData));
+				RunPostProcessPass(d3dContext, chromaPS.Get(), src,
+					Graphics::BackBufferRTV.Get(), chromaSlice);
 			}
 
 			// Neither effect active → copy scene to back buffer unchanged
 			if (!doBlur && !doChroma)
 			{
-				BlurCB blurData = {};   // radius 0 → identity copy
-				blurData.blurRadius = 0;
-				blurData.texelSizeX = 1.0f / (float)Window::Width();
-				blurData.texelSizeY = 1.0f / (float)Window::Height();
-
-				RunPostProcessPass(blurPS.Get(), ppSRV.Get(),
-					Graphics::BackBufferRTV.Get(),
-					&blurData, sizeof(blurData));
+				RunPostProcessPass(d3dContext, blurPS.Get(), ppSRV.Get(),
+					Graphics::BackBufferRTV.Get(), blurSlice);
 			}
-		}
+		});
 
-		ImGui::Render(); // Turns this frame¡¦s UI into renderable triangles
-		ImGui_ImplDX11_RenderDrawData(ImGui::GetDrawData()); // Draws it to the screen
+		size_t uiPass = passScheduler->AddPass("UI", [&](IRecordingContext& context)
+		{
+			// Executing a command list unbinds everything, so target the
+			// back buffer explicitly
+			D3D11RecordingContext::From(context).GetContext()->OMSetRenderTargets(
+				1, Graphics::BackBufferRTV.GetAddressOf(), nullptr);
+
+			// The triangles Update() copied out of ImGui
+			AllocationScope uiScope(AllocationTag::UI);
+			if (ImDrawData* uiDrawData = snapshot.ui.GetDrawData())
+				ImGui_ImplDX11_RenderDrawData(uiDrawData); // Draws it to the screen
+		}, true);
+
+		passScheduler->AddDependency(scenePass, shadowPass);
+		passScheduler->AddDependency(postProcessPass, scenePass);
+		passScheduler->AddDependency(uiPass, postProcessPass);
+
+		passScheduler->Run(settings.deferredRecording);
 		
 		//A4
 		// present
@@ -1449,6 +2377,60 @@ void Game::Draw(float deltaTime, float totalTime)
 			1,
 			Graphics::BackBufferRTV.GetAddressOf(),
 			Graphics::DepthBufferDSV.Get());
+
+		// Everything using this frame's constant slices has been submitted
+		constantRing->EndFrame();
+		resources->EndFrame();
+	}
+
+	RecordDrawnStats(snapshot);
+}
+
+// --------------------------------------------------------
+// Leaves the render thread's numbers for the frame just drawn
+// in its snapshot, for the UI once the game thread gets it back
+// --------------------------------------------------------
+void Game::RecordDrawnStats(GameSnapshot& snapshot)
+{
+	DrawnFrameStats& drawn = snapshot.drawn;
+	drawn.drawn = true;
+	drawn.ringFrameBytes = constantRing->GetFrameBytes();
+	drawn.ringCapacity = constantRing->GetCapacity();
+	drawn.ringFramesInFlight = constantRing->GetFramesInFlight();
+	drawn.ringGrowCount = constantRing->GetGrowCount();
+	drawn.pendingReleases = resources->GetPendingCount();
+	drawn.arena = renderArena.GetStats();
+	drawn.arenaFrames = renderArena.GetFrameCount();
+
+	drawn.scene = sceneRenderer->GetStats();
+	drawn.skinning = skinner.GetStats();
+	drawn.tubePoseMs = tubePoseMs;
+	drawn.occlusion = occlusionCuller->GetStats();
+	drawn.occlusionMs = occlusionMs;
+
+	for (unsigned int i = 0; i < ShadowCascades::CascadeCount; i++)
+		drawn.cascades[i] = shadowCascades->GetCascade(i);
+	drawn.shadowCache = shadowCache->GetStats();
+	drawn.atlas = shadowAtlas->GetStats();
+	drawn.lightShadows.resize(snapshot.lights.size());
+	for (size_t i = 0; i < drawn.lightShadows.size(); i++)
+	{
+		drawn.lightShadows[i].tileSize = shadowAtlas->GetTileSize(i);
+		drawn.lightShadows[i].updatePeriod = shadowAtlas->GetUpdatePeriod(i);
+	}
+
+	drawn.objectLights = objectLights->GetStats();
+	drawn.lightClusters = lightClusters->GetStats();
+	drawn.lightClusterMs = lightClusterMs;
+
+	drawn.passes = passScheduler->GetStats();
+	const std::vector<PassTiming>& timings = passScheduler->GetTimings();
+	drawn.passTimings.resize(timings.size());
+	for (size_t i = 0; i < timings.size(); i++)
+	{
+		snprintf(drawn.passTimings[i].name, sizeof(drawn.passTimings[i].name), "%s", timings[i].name ? timings[i].name : "");
+		drawn.passTimings[i].timing = timings[i];
+		drawn.passTimings[i].timing.name = nullptr;		// Gone with the arena's frame
 	}
 }
 
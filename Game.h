@@ -7,12 +7,35 @@
 #include <vector>
 #include <memory>
 #include "Mesh.h"
-#include "GameEntity.h"
+#include "EntitySystems.h"
 #include "Camera.h"
 #include "Material.h"
 #include "WICTextureLoader.h"
 #include "Lights.h"
 #include "Sky.h"
+#include "ConstantBufferRing.h"
+#include "ResourceRegistry.h"
+#include "D3D11Backend.h"
+#include "SceneRenderer.h"
+#include "LightClusterGrid.h"
+#include "ShadowCascades.h"
+#include "ShadowCache.h"
+#include "ShadowAtlas.h"
+#include "OcclusionCuller.h"
+#include "EntityBVH.h"
+#include "Picking.h"
+#include "SpatialHashGrid.h"
+#include "JobSystem.h"
+#include "D3D11CommandDevice.h"
+#include "PassScheduler.h"
+#include "FrameArena.h"
+#include "FixedTimestep.h"
+#include "FramePipeline.h"
+#include "RenderSnapshot.h"
+#include "Skinning.h"
+#include "CompressedClip.h"
+#include "UiDrawSnapshot.h"
+#include <thread>
 
 // -- Post Process constant buffer structs ------------------------------
 // must be 16-byte aligned
@@ -32,8 +55,117 @@ struct ChromaCB
 	float padding;
 };
 
+// -- What the UI sets for the renderer ---------------------------------
+// Edited on the game thread, copied into every snapshot, and read
+// from there by Draw()
+struct RenderSettings
+{
+	float clearColor[4] = { 0.4f, 0.6f, 0.75f, 0.0f };
+
+	// Post process
+	bool  blurEnabled = true;
+	int   blurRadius = 0;        // 0 = no blur, max slider = 10
+	bool  chromaEnabled = true;
+	float chromaStrength = 0.005f;   // 0 = no effect, max slider = 0.03
+
+	// Shadows
+	float cascadeSplitLambda = 0.75f;
+	float shadowDistance = 60.0f;
+	bool shadowTexelSnapping = true;
+	bool shadowSceneFitting = true;
+	bool shadowCaching = true;
+	bool invalidateShadowCache = false;		// This frame's only
+	bool shadowAtlasPeriods = true;
+
+	bool perObjectLights = false;
+	bool occlusionCulling = true;
+	bool deferredRecording = false;
+
+	SkinningMode skinningMode = SkinningMode::DualQuaternion;
+	bool compressedTubeClip = true;
+};
+
+// A material's UI-editable values - the renderer sets them on the
+// material before packing the frame's constants
+struct MaterialSettings
+{
+	MaterialHandle material;
+	DirectX::XMFLOAT4 colorTint;
+	DirectX::XMFLOAT2 uvScale;
+	DirectX::XMFLOAT2 uvOffset;
+};
+
+// -- What drawing a frame found, for the UI ---------------------------
+// Written into the snapshot by the render thread and copied out by
+// the game thread when it next writes that snapshot, so the UI's
+// numbers are a couple of frames old
+struct DrawnLightShadow
+{
+	unsigned int tileSize = 0;		// 0 = no atlas tile
+	unsigned int updatePeriod = 0;
+};
+
+struct DrawnPassTiming
+{
+	char name[32] = {};		// A copy - the pass's is in the render thread's arena
+	PassTiming timing;
+};
+
+struct DrawnFrameStats
+{
+	bool drawn = false;
+
+	size_t ringFrameBytes = 0;
+	size_t ringCapacity = 0;
+	size_t ringFramesInFlight = 0;
+	unsigned int ringGrowCount = 0;
+	size_t pendingReleases = 0;
+	FrameArenaStats arena;
+	unsigned int arenaFrames = 0;
+
+	SceneRenderStats scene;
+	SkinningStats skinning;
+	double tubePoseMs = 0.0;
+	OcclusionStats occlusion;
+	double occlusionMs = 0.0;
+
+	ShadowCascade cascades[ShadowCascades::CascadeCount] = {};
+	int shadowCascadeLight = -1;
+	ShadowCacheStats shadowCache;
+	ShadowAtlasStats atlas;
+	std::vector<DrawnLightShadow> lightShadows;		// By light
+
+	ObjectLightStats objectLights;
+	LightClusterStats lightClusters;
+	double lightClusterMs = 0.0;
+
+	PassSchedulerStats passes;
+	std::vector<DrawnPassTiming> passTimings;
+};
+
+// --------------------------------------------------------
+// The game's frame snapshot: the scene (see RenderSnapshot),
+// plus the UI's settings and draw lists, and room for the
+// render thread's numbers on the way back
+// --------------------------------------------------------
+struct GameSnapshot : RenderSnapshot
+{
+	RenderSettings settings;
+	std::vector<MaterialSettings> materials;
+	UiDrawSnapshot ui;
+
+	DrawnFrameStats drawn;
+};
+
 class Game
 {
+	// Declared first so it is destroyed last - meshes, materials and
+	// the constant ring all hold handles to objects it owns
+	std::unique_ptr<D3D11Backend> backend;
+
+	// Every mesh and material - everything else holds handles
+	std::unique_ptr<ResourceRegistry> resources;
+
 public:
 	// Basic OOP setup
 	Game();
@@ -49,9 +181,10 @@ public:
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srvFloorNormalMap;
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srvFlatNormalMap;
 
-	// Primary functions
+	// Primary functions - Update() hands each frame to the render
+	// thread, which draws and presents it
 	void Update(float deltaTime, float totalTime);
-	void Draw(float deltaTime, float totalTime);
+	void OnBeforeResize();
 	void OnResize();
 
 private:
@@ -67,13 +200,93 @@ private:
 	Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState;
 
 	// Ring buffer constant buffer
-	Microsoft::WRL::ComPtr<ID3D11Buffer> cbRingBuffer;
-	size_t cbRingBufferOffset = 0;
-	static const size_t cbRingBufferSize = 256000;
+	// - Mapped once per frame, every draw gets a slice of it
+	std::unique_ptr<ConstantBufferRing> constantRing;
+	static const size_t constantRingInitialSize = 256 * 1024;
+
+	// Transient per-frame data, an arena per thread: UI strings and
+	// scratch on the game thread, reset at the start of each Update(),
+	// and draw packets and pass lists on the render thread, reset at
+	// the start of each Draw()
+	FrameArena frameArena;
+	FrameArena renderArena;
+
+	// Worker threads for per-entity work (culling, constant packing)
+	std::unique_ptr<JobSystem> jobSystem;
+
+	// Entities are simulated in fixed ticks, and drawn between the
+	// last two
+	FixedTimestep fixedTimestep;
+
+	// Update() ends by copying what Draw() needs into a snapshot -
+	// the scene, the UI's settings and its draw lists - and Draw()
+	// runs on the render thread, a frame behind, reading nothing else
+	// the game thread changes.  Between them:
+	//  - the game thread owns the entities, cameras, lights, settings
+	//    and ImGui; the render thread owns the D3D11 context and every
+	//    renderer system (shadows, lights, culling, skinning, passes)
+	//  - nothing creates or releases resources after startup, so both
+	//    look meshes and materials up freely; materials only change
+	//    on the render thread, from the snapshot's settings
+	//  - the render thread's numbers come back in the snapshot, for
+	//    the UI
+	//  - the render thread is idle while the window resizes the swap
+	//    chain, and while the game thread updates ImGui's textures
+	FramePipeline<GameSnapshot> framePipeline;
+	std::thread renderThread;
+	void CaptureSnapshot(float deltaTime, float totalTime);
+	void RenderLoop();
+	void Draw(GameSnapshot& snapshot);
+	void RecordDrawnStats(GameSnapshot& snapshot);
+
+	// The UI's settings, and the last drawn frame's numbers
+	RenderSettings renderSettings;
+	std::vector<MaterialSettings> materialSettings;		// By materials index
+	DrawnFrameStats drawnStats;
+
+	// Per-entity constant packing and draws, backend-only
+	std::unique_ptr<SceneRenderer> sceneRenderer;
+
+	// Point/spot lights binned into view space clusters each frame
+	std::unique_ptr<LightClusterGrid> lightClusters;
+	double lightClusterMs = 0.0;
+
+	// Forward alternative: each entity gets its own few lights
+	std::unique_ptr<ObjectLightSelector> objectLights;
 
-	// Helper method
-	void FillAndBindNextConstantBuffer(void* data, size_t dataSize,
-		bool isVertexShader, UINT slot);
+	// Software depth buffer of the occluder entities, so the opaque
+	// pass skips what's behind them
+	std::unique_ptr<OcclusionCuller> occlusionCuller;
+	double occlusionMs = 0.0;
+
+	// Every entity's world bounds in a BVH for spatial queries,
+	// refitted at the end of Update() for whatever moved
+	EntityBVH entityBVH;
+	std::vector<unsigned int> entityBVHVersions;
+	double entityBVHMs = 0.0;
+	void UpdateEntityBVH();
+
+	// Left click picks the entity under the mouse through the BVH and
+	// the meshes' triangles, and opens it in the entity inspector
+	int selectedEntity = -1;
+	bool selectionChanged = false;
+	PickHit lastPick;
+	double pickMs = 0.0;
+	void PickUnderMouse();
+
+	// Entity positions hashed into a grid every frame, for radius and
+	// nearest neighbour queries around the picked entity
+	SpatialHashGrid entityGrid;
+	std::vector<DirectX::XMFLOAT3> entityPositions;		// By entity id
+	double entityGridMs = 0.0;
+	std::vector<uint32_t> neighbourScratch;		// The selected entity's, for the UI
+	float neighbourRadius = 5.0f;
+	void UpdateEntityGrid();
+
+	// Shadow / scene / post process / UI passes, optionally recorded
+	// on deferred contexts by the job system's workers
+	std::unique_ptr<D3D11CommandDevice> commandDevice;
+	std::unique_ptr<PassScheduler> passScheduler;
 
 
 	// UI-editable data
@@ -85,30 +298,59 @@ private:
 	void CreateGeometry();
 	void ImGuiFresh(float);
 	void CreateShadowMapResources();	
-	void RenderShadowMap();
+	void RenderShadowMap(D3D11RecordingContext& context, const RenderSettings& settings);
+	void RedrawShadowRects(D3D11RecordingContext& context, unsigned int cascade, const D3D11_VIEWPORT& shadowViewport);
+	void RenderShadowAtlas(D3D11RecordingContext& context);
+	void ClearShadowRegion(ID3D11DeviceContext1* ctx, const D3D11_VIEWPORT& viewport);
+	void RenderScene(D3D11RecordingContext& context, const GameSnapshot& snapshot);
 	void CreatePostProcessResources();
-	void RunPostProcessPass(ID3D11PixelShader* ps,
+	void RunPostProcessPass(D3D11RecordingContext& context,
+		ID3D11PixelShader* ps,
 		ID3D11ShaderResourceView* srcSRV,
 		ID3D11RenderTargetView* dstRTV,
-		void* cbData,
-		size_t                        cbSize);
+		const ConstantBufferSlice& cbSlice);
 
-	//mesh storage - using shared_ptr for proper lifetime management
-	std::vector<std::shared_ptr<Mesh>> meshes;
+	// The loaded meshes and materials, owned by the registry
+	std::vector<MeshHandle> meshes;
 
-	std::vector<std::shared_ptr<Material>> materials;
+	std::vector<MaterialHandle> materials;
 
-	// game entitites
-	std::vector<GameEntity> entities;
+	// Keyframed clips, loaded from Assets/Animations
+	std::vector<AnimationClipHandle> clips;
+
+	// A tube bent and twisted by a chain of joints, a clip each,
+	// skinned on the CPU into its entity's dynamic mesh at the top
+	// of every Draw()
+	Skeleton tubeSkeleton;
+	std::unique_ptr<SkinnedMesh> skinnedTube;
+	std::vector<AnimationClip> tubeClips;
+	std::vector<const AnimationClip*> tubeJointClips;
+	std::vector<AnimationCursor> tubeCursors;
+	CompressedClip tubeCompressed;		// The same clips, played instead when set
+	CompressedClipCursor tubeCompressedCursor;
+	std::vector<JointPose> tubePose;
+	SkinningPalette tubePalette;
+	MeshHandle tubeMesh;
+	EntityId tubeEntity = InvalidEntity;
+	CpuSkinner skinner;
+	double tubePoseMs = 0.0;
+	void CreateTubeEntity();
+	void SkinMeshes(GameSnapshot& snapshot);
+
+	// game entities - archetype storage, and the query each system
+	// walks every frame
+	EntityStore entities;
+	AnimatedQuery animatedEntities{ entities };
+	AnimationPlayerQuery clipPlayers{ entities };
+	InterpolatedQuery interpolatedEntities{ entities };
+	BoundsQuery boundedEntities{ entities };
+	RenderQuery renderEntities{ entities };
 
 	// Cameras 
 	std::vector<std::shared_ptr<Camera>> cameras;
 	int activeCameraIndex; // tracks which camera is currently active
 
 
-	//establish color as a member of the Game class
-	float color[4] = { 0.4f, 0.6f, 0.75f, 0.0f };
-
 	// UI state
 	bool showDemoMenu = false;
 	bool showHappyMeter = false;
@@ -129,14 +371,33 @@ private:
 	Microsoft::WRL::ComPtr<ID3D11VertexShader> vertexShader;
 	Microsoft::WRL::ComPtr<ID3D11InputLayout> inputLayout;
 
-	// shadow resources
-	Microsoft::WRL::ComPtr<ID3D11VertexShader> shadowVertexShader;
-	Microsoft::WRL::ComPtr<ID3D11DepthStencilView> shadowDSV;
+	// shadow resources - a texture array with one slice per cascade,
+	// refitted to the active camera every frame
+	ShaderHandle shadowVertexShader;
+	std::unique_ptr<ShadowCascades> shadowCascades;
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> shadowTexture;
+	Microsoft::WRL::ComPtr<ID3D11DepthStencilView> shadowDSVs[ShadowCascades::CascadeCount];
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> shadowSRV;
 	Microsoft::WRL::ComPtr<ID3D11RasterizerState> shadowRasterizer;
+
+	// Cached static casters - a second array the same shape, copied
+	// under the dynamic casters every frame.  Dirty rectangles are
+	// cleared by a scissored full-screen triangle at depth 1.
+	std::unique_ptr<ShadowCache> shadowCache;
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> staticShadowTexture;
+	Microsoft::WRL::ComPtr<ID3D11DepthStencilView> staticShadowDSVs[ShadowCascades::CascadeCount];
+	Microsoft::WRL::ComPtr<ID3D11RasterizerState> shadowScissorRasterizer;
+	Microsoft::WRL::ComPtr<ID3D11DepthStencilState> shadowClearDepthState;
+
+	// Every other shadow casting light - tiles of one big depth
+	// texture, sized and refreshed by importance
+	std::unique_ptr<ShadowAtlas> shadowAtlas;
+	Microsoft::WRL::ComPtr<ID3D11DepthStencilView> shadowAtlasDSV;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> shadowAtlasSRV;
+	TextureHandle shadowAtlasTexture;
 	Microsoft::WRL::ComPtr<ID3D11SamplerState> shadowSampler;
-	DirectX::XMFLOAT4X4 lightViewMatrix;
-	DirectX::XMFLOAT4X4 lightProjectionMatrix;
+	TextureHandle shadowMapTexture;
+	SamplerHandle shadowMapSampler;
 
 	// ---- Post-process resources ----------------------------------------------
 	// Off-screen render target: all 3-D rendering goes here first
@@ -156,12 +417,6 @@ private:
 	Microsoft::WRL::ComPtr<ID3D11VertexShader> ppVS;     // full-screen triangle VS
 	Microsoft::WRL::ComPtr<ID3D11PixelShader>  blurPS;   // Task 1
 	Microsoft::WRL::ComPtr<ID3D11PixelShader>  chromaPS; // Task 2
-
-	// ImGui-controlled post-process parameters
-	bool  blurEnabled = true;
-	int   blurRadius = 0;        // 0 = no blur, max slider = 10
-	bool  chromaEnabled = true;
-	float chromaStrength = 0.005f;   // 0 = no effect, max slider = 0.03
 	// ----------------------------------------------------------------------------
 };
 
@@ -0,0 +1,11 @@
+#include "HeadlessModes.h"
+
+// --------------------------------------------------------
+// Entry point for the headless build (CMakeLists.txt) - the
+// checks and benchmarks alone, no window or GPU, on any
+// platform.  The Windows app runs the same modes from WinMain.
+// --------------------------------------------------------
+int main(int argc, char** argv)
+{
+	return RunHeadlessMode(argc, argv);
+}
@@ -0,0 +1,263 @@
+#include "HeadlessModes.h"
+#include "SceneRendererTests.h"
+#include "ConstantBufferRingTests.h"
+#include "LightClusterGridTests.h"
+#include "ObjectLightSelectorTests.h"
+#include "ShadowCascadesTests.h"
+#include "ShadowCacheTests.h"
+#include "ShadowAtlasTests.h"
+#include "OcclusionCullerTests.h"
+#include "EntityBVHTests.h"
+#include "MeshBVHTests.h"
+#include "PickingTests.h"
+#include "SpatialHashGridTests.h"
+#include "EntityStoreTests.h"
+#include "ResourceRegistryTests.h"
+#include "FrameArenaTests.h"
+#include "AllocationTrackerTests.h"
+#include "JobSystemTests.h"
+#include "FramePipelineTests.h"
+#include "FixedTimestepTests.h"
+#include "AnimationClipTests.h"
+#include "SkinningTests.h"
+#include "CompressedClipTests.h"
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+	// Replaces a setting's default with the count, if one was given
+	void SetCount(int& setting, const HeadlessOptions& options)
+	{
+		if (options.count > 0)
+			setting = options.count;
+	}
+
+	int SceneBench(const HeadlessOptions& options)
+	{
+		HeadlessBenchSettings settings;
+		SetCount(settings.entityCount, options);
+		settings.threadCount = options.threadCount;
+		settings.scaling = options.scaling;
+		settings.deferred = options.deferred;
+		settings.allocationCsv = options.allocationCsv;
+		return RunHeadlessBench(settings);
+	}
+
+	int LightBench(const HeadlessOptions& options)
+	{
+		LightClusterBenchSettings settings;
+		SetCount(settings.lightCount, options);
+		settings.threadCount = options.threadCount;
+		return RunLightClusterBench(settings);
+	}
+
+	int SelectBench(const HeadlessOptions& options)
+	{
+		LightSelectionBenchSettings settings;
+		SetCount(settings.entityCount, options);
+		settings.threadCount = options.threadCount;
+		return RunLightSelectionBench(settings);
+	}
+
+	int OcclusionBench(const HeadlessOptions& options)
+	{
+		OcclusionBenchSettings settings;
+		SetCount(settings.entityCount, options);
+		settings.threadCount = options.threadCount;
+		return RunOcclusionBench(settings);
+	}
+
+	int BVHBench(const HeadlessOptions& options)
+	{
+		BVHBenchSettings settings;
+		SetCount(settings.maxEntityCount, options);
+		return RunBVHBench(settings);
+	}
+
+	int RayBench(const HeadlessOptions& options)
+	{
+		RayBenchSettings settings;
+		SetCount(settings.rayCount, options);
+		settings.threadCount = options.threadCount;
+		return RunRayBench(settings);
+	}
+
+	int HashBench(const HeadlessOptions& options)
+	{
+		SpatialHashBenchSettings settings;
+		SetCount(settings.maxEntityCount, options);
+		settings.threadCount = options.threadCount;
+		return RunSpatialHashBench(settings);
+	}
+
+	int EntityLayoutBench(const HeadlessOptions& options)
+	{
+		EntityLayoutBenchSettings settings;
+		SetCount(settings.entityCount, options);
+		settings.threadCount = options.threadCount;
+		return RunEntityLayoutBench(settings);
+	}
+
+	int ResourceBench(const HeadlessOptions& options)
+	{
+		ResourceRegistryBenchSettings settings;
+		SetCount(settings.drawCount, options);
+		settings.threadCount = options.threadCount;
+		return RunResourceRegistryBench(settings);
+	}
+
+	int JobBench(const HeadlessOptions& options)
+	{
+		JobSystemBenchSettings settings;
+		SetCount(settings.fibN, options);
+		settings.threadCount = options.threadCount;
+		settings.scaling = options.scaling;
+		return RunJobSystemBench(settings);
+	}
+
+	int PipelineBench(const HeadlessOptions& options)
+	{
+		FramePipelineBenchSettings settings;
+		SetCount(settings.entityCount, options);
+		settings.threadCount = options.threadCount;
+		return RunFramePipelineBench(settings);
+	}
+
+	int AnimationBench(const HeadlessOptions& options)
+	{
+		AnimationBenchSettings settings;
+		SetCount(settings.entityCount, options);
+		settings.threadCount = options.threadCount;
+		return RunAnimationBench(settings);
+	}
+
+	int SkinningBench(const HeadlessOptions& options)
+	{
+		SkinningBenchSettings settings;
+		SetCount(settings.meshCount, options);
+		settings.threadCount = options.threadCount;
+		return RunSkinningBench(settings);
+	}
+
+	int CompressionBench(const HeadlessOptions& options)
+	{
+		ClipCompressionBenchSettings settings;
+		SetCount(settings.jointCount, options);
+		return RunClipCompressionBench(settings);
+	}
+
+	struct HeadlessMode
+	{
+		const char* flag;
+		const char* count;		// What the count after the flag is, null if it takes none
+		int (*run)(const HeadlessOptions& options);
+		const char* description;
+	};
+
+	const HeadlessMode modes[] =
+	{
+		{ "--bench",			"entityCount",		SceneBench,			"CPU cost of the scene passes" },
+		{ "--ringtest",			nullptr,			[](const HeadlessOptions&) { return RunConstantBufferRingChecks(); },	"Constant buffer ring, against a fake fence" },
+		{ "--lightbench",		"lightCount",		LightBench,			"Clustered light binning, against brute force" },
+		{ "--selectbench",		"entityCount",		SelectBench,		"Per-object light selection" },
+		{ "--cascadetest",		nullptr,			[](const HeadlessOptions&) { return RunShadowCascadeChecks(); },	"Shadow cascade math" },
+		{ "--shadowcachetest",	nullptr,			[](const HeadlessOptions&) { return RunShadowCacheChecks(); },		"Static shadow cache invalidation" },
+		{ "--atlastest",		nullptr,			[](const HeadlessOptions&) { return RunShadowAtlasChecks(); },		"Shadow atlas allocator and light tiles" },
+		{ "--occlusionbench",	"entityCount",		OcclusionBench,		"Software occlusion culling, against a ray cast" },
+		{ "--bvhbench",			"maxEntityCount",	BVHBench,			"Entity BVH, against a linear walk" },
+		{ "--raybench",			"rayCount",			RayBench,			"Mesh ray casting, against every triangle" },
+		{ "--picktest",			nullptr,			[](const HeadlessOptions&) { return RunPickingChecks(); },			"Entity picking" },
+		{ "--hashbench",		"maxEntityCount",	HashBench,			"Spatial hash grid, against a linear scan" },
+		{ "--ecsbench",			"entityCount",		EntityLayoutBench,	"Entity store, against an entity array" },
+		{ "--resourcebench",	"drawCount",		ResourceBench,		"Resource registry handles and use after free" },
+		{ "--arenatest",		nullptr,			[](const HeadlessOptions&) { return RunFrameArenaChecks(); },		"Frame arena, and frames that don't touch the heap" },
+		{ "--alloctest",		nullptr,			[](const HeadlessOptions&) { return RunAllocationTrackerChecks(); },	"Allocation tracker" },
+		{ "--jobtest",			nullptr,			[](const HeadlessOptions&) { return RunJobSystemChecks(); },		"Job system stress test" },
+		{ "--jobbench",			"fibN",				JobBench,			"Job system, against serial code" },
+		{ "--pipelinetest",		nullptr,			[](const HeadlessOptions&) { return RunFramePipelineChecks(); },	"Frame pipeline and entity store copies" },
+		{ "--pipelinebench",	"entityCount",		PipelineBench,		"Simulating and rendering on two threads" },
+		{ "--ticktest",			nullptr,			[](const HeadlessOptions&) { return RunFixedTimestepChecks(); },	"Fixed timestep and interpolation" },
+		{ "--animbench",		"entityCount",		AnimationBench,		"Keyframe animation sampling" },
+		{ "--skinbench",		"meshCount",		SkinningBench,		"Skeletal skinning" },
+		{ "--compressbench",	"jointCount",		CompressionBench,	"Animation clip compression" },
+	};
+
+	const HeadlessMode* FindMode(const char* arg)
+	{
+		for (const HeadlessMode& mode : modes)
+		{
+			if (strcmp(arg, mode.flag) == 0)
+				return &mode;
+		}
+		return nullptr;
+	}
+
+	void PrintModes()
+	{
+		printf("Headless modes:\n");
+		for (const HeadlessMode& mode : modes)
+		{
+			char usage[64];
+			snprintf(usage, sizeof(usage), "%s%s%s%s", mode.flag, mode.count ? " [" : "", mode.count ? mode.count : "", mode.count ? "]" : "");
+			printf("  %-34s %s\n", usage, mode.description);
+		}
+		printf("Options: --threads <n>, --scaling, --deferred, --alloccsv\n");
+	}
+}
+
+bool HasHeadlessMode(int argc, char** argv)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		if (FindMode(argv[i]))
+			return true;
+	}
+	return false;
+}
+
+int RunHeadlessMode(int argc, char** argv)
+{
+	const HeadlessMode* mode = nullptr;
+	HeadlessOptions options;
+	for (int i = 1; i < argc; i++)
+	{
+		const char* arg = argv[i];
+		const HeadlessMode* found = FindMode(arg);
+		if (found)
+		{
+			if (mode)
+			{
+				printf("One mode at a time, not %s and %s\n", mode->flag, found->flag);
+				return 1;
+			}
+			mode = found;
+			if (mode->count && i + 1 < argc && isdigit((unsigned char)argv[i + 1][0]))
+				options.count = atoi(argv[++i]);
+		}
+		else if (strcmp(arg, "--threads") == 0 && i + 1 < argc)
+			options.threadCount = atoi(argv[++i]);
+		else if (strcmp(arg, "--scaling") == 0)
+			options.scaling = true;
+		else if (strcmp(arg, "--deferred") == 0)
+			options.deferred = true;
+		else if (strcmp(arg, "--alloccsv") == 0)
+			options.allocationCsv = "allocations.csv";
+		else
+		{
+			printf("Unknown argument %s\n", arg);
+			PrintModes();
+			return 1;
+		}
+	}
+
+	if (!mode)
+	{
+		PrintModes();
+		return 1;
+	}
+	return mode->run(options);
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+// --------------------------------------------------------
+// The headless checks and benchmarks, picked from the command
+// line - no window or GPU.  One flag picks the mode, optionally
+// followed by a count (entities, lights, rays... whatever the
+// mode scales with), and these apply to every mode that uses
+// them:
+//  - "--threads <n>" threads including the caller, instead of
+//    every hardware thread
+//  - "--scaling" once per power of two up to the hardware
+//  - "--deferred" record passes on deferred contexts
+//  - "--alloccsv" write each frame's allocations to
+//    allocations.csv
+//
+// e.g. "--bench 20000 --threads 4" or "--jobtest"
+// --------------------------------------------------------
+struct HeadlessOptions
+{
+	int count = 0;			// After the mode's flag, 0 for the mode's own default
+	int threadCount = -1;	// Including the caller, negative = every hardware thread
+	bool scaling = false;
+	bool deferred = false;
+	const char* allocationCsv = nullptr;
+};
+
+// Is there a mode's flag on the command line
+bool HasHeadlessMode(int argc, char** argv);
+
+// Runs the mode on the command line and returns its result, 0 if
+// everything passed.  Lists the modes, and returns 1, if there's
+// no mode or an argument it doesn't know.
+int RunHeadlessMode(int argc, char** argv);
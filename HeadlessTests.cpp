@@ -0,0 +1,188 @@
+#include "HeadlessTests.h"
+#include "RecordingBackend.h"
+#include "Mesh.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+using namespace DirectX;
+
+const unsigned char fakeBytecode[4] = { 'D', 'X', 'B', 'C' };
+
+namespace
+{
+	void BenchCubeGeometry(Vertex (&vertices)[8], unsigned int (&indices)[36])
+	{
+		for (int i = 0; i < 8; i++)
+		{
+			vertices[i].Position = XMFLOAT3(
+				(i & 1) ? 0.5f : -0.5f,
+				(i & 2) ? 0.5f : -0.5f,
+				(i & 4) ? 0.5f : -0.5f);
+			vertices[i].Normal = vertices[i].Position;
+			vertices[i].UV = XMFLOAT2((i & 1) ? 1.0f : 0.0f, (i & 2) ? 1.0f : 0.0f);
+			vertices[i].Tangent = XMFLOAT3(1, 0, 0);
+		}
+
+		const unsigned int cubeIndices[36] =
+		{
+			0, 2, 1,  1, 2, 3,	// -z
+			4, 5, 6,  5, 7, 6,	// +z
+			0, 1, 4,  1, 5, 4,	// -y
+			2, 6, 3,  3, 6, 7,	// +y
+			0, 4, 2,  2, 4, 6,	// -x
+			1, 3, 5,  3, 7, 5	// +x
+		};
+		memcpy(indices, cubeIndices, sizeof(cubeIndices));
+	}
+}
+
+int ReportCheck(const char* name, bool passed, const char* detail)
+{
+	printf("  %-44s %s  %s\n", name, passed ? "ok  " : "FAIL", detail);
+	return passed ? 0 : 1;
+}
+
+int ReportValidation(const RecordingBackend& backend)
+{
+	printf("  validation errors: %zu\n", backend.GetErrorCount());
+	for (const std::string& error : backend.GetErrors())
+		printf("    %s\n", error.c_str());
+	return backend.GetErrorCount() == 0 ? 0 : 1;
+}
+
+int ReportFailures(int failures)
+{
+	printf("\n  %d failed\n", failures);
+	return failures == 0 ? 0 : 1;
+}
+
+double Milliseconds(std::chrono::high_resolution_clock::duration d)
+{
+	return std::chrono::duration<double, std::milli>(d).count();
+}
+
+std::shared_ptr<Mesh> CreateBenchCube(IRenderBackend& backend)
+{
+	Vertex vertices[8] = {};
+	unsigned int indices[36];
+	BenchCubeGeometry(vertices, indices);
+	return std::make_shared<Mesh>(vertices, 8, indices, 36, backend, BufferUsage::Immutable, MeshCpuGeometry::Keep);
+}
+
+MeshHandle CreateBenchCube(ResourceRegistry& resources, IRenderBackend& backend)
+{
+	Vertex vertices[8] = {};
+	unsigned int indices[36];
+	BenchCubeGeometry(vertices, indices);
+	return resources.Create<Mesh>(vertices, 8, indices, 36, backend, BufferUsage::Immutable, MeshCpuGeometry::Keep);
+}
+
+float QuaternionAngle(FXMVECTOR a, FXMVECTOR b)
+{
+	XMVECTOR unitA = XMQuaternionNormalize(a);
+	XMVECTOR unitB = XMQuaternionNormalize(b);
+	if (XMVectorGetX(XMVector4Dot(unitA, unitB)) < 0.0f)
+		unitB = XMVectorNegate(unitB);
+	float chord = XMVectorGetX(XMVector4Length(XMVectorSubtract(unitA, unitB)));
+	return 4.0f * asinf((std::min)(chord * 0.5f, 1.0f));
+}
+
+float MaxDifference(const XMFLOAT3& a, const XMFLOAT3& b)
+{
+	return (std::max)((std::max)(fabsf(a.x - b.x), fabsf(a.y - b.y)), fabsf(a.z - b.z));
+}
+
+bool RayHitsBox(const XMFLOAT3& origin, const XMFLOAT3& direction, const AABB& box)
+{
+	const float o[3] = { origin.x, origin.y, origin.z };
+	const float d[3] = { direction.x, direction.y, direction.z };
+	const float c[3] = { box.center.x, box.center.y, box.center.z };
+	const float e[3] = { box.extents.x, box.extents.y, box.extents.z };
+
+	float tMin = 0.0f;
+	float tMax = FLT_MAX;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		if (fabsf(d[axis]) < 1e-8f)
+		{
+			if (fabsf(o[axis] - c[axis]) > e[axis])
+				return false;
+			continue;
+		}
+		float t0 = (c[axis] - e[axis] - o[axis]) / d[axis];
+		float t1 = (c[axis] + e[axis] - o[axis]) / d[axis];
+		tMin = (std::max)(tMin, (std::min)(t0, t1));
+		tMax = (std::min)(tMax, (std::max)(t0, t1));
+	}
+	return tMin <= tMax;
+}
+
+bool SameIndices(std::vector<uint32_t> a, std::vector<uint32_t> b)
+{
+	std::sort(a.begin(), a.end());
+	std::sort(b.begin(), b.end());
+	return a == b;
+}
+
+Skeleton CreateRandomSkeleton(std::mt19937& random, uint32_t jointCount, bool scaled)
+{
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	Skeleton skeleton;
+	for (uint32_t joint = 0; joint < jointCount; joint++)
+	{
+		JointPose pose;
+		pose.translation = XMFLOAT3(unit(random) - 0.5f, unit(random) * 0.5f + 0.25f, unit(random) - 0.5f);
+		XMStoreFloat4(&pose.rotation, XMQuaternionRotationRollPitchYaw(unit(random) - 0.5f, unit(random) * 3.0f, unit(random) - 0.5f));
+		if (scaled)
+			pose.scale = XMFLOAT3(0.8f + unit(random) * 0.4f, 0.8f + unit(random) * 0.4f, 0.8f + unit(random) * 0.4f);
+		skeleton.AddJoint(joint == 0 ? Skeleton::NoParent : (uint16_t)(random() % joint), pose);
+	}
+	return skeleton;
+}
+
+MeshHit BruteForceRay(const Mesh& mesh, const MeshRay& ray, bool anyHit)
+{
+	const std::vector<XMFLOAT3>& positions = mesh.GetPositions();
+	const std::vector<unsigned int>& indices = mesh.GetIndices();
+	MeshHit hit;
+	float closest = ray.maxDistance;
+	for (size_t t = 0; t + 2 < indices.size(); t += 3)
+	{
+		const XMFLOAT3& a = positions[indices[t]];
+		const XMFLOAT3& b = positions[indices[t + 1]];
+		const XMFLOAT3& c = positions[indices[t + 2]];
+		XMFLOAT3 e1(b.x - a.x, b.y - a.y, b.z - a.z);
+		XMFLOAT3 e2(c.x - a.x, c.y - a.y, c.z - a.z);
+		const XMFLOAT3& d = ray.direction;
+		XMFLOAT3 p(d.y * e2.z - d.z * e2.y, d.z * e2.x - d.x * e2.z, d.x * e2.y - d.y * e2.x);
+		float determinant = e1.x * p.x + e1.y * p.y + e1.z * p.z;
+		if (fabsf(determinant) < 1e-12f)
+			continue;
+
+		float inverse = 1.0f / determinant;
+		XMFLOAT3 s(ray.origin.x - a.x, ray.origin.y - a.y, ray.origin.z - a.z);
+		float u = (s.x * p.x + s.y * p.y + s.z * p.z) * inverse;
+		if (u < 0.0f || u > 1.0f)
+			continue;
+		XMFLOAT3 q(s.y * e1.z - s.z * e1.y, s.z * e1.x - s.x * e1.z, s.x * e1.y - s.y * e1.x);
+		float v = (d.x * q.x + d.y * q.y + d.z * q.z) * inverse;
+		if (v < 0.0f || u + v > 1.0f)
+			continue;
+		float distance = (e2.x * q.x + e2.y * q.y + e2.z * q.z) * inverse;
+		if (distance < 0.0f || distance > closest || (hit.IsHit() && distance == closest))
+			continue;
+
+		closest = distance;
+		hit.distance = distance;
+		hit.triangle = (uint32_t)(t / 3);
+		hit.u = u;
+		hit.v = v;
+		if (anyHit)
+			break;
+	}
+	return hit;
+}
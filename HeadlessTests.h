@@ -0,0 +1,71 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <vector>
+#include "Bounds.h"
+#include "MeshBVH.h"
+#include "RenderBackend.h"
+#include "ResourceRegistry.h"
+#include "Skeleton.h"
+
+class Mesh;
+class RecordingBackend;
+
+// --------------------------------------------------------
+// Helpers shared by the headless checks and benchmarks, one
+// file of them per system (*Tests.cpp).
+//
+// A check prints one line - its name, ok or FAIL, and what it
+// measured - and a run ends with how many failed, returning
+// 0 if none did.
+// --------------------------------------------------------
+
+// Stand-in for compiled shader code - the recording backend
+// only checks that there is some
+extern const unsigned char fakeBytecode[4];
+
+// Frames for the scratch arrays, the ring and the arena to reach
+// their sizes before heap allocations count against a frame
+const int WarmUpFrames = 4;
+
+// Prints a check's line, returns 1 if it failed so runs can
+// add up their failures
+int ReportCheck(const char* name, bool passed, const char* detail);
+
+// Prints the backend's validation errors, returns 1 if there
+// were any
+int ReportValidation(const RecordingBackend& backend);
+
+// Prints how many checks failed, returns the run's result:
+// 0 if none did, 1 otherwise
+int ReportFailures(int failures);
+
+double Milliseconds(std::chrono::high_resolution_clock::duration d);
+
+// A unit cube around the origin, keeping its CPU geometry
+std::shared_ptr<Mesh> CreateBenchCube(IRenderBackend& backend);
+MeshHandle CreateBenchCube(ResourceRegistry& resources, IRenderBackend& backend);
+
+// The angle between two rotations, in radians - from the chord
+// between the quaternions, which keeps its precision for tiny
+// angles where acos of their dot product doesn't
+float QuaternionAngle(DirectX::FXMVECTOR a, DirectX::FXMVECTOR b);
+
+// The largest difference of any component
+float MaxDifference(const DirectX::XMFLOAT3& a, const DirectX::XMFLOAT3& b);
+
+// Does a ray hit a box (slab test)
+bool RayHitsBox(const DirectX::XMFLOAT3& origin, const DirectX::XMFLOAT3& direction, const AABB& box);
+
+// Do two lists hold the same indices, in any order
+bool SameIndices(std::vector<uint32_t> a, std::vector<uint32_t> b);
+
+// A random tree of joints, each some way off its parent and
+// turned at random, with scale only if asked for
+Skeleton CreateRandomSkeleton(std::mt19937& random, uint32_t jointCount, bool scaled);
+
+// Every triangle of a mesh, with the same arithmetic as MeshBVH
+MeshHit BruteForceRay(const Mesh& mesh, const MeshRay& ray, bool anyHit);
@@ -0,0 +1,373 @@
+#include "JobSystem.h"
+#include <algorithm>
+
+namespace
+{
+	// Set on each worker thread, so a job knows whose deque to use
+	thread_local const JobSystem* workerSystem = nullptr;
+	thread_local unsigned int workerIndex = 0;
+
+	// Tries a worker makes for a job before it goes to sleep
+	const int IdleSpins = 64;
+
+	// Job slots tried before a thread gives up and runs inline
+	const uint32_t AllocateAttempts = 64;
+
+	// An adaptive ParallelFor() never splits a range smaller than
+	// this fraction of a thread's share
+	const size_t AdaptiveRangesPerThread = 64;
+
+	uint32_t NextRandom(uint32_t& state)
+	{
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return state;
+	}
+}
+
+// --------------------------------------------------------
+// Chase-Lev deque, after Le et al., "Correct and Efficient
+// Work-Stealing for Weak Memory Models" - the fences there are
+// folded into seq_cst operations here.  Full means Capacity
+// jobs between top and bottom; the ring never grows.
+// --------------------------------------------------------
+bool JobSystem::WorkDeque::Push(JobSlot* job)
+{
+	int64_t b = bottom.load(std::memory_order_relaxed);
+	int64_t t = top.load(std::memory_order_acquire);
+	if (b - t >= Capacity)
+		return false;
+
+	slots[b & (Capacity - 1)].store(job, std::memory_order_relaxed);
+	bottom.store(b + 1, std::memory_order_release);
+	return true;
+}
+
+JobSystem::JobSlot* JobSystem::WorkDeque::Pop()
+{
+	int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+	bottom.store(b, std::memory_order_seq_cst);
+	int64_t t = top.load(std::memory_order_seq_cst);
+
+	if (t > b)
+	{
+		// Already empty
+		bottom.store(b + 1, std::memory_order_relaxed);
+		return nullptr;
+	}
+
+	JobSlot* job = slots[b & (Capacity - 1)].load(std::memory_order_relaxed);
+	if (t == b)
+	{
+		// The last job - a thief may be after it too
+		if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			job = nullptr;
+		bottom.store(b + 1, std::memory_order_relaxed);
+	}
+	return job;
+}
+
+JobSystem::JobSlot* JobSystem::WorkDeque::Steal()
+{
+	int64_t t = top.load(std::memory_order_seq_cst);
+	int64_t b = bottom.load(std::memory_order_seq_cst);
+	if (t >= b)
+		return nullptr;
+
+	JobSlot* job = slots[t & (Capacity - 1)].load(std::memory_order_relaxed);
+	if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+		return nullptr;
+	return job;
+}
+
+bool JobSystem::WorkDeque::IsEmpty() const
+{
+	return bottom.load(std::memory_order_relaxed) <= top.load(std::memory_order_relaxed);
+}
+
+JobSystem::JobSystem(int workerCount, unsigned int extraThreads)
+{
+	if (workerCount < 0)
+	{
+		unsigned int hardwareThreads = std::thread::hardware_concurrency();
+		workerCount = hardwareThreads > 1 ? (int)hardwareThreads - 1 : 0;
+	}
+
+	firstExtraThread = (unsigned int)workerCount + 1;
+	threadCount = firstExtraThread + extraThreads;
+	threads = std::make_unique<ThreadData[]>(threadCount);
+	for (unsigned int i = 0; i < threadCount; i++)
+	{
+		threads[i].pool = std::make_unique<JobSlot[]>(ThreadData::PoolSize);
+		threads[i].random = 0x9E3779B9u * (uint32_t)(i + 1);
+	}
+
+	for (int i = 1; i <= workerCount; i++)
+		workers.emplace_back(&JobSystem::WorkerLoop, this, (unsigned int)i);
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+	wake.notify_all();
+
+	for (std::thread& worker : workers)
+		worker.join();
+}
+
+unsigned int JobSystem::GetThreadIndex() const
+{
+	return workerSystem == this ? workerIndex : 0;
+}
+
+bool JobSystem::AttachThread()
+{
+	if (workerSystem == this)
+		return true;
+
+	unsigned int index = firstExtraThread + attachedThreads.fetch_add(1, std::memory_order_relaxed);
+	if (index >= threadCount)
+		return false;
+
+	workerSystem = this;
+	workerIndex = index;
+	return true;
+}
+
+// --------------------------------------------------------
+// The next free slot in the calling thread's pool, or null if
+// the ones tried are all still queued or running
+// --------------------------------------------------------
+JobSystem::JobSlot* JobSystem::AllocateJob()
+{
+	ThreadData& thread = threads[GetThreadIndex()];
+	for (uint32_t attempt = 0; attempt < AllocateAttempts; attempt++)
+	{
+		JobSlot* job = &thread.pool[thread.nextJob++ % ThreadData::PoolSize];
+		if (!job->busy.load(std::memory_order_acquire))
+		{
+			job->busy.store(true, std::memory_order_relaxed);
+			return job;
+		}
+	}
+
+	thread.inlineJobs.fetch_add(1, std::memory_order_relaxed);
+	return nullptr;
+}
+
+void JobSystem::Submit(JobCounter& counter, JobSlot* job)
+{
+	ThreadData& thread = threads[GetThreadIndex()];
+	job->counter = &counter;
+	job->allocationTag = AllocationTracker::GetTag();
+	counter.pending.fetch_add(1, std::memory_order_relaxed);
+
+	// Counted before the push, so a sleeping worker can't miss it
+	queuedJobs.fetch_add(1, std::memory_order_seq_cst);
+	if (!thread.deque.Push(job))
+	{
+		queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+		thread.inlineJobs.fetch_add(1, std::memory_order_relaxed);
+		Execute(job);
+		return;
+	}
+
+	if (sleepingWorkers.load(std::memory_order_seq_cst) > 0)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		wake.notify_one();
+	}
+}
+
+// --------------------------------------------------------
+// The thread's own newest job, or else the oldest job of a
+// random other thread
+// --------------------------------------------------------
+JobSystem::JobSlot* JobSystem::FindJob(unsigned int index)
+{
+	ThreadData& thread = threads[index];
+	JobSlot* job = thread.deque.Pop();
+	if (!job)
+	{
+		unsigned int first = NextRandom(thread.random) % threadCount;
+		for (unsigned int i = 0; i < threadCount && !job; i++)
+		{
+			unsigned int victim = (first + i) % threadCount;
+			if (victim != index)
+				job = threads[victim].deque.Steal();
+		}
+		if (!job)
+			return nullptr;
+		thread.steals.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+	thread.jobs.fetch_add(1, std::memory_order_relaxed);
+	return job;
+}
+
+void JobSystem::Execute(JobSlot* job)
+{
+	{
+		AllocationScope scope(job->allocationTag);
+		job->function(job->data);
+	}
+
+	// The slot can be reused as soon as it's marked free, and the
+	// counter may be gone as soon as it reaches zero
+	JobCounter* counter = job->counter;
+	job->busy.store(false, std::memory_order_release);
+	counter->pending.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+void JobSystem::Wait(JobCounter& counter)
+{
+	unsigned int index = GetThreadIndex();
+	while (!counter.IsDone())
+	{
+		JobSlot* job = FindJob(index);
+		if (job)
+			Execute(job);
+		else
+			std::this_thread::yield();
+	}
+}
+
+void JobSystem::WorkerLoop(unsigned int index)
+{
+	workerSystem = this;
+	workerIndex = index;
+
+	while (true)
+	{
+		JobSlot* job = FindJob(index);
+		for (int spin = 0; !job && spin < IdleSpins; spin++)
+		{
+			std::this_thread::yield();
+			job = FindJob(index);
+		}
+		if (job)
+		{
+			Execute(job);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(mutex);
+		if (quit)
+			return;
+		sleepingWorkers.fetch_add(1, std::memory_order_seq_cst);
+		threads[index].sleeps.fetch_add(1, std::memory_order_relaxed);
+		wake.wait(lock, [&] { return quit || queuedJobs.load(std::memory_order_seq_cst) > 0; });
+		sleepingWorkers.fetch_sub(1, std::memory_order_relaxed);
+		if (quit)
+			return;
+	}
+}
+
+void JobSystem::RunChunks(size_t count, size_t chunkSize, const void* job, JobFunction invoke)
+{
+	if (count == 0)
+		return;
+	if (chunkSize == 0)
+		chunkSize = 1;
+
+	// Nothing to share - skip the jobs
+	if (threadCount == 1 || count <= chunkSize)
+	{
+		invoke(job, 0, count);
+		return;
+	}
+
+	JobCounter counter;
+	Range range = { job, invoke, count, chunkSize, &counter };
+	SplitChunks(&range, 0, GetChunkCount(count, chunkSize));
+	Wait(counter);
+}
+
+// --------------------------------------------------------
+// Spawns the upper half of the chunks until one is left, so
+// the oldest jobs in the deque - the ones thieves take - are
+// the biggest
+// --------------------------------------------------------
+void JobSystem::SplitChunks(const Range* range, size_t first, size_t last)
+{
+	while (last - first > 1)
+	{
+		size_t middle = first + (last - first) / 2;
+		Spawn(*range->counter, [this, range, middle, last]() { SplitChunks(range, middle, last); });
+		last = middle;
+	}
+
+	size_t begin = first * range->chunkSize;
+	range->invoke(range->job, begin, (std::min)(begin + range->chunkSize, range->count));
+}
+
+void JobSystem::RunAdaptive(size_t count, const void* job, JobFunction invoke)
+{
+	if (count == 0)
+		return;
+	if (threadCount == 1)
+	{
+		invoke(job, 0, count);
+		return;
+	}
+
+	size_t smallest = (std::max)(count / (GetThreadCount() * AdaptiveRangesPerThread), (size_t)1);
+	JobCounter counter;
+	Range range = { job, invoke, count, smallest, &counter };
+	SplitAdaptive(&range, 0, count);
+	Wait(counter);
+}
+
+// --------------------------------------------------------
+// Lazy binary splitting: works through the range a smallest
+// piece at a time, and hands half of what's left to the deque
+// whenever the deque is empty - nothing was queued yet, or
+// another thread took it, which means threads are idle
+// --------------------------------------------------------
+void JobSystem::SplitAdaptive(const Range* range, size_t first, size_t last)
+{
+	const WorkDeque& deque = threads[GetThreadIndex()].deque;
+	while (first < last)
+	{
+		if (last - first > range->chunkSize && deque.IsEmpty())
+		{
+			size_t middle = first + (last - first) / 2;
+			Spawn(*range->counter, [this, range, middle, last]() { SplitAdaptive(range, middle, last); });
+			last = middle;
+			continue;
+		}
+
+		size_t end = (std::min)(first + range->chunkSize, last);
+		range->invoke(range->job, first, end);
+		first = end;
+	}
+}
+
+JobSystemStats JobSystem::GetStats() const
+{
+	JobSystemStats stats;
+	for (unsigned int i = 0; i < GetThreadCount(); i++)
+	{
+		stats.jobs += threads[i].jobs.load(std::memory_order_relaxed);
+		stats.steals += threads[i].steals.load(std::memory_order_relaxed);
+		stats.inlineJobs += threads[i].inlineJobs.load(std::memory_order_relaxed);
+		stats.sleeps += threads[i].sleeps.load(std::memory_order_relaxed);
+	}
+	return stats;
+}
+
+void JobSystem::ResetStats()
+{
+	for (unsigned int i = 0; i < GetThreadCount(); i++)
+	{
+		threads[i].jobs.store(0, std::memory_order_relaxed);
+		threads[i].steals.store(0, std::memory_order_relaxed);
+		threads[i].inlineJobs.store(0, std::memory_order_relaxed);
+		threads[i].sleeps.store(0, std::memory_order_relaxed);
+	}
+}
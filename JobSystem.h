@@ -0,0 +1,231 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "AllocationTracker.h"
+
+// --------------------------------------------------------
+// Counts the jobs spawned against it that haven't finished.
+// JobSystem::Wait() returns once it's back to zero, so one
+// counter joins any number of forks - including jobs spawned
+// by those jobs against the same counter.
+// --------------------------------------------------------
+class JobCounter
+{
+public:
+	JobCounter() = default;
+	JobCounter(const JobCounter&) = delete;
+	JobCounter& operator=(const JobCounter&) = delete;
+
+	bool IsDone() const { return pending.load(std::memory_order_acquire) == 0; }
+
+private:
+	friend class JobSystem;
+	std::atomic<uint32_t> pending{ 0 };
+};
+
+struct JobSystemStats
+{
+	uint64_t jobs = 0;			// Run from a deque
+	uint64_t steals = 0;		// Of those, taken from another thread's deque
+	uint64_t inlineJobs = 0;	// Run on the spot, with the thread's deque or job pool full
+	uint64_t sleeps = 0;		// Times a worker ran out of work and slept
+};
+
+// --------------------------------------------------------
+// Work-stealing job system: one worker per hardware thread,
+// minus the thread that owns the system (usually the main
+// thread), which runs jobs too whenever it waits.
+//
+// Every thread has a Chase-Lev deque.  Spawn() pushes onto the
+// spawning thread's own deque, a thread pops its newest job
+// first, and a thread with nothing left steals the oldest job
+// from another's.  Jobs live in a per-thread pool of fixed
+// slots with their captures stored inline, so spawning never
+// allocates; a thread whose deque or pool is full just runs the
+// job on the spot.
+//
+// Fork-join is Spawn() against a JobCounter, then Wait() on it.
+// Jobs may spawn and wait themselves, and ParallelFor() may be
+// nested.  Workers charge what a job allocates to the
+// allocation tag of the thread that spawned it.
+//
+// Work may be started from the workers, from one other thread
+// at a time - the owner - and from up to extraThreads more that
+// called AttachThread() first, like a render thread running
+// beside the simulation.
+// --------------------------------------------------------
+class JobSystem
+{
+public:
+	// Negative = one worker per hardware thread, minus the caller.
+	// Zero workers runs everything on the calling thread.
+	explicit JobSystem(int workerCount = -1, unsigned int extraThreads = 0);
+	~JobSystem();
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	// function() runs on any thread, some time before Wait(counter)
+	// returns.  Captures must fit in a job - capture by reference,
+	// or a pointer to a struct.
+	template<typename Function> void Spawn(JobCounter& counter, Function&& function)
+	{
+		typedef typename std::decay<Function>::type Stored;
+		static_assert(sizeof(Stored) <= JobSlot::DataSize && alignof(Stored) <= alignof(void*),
+			"Job captures too big - capture a pointer to them instead");
+
+		JobSlot* job = AllocateJob();
+		if (!job)
+		{
+			function();
+			return;
+		}
+
+		new (job->data) Stored(std::forward<Function>(function));
+		job->function = [](void* data)
+		{
+			Stored* stored = std::launder(reinterpret_cast<Stored*>(data));
+			(*stored)();
+			stored->~Stored();
+		};
+		Submit(counter, job);
+	}
+
+	// Runs other jobs until every job spawned against counter is done
+	void Wait(JobCounter& counter);
+
+	// Gives the calling thread its own deque, so it can spawn and
+	// wait alongside the owner.  Once per thread, for the thread's
+	// lifetime; false once all extraThreads are taken.
+	bool AttachThread();
+
+	// Splits [0, count) into chunks of chunkSize and returns once
+	// every chunk has run.  Chunk N always covers
+	// [N * chunkSize, (N + 1) * chunkSize), so callers can give each
+	// chunk its own output slot and never lock.  With no workers, or
+	// one chunk, the whole range is a single call instead.
+	//
+	// job(size_t begin, size_t end)
+	template<typename Job> void ParallelFor(size_t count, size_t chunkSize, const Job& job)
+	{
+		RunChunks(count, chunkSize, &job, [](const void* job, size_t begin, size_t end)
+		{
+			(*static_cast<const Job*>(job))(begin, end);
+		});
+	}
+
+	// The same, with ranges decided as it runs: a range is halved
+	// only while other threads are out of work, so cheap items run
+	// in long ranges and uneven ones still spread out.  Calls may
+	// cover any range.
+	template<typename Job> void ParallelFor(size_t count, const Job& job)
+	{
+		RunAdaptive(count, &job, [](const void* job, size_t begin, size_t end)
+		{
+			(*static_cast<const Job*>(job))(begin, end);
+		});
+	}
+
+	// Workers, the owner and the extra threads
+	unsigned int GetThreadCount() const { return threadCount; }
+
+	static size_t GetChunkCount(size_t count, size_t chunkSize) { return (count + chunkSize - 1) / chunkSize; }
+
+	// Summed over every thread since the last ResetStats()
+	JobSystemStats GetStats() const;
+	void ResetStats();
+
+private:
+	typedef void (*JobFunction)(const void* job, size_t begin, size_t end);
+
+	struct alignas(64) JobSlot
+	{
+		static const size_t DataSize = 40;
+
+		void (*function)(void* data) = nullptr;
+		JobCounter* counter = nullptr;
+		std::atomic<bool> busy{ false };		// Until it has run
+		AllocationTag allocationTag = AllocationTag::Other;
+		alignas(void*) unsigned char data[DataSize];
+	};
+
+	// --------------------------------------------------------
+	// Fixed size Chase-Lev deque.  The owning thread pushes and
+	// pops at the bottom; any thread steals from the top.
+	// --------------------------------------------------------
+	class WorkDeque
+	{
+	public:
+		static const int64_t Capacity = 4096;
+
+		bool Push(JobSlot* job);		// Owner only, false if full
+		JobSlot* Pop();					// Owner only
+		JobSlot* Steal();
+		bool IsEmpty() const;
+
+	private:
+		alignas(64) std::atomic<int64_t> top{ 0 };
+		alignas(64) std::atomic<int64_t> bottom{ 0 };
+		std::atomic<JobSlot*> slots[Capacity] = {};
+	};
+
+	// One per thread; 0 is the owner's, then the workers', then
+	// the attached threads'
+	struct alignas(64) ThreadData
+	{
+		static const uint32_t PoolSize = 4096;
+
+		WorkDeque deque;
+		std::unique_ptr<JobSlot[]> pool;
+		uint32_t nextJob = 0;
+		uint32_t random = 0;
+		std::atomic<uint64_t> jobs{ 0 };
+		std::atomic<uint64_t> steals{ 0 };
+		std::atomic<uint64_t> inlineJobs{ 0 };
+		std::atomic<uint64_t> sleeps{ 0 };
+	};
+
+	// One ParallelFor() call
+	struct Range
+	{
+		const void* job;
+		JobFunction invoke;
+		size_t count;
+		size_t chunkSize;		// Or the smallest range, adaptively
+		JobCounter* counter;
+	};
+
+	std::vector<std::thread> workers;
+	unsigned int threadCount;			// Set before the workers start, which read it
+	unsigned int firstExtraThread;
+	std::atomic<unsigned int> attachedThreads{ 0 };
+	std::unique_ptr<ThreadData[]> threads;
+
+	std::mutex mutex;
+	std::condition_variable wake;		// Sleeping workers wait for jobs
+	std::atomic<bool> quit{ false };
+	std::atomic<int> queuedJobs{ 0 };	// Pushed and not yet taken
+	std::atomic<int> sleepingWorkers{ 0 };
+
+	unsigned int GetThreadIndex() const;
+	JobSlot* AllocateJob();
+	void Submit(JobCounter& counter, JobSlot* job);
+	JobSlot* FindJob(unsigned int index);
+	void Execute(JobSlot* job);
+	void WorkerLoop(unsigned int index);
+
+	void RunChunks(size_t count, size_t chunkSize, const void* job, JobFunction invoke);
+	void SplitChunks(const Range* range, size_t first, size_t last);
+	void RunAdaptive(size_t count, const void* job, JobFunction invoke);
+	void SplitAdaptive(const Range* range, size_t first, size_t last);
+};
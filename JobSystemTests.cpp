@@ -0,0 +1,407 @@
+#include "JobSystemTests.h"
+#include "HeadlessTests.h"
+#include "JobSystem.h"
+#include "AllocationTracker.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+	uint64_t SerialFib(int n)
+	{
+		return n < 2 ? (uint64_t)n : SerialFib(n - 1) + SerialFib(n - 2);
+	}
+
+	// Forks n - 1 and works on n - 2, down to the cutoff
+	uint64_t ParallelFib(JobSystem& jobSystem, int n, int cutoff)
+	{
+		if (n < cutoff)
+			return SerialFib(n);
+
+		uint64_t a = 0;
+		JobCounter counter;
+		jobSystem.Spawn(counter, [&jobSystem, &a, n, cutoff]() { a = ParallelFib(jobSystem, n - 1, cutoff); });
+		uint64_t b = ParallelFib(jobSystem, n - 2, cutoff);
+		jobSystem.Wait(counter);
+		return a + b;
+	}
+
+	// A chain of jobs, each spawning the next once it has run
+	struct JobChain
+	{
+		JobSystem* jobSystem;
+		JobCounter* counter;
+		int length;
+		int links = 0;
+		int outOfOrder = 0;
+	};
+
+	void RunChainLink(JobChain* chain, int link)
+	{
+		if (chain->links != link)
+			chain->outOfOrder++;
+		chain->links++;
+		if (link + 1 < chain->length)
+			chain->jobSystem->Spawn(*chain->counter, [chain, link]() { RunChainLink(chain, link + 1); });
+	}
+
+	// A random tree of jobs - the same tree for the same seed
+	uint32_t TreeChildren(uint32_t seed, int depth)
+	{
+		return depth >= 7 ? 0 : (seed * 2654435761u >> 16) % 4;
+	}
+
+	uint64_t CountTree(uint32_t seed, int depth)
+	{
+		uint64_t nodes = 1;
+		for (uint32_t c = 0; c < TreeChildren(seed, depth); c++)
+			nodes += CountTree(seed * 31 + c + 1, depth + 1);
+		return nodes;
+	}
+
+	struct JobTree
+	{
+		JobSystem* jobSystem;
+		JobCounter* counter;
+		std::atomic<uint64_t> nodes{ 0 };
+	};
+
+	void SpawnTree(JobTree* tree, uint32_t seed, int depth)
+	{
+		tree->nodes.fetch_add(1, std::memory_order_relaxed);
+		for (uint32_t c = 0; c < TreeChildren(seed, depth); c++)
+		{
+			uint32_t child = seed * 31 + c + 1;
+			tree->jobSystem->Spawn(*tree->counter, [tree, child, depth]() { SpawnTree(tree, child, depth + 1); });
+		}
+	}
+}
+
+int RunJobSystemChecks()
+{
+	printf("Job system checks\n");
+	int failures = 0;
+	char detail[256];
+	char name[128];
+
+	const int workerCounts[] = { 0, 1, 3, 7 };
+	for (int workerCount : workerCounts)
+	{
+		JobSystem jobSystem(workerCount);
+		printf("\n  %d worker%s\n", workerCount, workerCount == 1 ? "" : "s");
+
+		// Fixed chunks: every index once, every call one whole chunk
+		{
+			const size_t counts[] = { 1, 7, 1000, 100003 };
+			const size_t chunkSizes[] = { 1, 16, 1000 };
+			size_t wrongVisits = 0;
+			size_t badCalls = 0;
+			for (size_t count : counts)
+			{
+				std::vector<std::atomic<uint32_t>> visits(count);
+				for (size_t chunkSize : chunkSizes)
+				{
+					for (std::atomic<uint32_t>& visit : visits)
+						visit.store(0, std::memory_order_relaxed);
+					std::atomic<size_t> bad{ 0 };
+					jobSystem.ParallelFor(count, chunkSize, [&](size_t begin, size_t end)
+					{
+						bool wholeRange = begin == 0 && end == count;
+						bool oneChunk = begin % chunkSize == 0 && end == (std::min)(begin + chunkSize, count);
+						if (!wholeRange && !oneChunk)
+							bad.fetch_add(1, std::memory_order_relaxed);
+						for (size_t i = begin; i < end; i++)
+							visits[i].fetch_add(1, std::memory_order_relaxed);
+					});
+					for (std::atomic<uint32_t>& visit : visits)
+						wrongVisits += visit.load(std::memory_order_relaxed) != 1;
+					badCalls += bad.load();
+				}
+			}
+			snprintf(detail, sizeof(detail), "%zu indices not run exactly once, %zu calls off a chunk", wrongVisits, badCalls);
+			failures += ReportCheck("chunked ParallelFor covers each chunk once", wrongVisits == 0 && badCalls == 0, detail);
+		}
+
+		// Adaptive ranges: every index once
+		{
+			size_t wrongVisits = 0;
+			size_t calls = 0;
+			const size_t counts[] = { 1, 5, 4096, 1000003 };
+			for (size_t count : counts)
+			{
+				std::vector<std::atomic<uint32_t>> visits(count);
+				std::atomic<size_t> callCount{ 0 };
+				jobSystem.ParallelFor(count, [&](size_t begin, size_t end)
+				{
+					callCount.fetch_add(1, std::memory_order_relaxed);
+					for (size_t i = begin; i < end; i++)
+						visits[i].fetch_add(1, std::memory_order_relaxed);
+				});
+				for (std::atomic<uint32_t>& visit : visits)
+					wrongVisits += visit.load(std::memory_order_relaxed) != 1;
+				calls += callCount.load();
+			}
+			snprintf(detail, sizeof(detail), "%zu indices not run exactly once, %zu calls", wrongVisits, calls);
+			failures += ReportCheck("adaptive ParallelFor covers each index once", wrongVisits == 0, detail);
+		}
+
+		// ParallelFor inside ParallelFor
+		{
+			std::atomic<uint64_t> sum{ 0 };
+			jobSystem.ParallelFor(200, 10, [&](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; i++)
+				{
+					jobSystem.ParallelFor(64, 1, [&](size_t innerBegin, size_t innerEnd)
+					{
+						for (size_t j = innerBegin; j < innerEnd; j++)
+							sum.fetch_add(i * 64 + j, std::memory_order_relaxed);
+					});
+				}
+			});
+			uint64_t expected = 200ull * 64 * (200 * 64 - 1) / 2;
+			snprintf(detail, sizeof(detail), "sum %llu, expected %llu", (unsigned long long)sum.load(), (unsigned long long)expected);
+			failures += ReportCheck("nested ParallelFor", sum.load() == expected, detail);
+		}
+
+		// Fork-join recursion
+		{
+			uint64_t fib = ParallelFib(jobSystem, 24, 8);
+			snprintf(detail, sizeof(detail), "fib(24) = %llu", (unsigned long long)fib);
+			failures += ReportCheck("recursive spawn and wait", fib == SerialFib(24), detail);
+		}
+
+		// Random trees of jobs spawning jobs, all against one counter
+		{
+			uint64_t wrongTrees = 0;
+			uint64_t nodes = 0;
+			for (uint32_t round = 0; round < 200; round++)
+			{
+				JobCounter counter;
+				JobTree tree;
+				tree.jobSystem = &jobSystem;
+				tree.counter = &counter;
+				uint32_t seed = round * 7919 + 1;
+				jobSystem.Spawn(counter, [&tree, seed]() { SpawnTree(&tree, seed, 0); });
+				jobSystem.Wait(counter);
+				uint64_t expected = CountTree(seed, 0);
+				wrongTrees += tree.nodes.load() != expected;
+				nodes += expected;
+			}
+			snprintf(detail, sizeof(detail), "%llu of 200 trees wrong, %llu jobs", (unsigned long long)wrongTrees, (unsigned long long)nodes);
+			failures += ReportCheck("one counter joins jobs spawned by jobs", wrongTrees == 0, detail);
+		}
+
+		// Dependent chains, several at once
+		{
+			const int chainCount = 16;
+			JobCounter counter;
+			std::vector<JobChain> chains(chainCount, JobChain{ &jobSystem, &counter, 500 });
+			for (JobChain& chain : chains)
+			{
+				JobChain* link = &chain;
+				jobSystem.Spawn(counter, [link]() { RunChainLink(link, 0); });
+			}
+			jobSystem.Wait(counter);
+			int wrong = 0;
+			for (const JobChain& chain : chains)
+				wrong += chain.links != chain.length || chain.outOfOrder != 0;
+			snprintf(detail, sizeof(detail), "%d of %d chains wrong", wrong, chainCount);
+			failures += ReportCheck("chains run their links in order", wrong == 0, detail);
+		}
+
+		// More jobs than a thread's deque and pool hold
+		{
+			jobSystem.ResetStats();
+			std::atomic<int> ran{ 0 };
+			JobCounter counter;
+			for (int i = 0; i < 20000; i++)
+				jobSystem.Spawn(counter, [&ran]() { ran.fetch_add(1, std::memory_order_relaxed); });
+			jobSystem.Wait(counter);
+			JobSystemStats stats = jobSystem.GetStats();
+			snprintf(detail, sizeof(detail), "%d of 20000 ran, %llu inline, %llu stolen",
+				ran.load(), (unsigned long long)stats.inlineJobs, (unsigned long long)stats.steals);
+			failures += ReportCheck("a flood of jobs overflows into running inline", ran.load() == 20000, detail);
+		}
+
+		// Once warm, spawning and ParallelFor() stay off the heap
+		{
+			std::vector<float> values(100000, 1.0f);
+			auto work = [&]()
+			{
+				jobSystem.ParallelFor(values.size(), 1000, [&](size_t begin, size_t end)
+				{
+					for (size_t i = begin; i < end; i++)
+						values[i] = values[i] * 0.5f + 1.0f;
+				});
+				jobSystem.ParallelFor(values.size(), [&](size_t begin, size_t end)
+				{
+					for (size_t i = begin; i < end; i++)
+						values[i] = values[i] * 0.5f + 1.0f;
+				});
+				ParallelFib(jobSystem, 18, 6);
+			};
+			work();
+			AllocationTracker::SetSteadyState(true);
+			work();
+			uint64_t allocations = AllocationTracker::GetSteadyStateAllocations();
+			AllocationTracker::SetSteadyState(false);
+			snprintf(detail, sizeof(detail), "%llu heap allocations", (unsigned long long)allocations);
+			failures += ReportCheck("jobs never allocate", allocations == 0, detail);
+		}
+	}
+
+	// Systems coming and going, with work in flight right up to the end
+	{
+		printf("\n");
+		size_t wrong = 0;
+		for (int i = 0; i < 50; i++)
+		{
+			JobSystem jobSystem(3);
+			std::atomic<int> ran{ 0 };
+			jobSystem.ParallelFor(100, 1, [&](size_t begin, size_t end)
+			{
+				ran.fetch_add((int)(end - begin), std::memory_order_relaxed);
+			});
+			wrong += ran.load() != 100;
+		}
+		snprintf(name, sizeof(name), "systems start and stop cleanly");
+		snprintf(detail, sizeof(detail), "%zu of 50 wrong", wrong);
+		failures += ReportCheck(name, wrong == 0, detail);
+	}
+
+	return ReportFailures(failures);
+}
+
+int RunJobSystemBench(const JobSystemBenchSettings& settings)
+{
+	int hardwareThreads = (int)std::thread::hardware_concurrency();
+	if (hardwareThreads < 1)
+		hardwareThreads = 1;
+
+	std::vector<int> threadCounts;
+	if (settings.scaling)
+	{
+		for (int t = 1; t < hardwareThreads; t *= 2)
+			threadCounts.push_back(t);
+		threadCounts.push_back(hardwareThreads);
+	}
+	else
+	{
+		threadCounts.push_back(settings.threadCount > 0 ? settings.threadCount : hardwareThreads);
+	}
+
+	printf("Job system bench: fib(%d) cut off at %d, %d floats, %d chains of %d jobs\n",
+		settings.fibN, settings.fibCutoff, settings.arraySize, settings.chainCount, settings.chainLength);
+
+	// Serial baselines ---------------------------------------------------------
+	auto t0 = std::chrono::high_resolution_clock::now();
+	uint64_t expectedFib = SerialFib(settings.fibN);
+	double serialFibMs = Milliseconds(std::chrono::high_resolution_clock::now() - t0);
+
+	// Even work - the same per element - and uneven, costlier toward
+	// the end of the array
+	std::vector<float> input(settings.arraySize);
+	std::vector<float> output(settings.arraySize);
+	for (size_t i = 0; i < input.size(); i++)
+		input[i] = (float)(i % 1000) * 0.001f;
+	auto evenWork = [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+			output[i] = sqrtf(input[i]) * 0.5f + input[i];
+	};
+	auto unevenWork = [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			float value = input[i];
+			int steps = (int)(i * 32 / input.size());
+			for (int s = 0; s < steps; s++)
+				value = sqrtf(value + 1.0f);
+			output[i] = value;
+		}
+	};
+
+	// Touched once first, so no run pays for the page faults
+	const int repeats = 5;
+	evenWork(0, input.size());
+	t0 = std::chrono::high_resolution_clock::now();
+	for (int r = 0; r < repeats; r++)
+		evenWork(0, input.size());
+	double serialEvenMs = Milliseconds(std::chrono::high_resolution_clock::now() - t0) / repeats;
+	t0 = std::chrono::high_resolution_clock::now();
+	for (int r = 0; r < repeats; r++)
+		unevenWork(0, input.size());
+	double serialUnevenMs = Milliseconds(std::chrono::high_resolution_clock::now() - t0) / repeats;
+	std::vector<float> expectedUneven = output;
+
+	printf("  serial: fib %.2f ms, even array %.2f ms, uneven array %.2f ms\n\n", serialFibMs, serialEvenMs, serialUnevenMs);
+	printf("  threads   fib (speedup)        even: fixed / adaptive      uneven: fixed / adaptive    chain job    steals\n");
+
+	bool failed = false;
+	for (int threads : threadCounts)
+	{
+		JobSystem jobSystem(threads - 1);
+		jobSystem.ResetStats();
+
+		// Fork-join recursion
+		t0 = std::chrono::high_resolution_clock::now();
+		uint64_t fib = ParallelFib(jobSystem, settings.fibN, settings.fibCutoff);
+		double fibMs = Milliseconds(std::chrono::high_resolution_clock::now() - t0);
+		failed |= fib != expectedFib;
+
+		// Array loops, fixed chunks and adaptive
+		double arrayMs[4] = {};
+		for (int kind = 0; kind < 4; kind++)
+		{
+			t0 = std::chrono::high_resolution_clock::now();
+			for (int r = 0; r < repeats; r++)
+			{
+				switch (kind)
+				{
+				case 0: jobSystem.ParallelFor(input.size(), settings.chunkSize, evenWork); break;
+				case 1: jobSystem.ParallelFor(input.size(), evenWork); break;
+				case 2: jobSystem.ParallelFor(input.size(), settings.chunkSize, unevenWork); break;
+				case 3: jobSystem.ParallelFor(input.size(), unevenWork); break;
+				}
+			}
+			arrayMs[kind] = Milliseconds(std::chrono::high_resolution_clock::now() - t0) / repeats;
+			if (kind >= 2)
+				failed |= output != expectedUneven;
+		}
+
+		// Dependent chains - each job only spawns the next
+		JobCounter counter;
+		std::vector<JobChain> chains(settings.chainCount, JobChain{ &jobSystem, &counter, settings.chainLength });
+		t0 = std::chrono::high_resolution_clock::now();
+		for (JobChain& chain : chains)
+		{
+			JobChain* link = &chain;
+			jobSystem.Spawn(counter, [link]() { RunChainLink(link, 0); });
+		}
+		jobSystem.Wait(counter);
+		double chainMs = Milliseconds(std::chrono::high_resolution_clock::now() - t0);
+		for (const JobChain& chain : chains)
+			failed |= chain.links != chain.length || chain.outOfOrder != 0;
+
+		JobSystemStats stats = jobSystem.GetStats();
+		printf("  %7d   %8.2f ms (%5.2fx)   %7.2f / %7.2f ms (%5.2fx)   %7.2f / %7.2f ms (%5.2fx)   %6.0f ns   %llu of %llu\n",
+			threads,
+			fibMs, serialFibMs / fibMs,
+			arrayMs[0], arrayMs[1], serialEvenMs / (std::min)(arrayMs[0], arrayMs[1]),
+			arrayMs[2], arrayMs[3], serialUnevenMs / (std::min)(arrayMs[2], arrayMs[3]),
+			chainMs * 1e6 / ((double)settings.chainCount * settings.chainLength),
+			(unsigned long long)stats.steals, (unsigned long long)stats.jobs);
+	}
+
+	printf("  results %s\n", failed ? "WRONG" : "match the serial runs");
+	return failed ? 1 : 0;
+}
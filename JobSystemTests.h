@@ -0,0 +1,46 @@
+#pragma once
+
+// --------------------------------------------------------
+// Headless stress test of the job system, for each of 0, 1, 3
+// and 7 workers - more threads than cores on purpose.
+//
+//  - chunked ParallelFor() runs every chunk once, one per call
+//  - adaptive ParallelFor() runs every index once
+//  - ParallelFor() nests
+//  - recursive Spawn() and Wait() give the right answer
+//  - random trees of jobs spawning jobs join on one counter
+//  - chains of jobs, each spawning the next, run in order
+//  - a flood of jobs past the deque and pool sizes all run
+//  - once warm, none of it allocates
+// Then job systems are started and stopped with work in flight.
+//
+// Built for a sanitizer, it's the thread sanitizer's test too.
+//
+// Returns 0 if all checks passed.
+// --------------------------------------------------------
+int RunJobSystemChecks();
+
+// --------------------------------------------------------
+// Headless benchmark of the job system against serial code:
+//  - fork-join Fibonacci, serial below the cutoff
+//  - a loop over an array where every element costs the same,
+//    and one where they cost more toward the end, each with
+//    fixed chunks and adaptive ranges
+//  - chains of jobs that each spawn the next, for the cost of
+//    a dependent job
+//
+// Returns 0 if every result matched the serial run.
+// --------------------------------------------------------
+struct JobSystemBenchSettings
+{
+	int fibN = 32;
+	int fibCutoff = 12;
+	int arraySize = 1 << 24;
+	int chunkSize = 4096;		// For the fixed chunk loops
+	int chainCount = 64;
+	int chainLength = 2000;
+	int threadCount = -1;		// Including the caller, negative = every hardware thread
+	bool scaling = false;		// Run once per thread count instead
+};
+
+int RunJobSystemBench(const JobSystemBenchSettings& settings);
@@ -0,0 +1,355 @@
+#include "LightClusterGrid.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace DirectX;
+
+namespace
+{
+	// Distance from v to the closest point of [minV, maxV]
+	float DistanceToRange(float v, float minV, float maxV)
+	{
+		if (v < minV)
+			return minV - v;
+		if (v > maxV)
+			return v - maxV;
+		return 0.0f;
+	}
+}
+
+LightClusterGrid::LightClusterGrid(IRenderBackend& backend, JobSystem& jobSystem)
+	: backend(backend), jobSystem(jobSystem)
+{
+	sliceLists.resize(Slices);
+	clusterRanges.assign(ClusterCount, ClusterLightRange{ 0, 0 });
+	rangeBuffer = CreateStructuredBuffer(ClusterCount, sizeof(ClusterLightRange));
+}
+
+LightClusterGrid::~LightClusterGrid()
+{
+	if (lightBuffer.IsValid())
+		backend.DestroyBuffer(lightBuffer);
+	if (indexBuffer.IsValid())
+		backend.DestroyBuffer(indexBuffer);
+	if (rangeBuffer.IsValid())
+		backend.DestroyBuffer(rangeBuffer);
+}
+
+void LightClusterGrid::Build(const std::vector<Light>& lights, const XMFLOAT4X4& view, const XMFLOAT4X4& projection)
+{
+	SetupFrame(lights, view, projection);
+
+	// Every slice writes only its own lists, so no locking
+	jobSystem.ParallelFor(Slices, 1, [&](size_t begin, size_t end)
+	{
+		for (size_t slice = begin; slice < end; slice++)
+			BinSlice((unsigned int)slice);
+	});
+
+	Compact();
+}
+
+// --------------------------------------------------------
+// Same output as Build(), without the slice ranges and the
+// row/column search - every light against every cluster box
+// --------------------------------------------------------
+void LightClusterGrid::BuildBruteForce(const std::vector<Light>& lights, const XMFLOAT4X4& view, const XMFLOAT4X4& projection)
+{
+	SetupFrame(lights, view, projection);
+
+	for (unsigned int slice = 0; slice < Slices; slice++)
+	{
+		const SliceBounds& bounds = sliceBounds[slice];
+		for (unsigned int y = 0; y < TilesY; y++)
+		{
+			for (unsigned int x = 0; x < TilesX; x++)
+			{
+				std::vector<uint32_t>& list = sliceLists[slice].clusterLights[x + TilesX * y];
+				list.clear();
+
+				for (const LightSphere& sphere : spheres)
+				{
+					float dx = DistanceToRange(sphere.x, bounds.minX[x], bounds.maxX[x]);
+					float dy = DistanceToRange(sphere.y, bounds.minY[y], bounds.maxY[y]);
+					float dz = DistanceToRange(sphere.z, bounds.minZ, bounds.maxZ);
+					float dxSq = dx * dx;
+					float dySq = dy * dy;
+					float dzSq = dz * dz;
+					if (dxSq + dySq + dzSq <= sphere.radiusSq)
+						list.push_back(sphere.light);
+				}
+			}
+		}
+	}
+
+	Compact();
+}
+
+// --------------------------------------------------------
+// Cluster boxes for this projection, and a view space sphere
+// for every point/spot light
+// --------------------------------------------------------
+void LightClusterGrid::SetupFrame(const std::vector<Light>& lights, const XMFLOAT4X4& view, const XMFLOAT4X4& projection)
+{
+	// Near and far planes back out of a left handed perspective matrix
+	nearZ = -projection._43 / projection._33;
+	farZ = projection._43 / (1.0f - projection._33);
+
+	float xScale = 1.0f / projection._11;
+	float yScale = 1.0f / projection._22;
+	float depthRatio = farZ / nearZ;
+
+	for (unsigned int slice = 0; slice < Slices; slice++)
+	{
+		SliceBounds& bounds = sliceBounds[slice];
+		bounds.minZ = nearZ * powf(depthRatio, (float)slice / Slices);
+		bounds.maxZ = slice + 1 == Slices ? farZ : nearZ * powf(depthRatio, (float)(slice + 1) / Slices);
+
+		// A tile's sides go through the camera, so its widest point
+		// is at whichever end of the slice is further out
+		for (unsigned int x = 0; x < TilesX; x++)
+		{
+			float left = -1.0f + 2.0f * x / TilesX;
+			float right = -1.0f + 2.0f * (x + 1) / TilesX;
+			bounds.minX[x] = (std::min)(left * bounds.minZ, left * bounds.maxZ) * xScale;
+			bounds.maxX[x] = (std::max)(right * bounds.minZ, right * bounds.maxZ) * xScale;
+		}
+
+		// Row 0 is the top of the screen, like SV_Position
+		for (unsigned int y = 0; y < TilesY; y++)
+		{
+			float top = 1.0f - 2.0f * y / TilesY;
+			float bottom = 1.0f - 2.0f * (y + 1) / TilesY;
+			bounds.minY[y] = (std::min)(bottom * bounds.minZ, bottom * bounds.maxZ) * yScale;
+			bounds.maxY[y] = (std::max)(top * bounds.minZ, top * bounds.maxZ) * yScale;
+		}
+	}
+
+	XMMATRIX viewMatrix = XMLoadFloat4x4(&view);
+	spheres.clear();
+	directionalLights.clear();
+
+	for (size_t i = 0; i < lights.size(); i++)
+	{
+		const Light& light = lights[i];
+		if (light.Type == LIGHT_TYPE_DIRECTIONAL)
+		{
+			directionalLights.push_back((uint32_t)i);
+			continue;
+		}
+
+		if (!(light.Range > 0.0f))
+			continue;
+
+		XMVECTOR center = XMVector3TransformCoord(XMLoadFloat3(&light.Position), viewMatrix);
+		float radius = light.Range;
+
+		// Smallest sphere around the cone: for narrow cones it passes
+		// through the apex and the rim, for wide ones the rim is its equator
+		if (light.Type == LIGHT_TYPE_SPOT && light.SpotOuterAngle > 0.0f && light.SpotOuterAngle < XM_PIDIV2)
+		{
+			XMVECTOR direction = XMVector3Normalize(XMVector3TransformNormal(XMLoadFloat3(&light.Direction), viewMatrix));
+			float cosAngle = cosf(light.SpotOuterAngle);
+			float offset;
+			if (light.SpotOuterAngle < XM_PIDIV4)
+			{
+				radius = light.Range / (2.0f * cosAngle);
+				offset = radius;
+			}
+			else
+			{
+				radius = light.Range * sinf(light.SpotOuterAngle);
+				offset = light.Range * cosAngle;
+			}
+			center = XMVectorMultiplyAdd(direction, XMVectorReplicate(offset), center);
+		}
+
+		XMFLOAT3 c;
+		XMStoreFloat3(&c, center);
+
+		// Entirely behind the camera
+		if (c.z + radius < 0.0f)
+			continue;
+
+		// One slice of slack either way - the exact test is done
+		// against the boxes, this only has to not miss any
+		LightSphere sphere;
+		sphere.x = c.x;
+		sphere.y = c.y;
+		sphere.z = c.z;
+		sphere.radiusSq = radius * radius;
+		sphere.light = (uint32_t)i;
+		unsigned int first = GetSlice(c.z - radius);
+		unsigned int last = GetSlice(c.z + radius);
+		sphere.firstSlice = first > 0 ? first - 1 : 0;
+		sphere.lastSlice = (std::min)(last + 1, Slices - 1);
+		spheres.push_back(sphere);
+	}
+
+	stats.lights = lights.size();
+	stats.directionalLights = directionalLights.size();
+	stats.localLights = spheres.size();
+	stats.threads = jobSystem.GetThreadCount();
+}
+
+// --------------------------------------------------------
+// Adds each sphere to the clusters of one slice it touches.
+// The columns (and rows) it can reach are found first from
+// the x (y) and z distances alone, then each cluster in that
+// rectangle gets the full sphere-box test.
+// --------------------------------------------------------
+void LightClusterGrid::BinSlice(unsigned int slice)
+{
+	const SliceBounds& bounds = sliceBounds[slice];
+	SliceLists& lists = sliceLists[slice];
+	for (std::vector<uint32_t>& list : lists.clusterLights)
+		list.clear();
+
+	float dxSq[TilesX];
+	for (const LightSphere& sphere : spheres)
+	{
+		if (slice < sphere.firstSlice || slice > sphere.lastSlice)
+			continue;
+
+		float dz = DistanceToRange(sphere.z, bounds.minZ, bounds.maxZ);
+		float dzSq = dz * dz;
+		if (dzSq > sphere.radiusSq)
+			continue;
+
+		unsigned int firstX = TilesX;
+		unsigned int lastX = 0;
+		for (unsigned int x = 0; x < TilesX; x++)
+		{
+			float dx = DistanceToRange(sphere.x, bounds.minX[x], bounds.maxX[x]);
+			dxSq[x] = dx * dx;
+			if (dxSq[x] + dzSq <= sphere.radiusSq)
+			{
+				firstX = (std::min)(firstX, x);
+				lastX = x;
+			}
+		}
+
+		if (firstX > lastX)
+			continue;
+
+		for (unsigned int y = 0; y < TilesY; y++)
+		{
+			float dy = DistanceToRange(sphere.y, bounds.minY[y], bounds.maxY[y]);
+			float dySq = dy * dy;
+			if (dySq + dzSq > sphere.radiusSq)
+				continue;
+
+			for (unsigned int x = firstX; x <= lastX; x++)
+			{
+				if (dxSq[x] + dySq + dzSq <= sphere.radiusSq)
+					lists.clusterLights[x + TilesX * y].push_back(sphere.light);
+			}
+		}
+	}
+}
+
+// --------------------------------------------------------
+// Directional lights, then every cluster's list in cluster
+// index order
+// --------------------------------------------------------
+void LightClusterGrid::Compact()
+{
+	lightIndices.assign(directionalLights.begin(), directionalLights.end());
+	stats.activeClusters = 0;
+	stats.maxLightsPerCluster = 0;
+
+	for (unsigned int slice = 0; slice < Slices; slice++)
+	{
+		for (unsigned int tile = 0; tile < TilesX * TilesY; tile++)
+		{
+			const std::vector<uint32_t>& list = sliceLists[slice].clusterLights[tile];
+			ClusterLightRange& range = clusterRanges[tile + TilesX * TilesY * slice];
+			range.offset = (uint32_t)lightIndices.size();
+			range.count = (uint32_t)list.size();
+			lightIndices.insert(lightIndices.end(), list.begin(), list.end());
+
+			if (!list.empty())
+				stats.activeClusters++;
+			stats.maxLightsPerCluster = (std::max)(stats.maxLightsPerCluster, list.size());
+		}
+	}
+
+	stats.indices = lightIndices.size();
+}
+
+unsigned int LightClusterGrid::GetSlice(float viewZ) const
+{
+	if (!(viewZ > nearZ))
+		return 0;
+
+	float slice = floorf(logf(viewZ / nearZ) * Slices / logf(farZ / nearZ));
+	return slice < (float)Slices ? (unsigned int)slice : Slices - 1;
+}
+
+void LightClusterGrid::Upload(const std::vector<Light>& lights)
+{
+	// Grown by doubling, never empty so there's always something to bind
+	if (lights.size() > lightCapacity || !lightBuffer.IsValid())
+	{
+		if (lightBuffer.IsValid())
+			backend.DestroyBuffer(lightBuffer);
+		lightCapacity = (std::max)((std::max)(lights.size(), lightCapacity * 2), (size_t)64);
+		lightBuffer = CreateStructuredBuffer(lightCapacity, sizeof(Light));
+	}
+
+	if (lightIndices.size() > indexCapacity || !indexBuffer.IsValid())
+	{
+		if (indexBuffer.IsValid())
+			backend.DestroyBuffer(indexBuffer);
+		indexCapacity = (std::max)((std::max)(lightIndices.size(), indexCapacity * 2), (size_t)1024);
+		indexBuffer = CreateStructuredBuffer(indexCapacity, sizeof(uint32_t));
+	}
+
+	Write(lightBuffer, lights.data(), lights.size() * sizeof(Light));
+	Write(indexBuffer, lightIndices.data(), lightIndices.size() * sizeof(uint32_t));
+	Write(rangeBuffer, clusterRanges.data(), clusterRanges.size() * sizeof(ClusterLightRange));
+}
+
+void LightClusterGrid::Bind(IRenderBackend& context, ShaderStage stage, unsigned int firstSlot) const
+{
+	context.SetShaderBuffer(stage, firstSlot, lightBuffer);
+	context.SetShaderBuffer(stage, firstSlot + 1, indexBuffer);
+	context.SetShaderBuffer(stage, firstSlot + 2, rangeBuffer);
+}
+
+LightClusterShaderData LightClusterGrid::GetShaderData(float screenWidth, float screenHeight) const
+{
+	float logDepthRatio = logf(farZ / nearZ);
+
+	LightClusterShaderData data = {};
+	data.clusterCountX = TilesX;
+	data.clusterCountY = TilesY;
+	data.clusterCountZ = Slices;
+	data.directionalLightCount = (unsigned int)directionalLights.size();
+	data.tileScale = XMFLOAT2(TilesX / screenWidth, TilesY / screenHeight);
+	data.depthScale = Slices / logDepthRatio;
+	data.depthBias = -(float)Slices * logf(nearZ) / logDepthRatio;
+	return data;
+}
+
+BufferHandle LightClusterGrid::CreateStructuredBuffer(size_t elements, unsigned int stride)
+{
+	BufferDesc desc;
+	desc.type = BufferType::Structured;
+	desc.usage = BufferUsage::Dynamic;
+	desc.size = elements * stride;
+	desc.stride = stride;
+	return backend.CreateBuffer(desc);
+}
+
+void LightClusterGrid::Write(BufferHandle buffer, const void* data, size_t size)
+{
+	void* mapped = backend.Map(buffer, MapMode::WriteDiscard);
+	if (!mapped)
+		return;
+
+	if (size > 0)
+		memcpy(mapped, data, size);
+	backend.Unmap(buffer);
+}
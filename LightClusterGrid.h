@@ -0,0 +1,147 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <DirectXMath.h>
+#include "RenderBackend.h"
+#include "JobSystem.h"
+#include "Lights.h"
+#include "BufferStructs.h"
+
+// --------------------------------------------------------
+// Where a cluster's lights are in the index list
+// --------------------------------------------------------
+struct ClusterLightRange
+{
+	uint32_t offset;
+	uint32_t count;
+};
+
+// --------------------------------------------------------
+// Counts from the last Build()
+// --------------------------------------------------------
+struct LightClusterStats
+{
+	size_t lights = 0;
+	size_t directionalLights = 0;
+	size_t localLights = 0;			// Point and spot lights that were binned
+	size_t indices = 0;				// Total length of the index list
+	size_t activeClusters = 0;		// Clusters with at least one light
+	size_t maxLightsPerCluster = 0;
+	unsigned int threads = 0;
+};
+
+// --------------------------------------------------------
+// Clustered light assignment.
+//
+// The view frustum is split into TilesX x TilesY screen tiles
+// and Slices depth slices (exponentially spaced between the
+// near and far planes, so clusters stay roughly cube shaped).
+// Every point and spot light is bounded by a view space sphere
+// and added to each cluster whose view space box it touches.
+// The pixel shader finds its cluster from SV_Position and only
+// walks that cluster's lights.
+//
+// Output (also uploaded to structured buffers):
+//  - a light index list: the directional lights first (they
+//    apply everywhere), then each cluster's lights back to back
+//  - one ClusterLightRange per cluster into that list
+//
+// Build() bins one depth slice per job on the job system.
+// BuildBruteForce() tests every light against every cluster
+// instead - it's only there to check Build() against.
+//
+// Assumes a symmetric perspective projection, which is what
+// Camera makes.
+// --------------------------------------------------------
+class LightClusterGrid
+{
+public:
+	static const unsigned int TilesX = 16;
+	static const unsigned int TilesY = 9;
+	static const unsigned int Slices = 24;
+	static const unsigned int ClusterCount = TilesX * TilesY * Slices;
+
+	// Light, index and range buffers take this many texture slots
+	static const unsigned int ShaderBufferCount = 3;
+
+	LightClusterGrid(IRenderBackend& backend, JobSystem& jobSystem);
+	~LightClusterGrid();
+
+	LightClusterGrid(const LightClusterGrid&) = delete;
+	LightClusterGrid& operator=(const LightClusterGrid&) = delete;
+
+	void Build(const std::vector<Light>& lights, const DirectX::XMFLOAT4X4& view, const DirectX::XMFLOAT4X4& projection);
+	void BuildBruteForce(const std::vector<Light>& lights, const DirectX::XMFLOAT4X4& view, const DirectX::XMFLOAT4X4& projection);
+
+	// Writes the lights and the last Build()'s lists to the GPU -
+	// immediate context only, since it maps buffers
+	void Upload(const std::vector<Light>& lights);
+
+	// Lights, indices, ranges in firstSlot, +1, +2
+	void Bind(IRenderBackend& context, ShaderStage stage, unsigned int firstSlot) const;
+
+	// Constants the shader needs to find its cluster
+	LightClusterShaderData GetShaderData(float screenWidth, float screenHeight) const;
+
+	static unsigned int GetClusterIndex(unsigned int x, unsigned int y, unsigned int slice) { return x + TilesX * (y + TilesY * slice); }
+
+	const std::vector<ClusterLightRange>& GetClusterRanges() const { return clusterRanges; }
+	const std::vector<uint32_t>& GetLightIndices() const { return lightIndices; }
+	const LightClusterStats& GetStats() const { return stats; }
+
+private:
+	// View space bounding sphere of a point or spot light
+	struct LightSphere
+	{
+		float x, y, z;
+		float radiusSq;
+		uint32_t light;
+		unsigned int firstSlice;
+		unsigned int lastSlice;
+	};
+
+	// A cluster's box is separable: x only depends on the column and
+	// slice, y on the row and slice, z on the slice
+	struct SliceBounds
+	{
+		float minZ, maxZ;
+		float minX[TilesX], maxX[TilesX];
+		float minY[TilesY], maxY[TilesY];
+	};
+
+	// Per-slice output of the binning jobs, reused between frames
+	struct SliceLists
+	{
+		std::vector<uint32_t> clusterLights[TilesX * TilesY];
+	};
+
+	IRenderBackend& backend;
+	JobSystem& jobSystem;
+
+	float nearZ = 0.01f;
+	float farZ = 100.0f;
+	SliceBounds sliceBounds[Slices];
+
+	std::vector<LightSphere> spheres;
+	std::vector<uint32_t> directionalLights;
+	std::vector<SliceLists> sliceLists;
+
+	std::vector<ClusterLightRange> clusterRanges;
+	std::vector<uint32_t> lightIndices;
+	LightClusterStats stats;
+
+	BufferHandle lightBuffer;
+	BufferHandle indexBuffer;
+	BufferHandle rangeBuffer;
+	size_t lightCapacity = 0;
+	size_t indexCapacity = 0;
+
+	void SetupFrame(const std::vector<Light>& lights, const DirectX::XMFLOAT4X4& view, const DirectX::XMFLOAT4X4& projection);
+	void BinSlice(unsigned int slice);
+	void Compact();
+	unsigned int GetSlice(float viewZ) const;
+
+	BufferHandle CreateStructuredBuffer(size_t elements, unsigned int stride);
+	void Write(BufferHandle buffer, const void* data, size_t size);
+};
@@ -0,0 +1,139 @@
+#include "LightClusterGridTests.h"
+#include "HeadlessTests.h"
+#include "RecordingBackend.h"
+#include "JobSystem.h"
+#include "LightClusterGrid.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace DirectX;
+
+int RunLightClusterBench(const LightClusterBenchSettings& settings)
+{
+	RecordingBackend backend;
+	bool failed = false;
+
+	{
+		int threads = settings.threadCount > 0 ? settings.threadCount : (int)std::thread::hardware_concurrency();
+		JobSystem jobSystem((std::max)(threads, 1) - 1);
+		LightClusterGrid grid(backend, jobSystem);
+		LightClusterGrid reference(backend, jobSystem);
+
+		// One sun, then point and spot lights scattered through a box in
+		// front of the camera - some of them fall outside the frustum
+		std::mt19937 rng(1);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+		std::vector<Light> lights(1);
+		lights[0].Type = LIGHT_TYPE_DIRECTIONAL;
+		lights[0].Direction = XMFLOAT3(0.577f, -0.577f, 0.577f);
+		lights[0].Color = XMFLOAT3(1, 1, 1);
+		lights[0].Intensity = 1.0f;
+
+		for (int i = 0; i < settings.lightCount; i++)
+		{
+			Light light = {};
+			light.Type = unit(rng) < 0.75f ? LIGHT_TYPE_POINT : LIGHT_TYPE_SPOT;
+			light.Position = XMFLOAT3(unit(rng) * 200.0f - 100.0f, unit(rng) * 20.0f, unit(rng) * 200.0f - 20.0f);
+			light.Range = 2.0f + unit(rng) * 8.0f;
+			light.Color = XMFLOAT3(unit(rng), unit(rng), unit(rng));
+			light.Intensity = 1.0f;
+			if (light.Type == LIGHT_TYPE_SPOT)
+			{
+				XMVECTOR direction = XMVector3Normalize(XMVectorSet(unit(rng) - 0.5f, unit(rng) - 0.5f, unit(rng) - 0.5f, 0));
+				XMStoreFloat3(&light.Direction, direction);
+				light.SpotOuterAngle = XMConvertToRadians(10.0f + unit(rng) * 60.0f);
+				light.SpotInnerAngle = light.SpotOuterAngle * 0.5f;
+			}
+			lights.push_back(light);
+		}
+
+		XMFLOAT4X4 projection;
+		XMStoreFloat4x4(&projection, XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.1f, 200.0f));
+
+		printf("Light cluster bench: %d lights, %u x %u x %u clusters, %d frames, %u threads\n",
+			settings.lightCount,
+			LightClusterGrid::TilesX, LightClusterGrid::TilesY, LightClusterGrid::Slices,
+			settings.frames,
+			jobSystem.GetThreadCount());
+
+		double buildMs = 0.0;
+		double uploadMs = 0.0;
+		double bruteForceMs = 0.0;
+		int checkedFrames = 0;
+		size_t mismatchedClusters = 0;
+
+		for (int f = 0; f < settings.frames; f++)
+		{
+			// Camera turns a little every frame so the binning changes
+			XMFLOAT4X4 view;
+			float yaw = f * 0.01f;
+			XMStoreFloat4x4(&view, XMMatrixLookToLH(
+				XMVectorSet(0, 10, -30, 1),
+				XMVectorSet(sinf(yaw), -0.2f, cosf(yaw), 0),
+				XMVectorSet(0, 1, 0, 0)));
+
+			auto t0 = std::chrono::high_resolution_clock::now();
+			grid.Build(lights, view, projection);
+			auto t1 = std::chrono::high_resolution_clock::now();
+			grid.Upload(lights);
+			auto t2 = std::chrono::high_resolution_clock::now();
+
+			buildMs += Milliseconds(t1 - t0);
+			uploadMs += Milliseconds(t2 - t1);
+
+			// Brute force is slow, check every tenth frame
+			if (!settings.validate || f % 10 != 0)
+				continue;
+
+			auto t3 = std::chrono::high_resolution_clock::now();
+			reference.BuildBruteForce(lights, view, projection);
+			bruteForceMs += Milliseconds(std::chrono::high_resolution_clock::now() - t3);
+			checkedFrames++;
+
+			const std::vector<ClusterLightRange>& ranges = grid.GetClusterRanges();
+			const std::vector<ClusterLightRange>& expectedRanges = reference.GetClusterRanges();
+			const std::vector<uint32_t>& indices = grid.GetLightIndices();
+			const std::vector<uint32_t>& expectedIndices = reference.GetLightIndices();
+			for (unsigned int c = 0; c < LightClusterGrid::ClusterCount; c++)
+			{
+				if (ranges[c].count != expectedRanges[c].count ||
+					!std::equal(
+						indices.begin() + ranges[c].offset,
+						indices.begin() + ranges[c].offset + ranges[c].count,
+						expectedIndices.begin() + expectedRanges[c].offset))
+					mismatchedClusters++;
+			}
+		}
+
+		int count = settings.frames > 0 ? settings.frames : 1;
+		const LightClusterStats& stats = grid.GetStats();
+		printf("  build %.3f ms, upload %.3f ms\n", buildMs / count, uploadMs / count);
+		printf("  %zu lights binned, %zu indices, %zu / %u clusters lit, max %zu per cluster\n",
+			stats.localLights,
+			stats.indices,
+			stats.activeClusters,
+			LightClusterGrid::ClusterCount,
+			stats.maxLightsPerCluster);
+
+		if (settings.validate)
+		{
+			printf("  brute force %.3f ms, %d frames checked, %zu clusters differ\n",
+				checkedFrames > 0 ? bruteForceMs / checkedFrames : 0.0,
+				checkedFrames,
+				mismatchedClusters);
+			if (mismatchedClusters > 0)
+				failed = true;
+		}
+	}
+
+	if (ReportValidation(backend) > 0)
+		failed = true;
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+// --------------------------------------------------------
+// Headless CPU benchmark of clustered light binning.
+//
+// Scatters point and spot lights in front of a slowly turning
+// camera and times LightClusterGrid::Build() and Upload() each
+// frame.  With validation on, every tenth frame is also binned
+// by brute force and each cluster's list compared.
+//
+// Returns 0 if every compared cluster matched and the recording
+// backend saw no errors.
+// --------------------------------------------------------
+struct LightClusterBenchSettings
+{
+	int lightCount = 10000;
+	int frames = 100;
+	int threadCount = -1;	// Including the caller, negative = every hardware thread
+	bool validate = true;	// Compare against brute force binning
+};
+
+int RunLightClusterBench(const LightClusterBenchSettings& settings);
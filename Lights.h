@@ -5,6 +5,12 @@
 #define LIGHT_TYPE_POINT 1
 #define LIGHT_TYPE_SPOT 2
 
+// Light::ShadowIndex - which shadow map, if any, the light uses.
+// Anything above zero is the light's first shadow atlas tile + 1
+// (zero-initialized lights have no shadow).
+#define LIGHT_SHADOW_NONE 0
+#define LIGHT_SHADOW_CASCADES -1
+
 struct Light
 {
     int Type;
@@ -15,6 +21,7 @@ struct Light
     DirectX::XMFLOAT3 Color;
     float SpotInnerAngle;
     float SpotOuterAngle;
-    DirectX::XMFLOAT2 Padding;
+    int ShadowIndex; // LIGHT_SHADOW_*, set each frame by ShadowAtlas::Update()
+    float Padding;
     int CastsShadows;
 };
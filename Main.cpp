@@ -6,6 +6,7 @@
 #include "Graphics.h"
 #include "Game.h"
 #include "Input.h"
+#include "HeadlessModes.h"
 
 // Annonymous namespace to hold variables
 // only accessible in this file
@@ -14,6 +15,15 @@ namespace
 	// The "game" object that drives the application
 	Game* game = 0;
 
+	// Called before the window's size
+	// and swap chain change, so the
+	// game's render thread can finish
+	void WindowBeforeResizeCallback()
+	{
+		if(game)
+			game->OnBeforeResize();
+	}
+
 	// A simple function to hook up 
 	// to the window for resize
 	// notifications
@@ -48,6 +58,21 @@ int WINAPI WinMain(
 	printf("Console window created successfully.  Feel free to printf() here.\n");
 #endif
 
+	// Headless checks and benchmarks - no window or GPU
+	//  - Run with a mode's flag, e.g. "--bench" or "--jobtest", see
+	//    HeadlessModes.h for the list and the options they share
+	if (HasHeadlessMode(__argc, __argv))
+	{
+		Window::CreateConsoleWindow(500, 140, 32, 140);
+
+		int result = RunHeadlessMode(__argc, __argv);
+
+		// The console goes away with the process
+		printf("Press Enter to exit\n");
+		getchar();
+		return result;
+	}
+
 	// Set up app initialization details
 	unsigned int windowWidth = 1280;
 	unsigned int windowHeight = 720;
@@ -62,6 +87,7 @@ int WINAPI WinMain(
 		windowHeight,
 		windowTitle,
 		statsInTitleBar,
+		WindowBeforeResizeCallback,
 		WindowResizeCallback);
 	if (FAILED(windowResult))
 		return windowResult;
@@ -123,9 +149,9 @@ int WINAPI WinMain(
 			// Input updating
 			Input::Update();
 
-			// Update and draw
+			// Update - the game's render thread draws
+			// each frame once Update() hands it over
 			game->Update(deltaTime, totalTime);
-			game->Draw(deltaTime, totalTime);
 
 			// Notify Input system about end of frame
 			Input::EndOfFrame();
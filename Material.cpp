@@ -2,41 +2,45 @@
 
 Material::Material(
     DirectX::XMFLOAT4 colorTint,
-    Microsoft::WRL::ComPtr<ID3D11VertexShader> vertexShader,
-    Microsoft::WRL::ComPtr<ID3D11PixelShader> pixelShader)
+    ShaderHandle vertexShader,
+    ShaderHandle pixelShader)
     : colorTint(colorTint),
     vertexShader(vertexShader),
     pixelShader(pixelShader)
 {
+    // materials are only created on the main thread
+    static unsigned int nextSortId = 0;
+    sortId = nextSortId++;
 }
 
 DirectX::XMFLOAT4 Material::GetColorTint() const { return colorTint; }
-Microsoft::WRL::ComPtr<ID3D11VertexShader> Material::GetVertexShader() const { return vertexShader; }
-Microsoft::WRL::ComPtr<ID3D11PixelShader> Material::GetPixelShader() const { return pixelShader; }
+ShaderHandle Material::GetVertexShader() const { return vertexShader; }
+ShaderHandle Material::GetPixelShader() const { return pixelShader; }
+unsigned int Material::GetSortId() const { return sortId; }
 
 void Material::SetColorTint(DirectX::XMFLOAT4 tint) { colorTint = tint; }
-void Material::SetVertexShader(Microsoft::WRL::ComPtr<ID3D11VertexShader> vs) { vertexShader = vs; }
-void Material::SetPixelShader(Microsoft::WRL::ComPtr<ID3D11PixelShader> ps) { pixelShader = ps; }
+void Material::SetVertexShader(ShaderHandle vs) { vertexShader = vs; }
+void Material::SetPixelShader(ShaderHandle ps) { pixelShader = ps; }
 
 DirectX::XMFLOAT2 Material::GetUVScale()  const { return uvScale; }
 DirectX::XMFLOAT2 Material::GetUVOffset() const { return uvOffset; }
 void Material::SetUVScale(DirectX::XMFLOAT2 scale) { uvScale = scale; }
 void Material::SetUVOffset(DirectX::XMFLOAT2 offset) { uvOffset = offset; }
 
-void Material::AddTextureSRV(unsigned int slot, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv)
+void Material::AddTexture(unsigned int slot, TextureHandle texture)
 {
-    textureSRVs[slot] = srv;
+    textures[slot] = texture;
 }
 
-void Material::AddSampler(unsigned int slot, Microsoft::WRL::ComPtr<ID3D11SamplerState> sampler)
+void Material::AddSampler(unsigned int slot, SamplerHandle sampler)
 {
     samplers[slot] = sampler;
 }
 
-void Material::BindTexturesAndSamplers(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+void Material::BindTexturesAndSamplers(IRenderBackend& backend)
 {
-    for (auto& t : textureSRVs)
-        Graphics::Context->PSSetShaderResources(t.first, 1, t.second.GetAddressOf());
+    for (auto& t : textures)
+        backend.SetTexture(ShaderStage::Pixel, t.first, t.second);
     for (auto& s : samplers)
-        Graphics::Context->PSSetSamplers(s.first, 1, s.second.GetAddressOf());
-}
\ No newline at end of file
+        backend.SetSampler(ShaderStage::Pixel, s.first, s.second);
+}
@@ -1,47 +1,49 @@
 #pragma once
 #pragma once
-#include <d3d11.h>
-#include <wrl/client.h>
 #include <DirectXMath.h>
 #include <unordered_map>
-#include "Graphics.h"
+#include "RenderBackend.h"
 
 class Material
 {
 public:
     Material(
         DirectX::XMFLOAT4 colorTint,
-        Microsoft::WRL::ComPtr<ID3D11VertexShader> vertexShader,
-        Microsoft::WRL::ComPtr<ID3D11PixelShader> pixelShader
+        ShaderHandle vertexShader,
+        ShaderHandle pixelShader
     );
 
     // Getters
     DirectX::XMFLOAT4 GetColorTint() const;
-    Microsoft::WRL::ComPtr<ID3D11VertexShader> GetVertexShader() const;
-    Microsoft::WRL::ComPtr<ID3D11PixelShader> GetPixelShader() const;
+    ShaderHandle GetVertexShader() const;
+    ShaderHandle GetPixelShader() const;
     DirectX::XMFLOAT2 GetUVScale() const;
     DirectX::XMFLOAT2 GetUVOffset() const;
+    unsigned int GetSortId() const;
 
     // Setters
     void SetColorTint(DirectX::XMFLOAT4 tint);
-    void SetVertexShader(Microsoft::WRL::ComPtr<ID3D11VertexShader> vs);
-    void SetPixelShader(Microsoft::WRL::ComPtr<ID3D11PixelShader> ps);
+    void SetVertexShader(ShaderHandle vs);
+    void SetPixelShader(ShaderHandle ps);
     void SetUVScale(DirectX::XMFLOAT2 scale);
     void SetUVOffset(DirectX::XMFLOAT2 offset);
 
     // Texture/Sampler methods                
-    void AddTextureSRV(unsigned int slot, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv);
-    void AddSampler(unsigned int slot, Microsoft::WRL::ComPtr<ID3D11SamplerState> sampler);
-    void BindTexturesAndSamplers(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
+    void AddTexture(unsigned int slot, TextureHandle texture);
+    void AddSampler(unsigned int slot, SamplerHandle sampler);
+    void BindTexturesAndSamplers(IRenderBackend& backend);
 
 private:
     DirectX::XMFLOAT4 colorTint;
-    Microsoft::WRL::ComPtr<ID3D11VertexShader> vertexShader;
-    Microsoft::WRL::ComPtr<ID3D11PixelShader> pixelShader;
+    ShaderHandle vertexShader;
+    ShaderHandle pixelShader;
+
+    // small id for draw sort keys, assigned at creation
+    unsigned int sortId;
 
     DirectX::XMFLOAT2 uvScale = { 1.0f, 1.0f };
     DirectX::XMFLOAT2 uvOffset = { 0.0f, 0.0f };
-    std::unordered_map<unsigned int, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>> textureSRVs;
-    std::unordered_map<unsigned int, Microsoft::WRL::ComPtr<ID3D11SamplerState>> samplers;
+    std::unordered_map<unsigned int, TextureHandle> textures;
+    std::unordered_map<unsigned int, SamplerHandle> samplers;
 };
 
@@ -1,4 +1,6 @@
 #include "Mesh.h"
+#include <algorithm>
+#include <filesystem>
 #include <fstream>
 #include <vector>
 #include "PathHelpers.h"
@@ -6,6 +8,12 @@
 #include <stdexcept>
 #include <DirectXMath.h>
 
+// sscanf_s is MSVC's own - none of the formats below read strings,
+// so elsewhere plain sscanf takes the same arguments
+#ifndef _WIN32
+#define sscanf_s sscanf
+#endif
+
 
 using namespace DirectX;
 
@@ -104,40 +112,18 @@ Mesh::Mesh(
 	int vertexCount,
 	unsigned int* indices,
 	int indexCount,
-	Microsoft::WRL::ComPtr<ID3D11Device> device)
-	:vertexCount(vertexCount), indexCount(indexCount)
+	IRenderBackend& backend,
+	BufferUsage vertexUsage,
+	MeshCpuGeometry cpuGeometry)
+	: backend(&backend), vertexUsage(vertexUsage),
+	cpuGeometry(vertexUsage == BufferUsage::Dynamic ? MeshCpuGeometry::Discard : cpuGeometry),
+	indexCount(indexCount), vertexCount(vertexCount)
 {
-	// create the vertex buffer
-	D3D11_BUFFER_DESC vbd = {};
-	vbd.Usage = D3D11_USAGE_IMMUTABLE;
-	vbd.ByteWidth = sizeof(Vertex) * vertexCount;
-	vbd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-	vbd.CPUAccessFlags = 0;
-	vbd.MiscFlags = 0;
-	vbd.StructureByteStride = 0;
-
-	D3D11_SUBRESOURCE_DATA initialVertexData = {};
-	initialVertexData.pSysMem = vertices;
-
-	device->CreateBuffer(&vbd, &initialVertexData, vertexBuffer.GetAddressOf());
-
-	// create the index buffer
-	D3D11_BUFFER_DESC ibd = {};
-	ibd.Usage = D3D11_USAGE_IMMUTABLE;
-	ibd.ByteWidth = sizeof(unsigned int) * indexCount;
-	ibd.BindFlags = D3D11_BIND_INDEX_BUFFER;
-	ibd.CPUAccessFlags = 0;
-	ibd.MiscFlags = 0;
-	ibd.StructureByteStride = 0;
-
-	D3D11_SUBRESOURCE_DATA initialIndexData = {};
-	initialIndexData.pSysMem = indices;
-
-	device->CreateBuffer(&ibd, &initialIndexData, indexBuffer.GetAddressOf());
+	CreateBuffers(vertices, indices);
 }
 
-Mesh::Mesh(const wchar_t* objFile, Microsoft::WRL::ComPtr<ID3D11Device> device)
-    : vertexCount(0), indexCount(0)
+Mesh::Mesh(const wchar_t* objFile, IRenderBackend& backend, MeshCpuGeometry cpuGeometry)
+    : backend(&backend), vertexUsage(BufferUsage::Immutable), cpuGeometry(cpuGeometry), indexCount(0), vertexCount(0)
 {
 	// Author: Chris Cascioli
 	// Latest Revision: 02/2026
@@ -167,8 +153,9 @@ Mesh::Mesh(const wchar_t* objFile, Microsoft::WRL::ComPtr<ID3D11Device> device)
 	//
 	// *************************************
 
-	// File input object
-	std::ifstream obj(objFile);
+	// File input object - through a path, as only MSVC's streams
+	// take wide strings themselves
+	std::ifstream obj(std::filesystem::path{ objFile });
 
 	// Check for successful open
 	if (!obj.is_open())
@@ -180,7 +167,7 @@ Mesh::Mesh(const wchar_t* objFile, Microsoft::WRL::ComPtr<ID3D11Device> device)
 	std::vector<DirectX::XMFLOAT2> uvs;		// UVs from the file
 	std::vector<Vertex> vertsFromFile;	// Verts from file (including duplicates)
 	std::vector<Vertex> finalVertices;	// Final, de-duplicated verts
-	std::vector<UINT> finalIndices;		// Indices for final verts
+	std::vector<unsigned int> finalIndices;		// Indices for final verts
 	char chars[100];			// String for line reading
 
 	// Still have data left?
@@ -274,19 +261,19 @@ Mesh::Mesh(const wchar_t* objFile, Microsoft::WRL::ComPtr<ID3D11Device> device)
 			// - OBJ File indices are 1-based, so
 			//    they need to be adusted
 			Vertex v1{};
-			v1.Position = positions[max(i[0] - 1, 0)];
-			v1.UV = uvs[max(i[1] - 1, 0)];
-			v1.Normal = normals[max(i[2] - 1, 0)];
+			v1.Position = positions[(std::max)(i[0] - 1, 0u)];
+			v1.UV = uvs[(std::max)(i[1] - 1, 0u)];
+			v1.Normal = normals[(std::max)(i[2] - 1, 0u)];
 
 			Vertex v2{};
-			v2.Position = positions[max(i[3] - 1, 0)];
-			v2.UV = uvs[max(i[4] - 1, 0)];
-			v2.Normal = normals[max(i[5] - 1, 0)];
+			v2.Position = positions[(std::max)(i[3] - 1, 0u)];
+			v2.UV = uvs[(std::max)(i[4] - 1, 0u)];
+			v2.Normal = normals[(std::max)(i[5] - 1, 0u)];
 
 			Vertex v3{};
-			v3.Position = positions[max(i[6] - 1, 0)];
-			v3.UV = uvs[max(i[7] - 1, 0)];
-			v3.Normal = normals[max(i[8] - 1, 0)];
+			v3.Position = positions[(std::max)(i[6] - 1, 0u)];
+			v3.UV = uvs[(std::max)(i[7] - 1, 0u)];
+			v3.Normal = normals[(std::max)(i[8] - 1, 0u)];
 
 			// The model is most likely in a right-handed space,
 			// especially if it came from Maya.  We probably want 
@@ -326,9 +313,9 @@ Mesh::Mesh(const wchar_t* objFile, Microsoft::WRL::ComPtr<ID3D11Device> device)
 			{
 				// Make the last vertex
 				Vertex v4{};
-				v4.Position = positions[max(i[9] - 1, 0)];
-				v4.UV = uvs[max(i[10] - 1, 0)];
-				v4.Normal = normals[max(i[11] - 1, 0)];
+				v4.Position = positions[(std::max)(i[9] - 1, 0u)];
+				v4.UV = uvs[(std::max)(i[10] - 1, 0u)];
+				v4.Normal = normals[(std::max)(i[11] - 1, 0u)];
 
 				// Flip the UV, Z pos and normal's Z
 				v4.UV.y = 1.0f - v4.UV.y;
@@ -394,22 +381,8 @@ Mesh::Mesh(const wchar_t* objFile, Microsoft::WRL::ComPtr<ID3D11Device> device)
 	vertexCount = (int)finalVertices.size();
 	indexCount = (int)finalIndices.size();
 
-	D3D11_BUFFER_DESC vbd = {};
-	vbd.Usage = D3D11_USAGE_IMMUTABLE;
-	vbd.ByteWidth = sizeof(Vertex) * vertexCount;
-	vbd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-	D3D11_SUBRESOURCE_DATA vData = {};
-	vData.pSysMem = &finalVertices[0];
-	device->CreateBuffer(&vbd, &vData, vertexBuffer.GetAddressOf());
-
-	D3D11_BUFFER_DESC ibd = {};
-	ibd.Usage = D3D11_USAGE_IMMUTABLE;
-	ibd.ByteWidth = sizeof(unsigned int) * indexCount;
-	ibd.BindFlags = D3D11_BIND_INDEX_BUFFER;
-	D3D11_SUBRESOURCE_DATA iData = {};
-	iData.pSysMem = &finalIndices[0];
 	CalculateTangents(&finalVertices[0], vertexCount, &finalIndices[0], indexCount);
-	device->CreateBuffer(&ibd, &iData, indexBuffer.GetAddressOf());
+	CreateBuffers(&finalVertices[0], &finalIndices[0]);
 
 	// *************************************
 	//      IMPLEMENTATION NOTES (2/2)
@@ -436,17 +409,62 @@ Mesh::Mesh(const wchar_t* objFile, Microsoft::WRL::ComPtr<ID3D11Device> device)
 	// *************************************
 }
 
-// destructor - empty because ComPtrs handle cleanup
+// destructor - buffers belong to the backend, hand them back
 Mesh::~Mesh() {
+	backend->DestroyBuffer(vertexBuffer);
+	backend->DestroyBuffer(indexBuffer);
+}
+
+// creates the immutable vertex and index buffers from the counts already stored
+// (also computes the bounds, keeps any CPU copies and hands out the sort id)
+void Mesh::CreateBuffers(Vertex* vertices, unsigned int* indices)
+{
+	// meshes are only created on the main thread
+	static unsigned int nextSortId = 0;
+	sortId = nextSortId++;
+
+	if (vertexCount > 0)
+	{
+		XMFLOAT3 min = vertices[0].Position;
+		XMFLOAT3 max = vertices[0].Position;
+		for (int i = 1; i < vertexCount; i++)
+		{
+			const XMFLOAT3& p = vertices[i].Position;
+			min = XMFLOAT3(p.x < min.x ? p.x : min.x, p.y < min.y ? p.y : min.y, p.z < min.z ? p.z : min.z);
+			max = XMFLOAT3(p.x > max.x ? p.x : max.x, p.y > max.y ? p.y : max.y, p.z > max.z ? p.z : max.z);
+		}
+		localBounds = AABB::FromMinMax(min, max);
+	}
 
+	if (cpuGeometry == MeshCpuGeometry::Keep)
+	{
+		positions.resize(vertexCount);
+		for (int i = 0; i < vertexCount; i++)
+			positions[i] = vertices[i].Position;
+		this->indices.assign(indices, indices + indexCount);
+	}
+
+	BufferDesc vbd;
+	vbd.type = BufferType::Vertex;
+	vbd.usage = vertexUsage;
+	vbd.size = sizeof(Vertex) * vertexCount;
+	vbd.initialData = vertices;
+	vertexBuffer = backend->CreateBuffer(vbd);
+
+	BufferDesc ibd;
+	ibd.type = BufferType::Index;
+	ibd.usage = BufferUsage::Immutable;
+	ibd.size = sizeof(unsigned int) * indexCount;
+	ibd.initialData = indices;
+	indexBuffer = backend->CreateBuffer(ibd);
 }
 
 // getters
-Microsoft::WRL::ComPtr<ID3D11Buffer> Mesh::GetVertexBuffer() const 
+BufferHandle Mesh::GetVertexBuffer() const 
 {
 	return vertexBuffer;
 }
-Microsoft::WRL::ComPtr<ID3D11Buffer> Mesh::GetIndexBuffer() const
+BufferHandle Mesh::GetIndexBuffer() const
 {
 	return indexBuffer;
 }
@@ -461,18 +479,63 @@ int Mesh::GetVertexCount() const
 	return vertexCount;
 }
 
+const AABB& Mesh::GetLocalBounds() const
+{
+	return localBounds;
+}
+
+unsigned int Mesh::GetSortId() const
+{
+	return sortId;
+}
+
+const std::vector<XMFLOAT3>& Mesh::GetPositions() const
+{
+	return positions;
+}
+
+const std::vector<unsigned int>& Mesh::GetIndices() const
+{
+	return indices;
+}
+
+Vertex* Mesh::MapVertices()
+{
+	if (vertexUsage != BufferUsage::Dynamic)
+		return nullptr;
+	return static_cast<Vertex*>(backend->Map(vertexBuffer, MapMode::WriteDiscard));
+}
+
+void Mesh::UnmapVertices(const AABB& bounds)
+{
+	backend->Unmap(vertexBuffer);
+	localBounds = bounds;
+}
+
+void Mesh::UnmapVertices()
+{
+	backend->Unmap(vertexBuffer);
+}
+
+void Mesh::BuildTriangleBVH()
+{
+	if (cpuGeometry != MeshCpuGeometry::Keep)
+		return;
+	if (!triangleBVH)
+		triangleBVH = std::make_unique<MeshBVH>();
+	triangleBVH->Build(positions.data(), positions.size(), indices.data(), indices.size());
+}
+
 
 // draw method - sets the vertex and index buffer, then draws
-void Mesh::Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+void Mesh::Draw(IRenderBackend& backend)
 {
 	// set the vertex buffer
-	UINT stride = sizeof(Vertex);
-	UINT offset = 0;
-	context->IASetVertexBuffers(0, 1, vertexBuffer.GetAddressOf(), &stride, &offset);
+	backend.SetVertexBuffer(vertexBuffer, sizeof(Vertex), 0);
 
 	// set the index buffer
-	context->IASetIndexBuffer(indexBuffer.Get(), DXGI_FORMAT_R32_UINT, 0);
+	backend.SetIndexBuffer(indexBuffer);
 
 	// draw the mesh using the index buffer
-	context->DrawIndexed(indexCount, 0, 0);
+	backend.DrawIndexed(indexCount, 0, 0);
 }
\ No newline at end of file
@@ -1,47 +1,107 @@
 #pragma once
 
-#include <d3d11.h>
-#include <wrl/client.h>
+#include <memory>
+#include <vector>
 #include "Vertex.h"
-#include "Graphics.h"
+#include "RenderBackend.h"
+#include "Bounds.h"
+#include "MeshBVH.h"
+
+// Whether a mesh keeps a CPU copy of its positions and indices
+// once the buffers are made - for occlusion, ray casts and picking
+enum class MeshCpuGeometry
+{
+	Discard,
+	Keep
+};
 
 class Mesh
 {
 public: 
-	// constructor 
+	// constructor - a dynamic mesh never keeps CPU geometry, as its
+	// vertices are rewritten straight into the vertex buffer
 	Mesh(
 		Vertex* vertices,
 		int vertexCount,
 		unsigned int* indices,
 		int indexCount,
-		Microsoft::WRL::ComPtr<ID3D11Device> device
+		IRenderBackend& backend,
+		BufferUsage vertexUsage = BufferUsage::Immutable,
+		MeshCpuGeometry cpuGeometry = MeshCpuGeometry::Discard
 	);
 	Mesh(
 		const wchar_t* objFile, 
-		Microsoft::WRL::ComPtr<ID3D11Device> device
+		IRenderBackend& backend,
+		MeshCpuGeometry cpuGeometry = MeshCpuGeometry::Discard
 	);
 
 	// destructor
 	~Mesh();
 
+	// the buffers are released in the destructor, so no copies
+	Mesh(const Mesh&) = delete;
+	Mesh& operator=(const Mesh&) = delete;
+
 	// getters
-	Microsoft::WRL::ComPtr<ID3D11Buffer> GetVertexBuffer() const;
-	Microsoft::WRL::ComPtr<ID3D11Buffer> GetIndexBuffer() const;
+	BufferHandle GetVertexBuffer() const;
+	BufferHandle GetIndexBuffer() const;
 	int GetIndexCount() const;
 	int GetVertexCount() const;
+	const AABB& GetLocalBounds() const;
+	unsigned int GetSortId() const;
+
+	// CPU copies of the positions and indices, for CPU-side work like
+	// software occlusion - empty unless the mesh was made to keep them
+	bool HasCpuGeometry() const { return cpuGeometry == MeshCpuGeometry::Keep; }
+	const std::vector<DirectX::XMFLOAT3>& GetPositions() const;
+	const std::vector<unsigned int>& GetIndices() const;
+
+	// Triangle BVH over the CPU copy, for exact ray hits - null until
+	// BuildTriangleBVH() is called, and always without CPU geometry
+	void BuildTriangleBVH();
+	const MeshBVH* GetTriangleBVH() const { return triangleBVH.get(); }
+
+	// Dynamic meshes only (see the constructor): the vertex buffer to
+	// rewrite, all of it, for this frame - null on failure.  Unmapping
+	// takes the new vertices' bounds, or leaves the old ones for a
+	// caller that keeps the new ones itself (another thread may be
+	// reading them).
+	Vertex* MapVertices();
+	void UnmapVertices(const AABB& bounds);
+	void UnmapVertices();
+	bool IsDynamic() const { return vertexUsage == BufferUsage::Dynamic; }
 
 	void CalculateTangents(Vertex* verts, int numVerts, unsigned int* indices, int numIndices); // optional helper method to calculate tangents for normal mapping, if your OBJ loader doesn't support it
 
 	// draw method
-	void Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
+	void Draw(IRenderBackend& backend);
 
 private:
+	// backend that owns the buffers
+	IRenderBackend* backend;
+
 	// buffers
-	Microsoft::WRL::ComPtr<ID3D11Buffer> vertexBuffer;
-	Microsoft::WRL::ComPtr<ID3D11Buffer> indexBuffer;
+	BufferHandle vertexBuffer;
+	BufferHandle indexBuffer;
+
+	BufferUsage vertexUsage;
+	MeshCpuGeometry cpuGeometry;
 
 	// counts 
 	int indexCount;
 	int vertexCount;
+
+	// object-space box around every vertex
+	AABB localBounds;
+
+	// kept after the buffers are created, if asked for
+	std::vector<DirectX::XMFLOAT3> positions;
+	std::vector<unsigned int> indices;
+	std::unique_ptr<MeshBVH> triangleBVH;
+
+	// small id for draw sort keys, assigned at creation
+	unsigned int sortId;
+
+	void CreateBuffers(Vertex* vertices, unsigned int* indices);
 };
 
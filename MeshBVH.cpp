@@ -0,0 +1,480 @@
+#include "MeshBVH.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX;
+
+namespace
+{
+	float SurfaceArea(const XMFLOAT3& min, const XMFLOAT3& max)
+	{
+		float x = max.x - min.x;
+		float y = max.y - min.y;
+		float z = max.z - min.z;
+		return 2.0f * (x * y + y * z + z * x);
+	}
+
+	void Grow(XMFLOAT3& min, XMFLOAT3& max, const XMFLOAT3& boxMin, const XMFLOAT3& boxMax)
+	{
+		min = XMFLOAT3((std::min)(min.x, boxMin.x), (std::min)(min.y, boxMin.y), (std::min)(min.z, boxMin.z));
+		max = XMFLOAT3((std::max)(max.x, boxMax.x), (std::max)(max.y, boxMax.y), (std::max)(max.z, boxMax.z));
+	}
+
+	float Component(const XMFLOAT3& v, unsigned int axis)
+	{
+		return axis == 0 ? v.x : axis == 1 ? v.y : v.z;
+	}
+
+	float& Lane(XMFLOAT4& v, int lane)
+	{
+		return lane == 0 ? v.x : lane == 1 ? v.y : lane == 2 ? v.z : v.w;
+	}
+
+	XMFLOAT3 Subtract(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		return XMFLOAT3(a.x - b.x, a.y - b.y, a.z - b.z);
+	}
+
+	XMFLOAT3 Cross(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		return XMFLOAT3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+	}
+
+	float Dot(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		return a.x * b.x + a.y * b.y + a.z * b.z;
+	}
+}
+
+void MeshBVH::Build(const XMFLOAT3* positions, size_t vertexCount, const unsigned int* indices, size_t indexCount)
+{
+	nodes.clear();
+	triangles.clear();
+	binaryNodes.clear();
+	depth = 0;
+
+	// Triangles with an index past the vertices are left out
+	buildTriangles.clear();
+	buildTriangles.reserve(indexCount / 3);
+	BinaryNode root;
+	root.first = 0;
+	root.min = XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
+	root.max = XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (size_t t = 0; t + 2 < indexCount; t += 3)
+	{
+		if (indices[t] >= vertexCount || indices[t + 1] >= vertexCount || indices[t + 2] >= vertexCount)
+			continue;
+
+		const XMFLOAT3& a = positions[indices[t]];
+		const XMFLOAT3& b = positions[indices[t + 1]];
+		const XMFLOAT3& c = positions[indices[t + 2]];
+		BuildTriangle triangle;
+		triangle.index = (uint32_t)(t / 3);
+		triangle.min = a;
+		triangle.max = a;
+		Grow(triangle.min, triangle.max, b, b);
+		Grow(triangle.min, triangle.max, c, c);
+		triangle.centroid = XMFLOAT3(
+			(triangle.min.x + triangle.max.x) * 0.5f,
+			(triangle.min.y + triangle.max.y) * 0.5f,
+			(triangle.min.z + triangle.max.z) * 0.5f);
+		Grow(root.min, root.max, triangle.min, triangle.max);
+		buildTriangles.push_back(triangle);
+	}
+	if (buildTriangles.empty())
+		return;
+
+	root.count = (uint32_t)buildTriangles.size();
+	binaryNodes.reserve(buildTriangles.size() * 2);
+	binaryNodes.push_back(root);
+	Subdivide(0, 1);
+
+	triangles.resize(buildTriangles.size());
+	for (size_t i = 0; i < buildTriangles.size(); i++)
+	{
+		uint32_t t = buildTriangles[i].index * 3;
+		const XMFLOAT3& a = positions[indices[t]];
+		triangles[i].v0 = a;
+		triangles[i].edge1 = Subtract(positions[indices[t + 1]], a);
+		triangles[i].edge2 = Subtract(positions[indices[t + 2]], a);
+		triangles[i].index = buildTriangles[i].index;
+	}
+
+	nodes.reserve(binaryNodes.size() / 2 + 1);
+	Collapse(0, 1);
+
+	buildTriangles.clear();
+	buildTriangles.shrink_to_fit();
+	binaryNodes.clear();
+	binaryNodes.shrink_to_fit();
+}
+
+// --------------------------------------------------------
+// Splits a binary node with the cheapest of BinCount - 1
+// planes on each axis (see EntityBVH::Subdivide()), or in half
+// by count when binning can't separate the centroids or the
+// tree is getting deep
+// --------------------------------------------------------
+void MeshBVH::Subdivide(uint32_t index, unsigned int nodeDepth)
+{
+	uint32_t count = binaryNodes[index].count;
+	if (count <= 1)
+		return;
+
+	BuildTriangle* first = buildTriangles.data() + binaryNodes[index].first;
+	BuildTriangle* last = first + count;
+	XMFLOAT3 centroidMin(FLT_MAX, FLT_MAX, FLT_MAX);
+	XMFLOAT3 centroidMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (BuildTriangle* triangle = first; triangle < last; triangle++)
+		Grow(centroidMin, centroidMax, triangle->centroid, triangle->centroid);
+
+	float bestCost = FLT_MAX;
+	unsigned int bestAxis = 0;
+	unsigned int bestSplit = 0;
+	float scale[3];
+	auto binOf = [&](const BuildTriangle& triangle, unsigned int axis)
+	{
+		float offset = (Component(triangle.centroid, axis) - Component(centroidMin, axis)) * scale[axis];
+		return (std::min)((unsigned int)offset, BinCount - 1);
+	};
+
+	bool deep = nodeDepth + 24 >= 64;
+	if (!deep)
+	{
+		XMFLOAT3 binMin[3][BinCount];
+		XMFLOAT3 binMax[3][BinCount];
+		uint32_t binCount[3][BinCount] = {};
+		for (unsigned int axis = 0; axis < 3; axis++)
+		{
+			float extent = Component(centroidMax, axis) - Component(centroidMin, axis);
+			scale[axis] = extent > 0.0f ? BinCount / extent : 0.0f;
+			for (unsigned int b = 0; b < BinCount; b++)
+			{
+				binMin[axis][b] = XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
+				binMax[axis][b] = XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+			}
+		}
+
+		for (BuildTriangle* triangle = first; triangle < last; triangle++)
+		{
+			for (unsigned int axis = 0; axis < 3; axis++)
+			{
+				if (scale[axis] == 0.0f)
+					continue;
+				unsigned int b = binOf(*triangle, axis);
+				Grow(binMin[axis][b], binMax[axis][b], triangle->min, triangle->max);
+				binCount[axis][b]++;
+			}
+		}
+
+		for (unsigned int axis = 0; axis < 3; axis++)
+		{
+			if (scale[axis] == 0.0f)
+				continue;
+
+			float leftCost[BinCount];
+			XMFLOAT3 sweepMin(FLT_MAX, FLT_MAX, FLT_MAX);
+			XMFLOAT3 sweepMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+			uint32_t leftCount = 0;
+			for (unsigned int b = 0; b < BinCount - 1; b++)
+			{
+				if (binCount[axis][b] > 0)
+					Grow(sweepMin, sweepMax, binMin[axis][b], binMax[axis][b]);
+				leftCount += binCount[axis][b];
+				leftCost[b] = leftCount > 0 ? SurfaceArea(sweepMin, sweepMax) * leftCount : 0.0f;
+			}
+
+			sweepMin = XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
+			sweepMax = XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+			uint32_t rightCount = 0;
+			for (unsigned int b = BinCount - 1; b > 0; b--)
+			{
+				if (binCount[axis][b] > 0)
+					Grow(sweepMin, sweepMax, binMin[axis][b], binMax[axis][b]);
+				rightCount += binCount[axis][b];
+				if (rightCount == 0 || rightCount == count)
+					continue;
+
+				float cost = leftCost[b - 1] + SurfaceArea(sweepMin, sweepMax) * rightCount;
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestSplit = b;
+				}
+			}
+		}
+	}
+
+	uint32_t leftCount;
+	if (bestCost == FLT_MAX)
+	{
+		if (count <= MaxLeafSize)
+			return;
+
+		const BinaryNode& node = binaryNodes[index];
+		XMFLOAT3 size = Subtract(node.max, node.min);
+		unsigned int axis = size.x >= size.y && size.x >= size.z ? 0 : size.y >= size.z ? 1 : 2;
+		std::nth_element(first, first + count / 2, last,
+			[&](const BuildTriangle& a, const BuildTriangle& b) { return Component(a.centroid, axis) < Component(b.centroid, axis); });
+		leftCount = count / 2;
+	}
+	else
+	{
+		float area = SurfaceArea(binaryNodes[index].min, binaryNodes[index].max);
+		float splitCost = 1.0f + (area > 0.0f ? bestCost / area : 0.0f);
+		if (count <= MaxLeafSize && (float)count <= splitCost)
+			return;
+
+		BuildTriangle* middle = std::partition(first, last, [&](const BuildTriangle& triangle) { return binOf(triangle, bestAxis) < bestSplit; });
+		leftCount = (uint32_t)(middle - first);
+	}
+
+	uint32_t left = AddChildren(index, leftCount);
+	Subdivide(left, nodeDepth + 1);
+	Subdivide(left + 1, nodeDepth + 1);
+}
+
+// Turns a binary leaf whose triangles are partitioned into an inner
+// node with two leaf children, returning the first child
+uint32_t MeshBVH::AddChildren(uint32_t index, uint32_t leftCount)
+{
+	uint32_t first = binaryNodes[index].first;
+	uint32_t counts[2] = { leftCount, binaryNodes[index].count - leftCount };
+	uint32_t left = (uint32_t)binaryNodes.size();
+	for (int child = 0; child < 2; child++)
+	{
+		BinaryNode node;
+		node.first = child == 0 ? first : first + leftCount;
+		node.count = counts[child];
+		node.min = XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
+		node.max = XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		for (uint32_t i = node.first; i < node.first + node.count; i++)
+			Grow(node.min, node.max, buildTriangles[i].min, buildTriangles[i].max);
+		binaryNodes.push_back(node);
+	}
+
+	binaryNodes[index].first = left;
+	binaryNodes[index].count = 0;
+	return left;
+}
+
+// --------------------------------------------------------
+// Makes a 4-wide node out of a binary one: starting from its
+// two children, the inner child with the biggest surface area
+// is replaced by its own two until there are four (or only
+// leaves)
+// --------------------------------------------------------
+uint32_t MeshBVH::Collapse(uint32_t binaryIndex, unsigned int nodeDepth)
+{
+	depth = (std::max)(depth, nodeDepth);
+
+	uint32_t slots[4];
+	unsigned int slotCount = 0;
+	const BinaryNode& binary = binaryNodes[binaryIndex];
+	if (binary.count > 0)
+	{
+		slots[slotCount++] = binaryIndex;	// A leaf root
+	}
+	else
+	{
+		slots[slotCount++] = binary.first;
+		slots[slotCount++] = binary.first + 1;
+	}
+
+	while (slotCount < 4)
+	{
+		int widest = -1;
+		float widestArea = -1.0f;
+		for (unsigned int s = 0; s < slotCount; s++)
+		{
+			const BinaryNode& node = binaryNodes[slots[s]];
+			float area = SurfaceArea(node.min, node.max);
+			if (node.count == 0 && area > widestArea)
+			{
+				widest = (int)s;
+				widestArea = area;
+			}
+		}
+		if (widest < 0)
+			break;
+
+		uint32_t children = binaryNodes[slots[widest]].first;
+		slots[widest] = children;
+		slots[slotCount++] = children + 1;
+	}
+
+	uint32_t index = (uint32_t)nodes.size();
+	nodes.emplace_back();
+	Node node;
+	for (int s = 0; s < 4; s++)
+	{
+		bool used = s < (int)slotCount;
+		const BinaryNode* binaryChild = used ? &binaryNodes[slots[s]] : nullptr;
+		Lane(node.minX, s) = used ? binaryChild->min.x : FLT_MAX;
+		Lane(node.minY, s) = used ? binaryChild->min.y : FLT_MAX;
+		Lane(node.minZ, s) = used ? binaryChild->min.z : FLT_MAX;
+		Lane(node.maxX, s) = used ? binaryChild->max.x : -FLT_MAX;
+		Lane(node.maxY, s) = used ? binaryChild->max.y : -FLT_MAX;
+		Lane(node.maxZ, s) = used ? binaryChild->max.z : -FLT_MAX;
+		if (!used)
+		{
+			node.child[s] = EmptySlot;
+			node.count[s] = 0;
+		}
+		else if (binaryChild->count > 0)
+		{
+			node.child[s] = LeafBit | binaryChild->first;
+			node.count[s] = binaryChild->count;
+		}
+		else
+		{
+			node.child[s] = Collapse(slots[s], nodeDepth + 1);
+			node.count[s] = 0;
+		}
+	}
+	nodes[index] = node;
+	return index;
+}
+
+bool MeshBVH::Intersect(const MeshRay& ray, MeshHit& hit) const
+{
+	hit = MeshHit();
+	return Trace(ray, &hit, false);
+}
+
+bool MeshBVH::Occluded(const MeshRay& ray) const
+{
+	return Trace(ray, nullptr, true);
+}
+
+void MeshBVH::IntersectRays(JobSystem& jobSystem, const MeshRay* rays, MeshHit* hits, size_t count) const
+{
+	jobSystem.ParallelFor(count, PacketSize, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+			Intersect(rays[i], hits[i]);
+	});
+}
+
+void MeshBVH::OccludedRays(JobSystem& jobSystem, const MeshRay* rays, uint8_t* occluded, size_t count) const
+{
+	jobSystem.ParallelFor(count, PacketSize, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+			occluded[i] = Occluded(rays[i]) ? 1 : 0;
+	});
+}
+
+// --------------------------------------------------------
+// Walks the tree with a fixed stack.  Each node's four boxes
+// are slab tested at once; with anyHit the first triangle hit
+// ends it, otherwise hit children are pushed farthest first
+// and anything past the closest hit so far is skipped.
+// --------------------------------------------------------
+bool MeshBVH::Trace(const MeshRay& ray, MeshHit* hit, bool anyHit) const
+{
+	if (nodes.empty())
+		return false;
+
+	// Zero components would give 0 * infinity on the slab planes
+	auto nudge = [](float v) { return fabsf(v) < 1e-20f ? 1e-20f : v; };
+	XMVECTOR originX = XMVectorReplicate(ray.origin.x);
+	XMVECTOR originY = XMVectorReplicate(ray.origin.y);
+	XMVECTOR originZ = XMVectorReplicate(ray.origin.z);
+	XMVECTOR inverseX = XMVectorReplicate(1.0f / nudge(ray.direction.x));
+	XMVECTOR inverseY = XMVectorReplicate(1.0f / nudge(ray.direction.y));
+	XMVECTOR inverseZ = XMVectorReplicate(1.0f / nudge(ray.direction.z));
+	XMVECTOR missed = XMVectorReplicate(FLT_MAX);
+
+	float closest = ray.maxDistance;
+	bool found = false;
+
+	struct Entry { uint32_t child; uint32_t count; float entry; };
+	Entry stack[StackSize];
+	unsigned int top = 0;
+	stack[top++] = { 0, 0, 0.0f };
+	while (top > 0)
+	{
+		Entry entry = stack[--top];
+		if (entry.entry > closest)
+			continue;
+
+		if (entry.child & LeafBit)
+		{
+			uint32_t first = entry.child & ~LeafBit;
+			for (uint32_t i = first; i < first + entry.count; i++)
+			{
+				// Moller-Trumbore, both sides
+				const Triangle& triangle = triangles[i];
+				XMFLOAT3 p = Cross(ray.direction, triangle.edge2);
+				float determinant = Dot(triangle.edge1, p);
+				if (fabsf(determinant) < 1e-12f)
+					continue;
+
+				float inverse = 1.0f / determinant;
+				XMFLOAT3 s = Subtract(ray.origin, triangle.v0);
+				float u = Dot(s, p) * inverse;
+				if (u < 0.0f || u > 1.0f)
+					continue;
+				XMFLOAT3 q = Cross(s, triangle.edge1);
+				float v = Dot(ray.direction, q) * inverse;
+				if (v < 0.0f || u + v > 1.0f)
+					continue;
+				float t = Dot(triangle.edge2, q) * inverse;
+				if (t < 0.0f || t > closest)
+					continue;
+
+				if (anyHit)
+					return true;
+
+				// Ties go to the lowest triangle, so the result doesn't
+				// depend on the traversal order
+				if (found && t == closest && triangle.index > hit->triangle)
+					continue;
+				found = true;
+				closest = t;
+				hit->distance = t;
+				hit->triangle = triangle.index;
+				hit->u = u;
+				hit->v = v;
+			}
+			continue;
+		}
+
+		const Node& node = nodes[entry.child];
+		XMVECTOR x0 = XMVectorMultiply(XMVectorSubtract(XMLoadFloat4(&node.minX), originX), inverseX);
+		XMVECTOR x1 = XMVectorMultiply(XMVectorSubtract(XMLoadFloat4(&node.maxX), originX), inverseX);
+		XMVECTOR y0 = XMVectorMultiply(XMVectorSubtract(XMLoadFloat4(&node.minY), originY), inverseY);
+		XMVECTOR y1 = XMVectorMultiply(XMVectorSubtract(XMLoadFloat4(&node.maxY), originY), inverseY);
+		XMVECTOR z0 = XMVectorMultiply(XMVectorSubtract(XMLoadFloat4(&node.minZ), originZ), inverseZ);
+		XMVECTOR z1 = XMVectorMultiply(XMVectorSubtract(XMLoadFloat4(&node.maxZ), originZ), inverseZ);
+		XMVECTOR entryT = XMVectorMax(XMVectorMax(XMVectorMin(x0, x1), XMVectorMin(y0, y1)), XMVectorMax(XMVectorMin(z0, z1), XMVectorZero()));
+		XMVECTOR exitT = XMVectorMin(XMVectorMin(XMVectorMax(x0, x1), XMVectorMax(y0, y1)), XMVectorMin(XMVectorMax(z0, z1), XMVectorReplicate(closest)));
+		XMFLOAT4 entries;
+		XMStoreFloat4(&entries, XMVectorSelect(missed, entryT, XMVectorLessOrEqual(entryT, exitT)));
+
+		// Hit children, sorted farthest first so the nearest pops next
+		Entry children[4];
+		unsigned int childCount = 0;
+		for (int s = 0; s < 4; s++)
+		{
+			float childEntry = Lane(entries, s);
+			if (node.child[s] == EmptySlot || childEntry == FLT_MAX)
+				continue;
+
+			Entry child = { node.child[s], node.count[s], childEntry };
+			unsigned int slot = childCount++;
+			while (!anyHit && slot > 0 && children[slot - 1].entry < childEntry)
+			{
+				children[slot] = children[slot - 1];
+				slot--;
+			}
+			children[slot] = child;
+		}
+		for (unsigned int c = 0; c < childCount; c++)
+			stack[top++] = children[c];
+	}
+
+	return found;
+}
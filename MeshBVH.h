@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cfloat>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <DirectXMath.h>
+#include "JobSystem.h"
+
+// --------------------------------------------------------
+// A ray in the mesh's object space.  Distances are in units
+// of direction, which needn't be normalized.
+// --------------------------------------------------------
+struct MeshRay
+{
+	DirectX::XMFLOAT3 origin = DirectX::XMFLOAT3(0, 0, 0);
+	float maxDistance = FLT_MAX;
+	DirectX::XMFLOAT3 direction = DirectX::XMFLOAT3(0, 0, 1);
+};
+
+// --------------------------------------------------------
+// Closest hit along a ray.  The hit point is vertex 0 of the
+// triangle plus u and v times its edges to vertices 1 and 2.
+// --------------------------------------------------------
+struct MeshHit
+{
+	float distance = FLT_MAX;
+	uint32_t triangle = UINT32_MAX;		// Index buffer offset / 3
+	float u = 0.0f;
+	float v = 0.0f;
+
+	bool IsHit() const { return triangle != UINT32_MAX; }
+};
+
+// --------------------------------------------------------
+// Ray casting against a mesh's triangles, for picking,
+// visibility checks and baking.
+//
+// Built like EntityBVH - binned SAH, 16 bins on each axis, up
+// to 4 triangles per leaf - and then collapsed into a 4-wide
+// tree: each node holds the boxes of up to four children as
+// separate x / y / z arrays, so one ray is tested against all
+// four with a handful of DirectXMath vector operations.
+// Collapsing pulls up the grandchildren with the biggest
+// surface area until a node has four.
+//
+// Triangles are stored in leaf order as a vertex and two edges.
+// They're hit from both sides.
+//
+// Intersect() finds the closest hit, visiting hit children
+// nearest first and skipping any beyond the closest so far.
+// Occluded() stops at the first hit.  The batched versions split
+// the rays into packets of PacketSize for the job system; each
+// ray in a packet is traced on its own.
+//
+// Everything but Build() is const and safe from any thread.
+// --------------------------------------------------------
+class MeshBVH
+{
+public:
+	static const unsigned int MaxLeafSize = 4;
+	static const unsigned int BinCount = 16;
+	static const unsigned int PacketSize = 64;
+
+	void Build(const DirectX::XMFLOAT3* positions, size_t vertexCount, const unsigned int* indices, size_t indexCount);
+
+	bool Intersect(const MeshRay& ray, MeshHit& hit) const;
+	bool Occluded(const MeshRay& ray) const;
+
+	void IntersectRays(JobSystem& jobSystem, const MeshRay* rays, MeshHit* hits, size_t count) const;
+	void OccludedRays(JobSystem& jobSystem, const MeshRay* rays, uint8_t* occluded, size_t count) const;
+
+	size_t GetTriangleCount() const { return triangles.size(); }
+	size_t GetNodeCount() const { return nodes.size(); }
+	unsigned int GetDepth() const { return depth; }
+
+private:
+	static const uint32_t LeafBit = 0x80000000u;
+	static const uint32_t EmptySlot = 0xFFFFFFFFu;
+	static const unsigned int StackSize = 256;
+
+	// Children are inner nodes, leaves (LeafBit | first triangle,
+	// with a count) or empty
+	struct Node
+	{
+		DirectX::XMFLOAT4 minX;
+		DirectX::XMFLOAT4 minY;
+		DirectX::XMFLOAT4 minZ;
+		DirectX::XMFLOAT4 maxX;
+		DirectX::XMFLOAT4 maxY;
+		DirectX::XMFLOAT4 maxZ;
+		uint32_t child[4];
+		uint32_t count[4];
+	};
+
+	struct Triangle
+	{
+		DirectX::XMFLOAT3 v0;
+		DirectX::XMFLOAT3 edge1;
+		DirectX::XMFLOAT3 edge2;
+		uint32_t index;
+	};
+
+	// Build scratch - a binary tree first
+	struct BuildTriangle
+	{
+		DirectX::XMFLOAT3 centroid;
+		uint32_t index;
+		DirectX::XMFLOAT3 min;
+		DirectX::XMFLOAT3 max;
+	};
+
+	struct BinaryNode
+	{
+		DirectX::XMFLOAT3 min;
+		uint32_t first;		// Children or triangles
+		DirectX::XMFLOAT3 max;
+		uint32_t count;		// 0 for inner nodes
+	};
+
+	std::vector<Node> nodes;
+	std::vector<Triangle> triangles;
+	unsigned int depth = 0;
+
+	std::vector<BuildTriangle> buildTriangles;
+	std::vector<BinaryNode> binaryNodes;
+
+	void Subdivide(uint32_t node, unsigned int depth);
+	uint32_t AddChildren(uint32_t node, uint32_t leftCount);
+	uint32_t Collapse(uint32_t binaryNode, unsigned int depth);
+
+	bool Trace(const MeshRay& ray, MeshHit* hit, bool anyHit) const;
+};
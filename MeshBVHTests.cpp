@@ -0,0 +1,160 @@
+#include "MeshBVHTests.h"
+#include "HeadlessTests.h"
+#include "RecordingBackend.h"
+#include "Mesh.h"
+#include "JobSystem.h"
+#include "MeshBVH.h"
+#include "PathHelpers.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace DirectX;
+
+int RunRayBench(const RayBenchSettings& settings)
+{
+	RecordingBackend backend;
+	int failures = 0;
+	{
+		int threads = settings.threadCount > 0 ? settings.threadCount : (int)std::thread::hardware_concurrency();
+		threads = (std::max)(threads, 1);
+		JobSystem serial(0);
+		JobSystem parallel(threads - 1);
+		printf("Ray bench: %d rays of each kind per mesh, %u threads\n", settings.rayCount, parallel.GetThreadCount());
+
+		const wchar_t* files[2] = { L"../../Assets/helix.obj", L"../../Assets/torus.obj" };
+		for (const wchar_t* file : files)
+		{
+			Mesh mesh(FixPath(file).c_str(), backend, MeshCpuGeometry::Keep);
+			auto buildStart = std::chrono::high_resolution_clock::now();
+			mesh.BuildTriangleBVH();
+			double buildMs = Milliseconds(std::chrono::high_resolution_clock::now() - buildStart);
+			const MeshBVH& bvh = *mesh.GetTriangleBVH();
+			printf("\n  %s: %zu triangles, build %.2f ms, %zu 4-wide nodes, depth %u\n",
+				WideToNarrow(file).c_str(), bvh.GetTriangleCount(), buildMs, bvh.GetNodeCount(), bvh.GetDepth());
+
+			// Closest hit rays come in from a sphere around the mesh, any
+			// hit rays run between two points inside its bounds
+			const AABB& bounds = mesh.GetLocalBounds();
+			float radius = 1.5f * sqrtf(bounds.extents.x * bounds.extents.x + bounds.extents.y * bounds.extents.y + bounds.extents.z * bounds.extents.z);
+			std::mt19937 rng(43);
+			std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+			auto pointInBounds = [&]()
+			{
+				return XMFLOAT3(
+					bounds.center.x + unit(rng) * bounds.extents.x,
+					bounds.center.y + unit(rng) * bounds.extents.y,
+					bounds.center.z + unit(rng) * bounds.extents.z);
+			};
+
+			size_t rayCount = (size_t)(std::max)(settings.rayCount, 1);
+			std::vector<MeshRay> closestRays(rayCount);
+			std::vector<MeshRay> anyRays(rayCount);
+			for (size_t i = 0; i < rayCount; i++)
+			{
+				XMVECTOR around = XMVector3Normalize(XMVectorSet(unit(rng), unit(rng), unit(rng), 0.0f));
+				XMFLOAT3 origin;
+				XMStoreFloat3(&origin, XMVectorMultiplyAdd(around, XMVectorReplicate(radius), XMLoadFloat3(&bounds.center)));
+				XMFLOAT3 target = pointInBounds();
+				closestRays[i].origin = origin;
+				closestRays[i].direction = XMFLOAT3(target.x - origin.x, target.y - origin.y, target.z - origin.z);
+
+				XMFLOAT3 from = pointInBounds();
+				XMFLOAT3 to = pointInBounds();
+				anyRays[i].origin = from;
+				anyRays[i].direction = XMFLOAT3(to.x - from.x, to.y - from.y, to.z - from.z);
+				anyRays[i].maxDistance = 1.0f;
+			}
+
+			std::vector<MeshHit> hits[2];
+			std::vector<uint8_t> occluded[2];
+			printf("    threads   closest Mrays/s   any Mrays/s\n");
+			JobSystem* jobSystems[2] = { &serial, &parallel };
+			for (int run = 0; run < 2; run++)
+			{
+				JobSystem& jobSystem = *jobSystems[run];
+				hits[run].resize(rayCount);
+				occluded[run].resize(rayCount);
+
+				auto start = std::chrono::high_resolution_clock::now();
+				bvh.IntersectRays(jobSystem, closestRays.data(), hits[run].data(), rayCount);
+				double closestMs = Milliseconds(std::chrono::high_resolution_clock::now() - start);
+				start = std::chrono::high_resolution_clock::now();
+				bvh.OccludedRays(jobSystem, anyRays.data(), occluded[run].data(), rayCount);
+				double anyMs = Milliseconds(std::chrono::high_resolution_clock::now() - start);
+
+				printf("    %7u   %15.2f   %11.2f\n", jobSystem.GetThreadCount(),
+					rayCount / (closestMs * 1000.0), rayCount / (anyMs * 1000.0));
+			}
+
+			size_t hitCount = 0;
+			size_t occludedCount = 0;
+			for (size_t i = 0; i < rayCount; i++)
+			{
+				hitCount += hits[0][i].IsHit() ? 1 : 0;
+				occludedCount += occluded[0][i];
+			}
+			printf("    %.1f%% of closest hit rays hit, %.1f%% of any hit rays blocked\n",
+				100.0 * hitCount / rayCount, 100.0 * occludedCount / rayCount);
+
+			// Against every triangle
+			size_t checked = (std::min)((size_t)(std::max)(settings.checkedRays, 0), rayCount);
+			size_t closestMismatches = 0;
+			size_t anyMismatches = 0;
+			float worstPointError = 0.0f;
+			const std::vector<XMFLOAT3>& positions = mesh.GetPositions();
+			const std::vector<unsigned int>& indices = mesh.GetIndices();
+			for (size_t i = 0; i < checked; i++)
+			{
+				const MeshHit& hit = hits[0][i];
+				MeshHit expected = BruteForceRay(mesh, closestRays[i], false);
+				if (hit.IsHit() != expected.IsHit() || (hit.IsHit() && hit.distance != expected.distance))
+					closestMismatches++;
+				if ((occluded[0][i] != 0) != BruteForceRay(mesh, anyRays[i], true).IsHit())
+					anyMismatches++;
+
+				if (hit.IsHit())
+				{
+					const MeshRay& ray = closestRays[i];
+					const XMFLOAT3& a = positions[indices[hit.triangle * 3]];
+					const XMFLOAT3& b = positions[indices[hit.triangle * 3 + 1]];
+					const XMFLOAT3& c = positions[indices[hit.triangle * 3 + 2]];
+					float w = 1.0f - hit.u - hit.v;
+					XMFLOAT3 onTriangle(
+						a.x * w + b.x * hit.u + c.x * hit.v,
+						a.y * w + b.y * hit.u + c.y * hit.v,
+						a.z * w + b.z * hit.u + c.z * hit.v);
+					XMFLOAT3 onRay(
+						ray.origin.x + ray.direction.x * hit.distance,
+						ray.origin.y + ray.direction.y * hit.distance,
+						ray.origin.z + ray.direction.z * hit.distance);
+					worstPointError = (std::max)(worstPointError, (std::max)((std::max)(
+						fabsf(onTriangle.x - onRay.x), fabsf(onTriangle.y - onRay.y)), fabsf(onTriangle.z - onRay.z)));
+				}
+			}
+
+			char detail[256];
+			snprintf(detail, sizeof(detail), "%zu of %zu rays differ", closestMismatches, checked);
+			failures += ReportCheck("closest hits match every triangle", closestMismatches == 0, detail);
+			snprintf(detail, sizeof(detail), "%zu of %zu rays differ", anyMismatches, checked);
+			failures += ReportCheck("any hits match every triangle", anyMismatches == 0, detail);
+			snprintf(detail, sizeof(detail), "worst %g, mesh radius %g", worstPointError, radius / 1.5f);
+			failures += ReportCheck("barycentrics land on the ray", worstPointError <= radius * 1e-4f, detail);
+
+			bool same = occluded[0] == occluded[1];
+			for (size_t i = 0; i < rayCount && same; i++)
+				same = memcmp(&hits[0][i], &hits[1][i], sizeof(MeshHit)) == 0;
+			failures += ReportCheck("one thread and many hit the same", same, "");
+		}
+	}
+
+	printf("\n");
+	failures += ReportValidation(backend);
+	return ReportFailures(failures);
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+// --------------------------------------------------------
+// Headless CPU benchmark of mesh ray casting - no GPU.
+//
+// Loads helix.obj and torus.obj, builds their triangle BVHs
+// and casts rayCount rays at each: closest hit rays from
+// around the mesh toward points in its bounds, and any hit
+// rays between two points in its bounds.  Prints rays per
+// second on one thread and on all of them.
+//
+// Checks, on the first checkedRays of each kind:
+//  - closest and any hit agree with testing every triangle
+//  - the barycentrics put the hit point on the ray
+//  - one thread and many return exactly the same hits
+//
+// Returns 0 if all checks passed.
+// --------------------------------------------------------
+struct RayBenchSettings
+{
+	int rayCount = 1000000;
+	int checkedRays = 2000;
+	int threadCount = -1;	// Including the caller, negative = every hardware thread
+};
+
+int RunRayBench(const RayBenchSettings& settings);
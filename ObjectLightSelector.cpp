@@ -0,0 +1,322 @@
+#include "ObjectLightSelector.h"
+#include <algorithm>
+#include <bit>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+using namespace DirectX;
+
+namespace
+{
+	// Point and spot lights that can reach anything
+	bool IsLocalLight(const Light& light)
+	{
+		return light.Type != LIGHT_TYPE_DIRECTIONAL && light.Range > 0.0f;
+	}
+}
+
+ObjectLightSelector::ObjectLightSelector(IRenderBackend& backend)
+	: backend(backend)
+{
+}
+
+ObjectLightSelector::~ObjectLightSelector()
+{
+	if (lightBuffer.IsValid())
+		backend.DestroyBuffer(lightBuffer);
+}
+
+void ObjectLightSelector::BeginFrame(const std::vector<Light>& frameLights, size_t objectCount)
+{
+	lights = &frameLights;
+
+	// Directional lights, and the point/spot ranges as scratch for
+	// finding the median
+	directionalLights.clear();
+	lightRange.clear();
+	for (size_t i = 0; i < frameLights.size(); i++)
+	{
+		const Light& light = frameLights[i];
+		if (light.Type == LIGHT_TYPE_DIRECTIONAL)
+			directionalLights.push_back((uint32_t)i);
+		else if (IsLocalLight(light))
+			lightRange.push_back(light.Range);
+	}
+
+	const size_t localCount = lightRange.size();
+	float wideRange = FLT_MAX;
+	cellSize = 1.0f;
+	if (localCount > 0)
+	{
+		std::nth_element(lightRange.begin(), lightRange.begin() + localCount / 2, lightRange.end());
+		float median = lightRange[localCount / 2];
+		wideRange = median * 4.0f;
+		cellSize = median * 0.5f;
+	}
+
+	// Bounds of the grid lights' centres, and the cells over them -
+	// made bigger if there would be too many
+	XMFLOAT3 lower(FLT_MAX, FLT_MAX, FLT_MAX);
+	XMFLOAT3 upper(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	gridRange = 0.0f;
+	for (const Light& light : frameLights)
+	{
+		if (!IsLocalLight(light) || light.Range > wideRange)
+			continue;
+		lower = XMFLOAT3((std::min)(lower.x, light.Position.x), (std::min)(lower.y, light.Position.y), (std::min)(lower.z, light.Position.z));
+		upper = XMFLOAT3((std::max)(upper.x, light.Position.x), (std::max)(upper.y, light.Position.y), (std::max)(upper.z, light.Position.z));
+		gridRange = (std::max)(gridRange, light.Range);
+	}
+
+	if (lower.x > upper.x)
+		lower = upper = XMFLOAT3(0, 0, 0);
+	gridOrigin = lower;
+
+	const float extent[3] = { upper.x - lower.x, upper.y - lower.y, upper.z - lower.z };
+	for (int a = 0; a < 3; a++)
+		cellSize = (std::max)(cellSize, extent[a] / MaxGridDim);
+	for (int a = 0; a < 3; a++)
+		gridDims[a] = (std::min)((int)(extent[a] / cellSize) + 1, (int)MaxGridDim);
+
+	// Counting sort into buckets: the wide lights, then each cell
+	const size_t cellCount = (size_t)gridDims[0] * gridDims[1] * gridDims[2];
+	cellStart.assign(cellCount + 2, 0);
+	lightBucket.resize(localCount);
+
+	size_t local = 0;
+	for (const Light& light : frameLights)
+	{
+		if (!IsLocalLight(light))
+			continue;
+
+		uint32_t bucket = 0;
+		if (!(light.Range > wideRange))
+		{
+			int cell[3];
+			const float position[3] = { light.Position.x - gridOrigin.x, light.Position.y - gridOrigin.y, light.Position.z - gridOrigin.z };
+			for (int a = 0; a < 3; a++)
+				cell[a] = (std::min)((int)(position[a] / cellSize), gridDims[a] - 1);
+			bucket = 1 + (uint32_t)((cell[2] * gridDims[1] + cell[1]) * gridDims[0] + cell[0]);
+		}
+		lightBucket[local++] = bucket;
+		cellStart[bucket + 1]++;
+	}
+
+	for (size_t b = 1; b < cellStart.size(); b++)
+		cellStart[b] += cellStart[b - 1];
+
+	// Padding lights are too far away to touch anything and weigh nothing
+	const size_t packedCount = localCount + 3;
+	lightX.assign(packedCount, FLT_MAX);
+	lightY.assign(packedCount, FLT_MAX);
+	lightZ.assign(packedCount, FLT_MAX);
+	lightRange.assign(packedCount, 1.0f);
+	lightWeight.assign(packedCount, 0.0f);
+	localLights.assign(packedCount, 0);
+
+	// Scattered in light order, so each bucket is in light order too.
+	// The starts are bumped along as lights go in, which leaves each
+	// one at the next bucket's start - shifted back after.
+	local = 0;
+	for (size_t i = 0; i < frameLights.size(); i++)
+	{
+		const Light& light = frameLights[i];
+		if (!IsLocalLight(light))
+			continue;
+
+		uint32_t at = cellStart[lightBucket[local++]]++;
+		lightX[at] = light.Position.x;
+		lightY[at] = light.Position.y;
+		lightZ[at] = light.Position.z;
+		lightRange[at] = light.Range;
+		lightWeight[at] = light.Intensity * (0.2126f * light.Color.x + 0.7152f * light.Color.y + 0.0722f * light.Color.z);
+		localLights[at] = (uint32_t)i;
+	}
+
+	for (size_t b = cellStart.size() - 1; b > 0; b--)
+		cellStart[b] = cellStart[b - 1];
+	cellStart[0] = 0;
+
+	history.resize(objectCount);
+	remap.assign(frameLights.size(), NotUploaded);
+	uploadOrder.clear();
+
+	stats.lights = frameLights.size();
+	stats.selections = 0;
+	stats.uploadedLights = 0;
+}
+
+unsigned int ObjectLightSelector::Select(uint32_t objectId, const XMFLOAT3& center, float radius, uint32_t lightsOut[MaxLightsPerObject])
+{
+	unsigned int count = 0;
+	for (uint32_t light : directionalLights)
+	{
+		if (count == MaxLightsPerObject)
+			break;
+		lightsOut[count++] = light;
+	}
+
+	History& previous = history[objectId];
+
+	// Best local lights so far as score and light keys, highest
+	// first - zero is an empty slot, as every light found scores
+	const unsigned int slots = MaxLightsPerObject - count;
+	uint64_t best[MaxLightsPerObject] = {};
+
+	XMVECTOR cx = XMVectorReplicate(center.x);
+	XMVECTOR cy = XMVectorReplicate(center.y);
+	XMVECTOR cz = XMVectorReplicate(center.z);
+	XMVECTOR objectRadius = XMVectorReplicate(radius);
+	XMVECTOR zero = XMVectorZero();
+	XMVECTOR one = XMVectorSplatOne();
+	XMVECTOR laneIndex = XMVectorSet(0.0f, 1.0f, 2.0f, 3.0f);
+	XMVECTOR laneBits = XMVectorSet(1.0f, 2.0f, 4.0f, 8.0f);
+	const float bonus = (std::max)(hysteresis, 1.0f);
+
+	// Tests the packed lights [begin, end), four at a time - lanes
+	// past the end are masked off, as they're some other cell's
+	auto scan = [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i += 4)
+		{
+			// Do the range and bounding spheres touch?
+			XMVECTOR dx = XMVectorSubtract(XMLoadFloat4((const XMFLOAT4*)&lightX[i]), cx);
+			XMVECTOR dy = XMVectorSubtract(XMLoadFloat4((const XMFLOAT4*)&lightY[i]), cy);
+			XMVECTOR dz = XMVectorSubtract(XMLoadFloat4((const XMFLOAT4*)&lightZ[i]), cz);
+			XMVECTOR distSq = XMVectorMultiplyAdd(dz, dz, XMVectorMultiplyAdd(dy, dy, XMVectorMultiply(dx, dx)));
+
+			XMVECTOR range = XMLoadFloat4((const XMFLOAT4*)&lightRange[i]);
+			XMVECTOR reach = XMVectorAdd(range, objectRadius);
+			XMVECTOR touching = XMVectorLess(distSq, XMVectorMultiply(reach, reach));
+			touching = XMVectorAndInt(touching, XMVectorLess(laneIndex, XMVectorReplicate((float)(end - i))));
+			if (XMVector4EqualInt(touching, XMVectorFalseInt()))
+				continue;
+
+			// Estimated contribution: the shader's range falloff at the
+			// object's closest point, times how bright the light is
+			XMVECTOR gap = XMVectorMax(XMVectorSubtract(XMVectorSqrt(distSq), objectRadius), zero);
+			XMVECTOR falloff = XMVectorSaturate(XMVectorSubtract(one, XMVectorDivide(XMVectorMultiply(gap, gap), XMVectorMultiply(range, range))));
+			XMVECTOR score = XMVectorMultiply(XMLoadFloat4((const XMFLOAT4*)&lightWeight[i]), XMVectorMultiply(falloff, falloff));
+
+			// Only the lanes that touch and score anything, as bits
+			XMVECTOR scoring = XMVectorAndInt(touching, XMVectorGreater(score, zero));
+			unsigned int lanes = (unsigned int)XMVectorGetX(XMVector4Dot(XMVectorAndInt(scoring, laneBits), one));
+
+			XMFLOAT4 scores;
+			XMStoreFloat4(&scores, score);
+			const float* laneScores = &scores.x;
+
+			for (; lanes != 0; lanes &= lanes - 1)
+			{
+				unsigned int lane = (unsigned int)std::countr_zero(lanes);
+				float s = laneScores[lane];
+
+				// Can't make the list even with the bonus
+				if (s * bonus < std::bit_cast<float>((uint32_t)(best[slots - 1] >> 32)))
+					continue;
+
+				uint32_t light = localLights[i + lane];
+				bool had = false;
+				for (unsigned int h = 0; h < MaxLightsPerObject; h++)
+					had |= (h < previous.count) & (previous.lights[h] == light);
+				s *= had ? hysteresis : 1.0f;
+
+				// Insert in key order without branching on where, the list
+				// shuffling down past it.  A positive float's bits sort as
+				// it does, and the light index goes in flipped so the lower
+				// one wins a tie - cells aren't visited in light order.
+				uint64_t key = ((uint64_t)std::bit_cast<uint32_t>(s) << 32) | (uint32_t)~light;
+				for (unsigned int k = MaxLightsPerObject - 1; k > 0; k--)
+					best[k] = key > best[k - 1] ? best[k - 1] : (std::max)(key, best[k]);
+				best[0] = (std::max)(key, best[0]);
+			}
+		}
+	};
+
+	if (slots > 0)
+	{
+		scan(cellStart[0], cellStart[1]);
+
+		// The cells a light reaching the object could be centred in
+		const float reach = radius + gridRange;
+		const float position[3] = { center.x - gridOrigin.x, center.y - gridOrigin.y, center.z - gridOrigin.z };
+		int lo[3];
+		int hi[3];
+		bool inGrid = true;
+		for (int a = 0; a < 3; a++)
+		{
+			float first = floorf((position[a] - reach) / cellSize);
+			float last = floorf((position[a] + reach) / cellSize);
+			if (!(last >= 0.0f && first < (float)gridDims[a]))
+			{
+				inGrid = false;
+				break;
+			}
+			lo[a] = (int)(std::max)(first, 0.0f);
+			hi[a] = (int)(std::min)(last, (float)(gridDims[a] - 1));
+		}
+
+		// Each row of cells is one span, x running fastest
+		for (int z = lo[2]; inGrid && z <= hi[2]; z++)
+		{
+			for (int y = lo[1]; y <= hi[1]; y++)
+			{
+				size_t row = 1 + (size_t)(z * gridDims[1] + y) * gridDims[0];
+				scan(cellStart[row + lo[0]], cellStart[row + hi[0] + 1]);
+			}
+		}
+	}
+
+	for (unsigned int k = 0; k < slots && best[k] != 0; k++)
+		lightsOut[count++] = ~(uint32_t)best[k];
+
+	std::sort(lightsOut, lightsOut + count);
+
+	memcpy(previous.lights, lightsOut, count * sizeof(uint32_t));
+	previous.count = count;
+	return count;
+}
+
+uint32_t ObjectLightSelector::Remap(uint32_t light)
+{
+	stats.selections++;
+	if (remap[light] == NotUploaded)
+	{
+		remap[light] = (uint32_t)uploadOrder.size();
+		uploadOrder.push_back(light);
+		stats.uploadedLights = uploadOrder.size();
+	}
+	return remap[light];
+}
+
+void ObjectLightSelector::Upload()
+{
+	// Grown by doubling, never empty so there's always something to bind
+	if (uploadOrder.size() > lightCapacity || !lightBuffer.IsValid())
+	{
+		if (lightBuffer.IsValid())
+			backend.DestroyBuffer(lightBuffer);
+		lightCapacity = (std::max)((std::max)(uploadOrder.size(), lightCapacity * 2), (size_t)64);
+
+		BufferDesc desc;
+		desc.type = BufferType::Structured;
+		desc.usage = BufferUsage::Dynamic;
+		desc.size = lightCapacity * sizeof(Light);
+		desc.stride = sizeof(Light);
+		lightBuffer = backend.CreateBuffer(desc);
+	}
+
+	Light* mapped = (Light*)backend.Map(lightBuffer, MapMode::WriteDiscard);
+	if (!mapped)
+		return;
+
+	for (size_t slot = 0; slot < uploadOrder.size(); slot++)
+		mapped[slot] = (*lights)[uploadOrder[slot]];
+	backend.Unmap(lightBuffer);
+}
+
+void ObjectLightSelector::Bind(IRenderBackend& context, ShaderStage stage, unsigned int slot) const
+{
+	context.SetShaderBuffer(stage, slot, lightBuffer);
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <DirectXMath.h>
+#include "RenderBackend.h"
+#include "Lights.h"
+
+// --------------------------------------------------------
+// Counts from the last frame
+// --------------------------------------------------------
+struct ObjectLightStats
+{
+	size_t lights = 0;
+	size_t selections = 0;		// Lights handed out over all objects
+	size_t uploadedLights = 0;	// Distinct lights any object selected
+};
+
+// --------------------------------------------------------
+// Per-object light selection for plain forward shading - the
+// lighter alternative to the LightClusterGrid.
+//
+// Each object gets up to MaxLightsPerObject lights:
+//  - every directional light (they reach everything), then
+//  - the point/spot lights whose range sphere touches the
+//    object's bounding sphere, best estimated contribution
+//    first: intensity * luminance * range falloff at the
+//    object's closest point
+//
+// Point and spot lights are binned into a uniform grid each
+// frame, by their centres, cells half the median range across.
+// An object only tests the cells its bounding sphere could be
+// reached from; lights ranging over four times the median go
+// in a list every object tests instead, so one huge light
+// doesn't make every query wide.  The lights are kept in packed
+// x/y/z/range arrays, cell after cell with x running fastest,
+// so a row of cells is one span and four lights are tested per
+// SIMD instruction.  Spot cones are ignored - a spot light is
+// treated as its range sphere.
+//
+// Lights an object had last frame get a score bonus, so small
+// changes in intensity or position don't swap lights back and
+// forth (visible popping).  The picked lights are handed back
+// in light index order so the shader's loop order is stable too.
+//
+// Only lights some object picked are uploaded: Remap() turns a
+// light index into its slot in the upload buffer.
+// --------------------------------------------------------
+class ObjectLightSelector
+{
+public:
+	static const unsigned int MaxLightsPerObject = 8;
+
+	explicit ObjectLightSelector(IRenderBackend& backend);
+	~ObjectLightSelector();
+
+	ObjectLightSelector(const ObjectLightSelector&) = delete;
+	ObjectLightSelector& operator=(const ObjectLightSelector&) = delete;
+
+	// Packs the lights for this frame's Select() calls.  Object ids
+	// passed to Select() must be below objectCount.  The lights
+	// have to stay alive until Upload().
+	void BeginFrame(const std::vector<Light>& lights, size_t objectCount);
+
+	// Fills lightsOut with light indices, returns how many.  Safe to
+	// call from several threads at once for different objects.
+	unsigned int Select(uint32_t objectId, const DirectX::XMFLOAT3& center, float radius, uint32_t lightsOut[MaxLightsPerObject]);
+
+	// Single-threaded, after every Select(): light index -> slot in
+	// the uploaded buffer
+	uint32_t Remap(uint32_t light);
+
+	// Writes every remapped light - immediate context only
+	void Upload();
+	void Bind(IRenderBackend& context, ShaderStage stage, unsigned int slot) const;
+
+	// Score multiplier for lights an object had last frame, 1 = none
+	void SetHysteresis(float bonus) { hysteresis = bonus; }
+
+	const ObjectLightStats& GetStats() const { return stats; }
+
+private:
+	static constexpr uint32_t NotUploaded = 0xFFFFFFFF;
+
+	// Last frame's picks, per object
+	struct History
+	{
+		uint32_t lights[MaxLightsPerObject] = {};
+		unsigned int count = 0;
+	};
+
+	IRenderBackend& backend;
+	const std::vector<Light>* lights = nullptr;
+
+	// Point and spot lights: the wide ones, then cell by cell,
+	// followed by three lights that can't touch anything so a span
+	// can always be read four at a time
+	std::vector<float> lightX;
+	std::vector<float> lightY;
+	std::vector<float> lightZ;
+	std::vector<float> lightRange;
+	std::vector<float> lightWeight;		// Intensity * luminance
+	std::vector<uint32_t> localLights;	// Index into lights
+	std::vector<uint32_t> directionalLights;
+
+	// The grid.  Bucket 0 holds the wide lights and bucket c + 1
+	// cell c; cellStart has each bucket's first light, plus the end.
+	static const int MaxGridDim = 32;
+	std::vector<uint32_t> cellStart;
+	std::vector<uint32_t> lightBucket;	// Per local light, while binning
+	float gridRange = 0.0f;				// The longest range in the grid
+	float cellSize = 1.0f;
+	DirectX::XMFLOAT3 gridOrigin = {};
+	int gridDims[3] = { 1, 1, 1 };
+
+	std::vector<History> history;
+	float hysteresis = 1.25f;
+
+	std::vector<uint32_t> remap;		// Per light, NotUploaded if unused
+	std::vector<uint32_t> uploadOrder;	// Per upload slot, the light
+
+	BufferHandle lightBuffer;
+	size_t lightCapacity = 0;
+
+	ObjectLightStats stats;
+};
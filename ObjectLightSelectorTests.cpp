@@ -0,0 +1,249 @@
+#include "ObjectLightSelectorTests.h"
+#include "HeadlessTests.h"
+#include "RecordingBackend.h"
+#include "JobSystem.h"
+#include "ObjectLightSelector.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+	struct SelectionFrameResult
+	{
+		double selectMs = 0.0;
+		double uploadMs = 0.0;
+		size_t changedObjects = 0;	// Picked something different from last frame
+	};
+
+	// --------------------------------------------------------
+	// Runs the selector over every sphere for a number of frames,
+	// jittering light intensities by up to +-jitter each frame.
+	// firstFrame/firstCounts get the first frame's picks.
+	// --------------------------------------------------------
+	SelectionFrameResult RunSelectionFrames(
+		ObjectLightSelector& selector,
+		JobSystem& jobSystem,
+		std::vector<Light> lights,
+		const std::vector<XMFLOAT4>& spheres,
+		int frames,
+		float jitter,
+		std::vector<uint32_t>* firstFrame,
+		std::vector<unsigned int>* firstCounts)
+	{
+		const unsigned int maxLights = ObjectLightSelector::MaxLightsPerObject;
+		std::vector<uint32_t> picks(spheres.size() * maxLights);
+		std::vector<uint32_t> previousPicks(picks.size());
+		std::vector<unsigned int> counts(spheres.size());
+		std::vector<unsigned int> previousCounts(spheres.size());
+		std::vector<float> baseIntensity(lights.size());
+		for (size_t i = 0; i < lights.size(); i++)
+			baseIntensity[i] = lights[i].Intensity;
+
+		std::mt19937 rng(7);
+		std::uniform_real_distribution<float> noise(-jitter, jitter);
+
+		SelectionFrameResult result;
+		for (int f = 0; f < frames; f++)
+		{
+			if (jitter > 0.0f)
+			{
+				for (size_t i = 0; i < lights.size(); i++)
+					lights[i].Intensity = baseIntensity[i] * (1.0f + noise(rng));
+			}
+
+			auto t0 = std::chrono::high_resolution_clock::now();
+			selector.BeginFrame(lights, spheres.size());
+			jobSystem.ParallelFor(spheres.size(), 256, [&](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; i++)
+				{
+					const XMFLOAT4& s = spheres[i];
+					counts[i] = selector.Select((uint32_t)i, XMFLOAT3(s.x, s.y, s.z), s.w, &picks[i * maxLights]);
+				}
+			});
+			auto t1 = std::chrono::high_resolution_clock::now();
+
+			// Remapping in place would hide what was picked, so use a copy
+			for (size_t i = 0; i < spheres.size(); i++)
+			{
+				for (unsigned int k = 0; k < counts[i]; k++)
+					selector.Remap(picks[i * maxLights + k]);
+			}
+			selector.Upload();
+			auto t2 = std::chrono::high_resolution_clock::now();
+
+			result.selectMs += Milliseconds(t1 - t0);
+			result.uploadMs += Milliseconds(t2 - t1);
+
+			if (f == 0 && firstFrame)
+			{
+				*firstFrame = picks;
+				*firstCounts = counts;
+			}
+
+			if (f > 0)
+			{
+				for (size_t i = 0; i < spheres.size(); i++)
+				{
+					if (counts[i] != previousCounts[i] ||
+						!std::equal(&picks[i * maxLights], &picks[i * maxLights] + counts[i], &previousPicks[i * maxLights]))
+						result.changedObjects++;
+				}
+			}
+
+			picks.swap(previousPicks);
+			counts.swap(previousCounts);
+		}
+
+		int count = frames > 0 ? frames : 1;
+		result.selectMs /= count;
+		result.uploadMs /= count;
+		return result;
+	}
+
+	// --------------------------------------------------------
+	// One light at a time, no SIMD and no history - what
+	// Select() should pick on an object's first frame
+	// --------------------------------------------------------
+	unsigned int ReferenceSelect(const std::vector<Light>& lights, const XMFLOAT4& sphere, uint32_t out[ObjectLightSelector::MaxLightsPerObject])
+	{
+		const unsigned int maxLights = ObjectLightSelector::MaxLightsPerObject;
+		std::vector<std::pair<float, uint32_t>> scored;
+		std::vector<uint32_t> picks;
+
+		for (size_t i = 0; i < lights.size(); i++)
+		{
+			const Light& light = lights[i];
+			if (light.Type == LIGHT_TYPE_DIRECTIONAL)
+			{
+				if (picks.size() < maxLights)
+					picks.push_back((uint32_t)i);
+				continue;
+			}
+
+			float dx = light.Position.x - sphere.x;
+			float dy = light.Position.y - sphere.y;
+			float dz = light.Position.z - sphere.z;
+			float dist = sqrtf(dx * dx + dy * dy + dz * dz);
+			if (!(light.Range > 0.0f) || dist >= light.Range + sphere.w)
+				continue;
+
+			float gap = (std::max)(dist - sphere.w, 0.0f);
+			float falloff = (std::min)((std::max)(1.0f - gap * gap / (light.Range * light.Range), 0.0f), 1.0f);
+			float weight = light.Intensity * (0.2126f * light.Color.x + 0.7152f * light.Color.y + 0.0722f * light.Color.z);
+			float score = weight * falloff * falloff;
+			if (score > 0.0f)
+				scored.push_back({ -score, (uint32_t)i });
+		}
+
+		std::sort(scored.begin(), scored.end());
+		for (size_t k = 0; k < scored.size() && picks.size() < maxLights; k++)
+			picks.push_back(scored[k].second);
+
+		std::sort(picks.begin(), picks.end());
+		std::copy(picks.begin(), picks.end(), out);
+		return (unsigned int)picks.size();
+	}
+}
+
+int RunLightSelectionBench(const LightSelectionBenchSettings& settings)
+{
+	RecordingBackend backend;
+	bool failed = false;
+
+	{
+		int threads = settings.threadCount > 0 ? settings.threadCount : (int)std::thread::hardware_concurrency();
+		JobSystem jobSystem((std::max)(threads, 1) - 1);
+		ObjectLightSelector selector(backend);
+
+		// One sun and a box of point lights, entities spread through the
+		// same box so most of them are in range of several lights
+		std::mt19937 rng(3);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+		std::vector<Light> lights(1);
+		lights[0].Type = LIGHT_TYPE_DIRECTIONAL;
+		lights[0].Direction = XMFLOAT3(0.577f, -0.577f, 0.577f);
+		lights[0].Color = XMFLOAT3(1, 1, 1);
+		lights[0].Intensity = 1.0f;
+
+		for (int i = 0; i < settings.lightCount; i++)
+		{
+			Light light = {};
+			light.Type = LIGHT_TYPE_POINT;
+			light.Position = XMFLOAT3(unit(rng) * 100.0f, unit(rng) * 10.0f, unit(rng) * 100.0f);
+			light.Range = 4.0f + unit(rng) * 8.0f;
+			light.Color = XMFLOAT3(unit(rng), unit(rng), unit(rng));
+			light.Intensity = 0.5f + unit(rng);
+			lights.push_back(light);
+		}
+
+		// A few reaching far enough to be kept out of the grid
+		for (int i = 0; i < 3 && settings.lightCount > 0; i++)
+		{
+			Light light = lights[1 + i * settings.lightCount / 3];
+			light.Range = 60.0f;
+			light.Intensity *= 0.25f;
+			lights.push_back(light);
+		}
+
+		std::vector<XMFLOAT4> spheres(settings.entityCount);
+		for (XMFLOAT4& s : spheres)
+			s = XMFLOAT4(unit(rng) * 100.0f, unit(rng) * 10.0f, unit(rng) * 100.0f, 0.5f + unit(rng) * 1.5f);
+
+		printf("Light selection bench: %d lights, %d entities, up to %u lights each, %d frames, %u threads\n",
+			settings.lightCount,
+			settings.entityCount,
+			ObjectLightSelector::MaxLightsPerObject,
+			settings.frames,
+			jobSystem.GetThreadCount());
+
+		// Static scene
+		std::vector<uint32_t> firstFrame;
+		std::vector<unsigned int> firstCounts;
+		SelectionFrameResult still = RunSelectionFrames(selector, jobSystem, lights, spheres, settings.frames, 0.0f, &firstFrame, &firstCounts);
+		const ObjectLightStats& stats = selector.GetStats();
+		printf("  select %.3f ms, remap + upload %.3f ms\n", still.selectMs, still.uploadMs);
+		printf("  %zu lights picked (%.2f per entity), %zu distinct uploaded\n",
+			stats.selections,
+			spheres.empty() ? 0.0 : (double)stats.selections / spheres.size(),
+			stats.uploadedLights);
+
+		// First frame against the scalar ranking
+		size_t referenceMismatches = 0;
+		const unsigned int maxLights = ObjectLightSelector::MaxLightsPerObject;
+		for (size_t i = 0; i < spheres.size(); i++)
+		{
+			uint32_t expected[ObjectLightSelector::MaxLightsPerObject];
+			unsigned int count = ReferenceSelect(lights, spheres[i], expected);
+			if (count != firstCounts[i] || !std::equal(expected, expected + count, &firstFrame[i * maxLights]))
+				referenceMismatches++;
+		}
+		printf("  scalar reference: %zu entities differ\n", referenceMismatches);
+		printf("  static scene: %zu entities changed picks\n", still.changedObjects);
+
+		// Flickering lights, with and without hysteresis
+		SelectionFrameResult noisy = RunSelectionFrames(selector, jobSystem, lights, spheres, settings.frames, 0.02f, nullptr, nullptr);
+		selector.SetHysteresis(1.0f);
+		SelectionFrameResult noisyNoHysteresis = RunSelectionFrames(selector, jobSystem, lights, spheres, settings.frames, 0.02f, nullptr, nullptr);
+		printf("  +-2%% intensity jitter: %zu entity changes over %d frames (%zu without hysteresis)\n",
+			noisy.changedObjects,
+			settings.frames,
+			noisyNoHysteresis.changedObjects);
+
+		if (referenceMismatches > 0 || still.changedObjects > 0 || noisy.changedObjects > 0)
+			failed = true;
+	}
+
+	if (ReportValidation(backend) > 0)
+		failed = true;
+	return failed ? 1 : 0;
+}
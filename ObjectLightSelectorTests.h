@@ -0,0 +1,29 @@
+#pragma once
+
+// --------------------------------------------------------
+// Headless CPU benchmark of per-object light selection.
+//
+// Scatters point lights and entity bounding spheres through the
+// same box, with a few lights of far longer range than the rest,
+// and times ObjectLightSelector::Select() for every entity (in
+// parallel) plus the upload compaction each frame.
+//
+// Checks:
+//  - the first frame's picks match a plain scalar ranking
+//  - a static scene picks the same lights every frame
+//  - with light intensities jittering by a couple of percent,
+//    hysteresis keeps every pick the same (the count without
+//    hysteresis is printed for comparison)
+//
+// Returns 0 if all checks passed and the recording backend saw
+// no errors.
+// --------------------------------------------------------
+struct LightSelectionBenchSettings
+{
+	int lightCount = 1000;
+	int entityCount = 10000;
+	int frames = 100;
+	int threadCount = -1;	// Including the caller, negative = every hardware thread
+};
+
+int RunLightSelectionBench(const LightSelectionBenchSettings& settings);
@@ -0,0 +1,451 @@
+#include "OcclusionCuller.h"
+#include "CpuFeatures.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#if HAS_AVX2_PATHS
+#include <immintrin.h>
+#endif
+
+using namespace DirectX;
+
+namespace
+{
+#if HAS_AVX2_PATHS
+	// RasterizeTriangle()'s rows eight pixels at a time: edge
+	// functions a * x + b * y + c, depth zx * x + zy * y + zc.
+	// startX is a multiple of eight, and the rows lie in one tile,
+	// so every group of eight does too.
+	AVX2_FUNCTION void RasterizeRowsAvx2(const float a[3], const float b[3], const float c[3], float zx, float zy, float zc,
+		unsigned int startX, unsigned int endX, unsigned int startY, unsigned int endY, float* depth, unsigned int width)
+	{
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 offsets = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+		const __m256 a0 = _mm256_set1_ps(a[0]);
+		const __m256 a1 = _mm256_set1_ps(a[1]);
+		const __m256 a2 = _mm256_set1_ps(a[2]);
+		const __m256 depthX = _mm256_set1_ps(zx);
+
+		for (unsigned int y = startY; y < endY; y++)
+		{
+			float py = (float)y + 0.5f;
+			__m256 row0 = _mm256_set1_ps(b[0] * py + c[0]);
+			__m256 row1 = _mm256_set1_ps(b[1] * py + c[1]);
+			__m256 row2 = _mm256_set1_ps(b[2] * py + c[2]);
+			__m256 rowDepth = _mm256_set1_ps(zy * py + zc);
+			float* row = depth + (size_t)y * width;
+
+			for (unsigned int x = startX; x < endX; x += 8)
+			{
+				__m256 px = _mm256_add_ps(_mm256_set1_ps((float)x), offsets);
+				__m256 inside = _mm256_and_ps(
+					_mm256_and_ps(
+						_mm256_cmp_ps(_mm256_add_ps(_mm256_mul_ps(a0, px), row0), zero, _CMP_GE_OQ),
+						_mm256_cmp_ps(_mm256_add_ps(_mm256_mul_ps(a1, px), row1), zero, _CMP_GE_OQ)),
+					_mm256_cmp_ps(_mm256_add_ps(_mm256_mul_ps(a2, px), row2), zero, _CMP_GE_OQ));
+				if (_mm256_movemask_ps(inside) == 0)
+					continue;
+
+				__m256 z = _mm256_add_ps(_mm256_mul_ps(depthX, px), rowDepth);
+				__m256 current = _mm256_loadu_ps(row + x);
+				__m256 write = _mm256_and_ps(inside, _mm256_cmp_ps(z, current, _CMP_LT_OQ));
+				_mm256_storeu_ps(row + x, _mm256_blendv_ps(current, z, write));
+			}
+		}
+	}
+#endif
+}
+
+OcclusionCuller::OcclusionCuller(JobSystem& jobSystem, unsigned int width, unsigned int height)
+	: jobSystem(jobSystem),
+	width(((std::max)(width, 1u) + TileSize - 1) / TileSize * TileSize),
+	height(((std::max)(height, 1u) + TileSize - 1) / TileSize * TileSize)
+{
+	tilesX = this->width / TileSize;
+	tilesY = this->height / TileSize;
+
+	tileLevels = 1;
+	for (unsigned int size = TileSize; size > 1; size /= 2)
+		tileLevels++;
+
+	// Whole tiles halve exactly; past a tile, round up until 1 x 1
+	unsigned int w = this->width;
+	unsigned int h = this->height;
+	while (true)
+	{
+		DepthLevel level;
+		level.width = w;
+		level.height = h;
+		level.depth.assign((size_t)w * h, 1.0f);
+		levels.push_back(std::move(level));
+		if (w == 1 && h == 1)
+			break;
+		w = (w + 1) / 2;
+		h = (h + 1) / 2;
+	}
+
+	XMStoreFloat4x4(&viewProjection, XMMatrixIdentity());
+	frustum = Frustum::FromViewProjection(viewProjection);
+}
+
+void OcclusionCuller::BeginFrame(const XMFLOAT4X4& viewProjection)
+{
+	this->viewProjection = viewProjection;
+	frustum = Frustum::FromViewProjection(viewProjection);
+	occluders.clear();
+}
+
+void OcclusionCuller::AddOccluder(const Mesh& mesh, const XMFLOAT4X4& world)
+{
+	occluders.push_back({ &mesh, world });
+}
+
+void OcclusionCuller::Rasterize()
+{
+	const size_t tileCount = (size_t)tilesX * tilesY;
+	const size_t chunkCount = JobSystem::GetChunkCount(occluders.size(), OccludersPerChunk);
+	if (chunks.size() < chunkCount)
+		chunks.resize(chunkCount);
+
+	// Cleared here rather than in the bin job - ParallelFor() may hand
+	// the whole range to one job, leaving later chunks untouched
+	for (size_t c = 0; c < chunkCount; c++)
+	{
+		ChunkData& chunk = chunks[c];
+		chunk.triangles.clear();
+		chunk.bins.resize(tileCount);
+		for (std::vector<uint32_t>& bin : chunk.bins)
+			bin.clear();
+		chunk.skippedOccluders = 0;
+		chunk.triangleCount = 0;
+		chunk.binnedCount = 0;
+	}
+	activeChunks = chunkCount;
+
+	// 1. Bin ------------------------------------------------------------------
+	jobSystem.ParallelFor(occluders.size(), OccludersPerChunk, [&](size_t begin, size_t end)
+	{
+		ChunkData& chunk = chunks[begin / OccludersPerChunk];
+		for (size_t i = begin; i < end; i++)
+			BinOccluder(chunk, occluders[i]);
+	});
+
+	// 2. Raster, and the pyramid levels inside each tile ----------------------
+	jobSystem.ParallelFor(tileCount, 1, [&](size_t begin, size_t end)
+	{
+		for (size_t tile = begin; tile < end; tile++)
+			RasterizeTile((unsigned int)tile);
+	});
+
+	// The levels coarser than a tile are small enough to do here
+	for (size_t l = tileLevels; l < levels.size(); l++)
+	{
+		const DepthLevel& source = levels[l - 1];
+		DepthLevel& level = levels[l];
+		for (unsigned int y = 0; y < level.height; y++)
+		{
+			unsigned int y0 = y * 2;
+			unsigned int y1 = (std::min)(y0 + 1, source.height - 1);
+			for (unsigned int x = 0; x < level.width; x++)
+			{
+				unsigned int x0 = x * 2;
+				unsigned int x1 = (std::min)(x0 + 1, source.width - 1);
+				level.depth[(size_t)y * level.width + x] = (std::max)(
+					(std::max)(source.depth[(size_t)y0 * source.width + x0], source.depth[(size_t)y0 * source.width + x1]),
+					(std::max)(source.depth[(size_t)y1 * source.width + x0], source.depth[(size_t)y1 * source.width + x1]));
+			}
+		}
+	}
+
+	stats = OcclusionStats();
+	stats.occluders = occluders.size();
+	for (size_t c = 0; c < chunkCount; c++)
+	{
+		stats.skippedOccluders += chunks[c].skippedOccluders;
+		stats.triangles += chunks[c].triangleCount;
+		stats.binnedTriangles += chunks[c].binnedCount;
+	}
+}
+
+void OcclusionCuller::BinOccluder(ChunkData& chunk, const Occluder& occluder)
+{
+	const Mesh& mesh = *occluder.mesh;
+	if (!frustum.Intersects(mesh.GetLocalBounds().Transformed(occluder.world)))
+	{
+		chunk.skippedOccluders++;
+		return;
+	}
+
+	XMMATRIX worldViewProjection = XMMatrixMultiply(XMLoadFloat4x4(&occluder.world), XMLoadFloat4x4(&viewProjection));
+	const std::vector<XMFLOAT3>& positions = mesh.GetPositions();
+	chunk.clipPositions.resize(positions.size());
+	for (size_t i = 0; i < positions.size(); i++)
+		XMStoreFloat4(&chunk.clipPositions[i], XMVector3Transform(XMLoadFloat3(&positions[i]), worldViewProjection));
+
+	const std::vector<unsigned int>& indices = mesh.GetIndices();
+	for (size_t i = 0; i + 2 < indices.size(); i += 3)
+	{
+		XMFLOAT4 triangle[3] =
+		{
+			chunk.clipPositions[indices[i]],
+			chunk.clipPositions[indices[i + 1]],
+			chunk.clipPositions[indices[i + 2]]
+		};
+		AddTriangle(chunk, triangle);
+	}
+}
+
+void OcclusionCuller::AddTriangle(ChunkData& chunk, const XMFLOAT4* clip)
+{
+	chunk.triangleCount++;
+
+	// Entirely past one side of the view
+	if ((clip[0].x > clip[0].w && clip[1].x > clip[1].w && clip[2].x > clip[2].w) ||
+		(clip[0].x < -clip[0].w && clip[1].x < -clip[1].w && clip[2].x < -clip[2].w) ||
+		(clip[0].y > clip[0].w && clip[1].y > clip[1].w && clip[2].y > clip[2].w) ||
+		(clip[0].y < -clip[0].w && clip[1].y < -clip[1].w && clip[2].y < -clip[2].w) ||
+		(clip[0].z > clip[0].w && clip[1].z > clip[1].w && clip[2].z > clip[2].w))
+		return;
+
+	// Clip to the near plane (z >= 0), which can leave a quad
+	XMFLOAT4 polygon[4];
+	int count = 0;
+	for (int i = 0; i < 3; i++)
+	{
+		const XMFLOAT4& a = clip[i];
+		const XMFLOAT4& b = clip[(i + 1) % 3];
+		if (a.z >= 0.0f)
+			polygon[count++] = a;
+		if ((a.z >= 0.0f) != (b.z >= 0.0f))
+		{
+			float t = a.z / (a.z - b.z);
+			XMStoreFloat4(&polygon[count++], XMVectorLerp(XMLoadFloat4(&a), XMLoadFloat4(&b), t));
+		}
+	}
+	if (count < 3)
+		return;
+
+	// To pixels, y down
+	float sx[4];
+	float sy[4];
+	float sz[4];
+	for (int i = 0; i < count; i++)
+	{
+		float invW = 1.0f / polygon[i].w;
+		sx[i] = (polygon[i].x * invW * 0.5f + 0.5f) * width;
+		sy[i] = (0.5f - polygon[i].y * invW * 0.5f) * height;
+		sz[i] = polygon[i].z * invW;
+	}
+
+	for (int i = 1; i + 1 < count; i++)
+	{
+		ScreenTriangle triangle =
+		{
+			{ sx[0], sx[i], sx[i + 1] },
+			{ sy[0], sy[i], sy[i + 1] },
+			{ sz[0], sz[i], sz[i + 1] }
+		};
+
+		float minX = (std::min)((std::min)(triangle.x[0], triangle.x[1]), triangle.x[2]);
+		float maxX = (std::max)((std::max)(triangle.x[0], triangle.x[1]), triangle.x[2]);
+		float minY = (std::min)((std::min)(triangle.y[0], triangle.y[1]), triangle.y[2]);
+		float maxY = (std::max)((std::max)(triangle.y[0], triangle.y[1]), triangle.y[2]);
+		if (maxX <= 0.0f || maxY <= 0.0f || minX >= (float)width || minY >= (float)height)
+			continue;
+
+		unsigned int tx0 = (unsigned int)(std::max)(minX, 0.0f) / TileSize;
+		unsigned int ty0 = (unsigned int)(std::max)(minY, 0.0f) / TileSize;
+		unsigned int tx1 = (unsigned int)(std::min)(maxX, (float)(width - 1)) / TileSize;
+		unsigned int ty1 = (unsigned int)(std::min)(maxY, (float)(height - 1)) / TileSize;
+
+		uint32_t index = (uint32_t)chunk.triangles.size();
+		chunk.triangles.push_back(triangle);
+		for (unsigned int ty = ty0; ty <= ty1; ty++)
+		{
+			for (unsigned int tx = tx0; tx <= tx1; tx++)
+				chunk.bins[ty * tilesX + tx].push_back(index);
+		}
+		chunk.binnedCount += (size_t)(tx1 - tx0 + 1) * (ty1 - ty0 + 1);
+	}
+}
+
+void OcclusionCuller::RasterizeTile(unsigned int tile)
+{
+	unsigned int tx = tile % tilesX;
+	unsigned int ty = tile / tilesX;
+	unsigned int x0 = tx * TileSize;
+	unsigned int y0 = ty * TileSize;
+
+	DepthLevel& depth = levels[0];
+	for (unsigned int y = y0; y < y0 + TileSize; y++)
+		std::fill_n(&depth.depth[(size_t)y * width + x0], TileSize, 1.0f);
+
+	for (size_t c = 0; c < activeChunks; c++)
+	{
+		const ChunkData& chunk = chunks[c];
+		for (uint32_t index : chunk.bins[tile])
+			RasterizeTriangle(chunk.triangles[index], x0, y0, x0 + TileSize, y0 + TileSize);
+	}
+
+	// This tile's part of each level, down to one texel
+	for (unsigned int l = 1; l < tileLevels; l++)
+	{
+		const DepthLevel& source = levels[l - 1];
+		DepthLevel& level = levels[l];
+		unsigned int size = TileSize >> l;
+		for (unsigned int y = ty * size; y < (ty + 1) * size; y++)
+		{
+			const float* row0 = &source.depth[(size_t)(y * 2) * source.width];
+			const float* row1 = row0 + source.width;
+			for (unsigned int x = tx * size; x < (tx + 1) * size; x++)
+			{
+				level.depth[(size_t)y * level.width + x] = (std::max)(
+					(std::max)(row0[x * 2], row0[x * 2 + 1]),
+					(std::max)(row1[x * 2], row1[x * 2 + 1]));
+			}
+		}
+	}
+}
+
+void OcclusionCuller::RasterizeTriangle(const ScreenTriangle& t, unsigned int x0, unsigned int y0, unsigned int x1, unsigned int y1)
+{
+	float area = (t.x[1] - t.x[0]) * (t.y[2] - t.y[0]) - (t.x[2] - t.x[0]) * (t.y[1] - t.y[0]);
+	if (!(fabsf(area) > 0.0f))
+		return;
+
+	// Edge functions a * x + b * y + c, positive inside whichever way
+	// the triangle winds
+	float sign = area > 0.0f ? 1.0f : -1.0f;
+	float a[3];
+	float b[3];
+	float c[3];
+	for (int i = 0; i < 3; i++)
+	{
+		int j = (i + 1) % 3;
+		a[i] = sign * (t.y[i] - t.y[j]);
+		b[i] = sign * (t.x[j] - t.x[i]);
+		c[i] = sign * (t.x[i] * t.y[j] - t.x[j] * t.y[i]);
+	}
+
+	// Depth is linear in screen space
+	float zx = ((t.z[1] - t.z[0]) * (t.y[2] - t.y[0]) - (t.z[2] - t.z[0]) * (t.y[1] - t.y[0])) / area;
+	float zy = ((t.x[1] - t.x[0]) * (t.z[2] - t.z[0]) - (t.x[2] - t.x[0]) * (t.z[1] - t.z[0])) / area;
+	float zc = t.z[0] - zx * t.x[0] - zy * t.y[0];
+
+	// Triangle's box within the tile, in groups of eight pixels with
+	// AVX2 and four without
+	float minX = (std::min)((std::min)(t.x[0], t.x[1]), t.x[2]);
+	float maxX = (std::max)((std::max)(t.x[0], t.x[1]), t.x[2]);
+	float minY = (std::min)((std::min)(t.y[0], t.y[1]), t.y[2]);
+	float maxY = (std::max)((std::max)(t.y[0], t.y[1]), t.y[2]);
+	unsigned int startX = (unsigned int)(std::min)((std::max)(minX, (float)x0), (float)x1);
+	unsigned int endX = (unsigned int)(std::min)((std::max)(ceilf(maxX), (float)x0), (float)x1);
+	unsigned int startY = (unsigned int)(std::min)((std::max)(minY, (float)y0), (float)y1);
+	unsigned int endY = (unsigned int)(std::min)((std::max)(ceilf(maxY), (float)y0), (float)y1);
+
+	float* depth = levels[0].depth.data();
+#if HAS_AVX2_PATHS
+	static_assert(TileSize % 8 == 0, "Groups of eight pixels have to stay in a tile");
+	if (CpuHasAvx2())
+	{
+		RasterizeRowsAvx2(a, b, c, zx, zy, zc, startX & ~7u, endX, startY, endY, depth, width);
+		return;
+	}
+#endif
+	startX &= ~3u;
+
+	const XMVECTOR zero = XMVectorZero();
+	const XMVECTOR offsets = XMVectorSet(0.5f, 1.5f, 2.5f, 3.5f);
+	const XMVECTOR a0 = XMVectorReplicate(a[0]);
+	const XMVECTOR a1 = XMVectorReplicate(a[1]);
+	const XMVECTOR a2 = XMVectorReplicate(a[2]);
+	const XMVECTOR depthX = XMVectorReplicate(zx);
+
+	for (unsigned int y = startY; y < endY; y++)
+	{
+		float py = (float)y + 0.5f;
+		XMVECTOR row0 = XMVectorReplicate(b[0] * py + c[0]);
+		XMVECTOR row1 = XMVectorReplicate(b[1] * py + c[1]);
+		XMVECTOR row2 = XMVectorReplicate(b[2] * py + c[2]);
+		XMVECTOR rowDepth = XMVectorReplicate(zy * py + zc);
+		float* row = depth + (size_t)y * width;
+
+		for (unsigned int x = startX; x < endX; x += 4)
+		{
+			XMVECTOR px = XMVectorAdd(XMVectorReplicate((float)x), offsets);
+			XMVECTOR inside = XMVectorAndInt(
+				XMVectorAndInt(
+					XMVectorGreaterOrEqual(XMVectorMultiplyAdd(a0, px, row0), zero),
+					XMVectorGreaterOrEqual(XMVectorMultiplyAdd(a1, px, row1), zero)),
+				XMVectorGreaterOrEqual(XMVectorMultiplyAdd(a2, px, row2), zero));
+			if (XMVector4EqualInt(inside, XMVectorFalseInt()))
+				continue;
+
+			XMVECTOR z = XMVectorMultiplyAdd(depthX, px, rowDepth);
+			XMVECTOR current = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(row + x));
+			XMVECTOR write = XMVectorAndInt(inside, XMVectorLess(z, current));
+			XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(row + x), XMVectorSelect(current, z, write));
+		}
+	}
+}
+
+bool OcclusionCuller::IsVisible(const AABB& worldBounds) const
+{
+	// The box's corners on screen, and its nearest depth
+	XMMATRIX m = XMLoadFloat4x4(&viewProjection);
+	XMVECTOR center = XMLoadFloat3(&worldBounds.center);
+	XMVECTOR extents = XMLoadFloat3(&worldBounds.extents);
+	float minX = FLT_MAX;
+	float minY = FLT_MAX;
+	float maxX = -FLT_MAX;
+	float maxY = -FLT_MAX;
+	float nearest = FLT_MAX;
+	for (int corner = 0; corner < 8; corner++)
+	{
+		XMVECTOR offset = XMVectorSet(
+			(corner & 1) ? 1.0f : -1.0f,
+			(corner & 2) ? 1.0f : -1.0f,
+			(corner & 4) ? 1.0f : -1.0f,
+			0.0f);
+		XMFLOAT4 clip;
+		XMStoreFloat4(&clip, XMVector3Transform(XMVectorMultiplyAdd(offset, extents, center), m));
+
+		// Crossing the near plane - too close to say
+		if (clip.z <= 0.0f)
+			return true;
+
+		float invW = 1.0f / clip.w;
+		float x = (clip.x * invW * 0.5f + 0.5f) * width;
+		float y = (0.5f - clip.y * invW * 0.5f) * height;
+		minX = (std::min)(minX, x);
+		maxX = (std::max)(maxX, x);
+		minY = (std::min)(minY, y);
+		maxY = (std::max)(maxY, y);
+		nearest = (std::min)(nearest, clip.z * invW);
+	}
+
+	// Off screen is the frustum's business
+	if (maxX < 0.0f || maxY < 0.0f || minX >= (float)width || minY >= (float)height)
+		return true;
+
+	unsigned int px0 = (unsigned int)(std::max)(minX, 0.0f);
+	unsigned int py0 = (unsigned int)(std::max)(minY, 0.0f);
+	unsigned int px1 = (unsigned int)(std::min)(maxX, (float)(width - 1));
+	unsigned int py1 = (unsigned int)(std::min)(maxY, (float)(height - 1));
+
+	// Coarsest level needed to cover the rectangle with 4 x 4 texels
+	unsigned int l = 0;
+	while (l + 1 < levels.size() && ((px1 >> l) - (px0 >> l) >= 4 || (py1 >> l) - (py0 >> l) >= 4))
+		l++;
+
+	const DepthLevel& level = levels[l];
+	for (unsigned int y = py0 >> l; y <= (py1 >> l); y++)
+	{
+		for (unsigned int x = px0 >> l; x <= (px1 >> l); x++)
+		{
+			if (nearest <= level.depth[(size_t)y * level.width + x])
+				return true;
+		}
+	}
+	return false;
+}
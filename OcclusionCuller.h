@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <DirectXMath.h>
+#include "Bounds.h"
+#include "JobSystem.h"
+#include "Mesh.h"
+
+// --------------------------------------------------------
+// Counts from the last Rasterize()
+// --------------------------------------------------------
+struct OcclusionStats
+{
+	size_t occluders = 0;			// Added this frame
+	size_t skippedOccluders = 0;	// Outside the view, never transformed
+	size_t triangles = 0;			// Transformed and set up
+	size_t binnedTriangles = 0;		// Triangle / tile pairs rasterized
+};
+
+// --------------------------------------------------------
+// Software occlusion culling: a small depth buffer of the
+// designated occluders, rasterized on the CPU, and a test of
+// screen space bounds against it.
+//
+// Rasterize() runs in two parallel steps on the job system:
+//  1. bin - chunks of occluders are culled against the view,
+//     transformed, clipped to the near plane and set up, and
+//     each triangle is listed in every tile its box touches.
+//     Each chunk has its own bins, so there's no sharing.
+//  2. raster - each tile clears and draws its triangles (in
+//     chunk order) eight pixels at a time with AVX2, or four
+//     with DirectXMath vectors on CPUs without it, then
+//     max-reduces itself into a depth pyramid.
+// The pyramid levels coarser than a tile are reduced after.
+//
+// Depth is D3D's: 0 at the near plane, cleared to 1, nearest
+// kept.  Each pyramid texel holds the farthest depth under it,
+// so IsVisible() can test a box's nearest depth against a few
+// texels at whichever level its screen rectangle spans 4 or
+// fewer.  Boxes crossing the near plane are always visible.
+//
+// Coverage is sampled at pixel centers like the GPU, so it's
+// not strictly conservative at occluder silhouettes - a box
+// peeking out by less than a pixel can be culled.  Occluders
+// are drawn double sided.
+// --------------------------------------------------------
+class OcclusionCuller
+{
+public:
+	static const unsigned int TileSize = 32;			// Pixels on a side
+	static const unsigned int OccludersPerChunk = 16;
+
+	// Rounded up to whole tiles
+	OcclusionCuller(JobSystem& jobSystem, unsigned int width = 256, unsigned int height = 128);
+
+	OcclusionCuller(const OcclusionCuller&) = delete;
+	OcclusionCuller& operator=(const OcclusionCuller&) = delete;
+
+	void BeginFrame(const DirectX::XMFLOAT4X4& viewProjection);
+
+	// The mesh must stay alive until Rasterize() returns, and only
+	// adds anything if it keeps its CPU geometry
+	void AddOccluder(const Mesh& mesh, const DirectX::XMFLOAT4X4& world);
+
+	void Rasterize();
+
+	// False if the box is hidden behind the occluders.  Safe from any
+	// thread once Rasterize() has returned.
+	bool IsVisible(const AABB& worldBounds) const;
+
+	unsigned int GetWidth() const { return width; }
+	unsigned int GetHeight() const { return height; }
+
+	// Level 0 is the depth buffer, each level halves it (rounding up)
+	unsigned int GetLevelCount() const { return (unsigned int)levels.size(); }
+	unsigned int GetLevelWidth(unsigned int level) const { return levels[level].width; }
+	unsigned int GetLevelHeight(unsigned int level) const { return levels[level].height; }
+	const float* GetLevelDepth(unsigned int level) const { return levels[level].depth.data(); }
+
+	const OcclusionStats& GetStats() const { return stats; }
+
+private:
+	struct Occluder
+	{
+		const Mesh* mesh;
+		DirectX::XMFLOAT4X4 world;
+	};
+
+	// A triangle in pixels, ready for edge functions
+	struct ScreenTriangle
+	{
+		float x[3];
+		float y[3];
+		float z[3];
+	};
+
+	struct ChunkData
+	{
+		std::vector<DirectX::XMFLOAT4> clipPositions;	// Scratch
+		std::vector<ScreenTriangle> triangles;
+		std::vector<std::vector<uint32_t>> bins;	// Triangle indices per tile
+		size_t skippedOccluders = 0;
+		size_t triangleCount = 0;
+		size_t binnedCount = 0;
+	};
+
+	struct DepthLevel
+	{
+		unsigned int width = 0;
+		unsigned int height = 0;
+		std::vector<float> depth;
+	};
+
+	JobSystem& jobSystem;
+	unsigned int width;
+	unsigned int height;
+	unsigned int tilesX;
+	unsigned int tilesY;
+	unsigned int tileLevels;	// Pyramid levels reduced inside a tile (level 0 included)
+
+	DirectX::XMFLOAT4X4 viewProjection;
+	Frustum frustum;
+	std::vector<Occluder> occluders;
+	std::vector<ChunkData> chunks;
+	size_t activeChunks = 0;		// Used by the last Rasterize()
+	std::vector<DepthLevel> levels;
+	OcclusionStats stats;
+
+	void BinOccluder(ChunkData& chunk, const Occluder& occluder);
+	void AddTriangle(ChunkData& chunk, const DirectX::XMFLOAT4* clip);
+	void RasterizeTile(unsigned int tile);
+	void RasterizeTriangle(const ScreenTriangle& triangle, unsigned int x0, unsigned int y0, unsigned int x1, unsigned int y1);
+};
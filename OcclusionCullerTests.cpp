@@ -0,0 +1,336 @@
+#include "OcclusionCullerTests.h"
+#include "HeadlessTests.h"
+#include "RecordingBackend.h"
+#include "Mesh.h"
+#include "JobSystem.h"
+#include "OcclusionCuller.h"
+#include "CpuFeatures.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+	struct OcclusionScene
+	{
+		std::vector<XMFLOAT4X4> occluders;	// World matrices of the unit cube
+		std::vector<AABB> occluderBounds;
+		std::vector<AABB> entities;
+	};
+
+	OcclusionScene BuildOcclusionScene(const OcclusionBenchSettings& settings)
+	{
+		OcclusionScene scene;
+		auto addOccluder = [&](XMFLOAT3 position, XMFLOAT3 scale)
+		{
+			XMFLOAT4X4 world;
+			XMStoreFloat4x4(&world, XMMatrixMultiply(
+				XMMatrixScaling(scale.x, scale.y, scale.z),
+				XMMatrixTranslation(position.x, position.y, position.z)));
+			scene.occluders.push_back(world);
+
+			AABB bounds;
+			bounds.center = position;
+			bounds.extents = XMFLOAT3(scale.x * 0.5f, scale.y * 0.5f, scale.z * 0.5f);
+			scene.occluderBounds.push_back(bounds);
+		};
+
+		// Storey k: floor slab at y = 4k, walls along z at x = +-3.5
+		// leaving a corridor down the middle and gaps at the ends
+		for (int k = 0; k < settings.storeys; k++)
+		{
+			float y = k * 4.0f;
+			addOccluder(XMFLOAT3(0, y, 0), XMFLOAT3(20.0f, 0.5f, 20.0f));
+			addOccluder(XMFLOAT3(-3.5f, y + 2.0f, 0), XMFLOAT3(0.3f, 3.5f, 14.0f));
+			addOccluder(XMFLOAT3(3.5f, y + 2.0f, 0), XMFLOAT3(0.3f, 3.5f, 14.0f));
+		}
+		addOccluder(XMFLOAT3(0, settings.storeys * 4.0f, 0), XMFLOAT3(20.0f, 0.5f, 20.0f));	// Roof
+
+		std::mt19937 rng(9);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		for (int i = 0; i < settings.entityCount; i++)
+		{
+			int storey = (int)(unit(rng) * settings.storeys) % (std::max)(settings.storeys, 1);
+			AABB box;
+			box.center = XMFLOAT3(unit(rng) * 19.0f - 9.5f, storey * 4.0f + 0.6f + unit(rng) * 2.8f, unit(rng) * 19.0f - 9.5f);
+			box.extents = XMFLOAT3(0.25f, 0.25f, 0.25f);
+			scene.entities.push_back(box);
+		}
+		return scene;
+	}
+
+	// Nearest hit along a ray, as a distance along it, FLT_MAX for none
+	float RayTriangle(FXMVECTOR origin, FXMVECTOR direction, FXMVECTOR a, GXMVECTOR b, HXMVECTOR c)
+	{
+		XMVECTOR e1 = XMVectorSubtract(b, a);
+		XMVECTOR e2 = XMVectorSubtract(c, a);
+		XMVECTOR p = XMVector3Cross(direction, e2);
+		float det = XMVectorGetX(XMVector3Dot(e1, p));
+		if (fabsf(det) < 1e-12f)
+			return FLT_MAX;
+
+		float invDet = 1.0f / det;
+		XMVECTOR s = XMVectorSubtract(origin, a);
+		float u = XMVectorGetX(XMVector3Dot(s, p)) * invDet;
+		if (u < 0.0f || u > 1.0f)
+			return FLT_MAX;
+		XMVECTOR q = XMVector3Cross(s, e1);
+		float v = XMVectorGetX(XMVector3Dot(direction, q)) * invDet;
+		if (v < 0.0f || u + v > 1.0f)
+			return FLT_MAX;
+		float t = XMVectorGetX(XMVector3Dot(e2, q)) * invDet;
+		return t >= 0.0f ? t : FLT_MAX;
+	}
+
+	// Depth of the nearest occluder through every pixel center, 1 for
+	// none - what the rasterizer should produce
+	std::vector<float> RayCastOcclusionDepth(const OcclusionScene& scene, const Mesh& cube, const XMFLOAT4X4& viewProjection, unsigned int width, unsigned int height)
+	{
+		XMMATRIX vp = XMLoadFloat4x4(&viewProjection);
+		XMMATRIX inverse = XMMatrixInverse(nullptr, vp);
+		const std::vector<XMFLOAT3>& positions = cube.GetPositions();
+		const std::vector<unsigned int>& indices = cube.GetIndices();
+
+		std::vector<float> depth((size_t)width * height, 1.0f);
+		for (unsigned int y = 0; y < height; y++)
+		{
+			for (unsigned int x = 0; x < width; x++)
+			{
+				float ndcX = ((x + 0.5f) / width) * 2.0f - 1.0f;
+				float ndcY = 1.0f - ((y + 0.5f) / height) * 2.0f;
+				XMVECTOR origin = XMVector3TransformCoord(XMVectorSet(ndcX, ndcY, 0.0f, 1.0f), inverse);
+				XMVECTOR end = XMVector3TransformCoord(XMVectorSet(ndcX, ndcY, 1.0f, 1.0f), inverse);
+				XMVECTOR direction = XMVectorSubtract(end, origin);
+				XMFLOAT3 o;
+				XMFLOAT3 d;
+				XMStoreFloat3(&o, origin);
+				XMStoreFloat3(&d, direction);
+
+				float nearest = FLT_MAX;
+				for (size_t i = 0; i < scene.occluders.size(); i++)
+				{
+					if (!RayHitsBox(o, d, scene.occluderBounds[i]))
+						continue;
+
+					XMMATRIX world = XMLoadFloat4x4(&scene.occluders[i]);
+					for (size_t t = 0; t + 2 < indices.size(); t += 3)
+					{
+						nearest = (std::min)(nearest, RayTriangle(origin, direction,
+							XMVector3TransformCoord(XMLoadFloat3(&positions[indices[t]]), world),
+							XMVector3TransformCoord(XMLoadFloat3(&positions[indices[t + 1]]), world),
+							XMVector3TransformCoord(XMLoadFloat3(&positions[indices[t + 2]]), world)));
+					}
+				}
+
+				// Only hits between the near and far planes count
+				if (nearest <= 1.0f)
+				{
+					XMVECTOR hit = XMVectorMultiplyAdd(direction, XMVectorReplicate(nearest), origin);
+					depth[(size_t)y * width + x] = XMVectorGetZ(XMVector3TransformCoord(hit, vp));
+				}
+			}
+		}
+		return depth;
+	}
+
+	// Pixel rectangle a box covers and its nearest depth, false if it
+	// crosses the near plane or is off screen
+	bool ScreenRect(const AABB& box, const XMFLOAT4X4& viewProjection, unsigned int width, unsigned int height,
+		unsigned int& x0, unsigned int& y0, unsigned int& x1, unsigned int& y1, float& nearest)
+	{
+		float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+		nearest = FLT_MAX;
+		for (int corner = 0; corner < 8; corner++)
+		{
+			XMVECTOR p = XMVectorSet(
+				box.center.x + ((corner & 1) ? box.extents.x : -box.extents.x),
+				box.center.y + ((corner & 2) ? box.extents.y : -box.extents.y),
+				box.center.z + ((corner & 4) ? box.extents.z : -box.extents.z),
+				1.0f);
+			XMFLOAT4 clip;
+			XMStoreFloat4(&clip, XMVector4Transform(p, XMLoadFloat4x4(&viewProjection)));
+			if (clip.z <= 0.0f)
+				return false;
+			float x = (clip.x / clip.w * 0.5f + 0.5f) * width;
+			float y = (0.5f - clip.y / clip.w * 0.5f) * height;
+			minX = (std::min)(minX, x);
+			maxX = (std::max)(maxX, x);
+			minY = (std::min)(minY, y);
+			maxY = (std::max)(maxY, y);
+			nearest = (std::min)(nearest, clip.z / clip.w);
+		}
+		if (maxX < 0.0f || maxY < 0.0f || minX >= (float)width || minY >= (float)height)
+			return false;
+
+		x0 = (unsigned int)(std::max)(minX, 0.0f);
+		y0 = (unsigned int)(std::max)(minY, 0.0f);
+		x1 = (unsigned int)(std::min)(maxX, (float)(width - 1));
+		y1 = (unsigned int)(std::min)(maxY, (float)(height - 1));
+		return true;
+	}
+}
+
+int RunOcclusionBench(const OcclusionBenchSettings& settings)
+{
+	RecordingBackend backend;
+	bool failed = false;
+	{
+		int threads = settings.threadCount > 0 ? settings.threadCount : (int)std::thread::hardware_concurrency();
+		threads = (std::max)(threads, 1);
+
+		std::shared_ptr<Mesh> cube = CreateBenchCube(backend);
+		OcclusionScene scene = BuildOcclusionScene(settings);
+
+		// Standing in the bottom storey's corridor, looking down it
+		XMFLOAT4X4 viewProjection;
+		XMStoreFloat4x4(&viewProjection, XMMatrixMultiply(
+			XMMatrixLookToLH(XMVectorSet(0.0f, 2.0f, -9.0f, 1.0f), XMVectorSet(0.0f, -0.05f, 1.0f, 0.0f), XMVectorSet(0, 1, 0, 0)),
+			XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.1f, 200.0f)));
+		Frustum frustum = Frustum::FromViewProjection(viewProjection);
+
+		printf("Occlusion bench: %d storeys, %zu occluders, %zu entities, %d frames\n",
+			settings.storeys, scene.occluders.size(), scene.entities.size(), settings.frames);
+		printf("  kernel  threads    raster       test    speedup\n");
+
+		// The four-wide rasterizer, and the AVX2 one where the CPU has it
+		const int kernelCount = CpuHasAvx2() ? 2 : 1;
+		const char* kernelNames[] = { "4-wide", "AVX2" };
+
+		std::vector<float> depthPerRun[4];
+		std::vector<uint8_t> visible(scene.entities.size());
+		size_t inFrustum = 0;
+		size_t culled = 0;
+		double baseline = 0.0;
+		unsigned int width = 0;
+		unsigned int height = 0;
+		const int threadCounts[2] = { 1, threads };
+		for (int run = 0; run < kernelCount * 2; run++)
+		{
+			int kernel = run / 2;
+			if (run % 2 == 1 && threads == 1)
+				continue;
+
+			SetAvx2Enabled(kernel == 1);
+			JobSystem jobSystem(threadCounts[run % 2] - 1);
+			OcclusionCuller culler(jobSystem);
+			width = culler.GetWidth();
+			height = culler.GetHeight();
+
+			double rasterMs = 0.0;
+			double testMs = 0.0;
+			for (int frame = 0; frame < settings.frames; frame++)
+			{
+				auto start = std::chrono::high_resolution_clock::now();
+				culler.BeginFrame(viewProjection);
+				for (const XMFLOAT4X4& world : scene.occluders)
+					culler.AddOccluder(*cube, world);
+				culler.Rasterize();
+				auto rastered = std::chrono::high_resolution_clock::now();
+
+				jobSystem.ParallelFor(scene.entities.size(), 256, [&](size_t begin, size_t end)
+				{
+					for (size_t i = begin; i < end; i++)
+					{
+						const AABB& box = scene.entities[i];
+						visible[i] = !frustum.Intersects(box) ? 0 : culler.IsVisible(box) ? 1 : 2;
+					}
+				});
+				auto tested = std::chrono::high_resolution_clock::now();
+
+				rasterMs += Milliseconds(rastered - start);
+				testMs += Milliseconds(tested - rastered);
+			}
+			rasterMs /= settings.frames;
+			testMs /= settings.frames;
+			if (run == 0)
+				baseline = rasterMs + testMs;
+
+			printf("  %-6s  %7u  %6.3f ms  %6.3f ms    %5.2fx\n",
+				kernelNames[kernel], jobSystem.GetThreadCount(), rasterMs, testMs, baseline / (rasterMs + testMs));
+			depthPerRun[run].assign(culler.GetLevelDepth(0), culler.GetLevelDepth(0) + (size_t)width * height);
+
+			if (run == 0)
+			{
+				const OcclusionStats& stats = culler.GetStats();
+				printf("  %zu occluders drawn (%zu off screen), %zu triangles, %zu triangle / tile pairs\n",
+					stats.occluders - stats.skippedOccluders, stats.skippedOccluders, stats.triangles, stats.binnedTriangles);
+			}
+		}
+		SetAvx2Enabled(true);
+
+		inFrustum = 0;
+		culled = 0;
+		for (uint8_t v : visible)
+		{
+			inFrustum += v != 0;
+			culled += v == 2;
+		}
+		printf("  %zu entities in the frustum, %zu occluded: %.1f%% of the frustum, %.1f%% of all\n",
+			inFrustum, culled,
+			inFrustum ? 100.0 * culled / inFrustum : 0.0,
+			scene.entities.empty() ? 0.0 : 100.0 * culled / scene.entities.size());
+
+		// Each kernel against a ray cast through every pixel
+		std::vector<float> reference = RayCastOcclusionDepth(scene, *cube, viewProjection, width, height);
+		for (int kernel = 0; kernel < kernelCount; kernel++)
+		{
+			const std::vector<float>& depth = depthPerRun[kernel * 2];
+			size_t coverageMismatches = 0;
+			float worstDepth = 0.0f;
+			for (size_t i = 0; i < reference.size(); i++)
+			{
+				bool covered = depth[i] < 1.0f;
+				bool referenceCovered = reference[i] < 1.0f;
+				if (covered != referenceCovered)
+					coverageMismatches++;
+				else if (covered)
+					worstDepth = (std::max)(worstDepth, fabsf(depth[i] - reference[i]));
+			}
+			printf("  %s against the ray cast: %zu of %zu pixels covered differently, max depth error %g\n",
+				kernelNames[kernel], coverageMismatches, reference.size(), worstDepth);
+			if (coverageMismatches * 200 > reference.size() || worstDepth > 1e-4f)
+				failed = true;
+		}
+
+		// Everything culled is behind every pixel it covers
+		size_t wronglyCulled = 0;
+		for (size_t i = 0; i < scene.entities.size(); i++)
+		{
+			unsigned int x0, y0, x1, y1;
+			float nearest;
+			if (visible[i] != 2 || !ScreenRect(scene.entities[i], viewProjection, width, height, x0, y0, x1, y1, nearest))
+				continue;
+
+			bool hidden = true;
+			for (unsigned int y = y0; y <= y1; y++)
+			{
+				for (unsigned int x = x0; x <= x1; x++)
+					hidden &= nearest > reference[(size_t)y * width + x];
+			}
+			wronglyCulled += hidden ? 0 : 1;
+		}
+		printf("  culled but in front of the ray cast depth: %zu\n", wronglyCulled);
+		if (wronglyCulled > 0)
+			failed = true;
+
+		for (int kernel = 0; kernel < kernelCount && threads > 1; kernel++)
+		{
+			bool same = depthPerRun[kernel * 2] == depthPerRun[kernel * 2 + 1];
+			printf("  %s, 1 and %d threads rasterize the same buffer: %s\n", kernelNames[kernel], threads, same ? "yes" : "NO");
+			if (!same)
+				failed = true;
+		}
+	}
+
+	printf("  validation errors: %zu\n", backend.GetErrorCount());
+	return backend.GetErrorCount() == 0 && !failed ? 0 : 1;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+// --------------------------------------------------------
+// Headless CPU benchmark of software occlusion culling - no
+// GPU.
+//
+// A dense interior: a tower of storeys, each a 20 x 0.5 x 20
+// floor slab (like Game's floor) with two interior walls, all
+// of them occluders, and small entities scattered through every
+// storey.  The camera stands in the bottom storey's middle
+// corridor, so nearly everything in view is hidden.
+//
+// Times OcclusionCuller::Rasterize() and the per-entity
+// frustum + occlusion test (in parallel), on one thread and on
+// all of them, with the four-wide rasterizer and the AVX2 one if
+// the CPU has it, and prints the fraction culled.
+//
+// Checks:
+//  - each rasterizer's depth buffer matches a ray cast through
+//    each pixel center (a few silhouette pixels may differ)
+//  - every culled entity is behind the ray cast depth at every
+//    pixel it covers
+//  - one thread and many rasterize exactly the same buffer
+//
+// Returns 0 if all checks passed.
+// --------------------------------------------------------
+struct OcclusionBenchSettings
+{
+	int storeys = 100;
+	int entityCount = 20000;
+	int frames = 50;
+	int threadCount = -1;	// Including the caller, negative = every hardware thread
+};
+
+int RunOcclusionBench(const OcclusionBenchSettings& settings);
@@ -0,0 +1,211 @@
+#include "PassScheduler.h"
+#include <chrono>
+#include <thread>
+
+namespace
+{
+	double Milliseconds(std::chrono::high_resolution_clock::duration d)
+	{
+		return std::chrono::duration<double, std::milli>(d).count();
+	}
+}
+
+PassScheduler::PassScheduler(ICommandListDevice& device, JobSystem& jobSystem, FrameArena& frameArena)
+	: device(device), jobSystem(jobSystem), frameArena(frameArena)
+{
+}
+
+void PassScheduler::Reset()
+{
+	passes.clear();
+}
+
+size_t PassScheduler::AddPass(const char* name, void* record, RecordFunction invoke, bool mainThreadOnly)
+{
+	passes.push_back({ frameArena.CopyString(name), record, invoke, FrameVector<size_t>(frameArena), mainThreadOnly });
+	return passes.size() - 1;
+}
+
+void PassScheduler::AddDependency(size_t pass, size_t dependsOn)
+{
+	if (pass >= passes.size() || dependsOn >= passes.size() || pass == dependsOn)
+		return;
+
+	passes[pass].dependencies.push_back(dependsOn);
+}
+
+// --------------------------------------------------------
+// Topological sort (Kahn).  Out of everything that's ready the
+// lowest index goes next, so without dependencies this is just
+// the declaration order.  Pass counts are tiny - the quadratic
+// scan is fine.
+// --------------------------------------------------------
+bool PassScheduler::BuildExecutionOrder()
+{
+	size_t count = passes.size();
+	FrameVector<size_t> waitingOn(count, 0, frameArena);
+	FrameVector<bool> scheduled(count, false, frameArena);
+	for (size_t i = 0; i < count; i++)
+		waitingOn[i] = passes[i].dependencies.size();
+
+	executionOrder.clear();
+	while (executionOrder.size() < count)
+	{
+		size_t next = InvalidPass;
+		for (size_t i = 0; i < count; i++)
+		{
+			if (!scheduled[i] && waitingOn[i] == 0)
+			{
+				next = i;
+				break;
+			}
+		}
+
+		// Only a cycle leaves passes that can never become ready
+		if (next == InvalidPass)
+		{
+			for (size_t i = 0; i < count; i++)
+				if (!scheduled[i])
+					executionOrder.push_back(i);
+			return false;
+		}
+
+		scheduled[next] = true;
+		executionOrder.push_back(next);
+
+		// Duplicate dependencies were counted twice, so release them twice
+		for (size_t i = 0; i < count; i++)
+			for (size_t dependency : passes[i].dependencies)
+				if (dependency == next)
+					waitingOn[i]--;
+	}
+
+	return true;
+}
+
+bool PassScheduler::Run(bool deferred)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	bool valid = BuildExecutionOrder();
+
+	timings.assign(passes.size(), PassTiming());
+	for (size_t i = 0; i < passes.size(); i++)
+		timings[i].name = passes[i].name;
+
+	stats = PassSchedulerStats();
+	stats.deferred = deferred;
+
+	if (deferred)
+		RunDeferred();
+	else
+		RunImmediate();
+
+	stats.wallMs = Milliseconds(std::chrono::high_resolution_clock::now() - start);
+	return valid;
+}
+
+void PassScheduler::RunImmediate()
+{
+	IRecordingContext& immediate = device.GetImmediateContext();
+
+	for (size_t index : executionOrder)
+	{
+		auto t0 = std::chrono::high_resolution_clock::now();
+		passes[index].Record(immediate);
+		immediate.Finish();
+
+		PassTiming& timing = timings[index];
+		timing.recordMs = Milliseconds(std::chrono::high_resolution_clock::now() - t0);
+		timing.recordedOnMainThread = true;
+		stats.mainThreadMs += timing.recordMs;
+	}
+}
+
+void PassScheduler::RunDeferred()
+{
+	// Which passes record off the main thread, in execution order
+	FrameVector<size_t> deferredPasses(frameArena);
+	deferredPasses.reserve(executionOrder.size());
+	for (size_t index : executionOrder)
+		if (!passes[index].mainThreadOnly)
+			deferredPasses.push_back(index);
+
+	while (deferredContexts.size() < deferredPasses.size())
+	{
+		std::unique_ptr<IRecordingContext> context = device.CreateDeferredContext();
+		if (!context)
+		{
+			// Backend can't do it - everything records in place
+			stats.deferred = false;
+			RunImmediate();
+			return;
+		}
+		deferredContexts.push_back(std::move(context));
+	}
+
+	commandLists.clear();
+	commandLists.resize(passes.size());
+
+	// Record ---------------------------------------------------------------
+	// One pass per job; the calling thread picks some up as well
+	std::thread::id mainThread = std::this_thread::get_id();
+	jobSystem.ParallelFor(deferredPasses.size(), 1, [&](size_t begin, size_t end)
+	{
+		for (size_t k = begin; k < end; k++)
+		{
+			size_t index = deferredPasses[k];
+			IRecordingContext& context = *deferredContexts[k];
+
+			auto t0 = std::chrono::high_resolution_clock::now();
+			passes[index].Record(context);
+			commandLists[index] = context.Finish();
+
+			PassTiming& timing = timings[index];
+			timing.recordMs = Milliseconds(std::chrono::high_resolution_clock::now() - t0);
+			timing.deferred = true;
+			timing.recordedOnMainThread = std::this_thread::get_id() == mainThread;
+		}
+	});
+
+	for (size_t index : deferredPasses)
+	{
+		if (timings[index].recordedOnMainThread)
+			stats.mainThreadMs += timings[index].recordMs;
+		else
+			stats.workerRecordMs += timings[index].recordMs;
+	}
+
+	// Execute --------------------------------------------------------------
+	IRecordingContext& immediate = device.GetImmediateContext();
+	for (size_t index : executionOrder)
+	{
+		PassTiming& timing = timings[index];
+		auto t0 = std::chrono::high_resolution_clock::now();
+
+		if (passes[index].mainThreadOnly)
+		{
+			passes[index].Record(immediate);
+			immediate.Finish();
+			timing.recordMs = Milliseconds(std::chrono::high_resolution_clock::now() - t0);
+			timing.recordedOnMainThread = true;
+			stats.mainThreadMs += timing.recordMs;
+		}
+		else if (commandLists[index])
+		{
+			device.Execute(*commandLists[index]);
+			timing.executeMs = Milliseconds(std::chrono::high_resolution_clock::now() - t0);
+			stats.mainThreadMs += timing.executeMs;
+			stats.commandLists++;
+		}
+	}
+
+	// Lists hold references to whatever they bound, let them go now -
+	// back to the contexts that made them, to be reused next frame
+	for (size_t k = 0; k < deferredPasses.size(); k++)
+	{
+		if (commandLists[deferredPasses[k]])
+			deferredContexts[k]->Recycle(std::move(commandLists[deferredPasses[k]]));
+	}
+	commandLists.clear();
+}
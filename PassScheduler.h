@@ -0,0 +1,122 @@
+#pragma once
+
+#include <memory>
+#include <type_traits>
+#include <vector>
+#include "CommandListDevice.h"
+#include "FrameArena.h"
+#include "JobSystem.h"
+
+// --------------------------------------------------------
+// Timings from the last Run(), per pass
+// --------------------------------------------------------
+struct PassTiming
+{
+	const char* name = nullptr;		// In the frame arena, like the pass
+	double recordMs = 0.0;
+	double executeMs = 0.0;		// ExecuteCommandList() only, 0 when recorded in place
+	bool deferred = false;
+	bool recordedOnMainThread = false;
+};
+
+// --------------------------------------------------------
+// Totals from the last Run()
+// --------------------------------------------------------
+struct PassSchedulerStats
+{
+	double wallMs = 0.0;			// Whole Run()
+	double mainThreadMs = 0.0;		// Recording + executing done by the calling thread
+	double workerRecordMs = 0.0;	// Recording done by other threads
+	size_t commandLists = 0;
+	bool deferred = false;
+};
+
+// --------------------------------------------------------
+// Records a frame's passes and executes them in a valid order.
+//
+// Passes are added fresh every frame, into the frame arena: a
+// pass, its name, its record function and its dependencies are
+// pointer bumps, and nothing is freed.  Reset() must come after
+// the arena's BeginFrame().  A dependency means "reads
+// what that pass writes", so it has to execute first.  The
+// execution order is the declaration order wherever the
+// dependencies allow it.
+//
+// Immediate mode records each pass straight onto the immediate
+// context, in execution order.
+//
+// Deferred mode records every pass on its own deferred context,
+// spread over the job system, then executes the command lists in
+// order on the calling thread.  Passes marked main-thread-only
+// (UI, anything touching APIs that aren't thread safe) are still
+// recorded in place, at their slot in the order.
+//
+// Recording never waits on other passes - dependencies only
+// order the GPU work, so a pass's record function must only read
+// CPU data that is complete before Run().
+//
+// No graphics API types here, so the ordering logic runs the
+// same against the D3D11 device and the RecordingCommandDevice.
+// --------------------------------------------------------
+class PassScheduler
+{
+public:
+	static constexpr size_t InvalidPass = ~(size_t)0;
+
+	PassScheduler(ICommandListDevice& device, JobSystem& jobSystem, FrameArena& frameArena);
+
+	void Reset();
+
+	// record(IRecordingContext&) is copied into the frame arena and
+	// never destroyed - a lambda capturing by reference
+	template<typename Record> size_t AddPass(const char* name, const Record& record, bool mainThreadOnly = false)
+	{
+		static_assert(std::is_trivially_destructible<Record>::value, "Pass record functions are never destroyed");
+		return AddPass(name, frameArena.New<Record>(record), [](void* record, IRecordingContext& context)
+		{
+			(*static_cast<Record*>(record))(context);
+		}, mainThreadOnly);
+	}
+	void AddDependency(size_t pass, size_t dependsOn);
+
+	// Returns false if the dependencies had a cycle - those passes
+	// then run in declaration order
+	bool Run(bool deferred);
+
+	// Results of the last Run()
+	const std::vector<size_t>& GetExecutionOrder() const { return executionOrder; }
+	const std::vector<PassTiming>& GetTimings() const { return timings; }
+	const PassSchedulerStats& GetStats() const { return stats; }
+
+private:
+	typedef void (*RecordFunction)(void* record, IRecordingContext& context);
+
+	struct Pass
+	{
+		const char* name;
+		void* record;
+		RecordFunction invoke;
+		FrameVector<size_t> dependencies;
+		bool mainThreadOnly;
+
+		void Record(IRecordingContext& context) const { invoke(record, context); }
+	};
+
+	ICommandListDevice& device;
+	JobSystem& jobSystem;
+	FrameArena& frameArena;
+
+	std::vector<Pass> passes;
+	std::vector<size_t> executionOrder;
+	std::vector<PassTiming> timings;
+	PassSchedulerStats stats;
+
+	// Kept between frames, one per pass that records off the main thread
+	std::vector<std::unique_ptr<IRecordingContext>> deferredContexts;
+	std::vector<std::unique_ptr<ICommandList>> commandLists;
+
+	size_t AddPass(const char* name, void* record, RecordFunction invoke, bool mainThreadOnly);
+	bool BuildExecutionOrder();
+	void RunImmediate();
+	void RunDeferred();
+};
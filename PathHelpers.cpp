@@ -1,10 +1,22 @@
 
+#ifdef _WIN32
 #include <Windows.h>
+#else
+#include <unistd.h>
+#endif
 #include <codecvt>
+#include <cstring>
 #include <locale>
 
 #include "PathHelpers.h"
 
+// Windows takes either slash, elsewhere only this one works
+#ifdef _WIN32
+static const char PathSeparator = '\\';
+#else
+static const char PathSeparator = '/';
+#endif
+
 // --------------------------------------------------------------------------
 // Gets the actual path to this executable
 //
@@ -23,14 +35,19 @@
 std::string GetExePath()
 {
 	// Assume the path is just the "current directory" for now
-	std::string path = ".\\";
+	std::string path = std::string(".") + PathSeparator;
 
 	// Get the real, full path to this executable
 	char currentDir[1024] = {};
+#ifdef _WIN32
 	GetModuleFileNameA(0, currentDir, 1024);
+#else
+	ssize_t length = readlink("/proc/self/exe", currentDir, sizeof(currentDir) - 1);
+	currentDir[length > 0 ? length : 0] = 0;
+#endif
 
 	// Find the location of the last slash charaacter
-	char* lastSlash = strrchr(currentDir, '\\');
+	char* lastSlash = strrchr(currentDir, PathSeparator);
 	if (lastSlash)
 	{
 		// End the string at the last slash character, essentially
@@ -57,7 +74,7 @@ std::string GetExePath()
 // ----------------------------------------------------
 std::string FixPath(const std::string& relativeFilePath)
 {
-	return GetExePath() + "\\" + relativeFilePath;
+	return GetExePath() + PathSeparator + relativeFilePath;
 }
 
 
@@ -74,7 +91,7 @@ std::string FixPath(const std::string& relativeFilePath)
 // ---------------------------------------------------- 
 std::wstring FixPath(const std::wstring& relativeFilePath)
 {
-	return NarrowToWide(GetExePath()) + L"\\" + relativeFilePath;
+	return NarrowToWide(GetExePath()) + (wchar_t)PathSeparator + relativeFilePath;
 }
 
 
@@ -84,10 +101,14 @@ std::wstring FixPath(const std::wstring& relativeFilePath)
 // ----------------------------------------------------
 std::string WideToNarrow(const std::wstring& str)
 {
+#ifdef _WIN32
 	int size = WideCharToMultiByte(CP_UTF8, 0, str.c_str(), (int)str.length(), 0, 0, 0, 0);
 	std::string result(size, 0);
 	WideCharToMultiByte(CP_UTF8, 0, str.c_str(), -1, &result[0], size, 0, 0);
 	return result;
+#else
+	return std::wstring_convert<std::codecvt_utf8<wchar_t>>().to_bytes(str);
+#endif
 }
 
 
@@ -97,8 +118,12 @@ std::string WideToNarrow(const std::wstring& str)
 // ----------------------------------------------------
 std::wstring NarrowToWide(const std::string& str)
 {
+#ifdef _WIN32
 	int size = MultiByteToWideChar(CP_UTF8, 0, str.c_str(), (int)str.length(), 0, 0);
 	std::wstring result(size, 0);
 	MultiByteToWideChar(CP_UTF8, 0, str.c_str(), -1, &result[0], size);
 	return result;
+#else
+	return std::wstring_convert<std::codecvt_utf8<wchar_t>>().from_bytes(str);
+#endif
 }
\ No newline at end of file
@@ -0,0 +1,102 @@
+#include "Picking.h"
+#include "Mesh.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX;
+
+namespace
+{
+	// The ray in an entity's local space - same distances, since the
+	// world matrix is affine
+	MeshRay ToLocal(Transform& transform, const PickRay& ray, float maxDistance)
+	{
+		XMFLOAT4X4 world = transform.GetWorldMatrix();
+		XMMATRIX toLocal = XMMatrixInverse(nullptr, XMLoadFloat4x4(&world));
+		MeshRay local;
+		XMStoreFloat3(&local.origin, XMVector3TransformCoord(XMLoadFloat3(&ray.origin), toLocal));
+		XMStoreFloat3(&local.direction, XMVector3TransformNormal(XMLoadFloat3(&ray.direction), toLocal));
+		local.maxDistance = maxDistance;
+		return local;
+	}
+}
+
+PickRay PickRay::FromScreen(float x, float y, float width, float height, const XMFLOAT4X4& view, const XMFLOAT4X4& projection)
+{
+	// Pixel to clip space, then back through the inverse view * projection
+	// at the near (z = 0) and far (z = 1) planes
+	float clipX = (x / width) * 2.0f - 1.0f;
+	float clipY = 1.0f - (y / height) * 2.0f;
+	XMMATRIX inverse = XMMatrixInverse(nullptr, XMMatrixMultiply(XMLoadFloat4x4(&view), XMLoadFloat4x4(&projection)));
+	XMVECTOR nearPoint = XMVector3TransformCoord(XMVectorSet(clipX, clipY, 0.0f, 1.0f), inverse);
+	XMVECTOR farPoint = XMVector3TransformCoord(XMVectorSet(clipX, clipY, 1.0f, 1.0f), inverse);
+
+	PickRay ray;
+	XMStoreFloat3(&ray.origin, nearPoint);
+	XMStoreFloat3(&ray.direction, XMVector3Normalize(XMVectorSubtract(farPoint, nearPoint)));
+	return ray;
+}
+
+PickHit PickEntity(EntityStore& entities, const ResourceRegistry& resources, const EntityBVH& bvh, const PickRay& ray, float maxDistance)
+{
+	PickHit pick;
+	uint32_t hit = bvh.Raycast(ray.origin, ray.direction, maxDistance, [&](uint32_t id, float boxDistance)
+	{
+		const MeshRef* meshRef = entities.TryGet<MeshRef>(id);
+		const Mesh* mesh = meshRef ? resources.Get(meshRef->mesh) : nullptr;
+		if (!mesh || mesh->IsDynamic() || !entities.Has<Transform>(id))
+			return FLT_MAX;
+
+		const MeshBVH* triangles = mesh->GetTriangleBVH();
+		if (!triangles)
+			return boxDistance;
+
+		MeshHit meshHit;
+		return triangles->Intersect(ToLocal(entities.Get<Transform>(id), ray, maxDistance), meshHit) ? meshHit.distance : FLT_MAX;
+	}, &pick.distance);
+
+	if (hit == UINT32_MAX)
+		return pick;
+
+	pick.entity = (int)hit;
+	XMVECTOR direction = XMLoadFloat3(&ray.direction);
+	XMStoreFloat3(&pick.point, XMVectorMultiplyAdd(direction, XMVectorReplicate(pick.distance), XMLoadFloat3(&ray.origin)));
+
+	// Box hit - the normal of the face it came in through
+	Transform& transform = entities.Get<Transform>(hit);
+	const Mesh& mesh = *resources.Get(entities.Get<MeshRef>(hit).mesh);
+	const MeshBVH* triangles = mesh.GetTriangleBVH();
+	if (!triangles)
+	{
+		const AABB& box = bvh.GetBounds()[hit];
+		float x = (pick.point.x - box.center.x) / (std::max)(box.extents.x, 1e-6f);
+		float y = (pick.point.y - box.center.y) / (std::max)(box.extents.y, 1e-6f);
+		float z = (pick.point.z - box.center.z) / (std::max)(box.extents.z, 1e-6f);
+		if (fabsf(x) >= fabsf(y) && fabsf(x) >= fabsf(z))
+			pick.normal = XMFLOAT3(x > 0.0f ? 1.0f : -1.0f, 0.0f, 0.0f);
+		else if (fabsf(y) >= fabsf(z))
+			pick.normal = XMFLOAT3(0.0f, y > 0.0f ? 1.0f : -1.0f, 0.0f);
+		else
+			pick.normal = XMFLOAT3(0.0f, 0.0f, z > 0.0f ? 1.0f : -1.0f);
+		return pick;
+	}
+
+	// Again for the winning entity, for its triangle
+	MeshHit meshHit;
+	triangles->Intersect(ToLocal(transform, ray, maxDistance), meshHit);
+	pick.triangle = meshHit.triangle;
+
+	// The triangle's local normal, through the inverse transpose
+	const std::vector<XMFLOAT3>& positions = mesh.GetPositions();
+	const std::vector<unsigned int>& indices = mesh.GetIndices();
+	XMVECTOR a = XMLoadFloat3(&positions[indices[pick.triangle * 3]]);
+	XMVECTOR b = XMLoadFloat3(&positions[indices[pick.triangle * 3 + 1]]);
+	XMVECTOR c = XMLoadFloat3(&positions[indices[pick.triangle * 3 + 2]]);
+	XMVECTOR localNormal = XMVector3Cross(XMVectorSubtract(b, a), XMVectorSubtract(c, a));
+	XMFLOAT4X4 inverseTranspose = transform.GetWorldInverseTransposeMatrix();
+	XMVECTOR normal = XMVector3Normalize(XMVector3TransformNormal(localNormal, XMLoadFloat4x4(&inverseTranspose)));
+	if (XMVectorGetX(XMVector3Dot(normal, direction)) > 0.0f)
+		normal = XMVectorNegate(normal);
+	XMStoreFloat3(&pick.normal, normal);
+	return pick;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cfloat>
+#include <vector>
+#include <DirectXMath.h>
+#include "EntityBVH.h"
+#include "EntityComponents.h"
+
+// --------------------------------------------------------
+// A world space ray, direction normalized so distances are
+// in world units
+// --------------------------------------------------------
+struct PickRay
+{
+	DirectX::XMFLOAT3 origin = DirectX::XMFLOAT3(0, 0, 0);
+	DirectX::XMFLOAT3 direction = DirectX::XMFLOAT3(0, 0, 1);
+
+	// Through a pixel (top left origin, like Input::GetMouseX/Y()),
+	// starting on the near plane
+	static PickRay FromScreen(float x, float y, float width, float height,
+		const DirectX::XMFLOAT4X4& view, const DirectX::XMFLOAT4X4& projection);
+};
+
+// --------------------------------------------------------
+// What a pick hit, entity -1 if nothing.  The normal is the
+// triangle's, in world space, facing back along the ray.
+// --------------------------------------------------------
+struct PickHit
+{
+	int entity = -1;
+	float distance = FLT_MAX;
+	DirectX::XMFLOAT3 point = DirectX::XMFLOAT3(0, 0, 0);
+	DirectX::XMFLOAT3 normal = DirectX::XMFLOAT3(0, 0, 0);
+	uint32_t triangle = UINT32_MAX;
+
+	bool IsHit() const { return entity >= 0; }
+};
+
+// --------------------------------------------------------
+// Nearest entity along a ray.
+//
+// The BVH (indexed by entity id, and current) narrows it to
+// the entities whose world bounds the ray enters, nearest
+// first.  Each of those gets the ray moved into its mesh's
+// local space by the inverse world matrix - an affine map, so
+// distances along it carry over - and tested exactly against
+// the mesh's triangle BVH.  Entities are skipped once their
+// bounds start past the nearest hit so far.  A mesh without a
+// triangle BVH is hit at its bounds.  Ids that aren't drawable
+// entities, or whose mesh was released, are never hit - nor are
+// dynamic meshes, which keep neither CPU geometry nor current
+// bounds on the simulation's side once they're skinned.
+//
+// May rebuild world matrices, so not safe alongside anything
+// else touching the entities.
+// --------------------------------------------------------
+PickHit PickEntity(EntityStore& entities, const ResourceRegistry& resources, const EntityBVH& bvh, const PickRay& ray, float maxDistance = FLT_MAX);
@@ -0,0 +1,280 @@
+#include "PickingTests.h"
+#include "HeadlessTests.h"
+#include "RecordingBackend.h"
+#include "Mesh.h"
+#include "ResourceRegistry.h"
+#include "EntityStore.h"
+#include "EntityBVH.h"
+#include "MeshBVH.h"
+#include "PathHelpers.h"
+#include "Picking.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+	struct PickScene
+	{
+		ResourceRegistry resources;
+		std::vector<MeshHandle> meshes;	// cube, sphere, helix
+		EntityStore entities;		// Just a Transform and MeshRef each
+		EntityBVH bvh;
+
+		explicit PickScene(IRenderBackend& backend) : resources(backend, backend.CreateFence()) {}
+
+		EntityId Add(size_t mesh, XMFLOAT3 position)
+		{
+			Transform transform;
+			transform.SetPosition(position);
+			MeshRef meshRef;
+			meshRef.mesh = meshes[mesh];
+			return entities.Create(transform, meshRef);
+		}
+
+		void BuildBVH()
+		{
+			std::vector<AABB> bounds(entities.GetIdCapacity());
+			for (EntityId i = 0; i < bounds.size(); i++)
+				bounds[i] = resources.Get(entities.Get<MeshRef>(i).mesh)->GetLocalBounds().Transformed(entities.Get<Transform>(i).GetWorldMatrix());
+			bvh.Build(bounds.data(), bounds.size());
+		}
+	};
+
+	void LoadPickMeshes(PickScene& scene, IRenderBackend& backend)
+	{
+		const wchar_t* files[3] = { L"../../Assets/cube.obj", L"../../Assets/sphere.obj", L"../../Assets/helix.obj" };
+		for (const wchar_t* file : files)
+		{
+			scene.meshes.push_back(scene.resources.Create<Mesh>(FixPath(file).c_str(), backend, MeshCpuGeometry::Keep));
+			scene.resources.Get(scene.meshes.back())->BuildTriangleBVH();
+		}
+	}
+
+	// Game::CreateGeometry()'s entities - mesh and position
+	void BuildSamplePickScene(PickScene& scene)
+	{
+		const int meshIndices[] = { 0, 1, 1, 0, 2, 0, 2, 0, 2, 1 };
+		const XMFLOAT3 positions[] =
+		{
+			XMFLOAT3(-2, 0, 0), XMFLOAT3(0, 0, 0), XMFLOAT3(2, 2, 4), XMFLOAT3(0, 4, 0), XMFLOAT3(2, 4, 0),
+			XMFLOAT3(-2, 4, 0), XMFLOAT3(-4, 4, 0), XMFLOAT3(0, 6, 0), XMFLOAT3(2, 6, 0), XMFLOAT3(-6, 0, 0)
+		};
+		for (int i = 0; i < 10; i++)
+			scene.Add(meshIndices[i], positions[i]);
+
+		EntityId floor = scene.Add(0, XMFLOAT3(0.0f, -3.0f, 0.0f));
+		scene.entities.Get<Transform>(floor).SetScale(20.0f, 0.5f, 20.0f);
+		scene.BuildBVH();
+	}
+
+	// Nearest hit over every entity's triangles, no BVH over them
+	PickHit BruteForcePick(EntityStore& entities, const ResourceRegistry& resources, const PickRay& ray)
+	{
+		PickHit best;
+		for (EntityId i = 0; i < entities.GetIdCapacity(); i++)
+		{
+			XMFLOAT4X4 world = entities.Get<Transform>(i).GetWorldMatrix();
+			XMMATRIX toLocal = XMMatrixInverse(nullptr, XMLoadFloat4x4(&world));
+			MeshRay local;
+			XMStoreFloat3(&local.origin, XMVector3TransformCoord(XMLoadFloat3(&ray.origin), toLocal));
+			XMStoreFloat3(&local.direction, XMVector3TransformNormal(XMLoadFloat3(&ray.direction), toLocal));
+			MeshHit hit = BruteForceRay(*resources.Get(entities.Get<MeshRef>(i).mesh), local, false);
+			if (hit.IsHit() && hit.distance < best.distance)
+			{
+				best.entity = (int)i;
+				best.distance = hit.distance;
+			}
+		}
+		return best;
+	}
+
+	PickRay StraightRay(XMFLOAT3 origin, XMFLOAT3 direction)
+	{
+		PickRay ray;
+		ray.origin = origin;
+		XMStoreFloat3(&ray.direction, XMVector3Normalize(XMLoadFloat3(&direction)));
+		return ray;
+	}
+
+	float Distance3(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		return XMVectorGetX(XMVector3Length(XMVectorSubtract(XMLoadFloat3(&a), XMLoadFloat3(&b))));
+	}
+}
+
+int RunPickingChecks()
+{
+	printf("Picking checks\n");
+	int failures = 0;
+	char detail[256];
+	RecordingBackend backend;
+	{
+		PickScene scene(backend);
+		LoadPickMeshes(scene, backend);
+		BuildSamplePickScene(scene);
+
+		// Game's first camera, at 1280 x 720
+		const float width = 1280.0f;
+		const float height = 720.0f;
+		XMFLOAT4X4 view;
+		XMFLOAT4X4 projection;
+		XMStoreFloat4x4(&view, XMMatrixLookToLH(XMVectorSet(0, 0, -5, 1), XMVectorSet(0, 0, 1, 0), XMVectorSet(0, 1, 0, 0)));
+		XMStoreFloat4x4(&projection, XMMatrixPerspectiveFovLH(XM_PIDIV4, width / height, 0.01f, 100.0f));
+		auto pixelOf = [&](XMFLOAT3 point)
+		{
+			XMFLOAT3 clip;
+			XMStoreFloat3(&clip, XMVector3TransformCoord(XMLoadFloat3(&point),
+				XMMatrixMultiply(XMLoadFloat4x4(&view), XMLoadFloat4x4(&projection))));
+			return XMFLOAT2((clip.x * 0.5f + 0.5f) * width, (0.5f - clip.y * 0.5f) * height);
+		};
+
+		// The sphere's front, dead center
+		float sphereRadius = scene.resources.Get(scene.meshes[1])->GetLocalBounds().extents.z;
+		float cubeHalf = scene.resources.Get(scene.meshes[0])->GetLocalBounds().extents.z;
+		PickHit hit = PickEntity(scene.entities, scene.resources, scene.bvh, PickRay::FromScreen(width * 0.5f, height * 0.5f, width, height, view, projection));
+		snprintf(detail, sizeof(detail), "entity %d at %.3f, %.3f, %.3f, normal %.2f, %.2f, %.2f",
+			hit.entity, hit.point.x, hit.point.y, hit.point.z, hit.normal.x, hit.normal.y, hit.normal.z);
+		failures += ReportCheck("screen center picks the sphere", hit.entity == 1 &&
+			Distance3(hit.point, XMFLOAT3(0, 0, -sphereRadius)) < 0.02f && hit.normal.z < -0.95f, detail);
+
+		// The left cube's front face, through its center pixel - where the
+		// perspective ray through its center crosses the face
+		XMFLOAT2 cubePixel = pixelOf(XMFLOAT3(-2, 0, 0));
+		hit = PickEntity(scene.entities, scene.resources, scene.bvh, PickRay::FromScreen(cubePixel.x, cubePixel.y, width, height, view, projection));
+		snprintf(detail, sizeof(detail), "entity %d at %.3f, %.3f, %.3f, normal %.2f, %.2f, %.2f",
+			hit.entity, hit.point.x, hit.point.y, hit.point.z, hit.normal.x, hit.normal.y, hit.normal.z);
+		failures += ReportCheck("the left cube's pixel picks it", hit.entity == 0 &&
+			fabsf(hit.point.z + cubeHalf) < 1e-3f && fabsf(hit.point.x + 2.0f * (5.0f - cubeHalf) / 5.0f) < 1e-3f && hit.normal.z < -0.999f, detail);
+
+		// Turned 45 degrees, a ray left of its center meets the left
+		// front face
+		scene.entities.Get<Transform>(0).SetRotation(0.0f, XM_PIDIV4, 0.0f);
+		scene.BuildBVH();
+		hit = PickEntity(scene.entities, scene.resources, scene.bvh, StraightRay(XMFLOAT3(-2.0f - cubeHalf * 0.4f, 0.1f, -10.0f), XMFLOAT3(0, 0, 1)));
+		float faceDistance = (hit.point.x + 2.0f) * hit.normal.x + hit.point.y * hit.normal.y + hit.point.z * hit.normal.z;
+		snprintf(detail, sizeof(detail), "normal %.3f, %.3f, %.3f, %.3f from the center",
+			hit.normal.x, hit.normal.y, hit.normal.z, faceDistance);
+		failures += ReportCheck("a rotated cube's normal turns with it", hit.entity == 0 &&
+			fabsf(hit.normal.x + 0.7071f) < 1e-3f && fabsf(hit.normal.z + 0.7071f) < 1e-3f && fabsf(faceDistance - cubeHalf) < 1e-3f, detail);
+		scene.entities.Get<Transform>(0).SetRotation(0.0f, 0.0f, 0.0f);
+		scene.BuildBVH();
+
+		// The floor is scaled 20 x 0.5 x 20 - its normal must still be up
+		hit = PickEntity(scene.entities, scene.resources, scene.bvh, StraightRay(XMFLOAT3(5.0f, 10.0f, 5.0f), XMFLOAT3(0, -1, 0)));
+		snprintf(detail, sizeof(detail), "entity %d at y %.3f, normal %.3f, %.3f, %.3f",
+			hit.entity, hit.point.y, hit.normal.x, hit.normal.y, hit.normal.z);
+		failures += ReportCheck("from above the floor is hit on top", hit.entity == 10 &&
+			fabsf(hit.point.y - (-3.0f + 0.5f * cubeHalf)) < 1e-3f && hit.normal.y > 0.999f, detail);
+
+		// Through the corner of the sphere's box, clear of the sphere
+		PickRay corner = StraightRay(XMFLOAT3(sphereRadius * 0.9f, sphereRadius * 0.9f, -10.0f), XMFLOAT3(0, 0, 1));
+		std::vector<uint32_t> boxes;
+		scene.bvh.QueryRay(corner.origin, corner.direction, FLT_MAX, boxes);
+		hit = PickEntity(scene.entities, scene.resources, scene.bvh, corner);
+		snprintf(detail, sizeof(detail), "%zu boxes on the ray, picked %d", boxes.size(), hit.entity);
+		failures += ReportCheck("bounds alone don't make a pick", !boxes.empty() && !hit.IsHit(), detail);
+
+		// Random pixels against every entity's triangles
+		std::mt19937 rng(47);
+		std::uniform_real_distribution<float> pixelX(0.0f, width);
+		std::uniform_real_distribution<float> pixelY(0.0f, height);
+		size_t mismatches = 0;
+		size_t hits = 0;
+		const size_t rays = 2000;
+		for (size_t i = 0; i < rays; i++)
+		{
+			PickRay ray = PickRay::FromScreen(pixelX(rng), pixelY(rng), width, height, view, projection);
+			PickHit picked = PickEntity(scene.entities, scene.resources, scene.bvh, ray);
+			PickHit expected = BruteForcePick(scene.entities, scene.resources, ray);
+			hits += picked.IsHit() ? 1 : 0;
+			if (picked.entity != expected.entity || (picked.IsHit() && fabsf(picked.distance - expected.distance) > 1e-4f))
+				mismatches++;
+		}
+		snprintf(detail, sizeof(detail), "%zu of %zu differ, %zu hit something", mismatches, rays, hits);
+		failures += ReportCheck("random picks match testing everything", mismatches == 0, detail);
+	}
+
+	// A dynamic (skinned) mesh in front of the sphere -----------------------------
+	{
+		PickScene scene(backend);
+		LoadPickMeshes(scene, backend);
+
+		// A quad facing the camera, rewritten each frame like the tube -
+		// asking to keep its geometry must not keep a stale copy
+		Vertex quad[4] = {};
+		quad[0].Position = XMFLOAT3(-1, -1, 0);
+		quad[1].Position = XMFLOAT3(-1, 1, 0);
+		quad[2].Position = XMFLOAT3(1, 1, 0);
+		quad[3].Position = XMFLOAT3(1, -1, 0);
+		unsigned int quadIndices[6] = { 0, 1, 2, 0, 2, 3 };
+		scene.meshes.push_back(scene.resources.Create<Mesh>(quad, 4, quadIndices, 6, backend, BufferUsage::Dynamic, MeshCpuGeometry::Keep));
+		Mesh* skinned = scene.resources.Get(scene.meshes.back());
+		skinned->BuildTriangleBVH();
+
+		EntityId sphere = scene.Add(1, XMFLOAT3(0, 0, 0));
+		scene.Add(3, XMFLOAT3(0, 0, -2));
+		scene.BuildBVH();
+
+		PickHit hit = PickEntity(scene.entities, scene.resources, scene.bvh, StraightRay(XMFLOAT3(0, 0, -10), XMFLOAT3(0, 0, 1)));
+		snprintf(detail, sizeof(detail), "picked %d, CPU geometry %s, BVH %s", hit.entity,
+			skinned->HasCpuGeometry() ? "kept" : "none", skinned->GetTriangleBVH() ? "built" : "none");
+		failures += ReportCheck("a dynamic mesh is never picked", hit.entity == (int)sphere &&
+			!skinned->HasCpuGeometry() && !skinned->GetTriangleBVH(), detail);
+	}
+
+	// Timing at 100k entities ----------------------------------------------------
+	{
+		PickScene scene(backend);
+		LoadPickMeshes(scene, backend);
+		std::mt19937 rng(53);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		const int entityCount = 100000;
+		for (int i = 0; i < entityCount; i++)
+		{
+			float x = unit(rng) * 400.0f - 200.0f;
+			float y = unit(rng) * 20.0f;
+			float z = unit(rng) * 400.0f - 200.0f;
+			EntityId entity = scene.Add(i % 3, XMFLOAT3(x, y, z));
+			scene.entities.Get<Transform>(entity).SetRotation(0.0f, unit(rng) * XM_2PI, 0.0f);
+		}
+		auto buildStart = std::chrono::high_resolution_clock::now();
+		scene.BuildBVH();
+		double buildMs = Milliseconds(std::chrono::high_resolution_clock::now() - buildStart);
+
+		XMFLOAT4X4 view;
+		XMFLOAT4X4 projection;
+		XMStoreFloat4x4(&view, XMMatrixLookToLH(XMVectorSet(0, 10, -210, 1), XMVectorSet(0, -0.05f, 1, 0), XMVectorSet(0, 1, 0, 0)));
+		XMStoreFloat4x4(&projection, XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.01f, 1000.0f));
+
+		const int picks = 1000;
+		double totalMs = 0.0;
+		double worstMs = 0.0;
+		int hits = 0;
+		for (int i = 0; i < picks; i++)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			PickHit hit = PickEntity(scene.entities, scene.resources, scene.bvh,
+				PickRay::FromScreen(unit(rng) * 1280.0f, unit(rng) * 720.0f, 1280.0f, 720.0f, view, projection));
+			double ms = Milliseconds(std::chrono::high_resolution_clock::now() - start);
+			totalMs += ms;
+			worstMs = (std::max)(worstMs, ms);
+			hits += hit.IsHit() ? 1 : 0;
+		}
+
+		snprintf(detail, sizeof(detail), "%.4f ms average, %.4f ms worst, %d of %d hit (BVH built in %.1f ms)",
+			totalMs / picks, worstMs, hits, picks, buildMs);
+		failures += ReportCheck("picks at 100k entities are under 1 ms", totalMs / picks < 1.0, detail);
+	}
+
+	printf("\n");
+	failures += ReportValidation(backend);
+	return ReportFailures(failures);
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+// --------------------------------------------------------
+// Headless checks of entity picking - no GPU.
+//
+// The sample scene (Game's meshes and layout) seen from the
+// default camera:
+//  - the screen center picks the sphere in front, and a pixel
+//    on the left cube picks it, with the hit point and normal
+//    of the faces facing the camera
+//  - a rotated cube and the scaled floor get normals through
+//    their world matrices, with the hit point on that face
+//  - a ray through a sphere's bounds that misses the sphere
+//    itself picks nothing
+//  - random rays pick what testing every entity's triangles
+//    finds
+//
+// A dynamic mesh (like the skinned tube) in front of the sphere
+// keeps no CPU geometry or BVH, even when asked to, and the ray
+// goes on to the sphere.
+//
+// Then 100k entities of the same meshes: picks through random
+// pixels, timed, must average under a millisecond.
+//
+// Prints each check, returns 0 if all passed.
+// --------------------------------------------------------
+int RunPickingChecks();
@@ -6,9 +6,25 @@ Texture2D Albedo : register(t0);
 Texture2D NormalMap : register(t1);
 Texture2D RoughnessMap : register(t2);
 Texture2D MetalnessMap : register(t3);
-Texture2D ShadowMap : register(t4);
+Texture2DArray ShadowMap : register(t4); // one slice per cascade
 SamplerComparisonState ShadowSampler : register(s1);
 
+// Clustered lights (see LightClusterGrid), or just the lights
+// objects picked (see ObjectLightSelector)
+StructuredBuffer<Light> Lights : register(t5);
+StructuredBuffer<uint> LightIndices : register(t6);
+StructuredBuffer<uint2> ClusterLightRanges : register(t7); // offset, count
+
+// Every other shadow casting light's tiles (see ShadowAtlas),
+// indexed by Light.ShadowIndex - 1
+struct ShadowTile
+{
+    float4x4 viewProjection;
+    float4 atlasRect; // scale xy, offset zw from tile to atlas UVs
+};
+Texture2D ShadowAtlas : register(t8);
+StructuredBuffer<ShadowTile> ShadowTiles : register(t9);
+
 
 cbuffer ExternalData : register(b0)
 {
@@ -19,7 +35,66 @@ cbuffer ExternalData : register(b0)
     float padding;
     float3 cameraPosition;
     float padding2;
-    Light lights[5];
+    int objectLightCount; // -1 = use the light clusters
+    float3 padding3;
+    uint4 objectLights[2]; // indices into Lights, 4 per element
+}
+
+cbuffer LightClusterData : register(b1)
+{
+    uint3 clusterCount;
+    uint directionalLightCount;
+    float2 clusterTileScale;
+    float clusterDepthScale;
+    float clusterDepthBias;
+}
+
+cbuffer ShadowData : register(b2)
+{
+    float4x4 cascadeViewProjection[4];
+    float4 cascadeSplits; // far view depth of each cascade
+    uint cascadeCount;
+    float shadowTexelSize;
+    float atlasTexelSize;
+}
+
+// Shadow from a light's atlas tile - a point light's six cube
+// faces are consecutive tiles, +x -x +y -y +z -z
+float AtlasShadow(Light light, float3 worldPosition)
+{
+    uint tileIndex = (uint)(light.ShadowIndex - 1);
+    if (light.Type == LIGHT_TYPE_POINT)
+    {
+        float3 d = worldPosition - light.Position;
+        float3 a = abs(d);
+        if (a.x >= a.y && a.x >= a.z)
+            tileIndex += d.x < 0.0f ? 1 : 0;
+        else if (a.y >= a.z)
+            tileIndex += d.y < 0.0f ? 3 : 2;
+        else
+            tileIndex += d.z < 0.0f ? 5 : 4;
+    }
+    
+    ShadowTile tile = ShadowTiles[tileIndex];
+    float4 shadowPos = mul(tile.viewProjection, float4(worldPosition, 1.0f));
+    if (shadowPos.w <= 0.0f)
+        return 1.0f;
+    shadowPos.xyz /= shadowPos.w;
+    
+    // Stay a texel inside the tile so filtering never reads a neighbour
+    float2 uv = (shadowPos.xy * float2(0.5f, -0.5f) + 0.5f) * tile.atlasRect.xy + tile.atlasRect.zw;
+    uv = clamp(uv, tile.atlasRect.zw + atlasTexelSize, tile.atlasRect.zw + tile.atlasRect.xy - atlasTexelSize);
+    return ShadowAtlas.SampleCmpLevelZero(ShadowSampler, uv, shadowPos.z);
+}
+
+// The cascades' shadow was worked out once for the pixel
+float LightShadow(Light light, float cascadeShadow, float3 worldPosition)
+{
+    if (light.ShadowIndex == LIGHT_SHADOW_CASCADES)
+        return cascadeShadow;
+    if (light.ShadowIndex != LIGHT_SHADOW_NONE)
+        return AtlasShadow(light, worldPosition);
+    return 1.0f;
 }
 
 // Struct representing the data we expect to receive from earlier pipeline stages
@@ -87,12 +162,21 @@ float4 main(VertexToPixel input) : SV_TARGET
     float roughness = RoughnessMap.Sample(BasicSampler, uv).r;
     float metalness = MetalnessMap.Sample(BasicSampler, uv).r;
     
-    //shadow calculations
-    float2 shadowUV = input.shadowPos.xy / input.shadowPos.w;
-    shadowUV = shadowUV * 0.5f + 0.5f;
-    shadowUV.y = 1.0f - shadowUV.y; 
-    float depthFromLight = input.shadowPos.z / input.shadowPos.w;
-    float shadowAmount = ShadowMap.SampleCmpLevelZero(ShadowSampler, shadowUV, depthFromLight);
+    //shadow calculations - the first cascade that reaches this pixel's
+    //view depth (SV_Position.w), nothing past the last one is shadowed
+    float viewDepth = input.screenPosition.w;
+    float shadowAmount = 1.0f;
+    if (cascadeCount > 0 && viewDepth < cascadeSplits[cascadeCount - 1])
+    {
+        uint cascade = 0;
+        for (uint c = 0; c + 1 < cascadeCount; c++)
+            cascade += viewDepth > cascadeSplits[c] ? 1 : 0;
+        
+        float4 shadowPos = mul(cascadeViewProjection[cascade], float4(input.worldPosition, 1.0f));
+        float2 shadowUV = shadowPos.xy * 0.5f + 0.5f; // orthographic, w is 1
+        shadowUV.y = 1.0f - shadowUV.y;
+        shadowAmount = ShadowMap.SampleCmpLevelZero(ShadowSampler, float3(shadowUV, cascade), shadowPos.z);
+    }
     
     //return shadowAmount.rrrr;
     
@@ -112,23 +196,57 @@ float4 main(VertexToPixel input) : SV_TARGET
     //float3 totalLight = ambient + diffuseColor + specularColor;
     float3 totalLight = float3(0,0,0);
     
-    // loop through all lights
-    for (int i = 0; i < 5; i++)
+    if (objectLightCount >= 0)
     {
-        switch (lights[i].Type)
+        // per-object lights: the selector already picked the ones that matter
+        for (int o = 0; o < objectLightCount; o++)
+        {
+            Light light = Lights[objectLights[o / 4][o % 4]];
+            switch (light.Type)
+            {
+                case LIGHT_TYPE_DIRECTIONAL:
+                    totalLight += DirectionalLightPBR(light, input.normal,
+                        input.worldPosition, cameraPosition, surfaceColor.rgb, roughness, metalness) * LightShadow(light, shadowAmount, input.worldPosition);
+                    break;
+                case LIGHT_TYPE_POINT:
+                    totalLight += PointLightPBR(light, input.normal,
+                        input.worldPosition, cameraPosition, surfaceColor.rgb, roughness, metalness) * LightShadow(light, shadowAmount, input.worldPosition);
+                    break;
+                case LIGHT_TYPE_SPOT:
+                    totalLight += SpotLightPBR(light, input.normal,
+                        input.worldPosition, cameraPosition, surfaceColor.rgb, roughness, metalness) * LightShadow(light, shadowAmount, input.worldPosition);
+                    break;
+            }
+        }
+    }
+    else
+    {
+        // directional lights apply everywhere - they're at the start of the index list
+        for (uint d = 0; d < directionalLightCount; d++)
+        {
+            Light light = Lights[LightIndices[d]];
+            totalLight += DirectionalLightPBR(light, input.normal,
+                input.worldPosition, cameraPosition, surfaceColor.rgb, roughness, metalness) * LightShadow(light, shadowAmount, input.worldPosition);
+        }
+        
+        // point and spot lights - only the ones binned into this pixel's cluster
+        // (SV_Position.w is the view space depth)
+        uint2 tile = min(uint2(input.screenPosition.xy * clusterTileScale), clusterCount.xy - 1);
+        float slice = log(input.screenPosition.w) * clusterDepthScale + clusterDepthBias;
+        uint3 cluster = uint3(tile, (uint)clamp(slice, 0.0f, (float)(clusterCount.z - 1)));
+        uint2 range = ClusterLightRanges[cluster.x + clusterCount.x * (cluster.y + clusterCount.y * cluster.z)];
+        
+        for (uint i = 0; i < range.y; i++)
         {
-            case LIGHT_TYPE_DIRECTIONAL:
-                totalLight += DirectionalLightPBR(lights[i], input.normal,
-                input.worldPosition, cameraPosition, surfaceColor.rgb, roughness, metalness) * (lights[i].CastsShadows ? shadowAmount : 1.0f);
-                break;
-            case LIGHT_TYPE_POINT:
-                totalLight += PointLightPBR(lights[i], input.normal,
-                input.worldPosition, cameraPosition, surfaceColor.rgb, roughness, metalness);
-                break;
-            case LIGHT_TYPE_SPOT:
-                totalLight += SpotLightPBR(lights[i], input.normal,
-                input.worldPosition, cameraPosition, surfaceColor.rgb, roughness, metalness);
-                break;
+            Light light = Lights[LightIndices[range.x + i]];
+            float3 lit;
+            if (light.Type == LIGHT_TYPE_POINT)
+                lit = PointLightPBR(light, input.normal,
+                    input.worldPosition, cameraPosition, surfaceColor.rgb, roughness, metalness);
+            else
+                lit = SpotLightPBR(light, input.normal,
+                    input.worldPosition, cameraPosition, surfaceColor.rgb, roughness, metalness);
+            totalLight += lit * LightShadow(light, shadowAmount, input.worldPosition);
         }
     }
     
@@ -0,0 +1,502 @@
+#include "RecordingBackend.h"
+#include <cstring>
+
+BufferHandle RecordingBackend::CreateBuffer(const BufferDesc& desc)
+{
+	if (desc.size == 0)
+	{
+		Error("CreateBuffer: zero-sized buffer");
+		return BufferHandle();
+	}
+
+	if (desc.usage == BufferUsage::Immutable && !desc.initialData)
+	{
+		Error("CreateBuffer: immutable buffer without initial data");
+		return BufferHandle();
+	}
+
+	if (desc.type == BufferType::Constant && desc.size % 16 != 0)
+	{
+		Error("CreateBuffer: constant buffer size must be a multiple of 16");
+		return BufferHandle();
+	}
+
+	if (desc.type == BufferType::Structured && (desc.stride == 0 || desc.stride % 4 != 0 || desc.size % desc.stride != 0))
+	{
+		Error("CreateBuffer: structured buffer size must be a multiple of a 4-byte aligned stride");
+		return BufferHandle();
+	}
+
+	BufferInfo info;
+	info.type = desc.type;
+	info.usage = desc.usage;
+	info.size = desc.size;
+
+	// Only dynamic buffers need memory - nothing ever reads the others
+	if (desc.usage == BufferUsage::Dynamic)
+		info.storage.resize(desc.size);
+
+	BufferHandle handle;
+	handle.id = buffers.Add(info);
+	if (!handle.IsValid())
+		Error("CreateBuffer: every handle index is taken");
+	return handle;
+}
+
+TextureHandle RecordingBackend::CreateTexture(const TextureDesc& desc)
+{
+	if (desc.width == 0 || desc.height == 0)
+	{
+		Error("CreateTexture: zero-sized texture");
+		return TextureHandle();
+	}
+
+	TextureDesc stored = desc;
+	stored.initialData = nullptr;
+
+	TextureHandle handle;
+	handle.id = textures.Add(stored);
+	if (!handle.IsValid())
+		Error("CreateTexture: every handle index is taken");
+	return handle;
+}
+
+SamplerHandle RecordingBackend::CreateSampler(const SamplerDesc& desc)
+{
+	SamplerHandle handle;
+	handle.id = samplers.Add(desc);
+	if (!handle.IsValid())
+		Error("CreateSampler: every handle index is taken");
+	return handle;
+}
+
+ShaderHandle RecordingBackend::CreateShader(ShaderStage stage, const void* bytecode, size_t bytecodeSize)
+{
+	if (!bytecode || bytecodeSize == 0)
+	{
+		Error("CreateShader: no bytecode");
+		return ShaderHandle();
+	}
+
+	ShaderHandle handle;
+	handle.id = shaders.Add(stage);
+	if (!handle.IsValid())
+		Error("CreateShader: every handle index is taken");
+	return handle;
+}
+
+void RecordingBackend::DestroyBuffer(BufferHandle buffer)
+{
+	if (!buffers.Contains(buffer.id))
+		Error("DestroyBuffer: unknown or already destroyed buffer");
+	buffers.Remove(buffer.id);
+}
+
+void RecordingBackend::DestroyTexture(TextureHandle texture)
+{
+	if (!textures.Contains(texture.id))
+		Error("DestroyTexture: unknown or already destroyed texture");
+	textures.Remove(texture.id);
+}
+
+void RecordingBackend::DestroySampler(SamplerHandle sampler)
+{
+	if (!samplers.Contains(sampler.id))
+		Error("DestroySampler: unknown or already destroyed sampler");
+	samplers.Remove(sampler.id);
+}
+
+void RecordingBackend::DestroyShader(ShaderHandle shader)
+{
+	if (!shaders.Contains(shader.id))
+		Error("DestroyShader: unknown or already destroyed shader");
+	shaders.Remove(shader.id);
+}
+
+void* RecordingBackend::Map(BufferHandle buffer, MapMode mode)
+{
+	BufferInfo* info = buffers.Find(buffer.id);
+	if (!info)
+	{
+		Error("Map: unknown buffer");
+		return nullptr;
+	}
+
+	if (info->usage != BufferUsage::Dynamic)
+	{
+		Error("Map: buffer is not dynamic");
+		return nullptr;
+	}
+
+	if (info->mapped)
+		Error("Map: buffer is already mapped");
+
+	// A discarded buffer's old contents are gone on a GPU too, so
+	// they're scribbled over for anything that still reads them
+	if (mode == MapMode::WriteDiscard)
+	{
+		stats.discardMaps++;
+		if (validate)
+			memset(info->storage.data(), 0xCD, info->storage.size());
+	}
+
+	info->mapped = true;
+	stats.maps++;
+	return info->storage.data();
+}
+
+void RecordingBackend::Unmap(BufferHandle buffer)
+{
+	BufferInfo* info = buffers.Find(buffer.id);
+	if (!info || !info->mapped)
+	{
+		Error("Unmap: buffer is not mapped");
+		return;
+	}
+
+	info->mapped = false;
+}
+
+void RecordingBackend::SetShader(ShaderStage stage, ShaderHandle shader)
+{
+	if (shader.IsValid())
+	{
+		const ShaderStage* shaderStage = shaders.Find(shader.id);
+		if (!shaderStage)
+			Error("SetShader: unknown shader");
+		else if (*shaderStage != stage)
+			Error("SetShader: shader bound to the wrong stage");
+	}
+
+	unsigned int s = (unsigned int)stage;
+	if (boundShaders[s] == shader)
+		stats.redundantBinds++;
+
+	boundShaders[s] = shader;
+	stats.shaderBinds++;
+	Log(CommandType::SetShader, s, 0, shader.id);
+}
+
+void RecordingBackend::SetVertexBuffer(BufferHandle buffer, unsigned int stride, unsigned int offset)
+{
+	if (buffer.IsValid())
+	{
+		const BufferInfo* info = buffers.Find(buffer.id);
+		if (!info)
+			Error("SetVertexBuffer: unknown buffer");
+		else if (info->type != BufferType::Vertex)
+			Error("SetVertexBuffer: not a vertex buffer");
+	}
+
+	if (boundVertexBuffer == buffer && boundStride == stride && boundVertexOffset == offset)
+		stats.redundantBinds++;
+
+	boundVertexBuffer = buffer;
+	boundStride = stride;
+	boundVertexOffset = offset;
+	stats.vertexBufferBinds++;
+	Log(CommandType::SetVertexBuffer, 0, 0, buffer.id, stride, offset);
+}
+
+void RecordingBackend::SetIndexBuffer(BufferHandle buffer)
+{
+	if (buffer.IsValid())
+	{
+		const BufferInfo* info = buffers.Find(buffer.id);
+		if (!info)
+			Error("SetIndexBuffer: unknown buffer");
+		else if (info->type != BufferType::Index)
+			Error("SetIndexBuffer: not an index buffer");
+	}
+
+	if (boundIndexBuffer == buffer)
+		stats.redundantBinds++;
+
+	boundIndexBuffer = buffer;
+	stats.indexBufferBinds++;
+	Log(CommandType::SetIndexBuffer, 0, 0, buffer.id);
+}
+
+void RecordingBackend::SetConstantBuffer(ShaderStage stage, unsigned int slot, BufferHandle buffer,
+	unsigned int firstConstant, unsigned int numConstants)
+{
+	if (slot >= MaxConstantBufferSlots)
+	{
+		Error("SetConstantBuffer: slot out of range");
+		return;
+	}
+
+	if (buffer.IsValid())
+	{
+		const BufferInfo* info = buffers.Find(buffer.id);
+		if (!info)
+			Error("SetConstantBuffer: unknown buffer");
+		else if (info->type != BufferType::Constant)
+			Error("SetConstantBuffer: not a constant buffer");
+		else if (firstConstant % 16 != 0 || numConstants % 16 != 0 || numConstants == 0)
+			Error("SetConstantBuffer: range is not 256-byte aligned");
+		else if ((size_t)(firstConstant + numConstants) * 16 > info->size)
+			Error("SetConstantBuffer: range is past the end of the buffer");
+	}
+
+	unsigned int s = (unsigned int)stage;
+	ConstantBinding& binding = boundConstants[s][slot];
+	if (binding.buffer == buffer && binding.firstConstant == firstConstant && binding.numConstants == numConstants)
+		stats.redundantBinds++;
+
+	binding.buffer = buffer;
+	binding.firstConstant = firstConstant;
+	binding.numConstants = numConstants;
+	stats.constantBufferBinds++;
+	Log(CommandType::SetConstantBuffer, s, slot, buffer.id, firstConstant, numConstants);
+}
+
+void RecordingBackend::SetTexture(ShaderStage stage, unsigned int slot, TextureHandle texture)
+{
+	if (slot >= MaxTextureSlots)
+	{
+		Error("SetTexture: slot out of range");
+		return;
+	}
+
+	if (texture.IsValid() && !textures.Contains(texture.id))
+		Error("SetTexture: unknown texture");
+
+	unsigned int s = (unsigned int)stage;
+	if (boundTextures[s][slot] == texture)
+		stats.redundantBinds++;
+
+	// A texture and a structured buffer can't share a slot
+	boundTextures[s][slot] = texture;
+	boundShaderBuffers[s][slot] = BufferHandle();
+	stats.textureBinds++;
+	Log(CommandType::SetTexture, s, slot, texture.id);
+}
+
+void RecordingBackend::SetShaderBuffer(ShaderStage stage, unsigned int slot, BufferHandle buffer)
+{
+	if (slot >= MaxTextureSlots)
+	{
+		Error("SetShaderBuffer: slot out of range");
+		return;
+	}
+
+	if (buffer.IsValid())
+	{
+		const BufferInfo* info = buffers.Find(buffer.id);
+		if (!info)
+			Error("SetShaderBuffer: unknown buffer");
+		else if (info->type != BufferType::Structured)
+			Error("SetShaderBuffer: not a structured buffer");
+	}
+
+	unsigned int s = (unsigned int)stage;
+	if (boundShaderBuffers[s][slot] == buffer)
+		stats.redundantBinds++;
+
+	boundShaderBuffers[s][slot] = buffer;
+	boundTextures[s][slot] = TextureHandle();
+	stats.shaderBufferBinds++;
+	Log(CommandType::SetShaderBuffer, s, slot, buffer.id);
+}
+
+void RecordingBackend::SetSampler(ShaderStage stage, unsigned int slot, SamplerHandle sampler)
+{
+	if (slot >= MaxSamplerSlots)
+	{
+		Error("SetSampler: slot out of range");
+		return;
+	}
+
+	if (sampler.IsValid() && !samplers.Contains(sampler.id))
+		Error("SetSampler: unknown sampler");
+
+	unsigned int s = (unsigned int)stage;
+	if (boundSamplers[s][slot] == sampler)
+		stats.redundantBinds++;
+
+	boundSamplers[s][slot] = sampler;
+	stats.samplerBinds++;
+	Log(CommandType::SetSampler, s, slot, sampler.id);
+}
+
+void RecordingBackend::Draw(unsigned int vertexCount, unsigned int startVertex)
+{
+	ValidateDrawState("Draw");
+
+	// No vertex buffer is fine (SV_VertexID draws), but if there is
+	// one the draw has to stay inside it
+	const BufferInfo* vb = buffers.Find(boundVertexBuffer.id);
+	if (vb && boundStride > 0 &&
+		boundVertexOffset + (size_t)(startVertex + vertexCount) * boundStride > vb->size)
+		Error("Draw: vertex range is past the end of the vertex buffer");
+
+	stats.draws++;
+	Log(CommandType::Draw, 0, 0, 0, vertexCount, startVertex);
+}
+
+void RecordingBackend::DrawIndexed(unsigned int indexCount, unsigned int startIndex, int baseVertex)
+{
+	ValidateDrawState("DrawIndexed");
+
+	if (!buffers.Contains(boundVertexBuffer.id))
+		Error("DrawIndexed: no vertex buffer bound");
+
+	const BufferInfo* ib = buffers.Find(boundIndexBuffer.id);
+	if (!ib)
+		Error("DrawIndexed: no index buffer bound");
+	else if ((size_t)(startIndex + indexCount) * sizeof(unsigned int) > ib->size)
+		Error("DrawIndexed: index range is past the end of the index buffer");
+
+	stats.draws++;
+	stats.indexedDraws++;
+	stats.indices += indexCount;
+	Log(CommandType::DrawIndexed, 0, 0, 0, indexCount, startIndex, baseVertex);
+}
+
+std::shared_ptr<IFrameFence> RecordingBackend::CreateFence()
+{
+	return std::make_shared<ImmediateFence>();
+}
+
+void RecordingBackend::ResetFrame()
+{
+	stats = RecordingStats();
+	commands.clear();
+}
+
+void RecordingBackend::ClearState()
+{
+	for (unsigned int s = 0; s < StageCount; s++)
+	{
+		boundShaders[s] = ShaderHandle();
+		for (ConstantBinding& binding : boundConstants[s])
+			binding = ConstantBinding();
+		for (TextureHandle& texture : boundTextures[s])
+			texture = TextureHandle();
+		for (BufferHandle& buffer : boundShaderBuffers[s])
+			buffer = BufferHandle();
+		for (SamplerHandle& sampler : boundSamplers[s])
+			sampler = SamplerHandle();
+	}
+
+	boundVertexBuffer = BufferHandle();
+	boundStride = 0;
+	boundVertexOffset = 0;
+	boundIndexBuffer = BufferHandle();
+}
+
+void RecordingBackend::Replay(const std::vector<Command>& commands)
+{
+	for (const Command& command : commands)
+	{
+		ShaderStage stage = (ShaderStage)command.stage;
+		switch (command.type)
+		{
+		case CommandType::SetShader:
+			SetShader(stage, ShaderHandle{ command.handle });
+			break;
+		case CommandType::SetVertexBuffer:
+			SetVertexBuffer(BufferHandle{ command.handle }, command.a, command.b);
+			break;
+		case CommandType::SetIndexBuffer:
+			SetIndexBuffer(BufferHandle{ command.handle });
+			break;
+		case CommandType::SetConstantBuffer:
+			SetConstantBuffer(stage, command.slot, BufferHandle{ command.handle }, command.a, command.b);
+			break;
+		case CommandType::SetTexture:
+			SetTexture(stage, command.slot, TextureHandle{ command.handle });
+			break;
+		case CommandType::SetShaderBuffer:
+			SetShaderBuffer(stage, command.slot, BufferHandle{ command.handle });
+			break;
+		case CommandType::SetSampler:
+			SetSampler(stage, command.slot, SamplerHandle{ command.handle });
+			break;
+		case CommandType::Draw:
+			Draw(command.a, command.b);
+			break;
+		case CommandType::DrawIndexed:
+			DrawIndexed(command.a, command.b, command.c);
+			break;
+		}
+	}
+}
+
+// --------------------------------------------------------
+// Checks everything currently bound is still alive and
+// readable.  Shared by both draw calls.
+// --------------------------------------------------------
+void RecordingBackend::ValidateDrawState(const char* drawName)
+{
+	if (!validate)
+		return;
+
+	std::string name = drawName;
+
+	if (!shaders.Contains(boundShaders[(unsigned int)ShaderStage::Vertex].id))
+		Error(name + ": no vertex shader bound");
+
+	// A null pixel shader is valid (depth-only passes), a dead one isn't
+	ShaderHandle ps = boundShaders[(unsigned int)ShaderStage::Pixel];
+	if (ps.IsValid() && !shaders.Contains(ps.id))
+		Error(name + ": bound pixel shader was destroyed");
+
+	for (unsigned int s = 0; s < StageCount; s++)
+	{
+		for (unsigned int slot = 0; slot < MaxConstantBufferSlots; slot++)
+		{
+			BufferHandle cb = boundConstants[s][slot].buffer;
+			if (!cb.IsValid())
+				continue;
+
+			const BufferInfo* info = buffers.Find(cb.id);
+			if (!info)
+				Error(name + ": bound constant buffer was destroyed");
+			else if (info->mapped)
+				Error(name + ": bound constant buffer is still mapped");
+		}
+
+		for (unsigned int slot = 0; slot < MaxTextureSlots; slot++)
+		{
+			TextureHandle t = boundTextures[s][slot];
+			if (t.IsValid() && !textures.Contains(t.id))
+				Error(name + ": bound texture was destroyed");
+
+			BufferHandle sb = boundShaderBuffers[s][slot];
+			if (!sb.IsValid())
+				continue;
+
+			const BufferInfo* info = buffers.Find(sb.id);
+			if (!info)
+				Error(name + ": bound shader buffer was destroyed");
+			else if (info->mapped)
+				Error(name + ": bound shader buffer is still mapped");
+		}
+
+		for (unsigned int slot = 0; slot < MaxSamplerSlots; slot++)
+		{
+			SamplerHandle smp = boundSamplers[s][slot];
+			if (smp.IsValid() && !samplers.Contains(smp.id))
+				Error(name + ": bound sampler was destroyed");
+		}
+	}
+
+	const BufferInfo* vb = buffers.Find(boundVertexBuffer.id);
+	if (vb && vb->mapped)
+		Error(name + ": bound vertex buffer is still mapped");
+}
+
+void RecordingBackend::Error(const std::string& message)
+{
+	errorCount++;
+	if (errors.size() < MaxStoredErrors)
+		errors.push_back(message);
+}
+
+void RecordingBackend::Log(CommandType type, unsigned int stage, unsigned int slot, uint32_t handle, unsigned int a, unsigned int b, int c)
+{
+	if (logCommands)
+		commands.push_back({ type, stage, slot, handle, a, b, c });
+}
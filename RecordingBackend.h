@@ -0,0 +1,191 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "RenderBackend.h"
+
+// --------------------------------------------------------
+// Fence for backends without a GPU: every signaled value is
+// complete immediately
+// --------------------------------------------------------
+class ImmediateFence : public IFrameFence
+{
+public:
+	uint64_t Signal() override { completed = next; return next++; }
+	uint64_t GetCompletedValue() override { return completed; }
+	void WaitFor(uint64_t) override {}
+
+private:
+	uint64_t next = 1;
+	uint64_t completed = 0;
+};
+
+// --------------------------------------------------------
+// Per-frame call counts collected by the RecordingBackend
+// --------------------------------------------------------
+struct RecordingStats
+{
+	unsigned int draws = 0;
+	unsigned int indexedDraws = 0;
+	unsigned long long indices = 0;
+	unsigned int shaderBinds = 0;
+	unsigned int vertexBufferBinds = 0;
+	unsigned int indexBufferBinds = 0;
+	unsigned int constantBufferBinds = 0;
+	unsigned int textureBinds = 0;
+	unsigned int shaderBufferBinds = 0;
+	unsigned int samplerBinds = 0;
+	unsigned int redundantBinds = 0;	// Bind of what was already bound
+	unsigned int maps = 0;
+	unsigned int discardMaps = 0;		// Of those, with MapMode::WriteDiscard
+};
+
+// --------------------------------------------------------
+// IRenderBackend with no GPU behind it.
+//
+// Resources are just bookkeeping (dynamic buffers get real CPU
+// memory so Map() works), binds update a shadow copy of the
+// pipeline state and every draw is checked against it:
+//  - a vertex shader is bound, of the right stage
+//  - vertex/index buffers are bound and the draw stays in range
+//  - bound constant buffer ranges are 256-byte aligned and in range
+//  - structured buffers are only bound as shader buffers
+//  - nothing bound is still mapped or has been destroyed
+//
+// With validation on, mapping with WriteDiscard fills the buffer
+// with garbage, as the old contents can't be relied on.
+//
+// Problems are collected as messages instead of asserting so a
+// bench run can report all of them.
+// --------------------------------------------------------
+class RecordingBackend : public IRenderBackend
+{
+public:
+	enum class CommandType
+	{
+		SetShader,
+		SetVertexBuffer,
+		SetIndexBuffer,
+		SetConstantBuffer,
+		SetTexture,
+		SetShaderBuffer,
+		SetSampler,
+		Draw,
+		DrawIndexed
+	};
+
+	// Kept small on purpose - the log is only filled when enabled
+	struct Command
+	{
+		CommandType type;
+		unsigned int stage;
+		unsigned int slot;
+		uint32_t handle;
+		unsigned int a;
+		unsigned int b;
+		int c;		// DrawIndexed base vertex
+	};
+
+	static const unsigned int MaxConstantBufferSlots = 14;
+	static const unsigned int MaxTextureSlots = 16;
+	static const unsigned int MaxSamplerSlots = 16;
+
+	// IRenderBackend
+	BufferHandle CreateBuffer(const BufferDesc& desc) override;
+	TextureHandle CreateTexture(const TextureDesc& desc) override;
+	SamplerHandle CreateSampler(const SamplerDesc& desc) override;
+	ShaderHandle CreateShader(ShaderStage stage, const void* bytecode, size_t bytecodeSize) override;
+
+	void DestroyBuffer(BufferHandle buffer) override;
+	void DestroyTexture(TextureHandle texture) override;
+	void DestroySampler(SamplerHandle sampler) override;
+	void DestroyShader(ShaderHandle shader) override;
+
+	void* Map(BufferHandle buffer, MapMode mode) override;
+	void Unmap(BufferHandle buffer) override;
+
+	void SetShader(ShaderStage stage, ShaderHandle shader) override;
+	void SetVertexBuffer(BufferHandle buffer, unsigned int stride, unsigned int offset) override;
+	void SetIndexBuffer(BufferHandle buffer) override;
+	void SetConstantBuffer(ShaderStage stage, unsigned int slot, BufferHandle buffer,
+		unsigned int firstConstant, unsigned int numConstants) override;
+	void SetTexture(ShaderStage stage, unsigned int slot, TextureHandle texture) override;
+	void SetShaderBuffer(ShaderStage stage, unsigned int slot, BufferHandle buffer) override;
+	void SetSampler(ShaderStage stage, unsigned int slot, SamplerHandle sampler) override;
+
+	void Draw(unsigned int vertexCount, unsigned int startVertex) override;
+	void DrawIndexed(unsigned int indexCount, unsigned int startIndex, int baseVertex) override;
+
+	std::shared_ptr<IFrameFence> CreateFence() override;
+
+	// Recording control
+	void SetCommandLogEnabled(bool enabled) { logCommands = enabled; }
+	void SetValidationEnabled(bool enabled) { validate = enabled; }
+	const std::vector<Command>& GetCommands() const { return commands; }
+
+	// Clears stats and the command log, keeps resources and bound state
+	void ResetFrame();
+
+	// Unbinds everything, like a fresh D3D11 context
+	void ClearState();
+
+	// Issues logged commands again as if they were called now -
+	// how the RecordingCommandDevice executes command lists
+	void Replay(const std::vector<Command>& commands);
+
+	// Results
+	const RecordingStats& GetStats() const { return stats; }
+	const std::vector<std::string>& GetErrors() const { return errors; }
+	size_t GetErrorCount() const { return errorCount; }
+	size_t GetLiveBufferCount() const { return buffers.Count(); }
+
+private:
+	// Only the first few messages are kept, the rest are just counted
+	static const size_t MaxStoredErrors = 64;
+
+	struct BufferInfo
+	{
+		BufferType type = BufferType::Vertex;
+		BufferUsage usage = BufferUsage::Immutable;
+		size_t size = 0;
+		std::vector<unsigned char> storage;
+		bool mapped = false;
+	};
+
+	struct ConstantBinding
+	{
+		BufferHandle buffer;
+		unsigned int firstConstant = 0;
+		unsigned int numConstants = 0;
+	};
+
+	static const unsigned int StageCount = (unsigned int)ShaderStage::Count;
+
+	HandleTable<BufferInfo> buffers;
+	HandleTable<TextureDesc> textures;
+	HandleTable<SamplerDesc> samplers;
+	HandleTable<ShaderStage> shaders;
+
+	// Shadow copy of the pipeline
+	ShaderHandle boundShaders[StageCount];
+	BufferHandle boundVertexBuffer;
+	unsigned int boundStride = 0;
+	unsigned int boundVertexOffset = 0;
+	BufferHandle boundIndexBuffer;
+	ConstantBinding boundConstants[StageCount][MaxConstantBufferSlots];
+	TextureHandle boundTextures[StageCount][MaxTextureSlots];
+	BufferHandle boundShaderBuffers[StageCount][MaxTextureSlots];	// Same slots as textures
+	SamplerHandle boundSamplers[StageCount][MaxSamplerSlots];
+
+	RecordingStats stats;
+	std::vector<std::string> errors;
+	size_t errorCount = 0;
+
+	bool validate = true;
+	bool logCommands = false;
+	std::vector<Command> commands;
+
+	void Error(const std::string& message);
+	void Log(CommandType type, unsigned int stage, unsigned int slot, uint32_t handle, unsigned int a = 0, unsigned int b = 0, int c = 0);
+	void ValidateDrawState(const char* drawName);
+};
@@ -0,0 +1,88 @@
+#include "RecordingCommandDevice.h"
+
+using CommandType = RecordingBackend::CommandType;
+
+std::unique_ptr<ICommandList> RecordingDeferredContext::Finish()
+{
+	// The log and the list's trade places, so once both have grown
+	// to a frame's worth recording doesn't touch the heap
+	std::unique_ptr<RecordingCommandList> list = spare ? std::move(spare) : std::make_unique<RecordingCommandList>();
+	list->commands.swap(commands);
+	return list;
+}
+
+void RecordingDeferredContext::Recycle(std::unique_ptr<ICommandList> commandList)
+{
+	spare.reset(static_cast<RecordingCommandList*>(commandList.release()));
+	spare->commands.clear();
+}
+
+void RecordingDeferredContext::Record(CommandType type, unsigned int stage, unsigned int slot, uint32_t handle,
+	unsigned int a, unsigned int b, int c)
+{
+	commands.push_back({ type, stage, slot, handle, a, b, c });
+}
+
+void RecordingDeferredContext::SetShader(ShaderStage stage, ShaderHandle shader)
+{
+	Record(CommandType::SetShader, (unsigned int)stage, 0, shader.id);
+}
+
+void RecordingDeferredContext::SetVertexBuffer(BufferHandle buffer, unsigned int stride, unsigned int offset)
+{
+	Record(CommandType::SetVertexBuffer, 0, 0, buffer.id, stride, offset);
+}
+
+void RecordingDeferredContext::SetIndexBuffer(BufferHandle buffer)
+{
+	Record(CommandType::SetIndexBuffer, 0, 0, buffer.id);
+}
+
+void RecordingDeferredContext::SetConstantBuffer(ShaderStage stage, unsigned int slot, BufferHandle buffer,
+	unsigned int firstConstant, unsigned int numConstants)
+{
+	Record(CommandType::SetConstantBuffer, (unsigned int)stage, slot, buffer.id, firstConstant, numConstants);
+}
+
+void RecordingDeferredContext::SetTexture(ShaderStage stage, unsigned int slot, TextureHandle texture)
+{
+	Record(CommandType::SetTexture, (unsigned int)stage, slot, texture.id);
+}
+
+void RecordingDeferredContext::SetShaderBuffer(ShaderStage stage, unsigned int slot, BufferHandle buffer)
+{
+	Record(CommandType::SetShaderBuffer, (unsigned int)stage, slot, buffer.id);
+}
+
+void RecordingDeferredContext::SetSampler(ShaderStage stage, unsigned int slot, SamplerHandle sampler)
+{
+	Record(CommandType::SetSampler, (unsigned int)stage, slot, sampler.id);
+}
+
+void RecordingDeferredContext::Draw(unsigned int vertexCount, unsigned int startVertex)
+{
+	Record(CommandType::Draw, 0, 0, 0, vertexCount, startVertex);
+}
+
+void RecordingDeferredContext::DrawIndexed(unsigned int indexCount, unsigned int startIndex, int baseVertex)
+{
+	Record(CommandType::DrawIndexed, 0, 0, 0, indexCount, startIndex, baseVertex);
+}
+
+RecordingCommandDevice::RecordingCommandDevice(RecordingBackend& immediateBackend)
+	: immediateBackend(immediateBackend), immediate(immediateBackend)
+{
+}
+
+std::unique_ptr<IRecordingContext> RecordingCommandDevice::CreateDeferredContext()
+{
+	return std::make_unique<RecordingDeferredContext>(immediateBackend);
+}
+
+void RecordingCommandDevice::Execute(ICommandList& commandList)
+{
+	immediateBackend.ClearState();
+	immediateBackend.Replay(static_cast<RecordingCommandList&>(commandList).commands);
+	immediateBackend.ClearState();
+	executedLists++;
+}
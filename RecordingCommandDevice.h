@@ -0,0 +1,106 @@
+#pragma once
+
+#include <vector>
+#include "CommandListDevice.h"
+#include "RecordingBackend.h"
+
+// --------------------------------------------------------
+// Command list of the RecordingCommandDevice: just the log
+// --------------------------------------------------------
+class RecordingCommandList : public ICommandList
+{
+public:
+	std::vector<RecordingBackend::Command> commands;
+};
+
+// --------------------------------------------------------
+// Deferred context of the RecordingCommandDevice.
+//
+// Binds and draws are only logged - nothing is checked until the
+// list is replayed on the immediate RecordingBackend, the same
+// way a real driver only sees deferred work at execute time.
+// Resource creation and Map/Unmap go straight to the immediate
+// backend (main thread only, like the D3D11 handle tables).
+// --------------------------------------------------------
+class RecordingDeferredContext : public IRecordingContext, public IRenderBackend
+{
+public:
+	explicit RecordingDeferredContext(RecordingBackend& immediate) : immediate(immediate) {}
+
+	// IRecordingContext
+	IRenderBackend& GetBackend() override { return *this; }
+	std::unique_ptr<ICommandList> Finish() override;
+	void Recycle(std::unique_ptr<ICommandList> commandList) override;
+
+	// IRenderBackend
+	BufferHandle CreateBuffer(const BufferDesc& desc) override { return immediate.CreateBuffer(desc); }
+	TextureHandle CreateTexture(const TextureDesc& desc) override { return immediate.CreateTexture(desc); }
+	SamplerHandle CreateSampler(const SamplerDesc& desc) override { return immediate.CreateSampler(desc); }
+	ShaderHandle CreateShader(ShaderStage stage, const void* bytecode, size_t bytecodeSize) override { return immediate.CreateShader(stage, bytecode, bytecodeSize); }
+
+	void DestroyBuffer(BufferHandle buffer) override { immediate.DestroyBuffer(buffer); }
+	void DestroyTexture(TextureHandle texture) override { immediate.DestroyTexture(texture); }
+	void DestroySampler(SamplerHandle sampler) override { immediate.DestroySampler(sampler); }
+	void DestroyShader(ShaderHandle shader) override { immediate.DestroyShader(shader); }
+
+	void* Map(BufferHandle buffer, MapMode mode) override { return immediate.Map(buffer, mode); }
+	void Unmap(BufferHandle buffer) override { immediate.Unmap(buffer); }
+
+	void SetShader(ShaderStage stage, ShaderHandle shader) override;
+	void SetVertexBuffer(BufferHandle buffer, unsigned int stride, unsigned int offset) override;
+	void SetIndexBuffer(BufferHandle buffer) override;
+	void SetConstantBuffer(ShaderStage stage, unsigned int slot, BufferHandle buffer,
+		unsigned int firstConstant, unsigned int numConstants) override;
+	void SetTexture(ShaderStage stage, unsigned int slot, TextureHandle texture) override;
+	void SetShaderBuffer(ShaderStage stage, unsigned int slot, BufferHandle buffer) override;
+	void SetSampler(ShaderStage stage, unsigned int slot, SamplerHandle sampler) override;
+
+	void Draw(unsigned int vertexCount, unsigned int startVertex) override;
+	void DrawIndexed(unsigned int indexCount, unsigned int startIndex, int baseVertex) override;
+
+	std::shared_ptr<IFrameFence> CreateFence() override { return immediate.CreateFence(); }
+
+private:
+	RecordingBackend& immediate;
+	std::vector<RecordingBackend::Command> commands;
+	std::unique_ptr<RecordingCommandList> spare;		// Recycled, its log empty but still allocated
+
+	void Record(RecordingBackend::CommandType type, unsigned int stage, unsigned int slot, uint32_t handle,
+		unsigned int a = 0, unsigned int b = 0, int c = 0);
+};
+
+// --------------------------------------------------------
+// ICommandListDevice with no GPU, for running the PassScheduler
+// headless.  Executing a list replays it on the immediate
+// RecordingBackend between two ClearState() calls, matching what
+// D3D11 does to the immediate context around ExecuteCommandList().
+// --------------------------------------------------------
+class RecordingCommandDevice : public ICommandListDevice
+{
+public:
+	explicit RecordingCommandDevice(RecordingBackend& immediateBackend);
+
+	IRecordingContext& GetImmediateContext() override { return immediate; }
+	std::unique_ptr<IRecordingContext> CreateDeferredContext() override;
+	void Execute(ICommandList& commandList) override;
+
+	unsigned int GetExecutedListCount() const { return executedLists; }
+
+private:
+	// Commands go straight to the backend, Finish() has nothing to hand back
+	class ImmediateContext : public IRecordingContext
+	{
+	public:
+		explicit ImmediateContext(RecordingBackend& backend) : backend(backend) {}
+		IRenderBackend& GetBackend() override { return backend; }
+		std::unique_ptr<ICommandList> Finish() override { return nullptr; }
+		void Recycle(std::unique_ptr<ICommandList>) override {}
+
+	private:
+		RecordingBackend& backend;
+	};
+
+	RecordingBackend& immediateBackend;
+	ImmediateContext immediate;
+	unsigned int executedLists = 0;
+};
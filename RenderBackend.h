@@ -0,0 +1,230 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "FrameFence.h"
+
+// --------------------------------------------------------
+// Opaque handle to a backend-owned object.  Id 0 is never
+// handed out, so a default-constructed handle means "none".
+// The tag only exists to keep the handle types distinct.
+//
+// Ids are generational (see HandleId), so a handle to something
+// destroyed stays invalid even once its slot is reused.
+// --------------------------------------------------------
+template<typename Tag>
+struct RenderHandle
+{
+	uint32_t id = 0;
+
+	bool IsValid() const { return id != 0; }
+	bool operator==(const RenderHandle& other) const { return id == other.id; }
+	bool operator!=(const RenderHandle& other) const { return id != other.id; }
+};
+
+using BufferHandle = RenderHandle<struct BufferTag>;
+using TextureHandle = RenderHandle<struct TextureTag>;		// Shader-readable texture
+using SamplerHandle = RenderHandle<struct SamplerTag>;
+using ShaderHandle = RenderHandle<struct ShaderTag>;
+
+enum class ShaderStage
+{
+	Vertex,
+	Pixel,
+	Count
+};
+
+enum class BufferType
+{
+	Vertex,
+	Index,		// Always 32-bit indices
+	Constant,
+	Structured	// Shader-readable array of BufferDesc::stride sized elements
+};
+
+enum class BufferUsage
+{
+	Immutable,	// Initial data required, never written again
+	Dynamic		// CPU writes through Map()
+};
+
+enum class MapMode
+{
+	WriteDiscard,		// Previous contents are gone
+	WriteNoOverwrite	// Caller promises not to touch anything the GPU may still read
+};
+
+enum class TextureFormat
+{
+	RGBA8,
+	R32Float
+};
+
+enum class SamplerFilter
+{
+	Point,
+	Linear,
+	Anisotropic
+};
+
+enum class SamplerAddress
+{
+	Wrap,
+	Clamp
+};
+
+struct BufferDesc
+{
+	BufferType type = BufferType::Vertex;
+	BufferUsage usage = BufferUsage::Immutable;
+	size_t size = 0;
+	unsigned int stride = 0;			// Structured buffers only
+	const void* initialData = nullptr;
+};
+
+struct TextureDesc
+{
+	unsigned int width = 0;
+	unsigned int height = 0;
+	TextureFormat format = TextureFormat::RGBA8;
+	const void* initialData = nullptr;	// Optional, tightly packed rows
+};
+
+struct SamplerDesc
+{
+	SamplerFilter filter = SamplerFilter::Linear;
+	SamplerAddress address = SamplerAddress::Wrap;
+	unsigned int maxAnisotropy = 1;
+};
+
+// --------------------------------------------------------
+// The narrow slice of the graphics API the scene renderer
+// needs: resource creation, binds and draws.
+//
+// Render target / viewport / pipeline state setup is still
+// done directly against D3D11 by Game - those only happen a
+// handful of times per frame and aren't what we want to
+// measure or test.
+//
+// Implementations:
+//  - D3D11Backend:    forwards to Graphics::Device/Context
+//  - RecordingBackend: no GPU, validates binds and counts calls
+// --------------------------------------------------------
+class IRenderBackend
+{
+public:
+	virtual ~IRenderBackend() {}
+
+	// Resource creation - an invalid handle is returned on failure
+	virtual BufferHandle CreateBuffer(const BufferDesc& desc) = 0;
+	virtual TextureHandle CreateTexture(const TextureDesc& desc) = 0;
+	virtual SamplerHandle CreateSampler(const SamplerDesc& desc) = 0;
+	virtual ShaderHandle CreateShader(ShaderStage stage, const void* bytecode, size_t bytecodeSize) = 0;
+
+	virtual void DestroyBuffer(BufferHandle buffer) = 0;
+	virtual void DestroyTexture(TextureHandle texture) = 0;
+	virtual void DestroySampler(SamplerHandle sampler) = 0;
+	virtual void DestroyShader(ShaderHandle shader) = 0;
+
+	// Dynamic buffer access
+	virtual void* Map(BufferHandle buffer, MapMode mode) = 0;
+	virtual void Unmap(BufferHandle buffer) = 0;
+
+	// Binds - an invalid handle unbinds the slot
+	virtual void SetShader(ShaderStage stage, ShaderHandle shader) = 0;
+	virtual void SetVertexBuffer(BufferHandle buffer, unsigned int stride, unsigned int offset = 0) = 0;
+	virtual void SetIndexBuffer(BufferHandle buffer) = 0;
+	virtual void SetConstantBuffer(ShaderStage stage, unsigned int slot, BufferHandle buffer,
+		unsigned int firstConstant, unsigned int numConstants) = 0;
+	virtual void SetTexture(ShaderStage stage, unsigned int slot, TextureHandle texture) = 0;
+	virtual void SetShaderBuffer(ShaderStage stage, unsigned int slot, BufferHandle buffer) = 0;	// Structured, shares texture slots
+	virtual void SetSampler(ShaderStage stage, unsigned int slot, SamplerHandle sampler) = 0;
+
+	// Draws
+	virtual void Draw(unsigned int vertexCount, unsigned int startVertex) = 0;
+	virtual void DrawIndexed(unsigned int indexCount, unsigned int startIndex, int baseVertex) = 0;
+
+	// Fence that retires once the GPU has consumed everything submitted before Signal()
+	virtual std::shared_ptr<IFrameFence> CreateFence() = 0;
+};
+
+// --------------------------------------------------------
+// Handle id layout: a slot index in the low bits and the slot's
+// generation in the high ones.  A slot's generation moves on
+// every time it is freed, so an id kept past its object's
+// destruction never matches whatever reuses the slot.
+// Generations start at 1, so no valid id is 0.
+// --------------------------------------------------------
+struct HandleId
+{
+	static const unsigned int IndexBits = 20;
+	static const uint32_t IndexMask = (1u << IndexBits) - 1;
+	static const uint32_t MaxGeneration = (1u << (32 - IndexBits)) - 1;
+
+	static uint32_t Make(uint32_t index, uint32_t generation) { return index | (generation << IndexBits); }
+	static uint32_t Index(uint32_t id) { return id & IndexMask; }
+	static uint32_t Generation(uint32_t id) { return id >> IndexBits; }
+};
+
+// --------------------------------------------------------
+// Slot storage shared by the backends: handle ids as laid out
+// by HandleId, destroyed slots are reused under the next
+// generation.  A slot that runs out of generations is retired
+// rather than reused.
+// --------------------------------------------------------
+template<typename T>
+class HandleTable
+{
+public:
+	// The new item's id, or 0 - no handle - once every index that
+	// fits in HandleId::IndexBits is taken
+	uint32_t Add(const T& item)
+	{
+		uint32_t index;
+		if (!freeIndices.empty())
+		{
+			index = freeIndices.back();
+			freeIndices.pop_back();
+			items[index] = item;
+		}
+		else
+		{
+			index = (uint32_t)items.size();
+			if (index > HandleId::IndexMask)
+				return 0;
+			items.push_back(item);
+			generations.push_back(1);
+		}
+		alive++;
+		return HandleId::Make(index, generations[index]);
+	}
+
+	void Remove(uint32_t id)
+	{
+		if (!Contains(id))
+			return;
+
+		uint32_t index = HandleId::Index(id);
+		items[index] = T();
+		alive--;
+		if (++generations[index] <= HandleId::MaxGeneration)
+			freeIndices.push_back(index);
+	}
+
+	bool Contains(uint32_t id) const
+	{
+		uint32_t index = HandleId::Index(id);
+		return index < items.size() && generations[index] == HandleId::Generation(id);
+	}
+	T* Find(uint32_t id) { return Contains(id) ? std::addressof(items[HandleId::Index(id)]) : nullptr; }
+	const T* Find(uint32_t id) const { return Contains(id) ? std::addressof(items[HandleId::Index(id)]) : nullptr; }
+	size_t Count() const { return alive; }
+
+private:
+	std::vector<T> items;
+	std::vector<uint32_t> generations;		// Current, per slot
+	std::vector<uint32_t> freeIndices;
+	size_t alive = 0;
+};
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <cstdint>
+#include <vector>
+#include "Bounds.h"
+#include "EntityComponents.h"
+#include "Lights.h"
+
+// --------------------------------------------------------
+// Everything the renderer reads about one simulated frame,
+// copied out at the end of the simulation's update: the camera,
+// the lights and a copy of the entities.  Handed from the
+// simulation to the renderer through a FramePipeline, so the
+// next frame can be simulated while this one is drawn - the
+// game draws on a render thread of its own, from a GameSnapshot
+// that adds the UI's settings and draw lists (see Game.h).
+//
+// The renderer owns it until it's released, and may write the
+// per-frame results it works out into it (the lights' shadow
+// indices, the entities' interpolated transforms) - they're gone
+// with the snapshot.
+// --------------------------------------------------------
+struct RenderSnapshot
+{
+	uint64_t frame = 0;
+	float deltaTime = 0.0f;
+	float totalTime = 0.0f;
+
+	// How far between the last two simulation ticks to draw the
+	// entities with a TransformHistory
+	float tickAlpha = 1.0f;
+
+	DirectX::XMFLOAT4X4 view = {};
+	DirectX::XMFLOAT4X4 projection = {};
+	DirectX::XMFLOAT3 cameraPosition = DirectX::XMFLOAT3(0, 0, 0);
+	DirectX::XMFLOAT3 ambientColor = DirectX::XMFLOAT3(0, 0, 0);
+	std::vector<Light> lights;
+
+	// Every entity id's world bounds (empty for dead ids), for
+	// fitting the shadow cascades
+	std::vector<AABB> entityBounds;
+
+	// A copy of the simulation's store - world matrices and bounds
+	// are up to date as of the last tick, so only interpolated
+	// entities need theirs recomputed
+	EntityStore entities;
+	RenderQuery renderEntities{ entities };
+	InterpolatedQuery interpolatedEntities{ entities };
+	BoundsQuery boundedEntities{ entities };
+};
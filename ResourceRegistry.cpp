@@ -0,0 +1,67 @@
+#include "ResourceRegistry.h"
+#include "Mesh.h"
+#include "Material.h"
+#include "AnimationClip.h"
+
+ResourceRegistry::ResourceRegistry(IRenderBackend& backend, std::shared_ptr<IFrameFence> fence)
+	: backend(backend), fence(fence)
+{
+}
+
+ResourceRegistry::~ResourceRegistry()
+{
+	CollectAll();
+	clips.Clear();
+	materials.Clear();
+	meshes.Clear();
+}
+
+void ResourceRegistry::Release(TextureHandle texture)
+{
+	if (texture.IsValid())
+		textures.push_back({ texture, UINT64_MAX });
+}
+
+void ResourceRegistry::BeginFrame()
+{
+	Collect(fence->GetCompletedValue());
+}
+
+void ResourceRegistry::EndFrame()
+{
+	uint64_t value = fence->Signal();
+	meshes.Seal(value);
+	materials.Seal(value);
+	clips.Seal(value);
+	for (size_t i = textures.size(); i > 0 && textures[i - 1].fenceValue == UINT64_MAX; i--)
+		textures[i - 1].fenceValue = value;
+}
+
+void ResourceRegistry::CollectAll()
+{
+	meshes.Seal(0);
+	materials.Seal(0);
+	clips.Seal(0);
+	for (RetiredTexture& retired : textures)
+		retired.fenceValue = 0;
+	Collect(UINT64_MAX);
+}
+
+void ResourceRegistry::Collect(uint64_t completedValue)
+{
+	// Materials only refer to textures and shaders, never meshes,
+	// so the order doesn't matter
+	materials.Collect(completedValue);
+	meshes.Collect(completedValue);
+	clips.Collect(completedValue);
+
+	size_t kept = 0;
+	for (const RetiredTexture& retired : textures)
+	{
+		if (retired.fenceValue <= completedValue)
+			backend.DestroyTexture(retired.texture);
+		else
+			textures[kept++] = retired;
+	}
+	textures.resize(kept);
+}
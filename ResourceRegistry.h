@@ -0,0 +1,260 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+#include "RenderBackend.h"
+
+class Mesh;
+class Material;
+class AnimationClip;
+
+// The tags are the resource types themselves
+using MeshHandle = RenderHandle<Mesh>;
+using MaterialHandle = RenderHandle<Material>;
+using AnimationClipHandle = RenderHandle<AnimationClip>;
+
+// --------------------------------------------------------
+// Objects of one type behind generational handles (HandleId).
+//
+// Objects live in place in pages of PageSize slots, so a lookup
+// is two array reads and a generation compare - no reference
+// counts - and an object never moves while it's alive.  Freed
+// slots are reused first, so the live objects stay packed into
+// the lowest pages.
+//
+// Release() invalidates the handle at once but only queues the
+// object.  Seal() stamps everything queued with a fence value,
+// and Collect() destroys what the fence has passed, so pointers
+// resolved before the release stay good until then.
+//
+// Get() may be called from any number of threads, as long as
+// nothing creates, releases or collects at the same time.
+// --------------------------------------------------------
+template<typename T>
+class ResourcePool
+{
+public:
+	static const uint32_t PageSize = 64;
+
+	ResourcePool() = default;
+	ResourcePool(const ResourcePool&) = delete;
+	ResourcePool& operator=(const ResourcePool&) = delete;
+	~ResourcePool() { Clear(); }
+
+	template<typename... Args> RenderHandle<T> Create(Args&&... args)
+	{
+		uint32_t index;
+		if (!freeIndices.empty())
+		{
+			index = freeIndices.back();
+			freeIndices.pop_back();
+		}
+		else
+		{
+			index = (uint32_t)slots.size();
+			if (index > HandleId::IndexMask)
+				return RenderHandle<T>();
+			if (index % PageSize == 0)
+				pages.push_back(std::make_unique<Page>());
+			slots.push_back(Slot());
+		}
+
+		new (Address(index)) T(std::forward<Args>(args)...);
+		slots[index].state = SlotState::Alive;
+		alive++;
+
+		RenderHandle<T> handle;
+		handle.id = HandleId::Make(index, slots[index].generation);
+		return handle;
+	}
+
+	// Null for a stale or empty handle
+	T* Get(RenderHandle<T> handle) const
+	{
+		uint32_t index = HandleId::Index(handle.id);
+		if (index >= slots.size() || slots[index].generation != HandleId::Generation(handle.id) ||
+			slots[index].state != SlotState::Alive)
+		{
+			if (handle.IsValid())
+				staleLookups.fetch_add(1, std::memory_order_relaxed);
+			return nullptr;
+		}
+		return Address(index);
+	}
+
+	bool Contains(RenderHandle<T> handle) const
+	{
+		uint32_t index = HandleId::Index(handle.id);
+		return index < slots.size() && slots[index].generation == HandleId::Generation(handle.id) &&
+			slots[index].state == SlotState::Alive;
+	}
+
+	// Ignores stale handles, so releasing twice is harmless
+	void Release(RenderHandle<T> handle)
+	{
+		if (!Contains(handle))
+			return;
+
+		uint32_t index = HandleId::Index(handle.id);
+		slots[index].generation++;
+		slots[index].state = SlotState::Released;
+		alive--;
+		released.push_back({ index, UINT64_MAX });
+	}
+
+	// Everything released since the last Seal() goes once value completes
+	void Seal(uint64_t value)
+	{
+		for (size_t i = released.size(); i > 0 && released[i - 1].fenceValue == UINT64_MAX; i--)
+			released[i - 1].fenceValue = value;
+	}
+
+	// Destroys what was sealed at or below completedValue
+	void Collect(uint64_t completedValue)
+	{
+		size_t kept = 0;
+		for (const Retired& retired : released)
+		{
+			if (retired.fenceValue <= completedValue)
+				Destroy(retired.index);
+			else
+				released[kept++] = retired;
+		}
+		released.resize(kept);
+	}
+
+	// Destroys everything, alive or released - nothing may be in use
+	void Clear()
+	{
+		for (uint32_t index = 0; index < slots.size(); index++)
+		{
+			if (slots[index].state == SlotState::Alive)
+				slots[index].generation++;
+			if (slots[index].state != SlotState::Free)
+				Destroy(index);
+		}
+		released.clear();
+		alive = 0;
+	}
+
+	size_t GetCount() const { return alive; }
+	size_t GetPendingCount() const { return released.size(); }
+	size_t GetSlotCount() const { return slots.size(); }
+	uint32_t GetStaleLookups() const { return staleLookups.load(std::memory_order_relaxed); }
+
+private:
+	enum class SlotState : uint8_t
+	{
+		Free,
+		Alive,
+		Released		// Handle invalid, object not yet destroyed
+	};
+
+	struct Slot
+	{
+		uint32_t generation = 1;
+		SlotState state = SlotState::Free;
+	};
+
+	struct Page
+	{
+		alignas(T) unsigned char storage[PageSize][sizeof(T)];
+	};
+
+	struct Retired
+	{
+		uint32_t index;
+		uint64_t fenceValue;		// UINT64_MAX until sealed
+	};
+
+	std::vector<std::unique_ptr<Page>> pages;
+	std::vector<Slot> slots;
+	std::vector<uint32_t> freeIndices;
+	std::vector<Retired> released;
+	size_t alive = 0;
+	mutable std::atomic<uint32_t> staleLookups{ 0 };
+
+	T* Address(uint32_t index) const
+	{
+		return reinterpret_cast<T*>(pages[index / PageSize]->storage[index % PageSize]);
+	}
+
+	void Destroy(uint32_t index)
+	{
+		Address(index)->~T();
+		slots[index].state = SlotState::Free;
+		if (slots[index].generation <= HandleId::MaxGeneration)
+			freeIndices.push_back(index);
+	}
+};
+
+// --------------------------------------------------------
+// Owns the scene's meshes, materials and animation clips, and
+// hands out handles to them - entities, the sky and the renderer
+// keep handles and resolve them with Get() where they need the
+// object.
+//
+// Per frame:
+//  - BeginFrame() destroys whatever was released in frames the
+//    GPU has finished
+//  - EndFrame() signals the fence guarding this frame's releases
+// Textures are the backend's own handles (already generational);
+// Release() on one just holds the DestroyTexture() back the same
+// way.
+// --------------------------------------------------------
+class ResourceRegistry
+{
+public:
+	ResourceRegistry(IRenderBackend& backend, std::shared_ptr<IFrameFence> fence);
+	~ResourceRegistry();
+	ResourceRegistry(const ResourceRegistry&) = delete;
+	ResourceRegistry& operator=(const ResourceRegistry&) = delete;
+
+	template<typename T, typename... Args> RenderHandle<T> Create(Args&&... args)
+	{
+		return Pool<T>().Create(std::forward<Args>(args)...);
+	}
+
+	template<typename T> T* Get(RenderHandle<T> handle) const { return Pool<T>().Get(handle); }
+	template<typename T> bool IsValid(RenderHandle<T> handle) const { return Pool<T>().Contains(handle); }
+	template<typename T> void Release(RenderHandle<T> handle) { Pool<T>().Release(handle); }
+	void Release(TextureHandle texture);
+
+	void BeginFrame();
+	void EndFrame();
+
+	// Destroys everything released, without waiting on the fence -
+	// only once nothing in flight uses any of it
+	void CollectAll();
+
+	template<typename T> const ResourcePool<T>& GetPool() const { return Pool<T>(); }
+	size_t GetPendingCount() const { return meshes.GetPendingCount() + materials.GetPendingCount() + clips.GetPendingCount() + textures.size(); }
+
+private:
+	struct RetiredTexture
+	{
+		TextureHandle texture;
+		uint64_t fenceValue;
+	};
+
+	IRenderBackend& backend;
+	std::shared_ptr<IFrameFence> fence;
+
+	ResourcePool<Mesh> meshes;
+	ResourcePool<Material> materials;
+	ResourcePool<AnimationClip> clips;
+	std::vector<RetiredTexture> textures;
+
+	template<typename T> ResourcePool<T>& Pool();
+	template<typename T> const ResourcePool<T>& Pool() const { return const_cast<ResourceRegistry*>(this)->Pool<T>(); }
+
+	void Collect(uint64_t completedValue);
+};
+
+template<> inline ResourcePool<Mesh>& ResourceRegistry::Pool<Mesh>() { return meshes; }
+template<> inline ResourcePool<Material>& ResourceRegistry::Pool<Material>() { return materials; }
+template<> inline ResourcePool<AnimationClip>& ResourceRegistry::Pool<AnimationClip>() { return clips; }
@@ -0,0 +1,351 @@
+#include "ResourceRegistryTests.h"
+#include "HeadlessTests.h"
+#include "RecordingBackend.h"
+#include "ConstantBufferRing.h"
+#include "SceneRenderer.h"
+#include "Mesh.h"
+#include "Material.h"
+#include "ResourceRegistry.h"
+#include "EntitySystems.h"
+#include "EntityStore.h"
+#include "JobSystem.h"
+#include "FrameArena.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+	// A fence the checks complete by hand, to stand in for a GPU
+	// that's frames behind
+	class ManualFence : public IFrameFence
+	{
+	public:
+		uint64_t Signal() override { return next++; }
+		uint64_t GetCompletedValue() override { return completed; }
+		void WaitFor(uint64_t value) override { completed = (std::max)(completed, value); }
+
+		void CompleteAll() { completed = next - 1; }
+
+	private:
+		uint64_t next = 1;
+		uint64_t completed = 0;
+	};
+
+	// A draw as the renderer used to hold one - owning references,
+	// copied into each packet - and as it does now
+	struct SharedDraw
+	{
+		std::shared_ptr<Mesh> mesh;
+		std::shared_ptr<Material> material;
+	};
+
+	struct HandleDraw
+	{
+		MeshHandle mesh;
+		MaterialHandle material;
+	};
+
+	struct PointerDraw
+	{
+		Mesh* mesh;
+		Material* material;
+	};
+
+	// Runs resolve(i) -> checksum over every draw, a chunk per job
+	template<typename Resolve>
+	uint64_t ResolveDraws(JobSystem& jobSystem, size_t drawCount, Resolve resolve)
+	{
+		const size_t chunkSize = 4096;
+		std::vector<uint64_t> chunkSums(JobSystem::GetChunkCount(drawCount, chunkSize));
+		jobSystem.ParallelFor(chunkSums.size(), 1, [&](size_t begin, size_t end)
+		{
+			for (size_t c = begin; c < end; c++)
+			{
+				uint64_t sum = 0;
+				size_t last = (std::min)((c + 1) * chunkSize, drawCount);
+				for (size_t i = c * chunkSize; i < last; i++)
+					sum += resolve(i);
+				chunkSums[c] = sum;
+			}
+		});
+
+		uint64_t total = 0;
+		for (uint64_t sum : chunkSums)
+			total += sum;
+		return total;
+	}
+
+	int RunResourceRegistryChecks()
+	{
+		printf("\nResource registry checks\n");
+		int failures = 0;
+		char detail[256];
+
+		RecordingBackend backend;
+		{
+			auto fence = std::make_shared<ManualFence>();
+			ResourceRegistry resources(backend, fence);
+
+			// Release invalidates at once, destroys once the GPU is done
+			MeshHandle first = CreateBenchCube(resources, backend);
+			Mesh* resolved = resources.Get(first);
+			resources.Release(first);
+			uint32_t staleBefore = resources.GetPool<Mesh>().GetStaleLookups();
+			bool invalidated = resources.Get(first) == nullptr && !resources.IsValid(first);
+			bool counted = resources.GetPool<Mesh>().GetStaleLookups() == staleBefore + 1;
+			failures += ReportCheck("a released handle resolves to nothing at once", invalidated && counted, "");
+
+			resources.EndFrame();
+			resources.BeginFrame();
+			size_t pendingBefore = resources.GetPendingCount();
+			bool readable = resolved->GetIndexCount() == 36;
+			fence->CompleteAll();
+			resources.BeginFrame();
+			snprintf(detail, sizeof(detail), "%zu pending before the fence, %zu after", pendingBefore, resources.GetPendingCount());
+			failures += ReportCheck("the object lives until the fence passes its frame",
+				pendingBefore == 1 && readable && resources.GetPendingCount() == 0, detail);
+
+			// The slot comes back under a new generation
+			MeshHandle second = CreateBenchCube(resources, backend);
+			bool reused = HandleId::Index(second.id) == HandleId::Index(first.id) && second != first;
+			snprintf(detail, sizeof(detail), "old %08x, new %08x", first.id, second.id);
+			failures += ReportCheck("a reused slot never answers to the old handle",
+				reused && resources.Get(first) == nullptr && resources.Get(second) != nullptr, detail);
+
+			resources.Release(first);
+			resources.Release(second);
+			resources.Release(second);
+			failures += ReportCheck("releasing twice, or a stale handle, queues nothing more",
+				resources.GetPendingCount() == 1 && resources.GetPool<Mesh>().GetCount() == 0, "");
+			resources.EndFrame();
+			fence->CompleteAll();
+			resources.BeginFrame();
+		}
+
+		// Textures keep the backend's handles, with the destroy held
+		// back - on a backend of their own, as the stale handle trips
+		// its validation on purpose
+		{
+			RecordingBackend textureBackend;
+			auto fence = std::make_shared<ManualFence>();
+			ResourceRegistry resources(textureBackend, fence);
+
+			TextureDesc texDesc;
+			texDesc.width = 1;
+			texDesc.height = 1;
+			TextureHandle oldTexture = textureBackend.CreateTexture(texDesc);
+			resources.Release(oldTexture);
+			resources.EndFrame();
+			size_t errorsBefore = textureBackend.GetErrorCount();
+			textureBackend.SetTexture(ShaderStage::Pixel, 0, oldTexture);
+			bool usableInFlight = textureBackend.GetErrorCount() == errorsBefore;
+			fence->CompleteAll();
+			resources.BeginFrame();
+			TextureHandle newTexture = textureBackend.CreateTexture(texDesc);
+			textureBackend.SetTexture(ShaderStage::Pixel, 0, oldTexture);
+			bool caught = textureBackend.GetErrorCount() == errorsBefore + 1;
+			textureBackend.SetTexture(ShaderStage::Pixel, 0, newTexture);
+			snprintf(detail, sizeof(detail), "old %08x, new %08x", oldTexture.id, newTexture.id);
+			failures += ReportCheck("a destroyed texture's handle is caught after its slot is reused",
+				usableInFlight && caught && HandleId::Index(newTexture.id) == HandleId::Index(oldTexture.id) &&
+				newTexture != oldTexture && textureBackend.GetErrorCount() == errorsBefore + 1, detail);
+			textureBackend.SetTexture(ShaderStage::Pixel, 0, TextureHandle());
+			textureBackend.DestroyTexture(newTexture);
+		}
+
+		// The renderer skips entities whose material was released
+		{
+			ConstantBufferRing constantRing(backend, backend.CreateFence());
+			JobSystem jobSystem(0);
+			FrameArena frameArena;
+			SceneRenderer sceneRenderer(constantRing, jobSystem, frameArena);
+			ResourceRegistry resources(backend, backend.CreateFence());
+
+			MeshHandle cube = CreateBenchCube(resources, backend);
+			ShaderHandle vs = backend.CreateShader(ShaderStage::Vertex, fakeBytecode, sizeof(fakeBytecode));
+			ShaderHandle ps = backend.CreateShader(ShaderStage::Pixel, fakeBytecode, sizeof(fakeBytecode));
+			MaterialHandle kept = resources.Create<Material>(XMFLOAT4(1, 1, 1, 1), vs, ps);
+			MaterialHandle released = resources.Create<Material>(XMFLOAT4(1, 0, 0, 1), vs, ps);
+
+			EntityStore store;
+			for (int i = 0; i < 8; i++)
+				CreateRenderEntity(store, cube, i == 3 ? released : kept, XMFLOAT3((float)i * 2.0f - 8.0f, 0.0f, 0.0f));
+			RenderQuery entities(store);
+			BoundsQuery boundedEntities(store);
+			resources.Release(released);
+
+			SceneFrameData frame = {};
+			XMStoreFloat4x4(&frame.view, XMMatrixLookToLH(XMVectorSet(0, 0, -20, 1), XMVectorSet(0, 0, 1, 0), XMVectorSet(0, 1, 0, 0)));
+			XMStoreFloat4x4(&frame.projection, XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.1f, 100.0f));
+			frame.cameraPosition = XMFLOAT3(0, 0, -20);
+
+			frameArena.BeginFrame();
+			resources.BeginFrame();
+			UpdateWorldBounds(boundedEntities, resources, jobSystem);
+			constantRing.BeginFrame();
+			sceneRenderer.PackConstants(entities, resources, frame);
+			constantRing.Unmap();
+			constantRing.EndFrame();
+			resources.EndFrame();
+
+			const SceneRenderStats& stats = sceneRenderer.GetStats();
+			snprintf(detail, sizeof(detail), "%zu visible, %zu skipped", stats.visible, stats.staleHandles);
+			failures += ReportCheck("an entity with a released material isn't drawn", stats.staleHandles == 1 && stats.visible == 7, detail);
+
+			backend.DestroyShader(vs);
+			backend.DestroyShader(ps);
+		}
+
+		// A slot that has used every generation is retired
+		{
+			ResourcePool<int> pool;
+			RenderHandle<int> last;
+			for (uint32_t generation = 1; generation <= HandleId::MaxGeneration; generation++)
+			{
+				last = pool.Create((int)generation);
+				pool.Release(last);
+				pool.Seal(0);
+				pool.Collect(0);
+			}
+			RenderHandle<int> next = pool.Create(0);
+			snprintf(detail, sizeof(detail), "%zu slots after %u generations", pool.GetSlotCount(), HandleId::MaxGeneration);
+			failures += ReportCheck("a slot out of generations isn't reused",
+				HandleId::Index(last.id) == 0 && HandleId::Index(next.id) == 1 && pool.Get(last) == nullptr, detail);
+		}
+
+		// A backend's table stops at the indices a handle can hold,
+		// rather than alias the first slots
+		{
+			RecordingBackend full;
+			SamplerDesc samplerDesc;
+			SamplerHandle last;
+			for (uint32_t i = 0; i <= HandleId::IndexMask; i++)
+				last = full.CreateSampler(samplerDesc);
+			SamplerHandle past = full.CreateSampler(samplerDesc);
+			snprintf(detail, sizeof(detail), "last index %u, %zu errors past it", HandleId::Index(last.id), full.GetErrorCount());
+			failures += ReportCheck("a full handle table fails the create",
+				HandleId::Index(last.id) == HandleId::IndexMask && !past.IsValid() && full.GetErrorCount() == 1, detail);
+		}
+
+		failures += ReportValidation(backend);
+		return failures;
+	}
+}
+
+int RunResourceRegistryBench(const ResourceRegistryBenchSettings& settings)
+{
+	int threads = settings.threadCount > 0 ? settings.threadCount : (int)std::thread::hardware_concurrency();
+	threads = (std::max)(threads, 1);
+	JobSystem serial(0);
+	JobSystem parallel(threads - 1);
+	printf("Resource registry bench: %d draws, %d frames, %u threads\n",
+		settings.drawCount, settings.frames, parallel.GetThreadCount());
+	int failures = 0;
+	char detail[256];
+
+	RecordingBackend backend;
+	{
+		ResourceRegistry resources(backend, backend.CreateFence());
+		ShaderHandle vs = backend.CreateShader(ShaderStage::Vertex, fakeBytecode, sizeof(fakeBytecode));
+		ShaderHandle ps = backend.CreateShader(ShaderStage::Pixel, fakeBytecode, sizeof(fakeBytecode));
+
+		// A few meshes and materials shared by many draws, like the scene's
+		std::vector<MeshHandle> meshes;
+		std::vector<MaterialHandle> materials;
+		std::vector<std::shared_ptr<Mesh>> sharedMeshes;
+		std::vector<std::shared_ptr<Material>> sharedMaterials;
+		for (int i = 0; i < 16; i++)
+		{
+			meshes.push_back(CreateBenchCube(resources, backend));
+			sharedMeshes.push_back(std::shared_ptr<Mesh>(resources.Get(meshes.back()), [](Mesh*) {}));
+		}
+		for (int i = 0; i < 64; i++)
+		{
+			materials.push_back(resources.Create<Material>(XMFLOAT4(1, 1, 1, 1), vs, ps));
+			sharedMaterials.push_back(std::shared_ptr<Material>(resources.Get(materials.back()), [](Material*) {}));
+		}
+
+		size_t drawCount = (size_t)(std::max)(settings.drawCount, 1);
+		std::vector<SharedDraw> sharedDraws(drawCount);
+		std::vector<HandleDraw> handleDraws(drawCount);
+		std::vector<PointerDraw> pointerDraws(drawCount);
+		for (size_t i = 0; i < drawCount; i++)
+		{
+			size_t mesh = i % meshes.size();
+			size_t material = (i * 7) % materials.size();
+			sharedDraws[i] = { sharedMeshes[mesh], sharedMaterials[material] };
+			handleDraws[i] = { meshes[mesh], materials[material] };
+			pointerDraws[i] = { sharedMeshes[mesh].get(), sharedMaterials[material].get() };
+		}
+		printf("  %zu bytes per draw as shared_ptrs, %zu as handles, %zu as pointers\n\n",
+			sizeof(SharedDraw), sizeof(HandleDraw), sizeof(PointerDraw));
+
+		// Each resolves a draw's mesh and material and reads both, as
+		// packing a draw packet does
+		auto sharedResolve = [&](size_t i)
+		{
+			std::shared_ptr<Mesh> mesh = sharedDraws[i].mesh;
+			std::shared_ptr<Material> material = sharedDraws[i].material;
+			return (uint64_t)mesh->GetIndexCount() + ((uint64_t)(uintptr_t)material.get() >> 4);
+		};
+		auto handleResolve = [&](size_t i)
+		{
+			const Mesh* mesh = resources.Get(handleDraws[i].mesh);
+			const Material* material = resources.Get(handleDraws[i].material);
+			return (uint64_t)mesh->GetIndexCount() + ((uint64_t)(uintptr_t)material >> 4);
+		};
+		auto pointerResolve = [&](size_t i)
+		{
+			return (uint64_t)pointerDraws[i].mesh->GetIndexCount() + ((uint64_t)(uintptr_t)pointerDraws[i].material >> 4);
+		};
+
+		size_t checksumMismatches = 0;
+		for (int j = 0; j < 2; j++)
+		{
+			JobSystem& jobSystem = j == 0 ? serial : parallel;
+			double ms[3] = { 0.0, 0.0, 0.0 };
+			for (int f = 0; f < settings.frames; f++)
+			{
+				auto start = std::chrono::high_resolution_clock::now();
+				uint64_t sharedSum = ResolveDraws(jobSystem, drawCount, sharedResolve);
+				auto sharedDone = std::chrono::high_resolution_clock::now();
+				uint64_t handleSum = ResolveDraws(jobSystem, drawCount, handleResolve);
+				auto handleDone = std::chrono::high_resolution_clock::now();
+				uint64_t pointerSum = ResolveDraws(jobSystem, drawCount, pointerResolve);
+				auto pointerDone = std::chrono::high_resolution_clock::now();
+
+				ms[0] += Milliseconds(sharedDone - start);
+				ms[1] += Milliseconds(handleDone - sharedDone);
+				ms[2] += Milliseconds(pointerDone - handleDone);
+				if (sharedSum != handleSum || handleSum != pointerSum)
+					checksumMismatches++;
+			}
+
+			double draws = (double)drawCount * (std::max)(settings.frames, 1);
+			printf("  %u thread%s: %6.2f ns/draw shared_ptr, %6.2f handle, %6.2f pointer\n",
+				jobSystem.GetThreadCount(), jobSystem.GetThreadCount() == 1 ? "" : "s",
+				ms[0] * 1000000.0 / draws, ms[1] * 1000000.0 / draws, ms[2] * 1000000.0 / draws);
+		}
+		printf("\n");
+
+		snprintf(detail, sizeof(detail), "%zu of %d frames differ", checksumMismatches, settings.frames * 2);
+		failures += ReportCheck("every way of holding a draw reads the same objects", checksumMismatches == 0, detail);
+
+		sharedDraws.clear();
+		sharedMeshes.clear();
+		sharedMaterials.clear();
+		backend.DestroyShader(vs);
+		backend.DestroyShader(ps);
+	}
+	failures += ReportValidation(backend);
+
+	failures += RunResourceRegistryChecks();
+	return ReportFailures(failures);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+// --------------------------------------------------------
+// Headless CPU benchmark and checks of the resource registry -
+// no GPU.
+//
+// Times resolving each draw's mesh and material, over drawCount
+// draws sharing a few of each, on one thread and then on
+// threadCount, three ways:
+//  - shared_ptrs copied out of the draw, as draws used to hold
+//    them - a reference count up and down per object
+//  - registry handles resolved with Get()
+//  - raw pointers, the floor
+// and checks all three read the same objects.
+//
+// Then use after free, against a fence completed by hand:
+//  - a released handle resolves to nothing at once, and counts
+//    as a stale lookup, while the object itself lives until the
+//    fence passes the frame it was released in
+//  - a reused slot doesn't answer to the old handle, and
+//    releasing twice queues nothing more
+//  - a texture released through the registry stays bound-able
+//    until collected, and its old handle is flagged by the
+//    backend after a new texture reuses the slot
+//  - the renderer skips an entity whose material was released
+//  - a slot out of generations is retired, not reused
+//  - a backend out of handle indices fails the create instead of
+//    handing out an id that aliases slot 0
+//
+// Returns 0 if all checks passed.
+// --------------------------------------------------------
+struct ResourceRegistryBenchSettings
+{
+	int drawCount = 1000000;
+	int frames = 20;			// Per thread count
+	int threadCount = -1;		// Including the caller, negative = every hardware thread
+};
+
+int RunResourceRegistryBench(const ResourceRegistryBenchSettings& settings);
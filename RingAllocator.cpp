@@ -0,0 +1,106 @@
+#include "RingAllocator.h"
+#include <algorithm>
+
+RingAllocator::RingAllocator(size_t capacity, size_t alignment)
+	: capacity(capacity), alignment(alignment)
+{
+}
+
+void RingAllocator::Reset(size_t newCapacity)
+{
+	capacity = newCapacity;
+	head = 0;
+	tail = 0;
+	used = 0;
+	frameBytes = 0;
+	inFlightFirst = 0;
+	inFlightCount = 0;
+}
+
+// --------------------------------------------------------
+// Returns the offset of an aligned block of at least "size"
+// bytes, or InvalidOffset if it would overlap data the GPU may
+// still be reading.  Space skipped at the end of the buffer when
+// wrapping is charged to the current frame so it is released
+// together with it.
+// --------------------------------------------------------
+size_t RingAllocator::Allocate(size_t size)
+{
+	size_t alignedSize = AlignUp(size);
+	if (alignedSize == 0 || alignedSize > capacity - used)
+		return InvalidOffset;
+
+	// Free space is [head, capacity) + [0, tail) when head is ahead of
+	// tail (or the ring is empty), otherwise the single gap [head, tail)
+	if (head >= tail)
+	{
+		if (capacity - head >= alignedSize)
+		{
+			size_t offset = head;
+			head += alignedSize;
+			used += alignedSize;
+			frameBytes += alignedSize;
+			return offset;
+		}
+
+		// Not enough room at the end - wrap if the start is free
+		if (tail >= alignedSize)
+		{
+			size_t padding = capacity - head;
+			head = alignedSize;
+			used += padding + alignedSize;
+			frameBytes += padding + alignedSize;
+			return 0;
+		}
+
+		return InvalidOffset;
+	}
+
+	if (tail - head >= alignedSize)
+	{
+		size_t offset = head;
+		head += alignedSize;
+		used += alignedSize;
+		frameBytes += alignedSize;
+		return offset;
+	}
+
+	return InvalidOffset;
+}
+
+void RingAllocator::FinishFrame(uint64_t fenceValue)
+{
+	// Frames that allocated nothing still get recorded so fence
+	// values stay in order, they just release zero bytes
+	if (inFlightCount == inFlight.size())
+	{
+		// Unwrapped into a bigger ring, oldest first
+		std::vector<FrameRegion> grown((std::max)(inFlight.size() * 2, (size_t)4));
+		for (size_t i = 0; i < inFlightCount; i++)
+			grown[i] = inFlight[(inFlightFirst + i) % inFlight.size()];
+		inFlight.swap(grown);
+		inFlightFirst = 0;
+	}
+	inFlight[(inFlightFirst + inFlightCount) % inFlight.size()] = { head, frameBytes, fenceValue };
+	inFlightCount++;
+	frameBytes = 0;
+}
+
+void RingAllocator::Retire(uint64_t completedValue)
+{
+	while (inFlightCount > 0 && inFlight[inFlightFirst].fence <= completedValue)
+	{
+		tail = inFlight[inFlightFirst].end;
+		used -= inFlight[inFlightFirst].bytes;
+		inFlightFirst = (inFlightFirst + 1) % inFlight.size();
+		inFlightCount--;
+	}
+
+	// Once everything has retired, restart at the beginning so the
+	// next frame gets the longest contiguous run
+	if (used == 0 && frameBytes == 0)
+	{
+		head = 0;
+		tail = 0;
+	}
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// --------------------------------------------------------
+// Offset bookkeeping for a GPU ring buffer.
+//
+// Hands out aligned [offset, offset + size) ranges from a buffer
+// of fixed capacity.  Everything allocated between two calls to
+// FinishFrame() belongs to one frame, which is tagged with a fence
+// value; that range only becomes reusable once Retire() is told
+// the GPU has reached the fence.  Allocate() fails (returns
+// InvalidOffset) instead of ever wrapping onto in-flight data.
+//
+// No graphics API types here - see ConstantBufferRing for the
+// D3D11 side.
+// --------------------------------------------------------
+class RingAllocator
+{
+public:
+	static constexpr size_t InvalidOffset = ~(size_t)0;
+
+	explicit RingAllocator(size_t capacity, size_t alignment = 256);
+
+	// Forgets all in-flight frames and starts over with a new capacity
+	void Reset(size_t capacity);
+
+	size_t Allocate(size_t size);
+
+	// Closes the current frame and tags it with the fence value that
+	// will be signaled once the GPU is done with it
+	void FinishFrame(uint64_t fenceValue);
+
+	// Releases every finished frame whose fence value <= completedValue
+	void Retire(uint64_t completedValue);
+
+	// Getters
+	size_t GetCapacity() const { return capacity; }
+	size_t GetAlignment() const { return alignment; }
+	size_t GetUsedBytes() const { return used; }
+	size_t GetCurrentFrameBytes() const { return frameBytes; }
+	size_t GetFramesInFlight() const { return inFlightCount; }
+	bool IsIdle() const { return used == 0; }
+
+	size_t AlignUp(size_t size) const { return (size + alignment - 1) & ~(alignment - 1); }
+
+private:
+	struct FrameRegion
+	{
+		size_t end;			// head position when the frame finished
+		size_t bytes;		// bytes it consumed, including wrap padding
+		uint64_t fence;
+	};
+
+	size_t capacity;
+	size_t alignment;
+
+	size_t head = 0;		// next free byte
+	size_t tail = 0;		// oldest byte still in use
+	size_t used = 0;		// bytes between tail and head (0 == empty, capacity == full)
+	size_t frameBytes = 0;	// bytes allocated by the frame being built
+
+	// Oldest first, as a ring that only grows when more frames are
+	// in flight than ever before - a deque allocates a block every
+	// so many frames as it moves along
+	std::vector<FrameRegion> inFlight;
+	size_t inFlightFirst = 0;
+	size_t inFlightCount = 0;
+};
@@ -0,0 +1,518 @@
+#include "SceneRenderer.h"
+#include "BufferStructs.h"
+#include "Bounds.h"
+#include "Mesh.h"
+#include "Material.h"
+#include "Vertex.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace DirectX;
+
+namespace
+{
+	static_assert(sizeof(PixelShaderExternalData::objectLights) / sizeof(uint32_t) == ObjectLightSelector::MaxLightsPerObject,
+		"PixelShaderExternalData has room for a different number of lights than the selector picks");
+
+	// --------------------------------------------------------
+	// Sort key layout (most significant first):
+	//   pixel shader 10 | vertex shader 10 | material 14 | mesh 14 | depth 16
+	// so draws group by the most expensive state change first and
+	// go front to back within a group.  Ids wider than their field
+	// just wrap - that costs some extra binds, never correctness.
+	// --------------------------------------------------------
+	uint64_t QuantizeDepth(float depth)
+	{
+		// The bits of a non-negative float sort the same as its
+		// value, and the top 16 keep more precision up close
+		if (!(depth > 0.0f))
+			return 0;
+
+		uint32_t bits;
+		memcpy(&bits, &depth, sizeof(bits));
+		return bits >> 16;
+	}
+
+	uint64_t OpaqueSortKey(const Material& material, const Mesh& mesh, float depth)
+	{
+		return
+			((uint64_t)(material.GetPixelShader().id & 0x3FF) << 54) |
+			((uint64_t)(material.GetVertexShader().id & 0x3FF) << 44) |
+			((uint64_t)(material.GetSortId() & 0x3FFF) << 30) |
+			((uint64_t)(mesh.GetSortId() & 0x3FFF) << 16) |
+			QuantizeDepth(depth);
+	}
+
+	// Only the mesh changes between shadow draws
+	uint64_t ShadowSortKey(const Mesh& mesh)
+	{
+		return mesh.GetSortId();
+	}
+}
+
+SceneRenderer::SceneRenderer(ConstantBufferRing& constantRing, JobSystem& jobSystem, FrameArena& frameArena)
+	: constantRing(constantRing), jobSystem(jobSystem), frameArena(frameArena),
+	opaquePackets(frameArena), opaqueOrder(frameArena)
+{
+}
+
+void SceneRenderer::PackConstants(RenderQuery& entities, const ResourceRegistry& resources, const SceneFrameData& frame)
+{
+	const std::vector<EntityChunk*>& entityChunks = entities.GetChunks();
+	size_t chunkCount = entityChunks.size();
+	if (chunks.size() < chunkCount)
+		chunks.resize(chunkCount);
+
+	XMFLOAT4X4 viewProjection;
+	XMStoreFloat4x4(&viewProjection, XMMatrixMultiply(XMLoadFloat4x4(&frame.view), XMLoadFloat4x4(&frame.projection)));
+	Frustum cameraFrustum = Frustum::FromViewProjection(viewProjection);
+
+	const unsigned int cascadeCount = frame.shadowCascades ? (std::min)(frame.shadowCascadeCount, ShadowCascades::CascadeCount) : 0;
+	const unsigned int atlasViewCount = frame.atlasViews ? frame.atlasViewCount : 0;
+	const unsigned int shadowListCount = AtlasShadowList(atlasViewCount);
+
+	// Sized here rather than in the cull job - ParallelFor() may run the
+	// whole range as one job, leaving later chunks untouched
+	for (size_t c = 0; c < chunkCount; c++)
+	{
+		chunks[c].shadowCasters.resize(shadowListCount);
+		chunks[c].firstShadowCaster.resize(shadowListCount);
+		chunks[c].occluded = 0;
+		chunks[c].staleHandles = 0;
+	}
+
+	// 1. Cull ----------------------------------------------------------------
+	// Only the bounds, flag, handle and id columns - the rest of each
+	// entity is left alone until it's packed.  Entities whose mesh or
+	// material was released are left out of every pass.
+	size_t entityCount = 0;
+	auto cull = [&](size_t chunkIndex)
+	{
+		ChunkData& chunk = chunks[chunkIndex];
+		const EntityChunk& entityChunk = *entityChunks[chunkIndex];
+		const EntityId* ids = entityChunk.GetEntities();
+		const WorldBounds* worldBounds = entityChunk.GetColumn<WorldBounds>();
+		const RenderFlags* flags = entityChunk.GetColumn<RenderFlags>();
+		const MeshRef* meshes = entityChunk.GetColumn<MeshRef>();
+		const MaterialRef* materials = entityChunk.GetColumn<MaterialRef>();
+		chunk.visible.clear();
+		chunk.visibleDepth.clear();
+		for (std::vector<uint32_t>& casters : chunk.shadowCasters)
+			casters.clear();
+		chunk.visibleLights.clear();
+		chunk.visibleLightCounts.clear();
+
+		for (uint32_t i = 0; i < entityChunk.GetCount(); i++)
+		{
+			if (!resources.IsValid(meshes[i].mesh) || !resources.IsValid(materials[i].material))
+			{
+				chunk.staleHandles++;
+				continue;
+			}
+
+			const AABB& bounds = worldBounds[i].box;
+
+			// Hidden behind an occluder: left out of the opaque pass, but
+			// it may still cast a shadow
+			bool visible = cameraFrustum.Intersects(bounds);
+			if (visible && frame.occlusion && !frame.occlusion->IsVisible(bounds))
+			{
+				visible = false;
+				chunk.occluded++;
+			}
+
+			if (visible)
+			{
+				// View space z of the center - the view matrix's third column
+				const XMFLOAT3& c = bounds.center;
+				const XMFLOAT4X4& v = frame.view;
+				chunk.visible.push_back(i);
+				chunk.visibleDepth.push_back(c.x * v._13 + c.y * v._23 + c.z * v._33 + v._43);
+
+				if (frame.lightSelector)
+				{
+					const XMFLOAT3& e = bounds.extents;
+					size_t first = chunk.visibleLights.size();
+					chunk.visibleLights.resize(first + ObjectLightSelector::MaxLightsPerObject);
+					chunk.visibleLightCounts.push_back(frame.lightSelector->Select(
+						ids[i], c, sqrtf(e.x * e.x + e.y * e.y + e.z * e.z), &chunk.visibleLights[first]));
+				}
+			}
+
+			bool cached = frame.shadowCache && flags[i].isStatic;
+			for (unsigned int c = 0; c < cascadeCount; c++)
+			{
+				if (!frame.shadowCascades[c].casterFrustum.Intersects(bounds))
+					continue;
+
+				// A cached caster is only drawn where the cache is stale
+				if (!cached)
+					chunk.shadowCasters[ShadowList(c, false)].push_back(i);
+				else if (frame.shadowCache->NeedsStaticRedraw(c, bounds))
+					chunk.shadowCasters[ShadowList(c, true)].push_back(i);
+			}
+
+			for (unsigned int v = 0; v < atlasViewCount; v++)
+			{
+				if (frame.atlasViews[v].casterFrustum.Intersects(bounds))
+					chunk.shadowCasters[AtlasShadowList(v)].push_back(i);
+			}
+		}
+	};
+	jobSystem.ParallelFor(chunkCount, 1, [&](size_t begin, size_t end)
+	{
+		for (size_t c = begin; c < end; c++)
+			cull(c);
+	});
+
+	// Only the lights something picked get uploaded - swap light
+	// indices for upload slots, in chunk order so it's deterministic
+	if (frame.lightSelector)
+	{
+		for (size_t c = 0; c < chunkCount; c++)
+		{
+			ChunkData& chunk = chunks[c];
+			for (size_t j = 0; j < chunk.visibleLightCounts.size(); j++)
+			{
+				uint32_t* lights = &chunk.visibleLights[j * ObjectLightSelector::MaxLightsPerObject];
+				for (uint32_t k = 0; k < chunk.visibleLightCounts[j]; k++)
+					lights[k] = frame.lightSelector->Remap(lights[k]);
+			}
+		}
+	}
+
+	// 2. Hand out packet ranges and ring space --------------------------------
+	const size_t shadowStride = constantRing.AlignUp(sizeof(ShadowVSData));
+	const size_t vsStride = constantRing.AlignUp(sizeof(VertexShaderExternalData));
+	const size_t psStride = constantRing.AlignUp(sizeof(PixelShaderExternalData));
+
+	size_t visibleCount = 0;
+	FrameVector<size_t> shadowCasterCounts(shadowListCount, 0, frameArena);
+	size_t ringBytes = 0;
+	for (size_t c = 0; c < chunkCount; c++)
+	{
+		ChunkData& chunk = chunks[c];
+		entityCount += entityChunks[c]->GetCount();
+		chunk.firstVisible = visibleCount;
+		chunk.ringOffset = ringBytes;
+
+		visibleCount += chunk.visible.size();
+		ringBytes += chunk.visible.size() * (vsStride + psStride);
+
+		for (unsigned int list = 0; list < shadowListCount; list++)
+		{
+			chunk.firstShadowCaster[list] = shadowCasterCounts[list];
+			shadowCasterCounts[list] += chunk.shadowCasters[list].size();
+			ringBytes += chunk.shadowCasters[list].size() * shadowStride;
+		}
+	}
+
+	opaquePackets = FrameVector<DrawPacket>(visibleCount, frameArena);
+	opaqueOrder = FrameVector<SortEntry>(visibleCount, frameArena);
+
+	stats.entities = entityCount;
+	stats.visible = visibleCount;
+	stats.occluded = 0;
+	stats.staleHandles = 0;
+	for (size_t c = 0; c < chunkCount; c++)
+	{
+		stats.occluded += chunks[c].occluded;
+		stats.staleHandles += chunks[c].staleHandles;
+	}
+	stats.shadowCasters = 0;
+	stats.atlasShadowCasters = 0;
+	stats.cachedShadowCasters = 0;
+	stats.threads = jobSystem.GetThreadCount();
+
+	// Moved in rather than resized - last frame's capacity may already
+	// belong to another frame
+	shadowPackets.resize(shadowListCount, FrameVector<DrawPacket>(frameArena));
+	shadowOrder.resize(shadowListCount, FrameVector<SortEntry>(frameArena));
+	for (unsigned int list = 0; list < shadowListCount; list++)
+	{
+		shadowPackets[list] = FrameVector<DrawPacket>(shadowCasterCounts[list], frameArena);
+		shadowOrder[list] = FrameVector<SortEntry>(shadowCasterCounts[list], frameArena);
+		if (list < CascadeShadowLists)
+			stats.shadowCasters += shadowCasterCounts[list];
+		else
+			stats.atlasShadowCasters += shadowCasterCounts[list];
+	}
+	for (unsigned int cascade = 0; cascade < ShadowCascades::CascadeCount; cascade++)
+	{
+		size_t cached = shadowCasterCounts[ShadowList(cascade, true)];
+		stats.cascadeCasters[cascade] = shadowCasterCounts[ShadowList(cascade, false)] + cached;
+		stats.cachedShadowCasters += cached;
+	}
+
+	// Light cluster and shadow constants are shared by every opaque
+	// draw and go at the end of the block
+	size_t lightClusterOffset = ringBytes;
+	if (frame.lightClusters)
+		ringBytes += constantRing.AlignUp(sizeof(LightClusterShaderData));
+	size_t shadowOffset = ringBytes;
+	if (frame.shadows)
+		ringBytes += constantRing.AlignUp(sizeof(ShadowCascadeShaderData));
+
+	// A single allocation, so growing the ring can't move earlier
+	// blocks out from under the workers
+	ConstantBufferSlice block = ringBytes > 0 ? constantRing.Allocate(ringBytes) : ConstantBufferSlice();
+	if (!block.cpuAddress)
+	{
+		// Nothing to draw, or the ring is out of room - drop the frame's draws
+		opaquePackets.clear();
+		opaqueOrder.clear();
+		for (unsigned int list = 0; list < shadowListCount; list++)
+		{
+			shadowPackets[list].clear();
+			shadowOrder[list].clear();
+		}
+		lightClusterConstants = ConstantBufferSlice();
+		shadowConstants = ConstantBufferSlice();
+		return;
+	}
+
+	lightClusterConstants = ConstantBufferSlice();
+	if (frame.lightClusters)
+	{
+		lightClusterConstants = constantRing.SubSlice(block, lightClusterOffset, sizeof(LightClusterShaderData));
+		memcpy(lightClusterConstants.cpuAddress, frame.lightClusters, sizeof(LightClusterShaderData));
+	}
+
+	shadowConstants = ConstantBufferSlice();
+	if (frame.shadows)
+	{
+		shadowConstants = constantRing.SubSlice(block, shadowOffset, sizeof(ShadowCascadeShaderData));
+		memcpy(shadowConstants.cpuAddress, frame.shadows, sizeof(ShadowCascadeShaderData));
+	}
+
+	// 3. Pack constants, build packets and sort keys ---------------------------
+	auto pack = [&](size_t chunkIndex)
+	{
+		ChunkData& chunk = chunks[chunkIndex];
+		const EntityChunk& entityChunk = *entityChunks[chunkIndex];
+		Transform* transforms = entityChunk.GetColumn<Transform>();
+		const MeshRef* meshes = entityChunk.GetColumn<MeshRef>();
+		const MaterialRef* materials = entityChunk.GetColumn<MaterialRef>();
+		size_t offset = chunk.ringOffset;
+
+		// Shadow passes: world/view/proj from each cascade or atlas view
+		for (unsigned int list = 0; list < shadowListCount; list++)
+		{
+			const std::vector<uint32_t>& casters = chunk.shadowCasters[list];
+			if (casters.empty())
+				continue;
+
+			ShadowVSData shadowData = {};
+			if (list < CascadeShadowLists)
+			{
+				shadowData.view = frame.shadowCascades[list / 2].view;
+				shadowData.proj = frame.shadowCascades[list / 2].projection;
+			}
+			else
+			{
+				shadowData.view = frame.atlasViews[list - CascadeShadowLists].view;
+				shadowData.proj = frame.atlasViews[list - CascadeShadowLists].projection;
+			}
+
+			for (size_t j = 0; j < casters.size(); j++)
+			{
+				uint32_t row = casters[j];
+				shadowData.world = transforms[row].GetWorldMatrix();
+
+				size_t p = chunk.firstShadowCaster[list] + j;
+				DrawPacket& packet = shadowPackets[list][p];
+				packet.mesh = resources.Get(meshes[row].mesh);
+				packet.material = resources.Get(materials[row].material);
+				packet.vsConstants = constantRing.SubSlice(block, offset, sizeof(ShadowVSData));
+				packet.psConstants = ConstantBufferSlice();
+				memcpy(packet.vsConstants.cpuAddress, &shadowData, sizeof(shadowData));
+				offset += shadowStride;
+
+				shadowOrder[list][p] = { ShadowSortKey(*packet.mesh), (uint32_t)p };
+			}
+		}
+
+		// Main pass: per-entity vertex and pixel shader data
+		VertexShaderExternalData vsData = {};
+		vsData.view = frame.view;
+		vsData.projection = frame.projection;
+
+		PixelShaderExternalData psData = {};
+		psData.ambientColor = frame.ambientColor;
+		psData.cameraPosition = frame.cameraPosition;
+		psData.objectLightCount = -1;
+
+		for (size_t j = 0; j < chunk.visible.size(); j++)
+		{
+			uint32_t row = chunk.visible[j];
+			Material* mat = resources.Get(materials[row].material);
+
+			vsData.world = transforms[row].GetWorldMatrix();
+			vsData.worldInvTranspose = transforms[row].GetWorldInverseTransposeMatrix();
+
+			psData.colorTint = mat->GetColorTint();
+			psData.uvScale = mat->GetUVScale();
+			psData.uvOffset = mat->GetUVOffset();
+
+			if (frame.lightSelector)
+			{
+				psData.objectLightCount = (int)chunk.visibleLightCounts[j];
+				memcpy(psData.objectLights,
+					&chunk.visibleLights[j * ObjectLightSelector::MaxLightsPerObject],
+					sizeof(uint32_t) * chunk.visibleLightCounts[j]);
+			}
+
+			size_t p = chunk.firstVisible + j;
+			DrawPacket& packet = opaquePackets[p];
+			packet.mesh = resources.Get(meshes[row].mesh);
+			packet.material = mat;
+			packet.vsConstants = constantRing.SubSlice(block, offset, sizeof(VertexShaderExternalData));
+			packet.psConstants = constantRing.SubSlice(block, offset + vsStride, sizeof(PixelShaderExternalData));
+			memcpy(packet.vsConstants.cpuAddress, &vsData, sizeof(vsData));
+			memcpy(packet.psConstants.cpuAddress, &psData, sizeof(psData));
+			offset += vsStride + psStride;
+
+			opaqueOrder[p] = { OpaqueSortKey(*mat, *packet.mesh, chunk.visibleDepth[j]), (uint32_t)p };
+		}
+	};
+	jobSystem.ParallelFor(chunkCount, 1, [&](size_t begin, size_t end)
+	{
+		for (size_t c = begin; c < end; c++)
+			pack(c);
+	});
+
+	for (FrameVector<SortEntry>& order : shadowOrder)
+		SortByKey(order);
+	SortByKey(opaqueOrder);
+}
+
+// --------------------------------------------------------
+// LSD radix sort, 8 bits per pass.  Passes where every key has
+// the same byte are skipped, which is most of them in practice.
+// Stable, so equal keys keep chunk (entity) order.
+// --------------------------------------------------------
+void SceneRenderer::SortByKey(FrameVector<SortEntry>& entries)
+{
+	if (entries.size() < 2)
+		return;
+
+	FrameVector<SortEntry> sortScratch(entries.size(), frameArena);
+
+	for (unsigned int shift = 0; shift < 64; shift += 8)
+	{
+		size_t counts[256] = {};
+		for (const SortEntry& e : entries)
+			counts[(e.key >> shift) & 0xFF]++;
+
+		if (counts[(entries[0].key >> shift) & 0xFF] == entries.size())
+			continue;
+
+		size_t sum = 0;
+		for (size_t& count : counts)
+		{
+			size_t c = count;
+			count = sum;
+			sum += c;
+		}
+
+		for (const SortEntry& e : entries)
+			sortScratch[counts[(e.key >> shift) & 0xFF]++] = e;
+
+		entries.swap(sortScratch);
+	}
+}
+
+// --------------------------------------------------------
+// Walks packets in sorted order and only rebinds what changed
+// --------------------------------------------------------
+void SceneRenderer::SubmitPackets(IRenderBackend& context, const FrameVector<DrawPacket>& packets, const FrameVector<SortEntry>& order, bool bindMaterials)
+{
+	Mesh* boundMesh = nullptr;
+	Material* boundMaterial = nullptr;
+	ShaderHandle boundVS;
+	ShaderHandle boundPS;
+
+	for (const SortEntry& entry : order)
+	{
+		const DrawPacket& packet = packets[entry.packet];
+
+		if (bindMaterials && packet.material != boundMaterial)
+		{
+			// set the shaders for this entity's material
+			if (packet.material->GetVertexShader() != boundVS)
+			{
+				boundVS = packet.material->GetVertexShader();
+				context.SetShader(ShaderStage::Vertex, boundVS);
+			}
+			if (packet.material->GetPixelShader() != boundPS)
+			{
+				boundPS = packet.material->GetPixelShader();
+				context.SetShader(ShaderStage::Pixel, boundPS);
+			}
+
+			packet.material->BindTexturesAndSamplers(context);
+			boundMaterial = packet.material;
+		}
+
+		// Constant data was packed up front, just bind this draw's slices
+		ConstantBufferRing::BindVS(context, 0, packet.vsConstants);
+		if (bindMaterials)
+			ConstantBufferRing::BindPS(context, 0, packet.psConstants);
+
+		if (packet.mesh != boundMesh)
+		{
+			context.SetVertexBuffer(packet.mesh->GetVertexBuffer(), sizeof(Vertex), 0);
+			context.SetIndexBuffer(packet.mesh->GetIndexBuffer());
+			boundMesh = packet.mesh;
+		}
+
+		context.DrawIndexed(packet.mesh->GetIndexCount(), 0, 0);
+	}
+}
+
+void SceneRenderer::DrawShadowPass(IRenderBackend& context, ShaderHandle shadowVertexShader, unsigned int cascade) const
+{
+	if (cascade >= ShadowCascades::CascadeCount || shadowPackets.empty())
+		return;
+
+	// shadow VS only, no pixel shader
+	context.SetShader(ShaderStage::Vertex, shadowVertexShader);
+	context.SetShader(ShaderStage::Pixel, ShaderHandle());
+
+	unsigned int list = ShadowList(cascade, false);
+	SubmitPackets(context, shadowPackets[list], shadowOrder[list], false);
+}
+
+void SceneRenderer::DrawCachedShadowPass(IRenderBackend& context, ShaderHandle shadowVertexShader, unsigned int cascade) const
+{
+	if (cascade >= ShadowCascades::CascadeCount || shadowPackets.empty())
+		return;
+
+	context.SetShader(ShaderStage::Vertex, shadowVertexShader);
+	context.SetShader(ShaderStage::Pixel, ShaderHandle());
+
+	unsigned int list = ShadowList(cascade, true);
+	SubmitPackets(context, shadowPackets[list], shadowOrder[list], false);
+}
+
+void SceneRenderer::DrawAtlasShadowPass(IRenderBackend& context, ShaderHandle shadowVertexShader, unsigned int view) const
+{
+	unsigned int list = AtlasShadowList(view);
+	if (list >= shadowPackets.size())
+		return;
+
+	context.SetShader(ShaderStage::Vertex, shadowVertexShader);
+	context.SetShader(ShaderStage::Pixel, ShaderHandle());
+	SubmitPackets(context, shadowPackets[list], shadowOrder[list], false);
+}
+
+void SceneRenderer::DrawOpaquePass(IRenderBackend& context) const
+{
+	if (lightClusterConstants.cpuAddress)
+		ConstantBufferRing::BindPS(context, 1, lightClusterConstants);
+	if (shadowConstants.cpuAddress)
+		ConstantBufferRing::BindPS(context, 2, shadowConstants);
+
+	SubmitPackets(context, opaquePackets, opaqueOrder, true);
+}
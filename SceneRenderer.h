@@ -0,0 +1,187 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <DirectXMath.h>
+#include "RenderBackend.h"
+#include "ConstantBufferRing.h"
+#include "FrameArena.h"
+#include "EntityComponents.h"
+#include "JobSystem.h"
+#include "ObjectLightSelector.h"
+#include "ShadowCascades.h"
+#include "ShadowCache.h"
+#include "ShadowAtlas.h"
+#include "OcclusionCuller.h"
+#include "BufferStructs.h"
+
+// --------------------------------------------------------
+// Everything the scene passes need to know about the frame
+// --------------------------------------------------------
+struct SceneFrameData
+{
+	DirectX::XMFLOAT4X4 view;
+	DirectX::XMFLOAT4X4 projection;
+	DirectX::XMFLOAT3 cameraPosition;
+	DirectX::XMFLOAT3 ambientColor;
+	const LightClusterShaderData* lightClusters = nullptr;	// PixelShader b1, optional
+
+	// Per-object lights instead of clusters - BeginFrame() it with
+	// the entity count first, Upload() it after PackConstants()
+	ObjectLightSelector* lightSelector = nullptr;
+
+	// Shadow casters are culled and packed once per cascade
+	const ShadowCascade* shadowCascades = nullptr;
+	unsigned int shadowCascadeCount = 0;			// Up to ShadowCascades::CascadeCount
+	const ShadowCascadeShaderData* shadows = nullptr;	// PixelShader b2, optional
+
+	// With a cache, static casters are only packed where it's out
+	// of date, for DrawCachedShadowPass()
+	const ShadowCache* shadowCache = nullptr;
+
+	// Shadow atlas tiles to redraw this frame, each culled and packed
+	// like a cascade, for DrawAtlasShadowPass()
+	const ShadowAtlasView* atlasViews = nullptr;
+	unsigned int atlasViewCount = 0;
+
+	// Rasterized occluders - entities hidden behind them are left out
+	// of the opaque pass (shadow passes still draw them)
+	const OcclusionCuller* occlusion = nullptr;
+};
+
+// --------------------------------------------------------
+// One draw, ready to submit: what to bind and where its
+// constants already are in the ring
+// --------------------------------------------------------
+struct DrawPacket
+{
+	Mesh* mesh = nullptr;
+	Material* material = nullptr;
+	ConstantBufferSlice vsConstants;
+	ConstantBufferSlice psConstants;	// Unused in the shadow pass
+};
+
+// --------------------------------------------------------
+// Counts from the last PackConstants()
+// --------------------------------------------------------
+struct SceneRenderStats
+{
+	size_t entities = 0;
+	size_t visible = 0;			// Passed the camera frustum (and occlusion)
+	size_t occluded = 0;		// Passed the frustum, hidden behind occluders
+	size_t staleHandles = 0;	// Skipped for a released mesh or material
+	size_t shadowCasters = 0;	// Draws over all cascades
+	size_t atlasShadowCasters = 0;	// Draws over all redrawn atlas tiles
+	size_t cascadeCasters[ShadowCascades::CascadeCount] = {};	// Drawn into each cascade
+	size_t cachedShadowCasters = 0;	// Static casters redrawn into the shadow cache
+	unsigned int threads = 0;
+};
+
+// --------------------------------------------------------
+// Records the per-entity work of a frame (culling, constant
+// packing, shadow pass draws, main pass draws) using only the
+// IRenderBackend, so it runs the same on D3D11 and on the
+// RecordingBackend.
+//
+// PackConstants() is the draw system: it walks the render
+// query's entity chunks on the job system, a chunk per job:
+//  1. cull each entity's world bounds against the camera
+//     frustum (and the occlusion buffer) and each shadow
+//     cascade, and pick its lights if per-object lighting is on
+//  2. one ring allocation for everything that survived, split
+//     into a contiguous piece per chunk
+//  3. each chunk packs its own constants and draw packets and
+//     builds their sort keys
+// and then sorts the packets.  Packets and sort entries live in
+// the frame arena, a single bump per list, so the passes have to
+// be drawn before the arena comes back around to this frame.
+// The Draw*Pass() calls are the
+// only single-threaded part: they walk the sorted packets and
+// skip binds that wouldn't change anything.  They may record on
+// a deferred context, and the two passes may record at the same
+// time on different threads (they only read the packets).
+//
+// The caller owns pass setup: render targets, viewports,
+// rasterizer state and the shadow map binding.
+// --------------------------------------------------------
+class SceneRenderer
+{
+public:
+	SceneRenderer(ConstantBufferRing& constantRing, JobSystem& jobSystem, FrameArena& frameArena);
+
+	// Writes every slice the passes below will bind - the ring
+	// must be mapped (between BeginFrame() and Unmap()), and the
+	// entities' world bounds current (UpdateWorldBounds()).  The
+	// packets hold the meshes and materials resolved here, so
+	// nothing released may be collected before the passes record.
+	void PackConstants(RenderQuery& entities, const ResourceRegistry& resources, const SceneFrameData& frame);
+
+	// Depth only - no pixel shader.  One cascade's casters (just
+	// the dynamic ones with a shadow cache), the caller binds that
+	// cascade's depth target.
+	void DrawShadowPass(IRenderBackend& context, ShaderHandle shadowVertexShader, unsigned int cascade) const;
+
+	// The static casters the shadow cache wants redrawn, into the
+	// cascade's static slice
+	void DrawCachedShadowPass(IRenderBackend& context, ShaderHandle shadowVertexShader, unsigned int cascade) const;
+
+	// One of the frame's atlas views - the caller sets the viewport
+	// to its tile
+	void DrawAtlasShadowPass(IRenderBackend& context, ShaderHandle shadowVertexShader, unsigned int view) const;
+
+	// Each visible entity with its own material.  The light
+	// cluster buffers are the caller's to bind, like the shadow
+	// map array.
+	void DrawOpaquePass(IRenderBackend& context) const;
+
+	const SceneRenderStats& GetStats() const { return stats; }
+
+private:
+	// Shadow casters are listed per cascade, with the static ones a
+	// shadow cache redraws kept apart, then one list per atlas view
+	static const unsigned int CascadeShadowLists = ShadowCascades::CascadeCount * 2;
+	static unsigned int ShadowList(unsigned int cascade, bool cached) { return cascade * 2 + (cached ? 1 : 0); }
+	static unsigned int AtlasShadowList(unsigned int view) { return CascadeShadowLists + view; }
+
+	// Per entity chunk output of the cull step, reused between frames
+	struct ChunkData
+	{
+		std::vector<uint32_t> visible;			// Rows in the entity chunk
+		std::vector<float> visibleDepth;		// View space z of each
+		std::vector<std::vector<uint32_t>> shadowCasters;	// Rows, per shadow list
+		std::vector<uint32_t> visibleLights;	// MaxLightsPerObject per visible entity
+		std::vector<uint32_t> visibleLightCounts;
+		size_t occluded = 0;
+		size_t staleHandles = 0;
+
+		size_t firstVisible = 0;			// Where this chunk's packets start
+		std::vector<size_t> firstShadowCaster;
+		size_t ringOffset = 0;				// Bytes into the frame's ring block
+	};
+
+	struct SortEntry
+	{
+		uint64_t key;
+		uint32_t packet;
+	};
+
+	ConstantBufferRing& constantRing;
+	JobSystem& jobSystem;
+	FrameArena& frameArena;
+
+	std::vector<ChunkData> chunks;
+
+	// In the frame arena - made afresh by every PackConstants()
+	FrameVector<DrawPacket> opaquePackets;
+	std::vector<FrameVector<DrawPacket>> shadowPackets;
+	FrameVector<SortEntry> opaqueOrder;
+	std::vector<FrameVector<SortEntry>> shadowOrder;
+
+	ConstantBufferSlice lightClusterConstants;
+	ConstantBufferSlice shadowConstants;
+
+	SceneRenderStats stats;
+
+	static void SubmitPackets(IRenderBackend& context, const FrameVector<DrawPacket>& packets, const FrameVector<SortEntry>& order, bool bindMaterials);
+	void SortByKey(FrameVector<SortEntry>& entries);
+};
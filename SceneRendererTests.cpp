@@ -0,0 +1,398 @@
+#include "SceneRendererTests.h"
+#include "HeadlessTests.h"
+#include "RecordingBackend.h"
+#include "ConstantBufferRing.h"
+#include "SceneRenderer.h"
+#include "Mesh.h"
+#include "Material.h"
+#include "ResourceRegistry.h"
+#include "EntitySystems.h"
+#include "EntityStore.h"
+#include "JobSystem.h"
+#include "LightClusterGrid.h"
+#include "ShadowCascades.h"
+#include "PassScheduler.h"
+#include "FrameArena.h"
+#include "AllocationTracker.h"
+#include "RecordingCommandDevice.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+	struct BenchTimings
+	{
+		double packMs = 0.0;
+		double submitMs = 0.0;
+		double submitMainThreadMs = 0.0;
+		size_t orderErrors = 0;
+		size_t steadyFrames = 0;			// After the warm up, not counting the logged last frame
+		size_t steadyHeapAllocations = 0;	// Over all of those
+		uint64_t steadyTagAllocations[(size_t)AllocationTag::Count] = {};
+		FrameArenaStats arena;
+	};
+
+	// Each pass starts by binding its own vertex shader, which is
+	// how the executed command stream is checked for pass order
+	struct BenchShaders
+	{
+		ShaderHandle sceneVS;
+		ShaderHandle shadowVS;
+		ShaderHandle postVS;
+		ShaderHandle postPS;
+		ShaderHandle uiVS;
+		ShaderHandle uiPS;
+	};
+
+	// --------------------------------------------------------
+	// Counts passes whose first vertex shader bind in the executed
+	// command log is out of the expected order (or missing)
+	// --------------------------------------------------------
+	size_t CountOrderErrors(const std::vector<RecordingBackend::Command>& commands, const std::vector<ShaderHandle>& expected)
+	{
+		size_t errors = 0;
+		size_t previous = 0;
+		for (size_t i = 0; i < expected.size(); i++)
+		{
+			size_t first = commands.size();
+			for (size_t c = 0; c < commands.size(); c++)
+			{
+				const RecordingBackend::Command& command = commands[c];
+				if (command.type == RecordingBackend::CommandType::SetShader &&
+					command.stage == (unsigned int)ShaderStage::Vertex &&
+					command.handle == expected[i].id)
+				{
+					first = c;
+					break;
+				}
+			}
+
+			if (first == commands.size() || (i > 0 && first < previous))
+				errors++;
+			previous = first;
+		}
+		return errors;
+	}
+
+	// --------------------------------------------------------
+	// Runs the frames with a job system of the given size and
+	// returns per-frame averages.
+	//
+	// Passes go through the PassScheduler like in the game, declared
+	// out of order on purpose so the dependencies have to fix it:
+	//   shadow -> scene -> post process -> UI (main thread only)
+	// --------------------------------------------------------
+	BenchTimings RunFrames(
+		RecordingBackend& backend,
+		ConstantBufferRing& constantRing,
+		RenderQuery& entities,
+		const ResourceRegistry& resources,
+		const SceneFrameData& frame,
+		const std::vector<Light>& lights,
+		const BenchShaders& shaders,
+		int threadCount,
+		int frames,
+		bool deferred,
+		SceneRenderStats& sceneStats)
+	{
+		JobSystem jobSystem(threadCount - 1);
+		FrameArena frameArena;
+		SceneRenderer sceneRenderer(constantRing, jobSystem, frameArena);
+		LightClusterGrid lightClusters(backend, jobSystem);
+		RecordingCommandDevice commandDevice(backend);
+		PassScheduler passScheduler(commandDevice, jobSystem, frameArena);
+
+		BoundsQuery boundedEntities(entities.GetStore());
+
+		BenchTimings timings;
+		for (int f = 0; f < frames; f++)
+		{
+			// Only the last frame's commands are checked
+			bool lastFrame = f == frames - 1;
+
+			// Frames after the warm up must not touch the heap - the last
+			// one logs commands, so it doesn't count
+			AllocationTracker::BeginFrame();
+			if (f > WarmUpFrames)
+			{
+				const AllocationFrameStats& steadyFrame = AllocationTracker::GetLastFrame();
+				for (size_t t = 0; t < (size_t)AllocationTag::Count; t++)
+					timings.steadyTagAllocations[t] += steadyFrame.tags[t].allocations;
+			}
+			AllocationTracker::SetSteadyState(f >= WarmUpFrames && !lastFrame);
+			if (f >= WarmUpFrames && !lastFrame)
+				timings.steadyFrames++;
+
+			frameArena.BeginFrame();
+			AllocationScope rendererScope(AllocationTag::Renderer);
+
+			// Touch every transform so world matrices are rebuilt like
+			// they would be for a moving scene
+			entities.ForEach([](EntityId, Transform& transform, WorldBounds&, MeshRef&, MaterialRef&, RenderFlags&)
+			{
+				transform.Rotate(0.0f, 0.01f, 0.0f);
+			});
+
+			backend.ResetFrame();
+			backend.SetCommandLogEnabled(lastFrame);
+
+			auto t0 = std::chrono::high_resolution_clock::now();
+
+			lightClusters.Build(lights, frame.view, frame.projection);
+			lightClusters.Upload(lights);
+			LightClusterShaderData clusterData = lightClusters.GetShaderData(1280.0f, 720.0f);
+
+			SceneFrameData frameData = frame;
+			frameData.lightClusters = &clusterData;
+
+			{
+				AllocationScope entityScope(AllocationTag::Entities);
+				UpdateWorldBounds(boundedEntities, resources, jobSystem);
+			}
+			constantRing.BeginFrame();
+			sceneRenderer.PackConstants(entities, resources, frameData);
+			ConstantBufferSlice postSlice = constantRing.Push(XMFLOAT4(1, 1, 1, 1));
+			constantRing.Unmap();
+
+			auto t1 = std::chrono::high_resolution_clock::now();
+
+			passScheduler.Reset();
+			size_t postPass = passScheduler.AddPass("Post process", [&](IRecordingContext& context)
+			{
+				IRenderBackend& b = context.GetBackend();
+				b.SetShader(ShaderStage::Vertex, shaders.postVS);
+				b.SetShader(ShaderStage::Pixel, shaders.postPS);
+				ConstantBufferRing::BindPS(b, 0, postSlice);
+				b.Draw(3, 0);
+			});
+			size_t uiPass = passScheduler.AddPass("UI", [&](IRecordingContext& context)
+			{
+				IRenderBackend& b = context.GetBackend();
+				b.SetShader(ShaderStage::Vertex, shaders.uiVS);
+				b.SetShader(ShaderStage::Pixel, shaders.uiPS);
+				b.Draw(3, 0);
+			}, true);
+			size_t scenePass = passScheduler.AddPass("Scene", [&](IRecordingContext& context)
+			{
+				lightClusters.Bind(context.GetBackend(), ShaderStage::Pixel, 5);
+				sceneRenderer.DrawOpaquePass(context.GetBackend());
+			});
+			size_t shadowPass = passScheduler.AddPass("Shadow map", [&](IRecordingContext& context)
+			{
+				for (unsigned int cascade = 0; cascade < ShadowCascades::CascadeCount; cascade++)
+					sceneRenderer.DrawShadowPass(context.GetBackend(), shaders.shadowVS, cascade);
+			});
+
+			passScheduler.AddDependency(scenePass, shadowPass);
+			passScheduler.AddDependency(postPass, scenePass);
+			passScheduler.AddDependency(uiPass, postPass);
+			if (!passScheduler.Run(deferred))
+				timings.orderErrors++;
+
+			constantRing.EndFrame();
+
+			auto t2 = std::chrono::high_resolution_clock::now();
+
+			timings.packMs += Milliseconds(t1 - t0);
+			timings.submitMs += Milliseconds(t2 - t1);
+			timings.submitMainThreadMs += passScheduler.GetStats().mainThreadMs;
+
+			if (lastFrame)
+			{
+				timings.orderErrors += CountOrderErrors(backend.GetCommands(),
+					{ shaders.shadowVS, shaders.sceneVS, shaders.postVS, shaders.uiVS });
+			}
+		}
+
+		timings.steadyHeapAllocations = (size_t)AllocationTracker::GetSteadyStateAllocations();
+		AllocationTracker::SetSteadyState(false);
+		backend.SetCommandLogEnabled(false);
+
+		int count = frames > 0 ? frames : 1;
+		timings.packMs /= count;
+		timings.submitMs /= count;
+		timings.submitMainThreadMs /= count;
+		sceneStats = sceneRenderer.GetStats();
+		frameArena.BeginFrame();
+		timings.arena = frameArena.GetStats();
+		return timings;
+	}
+}
+
+int RunHeadlessBench(const HeadlessBenchSettings& settings)
+{
+	// Declared first so it outlives everything holding its handles
+	RecordingBackend backend;
+	backend.SetValidationEnabled(settings.validate);
+	bool failed = false;
+
+	{
+		ConstantBufferRing constantRing(backend, backend.CreateFence());
+		ResourceRegistry resources(backend, backend.CreateFence());
+
+		// Scene setup --------------------------------------------------------
+		MeshHandle cube = CreateBenchCube(resources, backend);
+
+		BenchShaders shaders;
+		shaders.sceneVS = backend.CreateShader(ShaderStage::Vertex, fakeBytecode, sizeof(fakeBytecode));
+		shaders.shadowVS = backend.CreateShader(ShaderStage::Vertex, fakeBytecode, sizeof(fakeBytecode));
+		shaders.postVS = backend.CreateShader(ShaderStage::Vertex, fakeBytecode, sizeof(fakeBytecode));
+		shaders.postPS = backend.CreateShader(ShaderStage::Pixel, fakeBytecode, sizeof(fakeBytecode));
+		shaders.uiVS = backend.CreateShader(ShaderStage::Vertex, fakeBytecode, sizeof(fakeBytecode));
+		shaders.uiPS = backend.CreateShader(ShaderStage::Pixel, fakeBytecode, sizeof(fakeBytecode));
+		ShaderHandle ps = backend.CreateShader(ShaderStage::Pixel, fakeBytecode, sizeof(fakeBytecode));
+
+		TextureDesc texDesc;
+		texDesc.width = 1;
+		texDesc.height = 1;
+		SamplerHandle sampler = backend.CreateSampler(SamplerDesc());
+
+		std::vector<MaterialHandle> materials;
+		for (int i = 0; i < settings.materialCount; i++)
+		{
+			materials.push_back(resources.Create<Material>(XMFLOAT4(1, 1, 1, 1), shaders.sceneVS, ps));
+			Material* mat = resources.Get(materials.back());
+			for (unsigned int slot = 0; slot < 4; slot++)
+				mat->AddTexture(slot, backend.CreateTexture(texDesc));
+			mat->AddSampler(0, sampler);
+		}
+
+		// Square grid of cubes, materials interleaved so neighbours differ
+		EntityStore store;
+		int side = (int)ceilf(sqrtf((float)settings.entityCount));
+		for (int i = 0; i < settings.entityCount; i++)
+		{
+			CreateRenderEntity(store, cube, materials[i % materials.size()], XMFLOAT3(
+				(float)(i % side) * 2.0f - side,
+				0.0f,
+				(float)(i / side) * 2.0f - side));
+		}
+		RenderQuery entities(store);
+
+		std::vector<Light> lights(1);
+		lights[0].Type = LIGHT_TYPE_DIRECTIONAL;
+		lights[0].Direction = XMFLOAT3(1, -1, 0);
+		lights[0].Color = XMFLOAT3(1, 1, 1);
+		lights[0].Intensity = 1.0f;
+
+		// Camera at the near edge of the grid looking across it, shadows
+		// only out to half way - so both the camera and the cascades
+		// actually cull
+		float extent = (float)side;
+		XMFLOAT3 cameraPosition(0, extent * 0.25f, -extent);
+		SceneFrameData frame = {};
+		XMStoreFloat4x4(&frame.view, XMMatrixLookToLH(XMLoadFloat3(&cameraPosition), XMVectorSet(0, -0.3f, 1, 0), XMVectorSet(0, 1, 0, 0)));
+		XMStoreFloat4x4(&frame.projection, XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.01f, extent * 4.0f));
+		frame.cameraPosition = cameraPosition;
+
+		ShadowCascades shadowCascades(1024);
+		shadowCascades.SetShadowDistance(extent);
+		shadowCascades.Update(frame.view, frame.projection, lights[0].Direction);
+		ShadowCascadeShaderData shadowData = shadowCascades.GetShaderData();
+		frame.shadowCascades = shadowCascades.GetCascades();
+		frame.shadowCascadeCount = ShadowCascades::CascadeCount;
+		frame.shadows = &shadowData;
+		frame.ambientColor = XMFLOAT3(0.02f, 0.02f, 0.02f);
+
+		// Thread counts to run -------------------------------------------------
+		int hardwareThreads = (int)std::thread::hardware_concurrency();
+		if (hardwareThreads < 1)
+			hardwareThreads = 1;
+
+		std::vector<int> threadCounts;
+		if (settings.scaling)
+		{
+			for (int t = 1; t < hardwareThreads; t *= 2)
+				threadCounts.push_back(t);
+			threadCounts.push_back(hardwareThreads);
+		}
+		else
+		{
+			threadCounts.push_back(settings.threadCount > 0 ? settings.threadCount : hardwareThreads);
+		}
+
+		printf("Headless bench: %d entities, %d materials, %d frames, validation %s, %s recording\n",
+			settings.entityCount, settings.materialCount, settings.frames,
+			settings.validate ? "on" : "off",
+			settings.deferred ? "deferred" : "immediate");
+		printf("  threads   cull+pack+sort   submit (main thread)    speedup\n");
+
+		// Frames --------------------------------------------------------------
+		double singleThreadPackMs = 0.0;
+		size_t orderErrors = 0;
+		size_t steadyFrames = 0;
+		size_t steadyHeapAllocations = 0;
+		uint64_t steadyTagAllocations[(size_t)AllocationTag::Count] = {};
+		FrameArenaStats arenaStats;
+		SceneRenderStats sceneStats;
+		for (int threads : threadCounts)
+		{
+			BenchTimings timings = RunFrames(backend, constantRing, entities, resources, frame, lights, shaders,
+				threads, settings.frames, settings.deferred, sceneStats);
+			if (singleThreadPackMs == 0.0)
+				singleThreadPackMs = timings.packMs;
+			orderErrors += timings.orderErrors;
+			steadyFrames += timings.steadyFrames;
+			steadyHeapAllocations += timings.steadyHeapAllocations;
+			for (size_t t = 0; t < (size_t)AllocationTag::Count; t++)
+				steadyTagAllocations[t] += timings.steadyTagAllocations[t];
+			arenaStats = timings.arena;
+
+			printf("  %7d   %11.3f ms  %6.3f ms (%6.3f ms)   %5.2fx\n",
+				threads,
+				timings.packMs,
+				timings.submitMs,
+				timings.submitMainThreadMs,
+				timings.packMs > 0.0 ? singleThreadPackMs / timings.packMs : 0.0);
+		}
+
+		// Report --------------------------------------------------------------
+		RecordingStats lastStats = backend.GetStats();
+		printf("  visible %zu, shadow casters %zu (per cascade:", sceneStats.visible, sceneStats.shadowCasters);
+		for (size_t casters : sceneStats.cascadeCasters)
+			printf(" %zu", casters);
+		printf(")\n");
+		printf("  draws %u, binds: shader %u, vb %u, ib %u, cb %u, tex %u, sampler %u (%u redundant)\n",
+			lastStats.draws,
+			lastStats.shaderBinds,
+			lastStats.vertexBufferBinds,
+			lastStats.indexBufferBinds,
+			lastStats.constantBufferBinds,
+			lastStats.textureBinds,
+			lastStats.samplerBinds,
+			lastStats.redundantBinds);
+		printf("  constant ring: %zu KB, grew %u times\n",
+			constantRing.GetCapacity() / 1024, constantRing.GetGrowCount());
+		printf("  frame arena: %.1f KB a frame, %.1f KB high water, %.0f KB per buffer, grew %u times\n",
+			arenaStats.frameBytes / 1024.0, arenaStats.highWaterMark / 1024.0, arenaStats.capacity / 1024.0, arenaStats.growCount);
+		// Deferred contexts reuse the command lists handed back to them,
+		// so deferred frames must be clean too
+		printf("  heap allocations after warm up: %zu over %zu frames\n", steadyHeapAllocations, steadyFrames);
+		if (steadyHeapAllocations > 0)
+		{
+			printf("    by tag:");
+			for (size_t t = 0; t < (size_t)AllocationTag::Count; t++)
+				if (steadyTagAllocations[t] > 0)
+					printf(" %s %llu", AllocationTracker::GetTagName((AllocationTag)t), (unsigned long long)steadyTagAllocations[t]);
+			printf("\n");
+		}
+		if (settings.allocationCsv)
+		{
+			printf("  allocations per frame %s %s\n", AllocationTracker::WriteCsv(settings.allocationCsv) ? "written to" : "could not be written to",
+				settings.allocationCsv);
+		}
+		printf("  pass order errors: %zu\n", orderErrors);
+		if (orderErrors > 0 || steadyHeapAllocations > 0)
+			failed = true;
+	}
+
+	if (ReportValidation(backend) > 0)
+		failed = true;
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+// --------------------------------------------------------
+// Headless CPU benchmark of the scene passes.
+//
+// Builds a synthetic scene (a grid of cubes spread over a few
+// materials) on the RecordingBackend, then times the parallel
+// part of a frame (culling + constant packing + sorting) and
+// the single-threaded draw submission for a number of frames.
+// No window or GPU is involved, so the numbers are the cost of
+// our own code with the driver taken out.
+//
+// With scaling on, the same scene is run once per thread count
+// (1, 2, 4, ... up to the hardware) to show how the parallel
+// part scales.
+//
+// Passes are submitted through the PassScheduler on a
+// RecordingCommandDevice, immediately or on deferred contexts,
+// and the executed command stream is checked for pass order.
+//
+// Frames after a short warm up run in the allocation tracker's
+// steady state mode, and any heap allocations are reported by tag.
+//
+// Returns 0 if the recording backend saw no binding errors,
+// every pass executed in dependency order and no frame, immediate
+// or deferred, allocated after the warm up.
+// --------------------------------------------------------
+struct HeadlessBenchSettings
+{
+	int entityCount = 50000;
+	int materialCount = 8;
+	int frames = 100;
+	int threadCount = -1;	// Including the caller, negative = every hardware thread
+	bool scaling = false;	// Run once per thread count instead
+	bool deferred = false;	// Record passes on deferred contexts
+	bool validate = true;	// Validation costs time, turn off for pure timing
+	const char* allocationCsv = nullptr;	// Per-frame allocation counts, if set
+};
+
+int RunHeadlessBench(const HeadlessBenchSettings& settings);
@@ -4,6 +4,10 @@
 #define LIGHT_TYPE_POINT 1
 #define LIGHT_TYPE_SPOT 2
 
+// Light.ShadowIndex: first shadow atlas tile + 1, or one of these
+#define LIGHT_SHADOW_NONE 0
+#define LIGHT_SHADOW_CASCADES -1
+
 // Struct representing data from vertex shader to pixel shader
 struct VertexToPixel
 {
@@ -11,7 +15,6 @@ struct VertexToPixel
     float3 normal : NORMAL;
     float2 uv : TEXCOORD;
     float3 worldPosition : POSITION;
-    float4 shadowPos : SHADOW_POSITION;
     float3 tangent : TANGENT;
 
 };
@@ -27,7 +30,8 @@ struct Light
     float3 Color;
     float SpotInnerAngle;
     float SpotOuterAngle;
-    float2 Padding;
+    int ShadowIndex;
+    float Padding;
     bool CastsShadows;
 };
 
@@ -0,0 +1,401 @@
+#include "ShadowAtlas.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace DirectX;
+
+namespace
+{
+	// Cube faces in D3D order, with the usual up vectors
+	const XMFLOAT3 faceDirections[ShadowAtlas::CubeFaces] =
+	{
+		XMFLOAT3(1, 0, 0), XMFLOAT3(-1, 0, 0),
+		XMFLOAT3(0, 1, 0), XMFLOAT3(0, -1, 0),
+		XMFLOAT3(0, 0, 1), XMFLOAT3(0, 0, -1)
+	};
+	const XMFLOAT3 faceUps[ShadowAtlas::CubeFaces] =
+	{
+		XMFLOAT3(0, 1, 0), XMFLOAT3(0, 1, 0),
+		XMFLOAT3(0, 0, -1), XMFLOAT3(0, 0, 1),
+		XMFLOAT3(0, 1, 0), XMFLOAT3(0, 1, 0)
+	};
+
+	bool SameShadowCaster(const Light& a, const Light& b)
+	{
+		return a.Type == b.Type &&
+			a.Range == b.Range &&
+			a.SpotOuterAngle == b.SpotOuterAngle &&
+			memcmp(&a.Position, &b.Position, sizeof(XMFLOAT3)) == 0 &&
+			memcmp(&a.Direction, &b.Direction, sizeof(XMFLOAT3)) == 0;
+	}
+}
+
+ShadowAtlas::ShadowAtlas(IRenderBackend& backend, unsigned int atlasSize)
+	: backend(backend),
+	allocator((std::max)(atlasSize, MaxTileSize), MinTileSize)
+{
+}
+
+ShadowAtlas::~ShadowAtlas()
+{
+	if (tileBuffer.IsValid())
+		backend.DestroyBuffer(tileBuffer);
+}
+
+float ShadowAtlas::Importance(const Light& light, const XMFLOAT3& cameraPosition, const Frustum& cameraFrustum)
+{
+	if (light.Type == LIGHT_TYPE_DIRECTIONAL)
+		return 1.0f;
+	if (!(light.Range > 0.0f))
+		return 0.0f;
+
+	// Nothing it lights is visible
+	AABB bounds;
+	bounds.center = light.Position;
+	bounds.extents = XMFLOAT3(light.Range, light.Range, light.Range);
+	if (!cameraFrustum.Intersects(bounds))
+		return 0.0f;
+
+	// Roughly how much of the screen its range covers
+	XMVECTOR offset = XMVectorSubtract(XMLoadFloat3(&light.Position), XMLoadFloat3(&cameraPosition));
+	float distance = XMVectorGetX(XMVector3Length(offset));
+	return distance <= light.Range ? 1.0f : light.Range / distance;
+}
+
+unsigned int ShadowAtlas::TileSizeFor(float importance)
+{
+	unsigned int size = MaxTileSize;
+	while (size > MinTileSize && (float)size > importance * MaxTileSize)
+		size /= 2;
+	return size;
+}
+
+unsigned int ShadowAtlas::UpdatePeriodFor(float importance)
+{
+	if (importance >= 0.5f)
+		return 1;
+	if (importance >= 0.25f)
+		return 2;
+	return 4;
+}
+
+void ShadowAtlas::Update(std::vector<Light>& lights, const XMFLOAT4X4& cameraView, const XMFLOAT4X4& cameraProjection, int cascadedLight)
+{
+	frame++;
+	stats = ShadowAtlasStats();
+	renderViews.clear();
+	shaderTiles.clear();
+
+	XMMATRIX view = XMLoadFloat4x4(&cameraView);
+	XMFLOAT4X4 cameraViewProjection;
+	XMStoreFloat4x4(&cameraViewProjection, XMMatrixMultiply(view, XMLoadFloat4x4(&cameraProjection)));
+	Frustum cameraFrustum = Frustum::FromViewProjection(cameraViewProjection);
+	XMFLOAT3 cameraPosition;
+	XMStoreFloat3(&cameraPosition, XMMatrixInverse(nullptr, view).r[3]);
+
+	// Lights that went away give their tiles back
+	for (size_t i = lights.size(); i < states.size(); i++)
+		FreeTiles(states[i]);
+	states.resize(lights.size());
+
+	// What each light would like
+	size_t atlasArea = (size_t)GetAtlasSize() * GetAtlasSize();
+	size_t wantedArea = 0;
+	order.clear();
+	for (uint32_t i = 0; i < (uint32_t)lights.size(); i++)
+	{
+		const Light& light = lights[i];
+		LightState& state = states[i];
+
+		unsigned int faceCount = light.Type == LIGHT_TYPE_POINT ? CubeFaces : 1;
+		if (faceCount != state.faceCount)
+		{
+			FreeTiles(state);
+			state.faceCount = faceCount;
+		}
+
+		bool wantsShadow = light.CastsShadows && (int)i != cascadedLight;
+		state.importance = wantsShadow ? Importance(light, cameraPosition, cameraFrustum) : 0.0f;
+		state.idealSize = 0;
+		if (state.importance > 0.0f)
+		{
+			// Six faces share what one tile would get
+			state.idealSize = TileSizeFor(state.importance);
+			if (faceCount > 1)
+				state.idealSize = (std::max)(state.idealSize / 2, MinTileSize);
+
+			wantedArea += (size_t)faceCount * state.idealSize * state.idealSize;
+			order.push_back(i);
+		}
+		else if (wantsShadow)
+		{
+			stats.droppedLights++;
+		}
+		state.wantedSize = state.idealSize;
+	}
+
+	// Oversubscribed: the least important shrink first, and once
+	// everything is as small as it goes they're dropped
+	std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+	{
+		return states[a].importance < states[b].importance;
+	});
+	while (wantedArea > atlasArea)
+	{
+		bool shrunk = false;
+		for (uint32_t i : order)
+		{
+			LightState& state = states[i];
+			if (wantedArea <= atlasArea)
+				break;
+			if (state.wantedSize <= MinTileSize)
+				continue;
+
+			size_t half = state.wantedSize / 2;
+			wantedArea -= state.faceCount * ((size_t)state.wantedSize * state.wantedSize - half * half);
+			state.wantedSize = (unsigned int)half;
+			shrunk = true;
+		}
+
+		if (!shrunk)
+		{
+			for (uint32_t i : order)
+			{
+				LightState& state = states[i];
+				if (state.wantedSize == 0)
+					continue;
+
+				wantedArea -= (size_t)state.faceCount * state.wantedSize * state.wantedSize;
+				state.wantedSize = 0;
+				stats.droppedLights++;
+				break;
+			}
+		}
+	}
+
+	// Tiles that no longer fit their light go back first
+	for (LightState& state : states)
+	{
+		if (state.tileSize != state.wantedSize)
+			FreeTiles(state);
+	}
+
+	// New tiles biggest first, so they pack.  Failing with enough
+	// room left means fragmentation - start over in this same order,
+	// which can't fail.
+	std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+	{
+		return states[a].wantedSize > states[b].wantedSize;
+	});
+	for (uint32_t i : order)
+	{
+		LightState& state = states[i];
+		if (state.wantedSize == 0 || state.tileSize != 0)
+			continue;
+
+		if (!AllocateTiles(state))
+		{
+			Repack();
+			break;
+		}
+	}
+
+	// Redraw what's new, moved or due, and list every tile for the shader
+	for (uint32_t i = 0; i < (uint32_t)lights.size(); i++)
+	{
+		Light& light = lights[i];
+		LightState& state = states[i];
+		if (state.tileSize == 0)
+		{
+			light.ShadowIndex = (int)i == cascadedLight ? LIGHT_SHADOW_CASCADES : LIGHT_SHADOW_NONE;
+			continue;
+		}
+
+		state.period = light.Type == LIGHT_TYPE_DIRECTIONAL || !updatePeriods ? 1 : UpdatePeriodFor(state.importance);
+		bool due = (frame + i) % state.period == 0;
+		if (!state.drawn || due || !SameShadowCaster(light, state.drawnLight))
+		{
+			AddRenderViews(lights, i, cameraPosition);
+			state.drawn = true;
+			state.drawnLight = light;
+		}
+
+		light.ShadowIndex = (int)shaderTiles.size() + 1;
+		float atlasSize = (float)GetAtlasSize();
+		for (unsigned int f = 0; f < state.faceCount; f++)
+		{
+			const ShadowAtlasTile& tile = state.tiles[f];
+			ShadowTileShaderData data;
+			data.viewProjection = state.viewProjection[f];
+			data.atlasRect = XMFLOAT4(tile.size / atlasSize, tile.size / atlasSize, tile.x / atlasSize, tile.y / atlasSize);
+			shaderTiles.push_back(data);
+		}
+
+		stats.shadowedLights++;
+		stats.tiles += state.faceCount;
+		if (state.tileSize < state.idealSize)
+			stats.shrunkLights++;
+	}
+
+	stats.renderedTiles = renderViews.size();
+	stats.usedArea = 1.0f - (float)allocator.GetFreeArea() / (float)atlasArea;
+	stats.fragmentation = allocator.GetFragmentation();
+}
+
+void ShadowAtlas::FreeTiles(LightState& state)
+{
+	if (state.tileSize == 0)
+		return;
+
+	for (unsigned int f = 0; f < state.faceCount; f++)
+		allocator.Free(state.tiles[f]);
+	state.tileSize = 0;
+	state.drawn = false;
+}
+
+bool ShadowAtlas::AllocateTiles(LightState& state)
+{
+	for (unsigned int f = 0; f < state.faceCount; f++)
+	{
+		state.tiles[f] = allocator.Allocate(state.wantedSize);
+		if (!state.tiles[f].IsValid())
+		{
+			// All or nothing
+			for (unsigned int g = 0; g < f; g++)
+				allocator.Free(state.tiles[g]);
+			return false;
+		}
+	}
+
+	state.tileSize = state.wantedSize;
+	state.drawn = false;
+	return true;
+}
+
+void ShadowAtlas::Repack()
+{
+	stats.repacks++;
+	allocator.Reset();
+	for (LightState& state : states)
+	{
+		state.tileSize = 0;
+		state.drawn = false;
+	}
+
+	// order is biggest first, and everything fits by area
+	for (uint32_t i : order)
+	{
+		if (states[i].wantedSize > 0)
+			AllocateTiles(states[i]);
+	}
+}
+
+void ShadowAtlas::AddRenderViews(const std::vector<Light>& lights, uint32_t index, const XMFLOAT3& cameraPosition)
+{
+	const Light& light = lights[index];
+	LightState& state = states[index];
+	XMVECTOR position = XMLoadFloat3(&light.Position);
+	float nearZ = (std::max)(light.Range * 0.01f, 0.05f);
+
+	for (unsigned int f = 0; f < state.faceCount; f++)
+	{
+		XMMATRIX view;
+		XMMATRIX projection;
+		bool directional = false;
+		switch (light.Type)
+		{
+		case LIGHT_TYPE_POINT:
+			view = XMMatrixLookToLH(position, XMLoadFloat3(&faceDirections[f]), XMLoadFloat3(&faceUps[f]));
+			projection = XMMatrixPerspectiveFovLH(XM_PIDIV2, 1.0f, nearZ, light.Range);
+			break;
+
+		case LIGHT_TYPE_SPOT:
+		{
+			XMVECTOR dir = XMVector3Normalize(XMLoadFloat3(&light.Direction));
+			XMVECTOR up = fabsf(XMVectorGetY(dir)) > 0.99f ? XMVectorSet(0, 0, 1, 0) : XMVectorSet(0, 1, 0, 0);
+			float fov = (std::min)(2.0f * light.SpotOuterAngle, XM_PI * 0.95f);
+			view = XMMatrixLookToLH(position, dir, up);
+			projection = XMMatrixPerspectiveFovLH(fov, 1.0f, nearZ, light.Range);
+			break;
+		}
+
+		default:
+		{
+			// A sphere of the shadow distance around the camera, snapped
+			// to texels like the cascades so it doesn't shimmer
+			directional = true;
+			float radius = shadowDistance;
+			float texelSize = 2.0f * radius / (float)state.tileSize;
+			XMVECTOR dir = XMVector3Normalize(XMLoadFloat3(&light.Direction));
+			XMVECTOR up = fabsf(XMVectorGetY(dir)) > 0.99f ? XMVectorSet(0, 0, 1, 0) : XMVectorSet(0, 1, 0, 0);
+			XMMATRIX lightRotation = XMMatrixLookToLH(XMVectorZero(), dir, up);
+
+			XMFLOAT3 center;
+			XMStoreFloat3(&center, XMVector3TransformCoord(XMLoadFloat3(&cameraPosition), lightRotation));
+			center.x = floorf(center.x / texelSize) * texelSize;
+			center.y = floorf(center.y / texelSize) * texelSize;
+			center.z = floorf(center.z / texelSize) * texelSize;
+
+			view = XMMatrixMultiply(lightRotation, XMMatrixTranslation(-center.x, -center.y, radius - center.z));
+			projection = XMMatrixOrthographicLH(2.0f * radius, 2.0f * radius, 0.0f, 2.0f * radius);
+			break;
+		}
+		}
+
+		ShadowAtlasView atlasView;
+		XMStoreFloat4x4(&atlasView.view, view);
+		XMStoreFloat4x4(&atlasView.projection, projection);
+		XMStoreFloat4x4(&atlasView.viewProjection, XMMatrixMultiply(view, projection));
+		atlasView.casterFrustum = Frustum::FromViewProjection(atlasView.viewProjection);
+		if (directional)
+			atlasView.casterFrustum.planes[4] = XMFLOAT4(0, 0, 0, 1);	// Near plane: everything toward the light casts
+		atlasView.tile = state.tiles[f];
+		atlasView.light = index;
+		atlasView.face = f;
+
+		state.viewProjection[f] = atlasView.viewProjection;
+		renderViews.push_back(atlasView);
+	}
+}
+
+void ShadowAtlas::Upload()
+{
+	// Grown by doubling, never empty so there's always something to bind
+	if (shaderTiles.size() > tileCapacity || !tileBuffer.IsValid())
+	{
+		if (tileBuffer.IsValid())
+			backend.DestroyBuffer(tileBuffer);
+		tileCapacity = (std::max)((std::max)(shaderTiles.size(), tileCapacity * 2), (size_t)64);
+
+		BufferDesc desc;
+		desc.type = BufferType::Structured;
+		desc.usage = BufferUsage::Dynamic;
+		desc.size = tileCapacity * sizeof(ShadowTileShaderData);
+		desc.stride = sizeof(ShadowTileShaderData);
+		tileBuffer = backend.CreateBuffer(desc);
+	}
+
+	void* mapped = backend.Map(tileBuffer, MapMode::WriteDiscard);
+	if (!mapped)
+		return;
+
+	if (!shaderTiles.empty())
+		memcpy(mapped, shaderTiles.data(), shaderTiles.size() * sizeof(ShadowTileShaderData));
+	backend.Unmap(tileBuffer);
+}
+
+void ShadowAtlas::Bind(IRenderBackend& context, ShaderStage stage, unsigned int slot) const
+{
+	context.SetShaderBuffer(stage, slot, tileBuffer);
+}
+
+unsigned int ShadowAtlas::GetTileSize(size_t light) const
+{
+	return light < states.size() ? states[light].tileSize : 0;
+}
+
+unsigned int ShadowAtlas::GetUpdatePeriod(size_t light) const
+{
+	return light < states.size() && states[light].tileSize > 0 ? states[light].period : 0;
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <DirectXMath.h>
+#include "RenderBackend.h"
+#include "Bounds.h"
+#include "Lights.h"
+#include "BufferStructs.h"
+#include "ShadowAtlasAllocator.h"
+
+// --------------------------------------------------------
+// One shadow map to render into the atlas this frame: a spot
+// light, one cube face of a point light, or a directional
+// light's tile
+// --------------------------------------------------------
+struct ShadowAtlasView
+{
+	DirectX::XMFLOAT4X4 view;
+	DirectX::XMFLOAT4X4 projection;
+	DirectX::XMFLOAT4X4 viewProjection;
+	Frustum casterFrustum;
+	ShadowAtlasTile tile;
+	uint32_t light;			// Index into the lights
+	unsigned int face;		// Cube face of a point light, +x -x +y -y +z -z
+};
+
+// --------------------------------------------------------
+// Counts from the last Update()
+// --------------------------------------------------------
+struct ShadowAtlasStats
+{
+	size_t shadowedLights = 0;	// Lights with tiles
+	size_t droppedLights = 0;	// Wanted a shadow, didn't get a tile (out of view or out of room)
+	size_t shrunkLights = 0;	// Got a smaller tile than their importance asked for
+	size_t tiles = 0;
+	size_t renderedTiles = 0;	// Redrawn this frame
+	float usedArea = 0.0f;		// Fraction of the atlas
+	float fragmentation = 0.0f;	// See ShadowAtlasAllocator::GetFragmentation()
+	unsigned int repacks = 0;	// Times everything was reallocated this frame
+};
+
+// --------------------------------------------------------
+// Shadow maps for any number of lights, packed into one depth
+// atlas.
+//
+// Every light with CastsShadows (except the one the cascades
+// cover) gets square tiles: one for a spot or directional
+// light, six cube faces for a point light.  Tile sizes follow
+// an importance metric - how big the light's range looks from
+// the camera, zero if it's out of view - rounded to powers of
+// two.  When the atlas is oversubscribed the least important
+// lights shrink first, and are dropped once they're at the
+// smallest size.
+//
+// Tiles are kept from frame to frame while their size holds.
+// Less important lights are redrawn less often (every 2nd or
+// 4th frame, staggered so they don't all land on one frame),
+// but always right after they moved or got a new tile.
+// Directional lights follow the camera, so they redraw every
+// frame.  The shader reads each tile with the matrices it was
+// last drawn with, so a skipped frame is only a bit stale.
+//
+// If allocation fails for fragmentation alone the whole atlas is
+// repacked, which the allocator guarantees to fit.
+//
+// Sets each light's ShadowIndex, and uploads a tile list for the
+// pixel shader.  Lights are tracked by index, like the shadow
+// cache's entities.
+// --------------------------------------------------------
+class ShadowAtlas
+{
+public:
+	static constexpr unsigned int MaxTileSize = 1024;
+	static constexpr unsigned int MinTileSize = 64;
+	static const unsigned int CubeFaces = 6;
+
+	explicit ShadowAtlas(IRenderBackend& backend, unsigned int atlasSize = 4096);
+	~ShadowAtlas();
+
+	ShadowAtlas(const ShadowAtlas&) = delete;
+	ShadowAtlas& operator=(const ShadowAtlas&) = delete;
+
+	// How far around the camera a directional light's tile reaches
+	void SetShadowDistance(float distance) { shadowDistance = distance; }
+	float GetShadowDistance() const { return shadowDistance; }
+
+	// Off redraws every tile every frame
+	void SetUpdatePeriodsEnabled(bool enabled) { updatePeriods = enabled; }
+
+	// cascadedLight is left to the cascades (-1 for none)
+	void Update(std::vector<Light>& lights, const DirectX::XMFLOAT4X4& cameraView, const DirectX::XMFLOAT4X4& cameraProjection, int cascadedLight);
+
+	// Tile list to the GPU - immediate context only, since it maps
+	void Upload();
+	void Bind(IRenderBackend& context, ShaderStage stage, unsigned int slot) const;
+
+	// Tiles to draw this frame, each already cleared by the caller
+	const std::vector<ShadowAtlasView>& GetRenderViews() const { return renderViews; }
+
+	unsigned int GetAtlasSize() const { return allocator.GetAtlasSize(); }
+	const ShadowAtlasAllocator& GetAllocator() const { return allocator; }
+	const ShadowAtlasStats& GetStats() const { return stats; }
+
+	// A light's tile size (per face) and update period from the last
+	// Update(), 0 if it has no tile
+	unsigned int GetTileSize(size_t light) const;
+	unsigned int GetUpdatePeriod(size_t light) const;
+
+	// 0 - 1: 1 when the camera is inside the light's range, falling
+	// off with distance, 0 if the range is out of view.  Directional
+	// lights are always 1.
+	static float Importance(const Light& light, const DirectX::XMFLOAT3& cameraPosition, const Frustum& cameraFrustum);
+	static unsigned int TileSizeFor(float importance);
+	static unsigned int UpdatePeriodFor(float importance);
+
+private:
+	struct LightState
+	{
+		ShadowAtlasTile tiles[CubeFaces];
+		unsigned int faceCount = 1;		// 6 for point lights
+		unsigned int tileSize = 0;		// Per face, 0 = no tiles
+		unsigned int idealSize = 0;		// What the importance asked for
+		unsigned int wantedSize = 0;	// After fitting everything in
+		unsigned int period = 1;
+		float importance = 0.0f;
+		bool drawn = false;			// Tiles hold something
+		Light drawnLight = {};		// What they were drawn with
+		DirectX::XMFLOAT4X4 viewProjection[CubeFaces];
+	};
+
+	IRenderBackend& backend;
+	ShadowAtlasAllocator allocator;
+	float shadowDistance = 40.0f;
+	bool updatePeriods = true;
+	uint64_t frame = 0;
+
+	std::vector<LightState> states;
+	std::vector<uint32_t> order;	// Scratch
+	std::vector<ShadowAtlasView> renderViews;
+	std::vector<ShadowTileShaderData> shaderTiles;
+	ShadowAtlasStats stats;
+
+	BufferHandle tileBuffer;
+	size_t tileCapacity = 0;
+
+	void FreeTiles(LightState& state);
+	bool AllocateTiles(LightState& state);
+	void Repack();
+	void AddRenderViews(const std::vector<Light>& lights, uint32_t index, const DirectX::XMFLOAT3& cameraPosition);
+};
@@ -0,0 +1,188 @@
+#include "ShadowAtlasAllocator.h"
+#include <algorithm>
+
+ShadowAtlasAllocator::ShadowAtlasAllocator(unsigned int atlasSize, unsigned int minTileSize)
+	: atlasSize(RoundUpToPowerOfTwo((std::max)(atlasSize, 1u))),
+	minTileSize(RoundUpToPowerOfTwo((std::max)(minTileSize, 1u))),
+	levelCount(1)
+{
+	this->minTileSize = (std::min)(this->minTileSize, this->atlasSize);
+	while (LevelSize(levelCount - 1) > this->minTileSize)
+		levelCount++;
+
+	uint32_t nodeCount = 0;
+	for (unsigned int level = 0; level < levelCount; level++)
+	{
+		levelStart.push_back(nodeCount);
+		nodeCount += LevelWidth(level) * LevelWidth(level);
+	}
+	nodes.resize(nodeCount);
+	freeNodes.resize(levelCount);
+
+	Reset();
+}
+
+void ShadowAtlasAllocator::Reset()
+{
+	std::fill(nodes.begin(), nodes.end(), NodeState::Unused);
+	for (std::vector<uint32_t>& list : freeNodes)
+		list.clear();
+
+	nodes[0] = NodeState::Free;
+	freeNodes[0].push_back(0);
+	allocatedCount = 0;
+	freeArea = (size_t)atlasSize * atlasSize;
+}
+
+unsigned int ShadowAtlasAllocator::RoundUpToPowerOfTwo(unsigned int value)
+{
+	unsigned int power = 1;
+	while (power < value && power < 0x80000000u)
+		power <<= 1;
+	return power;
+}
+
+ShadowAtlasTile ShadowAtlasAllocator::Allocate(unsigned int size)
+{
+	size = (std::max)(RoundUpToPowerOfTwo(size), minTileSize);
+	if (size > atlasSize)
+		return ShadowAtlasTile();
+
+	unsigned int targetLevel = 0;
+	while (LevelSize(targetLevel) > size)
+		targetLevel++;
+
+	// Smallest free tile that fits
+	int level = (int)targetLevel;
+	while (level >= 0 && freeNodes[level].empty())
+		level--;
+	if (level < 0)
+		return ShadowAtlasTile();
+
+	// Lowest index, so tiles pack toward the top left
+	std::vector<uint32_t>& list = freeNodes[level];
+	std::vector<uint32_t>::iterator lowest = std::min_element(list.begin(), list.end());
+	uint32_t node = *lowest;
+	*lowest = list.back();
+	list.pop_back();
+
+	unsigned int x = (node - levelStart[level]) % LevelWidth(level);
+	unsigned int y = (node - levelStart[level]) / LevelWidth(level);
+
+	// Split down to the size asked for, keeping the first child each
+	// time and freeing its three siblings
+	for (; level < (int)targetLevel; level++)
+	{
+		nodes[node] = NodeState::Split;
+		x *= 2;
+		y *= 2;
+		node = NodeIndex(level + 1, x, y);
+		nodes[node] = NodeState::Free;
+		PushFree(level + 1, NodeIndex(level + 1, x + 1, y));
+		PushFree(level + 1, NodeIndex(level + 1, x, y + 1));
+		PushFree(level + 1, NodeIndex(level + 1, x + 1, y + 1));
+	}
+
+	nodes[node] = NodeState::Allocated;
+	allocatedCount++;
+	freeArea -= (size_t)size * size;
+
+	ShadowAtlasTile tile;
+	tile.x = x * size;
+	tile.y = y * size;
+	tile.size = size;
+	return tile;
+}
+
+void ShadowAtlasAllocator::Free(const ShadowAtlasTile& tile)
+{
+	if (!tile.IsValid() || tile.size > atlasSize || tile.size < minTileSize)
+		return;
+
+	unsigned int level = 0;
+	while (LevelSize(level) > tile.size)
+		level++;
+	if (LevelSize(level) != tile.size || tile.x % tile.size != 0 || tile.y % tile.size != 0)
+		return;
+
+	unsigned int x = tile.x / tile.size;
+	unsigned int y = tile.y / tile.size;
+	uint32_t node = NodeIndex(level, x, y);
+	if (nodes[node] != NodeState::Allocated)
+		return;
+
+	nodes[node] = NodeState::Free;
+	allocatedCount--;
+	freeArea += (size_t)tile.size * tile.size;
+
+	// Merge while all four siblings are free
+	while (level > 0)
+	{
+		unsigned int px = x / 2;
+		unsigned int py = y / 2;
+		uint32_t children[4] =
+		{
+			NodeIndex(level, px * 2, py * 2),
+			NodeIndex(level, px * 2 + 1, py * 2),
+			NodeIndex(level, px * 2, py * 2 + 1),
+			NodeIndex(level, px * 2 + 1, py * 2 + 1)
+		};
+
+		bool allFree = true;
+		for (uint32_t child : children)
+			allFree &= nodes[child] == NodeState::Free;
+		if (!allFree)
+			break;
+
+		for (uint32_t child : children)
+		{
+			if (child != node)
+				RemoveFree(level, child);
+			nodes[child] = NodeState::Unused;
+		}
+
+		level--;
+		x = px;
+		y = py;
+		node = NodeIndex(level, x, y);
+		nodes[node] = NodeState::Free;
+	}
+
+	PushFree(level, node);
+}
+
+unsigned int ShadowAtlasAllocator::GetLargestFreeTile() const
+{
+	for (unsigned int level = 0; level < levelCount; level++)
+	{
+		if (!freeNodes[level].empty())
+			return LevelSize(level);
+	}
+	return 0;
+}
+
+float ShadowAtlasAllocator::GetFragmentation() const
+{
+	if (freeArea == 0)
+		return 0.0f;
+
+	size_t largest = GetLargestFreeTile();
+	return 1.0f - (float)(largest * largest) / (float)freeArea;
+}
+
+void ShadowAtlasAllocator::PushFree(unsigned int level, uint32_t node)
+{
+	nodes[node] = NodeState::Free;
+	freeNodes[level].push_back(node);
+}
+
+void ShadowAtlasAllocator::RemoveFree(unsigned int level, uint32_t node)
+{
+	std::vector<uint32_t>& list = freeNodes[level];
+	std::vector<uint32_t>::iterator it = std::find(list.begin(), list.end(), node);
+	if (it == list.end())
+		return;
+
+	*it = list.back();
+	list.pop_back();
+}
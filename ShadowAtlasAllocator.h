@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// --------------------------------------------------------
+// A square tile of the shadow atlas in texels, size 0 if
+// the allocation failed
+// --------------------------------------------------------
+struct ShadowAtlasTile
+{
+	unsigned int x = 0;
+	unsigned int y = 0;
+	unsigned int size = 0;
+
+	bool IsValid() const { return size > 0; }
+};
+
+// --------------------------------------------------------
+// Hands out power of two tiles of a square atlas - a quadtree
+// buddy allocator.
+//
+// Every node of the tree is a tile that is free, allocated or
+// split into four children.  Allocating takes the smallest free
+// tile that fits and splits it down; freeing merges four free
+// siblings back into their parent, so once everything is freed
+// the atlas is one free tile again.
+//
+// Tiles of mixed sizes allocated and freed in any order can
+// leave the free space in pieces too small for a big tile (see
+// GetFragmentation()).  Allocating in decreasing size order into
+// an empty atlas never fails while there's room: every tile so
+// far is at least as big, so they fill whole parents.  That's
+// what a repack is.
+//
+// Only bookkeeping - no GPU resources.
+// --------------------------------------------------------
+class ShadowAtlasAllocator
+{
+public:
+	// Both are rounded up to powers of two
+	ShadowAtlasAllocator(unsigned int atlasSize = 4096, unsigned int minTileSize = 64);
+
+	// Size is rounded up to a power of two, at least the minimum tile
+	ShadowAtlasTile Allocate(unsigned int size);
+	void Free(const ShadowAtlasTile& tile);
+
+	// Everything free
+	void Reset();
+
+	unsigned int GetAtlasSize() const { return atlasSize; }
+	unsigned int GetMinTileSize() const { return minTileSize; }
+	size_t GetAllocatedCount() const { return allocatedCount; }
+	size_t GetFreeArea() const { return freeArea; }
+
+	// Biggest tile Allocate() would succeed for, 0 if full
+	unsigned int GetLargestFreeTile() const;
+
+	// 0 when the free space is one tile, toward 1 as it's split up:
+	// 1 - (largest free tile's area / free area)
+	float GetFragmentation() const;
+
+	static unsigned int RoundUpToPowerOfTwo(unsigned int value);
+
+private:
+	enum class NodeState : uint8_t { Unused, Free, Split, Allocated };
+
+	unsigned int atlasSize;
+	unsigned int minTileSize;
+	unsigned int levelCount;	// Level 0 is the whole atlas, each level halves the size
+
+	// Nodes of all levels back to back, row by row within a level
+	std::vector<NodeState> nodes;
+	std::vector<uint32_t> levelStart;
+	std::vector<std::vector<uint32_t>> freeNodes;	// Per level
+
+	size_t allocatedCount = 0;
+	size_t freeArea = 0;
+
+	unsigned int LevelSize(unsigned int level) const { return atlasSize >> level; }
+	unsigned int LevelWidth(unsigned int level) const { return 1u << level; }
+	uint32_t NodeIndex(unsigned int level, unsigned int x, unsigned int y) const { return levelStart[level] + y * LevelWidth(level) + x; }
+
+	void PushFree(unsigned int level, uint32_t node);
+	void RemoveFree(unsigned int level, uint32_t node);
+};
@@ -0,0 +1,316 @@
+#include "ShadowAtlasTests.h"
+#include "HeadlessTests.h"
+#include "RecordingBackend.h"
+#include "ShadowAtlas.h"
+#include "ShadowAtlasAllocator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+	// Which minimum-size cells of the atlas are taken - for checking
+	// that tiles never overlap
+	class AtlasCoverage
+	{
+	public:
+		AtlasCoverage(unsigned int atlasSize, unsigned int cellSize)
+			: cellSize(cellSize), width(atlasSize / cellSize), cells(width * width, 0) {}
+
+		// False if the tile leaves the atlas or hits one already marked
+		bool Mark(const ShadowAtlasTile& tile)
+		{
+			if (tile.x + tile.size > width * cellSize || tile.y + tile.size > width * cellSize)
+				return false;
+
+			bool clear = true;
+			for (unsigned int y = tile.y / cellSize; y < (tile.y + tile.size) / cellSize; y++)
+			{
+				for (unsigned int x = tile.x / cellSize; x < (tile.x + tile.size) / cellSize; x++)
+				{
+					clear &= cells[y * width + x] == 0;
+					cells[y * width + x] = 1;
+				}
+			}
+			return clear;
+		}
+
+		void Unmark(const ShadowAtlasTile& tile)
+		{
+			for (unsigned int y = tile.y / cellSize; y < (tile.y + tile.size) / cellSize; y++)
+			{
+				for (unsigned int x = tile.x / cellSize; x < (tile.x + tile.size) / cellSize; x++)
+					cells[y * width + x] = 0;
+			}
+		}
+
+	private:
+		unsigned int cellSize;
+		unsigned int width;
+		std::vector<uint8_t> cells;
+	};
+
+	Light ShadowedLight(int type, XMFLOAT3 position, float range)
+	{
+		Light light = {};
+		light.Type = type;
+		light.Position = position;
+		light.Direction = XMFLOAT3(0.0f, -1.0f, 0.2f);
+		light.Range = range;
+		light.Color = XMFLOAT3(1, 1, 1);
+		light.Intensity = 1.0f;
+		light.SpotInnerAngle = 0.3f;
+		light.SpotOuterAngle = 0.5f;
+		light.CastsShadows = 1;
+		return light;
+	}
+
+	// The tiles in the render views (every tile, with update periods
+	// off) match their lights' sizes and don't overlap
+	bool AtlasTilesDisjoint(const ShadowAtlas& atlas, size_t& tileCount)
+	{
+		AtlasCoverage coverage(atlas.GetAtlasSize(), ShadowAtlas::MinTileSize);
+		tileCount = 0;
+		bool disjoint = true;
+		for (const ShadowAtlasView& view : atlas.GetRenderViews())
+		{
+			disjoint &= view.tile.size == atlas.GetTileSize(view.light);
+			disjoint &= coverage.Mark(view.tile);
+			tileCount++;
+		}
+		return disjoint;
+	}
+}
+
+int RunShadowAtlasChecks()
+{
+	const unsigned int atlasSize = 4096;
+	printf("Shadow atlas checks: %u x %u atlas, tiles %u - %u\n",
+		atlasSize, atlasSize, ShadowAtlas::MinTileSize, ShadowAtlas::MaxTileSize);
+	int failures = 0;
+	char detail[256];
+
+	// Allocator churn ------------------------------------------------------------
+	{
+		ShadowAtlasAllocator allocator(atlasSize, ShadowAtlas::MinTileSize);
+		AtlasCoverage coverage(atlasSize, ShadowAtlas::MinTileSize);
+		std::vector<ShadowAtlasTile> live;
+		std::vector<ShadowAtlasTile> fragmentedLive;	// Live tiles when fragmentation last made one fail
+		std::mt19937 rng(21);
+
+		bool valid = true;
+		size_t liveArea = 0;
+		size_t failures_ = 0;
+		size_t fragmentedFailures = 0;
+		double fragmentationSum = 0.0;
+		float worstFragmentation = 0.0f;
+		const int steps = 20000;
+		for (int step = 0; step < steps; step++)
+		{
+			// Mostly allocate until about three quarters full, then even
+			bool allocate = live.empty() || (rng() % 100) < (liveArea * 4 < (size_t)atlasSize * atlasSize * 3 ? 70u : 45u);
+			if (allocate)
+			{
+				unsigned int size = ShadowAtlas::MinTileSize << (rng() % 5);	// 64 - 1024
+				ShadowAtlasTile tile = allocator.Allocate(size);
+				if (tile.IsValid())
+				{
+					valid &= tile.size == size && coverage.Mark(tile);
+					live.push_back(tile);
+					liveArea += (size_t)tile.size * tile.size;
+				}
+				else
+				{
+					failures_++;
+					if (allocator.GetFreeArea() >= (size_t)size * size)
+					{
+						fragmentedFailures++;
+						fragmentedLive = live;
+					}
+				}
+			}
+			else
+			{
+				size_t index = rng() % live.size();
+				coverage.Unmark(live[index]);
+				allocator.Free(live[index]);
+				liveArea -= (size_t)live[index].size * live[index].size;
+				live[index] = live.back();
+				live.pop_back();
+			}
+
+			valid &= allocator.GetFreeArea() + liveArea == (size_t)atlasSize * atlasSize;
+			valid &= allocator.GetAllocatedCount() == live.size();
+			fragmentationSum += allocator.GetFragmentation();
+			worstFragmentation = (std::max)(worstFragmentation, allocator.GetFragmentation());
+		}
+		snprintf(detail, sizeof(detail), "%d steps, %zu live tiles at the end", steps, live.size());
+		failures += ReportCheck("tiles never overlap, free area adds up", valid, detail);
+
+		printf("  fragmentation: %.1f%% average, %.1f%% worst; %zu failed allocations, %zu with enough free area\n",
+			fragmentationSum / steps * 100.0, worstFragmentation * 100.0f, failures_, fragmentedFailures);
+
+		for (const ShadowAtlasTile& tile : live)
+			allocator.Free(tile);
+		snprintf(detail, sizeof(detail), "largest free tile %u", allocator.GetLargestFreeTile());
+		failures += ReportCheck("freeing everything merges back",
+			allocator.GetLargestFreeTile() == atlasSize && allocator.GetFragmentation() == 0.0f && allocator.GetAllocatedCount() == 0, detail);
+
+		// Repack the state where fragmentation made an allocation fail
+		std::vector<ShadowAtlasTile>& repack = fragmentedLive.empty() ? live : fragmentedLive;
+		std::sort(repack.begin(), repack.end(), [](const ShadowAtlasTile& a, const ShadowAtlasTile& b) { return a.size > b.size; });
+		allocator.Reset();
+		AtlasCoverage repacked(atlasSize, ShadowAtlas::MinTileSize);
+		bool fits = true;
+		for (const ShadowAtlasTile& tile : repack)
+		{
+			ShadowAtlasTile packed = allocator.Allocate(tile.size);
+			fits &= packed.IsValid() && repacked.Mark(packed);
+		}
+
+		// Then the smallest size keeps fitting until there's no room for it
+		unsigned int smallest = repack.empty() ? ShadowAtlas::MinTileSize : repack.back().size;
+		while (allocator.Allocate(smallest).IsValid())
+			;
+		fits &= allocator.GetFreeArea() < (size_t)smallest * smallest;
+		snprintf(detail, sizeof(detail), "%zu tiles, then filled with %u", repack.size(), smallest);
+		failures += ReportCheck("repacking biggest first always fits", fits, detail);
+	}
+
+	// Light tiles ----------------------------------------------------------------
+	RecordingBackend backend;
+	{
+		ShadowAtlas atlas(backend, atlasSize);
+		XMFLOAT4X4 view;
+		XMFLOAT4X4 projection;
+		XMStoreFloat4x4(&view, XMMatrixLookToLH(XMVectorSet(0, 2, -10, 1), XMVectorSet(0, 0, 1, 0), XMVectorSet(0, 1, 0, 0)));
+		XMStoreFloat4x4(&projection, XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.1f, 200.0f));
+
+		// A directional light for the cascades, spots ever further away,
+		// a point light, and one behind the camera
+		std::vector<Light> lights;
+		Light sun = ShadowedLight(LIGHT_TYPE_DIRECTIONAL, XMFLOAT3(0, 0, 0), 0.0f);
+		lights.push_back(sun);
+		lights.push_back(ShadowedLight(LIGHT_TYPE_SPOT, XMFLOAT3(0, 4, -6), 8.0f));		// 1: camera inside its range
+		lights.push_back(ShadowedLight(LIGHT_TYPE_SPOT, XMFLOAT3(0, 4, 10), 8.0f));		// 2: 20 away
+		lights.push_back(ShadowedLight(LIGHT_TYPE_SPOT, XMFLOAT3(0, 4, 40), 8.0f));		// 3: 50 away
+		lights.push_back(ShadowedLight(LIGHT_TYPE_POINT, XMFLOAT3(3, 2, 5), 10.0f));		// 4
+		lights.push_back(ShadowedLight(LIGHT_TYPE_SPOT, XMFLOAT3(0, 2, -60), 8.0f));		// 5: behind
+		Light unshadowed = ShadowedLight(LIGHT_TYPE_POINT, XMFLOAT3(0, 2, 0), 10.0f);
+		unshadowed.CastsShadows = 0;
+		lights.push_back(unshadowed);													// 6
+
+		atlas.Update(lights, view, projection, 0);
+		atlas.Upload();
+		size_t tiles = 0;
+		bool disjoint = AtlasTilesDisjoint(atlas, tiles);
+
+		snprintf(detail, sizeof(detail), "sizes %u, %u, %u", atlas.GetTileSize(1), atlas.GetTileSize(2), atlas.GetTileSize(3));
+		failures += ReportCheck("nearer lights get bigger tiles",
+			atlas.GetTileSize(1) == ShadowAtlas::MaxTileSize && atlas.GetTileSize(1) > atlas.GetTileSize(2) && atlas.GetTileSize(2) > atlas.GetTileSize(3), detail);
+		failures += ReportCheck("point lights get six faces",
+			atlas.GetTileSize(4) > 0 && atlas.GetStats().tiles == 9 && tiles == 9 && disjoint, "");
+		failures += ReportCheck("no tile out of view, unshadowed or cascaded",
+			lights[5].ShadowIndex == LIGHT_SHADOW_NONE && lights[6].ShadowIndex == LIGHT_SHADOW_NONE &&
+			lights[0].ShadowIndex == LIGHT_SHADOW_CASCADES && atlas.GetStats().droppedLights == 1, "");
+
+		bool indices = lights[1].ShadowIndex == 1 && lights[2].ShadowIndex == 2 && lights[3].ShadowIndex == 3 && lights[4].ShadowIndex == 4;
+		failures += ReportCheck("shadow indices follow the tile list", indices, "");
+
+		// Redraw counts over 8 more frames
+		int renders[7] = {};
+		for (int frame = 0; frame < 8; frame++)
+		{
+			atlas.Update(lights, view, projection, 0);
+			for (const ShadowAtlasView& v : atlas.GetRenderViews())
+			{
+				if (v.face == 0)
+					renders[v.light]++;
+			}
+		}
+		snprintf(detail, sizeof(detail), "redraws in 8 frames: %d, %d, %d (periods %u, %u, %u)",
+			renders[1], renders[2], renders[3], atlas.GetUpdatePeriod(1), atlas.GetUpdatePeriod(2), atlas.GetUpdatePeriod(3));
+		failures += ReportCheck("distant lights redraw less often",
+			renders[1] == 8 && renders[1] > renders[2] && renders[2] > renders[3] &&
+			renders[3] == 8 / (int)atlas.GetUpdatePeriod(3), detail);
+
+		// A moved far light is redrawn on the next frame, whatever its period
+		bool movedRedrawn = true;
+		for (int frame = 0; frame < 4; frame++)
+		{
+			lights[3].Position.x += 0.1f;
+			atlas.Update(lights, view, projection, 0);
+			bool drawn = false;
+			for (const ShadowAtlasView& v : atlas.GetRenderViews())
+				drawn |= v.light == 3;
+			movedRedrawn &= drawn;
+		}
+		failures += ReportCheck("moved lights redraw right away", movedRedrawn, "");
+	}
+
+	// Oversubscribed ---------------------------------------------------------------
+	{
+		ShadowAtlas atlas(backend, atlasSize);
+		XMFLOAT4X4 view;
+		XMFLOAT4X4 projection;
+		XMStoreFloat4x4(&view, XMMatrixLookToLH(XMVectorSet(0, 2, -10, 1), XMVectorSet(0, 0, 1, 0), XMVectorSet(0, 1, 0, 0)));
+		XMStoreFloat4x4(&projection, XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.1f, 200.0f));
+
+		// More lights than even the smallest tiles fit, marching away from
+		// the camera so importance falls with index
+		std::vector<Light> lights;
+		for (int i = 0; i < 2000; i++)
+			lights.push_back(ShadowedLight(i % 3 == 0 ? LIGHT_TYPE_POINT : LIGHT_TYPE_SPOT, XMFLOAT3((float)(i % 5) - 2.0f, 2.0f, (float)i * 0.03f), 12.0f));
+
+		atlas.Update(lights, view, projection, -1);
+		size_t tiles = 0;
+		bool disjoint = AtlasTilesDisjoint(atlas, tiles);
+		const ShadowAtlasStats& stats = atlas.GetStats();
+
+		// Whoever got dropped mattered least
+		float worstKept = 1.0f;
+		float bestDropped = 0.0f;
+		XMFLOAT3 cameraPosition(0, 2, -10);
+		XMFLOAT4X4 viewProjection;
+		XMStoreFloat4x4(&viewProjection, XMMatrixMultiply(XMLoadFloat4x4(&view), XMLoadFloat4x4(&projection)));
+		Frustum frustum = Frustum::FromViewProjection(viewProjection);
+		for (size_t i = 0; i < lights.size(); i++)
+		{
+			float importance = ShadowAtlas::Importance(lights[i], cameraPosition, frustum);
+			if (atlas.GetTileSize(i) > 0)
+				worstKept = (std::min)(worstKept, importance);
+			else if (importance > 0.0f)
+				bestDropped = (std::max)(bestDropped, importance);
+		}
+
+		snprintf(detail, sizeof(detail), "%zu lights kept (%zu shrunk), %zu dropped, %.0f%% used",
+			stats.shadowedLights, stats.shrunkLights, stats.droppedLights, stats.usedArea * 100.0f);
+		failures += ReportCheck("oversubscribed drops least important",
+			disjoint && tiles == stats.tiles && stats.droppedLights > 0 && stats.shrunkLights > 0 && bestDropped <= worstKept, detail);
+
+		// Wander the camera so tile sizes keep changing, and check the
+		// tiles never overlap
+		bool churnDisjoint = true;
+		unsigned int repacks = 0;
+		for (int frame = 0; frame < 300; frame++)
+		{
+			float z = -10.0f + 140.0f * (0.5f - 0.5f * cosf(frame * 0.05f));
+			XMStoreFloat4x4(&view, XMMatrixLookToLH(XMVectorSet(0, 2, z, 1), XMVectorSet(0, 0, 1, 0), XMVectorSet(0, 1, 0, 0)));
+			atlas.SetUpdatePeriodsEnabled(false);	// Every tile in the views, so all get checked
+			atlas.Update(lights, view, projection, -1);
+			churnDisjoint &= AtlasTilesDisjoint(atlas, tiles) && tiles == atlas.GetStats().tiles;
+			repacks += atlas.GetStats().repacks;
+		}
+		snprintf(detail, sizeof(detail), "300 frames, %u repacks", repacks);
+		failures += ReportCheck("tiles stay disjoint as sizes change", churnDisjoint, detail);
+	}
+
+	printf("  validation errors: %zu\n", backend.GetErrorCount());
+	failures += ReportValidation(backend);
+	return ReportFailures(failures);
+}
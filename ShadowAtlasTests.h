@@ -0,0 +1,25 @@
+#pragma once
+
+// --------------------------------------------------------
+// Headless checks of the shadow atlas - no GPU.
+//
+// The allocator, under random allocate/free churn:
+//  - tiles never overlap or leave the atlas, and the free area
+//    adds up
+//  - freeing everything merges back into one tile
+//  - fragmentation over the churn, and how often an allocation
+//    failed with enough free area (printed)
+//  - repacking the live tiles biggest first always fits, and
+//    leaves no room unusable for the smallest of them
+//
+// The light tiles on top of it:
+//  - nearer lights get bigger tiles, out of view ones none,
+//    point lights six faces, the cascaded light none
+//  - distant lights redraw every 2nd / 4th frame, moved ones
+//    right away
+//  - an oversubscribed atlas shrinks and then drops the least
+//    important lights first, without tiles overlapping
+//
+// Prints each check, returns 0 if all passed.
+// --------------------------------------------------------
+int RunShadowAtlasChecks();
@@ -0,0 +1,209 @@
+#include "ShadowCache.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace DirectX;
+
+namespace
+{
+	ShadowRect Union(const ShadowRect& a, const ShadowRect& b)
+	{
+		return {
+			(std::min)(a.x0, b.x0), (std::min)(a.y0, b.y0),
+			(std::max)(a.x1, b.x1), (std::max)(a.y1, b.y1) };
+	}
+}
+
+ShadowCache::ShadowCache()
+{
+	for (unsigned int c = 0; c < ShadowCascades::CascadeCount; c++)
+	{
+		full[c] = true;
+		XMStoreFloat4x4(&cachedViewProjection[c], XMMatrixIdentity());
+	}
+}
+
+void ShadowCache::Invalidate()
+{
+	valid = false;
+}
+
+void ShadowCache::Update(RenderQuery& entities, const ShadowCascade* frameCascades, unsigned int frameCascadeCount, unsigned int frameResolution)
+{
+	frameCascadeCount = (std::min)(frameCascadeCount, ShadowCascades::CascadeCount);
+	if (frameCascadeCount != cascadeCount || frameResolution != resolution)
+		valid = false;
+
+	cascades = frameCascades;
+	cascadeCount = frameCascadeCount;
+	resolution = frameResolution;
+
+	stats = ShadowCacheStats();
+
+	// A cascade that moved has nothing worth keeping
+	for (unsigned int c = 0; c < cascadeCount; c++)
+	{
+		full[c] = !valid || memcmp(&cachedViewProjection[c], &cascades[c].viewProjection, sizeof(XMFLOAT4X4)) != 0;
+		cachedViewProjection[c] = cascades[c].viewProjection;
+		dirtyRects[c].clear();
+	}
+	valid = true;
+
+	// Static entities that went away leave their old shadow behind
+	const EntityStore& store = entities.GetStore();
+	tracked.resize((std::max)(tracked.size(), store.GetIdCapacity()));
+	for (size_t id = 0; id < tracked.size(); id++)
+	{
+		if (tracked[id].isStatic && !store.Has<RenderFlags>((EntityId)id))
+		{
+			AddDirty(tracked[id].bounds);
+			tracked[id] = TrackedEntity();
+			stats.changedStatic++;
+		}
+	}
+
+	for (EntityChunk* chunk : entities.GetChunks())
+	{
+		const EntityId* ids = chunk->GetEntities();
+		const Transform* transforms = chunk->GetColumn<Transform>();
+		const WorldBounds* bounds = chunk->GetColumn<WorldBounds>();
+		const MeshRef* meshes = chunk->GetColumn<MeshRef>();
+		const RenderFlags* flags = chunk->GetColumn<RenderFlags>();
+		for (uint32_t row = 0; row < chunk->GetCount(); row++)
+		{
+			TrackedEntity& t = tracked[ids[row]];
+			bool isStatic = flags[row].isStatic;
+			if (!isStatic && !t.isStatic)
+				continue;
+
+			unsigned int version = transforms[row].GetVersion();
+			MeshHandle mesh = meshes[row].mesh;
+			if (isStatic)
+				stats.staticEntities++;
+			if (isStatic && t.isStatic && t.version == version && t.mesh == mesh)
+				continue;
+
+			// Clear where it was, draw where it is now
+			stats.changedStatic++;
+			if (t.isStatic)
+				AddDirty(t.bounds);
+			if (isStatic)
+			{
+				t.bounds = bounds[row].box;
+				AddDirty(t.bounds);
+			}
+
+			t.isStatic = isStatic;
+			t.version = version;
+			t.mesh = mesh;
+		}
+	}
+
+	for (unsigned int c = 0; c < cascadeCount; c++)
+	{
+		if (full[c])
+		{
+			stats.fullRedraws++;
+			stats.dirtyTexels += (size_t)resolution * resolution;
+			continue;
+		}
+
+		stats.dirtyRects += (unsigned int)dirtyRects[c].size();
+		for (const ShadowRect& rect : dirtyRects[c])
+			stats.dirtyTexels += rect.Area();
+	}
+}
+
+void ShadowCache::AddDirty(const AABB& bounds)
+{
+	for (unsigned int c = 0; c < cascadeCount; c++)
+	{
+		if (full[c])
+			continue;
+
+		ShadowRect rect;
+		if (!ProjectBounds(cascades[c], resolution, bounds, rect))
+			continue;
+
+		std::vector<ShadowRect>& rects = dirtyRects[c];
+		if (rects.size() < MaxDirtyRects)
+		{
+			rects.push_back(rect);
+		}
+		else
+		{
+			// Out of rectangles - grow whichever one grows least
+			size_t best = 0;
+			int bestGrowth = INT32_MAX;
+			for (size_t r = 0; r < rects.size(); r++)
+			{
+				int growth = Union(rects[r], rect).Area() - rects[r].Area();
+				if (growth < bestGrowth)
+				{
+					bestGrowth = growth;
+					best = r;
+				}
+			}
+			rects[best] = Union(rects[best], rect);
+		}
+
+		// Mostly dirty anyway - one clear and draw beats many scissored ones
+		size_t area = 0;
+		for (const ShadowRect& r : rects)
+			area += r.Area();
+		if (area * 2 > (size_t)resolution * resolution)
+		{
+			full[c] = true;
+			rects.clear();
+		}
+	}
+}
+
+bool ShadowCache::NeedsStaticRedraw(unsigned int cascade, const AABB& bounds) const
+{
+	if (full[cascade])
+		return true;
+
+	const std::vector<ShadowRect>& rects = dirtyRects[cascade];
+	if (rects.empty())
+		return false;
+
+	ShadowRect rect;
+	if (!ProjectBounds(cascades[cascade], resolution, bounds, rect))
+		return false;
+
+	for (const ShadowRect& dirty : rects)
+	{
+		if (dirty.Overlaps(rect))
+			return true;
+	}
+	return false;
+}
+
+bool ShadowCache::ProjectBounds(const ShadowCascade& cascade, unsigned int resolution, const AABB& bounds, ShadowRect& rect)
+{
+	// Orthographic, so the box's center and extents map straight
+	// into clip space (like AABB::Transformed)
+	const XMFLOAT4X4& m = cascade.viewProjection;
+	const XMFLOAT3& c = bounds.center;
+	const XMFLOAT3& e = bounds.extents;
+
+	float cx = c.x * m._11 + c.y * m._21 + c.z * m._31 + m._41;
+	float cy = c.x * m._12 + c.y * m._22 + c.z * m._32 + m._42;
+	float ex = e.x * fabsf(m._11) + e.y * fabsf(m._21) + e.z * fabsf(m._31);
+	float ey = e.x * fabsf(m._12) + e.y * fabsf(m._22) + e.z * fabsf(m._32);
+
+	// Clip to texels - y flips, and a texel of padding covers the
+	// comparison filter's footprint
+	float half = resolution * 0.5f;
+	float size = (float)resolution;
+	auto texel = [size](float t) { return (int)(std::min)((std::max)(t, -1.0f), size + 1.0f); };
+
+	rect.x0 = (std::max)(texel(floorf((cx - ex + 1.0f) * half)) - 1, 0);
+	rect.x1 = (std::min)(texel(ceilf((cx + ex + 1.0f) * half)) + 1, (int)resolution);
+	rect.y0 = (std::max)(texel(floorf((1.0f - cy - ey) * half)) - 1, 0);
+	rect.y1 = (std::min)(texel(ceilf((1.0f - cy + ey) * half)) + 1, (int)resolution);
+	return rect.x0 < rect.x1 && rect.y0 < rect.y1;
+}
+
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <DirectXMath.h>
+#include "Bounds.h"
+#include "EntityComponents.h"
+#include "ShadowCascades.h"
+
+// --------------------------------------------------------
+// Part of a cascade's shadow map in texels, max exclusive
+// --------------------------------------------------------
+struct ShadowRect
+{
+	int x0, y0;
+	int x1, y1;
+
+	int Area() const { return (x1 - x0) * (y1 - y0); }
+	bool Overlaps(const ShadowRect& other) const
+	{
+		return x0 < other.x1 && other.x0 < x1 && y0 < other.y1 && other.y0 < y1;
+	}
+};
+
+// --------------------------------------------------------
+// Counts from the last Update()
+// --------------------------------------------------------
+struct ShadowCacheStats
+{
+	size_t staticEntities = 0;
+	size_t changedStatic = 0;		// Moved, added, removed or made dynamic
+	unsigned int fullRedraws = 0;	// Cascades whose static slice is redrawn from scratch
+	unsigned int dirtyRects = 0;	// Partial redraws over all cascades
+	size_t dirtyTexels = 0;
+};
+
+// --------------------------------------------------------
+// Decides which parts of the cached static shadow maps need
+// redrawing each frame.
+//
+// Each cascade has two depth slices:
+//  - the static casters alone, redrawn only when something
+//    invalidates them
+//  - the sampled map: a copy of the static slice with the
+//    dynamic casters drawn over it, every frame
+//
+// A cascade's whole static slice is redrawn when its matrices
+// changed (the camera moved a snap step, or the light turned)
+// or after Invalidate().  Otherwise a static entity that moved,
+// was added or removed, or stopped being static dirties the
+// light space rectangles its old and new bounds cover, and only
+// the static casters touching those get redrawn, scissored to
+// them.  With an orthographic light a caster only ever writes
+// the texels its bounds project to, so nothing outside can be
+// stale.
+//
+// Changes are found by Transform::GetVersion(), so an untouched
+// entity costs one compare per frame.  Entities are tracked by
+// id - Invalidate() after destroying one and creating another
+// before the next Update(), which may reuse the id.
+// --------------------------------------------------------
+class ShadowCache
+{
+public:
+	// Past this many rectangles a cascade merges them
+	static const unsigned int MaxDirtyRects = 8;
+
+	ShadowCache();
+
+	// Before PackConstants(), with the entities' world bounds current
+	void Update(RenderQuery& entities, const ShadowCascade* cascades, unsigned int cascadeCount, unsigned int resolution);
+
+	// Everything is redrawn next Update()
+	void Invalidate();
+
+	bool IsFullRedraw(unsigned int cascade) const { return full[cascade]; }
+	const std::vector<ShadowRect>& GetDirtyRects(unsigned int cascade) const { return dirtyRects[cascade]; }
+	bool NeedsStaticPass(unsigned int cascade) const { return full[cascade] || !dirtyRects[cascade].empty(); }
+
+	// Does a static caster with these world bounds need drawing into
+	// the static slice this frame?  Safe from several threads.
+	bool NeedsStaticRedraw(unsigned int cascade, const AABB& bounds) const;
+
+	// The texels of a cascade's map a world box covers, padded a
+	// texel for filtering.  False if it's off the map.
+	static bool ProjectBounds(const ShadowCascade& cascade, unsigned int resolution, const AABB& bounds, ShadowRect& rect);
+
+	const ShadowCacheStats& GetStats() const { return stats; }
+
+private:
+	// What a static entity looked like when it was last drawn
+	struct TrackedEntity
+	{
+		bool isStatic = false;
+		unsigned int version = 0;
+		MeshHandle mesh;
+		AABB bounds;
+	};
+
+	std::vector<TrackedEntity> tracked;		// By entity id
+
+	bool valid = false;
+	unsigned int resolution = 0;
+	unsigned int cascadeCount = 0;
+	const ShadowCascade* cascades = nullptr;
+	DirectX::XMFLOAT4X4 cachedViewProjection[ShadowCascades::CascadeCount];
+
+	bool full[ShadowCascades::CascadeCount];
+	std::vector<ShadowRect> dirtyRects[ShadowCascades::CascadeCount];
+
+	ShadowCacheStats stats;
+
+	void AddDirty(const AABB& bounds);
+};
@@ -0,0 +1,310 @@
+#include "ShadowCacheTests.h"
+#include "HeadlessTests.h"
+#include "RecordingBackend.h"
+#include "ConstantBufferRing.h"
+#include "SceneRenderer.h"
+#include "Mesh.h"
+#include "Material.h"
+#include "ResourceRegistry.h"
+#include "EntitySystems.h"
+#include "EntityStore.h"
+#include "JobSystem.h"
+#include "ShadowCascades.h"
+#include "ShadowCache.h"
+#include "FrameArena.h"
+
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+	// Every static entity's shadow in a cascade is inside one of its
+	// dirty rectangles (or the cascade is redrawn whole)
+	bool DirtyRectsCover(const ShadowCache& cache, const ShadowCascade* cascades, unsigned int resolution, const AABB& bounds)
+	{
+		for (unsigned int c = 0; c < ShadowCascades::CascadeCount; c++)
+		{
+			ShadowRect rect;
+			if (cache.IsFullRedraw(c) || !ShadowCache::ProjectBounds(cascades[c], resolution, bounds, rect))
+				continue;
+
+			bool covered = false;
+			for (const ShadowRect& dirty : cache.GetDirtyRects(c))
+			{
+				covered |= dirty.x0 <= rect.x0 && dirty.y0 <= rect.y0 &&
+					dirty.x1 >= rect.x1 && dirty.y1 >= rect.y1;
+			}
+			if (!covered)
+				return false;
+		}
+		return true;
+	}
+
+	// Straight from the mesh and transform, not the WorldBounds
+	// component the systems keep
+	AABB EntityBounds(EntityStore& store, const ResourceRegistry& resources, EntityId entity)
+	{
+		const Mesh* mesh = resources.Get(store.Get<MeshRef>(entity).mesh);
+		return mesh->GetLocalBounds().Transformed(store.Get<Transform>(entity).GetWorldMatrix());
+	}
+}
+
+int RunShadowCacheChecks()
+{
+	const unsigned int resolution = 1024;
+	const unsigned int snapTexels = 16;
+	const int side = 24;		// side x side static cubes
+	const int dynamicCount = 8;
+
+	printf("Shadow cache checks: %d static and %d dynamic entities, %u x %u, %u texel snap\n",
+		side * side, dynamicCount, resolution, resolution, snapTexels);
+	int failures = 0;
+	char detail[256];
+
+	// Declared first so it outlives everything holding its handles
+	RecordingBackend backend;
+	{
+		ConstantBufferRing constantRing(backend, backend.CreateFence());
+		JobSystem jobSystem(0);
+		FrameArena frameArena;
+		SceneRenderer sceneRenderer(constantRing, jobSystem, frameArena);
+		ResourceRegistry resources(backend, backend.CreateFence());
+
+		MeshHandle cube = CreateBenchCube(resources, backend);
+		ShaderHandle vs = backend.CreateShader(ShaderStage::Vertex, fakeBytecode, sizeof(fakeBytecode));
+		ShaderHandle ps = backend.CreateShader(ShaderStage::Pixel, fakeBytecode, sizeof(fakeBytecode));
+		MaterialHandle material = resources.Create<Material>(XMFLOAT4(1, 1, 1, 1), vs, ps);
+
+		// Static cubes on a grid, dynamic ones floating above it
+		EntityStore store;
+		for (int i = 0; i < side * side; i++)
+		{
+			EntityId entity = CreateRenderEntity(store, cube, material,
+				XMFLOAT3((float)(i % side) * 2.0f - side, 0.0f, (float)(i / side) * 2.0f - side));
+			store.Get<RenderFlags>(entity).isStatic = true;
+		}
+		for (int i = 0; i < dynamicCount; i++)
+			CreateRenderEntity(store, cube, material, XMFLOAT3((float)i * 3.0f - 12.0f, 3.0f, 0.0f));
+		const EntityId firstDynamic = (EntityId)(side * side);
+		RenderQuery entities(store);
+		BoundsQuery boundedEntities(store);
+
+		XMFLOAT4X4 projection;
+		XMStoreFloat4x4(&projection, XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.1f, 200.0f));
+		XMFLOAT3 cameraPosition(0.0f, 6.0f, -30.0f);
+		XMFLOAT3 lightDirection(1.0f, -1.0f, 0.3f);
+
+		ShadowCascades cascades(resolution);
+		cascades.SetSnapTexels(snapTexels);
+		cascades.SetShadowDistance(60.0f);
+		ShadowCache cache;
+
+		// One frame: fit the cascades, update the cache, pack the passes
+		auto runFrame = [&]()
+		{
+			frameArena.BeginFrame();
+			SceneFrameData frame = {};
+			XMStoreFloat4x4(&frame.view, XMMatrixLookToLH(XMLoadFloat3(&cameraPosition), XMVectorSet(0, -0.3f, 1, 0), XMVectorSet(0, 1, 0, 0)));
+			frame.projection = projection;
+			frame.cameraPosition = cameraPosition;
+
+			UpdateWorldBounds(boundedEntities, resources, jobSystem);
+			cascades.Update(frame.view, frame.projection, lightDirection);
+			cache.Update(entities, cascades.GetCascades(), ShadowCascades::CascadeCount, resolution);
+
+			ShadowCascadeShaderData shadowData = cascades.GetShaderData();
+			frame.shadowCascades = cascades.GetCascades();
+			frame.shadowCascadeCount = ShadowCascades::CascadeCount;
+			frame.shadows = &shadowData;
+			frame.shadowCache = &cache;
+
+			backend.ResetFrame();
+			constantRing.BeginFrame();
+			sceneRenderer.PackConstants(entities, resources, frame);
+			constantRing.Unmap();
+			constantRing.EndFrame();
+			return sceneRenderer.GetStats();
+		};
+
+		// Static casters in each cascade's frustum, all of which a full
+		// redraw has to draw
+		auto staticCasterCount = [&]()
+		{
+			size_t count = 0;
+			for (EntityId i = 0; i < store.GetIdCapacity(); i++)
+			{
+				if (!store.IsAlive(i) || !store.Get<RenderFlags>(i).isStatic)
+					continue;
+				AABB bounds = EntityBounds(store, resources, i);
+				for (unsigned int c = 0; c < ShadowCascades::CascadeCount; c++)
+					count += cascades.GetCascade(c).casterFrustum.Intersects(bounds) ? 1 : 0;
+			}
+			return count;
+		};
+
+		auto moveDynamic = [&](float t)
+		{
+			for (EntityId i = firstDynamic; i < store.GetIdCapacity(); i++)
+				store.Get<Transform>(i).SetPosition((float)(i - firstDynamic) * 3.0f - 12.0f, 3.0f + sinf(t + i), cosf(t * 2.0f + i));
+		};
+
+		// First frame ----------------------------------------------------------
+		SceneRenderStats stats = runFrame();
+		size_t allStatic = staticCasterCount();
+		snprintf(detail, sizeof(detail), "%u full redraws, %zu of %zu static casters drawn",
+			cache.GetStats().fullRedraws, stats.cachedShadowCasters, allStatic);
+		failures += ReportCheck("first frame redraws everything",
+			cache.GetStats().fullRedraws == ShadowCascades::CascadeCount && stats.cachedShadowCasters == allStatic, detail);
+
+		// Only dynamic entities moving -----------------------------------------
+		size_t redrawn = 0;
+		size_t dynamicDrawn = 0;
+		unsigned int rects = 0;
+		for (int f = 0; f < 10; f++)
+		{
+			moveDynamic(f * 0.1f);
+			stats = runFrame();
+			redrawn += stats.cachedShadowCasters + cache.GetStats().fullRedraws;
+			rects += cache.GetStats().dirtyRects;
+			dynamicDrawn += stats.shadowCasters - stats.cachedShadowCasters;
+		}
+		snprintf(detail, sizeof(detail), "%zu static redrawn, %u rects, %zu dynamic drawn", redrawn, rects, dynamicDrawn);
+		failures += ReportCheck("dynamic movement keeps the cache", redrawn == 0 && rects == 0 && dynamicDrawn > 0, detail);
+
+		// One static entity moves ----------------------------------------------
+		{
+			EntityId moved = side * (side / 2) + side / 2;
+			AABB oldBounds = EntityBounds(store, resources, moved);
+			store.Get<Transform>(moved).MoveAbsolute(1.5f, 0.0f, 0.5f);
+			AABB newBounds = EntityBounds(store, resources, moved);
+			stats = runFrame();
+
+			const ShadowCacheStats& cacheStats = cache.GetStats();
+			bool covered = DirtyRectsCover(cache, cascades.GetCascades(), resolution, oldBounds) &&
+				DirtyRectsCover(cache, cascades.GetCascades(), resolution, newBounds);
+
+			// Every static caster whose shadow touches a rectangle, and no other
+			size_t expected = 0;
+			for (EntityId i = 0; i < firstDynamic; i++)
+			{
+				AABB bounds = EntityBounds(store, resources, i);
+				for (unsigned int c = 0; c < ShadowCascades::CascadeCount; c++)
+				{
+					ShadowRect rect;
+					if (!cascades.GetCascade(c).casterFrustum.Intersects(bounds) ||
+						!ShadowCache::ProjectBounds(cascades.GetCascade(c), resolution, bounds, rect))
+						continue;
+					for (const ShadowRect& dirty : cache.GetDirtyRects(c))
+					{
+						if (dirty.Overlaps(rect))
+						{
+							expected++;
+							break;
+						}
+					}
+				}
+			}
+
+			snprintf(detail, sizeof(detail), "%u rects, %zu texels, %zu of %zu static casters redrawn",
+				cacheStats.dirtyRects, cacheStats.dirtyTexels, stats.cachedShadowCasters, allStatic);
+			failures += ReportCheck("moved static entity dirties its shadows",
+				cacheStats.changedStatic == 1 && cacheStats.fullRedraws == 0 && cacheStats.dirtyRects > 0 && covered, detail);
+			failures += ReportCheck("only casters in dirty rects are redrawn",
+				stats.cachedShadowCasters == expected && expected > 0 && expected < allStatic / 10, "");
+
+			stats = runFrame();
+			failures += ReportCheck("next frame is clean again",
+				cache.GetStats().dirtyRects == 0 && stats.cachedShadowCasters == 0, "");
+		}
+
+		// Camera and light -----------------------------------------------------
+		{
+			// Panning one snap step of the finest cascade in small moves
+			// crosses at most one snap boundary per light space axis
+			float step = cascades.GetCascade(0).texelSize * snapTexels;
+			unsigned int panRedraws = 0;
+			for (int f = 0; f < 32; f++)
+			{
+				cameraPosition.x += step / 32.0f;
+				runFrame();
+				panRedraws += cache.GetStats().fullRedraws;
+			}
+
+			// A few snap steps of the widest cascade moves all of them
+			cameraPosition.x += cascades.GetCascade(ShadowCascades::CascadeCount - 1).texelSize * snapTexels * 3.0f;
+			runFrame();
+			unsigned int bigMove = cache.GetStats().fullRedraws;
+
+			snprintf(detail, sizeof(detail), "%u redraws over 32 small moves, %u after a big one", panRedraws, bigMove);
+			failures += ReportCheck("cascades redraw only when they snap",
+				panRedraws <= 3 * ShadowCascades::CascadeCount && bigMove == ShadowCascades::CascadeCount, detail);
+
+			lightDirection.z += 0.05f;
+			runFrame();
+			failures += ReportCheck("turned light redraws everything", cache.GetStats().fullRedraws == ShadowCascades::CascadeCount, "");
+		}
+
+		// Leaving the static set -----------------------------------------------
+		{
+			EntityId entity = side * 3 + side / 2;
+			AABB bounds = EntityBounds(store, resources, entity);
+			store.Get<RenderFlags>(entity).isStatic = false;
+			runFrame();
+			failures += ReportCheck("made dynamic dirties its shadow",
+				cache.GetStats().changedStatic == 1 && cache.GetStats().dirtyRects > 0 &&
+				DirtyRectsCover(cache, cascades.GetCascades(), resolution, bounds), "");
+			store.Get<RenderFlags>(entity).isStatic = true;
+			runFrame();
+
+			// Destroying moves another entity into its row - the cache
+			// tracks by id, so only the destroyed one's shadow changes
+			EntityId removed = side * 5 + side / 2;
+			bounds = EntityBounds(store, resources, removed);
+			store.Destroy(removed);
+			runFrame();
+			failures += ReportCheck("removed entity dirties its shadow",
+				cache.GetStats().changedStatic == 1 && cache.GetStats().fullRedraws == 0 &&
+				DirtyRectsCover(cache, cascades.GetCascades(), resolution, bounds), "");
+		}
+
+		// Many changes -----------------------------------------------------------
+		{
+			std::vector<AABB> moved;
+			for (int i = 0; i < 20; i++)
+			{
+				EntityId entity = (EntityId)((i * 53) % firstDynamic);
+				if (!store.IsAlive(entity) || !store.Get<RenderFlags>(entity).isStatic)
+					continue;
+				moved.push_back(EntityBounds(store, resources, entity));
+				store.Get<Transform>(entity).MoveAbsolute(0.0f, 0.25f, 0.0f);
+				moved.push_back(EntityBounds(store, resources, entity));
+			}
+			runFrame();
+
+			bool bounded = true;
+			bool covered = true;
+			for (unsigned int c = 0; c < ShadowCascades::CascadeCount; c++)
+				bounded &= cache.GetDirtyRects(c).size() <= ShadowCache::MaxDirtyRects;
+			for (const AABB& bounds : moved)
+				covered &= DirtyRectsCover(cache, cascades.GetCascades(), resolution, bounds);
+			snprintf(detail, sizeof(detail), "%u rects, %u full redraws", cache.GetStats().dirtyRects, cache.GetStats().fullRedraws);
+			failures += ReportCheck("many changes merge into few rects", bounded && covered, detail);
+
+			for (EntityId i = 0; i < firstDynamic; i++)
+			{
+				if (store.IsAlive(i))
+					store.Get<Transform>(i).MoveAbsolute(0.0f, 0.25f, 0.0f);
+			}
+			runFrame();
+			snprintf(detail, sizeof(detail), "%u full redraws", cache.GetStats().fullRedraws);
+			failures += ReportCheck("mostly dirty redraws whole cascades", cache.GetStats().fullRedraws > 0, detail);
+		}
+	}
+
+	printf("  validation errors: %zu\n", backend.GetErrorCount());
+	failures += ReportValidation(backend);
+	return ReportFailures(failures);
+}
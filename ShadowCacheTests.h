@@ -0,0 +1,25 @@
+#pragma once
+
+// --------------------------------------------------------
+// Headless checks of the static shadow cache's invalidation -
+// no GPU, the cache only decides what gets redrawn.
+//
+// A field of static cubes plus a few animated ones, under
+// cascades snapped in cache-sized steps:
+//  - the first frame redraws everything
+//  - with only dynamic entities moving nothing static is
+//    redrawn, and the dynamic casters are still drawn
+//  - moving one static entity dirties rectangles covering its
+//    old and new shadows, and redraws only the static casters
+//    touching them
+//  - small camera moves keep the cache, a full snap step or a
+//    turned light redraws the whole cascade
+//  - making an entity dynamic or removing it dirties its old
+//    shadow
+//  - many changes merge into at most MaxDirtyRects rectangles,
+//    and changing most of the map redraws it whole
+//
+// Prints each check and the redraw counters, returns 0 if all
+// passed.
+// --------------------------------------------------------
+int RunShadowCacheChecks();
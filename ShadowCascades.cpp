@@ -0,0 +1,266 @@
+#include "ShadowCascades.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+using namespace DirectX;
+
+namespace
+{
+	static_assert(sizeof(ShadowCascadeShaderData::cascadeViewProjection) / sizeof(XMFLOAT4X4) == ShadowCascades::CascadeCount,
+		"ShadowCascadeShaderData has room for a different number of cascades");
+}
+
+ShadowCascades::ShadowCascades(unsigned int resolution)
+	: resolution((std::max)(resolution, 4u))
+{
+	for (ShadowCascade& cascade : cascades)
+		cascade = {};
+}
+
+void ShadowCascades::SetSnapTexels(unsigned int texels)
+{
+	// The padding below eats two steps of the map
+	snapTexels = (std::min)((std::max)(texels, 1u), resolution / 4);
+}
+
+void ShadowCascades::ComputeSplits(float nearZ, float farZ, float lambda, float splits[CascadeCount + 1])
+{
+	splits[0] = nearZ;
+	for (unsigned int i = 1; i < CascadeCount; i++)
+	{
+		float t = (float)i / CascadeCount;
+		float logSplit = nearZ * powf(farZ / nearZ, t);
+		float uniformSplit = nearZ + (farZ - nearZ) * t;
+		splits[i] = lambda * logSplit + (1.0f - lambda) * uniformSplit;
+	}
+	splits[CascadeCount] = farZ;
+}
+
+void ShadowCascades::Update(const XMFLOAT4X4& cameraView, const XMFLOAT4X4& cameraProjection, const XMFLOAT3& lightDirection,
+	const AABB* sceneBounds, size_t sceneBoundsCount)
+{
+	// Near/far and the frustum's slope back out of the projection
+	// (XMMatrixPerspectiveFovLH: _33 = f / (f - n), _43 = -n * _33)
+	float cameraNear = -cameraProjection._43 / cameraProjection._33;
+	float cameraFar = cameraProjection._43 / (1.0f - cameraProjection._33);
+	float tanX = 1.0f / cameraProjection._11;
+	float tanY = 1.0f / cameraProjection._22;
+	float slopeSq = tanX * tanX + tanY * tanY;	// Squared distance of a corner from the view axis, per unit depth
+
+	float splits[CascadeCount + 1];
+	ComputeSplits(cameraNear, (std::min)(cameraFar, (std::max)(shadowDistance, cameraNear * 2.0f)), splitLambda, splits);
+
+	XMMATRIX inverseView = XMMatrixInverse(nullptr, XMLoadFloat4x4(&cameraView));
+
+	// The light's rotation is the same every frame, so snapping in its
+	// space is consistent from one frame to the next
+	XMVECTOR dir = XMVector3Normalize(XMLoadFloat3(&lightDirection));
+	XMVECTOR up = fabsf(XMVectorGetY(dir)) > 0.99f ? XMVectorSet(0, 0, 1, 0) : XMVectorSet(0, 1, 0, 0);
+	XMMATRIX lightRotation = XMMatrixLookToLH(XMVectorZero(), dir, up);
+	XMMATRIX inverseLightRotation = XMMatrixTranspose(lightRotation);
+
+	if (!sceneBounds)
+		sceneBoundsCount = 0;
+	lightBounds.resize(sceneBoundsCount);
+	if (sceneBoundsCount > 0)
+	{
+		XMFLOAT4X4 toLight;
+		XMStoreFloat4x4(&toLight, lightRotation);
+		for (size_t i = 0; i < sceneBoundsCount; i++)
+			lightBounds[i] = sceneBounds[i].Transformed(toLight);
+	}
+
+	for (unsigned int i = 0; i < CascadeCount; i++)
+	{
+		ShadowCascade& cascade = cascades[i];
+		float n = splits[i];
+		float f = splits[i + 1];
+
+		// Smallest sphere through both ends of the slice has its center
+		// on the view axis, where the near and far corners are equally
+		// far away - unless that's past the far end, then the far
+		// corners alone decide
+		float centerZ = (f + n) * (1.0f + slopeSq) * 0.5f;
+		float radius;
+		if (centerZ >= f)
+		{
+			centerZ = f;
+			radius = f * sqrtf(slopeSq);
+		}
+		else
+		{
+			radius = sqrtf((centerZ - n) * (centerZ - n) + n * n * slopeSq);
+		}
+
+		// Grow by a snap step on each side so snapping can't push the
+		// slice's edge out of the map
+		radius *= (float)resolution / (float)(resolution - 2 * snapTexels);
+		float texelSize = 2.0f * radius / (float)resolution;
+		float snapSize = texelSize * snapTexels;
+
+		XMVECTOR center = XMVector3TransformCoord(XMVectorSet(0, 0, centerZ, 1), inverseView);
+		XMFLOAT3 lightCenter;
+		XMStoreFloat3(&lightCenter, XMVector3TransformCoord(center, lightRotation));
+		if (texelSnapping)
+		{
+			lightCenter.x = floorf(lightCenter.x / snapSize) * snapSize;
+			lightCenter.y = floorf(lightCenter.y / snapSize) * snapSize;
+			lightCenter.z = floorf(lightCenter.z / snapSize) * snapSize;
+		}
+
+		// Translate in light space directly rather than through a look-at,
+		// so the snapped offset lands in the matrix unchanged.  The near
+		// plane is the sphere's edge facing the light.
+		XMMATRIX view = XMMatrixMultiply(lightRotation, XMMatrixTranslation(-lightCenter.x, -lightCenter.y, radius - lightCenter.z));
+		XMMATRIX projection = XMMatrixOrthographicLH(2.0f * radius, 2.0f * radius, 0.0f, 2.0f * radius);
+		cascade.depthRange = 2.0f * radius;
+		cascade.receivers = 0;
+
+		if (sceneBoundsCount > 0)
+		{
+			// The slice as its own frustum (XMMatrixPerspectiveFovLH with
+			// n and f swapped in), and its corners' box in light space
+			XMFLOAT4X4 sliceProjection = cameraProjection;
+			sliceProjection._33 = f / (f - n);
+			sliceProjection._43 = -n * sliceProjection._33;
+			XMFLOAT4X4 sliceViewProjection;
+			XMStoreFloat4x4(&sliceViewProjection, XMMatrixMultiply(XMLoadFloat4x4(&cameraView), XMLoadFloat4x4(&sliceProjection)));
+			Frustum slice = Frustum::FromViewProjection(sliceViewProjection);
+
+			XMVECTOR sliceMin = XMVectorReplicate(FLT_MAX);
+			XMVECTOR sliceMax = XMVectorReplicate(-FLT_MAX);
+			XMMATRIX viewToLight = XMMatrixMultiply(inverseView, lightRotation);
+			for (int corner = 0; corner < 8; corner++)
+			{
+				float z = (corner & 4) ? f : n;
+				XMVECTOR p = XMVector3TransformCoord(XMVectorSet(
+					(corner & 1 ? 1.0f : -1.0f) * z * tanX,
+					(corner & 2 ? 1.0f : -1.0f) * z * tanY,
+					z,
+					1.0f), viewToLight);
+				sliceMin = XMVectorMin(sliceMin, p);
+				sliceMax = XMVectorMax(sliceMax, p);
+			}
+			XMFLOAT3 sliceLightMin;
+			XMFLOAT3 sliceLightMax;
+			XMStoreFloat3(&sliceLightMin, sliceMin);
+			XMStoreFloat3(&sliceLightMax, sliceMax);
+
+			XMFLOAT3 boxMin(lightCenter.x - radius, lightCenter.y - radius, lightCenter.z - radius);
+			XMFLOAT3 boxMax(lightCenter.x + radius, lightCenter.y + radius, lightCenter.z + radius);
+			cascade.receivers = FitToScene(sceneBounds, sceneBoundsCount, slice, sliceLightMin, sliceLightMax, radius, boxMin, boxMax);
+			if (cascade.receivers > 0)
+			{
+				float width = boxMax.x - boxMin.x;
+				float height = boxMax.y - boxMin.y;
+				view = XMMatrixMultiply(lightRotation, XMMatrixTranslation(
+					-(boxMin.x + width * 0.5f),
+					-(boxMin.y + height * 0.5f),
+					-boxMin.z));
+				projection = XMMatrixOrthographicLH(width, height, 0.0f, boxMax.z - boxMin.z);
+				texelSize = (std::max)(width, height) / (float)resolution;
+				cascade.depthRange = boxMax.z - boxMin.z;
+			}
+		}
+
+		XMStoreFloat4x4(&cascade.view, view);
+		XMStoreFloat4x4(&cascade.projection, projection);
+		XMStoreFloat4x4(&cascade.viewProjection, XMMatrixMultiply(view, projection));
+
+		cascade.casterFrustum = Frustum::FromViewProjection(cascade.viewProjection);
+		cascade.casterFrustum.planes[4] = XMFLOAT4(0, 0, 0, 1);	// Near plane: everything passes
+
+		cascade.nearZ = n;
+		cascade.farZ = f;
+		XMStoreFloat3(&cascade.center, XMVector3TransformCoord(XMLoadFloat3(&lightCenter), inverseLightRotation));
+		cascade.radius = radius;
+		cascade.texelSize = texelSize;
+	}
+}
+
+unsigned int ShadowCascades::FitToScene(const AABB* sceneBounds, size_t sceneBoundsCount, const Frustum& slice,
+	const XMFLOAT3& sliceMin, const XMFLOAT3& sliceMax, float radius,
+	XMFLOAT3& boxMin, XMFLOAT3& boxMax)
+{
+	// Receivers: whatever is in the slice, clipped to its box
+	XMFLOAT3 receiverMin(FLT_MAX, FLT_MAX, FLT_MAX);
+	XMFLOAT3 receiverMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	unsigned int receivers = 0;
+	for (size_t i = 0; i < sceneBoundsCount; i++)
+	{
+		if (!slice.Intersects(sceneBounds[i]))
+			continue;
+
+		const AABB& b = lightBounds[i];
+		XMFLOAT3 lo(
+			(std::max)(b.center.x - b.extents.x, sliceMin.x),
+			(std::max)(b.center.y - b.extents.y, sliceMin.y),
+			(std::max)(b.center.z - b.extents.z, sliceMin.z));
+		XMFLOAT3 hi(
+			(std::min)(b.center.x + b.extents.x, sliceMax.x),
+			(std::min)(b.center.y + b.extents.y, sliceMax.y),
+			(std::min)(b.center.z + b.extents.z, sliceMax.z));
+		if (lo.x > hi.x || lo.y > hi.y || lo.z > hi.z)
+			continue;	// The frustum test is conservative near corners
+
+		receiverMin = XMFLOAT3((std::min)(receiverMin.x, lo.x), (std::min)(receiverMin.y, lo.y), (std::min)(receiverMin.z, lo.z));
+		receiverMax = XMFLOAT3((std::max)(receiverMax.x, hi.x), (std::max)(receiverMax.y, hi.y), (std::max)(receiverMax.z, hi.z));
+		receivers++;
+	}
+	if (receivers == 0)
+		return 0;
+
+	// Sideways: sizes in whole steps, padded by a snap step on each side
+	// like the sphere, and the corner snapped to whole snap steps.  An
+	// axis that needs the whole sphere keeps it.
+	float step = 2.0f * radius / (float)FitSteps;
+	float padding = (float)resolution / (float)(resolution - 2 * snapTexels);
+	float* fitMin[2] = { &boxMin.x, &boxMin.y };
+	float* fitMax[2] = { &boxMax.x, &boxMax.y };
+	const float receiverLow[2] = { receiverMin.x, receiverMin.y };
+	const float receiverHigh[2] = { receiverMax.x, receiverMax.y };
+	for (int axis = 0; axis < 2; axis++)
+	{
+		float size = (std::max)(ceilf((receiverHigh[axis] - receiverLow[axis]) / step), 1.0f) * step * padding;
+		if (size >= 2.0f * radius)
+			continue;
+
+		float snapSize = size / (float)resolution * snapTexels;
+		if (texelSnapping)
+			*fitMin[axis] = floorf(receiverLow[axis] / snapSize) * snapSize;
+		else
+			*fitMin[axis] = (receiverLow[axis] + receiverHigh[axis] - size) * 0.5f;
+		*fitMax[axis] = *fitMin[axis] + size;
+	}
+
+	// Depth: from the nearest caster over the receivers to the farthest
+	// receiver - anything past that shadows nothing visible
+	float casterMin = receiverMin.z;
+	for (const AABB& b : lightBounds)
+	{
+		if (b.center.x + b.extents.x < boxMin.x || b.center.x - b.extents.x > boxMax.x ||
+			b.center.y + b.extents.y < boxMin.y || b.center.y - b.extents.y > boxMax.y ||
+			b.center.z - b.extents.z > receiverMax.z)
+			continue;
+		casterMin = (std::min)(casterMin, b.center.z - b.extents.z);
+	}
+	boxMin.z = (std::max)(floorf(casterMin / step) * step, boxMin.z);
+	boxMax.z = (std::min)(ceilf(receiverMax.z / step) * step, boxMax.z);
+	boxMax.z = (std::max)(boxMax.z, boxMin.z + step);
+	return receivers;
+}
+
+ShadowCascadeShaderData ShadowCascades::GetShaderData() const
+{
+	ShadowCascadeShaderData data = {};
+	float* splits = &data.cascadeSplits.x;
+	for (unsigned int i = 0; i < CascadeCount; i++)
+	{
+		data.cascadeViewProjection[i] = cascades[i].viewProjection;
+		splits[i] = cascades[i].farZ;
+	}
+	data.cascadeCount = CascadeCount;
+	data.texelSize = 1.0f / (float)resolution;
+	return data;
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <vector>
+#include <DirectXMath.h>
+#include "Bounds.h"
+#include "BufferStructs.h"
+
+// --------------------------------------------------------
+// One cascade: the light matrices that render it and the
+// slice of the camera's view it covers
+// --------------------------------------------------------
+struct ShadowCascade
+{
+	DirectX::XMFLOAT4X4 view;
+	DirectX::XMFLOAT4X4 projection;
+	DirectX::XMFLOAT4X4 viewProjection;
+
+	// The light frustum without its near plane - anything between
+	// the light and the cascade can cast into it (the shadow
+	// rasterizer clamps depth instead of clipping)
+	Frustum casterFrustum;
+
+	float nearZ;					// View space depth range covered
+	float farZ;
+	DirectX::XMFLOAT3 center;		// World space bounding sphere of the slice, after snapping
+	float radius;
+	float texelSize;				// World units per shadow map texel (the longer side when fitted)
+	float depthRange;				// Light space depth the map spans
+	unsigned int receivers;			// Scene bounds it was fitted to, 0 = the whole sphere
+};
+
+// --------------------------------------------------------
+// Cascaded shadow maps for one directional light, fitted to
+// the camera's frustum every frame.
+//
+// The camera's depth range (up to the shadow distance) is split
+// with the practical split scheme: a blend of logarithmic splits
+// (even texel density per depth) and uniform splits (which
+// don't waste the first cascade on the first few centimeters).
+//
+// Each cascade is an orthographic projection around the
+// smallest sphere holding its slice of the frustum.  The sphere
+// only depends on the split distances and the field of view, so
+// its size never changes as the camera turns, and its center is
+// snapped to whole shadow map texels in light space (depth too),
+// so moving the camera slides the shadow map in whole texels.
+// Together that stops shadow edges from shimmering, and a
+// cascade's matrices stay exactly the same until the camera has
+// moved a full snap step.
+//
+// Given the scene's bounds, each cascade is fitted tighter:
+// sideways to the receivers in its slice (clipped to the slice),
+// and in depth from the nearest caster over them to the farthest
+// receiver.  Casters nearer the light than the sphere are left to
+// the rasterizer's depth clamp, as before.  Fitted sizes and
+// depths move in steps of 1/FitSteps of the sphere, so the texel
+// size only changes when the receivers grow or shrink by a step,
+// and the position still snaps to whole texels - small camera
+// moves keep the matrices.  With no receivers in a slice the
+// cascade keeps its sphere.
+//
+// Only math - the caller owns the depth texture array and the
+// passes that render into it.  Assumes a symmetric perspective
+// projection, which is what Camera makes.
+// --------------------------------------------------------
+class ShadowCascades
+{
+public:
+	static constexpr unsigned int CascadeCount = 4;
+	static const unsigned int FitSteps = 16;
+
+	explicit ShadowCascades(unsigned int resolution = 1024);
+
+	// 0 = uniform splits, 1 = logarithmic
+	void SetSplitLambda(float lambda) { splitLambda = lambda; }
+
+	// Shadows end here, or at the camera's far plane if that's closer
+	void SetShadowDistance(float distance) { shadowDistance = distance; }
+
+	// Off only to see what it fixes
+	void SetTexelSnapping(bool enabled) { texelSnapping = enabled; }
+
+	// Snap in steps of this many texels.  Bigger steps move the
+	// cascades less often, which is what a shadow cache wants, for
+	// a few texels of resolution at the edges.
+	void SetSnapTexels(unsigned int texels);
+
+	// World space bounds of everything that casts or receives, or
+	// none to cover each slice's whole sphere
+	void Update(const DirectX::XMFLOAT4X4& cameraView, const DirectX::XMFLOAT4X4& cameraProjection, const DirectX::XMFLOAT3& lightDirection,
+		const AABB* sceneBounds = nullptr, size_t sceneBoundsCount = 0);
+
+	// CascadeCount + 1 view depths: splits[i] to splits[i + 1] is
+	// cascade i
+	static void ComputeSplits(float nearZ, float farZ, float lambda, float splits[CascadeCount + 1]);
+
+	const ShadowCascade& GetCascade(unsigned int index) const { return cascades[index]; }
+	const ShadowCascade* GetCascades() const { return cascades; }
+	unsigned int GetResolution() const { return resolution; }
+	float GetSplitLambda() const { return splitLambda; }
+	float GetShadowDistance() const { return shadowDistance; }
+
+	// Matrices and split depths for the pixel shader
+	ShadowCascadeShaderData GetShaderData() const;
+
+private:
+	unsigned int resolution;
+	float splitLambda = 0.75f;
+	float shadowDistance = 60.0f;
+	bool texelSnapping = true;
+	unsigned int snapTexels = 1;
+
+	ShadowCascade cascades[CascadeCount];
+	std::vector<AABB> lightBounds;		// Scene bounds in light space, scratch
+
+	// Shrinks a cascade's light space box to the scene, returns the
+	// number of receivers it was fitted to
+	unsigned int FitToScene(const AABB* sceneBounds, size_t sceneBoundsCount, const Frustum& slice,
+		const DirectX::XMFLOAT3& sliceMin, const DirectX::XMFLOAT3& sliceMax, float radius,
+		DirectX::XMFLOAT3& boxMin, DirectX::XMFLOAT3& boxMax);
+};
@@ -0,0 +1,384 @@
+#include "ShadowCascadesTests.h"
+#include "HeadlessTests.h"
+#include "ShadowCascades.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+	// Where a world point lands in a cascade's map, in texels
+	XMFLOAT2 ShadowTexel(const ShadowCascade& cascade, unsigned int resolution, FXMVECTOR point)
+	{
+		XMFLOAT3 clip;
+		XMStoreFloat3(&clip, XMVector3TransformCoord(point, XMLoadFloat4x4(&cascade.viewProjection)));
+		return XMFLOAT2((clip.x * 0.5f + 0.5f) * resolution, (0.5f - clip.y * 0.5f) * resolution);
+	}
+
+	// Distance from a texel position to the same sub-texel offset as
+	// another, wrapped to [0, 0.5]
+	float SubTexelDrift(float a, float b)
+	{
+		float d = (a - floorf(a)) - (b - floorf(b));
+		d = fabsf(d);
+		return (std::min)(d, 1.0f - d);
+	}
+
+	// Game's scene layout: unit cubes, spheres and helixes (all taken
+	// as unit boxes) over a 20 x 20 floor
+	std::vector<AABB> GameSceneBounds()
+	{
+		const XMFLOAT3 positions[] =
+		{
+			XMFLOAT3(-2, 0, 0), XMFLOAT3(0, 0, 0), XMFLOAT3(2, 2, 4), XMFLOAT3(0, 4, 0), XMFLOAT3(2, 4, 0),
+			XMFLOAT3(-2, 4, 0), XMFLOAT3(-4, 4, 0), XMFLOAT3(0, 6, 0), XMFLOAT3(2, 6, 0), XMFLOAT3(-6, 0, 0)
+		};
+
+		std::vector<AABB> bounds;
+		for (const XMFLOAT3& position : positions)
+		{
+			AABB box;
+			box.center = position;
+			box.extents = XMFLOAT3(0.5f, 0.5f, 0.5f);
+			bounds.push_back(box);
+		}
+
+		AABB floor;
+		floor.center = XMFLOAT3(0, -3, 0);
+		floor.extents = XMFLOAT3(10.0f, 0.25f, 10.0f);
+		bounds.push_back(floor);
+		return bounds;
+	}
+
+	// World texel area of a cascade's map
+	float CascadeTexelArea(const ShadowCascade& cascade, unsigned int resolution)
+	{
+		return (2.0f / cascade.projection._11 / resolution) * (2.0f / cascade.projection._22 / resolution);
+	}
+}
+
+int RunShadowCascadeChecks()
+{
+	const unsigned int cascadeCount = ShadowCascades::CascadeCount;
+	const unsigned int resolution = 1024;
+	const float cameraNear = 0.01f;
+	const float cameraFar = 100.0f;
+	const XMFLOAT3 lightDirection(1.0f, -1.0f, 0.3f);
+	XMFLOAT4X4 projection;
+	XMStoreFloat4x4(&projection, XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, cameraNear, cameraFar));
+
+	printf("Shadow cascade checks: %u cascades, %u x %u\n", cascadeCount, resolution, resolution);
+	int failures = 0;
+	char detail[256];
+
+	// Splits -------------------------------------------------------------------
+	{
+		float splits[cascadeCount + 1];
+		float worst = 0.0f;
+
+		ShadowCascades::ComputeSplits(1.0f, 81.0f, 0.0f, splits);
+		for (unsigned int i = 0; i <= cascadeCount; i++)
+			worst = (std::max)(worst, fabsf(splits[i] - (1.0f + 80.0f * i / cascadeCount)));
+		snprintf(detail, sizeof(detail), "max error %g", worst);
+		failures += ReportCheck("lambda 0 splits are uniform", worst < 1e-4f, detail);
+
+		worst = 0.0f;
+		ShadowCascades::ComputeSplits(1.0f, 81.0f, 1.0f, splits);
+		for (unsigned int i = 0; i <= cascadeCount; i++)
+			worst = (std::max)(worst, fabsf(splits[i] - powf(81.0f, (float)i / cascadeCount)));
+		snprintf(detail, sizeof(detail), "max error %g", worst);
+		failures += ReportCheck("lambda 1 splits are logarithmic", worst < 1e-3f, detail);
+
+		bool ordered = true;
+		for (float lambda : { 0.0f, 0.25f, 0.5f, 0.75f, 1.0f })
+		{
+			ShadowCascades::ComputeSplits(cameraNear, 60.0f, lambda, splits);
+			ordered &= splits[0] == cameraNear && splits[cascadeCount] == 60.0f;
+			for (unsigned int i = 0; i < cascadeCount; i++)
+				ordered &= splits[i] < splits[i + 1];
+		}
+		failures += ReportCheck("splits increase from near to far", ordered, "");
+	}
+
+	// Containment --------------------------------------------------------------
+	{
+		ShadowCascades cascades(resolution);
+		std::mt19937 rng(11);
+		std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+		float tanX = 1.0f / projection._11;
+		float tanY = 1.0f / projection._22;
+		float worstOutside = -FLT_MAX;	// Largest clip space |x|, |y| or depth overshoot
+		for (int test = 0; test < 200; test++)
+		{
+			XMVECTOR position = XMVectorSet(unit(rng) * 50.0f, unit(rng) * 10.0f, unit(rng) * 50.0f, 1.0f);
+			XMVECTOR forward = XMVector3Normalize(XMVectorSet(unit(rng), unit(rng) * 0.9f, unit(rng), 0.0f));
+			XMFLOAT4X4 view;
+			XMStoreFloat4x4(&view, XMMatrixLookToLH(position, forward, XMVectorSet(0, 1, 0, 0)));
+			XMMATRIX inverseView = XMMatrixInverse(nullptr, XMLoadFloat4x4(&view));
+
+			cascades.Update(view, projection, lightDirection);
+			for (unsigned int c = 0; c < cascadeCount; c++)
+			{
+				const ShadowCascade& cascade = cascades.GetCascade(c);
+				for (int corner = 0; corner < 8; corner++)
+				{
+					float z = (corner & 4) ? cascade.farZ : cascade.nearZ;
+					XMVECTOR viewCorner = XMVectorSet(
+						(corner & 1 ? 1.0f : -1.0f) * z * tanX,
+						(corner & 2 ? 1.0f : -1.0f) * z * tanY,
+						z,
+						1.0f);
+					XMFLOAT3 clip;
+					XMStoreFloat3(&clip, XMVector3TransformCoord(
+						XMVector3TransformCoord(viewCorner, inverseView),
+						XMLoadFloat4x4(&cascade.viewProjection)));
+
+					worstOutside = (std::max)(worstOutside, (std::max)(fabsf(clip.x), fabsf(clip.y)) - 1.0f);
+					worstOutside = (std::max)(worstOutside, (std::max)(-clip.z, clip.z - 1.0f));
+				}
+			}
+		}
+		snprintf(detail, sizeof(detail), "closest corner %.4f inside the edge", -worstOutside);
+		failures += ReportCheck("each cascade holds its frustum slice", worstOutside <= 0.0f, detail);
+	}
+
+	// Stability ----------------------------------------------------------------
+	{
+		// Same orientation, camera sliding around: a fixed point must keep
+		// its sub-texel offset, with snapping off it drifts
+		float drift[2] = {};
+		for (int snapping = 0; snapping < 2; snapping++)
+		{
+			ShadowCascades cascades(resolution);
+			cascades.SetTexelSnapping(snapping == 1);
+
+			std::mt19937 rng(5);
+			std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+			XMVECTOR forward = XMVector3Normalize(XMVectorSet(0.3f, -0.2f, 1.0f, 0.0f));
+			XMVECTOR point = XMVectorSet(1.3f, 0.4f, 2.7f, 1.0f);
+
+			XMFLOAT2 first[cascadeCount];
+			for (int frame = 0; frame < 200; frame++)
+			{
+				XMVECTOR position = XMVectorSet(unit(rng) * 2.0f, unit(rng) * 0.5f, unit(rng) * 2.0f, 1.0f);
+				XMFLOAT4X4 view;
+				XMStoreFloat4x4(&view, XMMatrixLookToLH(position, forward, XMVectorSet(0, 1, 0, 0)));
+				cascades.Update(view, projection, lightDirection);
+
+				for (unsigned int c = 0; c < cascadeCount; c++)
+				{
+					XMFLOAT2 texel = ShadowTexel(cascades.GetCascade(c), resolution, point);
+					if (frame == 0)
+						first[c] = texel;
+					drift[snapping] = (std::max)(drift[snapping], SubTexelDrift(texel.x, first[c].x));
+					drift[snapping] = (std::max)(drift[snapping], SubTexelDrift(texel.y, first[c].y));
+				}
+			}
+		}
+		snprintf(detail, sizeof(detail), "max drift %.4f texels (%.4f unsnapped)", drift[1], drift[0]);
+		failures += ReportCheck("moving camera keeps sub-texel positions", drift[1] < 0.02f, detail);
+
+		// Turning camera: cascade sizes don't change at all
+		ShadowCascades cascades(resolution);
+		float firstTexel[cascadeCount] = {};
+		float worstChange = 0.0f;
+		for (int step = 0; step < 72; step++)
+		{
+			float yaw = step * XM_2PI / 72.0f;
+			XMFLOAT4X4 view;
+			XMStoreFloat4x4(&view, XMMatrixLookToLH(
+				XMVectorSet(3.0f, 1.0f, -2.0f, 1.0f),
+				XMVectorSet(sinf(yaw), 0.3f * sinf(yaw * 3.0f), cosf(yaw), 0.0f),
+				XMVectorSet(0, 1, 0, 0)));
+			cascades.Update(view, projection, lightDirection);
+
+			for (unsigned int c = 0; c < cascadeCount; c++)
+			{
+				float texelSize = cascades.GetCascade(c).texelSize;
+				if (step == 0)
+					firstTexel[c] = texelSize;
+				worstChange = (std::max)(worstChange, fabsf(texelSize - firstTexel[c]) / firstTexel[c]);
+			}
+		}
+		snprintf(detail, sizeof(detail), "max relative change %g", worstChange);
+		failures += ReportCheck("turning camera keeps texel size", worstChange < 1e-5f, detail);
+	}
+
+	// Caster culling -----------------------------------------------------------
+	{
+		ShadowCascades cascades(resolution);
+		XMFLOAT4X4 view;
+		XMStoreFloat4x4(&view, XMMatrixLookToLH(XMVectorSet(0, 2, 0, 1), XMVectorSet(0, 0, 1, 0), XMVectorSet(0, 1, 0, 0)));
+		cascades.Update(view, projection, lightDirection);
+
+		XMVECTOR dir = XMVector3Normalize(XMLoadFloat3(&lightDirection));
+		bool keptBehind = true;
+		bool droppedSide = true;
+		for (unsigned int c = 0; c < cascadeCount; c++)
+		{
+			const ShadowCascade& cascade = cascades.GetCascade(c);
+			XMVECTOR center = XMLoadFloat3(&cascade.center);
+
+			// Far up toward the light, well past the near plane
+			AABB behind;
+			XMStoreFloat3(&behind.center, XMVectorSubtract(center, XMVectorScale(dir, cascade.radius + 500.0f)));
+			behind.extents = XMFLOAT3(0.1f, 0.1f, 0.1f);
+			keptBehind &= cascade.casterFrustum.Intersects(behind);
+
+			// Beside the cascade, perpendicular to the light
+			XMVECTOR side = XMVector3Normalize(XMVector3Cross(dir, XMVectorSet(0, 1, 0, 0)));
+			AABB beside;
+			XMStoreFloat3(&beside.center, XMVectorAdd(center, XMVectorScale(side, cascade.radius * 3.0f)));
+			beside.extents = XMFLOAT3(0.1f, 0.1f, 0.1f);
+			droppedSide &= !cascade.casterFrustum.Intersects(beside);
+		}
+		failures += ReportCheck("casters toward the light are kept", keptBehind, "");
+		failures += ReportCheck("casters beside a cascade are culled", droppedSide, "");
+	}
+
+	// Scene fitting ------------------------------------------------------------
+	{
+		// Game's first camera and light
+		const XMFLOAT3 sunDirection(1.0f, -1.0f, 0.0f);
+		std::vector<AABB> scene = GameSceneBounds();
+		XMFLOAT4X4 view;
+		XMStoreFloat4x4(&view, XMMatrixLookToLH(XMVectorSet(0, 0, -5, 1), XMVectorSet(0, 0, 1, 0), XMVectorSet(0, 1, 0, 0)));
+		float tanX = 1.0f / projection._11;
+		float tanY = 1.0f / projection._22;
+
+		ShadowCascades sphere(resolution);
+		ShadowCascades fitted(resolution);
+		sphere.Update(view, projection, sunDirection);
+		fitted.Update(view, projection, sunDirection, scene.data(), scene.size());
+
+		// Points on every box, kept where they're in a cascade's slice
+		std::mt19937 rng(3);
+		std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+		XMFLOAT3 towardLight;
+		XMStoreFloat3(&towardLight, XMVectorNegate(XMVector3Normalize(XMLoadFloat3(&sunDirection))));
+
+		float worstOutside = -FLT_MAX;
+		size_t receiverPoints = 0;
+		size_t lostCasters = 0;
+		XMMATRIX worldToView = XMLoadFloat4x4(&view);
+		for (const AABB& box : scene)
+		{
+			for (int sample = 0; sample < 4000; sample++)
+			{
+				XMFLOAT3 point(
+					box.center.x + unit(rng) * box.extents.x,
+					box.center.y + unit(rng) * box.extents.y,
+					box.center.z + unit(rng) * box.extents.z);
+				XMFLOAT3 viewPoint;
+				XMStoreFloat3(&viewPoint, XMVector3TransformCoord(XMLoadFloat3(&point), worldToView));
+				if (fabsf(viewPoint.x) > viewPoint.z * tanX || fabsf(viewPoint.y) > viewPoint.z * tanY)
+					continue;
+
+				for (unsigned int c = 0; c < cascadeCount; c++)
+				{
+					const ShadowCascade& cascade = fitted.GetCascade(c);
+					if (viewPoint.z < cascade.nearZ || viewPoint.z > cascade.farZ)
+						continue;
+
+					receiverPoints++;
+					XMFLOAT3 clip;
+					XMStoreFloat3(&clip, XMVector3TransformCoord(XMLoadFloat3(&point), XMLoadFloat4x4(&cascade.viewProjection)));
+					worstOutside = (std::max)(worstOutside, (std::max)(fabsf(clip.x), fabsf(clip.y)) - 1.0f);
+					worstOutside = (std::max)(worstOutside, (std::max)(-clip.z, clip.z - 1.0f));
+
+					// Whatever shadows this point must survive caster culling
+					for (const AABB& caster : scene)
+					{
+						if (&caster != &box && RayHitsBox(point, towardLight, caster) && !cascade.casterFrustum.Intersects(caster))
+							lostCasters++;
+					}
+				}
+			}
+		}
+		snprintf(detail, sizeof(detail), "%zu receiver points, closest %.4f inside the edge", receiverPoints, -worstOutside);
+		failures += ReportCheck("fitted cascades hold every receiver", receiverPoints > 0 && worstOutside <= 1e-4f, detail);
+		snprintf(detail, sizeof(detail), "%zu shadowing casters culled", lostCasters);
+		failures += ReportCheck("fitted caster culling keeps shadows", lostCasters == 0, detail);
+
+		bool neverWorse = true;
+		float totalGain = 0.0f;
+		char gains[128] = "";
+		char depths[128] = "";
+		for (unsigned int c = 0; c < cascadeCount; c++)
+		{
+			float gain = CascadeTexelArea(sphere.GetCascade(c), resolution) / CascadeTexelArea(fitted.GetCascade(c), resolution);
+			float depth = sphere.GetCascade(c).depthRange / fitted.GetCascade(c).depthRange;
+			neverWorse &= gain >= 0.999f && depth >= 0.999f;
+			totalGain += gain;
+			size_t length = strlen(gains);
+			snprintf(gains + length, sizeof(gains) - length, " %.1fx", gain);
+			length = strlen(depths);
+			snprintf(depths + length, sizeof(depths) - length, " %.1fx", depth);
+		}
+		printf("  fitted texel density per cascade:%s, depth precision:%s\n", gains, depths);
+		snprintf(detail, sizeof(detail), "%.1fx texels per area on average", totalGain / cascadeCount);
+		failures += ReportCheck("fitting raises shadow resolution", neverWorse && totalGain / cascadeCount >= 2.0f, detail);
+
+		// Nothing in view: the spheres stay
+		std::vector<AABB> elsewhere = scene;
+		for (AABB& box : elsewhere)
+			box.center.y += 1000.0f;
+		fitted.Update(view, projection, sunDirection, elsewhere.data(), elsewhere.size());
+		bool same = true;
+		for (unsigned int c = 0; c < cascadeCount; c++)
+			same &= fitted.GetCascade(c).receivers == 0 && memcmp(&fitted.GetCascade(c).viewProjection, &sphere.GetCascade(c).viewProjection, sizeof(XMFLOAT4X4)) == 0;
+		failures += ReportCheck("no receivers keeps the sphere", same, "");
+
+		// A slow pan in cache-sized snap steps: while a cascade's size
+		// holds, a point on the floor keeps its sub-texel position, and
+		// the matrices mostly don't change at all
+		ShadowCascades cascades(resolution);
+		cascades.SetSnapTexels(16);
+		XMVECTOR point = XMVectorSet(0.3f, -2.75f, 1.7f, 1.0f);
+		XMFLOAT4X4 previous[cascadeCount] = {};
+		XMFLOAT2 previousTexel[cascadeCount] = {};
+		unsigned int changes = 0;
+		unsigned int resizes = 0;
+		float drift = 0.0f;
+		const int frames = 200;
+		for (int frame = 0; frame < frames; frame++)
+		{
+			XMStoreFloat4x4(&view, XMMatrixLookToLH(XMVectorSet(frame * 0.002f, 0, -5, 1), XMVectorSet(0, 0, 1, 0), XMVectorSet(0, 1, 0, 0)));
+			cascades.Update(view, projection, sunDirection, scene.data(), scene.size());
+
+			for (unsigned int c = 0; c < cascadeCount; c++)
+			{
+				const ShadowCascade& cascade = cascades.GetCascade(c);
+				XMFLOAT2 texel = ShadowTexel(cascade, resolution, point);
+				if (frame > 0)
+				{
+					if (memcmp(&previous[c], &cascade.viewProjection, sizeof(XMFLOAT4X4)) != 0)
+						changes++;
+					if (previous[c]._11 == cascade.viewProjection._11 && previous[c]._22 == cascade.viewProjection._22)
+					{
+						drift = (std::max)(drift, SubTexelDrift(texel.x, previousTexel[c].x));
+						drift = (std::max)(drift, SubTexelDrift(texel.y, previousTexel[c].y));
+					}
+					else
+					{
+						resizes++;
+					}
+				}
+				previous[c] = cascade.viewProjection;
+				previousTexel[c] = texel;
+			}
+		}
+		snprintf(detail, sizeof(detail), "max drift %.4f texels; %u changes, %u resizes in %d frames", drift, changes, resizes, frames * cascadeCount);
+		failures += ReportCheck("small moves keep fitted texels", drift < 0.02f && changes * 4 < frames * cascadeCount, detail);
+	}
+
+	return ReportFailures(failures);
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+// --------------------------------------------------------
+// Headless checks of the shadow cascade math - no timing.
+//
+//  - split placement: uniform and logarithmic extremes, and
+//    increasing from the near plane to the shadow distance
+//  - every cascade's map holds its whole slice of the view
+//    frustum, for cameras looking every which way
+//  - a fixed world point stays at the same sub-texel position
+//    in every cascade while the camera moves, and the texel
+//    size doesn't change while it turns (shimmer-free)
+//  - caster culling keeps casters between the light and a
+//    cascade, and drops ones off to the side
+//  - fitted to Game's scene layout: every receiver point in a
+//    slice lands inside its map and depth range, no caster the
+//    sphere kept is clipped, and how much resolution and depth
+//    precision it gains (printed); a slice with no receivers
+//    keeps its sphere, and small camera moves keep the texel grid
+//
+// Prints each check, returns 0 if all passed.
+// --------------------------------------------------------
+int RunShadowCascadeChecks();
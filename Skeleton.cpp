@@ -0,0 +1,82 @@
+#include "Skeleton.h"
+#include "AnimationClip.h"
+
+using namespace DirectX;
+
+uint16_t Skeleton::AddJoint(uint16_t parent, const JointPose& pose)
+{
+	if (parents.size() >= MaxJoints || (parent != NoParent && parent >= parents.size()))
+		return NoParent;
+
+	XMMATRIX model = PoseMatrix(pose);
+	if (parent != NoParent)
+		model = XMMatrixMultiply(model, XMLoadFloat4x4(&bindModelMatrices[parent]));
+
+	XMFLOAT4X4 stored;
+	parents.push_back(parent);
+	bindPose.push_back(pose);
+	XMStoreFloat4x4(&stored, model);
+	bindModelMatrices.push_back(stored);
+	XMStoreFloat4x4(&stored, XMMatrixInverse(nullptr, model));
+	inverseBindMatrices.push_back(stored);
+	return (uint16_t)(parents.size() - 1);
+}
+
+void Skeleton::SamplePose(const AnimationClip* const* jointClips, float time, AnimationCursor* cursors, JointPose* localPoses) const
+{
+	for (uint32_t joint = 0; joint < parents.size(); joint++)
+	{
+		JointPose& pose = localPoses[joint];
+		pose = bindPose[joint];
+
+		const AnimationClip* clip = jointClips[joint];
+		if (clip)
+			clip->Sample(clip->WrapTime(time), cursors[joint], pose.translation, pose.rotation, pose.scale);
+	}
+}
+
+void Skeleton::ComputeModelMatrices(const JointPose* localPoses, XMFLOAT4X4* modelMatrices) const
+{
+	// Parents come first, so theirs is always ready
+	for (uint32_t joint = 0; joint < parents.size(); joint++)
+	{
+		XMMATRIX model = PoseMatrix(localPoses[joint]);
+		if (parents[joint] != NoParent)
+			model = XMMatrixMultiply(model, XMLoadFloat4x4(&modelMatrices[parents[joint]]));
+		XMStoreFloat4x4(&modelMatrices[joint], model);
+	}
+}
+
+void Skeleton::ComputePalette(const JointPose* localPoses, SkinningPalette& palette) const
+{
+	palette.matrices.resize(parents.size());
+	palette.dualQuaternions.resize(parents.size());
+
+	// Model matrices first, then the inverse bind goes in front of
+	// each once no child needs it any more
+	ComputeModelMatrices(localPoses, palette.matrices.data());
+	for (uint32_t joint = 0; joint < parents.size(); joint++)
+	{
+		XMMATRIX skin = XMMatrixMultiply(XMLoadFloat4x4(&inverseBindMatrices[joint]), XMLoadFloat4x4(&palette.matrices[joint]));
+		XMStoreFloat4x4(&palette.matrices[joint], skin);
+
+		XMVECTOR scale, rotation, translation;
+		if (!XMMatrixDecompose(&scale, &rotation, &translation, skin))
+		{
+			rotation = XMQuaternionIdentity();
+			translation = skin.r[3];
+		}
+
+		// dual = translation * rotation / 2, as quaternions - XMQuaternionMultiply(a, b) is b * a
+		DualQuaternion& dq = palette.dualQuaternions[joint];
+		XMStoreFloat4(&dq.real, rotation);
+		XMStoreFloat4(&dq.dual, XMVectorScale(XMQuaternionMultiply(rotation, XMVectorSetW(translation, 0.0f)), 0.5f));
+	}
+}
+
+XMMATRIX Skeleton::PoseMatrix(const JointPose& pose)
+{
+	XMMATRIX matrix = XMMatrixScaling(pose.scale.x, pose.scale.y, pose.scale.z) * XMMatrixRotationQuaternion(XMLoadFloat4(&pose.rotation));
+	matrix.r[3] = XMVectorSet(pose.translation.x, pose.translation.y, pose.translation.z, 1.0f);
+	return matrix;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <cstdint>
+#include <vector>
+
+class AnimationClip;
+struct AnimationCursor;
+
+// A joint's transform relative to its parent
+struct JointPose
+{
+	DirectX::XMFLOAT3 translation = DirectX::XMFLOAT3(0, 0, 0);
+	DirectX::XMFLOAT4 rotation = DirectX::XMFLOAT4(0, 0, 0, 1);
+	DirectX::XMFLOAT3 scale = DirectX::XMFLOAT3(1, 1, 1);
+};
+
+// A rotation and translation as a unit dual quaternion: real is
+// the rotation, dual is half the translation times it
+struct DualQuaternion
+{
+	DirectX::XMFLOAT4 real = DirectX::XMFLOAT4(0, 0, 0, 1);
+	DirectX::XMFLOAT4 dual = DirectX::XMFLOAT4(0, 0, 0, 0);
+};
+
+// --------------------------------------------------------
+// What skinning reads for one pose of a skeleton, per joint: the
+// matrix taking a bind pose vertex to where the joint has moved
+// it (inverse bind, then the joint's model matrix, row vectors),
+// and the same transform as a dual quaternion.  Dual quaternions
+// only hold rotation and translation, so any scale is left out
+// of them.
+// --------------------------------------------------------
+struct SkinningPalette
+{
+	std::vector<DirectX::XMFLOAT4X4> matrices;
+	std::vector<DualQuaternion> dualQuaternions;
+};
+
+// --------------------------------------------------------
+// A joint hierarchy, stored flat: every joint comes after its
+// parent, so walking the arrays in order visits parents first
+// and a pose is evaluated in one pass, with no recursion.
+//
+// Joints are added with their bind pose - the pose the skinned
+// mesh was modelled in - and the inverse bind matrices are
+// worked out as they're added.
+// --------------------------------------------------------
+class Skeleton
+{
+public:
+	static const uint16_t NoParent = 0xFFFF;
+	static constexpr uint32_t MaxJoints = 256;	// Vertices name their joints in a byte
+
+	// The new joint's index, or NoParent if the parent doesn't exist
+	// yet or the skeleton is full
+	uint16_t AddJoint(uint16_t parent, const JointPose& bindPose);
+
+	uint32_t GetJointCount() const { return (uint32_t)parents.size(); }
+	uint16_t GetParent(uint32_t joint) const { return parents[joint]; }
+	const std::vector<JointPose>& GetBindPose() const { return bindPose; }
+
+	// Every joint's local pose at a time, from a clip per joint (null
+	// for a joint that holds its bind pose).  Channels a clip doesn't
+	// have keep the bind pose's values.  cursors has one per joint.
+	void SamplePose(const AnimationClip* const* jointClips, float time, AnimationCursor* cursors, JointPose* localPoses) const;
+
+	// Every joint's transform relative to the model, from local poses
+	void ComputeModelMatrices(const JointPose* localPoses, DirectX::XMFLOAT4X4* modelMatrices) const;
+
+	// The palette for local poses - reuses the palette's capacity
+	void ComputePalette(const JointPose* localPoses, SkinningPalette& palette) const;
+
+	// A pose as a matrix: scale, then rotate, then translate
+	static DirectX::XMMATRIX PoseMatrix(const JointPose& pose);
+
+private:
+	std::vector<uint16_t> parents;
+	std::vector<JointPose> bindPose;
+	std::vector<DirectX::XMFLOAT4X4> bindModelMatrices;
+	std::vector<DirectX::XMFLOAT4X4> inverseBindMatrices;
+};
@@ -0,0 +1,604 @@
+#include "Skinning.h"
+#include "CpuFeatures.h"
+#include "Mesh.h"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#if HAS_AVX2_PATHS
+#include <immintrin.h>
+#endif
+
+using namespace DirectX;
+
+namespace
+{
+	// v rotated by the unit quaternion q
+	XMVECTOR Rotate(FXMVECTOR v, FXMVECTOR q)
+	{
+		XMVECTOR t = XMVector3Cross(q, XMVectorMultiplyAdd(XMVectorSplatW(q), v, XMVector3Cross(q, v)));
+		return XMVectorMultiplyAdd(t, XMVectorReplicate(2.0f), v);
+	}
+
+	// Writes a whole vertex, in member order
+	void StoreVertex(Vertex& out, FXMVECTOR position, FXMVECTOR normal, FXMVECTOR tangent, const XMFLOAT2& uv)
+	{
+		XMStoreFloat3(&out.Position, position);
+		XMStoreFloat3(&out.Normal, XMVector3Normalize(normal));
+		out.UV = uv;
+		XMStoreFloat3(&out.Tangent, XMVector3Normalize(tangent));
+	}
+
+	void SkinLinear(const Vertex* vertices, const SkinWeights* weights, const XMFLOAT4X4* palette,
+		uint32_t begin, uint32_t end, Vertex* output, XMVECTOR& min, XMVECTOR& max)
+	{
+		for (uint32_t i = begin; i < end; i++)
+		{
+			const SkinWeights& skin = weights[i];
+			XMVECTOR weight = XMVectorReplicate(skin.weights[0]);
+			const XMFLOAT4X4& first = palette[skin.joints[0]];
+			XMVECTOR r0 = XMVectorMultiply(XMLoadFloat4((const XMFLOAT4*)&first._11), weight);
+			XMVECTOR r1 = XMVectorMultiply(XMLoadFloat4((const XMFLOAT4*)&first._21), weight);
+			XMVECTOR r2 = XMVectorMultiply(XMLoadFloat4((const XMFLOAT4*)&first._31), weight);
+			XMVECTOR r3 = XMVectorMultiply(XMLoadFloat4((const XMFLOAT4*)&first._41), weight);
+
+			// Weights are heaviest first, so the first zero ends them
+			for (int k = 1; k < 4 && skin.weights[k] > 0.0f; k++)
+			{
+				const XMFLOAT4X4& joint = palette[skin.joints[k]];
+				weight = XMVectorReplicate(skin.weights[k]);
+				r0 = XMVectorMultiplyAdd(XMLoadFloat4((const XMFLOAT4*)&joint._11), weight, r0);
+				r1 = XMVectorMultiplyAdd(XMLoadFloat4((const XMFLOAT4*)&joint._21), weight, r1);
+				r2 = XMVectorMultiplyAdd(XMLoadFloat4((const XMFLOAT4*)&joint._31), weight, r2);
+				r3 = XMVectorMultiplyAdd(XMLoadFloat4((const XMFLOAT4*)&joint._41), weight, r3);
+			}
+
+			// Row vectors: x * r0 + y * r1 + z * r2 (+ r3 for points)
+			const Vertex& in = vertices[i];
+			XMVECTOR position = XMVectorMultiplyAdd(XMVectorReplicate(in.Position.x), r0,
+				XMVectorMultiplyAdd(XMVectorReplicate(in.Position.y), r1,
+				XMVectorMultiplyAdd(XMVectorReplicate(in.Position.z), r2, r3)));
+			XMVECTOR normal = XMVectorMultiplyAdd(XMVectorReplicate(in.Normal.x), r0,
+				XMVectorMultiplyAdd(XMVectorReplicate(in.Normal.y), r1,
+				XMVectorMultiply(XMVectorReplicate(in.Normal.z), r2)));
+			XMVECTOR tangent = XMVectorMultiplyAdd(XMVectorReplicate(in.Tangent.x), r0,
+				XMVectorMultiplyAdd(XMVectorReplicate(in.Tangent.y), r1,
+				XMVectorMultiply(XMVectorReplicate(in.Tangent.z), r2)));
+
+			StoreVertex(output[i], position, normal, tangent, in.UV);
+			min = XMVectorMin(min, position);
+			max = XMVectorMax(max, position);
+		}
+	}
+
+	void SkinDualQuaternion(const Vertex* vertices, const SkinWeights* weights, const DualQuaternion* palette,
+		uint32_t begin, uint32_t end, Vertex* output, XMVECTOR& min, XMVECTOR& max)
+	{
+		for (uint32_t i = begin; i < end; i++)
+		{
+			const SkinWeights& skin = weights[i];
+			XMVECTOR firstReal = XMLoadFloat4(&palette[skin.joints[0]].real);
+			XMVECTOR weight = XMVectorReplicate(skin.weights[0]);
+			XMVECTOR real = XMVectorMultiply(firstReal, weight);
+			XMVECTOR dual = XMVectorMultiply(XMLoadFloat4(&palette[skin.joints[0]].dual), weight);
+
+			// q and -q are the same rotation - blend the one nearer the first
+			for (int k = 1; k < 4 && skin.weights[k] > 0.0f; k++)
+			{
+				const DualQuaternion& joint = palette[skin.joints[k]];
+				XMVECTOR jointReal = XMLoadFloat4(&joint.real);
+				weight = XMVectorReplicate(skin.weights[k]);
+				weight = XMVectorSelect(weight, XMVectorNegate(weight), XMVectorLess(XMVector4Dot(firstReal, jointReal), XMVectorZero()));
+				real = XMVectorMultiplyAdd(jointReal, weight, real);
+				dual = XMVectorMultiplyAdd(XMLoadFloat4(&joint.dual), weight, dual);
+			}
+
+			XMVECTOR inverseLength = XMVectorReciprocal(XMVector4Length(real));
+			real = XMVectorMultiply(real, inverseLength);
+			dual = XMVectorMultiply(dual, inverseLength);
+
+			// translation = 2 * (real.w * dual.xyz - dual.w * real.xyz + real.xyz x dual.xyz)
+			XMVECTOR translation = XMVectorMultiply(XMVectorSplatW(real), dual);
+			translation = XMVectorSubtract(translation, XMVectorMultiply(XMVectorSplatW(dual), real));
+			translation = XMVectorAdd(translation, XMVector3Cross(real, dual));
+			translation = XMVectorAdd(translation, translation);
+
+			const Vertex& in = vertices[i];
+			XMVECTOR position = XMVectorAdd(Rotate(XMLoadFloat3(&in.Position), real), translation);
+			XMVECTOR normal = Rotate(XMLoadFloat3(&in.Normal), real);
+			XMVECTOR tangent = Rotate(XMLoadFloat3(&in.Tangent), real);
+
+			StoreVertex(output[i], position, normal, tangent, in.UV);
+			min = XMVectorMin(min, position);
+			max = XMVectorMax(max, position);
+		}
+	}
+
+#if HAS_AVX2_PATHS
+	// --------------------------------------------------------
+	// The same two blends eight vertices at a time, a vertex a
+	// lane.  Vertices and palette entries are loaded a row each and
+	// transposed, weights gathered, and the skinned vertices
+	// transposed back and written in order.  Each returns where it
+	// stopped, a multiple of eight from begin, for the four-wide
+	// loops to finish off.
+	// --------------------------------------------------------
+	static_assert(sizeof(Vertex) == 11 * sizeof(float), "Vertex is loaded as 11 floats");
+	static_assert(sizeof(SkinWeights) == 5 * sizeof(float), "SkinWeights is gathered as 5 dwords");
+	static_assert(sizeof(DualQuaternion) == 8 * sizeof(float), "DualQuaternion is loaded as a row of 8 floats");
+
+	// Components of eight vertices, a lane each
+	struct VertexLanes
+	{
+		__m256 position[3];
+		__m256 normal[3];
+		__m256 uv[2];
+		__m256 tangent[3];
+	};
+
+	// Rows to columns
+	AVX2_FUNCTION inline void Transpose8(__m256 rows[8])
+	{
+		__m256 t0 = _mm256_unpacklo_ps(rows[0], rows[1]);
+		__m256 t1 = _mm256_unpackhi_ps(rows[0], rows[1]);
+		__m256 t2 = _mm256_unpacklo_ps(rows[2], rows[3]);
+		__m256 t3 = _mm256_unpackhi_ps(rows[2], rows[3]);
+		__m256 t4 = _mm256_unpacklo_ps(rows[4], rows[5]);
+		__m256 t5 = _mm256_unpackhi_ps(rows[4], rows[5]);
+		__m256 t6 = _mm256_unpacklo_ps(rows[6], rows[7]);
+		__m256 t7 = _mm256_unpackhi_ps(rows[6], rows[7]);
+		__m256 s0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+		__m256 s1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+		__m256 s2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+		__m256 s3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+		__m256 s4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+		__m256 s5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+		__m256 s6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+		__m256 s7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+		rows[0] = _mm256_permute2f128_ps(s0, s4, 0x20);
+		rows[1] = _mm256_permute2f128_ps(s1, s5, 0x20);
+		rows[2] = _mm256_permute2f128_ps(s2, s6, 0x20);
+		rows[3] = _mm256_permute2f128_ps(s3, s7, 0x20);
+		rows[4] = _mm256_permute2f128_ps(s0, s4, 0x31);
+		rows[5] = _mm256_permute2f128_ps(s1, s5, 0x31);
+		rows[6] = _mm256_permute2f128_ps(s2, s6, 0x31);
+		rows[7] = _mm256_permute2f128_ps(s3, s7, 0x31);
+	}
+
+	// A vertex's first eight floats are one row, its last eight
+	// another - they overlap, and never read past the vertex
+	AVX2_FUNCTION inline void LoadVertices8(const Vertex* vertices, VertexLanes& lanes)
+	{
+		const float* in = &vertices[0].Position.x;
+		__m256 head[8], tail[8];
+		for (int i = 0; i < 8; i++)
+		{
+			head[i] = _mm256_loadu_ps(in + i * 11);
+			tail[i] = _mm256_loadu_ps(in + i * 11 + 3);
+		}
+		Transpose8(head);
+		Transpose8(tail);
+		for (int c = 0; c < 3; c++)
+		{
+			lanes.position[c] = head[c];
+			lanes.normal[c] = head[3 + c];
+			lanes.tangent[c] = tail[5 + c];
+		}
+		lanes.uv[0] = head[6];
+		lanes.uv[1] = head[7];
+	}
+
+	// Each vertex written whole before the next, as its first eight
+	// floats and then its last four
+	AVX2_FUNCTION inline void StoreVertices8(const VertexLanes& lanes, Vertex* vertices)
+	{
+		__m256 head[8] = { lanes.position[0], lanes.position[1], lanes.position[2],
+			lanes.normal[0], lanes.normal[1], lanes.normal[2], lanes.uv[0], lanes.uv[1] };
+		__m256 tail[8] = { lanes.normal[0], lanes.normal[1], lanes.normal[2],
+			lanes.uv[0], lanes.uv[1], lanes.tangent[0], lanes.tangent[1], lanes.tangent[2] };
+		Transpose8(head);
+		Transpose8(tail);
+		float* out = &vertices[0].Position.x;
+		for (int i = 0; i < 8; i++)
+		{
+			_mm256_storeu_ps(out + i * 11, head[i]);
+			_mm_storeu_ps(out + i * 11 + 7, _mm256_extractf128_ps(tail[i], 1));
+		}
+	}
+
+	// As XMVector3Normalize: zero stays zero
+	AVX2_FUNCTION inline void Normalize8(__m256 v[3])
+	{
+		__m256 lengthSq = _mm256_fmadd_ps(v[0], v[0], _mm256_fmadd_ps(v[1], v[1], _mm256_mul_ps(v[2], v[2])));
+		__m256 scale = _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_sqrt_ps(lengthSq));
+		scale = _mm256_and_ps(scale, _mm256_cmp_ps(lengthSq, _mm256_setzero_ps(), _CMP_GT_OQ));
+		for (int c = 0; c < 3; c++)
+			v[c] = _mm256_mul_ps(v[c], scale);
+	}
+
+	AVX2_FUNCTION inline void Cross8(const __m256 a[3], const __m256 b[3], __m256 out[3])
+	{
+		out[0] = _mm256_fmsub_ps(a[1], b[2], _mm256_mul_ps(a[2], b[1]));
+		out[1] = _mm256_fmsub_ps(a[2], b[0], _mm256_mul_ps(a[0], b[2]));
+		out[2] = _mm256_fmsub_ps(a[0], b[1], _mm256_mul_ps(a[1], b[0]));
+	}
+
+	// v rotated by the unit quaternions q, as Rotate()
+	AVX2_FUNCTION inline void Rotate8(__m256 v[3], const __m256 q[4])
+	{
+		__m256 c[3], t[3];
+		Cross8(q, v, c);
+		for (int i = 0; i < 3; i++)
+			c[i] = _mm256_fmadd_ps(q[3], v[i], c[i]);
+		Cross8(q, c, t);
+		for (int i = 0; i < 3; i++)
+			v[i] = _mm256_fmadd_ps(t[i], _mm256_set1_ps(2.0f), v[i]);
+	}
+
+	// Slot k's dual quaternion for each of eight vertices, a row
+	// each, transposed.  A slot without weight can name a joint the
+	// palette doesn't have, so reads joint 0 instead.
+	AVX2_FUNCTION inline void LoadDualQuaternions8(const SkinWeights* weights, const DualQuaternion* palette, int k, __m256 lanes[8])
+	{
+		for (int v = 0; v < 8; v++)
+			lanes[v] = _mm256_loadu_ps(&palette[weights[v].weights[k] > 0.0f ? weights[v].joints[k] : 0].real.x);
+		Transpose8(lanes);
+	}
+
+	// Folds the lanes' boxes into one
+	AVX2_FUNCTION inline void StoreBounds8(const __m256 lo[3], const __m256 hi[3], XMFLOAT3& min, XMFLOAT3& max)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			__m256 a = _mm256_min_ps(lo[c], _mm256_permute2f128_ps(lo[c], lo[c], 1));
+			a = _mm256_min_ps(a, _mm256_shuffle_ps(a, a, _MM_SHUFFLE(1, 0, 3, 2)));
+			a = _mm256_min_ps(a, _mm256_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1)));
+			__m256 b = _mm256_max_ps(hi[c], _mm256_permute2f128_ps(hi[c], hi[c], 1));
+			b = _mm256_max_ps(b, _mm256_shuffle_ps(b, b, _MM_SHUFFLE(1, 0, 3, 2)));
+			b = _mm256_max_ps(b, _mm256_shuffle_ps(b, b, _MM_SHUFFLE(2, 3, 0, 1)));
+			(&min.x)[c] = _mm256_cvtss_f32(a);
+			(&max.x)[c] = _mm256_cvtss_f32(b);
+		}
+	}
+
+	AVX2_FUNCTION uint32_t SkinLinearAvx2(const Vertex* vertices, const SkinWeights* weights, const XMFLOAT4X4* palette,
+		uint32_t begin, uint32_t end, Vertex* output, XMFLOAT3& min, XMFLOAT3& max)
+	{
+		__m256 lo[3], hi[3];
+		for (int c = 0; c < 3; c++)
+		{
+			lo[c] = _mm256_set1_ps(FLT_MAX);
+			hi[c] = _mm256_set1_ps(-FLT_MAX);
+		}
+
+		uint32_t i = begin;
+		for (; end - i >= 8; i += 8)
+		{
+			// Each vertex's matrix blended two rows to a register, then
+			// transposed: rows 0 and 1 a component a lane in upper, rows
+			// 2 and 3 in lower
+			__m256 upper[8], lower[8];
+			for (int v = 0; v < 8; v++)
+			{
+				const SkinWeights& skin = weights[i + v];
+				const float* joint = &palette[skin.joints[0]]._11;
+				__m256 weight = _mm256_set1_ps(skin.weights[0]);
+				upper[v] = _mm256_mul_ps(_mm256_loadu_ps(joint), weight);
+				lower[v] = _mm256_mul_ps(_mm256_loadu_ps(joint + 8), weight);
+				for (int k = 1; k < 4 && skin.weights[k] > 0.0f; k++)
+				{
+					joint = &palette[skin.joints[k]]._11;
+					weight = _mm256_set1_ps(skin.weights[k]);
+					upper[v] = _mm256_fmadd_ps(_mm256_loadu_ps(joint), weight, upper[v]);
+					lower[v] = _mm256_fmadd_ps(_mm256_loadu_ps(joint + 8), weight, lower[v]);
+				}
+			}
+			Transpose8(upper);
+			Transpose8(lower);
+
+			VertexLanes in, out;
+			LoadVertices8(vertices + i, in);
+			for (int c = 0; c < 3; c++)
+			{
+				out.position[c] = _mm256_fmadd_ps(in.position[0], upper[c],
+					_mm256_fmadd_ps(in.position[1], upper[4 + c], _mm256_fmadd_ps(in.position[2], lower[c], lower[4 + c])));
+				out.normal[c] = _mm256_fmadd_ps(in.normal[0], upper[c],
+					_mm256_fmadd_ps(in.normal[1], upper[4 + c], _mm256_mul_ps(in.normal[2], lower[c])));
+				out.tangent[c] = _mm256_fmadd_ps(in.tangent[0], upper[c],
+					_mm256_fmadd_ps(in.tangent[1], upper[4 + c], _mm256_mul_ps(in.tangent[2], lower[c])));
+				lo[c] = _mm256_min_ps(lo[c], out.position[c]);
+				hi[c] = _mm256_max_ps(hi[c], out.position[c]);
+			}
+			out.uv[0] = in.uv[0];
+			out.uv[1] = in.uv[1];
+			Normalize8(out.normal);
+			Normalize8(out.tangent);
+			StoreVertices8(out, output + i);
+		}
+		StoreBounds8(lo, hi, min, max);
+		return i;
+	}
+
+	AVX2_FUNCTION uint32_t SkinDualQuaternionAvx2(const Vertex* vertices, const SkinWeights* weights, const DualQuaternion* palette,
+		uint32_t begin, uint32_t end, Vertex* output, XMFLOAT3& min, XMFLOAT3& max)
+	{
+		const __m256i weightOffsets = _mm256_setr_epi32(0, 5, 10, 15, 20, 25, 30, 35);
+		const __m256 signBit = _mm256_set1_ps(-0.0f);
+		__m256 lo[3], hi[3];
+		for (int c = 0; c < 3; c++)
+		{
+			lo[c] = _mm256_set1_ps(FLT_MAX);
+			hi[c] = _mm256_set1_ps(-FLT_MAX);
+		}
+
+		uint32_t i = begin;
+		for (; end - i >= 8; i += 8)
+		{
+			// Each slot's dual quaternions, the real parts' components then
+			// the dual parts'
+			const float* skin = (const float*)&weights[i];
+			__m256 weight = _mm256_i32gather_ps(skin + 1, weightOffsets, 4);
+			__m256 first[8];
+			LoadDualQuaternions8(weights + i, palette, 0, first);
+			__m256 real[4], dual[4];
+			for (int c = 0; c < 4; c++)
+			{
+				real[c] = _mm256_mul_ps(first[c], weight);
+				dual[c] = _mm256_mul_ps(first[4 + c], weight);
+			}
+
+			for (int k = 1; k < 4; k++)
+			{
+				weight = _mm256_i32gather_ps(skin + 1 + k, weightOffsets, 4);
+				if (_mm256_movemask_ps(_mm256_cmp_ps(weight, _mm256_setzero_ps(), _CMP_GT_OQ)) == 0)
+					break;
+				__m256 joint[8];
+				LoadDualQuaternions8(weights + i, palette, k, joint);
+
+				// q and -q are the same rotation - blend the one nearer the first
+				__m256 dot = _mm256_fmadd_ps(first[0], joint[0], _mm256_fmadd_ps(first[1], joint[1],
+					_mm256_fmadd_ps(first[2], joint[2], _mm256_mul_ps(first[3], joint[3]))));
+				weight = _mm256_xor_ps(weight, _mm256_and_ps(_mm256_cmp_ps(dot, _mm256_setzero_ps(), _CMP_LT_OQ), signBit));
+				for (int c = 0; c < 4; c++)
+				{
+					real[c] = _mm256_fmadd_ps(joint[c], weight, real[c]);
+					dual[c] = _mm256_fmadd_ps(joint[4 + c], weight, dual[c]);
+				}
+			}
+
+			__m256 lengthSq = _mm256_fmadd_ps(real[0], real[0], _mm256_fmadd_ps(real[1], real[1],
+				_mm256_fmadd_ps(real[2], real[2], _mm256_mul_ps(real[3], real[3]))));
+			__m256 inverseLength = _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_sqrt_ps(lengthSq));
+			for (int c = 0; c < 4; c++)
+			{
+				real[c] = _mm256_mul_ps(real[c], inverseLength);
+				dual[c] = _mm256_mul_ps(dual[c], inverseLength);
+			}
+
+			// translation = 2 * (real.w * dual.xyz - dual.w * real.xyz + real.xyz x dual.xyz)
+			__m256 translation[3];
+			Cross8(real, dual, translation);
+			for (int c = 0; c < 3; c++)
+			{
+				__m256 t = _mm256_add_ps(translation[c], _mm256_fmsub_ps(real[3], dual[c], _mm256_mul_ps(dual[3], real[c])));
+				translation[c] = _mm256_add_ps(t, t);
+			}
+
+			VertexLanes lanes;
+			LoadVertices8(vertices + i, lanes);
+			Rotate8(lanes.position, real);
+			Rotate8(lanes.normal, real);
+			Rotate8(lanes.tangent, real);
+			for (int c = 0; c < 3; c++)
+			{
+				lanes.position[c] = _mm256_add_ps(lanes.position[c], translation[c]);
+				lo[c] = _mm256_min_ps(lo[c], lanes.position[c]);
+				hi[c] = _mm256_max_ps(hi[c], lanes.position[c]);
+			}
+			Normalize8(lanes.normal);
+			Normalize8(lanes.tangent);
+			StoreVertices8(lanes, output + i);
+		}
+		StoreBounds8(lo, hi, min, max);
+		return i;
+	}
+#endif
+}
+
+SkinnedMesh::SkinnedMesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<SkinWeights> weights)
+	: vertices(std::move(vertices)), indices(std::move(indices)), weights(std::move(weights))
+{
+	this->weights.resize(this->vertices.size());
+	for (SkinWeights& skin : this->weights)
+	{
+		// Heaviest first - insertion sort, it's four
+		for (int k = 0; k < 4; k++)
+			skin.weights[k] = (std::max)(skin.weights[k], 0.0f);
+		for (int k = 1; k < 4; k++)
+		{
+			for (int j = k; j > 0 && skin.weights[j] > skin.weights[j - 1]; j--)
+			{
+				std::swap(skin.weights[j], skin.weights[j - 1]);
+				std::swap(skin.joints[j], skin.joints[j - 1]);
+			}
+		}
+
+		float total = skin.weights[0] + skin.weights[1] + skin.weights[2] + skin.weights[3];
+		if (total <= 0.0f)
+			skin = SkinWeights();
+		for (int k = 0; k < 4; k++)
+		{
+			if (total > 0.0f)
+				skin.weights[k] /= total;
+			if (skin.weights[k] > 0.0f)
+				jointCount = (std::max)(jointCount, skin.joints[k] + 1u);
+		}
+	}
+}
+
+MeshHandle SkinnedMesh::CreateOutputMesh(ResourceRegistry& resources, IRenderBackend& backend) const
+{
+	std::vector<Vertex> initial = vertices;
+	std::vector<unsigned int> initialIndices = indices;
+	return resources.Create<Mesh>(initial.data(), (int)initial.size(), initialIndices.data(), (int)initialIndices.size(),
+		backend, BufferUsage::Dynamic);
+}
+
+bool CpuSkinner::Add(const SkinnedMesh& mesh, const SkinningPalette& palette, Vertex* output, AABB* bounds)
+{
+	if (!output || palette.matrices.size() < mesh.GetJointCount() || palette.dualQuaternions.size() < mesh.GetJointCount())
+		return false;
+
+	tasks.push_back({ &mesh, &palette, output, bounds, chunkCount });
+	chunkCount += (mesh.GetVertexCount() + ChunkVertices - 1) / ChunkVertices;
+	return true;
+}
+
+void CpuSkinner::Run(JobSystem& jobSystem, SkinningMode mode)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	chunkBounds.resize(chunkCount);
+
+	// Chunks of every mesh in one loop - a chunk finds its mesh by
+	// searching the tasks' first chunks
+	jobSystem.ParallelFor(chunkCount, 1, [&](size_t begin, size_t end)
+	{
+		for (size_t chunk = begin; chunk < end; chunk++)
+		{
+			const Task& task = *(std::upper_bound(tasks.begin(), tasks.end(), (uint32_t)chunk,
+				[](uint32_t value, const Task& t) { return value < t.firstChunk; }) - 1);
+			uint32_t first = ((uint32_t)chunk - task.firstChunk) * ChunkVertices;
+			uint32_t last = (std::min)(first + ChunkVertices, task.mesh->GetVertexCount());
+			SkinVertices(*task.mesh, *task.palette, mode, first, last, task.output, chunkBounds[chunk].min, chunkBounds[chunk].max);
+		}
+	});
+
+	stats = SkinningStats();
+	for (size_t t = 0; t < tasks.size(); t++)
+	{
+		const Task& task = tasks[t];
+		stats.vertices += task.mesh->GetVertexCount();
+		if (!task.bounds || task.mesh->GetVertexCount() == 0)
+			continue;
+
+		uint32_t endChunk = t + 1 < tasks.size() ? tasks[t + 1].firstChunk : chunkCount;
+		XMVECTOR min = XMLoadFloat3(&chunkBounds[task.firstChunk].min);
+		XMVECTOR max = XMLoadFloat3(&chunkBounds[task.firstChunk].max);
+		for (uint32_t chunk = task.firstChunk + 1; chunk < endChunk; chunk++)
+		{
+			min = XMVectorMin(min, XMLoadFloat3(&chunkBounds[chunk].min));
+			max = XMVectorMax(max, XMLoadFloat3(&chunkBounds[chunk].max));
+		}
+		XMFLOAT3 boxMin, boxMax;
+		XMStoreFloat3(&boxMin, min);
+		XMStoreFloat3(&boxMax, max);
+		*task.bounds = AABB::FromMinMax(boxMin, boxMax);
+	}
+
+	stats.meshes = (uint32_t)tasks.size();
+	stats.chunks = chunkCount;
+	stats.ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	tasks.clear();
+	chunkCount = 0;
+}
+
+void SkinVertices(const SkinnedMesh& mesh, const SkinningPalette& palette, SkinningMode mode,
+	uint32_t begin, uint32_t end, Vertex* output, XMFLOAT3& min, XMFLOAT3& max)
+{
+	const Vertex* vertices = mesh.GetVertices().data();
+	const SkinWeights* weights = mesh.GetWeights().data();
+	XMVECTOR boxMin = XMVectorReplicate(FLT_MAX);
+	XMVECTOR boxMax = XMVectorReplicate(-FLT_MAX);
+#if HAS_AVX2_PATHS
+	// Eight at a time while there are eight left, then four-wide
+	if (CpuHasAvx2() && end - begin >= 8)
+	{
+		XMFLOAT3 wideMin, wideMax;
+		if (mode == SkinningMode::Linear)
+			begin = SkinLinearAvx2(vertices, weights, palette.matrices.data(), begin, end, output, wideMin, wideMax);
+		else
+			begin = SkinDualQuaternionAvx2(vertices, weights, palette.dualQuaternions.data(), begin, end, output, wideMin, wideMax);
+		boxMin = XMLoadFloat3(&wideMin);
+		boxMax = XMLoadFloat3(&wideMax);
+	}
+#endif
+	if (mode == SkinningMode::Linear)
+		SkinLinear(vertices, weights, palette.matrices.data(), begin, end, output, boxMin, boxMax);
+	else
+		SkinDualQuaternion(vertices, weights, palette.dualQuaternions.data(), begin, end, output, boxMin, boxMax);
+	XMStoreFloat3(&min, boxMin);
+	XMStoreFloat3(&max, boxMax);
+}
+
+Skeleton CreateTubeSkeleton(uint32_t jointCount, float length)
+{
+	jointCount = (std::min)((std::max)(jointCount, 1u), Skeleton::MaxJoints);
+	float spacing = jointCount > 1 ? length / (jointCount - 1) : 0.0f;
+
+	Skeleton skeleton;
+	JointPose pose;
+	uint16_t parent = Skeleton::NoParent;
+	for (uint32_t joint = 0; joint < jointCount; joint++)
+	{
+		pose.translation = XMFLOAT3(0.0f, joint == 0 ? 0.0f : spacing, 0.0f);
+		parent = skeleton.AddJoint(parent, pose);
+	}
+	return skeleton;
+}
+
+SkinnedMesh CreateSkinnedTube(uint32_t jointCount, float length, float radius, uint32_t rings, uint32_t sides)
+{
+	jointCount = (std::min)((std::max)(jointCount, 1u), Skeleton::MaxJoints);
+	rings = (std::max)(rings, 1u);
+	sides = (std::max)(sides, 3u);
+	float spacing = jointCount > 1 ? length / (jointCount - 1) : 1.0f;
+
+	std::vector<Vertex> vertices;
+	std::vector<SkinWeights> weights;
+	for (uint32_t ring = 0; ring <= rings; ring++)
+	{
+		float v = (float)ring / rings;
+		float y = v * length;
+
+		// The four joints nearest along the tube, falling off over a
+		// joint and a half
+		SkinWeights skin;
+		float along = y / spacing;
+		int nearest = (int)floorf(along);
+		for (int k = 0; k < 4; k++)
+		{
+			int joint = (std::min)((std::max)(nearest - 1 + k, 0), (int)jointCount - 1);
+			float falloff = (std::max)(0.0f, 1.0f - fabsf(along - (nearest - 1 + k)) / 1.5f);
+			skin.joints[k] = (uint8_t)joint;
+			skin.weights[k] = falloff * falloff;
+		}
+
+		for (uint32_t side = 0; side <= sides; side++)
+		{
+			float u = (float)side / sides;
+			float angle = u * XM_2PI;
+			float c = cosf(angle), s = sinf(angle);
+
+			Vertex vertex;
+			vertex.Position = XMFLOAT3(c * radius, y, s * radius);
+			vertex.Normal = XMFLOAT3(c, 0.0f, s);
+			vertex.UV = XMFLOAT2(u, 1.0f - v);
+			vertex.Tangent = XMFLOAT3(-s, 0.0f, c);
+			vertices.push_back(vertex);
+			weights.push_back(skin);
+		}
+	}
+
+	// Wound clockwise seen from outside, like the OBJ meshes
+	std::vector<unsigned int> indices;
+	for (uint32_t ring = 0; ring < rings; ring++)
+	{
+		for (uint32_t side = 0; side < sides; side++)
+		{
+			unsigned int a = ring * (sides + 1) + side;
+			unsigned int b = a + sides + 1;
+			indices.insert(indices.end(), { a, b, a + 1, a + 1, b, b + 1 });
+		}
+	}
+	return SkinnedMesh(std::move(vertices), std::move(indices), std::move(weights));
+}
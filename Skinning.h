@@ -0,0 +1,134 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <cstdint>
+#include <vector>
+#include "Bounds.h"
+#include "JobSystem.h"
+#include "ResourceRegistry.h"
+#include "Skeleton.h"
+#include "Vertex.h"
+
+enum class SkinningMode
+{
+	Linear,				// Blends the joints' matrices - cheap, but twists collapse
+	DualQuaternion		// Blends rigid transforms, keeping volume - joint scale is ignored
+};
+
+// The joints moving a vertex, heaviest first.  Weights are
+// non-negative and sum to one; unused slots have weight zero.
+struct SkinWeights
+{
+	uint8_t joints[4] = {};
+	float weights[4] = { 1.0f, 0.0f, 0.0f, 0.0f };
+};
+
+// --------------------------------------------------------
+// A mesh as modelled - its vertices in the skeleton's bind pose,
+// indices, and each vertex's joints and weights - kept on the CPU
+// for CpuSkinner to skin from.  What's drawn is a separate Mesh
+// with a dynamic vertex buffer (CreateOutputMesh()), rewritten
+// with the skinned vertices every frame.
+// --------------------------------------------------------
+class SkinnedMesh
+{
+public:
+	// Weights are sorted heaviest first and normalized; a vertex
+	// with no weight at all follows joint 0
+	SkinnedMesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<SkinWeights> weights);
+
+	uint32_t GetVertexCount() const { return (uint32_t)vertices.size(); }
+	const std::vector<Vertex>& GetVertices() const { return vertices; }
+	const std::vector<unsigned int>& GetIndices() const { return indices; }
+	const std::vector<SkinWeights>& GetWeights() const { return weights; }
+
+	// One more than the highest joint any vertex uses - the palette
+	// has to have at least this many
+	uint32_t GetJointCount() const { return jointCount; }
+
+	// A Mesh of the bind pose with a dynamic vertex buffer, to skin into
+	MeshHandle CreateOutputMesh(ResourceRegistry& resources, IRenderBackend& backend) const;
+
+private:
+	std::vector<Vertex> vertices;
+	std::vector<unsigned int> indices;
+	std::vector<SkinWeights> weights;
+	uint32_t jointCount = 0;
+};
+
+struct SkinningStats
+{
+	uint32_t meshes = 0;		// In the last Run()
+	uint32_t chunks = 0;
+	uint64_t vertices = 0;
+	double ms = 0.0;
+};
+
+// --------------------------------------------------------
+// Skins meshes on the CPU, positions, normals and tangents, four
+// weights a vertex.
+//
+// Add() queues each mesh with its palette and where its vertices
+// go - typically the mapped vertex buffer of its output mesh.
+// Run() cuts every queued mesh into chunks of ChunkVertices and
+// skins all the chunks, of all the meshes, in one parallel loop,
+// so a single big mesh and many small ones both spread over the
+// workers.  Each chunk writes only its own vertices, in order,
+// and never reads them back - fine for write-combined memory.
+//
+// Per vertex, linear blending sums the weighted palette matrices
+// and transforms by the sum; dual quaternion blending sums the
+// weighted dual quaternions, flipping any on the far side of the
+// first, and normalizes.  Both work a whole row or quaternion at
+// a time in vector registers, or with AVX2 eight vertices at a
+// time, a vertex a lane.  Normals and tangents are renormalized.
+// --------------------------------------------------------
+class CpuSkinner
+{
+public:
+	static const uint32_t ChunkVertices = 1024;
+
+	// False, and nothing queued, if the palette is short of joints
+	// the mesh uses.  bounds, if set, gets the skinned vertices'
+	// box once Run() is done.  Everything passed in has to stay put
+	// until then.
+	bool Add(const SkinnedMesh& mesh, const SkinningPalette& palette, Vertex* output, AABB* bounds = nullptr);
+
+	// Skins everything queued and empties the queue
+	void Run(JobSystem& jobSystem, SkinningMode mode);
+
+	const SkinningStats& GetStats() const { return stats; }
+
+private:
+	struct Task
+	{
+		const SkinnedMesh* mesh;
+		const SkinningPalette* palette;
+		Vertex* output;
+		AABB* bounds;
+		uint32_t firstChunk;
+	};
+
+	struct ChunkBounds
+	{
+		DirectX::XMFLOAT3 min;
+		DirectX::XMFLOAT3 max;
+	};
+
+	std::vector<Task> tasks;
+	std::vector<ChunkBounds> chunkBounds;
+	uint32_t chunkCount = 0;
+	SkinningStats stats;
+};
+
+// Skins vertices [begin, end) of a mesh on the calling thread,
+// and sets min and max to their box - what CpuSkinner's jobs run
+void SkinVertices(const SkinnedMesh& mesh, const SkinningPalette& palette, SkinningMode mode,
+	uint32_t begin, uint32_t end, Vertex* output, DirectX::XMFLOAT3& min, DirectX::XMFLOAT3& max);
+
+// An open tube along +y from the origin, length long, and a chain
+// of jointCount joints up its middle to bend it.  Each ring of
+// vertices is weighted to the nearest joints, falling off with
+// distance along the tube, so most vertices use four.
+Skeleton CreateTubeSkeleton(uint32_t jointCount, float length);
+SkinnedMesh CreateSkinnedTube(uint32_t jointCount, float length, float radius, uint32_t rings, uint32_t sides);
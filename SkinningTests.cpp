@@ -0,0 +1,522 @@
+#include "SkinningTests.h"
+#include "HeadlessTests.h"
+#include "RecordingBackend.h"
+#include "Mesh.h"
+#include "ResourceRegistry.h"
+#include "JobSystem.h"
+#include "AnimationClip.h"
+#include "CpuFeatures.h"
+#include "Skeleton.h"
+#include "Skinning.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+	// The bind pose with every joint turned a random amount
+	std::vector<JointPose> RandomSkeletonPose(std::mt19937& random, const Skeleton& skeleton, float amount)
+	{
+		std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+		std::vector<JointPose> pose = skeleton.GetBindPose();
+		for (JointPose& joint : pose)
+		{
+			XMVECTOR turn = XMQuaternionRotationRollPitchYaw(unit(random) * amount, unit(random) * amount, unit(random) * amount);
+			XMStoreFloat4(&joint.rotation, XMQuaternionMultiply(XMLoadFloat4(&joint.rotation), turn));
+		}
+		return pose;
+	}
+
+	// Random vertices around the origin with random unit normals
+	// and tangents, each on one to four random joints
+	SkinnedMesh CreateRandomSkinnedMesh(std::mt19937& random, uint32_t vertexCount, uint32_t jointCount)
+	{
+		std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+		std::vector<Vertex> vertices(vertexCount);
+		std::vector<SkinWeights> weights(vertexCount);
+		for (uint32_t i = 0; i < vertexCount; i++)
+		{
+			Vertex& vertex = vertices[i];
+			vertex.Position = XMFLOAT3(unit(random) * 2.0f, unit(random) * 2.0f + 2.0f, unit(random) * 2.0f);
+			XMVECTOR normal = XMVector3Normalize(XMVectorSet(unit(random), unit(random), unit(random) + 0.01f, 0));
+			XMVECTOR tangent = XMVector3Normalize(XMVector3Cross(normal, XMVectorSet(0.3f, 1.0f, 0.2f, 0)));
+			XMStoreFloat3(&vertex.Normal, normal);
+			XMStoreFloat3(&vertex.Tangent, tangent);
+			vertex.UV = XMFLOAT2(unit(random), unit(random));
+
+			uint32_t influences = 1 + i % 4;
+			for (uint32_t k = 0; k < influences; k++)
+			{
+				weights[i].joints[k] = (uint8_t)(random() % jointCount);
+				weights[i].weights[k] = 0.05f + (unit(random) + 1.0f);
+			}
+		}
+		return SkinnedMesh(std::move(vertices), std::vector<unsigned int>(), std::move(weights));
+	}
+
+	// Skinning in doubles, one vertex at a time, straight from the
+	// palette - the reference for CpuSkinner
+	struct ReferenceVertex
+	{
+		double position[3];
+		double normal[3];
+		double tangent[3];
+	};
+
+	void Normalize3(double v[3])
+	{
+		double length = sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+		for (int i = 0; i < 3; i++)
+			v[i] /= length;
+	}
+
+	void Cross3(const double a[3], const double b[3], double out[3])
+	{
+		out[0] = a[1] * b[2] - a[2] * b[1];
+		out[1] = a[2] * b[0] - a[0] * b[2];
+		out[2] = a[0] * b[1] - a[1] * b[0];
+	}
+
+	// v rotated by the unit quaternion q (x, y, z, w)
+	void Rotate3(const double q[4], const double v[3], double out[3])
+	{
+		double t[3], u[3], c[3];
+		Cross3(q, v, c);
+		for (int i = 0; i < 3; i++)
+			t[i] = c[i] + q[3] * v[i];
+		Cross3(q, t, u);
+		for (int i = 0; i < 3; i++)
+			out[i] = v[i] + 2.0 * u[i];
+	}
+
+	ReferenceVertex ReferenceSkin(const Vertex& vertex, const SkinWeights& skin, const SkinningPalette& palette, SkinningMode mode)
+	{
+		const double position[3] = { vertex.Position.x, vertex.Position.y, vertex.Position.z };
+		const double normal[3] = { vertex.Normal.x, vertex.Normal.y, vertex.Normal.z };
+		const double tangent[3] = { vertex.Tangent.x, vertex.Tangent.y, vertex.Tangent.z };
+		ReferenceVertex out = {};
+
+		if (mode == SkinningMode::Linear)
+		{
+			double m[4][4] = {};
+			for (int k = 0; k < 4; k++)
+			{
+				const XMFLOAT4X4& joint = palette.matrices[skin.joints[k]];
+				for (int r = 0; r < 4; r++)
+					for (int c = 0; c < 4; c++)
+						m[r][c] += (double)skin.weights[k] * joint.m[r][c];
+			}
+			for (int c = 0; c < 3; c++)
+			{
+				out.position[c] = position[0] * m[0][c] + position[1] * m[1][c] + position[2] * m[2][c] + m[3][c];
+				out.normal[c] = normal[0] * m[0][c] + normal[1] * m[1][c] + normal[2] * m[2][c];
+				out.tangent[c] = tangent[0] * m[0][c] + tangent[1] * m[1][c] + tangent[2] * m[2][c];
+			}
+		}
+		else
+		{
+			const DualQuaternion& first = palette.dualQuaternions[skin.joints[0]];
+			double real[4] = {}, dual[4] = {};
+			for (int k = 0; k < 4; k++)
+			{
+				const DualQuaternion& joint = palette.dualQuaternions[skin.joints[k]];
+				double dot = (double)first.real.x * joint.real.x + (double)first.real.y * joint.real.y +
+					(double)first.real.z * joint.real.z + (double)first.real.w * joint.real.w;
+				double weight = dot < 0.0 ? -(double)skin.weights[k] : skin.weights[k];
+				for (int i = 0; i < 4; i++)
+				{
+					real[i] += weight * (&joint.real.x)[i];
+					dual[i] += weight * (&joint.dual.x)[i];
+				}
+			}
+			double length = sqrt(real[0] * real[0] + real[1] * real[1] + real[2] * real[2] + real[3] * real[3]);
+			for (int i = 0; i < 4; i++)
+			{
+				real[i] /= length;
+				dual[i] /= length;
+			}
+
+			double cross[3], translation[3];
+			Cross3(real, dual, cross);
+			for (int i = 0; i < 3; i++)
+				translation[i] = 2.0 * (real[3] * dual[i] - dual[3] * real[i] + cross[i]);
+			Rotate3(real, position, out.position);
+			for (int i = 0; i < 3; i++)
+				out.position[i] += translation[i];
+			Rotate3(real, normal, out.normal);
+			Rotate3(real, tangent, out.tangent);
+		}
+		Normalize3(out.normal);
+		Normalize3(out.tangent);
+		return out;
+	}
+
+	// Worst position, normal and tangent difference from the reference
+	XMFLOAT3 CompareToReference(const SkinnedMesh& mesh, const SkinningPalette& palette, SkinningMode mode, const Vertex* skinned)
+	{
+		XMFLOAT3 worst(0, 0, 0);
+		for (uint32_t i = 0; i < mesh.GetVertexCount(); i++)
+		{
+			ReferenceVertex expected = ReferenceSkin(mesh.GetVertices()[i], mesh.GetWeights()[i], palette, mode);
+			const Vertex& actual = skinned[i];
+			for (int c = 0; c < 3; c++)
+			{
+				worst.x = (std::max)(worst.x, (float)fabs(expected.position[c] - (&actual.Position.x)[c]));
+				worst.y = (std::max)(worst.y, (float)fabs(expected.normal[c] - (&actual.Normal.x)[c]));
+				worst.z = (std::max)(worst.z, (float)fabs(expected.tangent[c] - (&actual.Tangent.x)[c]));
+			}
+		}
+		return worst;
+	}
+
+	// Skins a whole mesh into output on the job system
+	AABB SkinMesh(CpuSkinner& skinner, JobSystem& jobSystem, const SkinnedMesh& mesh, const SkinningPalette& palette,
+		SkinningMode mode, std::vector<Vertex>& output)
+	{
+		AABB bounds;
+		output.resize(mesh.GetVertexCount());
+		skinner.Add(mesh, palette, output.data(), &bounds);
+		skinner.Run(jobSystem, mode);
+		return bounds;
+	}
+}
+
+int RunSkinningBench(const SkinningBenchSettings& settings)
+{
+	int threads = settings.threadCount > 0 ? settings.threadCount : (int)std::thread::hardware_concurrency();
+	threads = (std::max)(threads, 1);
+	JobSystem serial(0);
+	JobSystem parallel(threads - 1);
+	printf("Skinning bench: %d meshes, %d joints, %d frames, %u threads\n",
+		settings.meshCount, settings.jointCount, settings.frames, parallel.GetThreadCount());
+	int failures = 0;
+	char detail[256];
+
+	std::mt19937 random(31337);
+	CpuSkinner skinner;
+	const SkinningMode modes[] = { SkinningMode::Linear, SkinningMode::DualQuaternion };
+	const char* modeNames[] = { "linear", "dual quaternion" };
+
+	// The four-wide kernels, and the AVX2 ones where the CPU has them
+	const int kernelCount = CpuHasAvx2() ? 2 : 1;
+	const char* kernelNames[] = { "4-wide", "AVX2" };
+
+	// Joint model matrices put each joint where walking its local
+	// poses up from it to the root does
+	{
+		Skeleton skeleton = CreateRandomSkeleton(random, 64, true);
+		std::vector<JointPose> pose = RandomSkeletonPose(random, skeleton, 1.0f);
+		std::vector<XMFLOAT4X4> model(skeleton.GetJointCount());
+		skeleton.ComputeModelMatrices(pose.data(), model.data());
+
+		float worst = 0.0f;
+		for (uint32_t joint = 0; joint < skeleton.GetJointCount(); joint++)
+		{
+			XMVECTOR point = XMVectorSet(0.1f, 0.2f, 0.3f, 1.0f);
+			for (uint16_t j = (uint16_t)joint; j != Skeleton::NoParent; j = skeleton.GetParent(j))
+				point = XMVector3Transform(point, Skeleton::PoseMatrix(pose[j]));
+			XMFLOAT3 walked, expected;
+			XMStoreFloat3(&walked, point);
+			XMStoreFloat3(&expected, XMVector3Transform(XMVectorSet(0.1f, 0.2f, 0.3f, 1.0f), XMLoadFloat4x4(&model[joint])));
+			worst = (std::max)(worst, MaxDifference(walked, expected));
+		}
+		snprintf(detail, sizeof(detail), "off by %.1e at worst over %u joints", worst, skeleton.GetJointCount());
+		failures += ReportCheck("model matrices follow the hierarchy", worst < 1e-4f, detail);
+	}
+
+	// Joints without a clip, and channels a clip lacks, hold the bind pose
+	{
+		Skeleton skeleton = CreateRandomSkeleton(random, 4, true);
+		AnimationClip turn;
+		AnimationCurve& rotation = turn.GetCurve(AnimationChannel::Rotation);
+		rotation.times = { 0.0f, 1.0f };
+		rotation.values = { XMFLOAT4(0, 0, 0, 1), XMFLOAT4(0, 0.70710678f, 0, 0.70710678f) };
+		turn.Finalize();
+
+		const AnimationClip* clips[4] = { nullptr, &turn, nullptr, &turn };
+		AnimationCursor cursors[4];
+		JointPose pose[4];
+		skeleton.SamplePose(clips, 0.5f, cursors, pose);
+		const std::vector<JointPose>& bind = skeleton.GetBindPose();
+		bool held = memcmp(&pose[0], &bind[0], sizeof(JointPose)) == 0 && memcmp(&pose[2], &bind[2], sizeof(JointPose)) == 0 &&
+			memcmp(&pose[1].translation, &bind[1].translation, sizeof(XMFLOAT3)) == 0 &&
+			memcmp(&pose[3].scale, &bind[3].scale, sizeof(XMFLOAT3)) == 0;
+		float angle = QuaternionAngle(XMLoadFloat4(&pose[1].rotation), XMQuaternionRotationRollPitchYaw(0, XM_PIDIV4, 0));
+		snprintf(detail, sizeof(detail), "%s, sampled rotation %.1e radians off", held ? "bind pose held" : "bind pose lost", angle);
+		failures += ReportCheck("poses sample clips over the bind pose", held && angle < 1e-5f, detail);
+	}
+
+	// The bind pose skins every vertex back where it was
+	{
+		Skeleton skeleton = CreateRandomSkeleton(random, 32, true);
+		SkinnedMesh mesh = CreateRandomSkinnedMesh(random, 5000, 32);
+		SkinningPalette palette;
+		skeleton.ComputePalette(skeleton.GetBindPose().data(), palette);
+
+		float worst = 0.0f;
+		std::vector<Vertex> output;
+		for (SkinningMode mode : modes)
+		{
+			SkinMesh(skinner, parallel, mesh, palette, mode, output);
+			for (uint32_t i = 0; i < mesh.GetVertexCount(); i++)
+			{
+				worst = (std::max)(worst, MaxDifference(output[i].Position, mesh.GetVertices()[i].Position));
+				worst = (std::max)(worst, MaxDifference(output[i].Normal, mesh.GetVertices()[i].Normal));
+			}
+		}
+		snprintf(detail, sizeof(detail), "off by %.1e at worst", worst);
+		failures += ReportCheck("the bind pose leaves vertices in place", worst < 1e-4f, detail);
+	}
+
+	// Against the double precision reference, posed, in both modes
+	// and with both kernels - linear with scaled joints too.  The
+	// odd vertex count leaves the AVX2 kernels a few for the
+	// four-wide ones.
+	{
+		for (int m = 0; m < 2; m++)
+		{
+			for (int kernel = 0; kernel < kernelCount; kernel++)
+			{
+				SetAvx2Enabled(kernel == 1);
+				XMFLOAT3 worst(0, 0, 0);
+				for (int scaled = 0; scaled < (modes[m] == SkinningMode::Linear ? 2 : 1); scaled++)
+				{
+					Skeleton skeleton = CreateRandomSkeleton(random, 48, scaled != 0);
+					SkinnedMesh mesh = CreateRandomSkinnedMesh(random, 20003, 48);
+					std::vector<JointPose> pose = RandomSkeletonPose(random, skeleton, 1.5f);
+					SkinningPalette palette;
+					skeleton.ComputePalette(pose.data(), palette);
+
+					std::vector<Vertex> output;
+					SkinMesh(skinner, parallel, mesh, palette, modes[m], output);
+					XMFLOAT3 error = CompareToReference(mesh, palette, modes[m], output.data());
+					worst = XMFLOAT3((std::max)(worst.x, error.x), (std::max)(worst.y, error.y), (std::max)(worst.z, error.z));
+				}
+				char name[64];
+				snprintf(name, sizeof(name), "%s, %s, matches the reference", modeNames[m], kernelNames[kernel]);
+				snprintf(detail, sizeof(detail), "off by %.1e in position, %.1e in normal, %.1e in tangent", worst.x, worst.y, worst.z);
+				failures += ReportCheck(name, worst.x < 1e-4f && worst.y < 1e-4f && worst.z < 1e-4f, detail);
+			}
+		}
+		SetAvx2Enabled(true);
+	}
+
+	// With one joint a vertex and no scale, both modes are the same
+	// rigid transform
+	{
+		Skeleton skeleton = CreateRandomSkeleton(random, 16, false);
+		SkinnedMesh blended = CreateRandomSkinnedMesh(random, 4000, 16);
+		std::vector<SkinWeights> rigid = blended.GetWeights();
+		for (SkinWeights& skin : rigid)
+			skin.weights[1] = skin.weights[2] = skin.weights[3] = 0.0f;
+		SkinnedMesh mesh(blended.GetVertices(), blended.GetIndices(), rigid);
+		std::vector<JointPose> pose = RandomSkeletonPose(random, skeleton, 2.0f);
+		SkinningPalette palette;
+		skeleton.ComputePalette(pose.data(), palette);
+
+		std::vector<Vertex> linear, dual;
+		SkinMesh(skinner, parallel, mesh, palette, SkinningMode::Linear, linear);
+		SkinMesh(skinner, parallel, mesh, palette, SkinningMode::DualQuaternion, dual);
+		float worst = 0.0f;
+		for (uint32_t i = 0; i < mesh.GetVertexCount(); i++)
+		{
+			worst = (std::max)(worst, MaxDifference(linear[i].Position, dual[i].Position));
+			worst = (std::max)(worst, MaxDifference(linear[i].Normal, dual[i].Normal));
+		}
+		snprintf(detail, sizeof(detail), "off by %.1e at worst", worst);
+		failures += ReportCheck("rigid vertices skin the same both ways", worst < 1e-4f, detail);
+	}
+
+	// A tube twisted half a turn at its middle: linear blending
+	// pinches it, dual quaternions keep its radius
+	{
+		const uint32_t jointCount = 3;
+		Skeleton skeleton = CreateTubeSkeleton(jointCount, 4.0f);
+		SkinnedMesh tube = CreateSkinnedTube(jointCount, 4.0f, 0.5f, 32, 32);
+		std::vector<JointPose> pose = skeleton.GetBindPose();
+		XMStoreFloat4(&pose[1].rotation, XMQuaternionRotationRollPitchYaw(0, XM_PI * 0.9f, 0));
+		SkinningPalette palette;
+		skeleton.ComputePalette(pose.data(), palette);
+
+		float narrowest[2] = { FLT_MAX, FLT_MAX };
+		std::vector<Vertex> output;
+		for (int m = 0; m < 2; m++)
+		{
+			SkinMesh(skinner, serial, tube, palette, modes[m], output);
+			for (const Vertex& vertex : output)
+				narrowest[m] = (std::min)(narrowest[m], sqrtf(vertex.Position.x * vertex.Position.x + vertex.Position.z * vertex.Position.z));
+		}
+		snprintf(detail, sizeof(detail), "narrowest radius %.3f linear, %.3f dual quaternion, of 0.5", narrowest[0], narrowest[1]);
+		failures += ReportCheck("dual quaternions keep a twist's volume", narrowest[1] > 0.45f && narrowest[0] < narrowest[1], detail);
+	}
+
+	// Chunks come out the same on any number of threads, in one mesh
+	// or spread over many, and the bounds hold every vertex
+	{
+		Skeleton skeleton = CreateRandomSkeleton(random, 32, true);
+		std::vector<SkinnedMesh> meshes;
+		for (uint32_t i = 0; i < 6; i++)
+			meshes.push_back(CreateRandomSkinnedMesh(random, i * 1500 + (i % 2 ? CpuSkinner::ChunkVertices : 7), 32));
+		std::vector<JointPose> pose = RandomSkeletonPose(random, skeleton, 1.0f);
+		SkinningPalette palette;
+		skeleton.ComputePalette(pose.data(), palette);
+
+		size_t differing = 0;
+		size_t outside = 0;
+		bool shortPaletteRefused = false;
+		for (SkinningMode mode : modes)
+		{
+			std::vector<std::vector<Vertex>> outputs[2];
+			std::vector<AABB> bounds(meshes.size());
+			for (int j = 0; j < 2; j++)
+			{
+				outputs[j].resize(meshes.size());
+				for (size_t i = 0; i < meshes.size(); i++)
+				{
+					outputs[j][i].resize(meshes[i].GetVertexCount());
+					skinner.Add(meshes[i], palette, outputs[j][i].data(), &bounds[i]);
+				}
+				skinner.Run(j == 0 ? serial : parallel, mode);
+			}
+			for (size_t i = 0; i < meshes.size(); i++)
+			{
+				differing += memcmp(outputs[0][i].data(), outputs[1][i].data(), outputs[0][i].size() * sizeof(Vertex)) != 0;
+				for (const Vertex& vertex : outputs[1][i])
+				{
+					for (int c = 0; c < 3; c++)
+						outside += fabsf((&vertex.Position.x)[c] - (&bounds[i].center.x)[c]) > (&bounds[i].extents.x)[c] + 1e-5f;
+				}
+			}
+
+			SkinningPalette shortPalette;
+			shortPalette.matrices.resize(8);
+			shortPalette.dualQuaternions.resize(8);
+			shortPaletteRefused = !skinner.Add(meshes[1], shortPalette, outputs[0][1].data());
+		}
+		snprintf(detail, sizeof(detail), "%zu of %zu meshes differ, %zu vertices outside their bounds, short palette %s",
+			differing, meshes.size() * 2, outside, shortPaletteRefused ? "refused" : "accepted");
+		failures += ReportCheck("threads, chunks and bounds", differing == 0 && outside == 0 && shortPaletteRefused, detail);
+	}
+
+	// Into a mesh's dynamic vertex buffer, through the backend
+	{
+		RecordingBackend backend;
+		{
+			ResourceRegistry resources(backend, backend.CreateFence());
+			Skeleton skeleton = CreateTubeSkeleton(8, 4.0f);
+			SkinnedMesh tube = CreateSkinnedTube(8, 4.0f, 0.5f, 64, 32);
+			MeshHandle handle = tube.CreateOutputMesh(resources, backend);
+			Mesh* mesh = resources.Get(handle);
+			MeshHandle fixed = CreateBenchCube(resources, backend);
+
+			std::vector<JointPose> pose = RandomSkeletonPose(random, skeleton, 0.5f);
+			SkinningPalette palette;
+			skeleton.ComputePalette(pose.data(), palette);
+			Vertex* mapped = mesh->MapVertices();
+			AABB bounds;
+			bool queued = skinner.Add(tube, palette, mapped, &bounds);
+			skinner.Run(parallel, SkinningMode::DualQuaternion);
+			mesh->UnmapVertices(bounds);
+
+			bool boundsSet = memcmp(&mesh->GetLocalBounds(), &bounds, sizeof(AABB)) == 0;
+
+			// Unmapped without bounds, the last ones stay
+			bool remapped = mesh->MapVertices() != nullptr;
+			mesh->UnmapVertices();
+			boundsSet &= remapped && memcmp(&mesh->GetLocalBounds(), &bounds, sizeof(AABB)) == 0;
+
+			bool fixedRefused = resources.Get(fixed)->MapVertices() == nullptr;
+			snprintf(detail, sizeof(detail), "%s, %u vertices, bounds %s, immutable mesh %s, %zu backend errors",
+				queued && mapped ? "mapped" : "not mapped", tube.GetVertexCount(), boundsSet ? "set and kept" : "not set",
+				fixedRefused ? "refused" : "mapped", backend.GetErrors().size());
+			failures += ReportCheck("skinning into a dynamic vertex buffer",
+				mapped && queued && boundsSet && fixedRefused && backend.GetErrors().empty(), detail);
+		}
+	}
+
+	// Throughput: tubes of a few thousand vertices on their own
+	// skeletons, posed and skinned every frame
+	{
+		const uint32_t rings = 127, sides = 63;
+		std::vector<Skeleton> skeletons;
+		std::vector<SkinnedMesh> meshes;
+		std::vector<std::vector<Vertex>> outputs(settings.meshCount);
+		std::vector<SkinningPalette> palettes(settings.meshCount);
+		std::vector<std::vector<AnimationClip>> clips(settings.meshCount);
+		uint64_t vertexCount = 0;
+		for (int i = 0; i < settings.meshCount; i++)
+		{
+			skeletons.push_back(CreateTubeSkeleton(settings.jointCount, 8.0f));
+			meshes.push_back(CreateSkinnedTube(settings.jointCount, 8.0f, 0.5f, rings, sides));
+			outputs[i].resize(meshes.back().GetVertexCount());
+			vertexCount += meshes.back().GetVertexCount();
+
+			// Every joint swings back and forth about z, out of step
+			for (int joint = 0; joint < settings.jointCount; joint++)
+			{
+				AnimationClip clip;
+				AnimationCurve& curve = clip.GetCurve(AnimationChannel::Rotation);
+				for (int k = 0; k <= 8; k++)
+				{
+					XMFLOAT4 q;
+					XMStoreFloat4(&q, XMQuaternionRotationRollPitchYaw(0, 0, 0.3f * sinf(k * XM_PIDIV4 + joint + i)));
+					curve.times.push_back(k * 0.25f);
+					curve.values.push_back(q);
+				}
+				clip.Finalize();
+				clips[i].push_back(clip);
+			}
+		}
+
+		std::vector<const AnimationClip*> clipPointers((size_t)settings.jointCount);
+		std::vector<AnimationCursor> cursors((size_t)settings.jointCount);
+		std::vector<JointPose> pose((size_t)settings.jointCount);
+		int frames = (std::max)(settings.frames, 1);
+		printf("\n  %llu vertices in %d meshes\n", (unsigned long long)vertexCount, settings.meshCount);
+		for (int m = 0; m < 2; m++)
+		{
+			for (int run = 0; run < kernelCount * 2; run++)
+			{
+				int kernel = run / 2;
+				JobSystem& jobSystem = run % 2 == 0 ? serial : parallel;
+				SetAvx2Enabled(kernel == 1);
+				double poseMs = 0.0, skinMs = 0.0;
+				for (int frame = 0; frame < frames; frame++)
+				{
+					auto start = std::chrono::high_resolution_clock::now();
+					for (int i = 0; i < settings.meshCount; i++)
+					{
+						for (int joint = 0; joint < settings.jointCount; joint++)
+							clipPointers[joint] = &clips[i][joint];
+						skeletons[i].SamplePose(clipPointers.data(), frame / 60.0f, cursors.data(), pose.data());
+						skeletons[i].ComputePalette(pose.data(), palettes[i]);
+					}
+					auto posed = std::chrono::high_resolution_clock::now();
+					for (int i = 0; i < settings.meshCount; i++)
+						skinner.Add(meshes[i], palettes[i], outputs[i].data());
+					skinner.Run(jobSystem, modes[m]);
+					auto skinned = std::chrono::high_resolution_clock::now();
+					poseMs += Milliseconds(posed - start);
+					skinMs += Milliseconds(skinned - posed);
+				}
+				printf("  %-16s %-6s %2u thread%s: %8.3f ms skinning (%7.0f vertices/ms), %6.3f ms posing (%.2f us a joint)\n",
+					modeNames[m], kernelNames[kernel], jobSystem.GetThreadCount(), jobSystem.GetThreadCount() == 1 ? " " : "s",
+					skinMs / frames, vertexCount * frames / skinMs, poseMs / frames,
+					poseMs / frames * 1000.0 / ((double)settings.meshCount * settings.jointCount));
+			}
+		}
+		SetAvx2Enabled(true);
+		printf("\n");
+	}
+
+	return ReportFailures(failures);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+// --------------------------------------------------------
+// Skinning bench: meshCount tubes of 8192 vertices, each with
+// its own chain of jointCount joints swinging from per joint
+// clips.  Every frame samples each skeleton's pose, builds its
+// palette and skins all the meshes, timed for linear and dual
+// quaternion blending, with the four-wide kernels and the AVX2
+// ones if the CPU has them, on one thread and on threadCount,
+// printed as vertices skinned a millisecond and posing cost a
+// joint.
+//
+// Checks:
+//  - model matrices put each joint where walking its local
+//    poses up to the root does
+//  - sampled poses keep the bind pose wherever there's no clip
+//  - the bind pose skins every vertex back in place
+//  - both modes, with both kernels, match a double precision
+//    scalar reference on random skeletons and weights, posed,
+//    linear with scaled joints too
+//  - vertices on one joint skin the same in both modes
+//  - a tube twisted nearly half a turn keeps its radius with
+//    dual quaternions and pinches with linear blending
+//  - one thread and many give bit for bit the same vertices,
+//    the bounds hold them, and a short palette is refused
+//  - skinning into a mapped dynamic vertex buffer through the
+//    recording backend, and immutable meshes refusing to map
+//
+// Returns 0 if all checks passed.
+// --------------------------------------------------------
+struct SkinningBenchSettings
+{
+	int meshCount = 64;
+	int jointCount = 32;
+	int frames = 20;			// Per mode and thread count
+	int threadCount = -1;		// Including the caller, negative = every hardware thread
+};
+
+int RunSkinningBench(const SkinningBenchSettings& settings);
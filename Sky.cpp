@@ -10,7 +10,7 @@
 using namespace DirectX;
 
 Sky::Sky(
-    std::shared_ptr<Mesh> mesh,
+    MeshHandle mesh,
     Microsoft::WRL::ComPtr<ID3D11SamplerState> sampler,
     const wchar_t* right, const wchar_t* left,
     const wchar_t* up, const wchar_t* down,
@@ -74,41 +74,45 @@ Sky::Sky(
 
 Sky::~Sky() {}
 
-void Sky::Draw(std::shared_ptr<Camera> camera)
+void Sky::Draw(IRenderBackend& backend, ID3D11DeviceContext* context, const ResourceRegistry& resources,
+    const DirectX::XMFLOAT4X4& view, const DirectX::XMFLOAT4X4& projection)
 {
+    Mesh* skyMesh = resources.Get(mesh);
+    if (!skyMesh)
+        return;
 
     // Set sky-specific render states
-    Graphics::Context->RSSetState(skyRasterState.Get());
-    Graphics::Context->OMSetDepthStencilState(skyDepthState.Get(), 0);
+    context->RSSetState(skyRasterState.Get());
+    context->OMSetDepthStencilState(skyDepthState.Get(), 0);
 
     // Set sky shaders
-    Graphics::Context->VSSetShader(skyVS.Get(), 0, 0);
-    Graphics::Context->PSSetShader(skyPS.Get(), 0, 0);
+    context->VSSetShader(skyVS.Get(), 0, 0);
+    context->PSSetShader(skyPS.Get(), 0, 0);
 
     // Bind cube map texture and sampler to pixel shader
-    Graphics::Context->PSSetShaderResources(0, 1, skySRV.GetAddressOf());
-    Graphics::Context->PSSetSamplers(0, 1, sampler.GetAddressOf());
+    context->PSSetShaderResources(0, 1, skySRV.GetAddressOf());
+    context->PSSetSamplers(0, 1, sampler.GetAddressOf());
 
     // Upload view + projection matrices to the sky VS constant buffer
     // Note: strip translation from view matrix so sky never moves
     SkyVSData data = {};
-    data.view = camera->GetViewMatrix();
+    data.view = view;
     //data.view._14 = 0; data.view._24 = 0; data.view._34 = 0;
-    data.projection = camera->GetProjectionMatrix();
+    data.projection = projection;
 
     D3D11_MAPPED_SUBRESOURCE mapped = {};
-    Graphics::Context->Map(skyVSConstantBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+    context->Map(skyVSConstantBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
     memcpy(mapped.pData, &data, sizeof(SkyVSData));
-    Graphics::Context->Unmap(skyVSConstantBuffer.Get(), 0);
+    context->Unmap(skyVSConstantBuffer.Get(), 0);
 
-    Graphics::Context->VSSetConstantBuffers(0, 1, skyVSConstantBuffer.GetAddressOf());
+    context->VSSetConstantBuffers(0, 1, skyVSConstantBuffer.GetAddressOf());
 
     // Draw the cube mesh
-    mesh->Draw(Graphics::Context);
+    skyMesh->Draw(backend);
 
     // Restore default render states so regular geometry draws correctly
-    Graphics::Context->RSSetState(nullptr);
-    Graphics::Context->OMSetDepthStencilState(nullptr, 0);
+    context->RSSetState(nullptr);
+    context->OMSetDepthStencilState(nullptr, 0);
 }
 
 Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> Sky::CreateCubemap(
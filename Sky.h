@@ -5,13 +5,14 @@
 #include <memory>
 #include "Mesh.h"
 #include "Camera.h"
+#include "ResourceRegistry.h"
 
 
 class Sky
 {
 public:
     Sky(
-        std::shared_ptr<Mesh> mesh,
+        MeshHandle mesh,
         Microsoft::WRL::ComPtr<ID3D11SamplerState> sampler,
         const wchar_t* right,
         const wchar_t* left,
@@ -24,7 +25,12 @@ public:
     );
     ~Sky();
 
-    void Draw(std::shared_ptr<Camera> camera);
+    // Sky states and constants are still set straight through D3D11
+    // (on whichever context the pass records into), only the mesh
+    // itself goes through the backend.  Draws nothing once the mesh
+    // is released.
+    void Draw(IRenderBackend& backend, ID3D11DeviceContext* context, const ResourceRegistry& resources,
+        const DirectX::XMFLOAT4X4& view, const DirectX::XMFLOAT4X4& projection);
 
 private:
     Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>    skySRV;
@@ -32,7 +38,7 @@ private:
     Microsoft::WRL::ComPtr<ID3D11RasterizerState>       skyRasterState;
     Microsoft::WRL::ComPtr<ID3D11DepthStencilState>     skyDepthState;
 
-    std::shared_ptr<Mesh>               mesh;
+    MeshHandle                          mesh;
     Microsoft::WRL::ComPtr<ID3D11VertexShader>  skyVS;
     Microsoft::WRL::ComPtr<ID3D11PixelShader>   skyPS;
 
@@ -0,0 +1,373 @@
+#include "SpatialHashGrid.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <utility>
+
+using namespace DirectX;
+
+namespace
+{
+	const int CellBias = 1 << 20;
+
+	uint64_t CellKey(int x, int y, int z)
+	{
+		return ((uint64_t)(x + CellBias) << 42) | ((uint64_t)(y + CellBias) << 21) | (uint64_t)(z + CellBias);
+	}
+
+	float DistanceSquared(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		float x = a.x - b.x;
+		float y = a.y - b.y;
+		float z = a.z - b.z;
+		return x * x + y * y + z * z;
+	}
+}
+
+void SpatialHashGrid::CellOf(const XMFLOAT3& position, int cell[3]) const
+{
+	const float p[3] = { position.x, position.y, position.z };
+	for (int axis = 0; axis < 3; axis++)
+	{
+		float c = floorf(p[axis] * inverseCellSize);
+		c = (std::max)((std::min)(c, (float)CellLimit), -(float)CellLimit);
+		cell[axis] = (int)c;
+	}
+}
+
+// Fibonacci hashing - the top bits of the key times 2^64 / phi
+uint32_t SpatialHashGrid::BucketOf(uint64_t key) const
+{
+	return (uint32_t)((key * 0x9E3779B97F4A7C15ull) >> (64 - bucketBits));
+}
+
+// --------------------------------------------------------
+// Rebuilds the grid from scratch for these points
+// --------------------------------------------------------
+void SpatialHashGrid::Build(JobSystem& jobSystem, const XMFLOAT3* positions, size_t count, float newCellSize)
+{
+	cellSize = newCellSize;
+	inverseCellSize = 1.0f / newCellSize;
+	entries.resize(count);
+	stats = SpatialHashStats();
+	stats.count = count;
+
+	// Twice as many buckets as points, so most cells get their own
+	bucketBits = 6;
+	while (((size_t)1 << bucketBits) < count * 2)
+		bucketBits++;
+	size_t buckets = (size_t)1 << bucketBits;
+	if (buckets > bucketCapacity)
+	{
+		bucketCounts.reset(new std::atomic<uint32_t>[buckets]);
+		bucketCapacity = buckets;
+	}
+	bucketStart.resize(buckets + 1);
+	stats.buckets = buckets;
+
+	jobSystem.ParallelFor(buckets, BucketChunkSize, [&](size_t begin, size_t end)
+	{
+		for (size_t b = begin; b < end; b++)
+			bucketCounts[b].store(0, std::memory_order_relaxed);
+	});
+
+	// Each point's cell, bucket and slot in the bucket
+	pointCells.resize(count);
+	pointBuckets.resize(count);
+	pointRanks.resize(count);
+	chunkRanges.resize(JobSystem::GetChunkCount(count, BuildChunkSize));
+	jobSystem.ParallelFor(count, BuildChunkSize, [&](size_t begin, size_t end)
+	{
+		CellRange range = { { CellLimit, CellLimit, CellLimit }, { -CellLimit, -CellLimit, -CellLimit } };
+		for (size_t i = begin; i < end; i++)
+		{
+			int cell[3];
+			CellOf(positions[i], cell);
+			for (int axis = 0; axis < 3; axis++)
+			{
+				range.min[axis] = (std::min)(range.min[axis], cell[axis]);
+				range.max[axis] = (std::max)(range.max[axis], cell[axis]);
+			}
+
+			uint64_t key = CellKey(cell[0], cell[1], cell[2]);
+			uint32_t bucket = BucketOf(key);
+			pointCells[i] = key;
+			pointBuckets[i] = bucket;
+			pointRanks[i] = bucketCounts[bucket].fetch_add(1, std::memory_order_relaxed);
+		}
+		chunkRanges[begin / BuildChunkSize] = range;
+	});
+
+	occupied = { { CellLimit, CellLimit, CellLimit }, { -CellLimit, -CellLimit, -CellLimit } };
+	for (const CellRange& range : chunkRanges)
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			occupied.min[axis] = (std::min)(occupied.min[axis], range.min[axis]);
+			occupied.max[axis] = (std::max)(occupied.max[axis], range.max[axis]);
+		}
+	}
+
+	// Exclusive prefix sum of the counts: each chunk of buckets sums
+	// its own, the chunk sums are scanned here, and each chunk then
+	// writes its starts from its offset
+	size_t bucketChunks = JobSystem::GetChunkCount(buckets, BucketChunkSize);
+	chunkSums.resize(bucketChunks);
+	chunkStats.resize(bucketChunks);
+	jobSystem.ParallelFor(buckets, BucketChunkSize, [&](size_t begin, size_t end)
+	{
+		SpatialHashStats chunk;
+		uint32_t sum = 0;
+		for (size_t b = begin; b < end; b++)
+		{
+			uint32_t bucketCount = bucketCounts[b].load(std::memory_order_relaxed);
+			sum += bucketCount;
+			chunk.usedBuckets += bucketCount > 0 ? 1 : 0;
+			chunk.largestBucket = (std::max)(chunk.largestBucket, bucketCount);
+		}
+		chunkSums[begin / BucketChunkSize] = sum;
+		chunkStats[begin / BucketChunkSize] = chunk;
+	});
+
+	uint32_t offset = 0;
+	for (size_t c = 0; c < bucketChunks; c++)
+	{
+		uint32_t sum = chunkSums[c];
+		chunkSums[c] = offset;
+		offset += sum;
+		stats.usedBuckets += chunkStats[c].usedBuckets;
+		stats.largestBucket = (std::max)(stats.largestBucket, chunkStats[c].largestBucket);
+	}
+
+	jobSystem.ParallelFor(buckets, BucketChunkSize, [&](size_t begin, size_t end)
+	{
+		uint32_t start = chunkSums[begin / BucketChunkSize];
+		for (size_t b = begin; b < end; b++)
+		{
+			bucketStart[b] = start;
+			start += bucketCounts[b].load(std::memory_order_relaxed);
+		}
+	});
+	bucketStart[buckets] = (uint32_t)count;
+
+	// Scatter - every point already knows its slot
+	jobSystem.ParallelFor(count, BuildChunkSize, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			Entry& entry = entries[bucketStart[pointBuckets[i]] + pointRanks[i]];
+			entry.position = positions[i];
+			entry.index = (uint32_t)i;
+			entry.cell = pointCells[i];
+		}
+	});
+}
+
+// --------------------------------------------------------
+// Shrinks the range to the occupied cells, false if nothing's
+// left of it
+// --------------------------------------------------------
+bool SpatialHashGrid::ClampToOccupied(CellRange& range) const
+{
+	for (int axis = 0; axis < 3; axis++)
+	{
+		range.min[axis] = (std::max)(range.min[axis], occupied.min[axis]);
+		range.max[axis] = (std::min)(range.max[axis], occupied.max[axis]);
+		if (range.min[axis] > range.max[axis])
+			return false;
+	}
+	return true;
+}
+
+template<typename Visit>
+void SpatialHashGrid::VisitCells(const CellRange& range, Visit visit) const
+{
+	double cells = 1.0;
+	for (int axis = 0; axis < 3; axis++)
+		cells *= (double)range.max[axis] - range.min[axis] + 1.0;
+
+	// More cells than buckets - cheaper to walk every point
+	if (cells > (double)(bucketStart.size() - 1))
+	{
+		for (const Entry& entry : entries)
+			visit(entry);
+		return;
+	}
+
+	for (int z = range.min[2]; z <= range.max[2]; z++)
+	{
+		for (int y = range.min[1]; y <= range.max[1]; y++)
+		{
+			for (int x = range.min[0]; x <= range.max[0]; x++)
+			{
+				uint64_t key = CellKey(x, y, z);
+				uint32_t bucket = BucketOf(key);
+				for (uint32_t e = bucketStart[bucket]; e < bucketStart[bucket + 1]; e++)
+				{
+					if (entries[e].cell == key)
+						visit(entries[e]);
+				}
+			}
+		}
+	}
+}
+
+void SpatialHashGrid::QueryRadius(XMFLOAT3 center, float radius, std::vector<uint32_t>& results) const
+{
+	if (entries.empty() || radius < 0.0f)
+		return;
+
+	CellRange range;
+	CellOf(XMFLOAT3(center.x - radius, center.y - radius, center.z - radius), range.min);
+	CellOf(XMFLOAT3(center.x + radius, center.y + radius, center.z + radius), range.max);
+	if (!ClampToOccupied(range))
+		return;
+
+	float radiusSquared = radius * radius;
+	VisitCells(range, [&](const Entry& entry)
+	{
+		if (DistanceSquared(entry.position, center) <= radiusSquared)
+			results.push_back(entry.index);
+	});
+}
+
+void SpatialHashGrid::QueryBox(const AABB& box, std::vector<uint32_t>& results) const
+{
+	if (entries.empty())
+		return;
+
+	XMFLOAT3 boxMin(box.center.x - box.extents.x, box.center.y - box.extents.y, box.center.z - box.extents.z);
+	XMFLOAT3 boxMax(box.center.x + box.extents.x, box.center.y + box.extents.y, box.center.z + box.extents.z);
+	CellRange range;
+	CellOf(boxMin, range.min);
+	CellOf(boxMax, range.max);
+	if (!ClampToOccupied(range))
+		return;
+
+	VisitCells(range, [&](const Entry& entry)
+	{
+		const XMFLOAT3& p = entry.position;
+		if (p.x >= boxMin.x && p.x <= boxMax.x &&
+			p.y >= boxMin.y && p.y <= boxMax.y &&
+			p.z >= boxMin.z && p.z <= boxMax.z)
+			results.push_back(entry.index);
+	});
+}
+
+// --------------------------------------------------------
+// Searches shells of cells outward from the center's cell,
+// keeping the k best in a max heap.  After the shells out to
+// ring r every point closer than the nearest face of that
+// block of cells has been seen, so it stops once the k-th best
+// is no further than that - or the block covers every occupied
+// cell, or the block has more cells than there are buckets and
+// the rest is a walk over every point.
+// --------------------------------------------------------
+void SpatialHashGrid::QueryNearest(XMFLOAT3 center, size_t k, std::vector<uint32_t>& results, float maxDistance) const
+{
+	results.clear();
+	if (entries.empty() || k == 0 || maxDistance < 0.0f)
+		return;
+
+	typedef std::pair<float, uint32_t> Candidate;	// Squared distance, index
+	std::vector<Candidate> best;
+	best.reserve((std::min)(k, entries.size()) + 1);
+	float maxDistanceSquared = maxDistance == FLT_MAX ? FLT_MAX : maxDistance * maxDistance;
+	auto consider = [&](const Entry& entry)
+	{
+		Candidate candidate(DistanceSquared(entry.position, center), entry.index);
+		if (candidate.first > maxDistanceSquared)
+			return;
+		if (best.size() < k)
+		{
+			best.push_back(candidate);
+			std::push_heap(best.begin(), best.end());
+		}
+		else if (candidate < best.front())
+		{
+			std::pop_heap(best.begin(), best.end());
+			best.back() = candidate;
+			std::push_heap(best.begin(), best.end());
+		}
+	};
+
+	int c[3];
+	CellOf(center, c);
+	const float p[3] = { center.x, center.y, center.z };
+
+	// Rings nearer than the occupied cells are empty
+	int firstRing = 0;
+	int lastRing = 0;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		firstRing = (std::max)(firstRing, (std::max)(occupied.min[axis] - c[axis], c[axis] - occupied.max[axis]));
+		lastRing = (std::max)(lastRing, (std::max)(c[axis] - occupied.min[axis], occupied.max[axis] - c[axis]));
+	}
+
+	size_t buckets = bucketStart.size() - 1;
+	for (int r = firstRing; r <= lastRing; r++)
+	{
+		CellRange block = { { c[0] - r, c[1] - r, c[2] - r }, { c[0] + r, c[1] + r, c[2] + r } };
+		if (!ClampToOccupied(block))
+			continue;
+
+		double blockCells = 1.0;
+		for (int axis = 0; axis < 3; axis++)
+			blockCells *= (double)block.max[axis] - block.min[axis] + 1.0;
+		if (blockCells > (double)buckets)
+		{
+			// Starting over on every point also revisits the rings so far
+			best.clear();
+			for (const Entry& entry : entries)
+				consider(entry);
+			break;
+		}
+
+		// Just the ring's cells: all of its z and y faces, the two x
+		// ends of every row in between
+		auto visitCell = [&](int x, int y, int z)
+		{
+			uint64_t key = CellKey(x, y, z);
+			uint32_t bucket = BucketOf(key);
+			for (uint32_t e = bucketStart[bucket]; e < bucketStart[bucket + 1]; e++)
+			{
+				if (entries[e].cell == key)
+					consider(entries[e]);
+			}
+		};
+		for (int z = block.min[2]; z <= block.max[2]; z++)
+		{
+			for (int y = block.min[1]; y <= block.max[1]; y++)
+			{
+				if (abs(z - c[2]) == r || abs(y - c[1]) == r)
+				{
+					for (int x = block.min[0]; x <= block.max[0]; x++)
+						visitCell(x, y, z);
+					continue;
+				}
+				if (c[0] - r >= block.min[0])
+					visitCell(c[0] - r, y, z);
+				if (r > 0 && c[0] + r <= block.max[0])
+					visitCell(c[0] + r, y, z);
+			}
+		}
+
+		// Everything nearer than the block's closest face has been seen
+		float covered = FLT_MAX;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			covered = (std::min)(covered, p[axis] - (float)(c[axis] - r) * cellSize);
+			covered = (std::min)(covered, (float)(c[axis] + r + 1) * cellSize - p[axis]);
+		}
+		covered = (std::max)(covered, 0.0f);
+		if (covered * covered >= maxDistanceSquared)
+			break;
+		if (best.size() == k && best.front().first <= covered * covered)
+			break;
+	}
+
+	std::sort_heap(best.begin(), best.end());
+	results.resize(best.size());
+	for (size_t i = 0; i < best.size(); i++)
+		results[i] = best[i].second;
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <cfloat>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <DirectXMath.h>
+#include "Bounds.h"
+#include "JobSystem.h"
+
+// --------------------------------------------------------
+// The grid as of the last Build()
+// --------------------------------------------------------
+struct SpatialHashStats
+{
+	size_t count = 0;
+	size_t buckets = 0;
+	size_t usedBuckets = 0;
+	uint32_t largestBucket = 0;		// Points in the fullest bucket
+};
+
+// --------------------------------------------------------
+// Uniform grid over points, hashed into a flat table - for
+// neighbourhood queries over things that move every frame,
+// where refitting a tree would cost more than starting over.
+//
+// Build() replaces every point at once, a counting sort on the
+// job system:
+//  - each point's cell goes through a multiplicative hash into
+//    one of a power of two buckets (at least twice the points),
+//    and an atomic count per bucket gives the point its slot
+//  - a prefix sum over the counts, by chunks, gives each bucket
+//    its start
+//  - the points are scattered into one array, by bucket
+// Nothing is allocated per cell, and nothing at all once the
+// arrays have grown to the point count.
+//
+// Cells that share a bucket keep their own points apart by the
+// full cell key stored with each point.  Queries visit the cells
+// they overlap, clamped to the cells that hold anything, and
+// walk every point instead once that's more cells than buckets.
+//
+// Queries are const and safe from several threads at once, but
+// not during Build().
+// --------------------------------------------------------
+class SpatialHashGrid
+{
+public:
+	static const size_t BuildChunkSize = 4096;		// Points per job
+	static const size_t BucketChunkSize = 16384;	// Buckets per job in the prefix sum
+
+	void Build(JobSystem& jobSystem, const DirectX::XMFLOAT3* positions, size_t count, float cellSize);
+
+	// Each appends the indices of the points inside, in no order
+	void QueryRadius(DirectX::XMFLOAT3 center, float radius, std::vector<uint32_t>& results) const;
+	void QueryBox(const AABB& box, std::vector<uint32_t>& results) const;
+
+	// Replaces results with up to k nearest points within maxDistance,
+	// nearest first, ties to the lower index
+	void QueryNearest(DirectX::XMFLOAT3 center, size_t k, std::vector<uint32_t>& results, float maxDistance = FLT_MAX) const;
+
+	size_t GetCount() const { return entries.size(); }
+	float GetCellSize() const { return cellSize; }
+	const SpatialHashStats& GetStats() const { return stats; }
+
+private:
+	// Cells are clamped to 21 bits an axis so a key fits in 64
+	static const int CellLimit = (1 << 20) - 1;
+
+	struct Entry
+	{
+		DirectX::XMFLOAT3 position;
+		uint32_t index;
+		uint64_t cell;
+	};
+
+	struct CellRange
+	{
+		int min[3];
+		int max[3];
+	};
+
+	float cellSize = 1.0f;
+	float inverseCellSize = 1.0f;
+	unsigned int bucketBits = 0;
+	std::vector<Entry> entries;				// By bucket
+	std::vector<uint32_t> bucketStart;		// Per bucket, plus the end
+	CellRange occupied = {};				// Cells holding any point
+	SpatialHashStats stats;
+
+	// Build scratch
+	std::unique_ptr<std::atomic<uint32_t>[]> bucketCounts;
+	size_t bucketCapacity = 0;
+	std::vector<uint64_t> pointCells;		// Per point
+	std::vector<uint32_t> pointBuckets;
+	std::vector<uint32_t> pointRanks;		// Slot within the bucket
+	std::vector<CellRange> chunkRanges;		// Per build chunk
+	std::vector<uint32_t> chunkSums;		// Per bucket chunk
+	std::vector<SpatialHashStats> chunkStats;
+
+	void CellOf(const DirectX::XMFLOAT3& position, int cell[3]) const;
+	uint32_t BucketOf(uint64_t key) const;
+	bool ClampToOccupied(CellRange& range) const;
+
+	// Calls visit(entry) for each point in the range's cells
+	template<typename Visit> void VisitCells(const CellRange& range, Visit visit) const;
+};
@@ -0,0 +1,286 @@
+#include "SpatialHashGridTests.h"
+#include "HeadlessTests.h"
+#include "JobSystem.h"
+#include "SpatialHashGrid.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+	// What the grid's queries find, by testing every point
+	struct LinearPointQueries
+	{
+		const std::vector<XMFLOAT3>& points;
+
+		static float DistanceSquared(const XMFLOAT3& a, const XMFLOAT3& b)
+		{
+			float x = a.x - b.x;
+			float y = a.y - b.y;
+			float z = a.z - b.z;
+			return x * x + y * y + z * z;
+		}
+
+		void InRadius(XMFLOAT3 center, float radius, std::vector<uint32_t>& results) const
+		{
+			for (uint32_t i = 0; i < (uint32_t)points.size(); i++)
+			{
+				if (DistanceSquared(points[i], center) <= radius * radius)
+					results.push_back(i);
+			}
+		}
+
+		void InBox(const AABB& box, std::vector<uint32_t>& results) const
+		{
+			for (uint32_t i = 0; i < (uint32_t)points.size(); i++)
+			{
+				const XMFLOAT3& p = points[i];
+				if (p.x >= box.center.x - box.extents.x && p.x <= box.center.x + box.extents.x &&
+					p.y >= box.center.y - box.extents.y && p.y <= box.center.y + box.extents.y &&
+					p.z >= box.center.z - box.extents.z && p.z <= box.center.z + box.extents.z)
+					results.push_back(i);
+			}
+		}
+
+		// Nearest first, ties to the lower index
+		void Nearest(XMFLOAT3 center, size_t k, std::vector<uint32_t>& results, float maxDistance = FLT_MAX) const
+		{
+			std::vector<std::pair<float, uint32_t>> all;
+			for (uint32_t i = 0; i < (uint32_t)points.size(); i++)
+			{
+				float distanceSquared = DistanceSquared(points[i], center);
+				if (maxDistance == FLT_MAX || distanceSquared <= maxDistance * maxDistance)
+					all.push_back({ distanceSquared, i });
+			}
+			size_t found = (std::min)(k, all.size());
+			std::partial_sort(all.begin(), all.begin() + found, all.end());
+			results.clear();
+			for (size_t i = 0; i < found; i++)
+				results.push_back(all[i].second);
+		}
+	};
+
+	// Every query kind on the grid against the linear scan
+	bool GridMatchesLinear(const SpatialHashGrid& grid, const std::vector<XMFLOAT3>& points, XMFLOAT3 center, float radius, size_t k, float maxDistance = FLT_MAX)
+	{
+		LinearPointQueries linear = { points };
+		std::vector<uint32_t> results;
+		std::vector<uint32_t> expected;
+		grid.QueryRadius(center, radius, results);
+		linear.InRadius(center, radius, expected);
+		bool matched = SameIndices(results, expected);
+
+		AABB box;
+		box.center = center;
+		box.extents = XMFLOAT3(radius, radius * 0.5f, radius * 2.0f);
+		results.clear();
+		expected.clear();
+		grid.QueryBox(box, results);
+		linear.InBox(box, expected);
+		matched &= SameIndices(results, expected);
+
+		grid.QueryNearest(center, k, results, maxDistance);
+		linear.Nearest(center, k, expected, maxDistance);
+		return matched && results == expected;
+	}
+}
+
+int RunSpatialHashBench(const SpatialHashBenchSettings& settings)
+{
+	int threads = settings.threadCount > 0 ? settings.threadCount : (int)std::thread::hardware_concurrency();
+	threads = (std::max)(threads, 1);
+	JobSystem serial(0);
+	JobSystem parallel(threads - 1);
+	printf("Spatial hash bench: %d queries of each kind (%d checked linearly), %d builds, %u threads\n",
+		settings.queries, settings.checkedQueries, settings.frames, parallel.GetThreadCount());
+	int failures = 0;
+	char detail[256];
+
+	std::vector<int> sizes;
+	for (int size = 1000; size <= settings.maxEntityCount; size *= 10)
+		sizes.push_back(size);
+	if (sizes.empty() || sizes.back() != settings.maxEntityCount)
+		sizes.push_back(settings.maxEntityCount);
+
+	const float cellSize = 5.0f;
+	const float radius = 5.0f;
+	const size_t k = 8;
+	for (int size : sizes)
+	{
+		// One point per 2 x 2 x 2 on average, whatever the count
+		float worldSize = 2.0f * cbrtf((float)size);
+		std::mt19937 rng(59);
+		std::uniform_real_distribution<float> position(-worldSize * 0.5f, worldSize * 0.5f);
+		std::uniform_real_distribution<float> step(-1.0f, 1.0f);
+		std::vector<XMFLOAT3> points(size);
+		for (XMFLOAT3& point : points)
+			point = XMFLOAT3(position(rng), position(rng), position(rng));
+
+		// Every point moves up to a unit a frame, the grid is built anew
+		SpatialHashGrid grids[2];
+		double buildMs[2] = { 0.0, 0.0 };
+		for (int frame = 0; frame < settings.frames; frame++)
+		{
+			for (XMFLOAT3& point : points)
+			{
+				point.x += step(rng);
+				point.y += step(rng);
+				point.z += step(rng);
+			}
+			for (int g = 0; g < 2; g++)
+			{
+				auto start = std::chrono::high_resolution_clock::now();
+				grids[g].Build(g == 0 ? serial : parallel, points.data(), points.size(), cellSize);
+				buildMs[g] += Milliseconds(std::chrono::high_resolution_clock::now() - start);
+			}
+		}
+		if (settings.frames <= 0)
+		{
+			grids[0].Build(serial, points.data(), points.size(), cellSize);
+			grids[1].Build(parallel, points.data(), points.size(), cellSize);
+		}
+		int frames = (std::max)(settings.frames, 1);
+		const SpatialHashGrid& grid = grids[1];
+		const SpatialHashStats& stats = grid.GetStats();
+		printf("\n  %d points: build %.3f ms on 1 thread, %.3f ms on %u, %zu of %zu buckets used, %u at most\n",
+			size, buildMs[0] / frames, buildMs[1] / frames, parallel.GetThreadCount(),
+			stats.usedBuckets, stats.buckets, stats.largestBucket);
+
+		LinearPointQueries linear = { points };
+		std::mt19937 queryRng(61);
+		struct Kind { const char* name; double gridMs; double linearMs; size_t hits; };
+		Kind kinds[3] = { { "radius", 0, 0, 0 }, { "box", 0, 0, 0 }, { "nearest", 0, 0, 0 } };
+		bool matched = true;
+		bool buildsAgree = true;
+		std::vector<uint32_t> results;
+		std::vector<uint32_t> expected;
+		for (int q = 0; q < settings.queries; q++)
+		{
+			bool check = q < settings.checkedQueries;
+			XMFLOAT3 center(position(queryRng), position(queryRng), position(queryRng));
+			AABB box;
+			box.center = center;
+			box.extents = XMFLOAT3(radius, radius, radius);
+
+			for (int kind = 0; kind < 3; kind++)
+			{
+				results.clear();
+				auto start = std::chrono::high_resolution_clock::now();
+				switch (kind)
+				{
+				case 0: grid.QueryRadius(center, radius, results); break;
+				case 1: grid.QueryBox(box, results); break;
+				case 2: grid.QueryNearest(center, k, results); break;
+				}
+				kinds[kind].gridMs += Milliseconds(std::chrono::high_resolution_clock::now() - start);
+				kinds[kind].hits += results.size();
+				if (!check)
+					continue;
+
+				expected.clear();
+				start = std::chrono::high_resolution_clock::now();
+				switch (kind)
+				{
+				case 0: linear.InRadius(center, radius, expected); break;
+				case 1: linear.InBox(box, expected); break;
+				case 2: linear.Nearest(center, k, expected); break;
+				}
+				kinds[kind].linearMs += Milliseconds(std::chrono::high_resolution_clock::now() - start);
+				matched &= kind == 2 ? results == expected : SameIndices(results, expected);
+
+				// The serial build answers the same
+				std::vector<uint32_t> serialResults;
+				switch (kind)
+				{
+				case 0: grids[0].QueryRadius(center, radius, serialResults); break;
+				case 1: grids[0].QueryBox(box, serialResults); break;
+				case 2: grids[0].QueryNearest(center, k, serialResults); break;
+				}
+				buildsAgree &= kind == 2 ? serialResults == results : SameIndices(serialResults, results);
+			}
+		}
+
+		int checked = (std::min)(settings.queries, settings.checkedQueries);
+		printf("    query      grid us   linear us   speedup   hits each\n");
+		for (const Kind& kind : kinds)
+		{
+			double gridUs = kind.gridMs * 1000.0 / (std::max)(settings.queries, 1);
+			double linearUs = checked > 0 ? kind.linearMs * 1000.0 / checked : 0.0;
+			printf("    %-7s %10.2f %11.1f %8.0fx %11.1f\n",
+				kind.name, gridUs, linearUs, gridUs > 0.0 ? linearUs / gridUs : 0.0, (double)kind.hits / (std::max)(settings.queries, 1));
+		}
+
+		snprintf(detail, sizeof(detail), "%d points", size);
+		failures += ReportCheck("queries match a linear scan", matched, detail);
+		failures += ReportCheck("1 and many threads build the same grid", buildsAgree, detail);
+	}
+
+	// Hand-made edge cases -------------------------------------------------------
+	printf("\n");
+	{
+		// A lattice on the cell corners, 1 unit cells, around the origin -
+		// radius 1 queries from lattice points touch exactly 6 neighbours
+		std::vector<XMFLOAT3> lattice;
+		for (int z = -3; z <= 3; z++)
+			for (int y = -3; y <= 3; y++)
+				for (int x = -3; x <= 3; x++)
+					lattice.push_back(XMFLOAT3((float)x, (float)y, (float)z));
+		SpatialHashGrid grid;
+		grid.Build(parallel, lattice.data(), lattice.size(), 1.0f);
+		bool matched = true;
+		for (const XMFLOAT3& point : lattice)
+			matched &= GridMatchesLinear(grid, lattice, point, 1.0f, 7);
+		std::vector<uint32_t> results;
+		grid.QueryRadius(XMFLOAT3(0, 0, 0), 1.0f, results);
+		snprintf(detail, sizeof(detail), "%zu points, %zu within 1 of the origin", lattice.size(), results.size());
+		failures += ReportCheck("points on cell boundaries", matched && results.size() == 7, detail);
+
+		// Ten copies of each of three points - the nearest come back by index
+		std::vector<XMFLOAT3> copies;
+		for (int i = 0; i < 30; i++)
+			copies.push_back(XMFLOAT3((float)(i % 3) * 2.0f - 10.5f, -4.25f, 7.0f));
+		grid.Build(parallel, copies.data(), copies.size(), 1.5f);
+		grid.QueryNearest(XMFLOAT3(-10.5f, -4.25f, 7.0f), 4, results);
+		bool tied = results == std::vector<uint32_t>{ 0, 3, 6, 9 };
+		snprintf(detail, sizeof(detail), "nearest %u %u %u %u", results.size() > 0 ? results[0] : 0, results.size() > 1 ? results[1] : 0,
+			results.size() > 2 ? results[2] : 0, results.size() > 3 ? results[3] : 0);
+		failures += ReportCheck("duplicates tie to the lower index", tied && GridMatchesLinear(grid, copies, XMFLOAT3(-9.0f, -4.0f, 7.5f), 1.0f, 13), detail);
+
+		// More neighbours than points, a distance limit, far away queries
+		std::mt19937 rng(67);
+		std::uniform_real_distribution<float> position(-20.0f, 20.0f);
+		std::vector<XMFLOAT3> sparse(50);
+		for (XMFLOAT3& point : sparse)
+			point = XMFLOAT3(position(rng), position(rng), position(rng));
+		grid.Build(serial, sparse.data(), sparse.size(), 2.0f);
+		grid.QueryNearest(XMFLOAT3(0, 0, 0), 100, results);
+		bool all = results.size() == sparse.size() && GridMatchesLinear(grid, sparse, XMFLOAT3(0, 0, 0), 6.0f, 100);
+		failures += ReportCheck("asking for more than there are returns all", all, "50 points, 100 asked for");
+
+		bool limited = true;
+		for (int q = 0; q < 50; q++)
+			limited &= GridMatchesLinear(grid, sparse, XMFLOAT3(position(rng), position(rng), position(rng)), 4.0f, 10, 8.0f);
+		failures += ReportCheck("nearest within a distance limit", limited, "10 nearest within 8");
+
+		bool far = GridMatchesLinear(grid, sparse, XMFLOAT3(5000.0f, -3000.0f, 100.0f), 10.0f, 5) &&
+			GridMatchesLinear(grid, sparse, XMFLOAT3(0, 0, 0), 1e6f, 5) &&
+			GridMatchesLinear(grid, sparse, XMFLOAT3(-1e7f, 0, 1e7f), 1e5f, 3);
+		failures += ReportCheck("queries far outside every point", far, "thousands of cells out, and huge radii");
+
+		grid.Build(parallel, nullptr, 0, 1.0f);
+		results.assign(1, 0);
+		grid.QueryNearest(XMFLOAT3(0, 0, 0), 3, results);
+		std::vector<uint32_t> none;
+		grid.QueryRadius(XMFLOAT3(0, 0, 0), 100.0f, none);
+		failures += ReportCheck("an empty grid finds nothing", results.empty() && none.empty(), "");
+	}
+
+	return ReportFailures(failures);
+}
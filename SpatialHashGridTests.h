@@ -0,0 +1,34 @@
+#pragma once
+
+// --------------------------------------------------------
+// Headless CPU benchmark of the spatial hash grid - no GPU.
+//
+// Random points at a constant density (one per 2 x 2 x 2 on
+// average), at 1k, 10k, 100k and 1M (up to maxEntityCount),
+// with 5 unit cells.  For each size it times:
+//  - Build() on one thread and on threadCount, with every point
+//    moved between builds like a frame of fast movers
+//  - radius and box queries 5 units out, and the 8 nearest,
+//    against a linear scan over every point
+//
+// Checks, per size:
+//  - every query returns exactly what the scan finds, and the
+//    nearest in the same order
+//  - one thread and many build grids that answer the same
+// Then on small hand-made sets: points on cell boundaries and
+// at negative coordinates, duplicates tied on distance, more
+// neighbours asked for than there are points, a distance limit,
+// queries far outside every point, and an empty grid.
+//
+// Returns 0 if all checks passed.
+// --------------------------------------------------------
+struct SpatialHashBenchSettings
+{
+	int maxEntityCount = 1000000;
+	int queries = 1000;			// Of each kind, per size
+	int checkedQueries = 50;	// Of those, also scanned linearly
+	int frames = 10;			// Builds timed, per size and thread count
+	int threadCount = -1;		// Including the caller, negative = every hardware thread
+};
+
+int RunSpatialHashBench(const SpatialHashBenchSettings& settings);
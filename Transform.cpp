@@ -1,4 +1,5 @@
 #include "Transform.h"
+#include <cmath>
 
 using namespace DirectX;
 
@@ -6,7 +7,8 @@ Transform::Transform()
 	: position(0, 0, 0),
 	rotation(0, 0, 0),
 	scale(1, 1, 1),
-	dirty(true)
+	dirty(true),
+	version(0)
 {
 	XMStoreFloat4x4(&worldMatrix, XMMatrixIdentity());
 	XMStoreFloat4x4(&worldInverseTransposeMatrix, XMMatrixIdentity());
@@ -18,36 +20,63 @@ void Transform::SetPosition(float x, float y, float z)
 {
 	position = XMFLOAT3(x, y, z);
 	dirty = true;
+	version++;
 }
 
 void Transform::SetPosition(XMFLOAT3 position)
 {
 	this->position = position;
 	dirty = true;
+	version++;
 }
 
 void Transform::SetRotation(float pitch, float yaw, float roll)
 {
 	rotation = XMFLOAT3(pitch, yaw, roll);
 	dirty = true;
+	version++;
 }
 
 void Transform::SetRotation(XMFLOAT3 rotation)
 {
 	this->rotation = rotation;
 	dirty = true;
+	version++;
+}
+
+void Transform::SetRotationQuaternion(XMFLOAT4 quaternion)
+{
+	// Rotation matrix terms, as XMMatrixRotationQuaternion() builds them
+	float x = quaternion.x, y = quaternion.y, z = quaternion.z, w = quaternion.w;
+	float m11 = 1.0f - 2.0f * (y * y + z * z), m13 = 2.0f * (x * z - w * y);
+	float m21 = 2.0f * (x * y - w * z), m23 = 2.0f * (y * z + w * x);
+	float m31 = 2.0f * (x * z + w * y), m32 = 2.0f * (y * z - w * x), m33 = 1.0f - 2.0f * (x * x + y * y);
+
+	// Yaw first, then pitch and roll from the matrix with the yaw
+	// taken back out.  Looking nearly straight up or down, yaw is
+	// poorly determined, but roll then makes up for any error in it.
+	float yaw = atan2f(m31, m33);
+	float cy = cosf(yaw), sy = sinf(yaw);
+	rotation = XMFLOAT3(
+		atan2f(-m32, m31 * sy + m33 * cy),
+		yaw,
+		atan2f(-(m21 * cy - m23 * sy), m11 * cy - m13 * sy));
+	dirty = true;
+	version++;
 }
 
 void Transform::SetScale(float x, float y, float z)
 {
 	scale = XMFLOAT3(x, y, z);
 	dirty = true;
+	version++;
 }
 
 void Transform::SetScale(XMFLOAT3 scale)
 {
 	this->scale = scale;
 	dirty = true;
+	version++;
 }
 
 // Getters
@@ -90,6 +119,7 @@ void Transform::MoveAbsolute(float x, float y, float z)
 	position.y += y;
 	position.z += z;
 	dirty = true;
+	version++;
 }
 
 void Transform::MoveRelative(float x, float y, float z)
@@ -107,6 +137,7 @@ void Transform::MoveRelative(float x, float y, float z)
 	XMVECTOR pos = XMLoadFloat3(&position);
 	XMStoreFloat3(&position, XMVectorAdd(pos, relativeMovement));
 	dirty = true;
+	version++;
 }
 
 void Transform::MoveRelative(XMFLOAT3 offset)
@@ -148,6 +179,7 @@ void Transform::MoveAbsolute(XMFLOAT3 offset)
 	position.y += offset.y;
 	position.z += offset.z;
 	dirty = true;
+	version++;
 }
 
 void Transform::Rotate(float pitch, float yaw, float roll)
@@ -156,6 +188,7 @@ void Transform::Rotate(float pitch, float yaw, float roll)
 	rotation.y += yaw;
 	rotation.z += roll;
 	dirty = true;
+	version++;
 }
 
 void Transform::Rotate(XMFLOAT3 rotation)
@@ -164,6 +197,7 @@ void Transform::Rotate(XMFLOAT3 rotation)
 	this->rotation.y += rotation.y;
 	this->rotation.z += rotation.z;
 	dirty = true;
+	version++;
 }
 
 void Transform::Scale(float x, float y, float z)
@@ -172,6 +206,7 @@ void Transform::Scale(float x, float y, float z)
 	scale.y *= y;
 	scale.z *= z;
 	dirty = true;
+	version++;
 }
 
 void Transform::Scale(XMFLOAT3 scale)
@@ -180,6 +215,16 @@ void Transform::Scale(XMFLOAT3 scale)
 	this->scale.y *= scale.y;
 	this->scale.z *= scale.z;
 	dirty = true;
+	version++;
+}
+
+void Transform::SetWorldMatrix(FXMMATRIX world)
+{
+	XMStoreFloat4x4(&worldMatrix, world);
+	XMStoreFloat4x4(&worldInverseTransposeMatrix,
+		XMMatrixInverse(0, XMMatrixTranspose(world)));
+	dirty = false;
+	version++;
 }
 
 // Private
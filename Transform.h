@@ -11,6 +11,7 @@ public:
 	void SetPosition(DirectX::XMFLOAT3 position);
 	void SetRotation(float pitch, float yaw, float roll);
 	void SetRotation(DirectX::XMFLOAT3 rotation);
+	void SetRotationQuaternion(DirectX::XMFLOAT4 quaternion); // Stored as the matching pitch, yaw, roll
 	void SetScale(float x, float y, float z);
 	void SetScale(DirectX::XMFLOAT3 scale);
 
@@ -34,6 +35,16 @@ public:
 	DirectX::XMFLOAT3 GetUp();
 	DirectX::XMFLOAT3 GetForward();
 
+	// Sets the matrices straight from a world matrix, for a pose
+	// pitch/yaw/roll can't hold (an interpolated one).  Position,
+	// rotation and scale keep their values, and the next change to
+	// them rebuilds the matrices from them.
+	void SetWorldMatrix(DirectX::FXMMATRIX world);
+
+	// Bumped by every change, so caches can cheaply tell whether
+	// anything moved since they last looked
+	unsigned int GetVersion() const { return version; }
+
 private:
 	DirectX::XMFLOAT3 position;
 	DirectX::XMFLOAT3 rotation; // pitch, yaw, roll
@@ -43,6 +54,7 @@ private:
 	DirectX::XMFLOAT4X4 worldInverseTransposeMatrix;
 
 	bool dirty; // true when matrix needs to be recalculated
+	unsigned int version;
 
 	void UpdateMatrices();
 };
@@ -0,0 +1,52 @@
+#include "UiDrawSnapshot.h"
+
+#include <cstring>
+
+namespace
+{
+	// Into the storage already there - ImVector's own assignment
+	// frees it first
+	template<typename T> void CopyInto(ImVector<T>& to, const ImVector<T>& from)
+	{
+		to.resize(from.Size);
+		if (from.Size > 0)
+			memcpy(to.Data, from.Data, (size_t)from.Size * sizeof(T));
+	}
+}
+
+void UiDrawSnapshot::Capture(const ImDrawData& source)
+{
+	while (lists.size() < (size_t)source.CmdListsCount)
+		lists.push_back(std::make_unique<ImDrawList>(nullptr));
+
+	drawData.Clear();
+	for (int i = 0; i < source.CmdListsCount; i++)
+	{
+		const ImDrawList& from = *source.CmdLists[i];
+		ImDrawList& to = *lists[i];
+		CopyInto(to.CmdBuffer, from.CmdBuffer);
+		CopyInto(to.IdxBuffer, from.IdxBuffer);
+		CopyInto(to.VtxBuffer, from.VtxBuffer);
+		CopyInto(to._CallbacksDataBuf, from._CallbacksDataBuf);
+		to.Flags = from.Flags;
+
+		// An atlas texture's id can change with the next frame's
+		// updates, so each command keeps the id it has now.  Callback
+		// data stored in the list points into the copy's own buffer.
+		for (ImDrawCmd& command : to.CmdBuffer)
+		{
+			command.TexRef = ImTextureRef(command.GetTexID());
+			if (command.UserCallback && command.UserCallbackDataSize > 0)
+				command.UserCallbackData = to._CallbacksDataBuf.Data + command.UserCallbackDataOffset;
+		}
+		drawData.CmdLists.push_back(&to);
+	}
+
+	drawData.CmdListsCount = source.CmdListsCount;
+	drawData.TotalIdxCount = source.TotalIdxCount;
+	drawData.TotalVtxCount = source.TotalVtxCount;
+	drawData.DisplayPos = source.DisplayPos;
+	drawData.DisplaySize = source.DisplaySize;
+	drawData.FramebufferScale = source.FramebufferScale;
+	drawData.Valid = source.Valid;
+}
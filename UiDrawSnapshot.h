@@ -0,0 +1,36 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "ImGui/imgui.h"
+
+// --------------------------------------------------------
+// A copy of one frame's ImGui draw data, so the render thread
+// can draw the UI while the game thread builds the next one.
+//
+// The draw lists ImGui::Render() hands out are ImGui's, and the
+// next NewFrame() rewrites them, so Capture() copies them into
+// lists of its own.  Those keep their capacity, so a settled UI
+// copies without touching the heap.
+//
+// Texture references are resolved to the backend's ids as
+// they're copied, and the texture update list is left out - any
+// updates the frame asks for (the font atlas, now and then) have
+// to be done before Capture(), on the game thread.
+// --------------------------------------------------------
+class UiDrawSnapshot
+{
+public:
+	UiDrawSnapshot() = default;
+	UiDrawSnapshot(const UiDrawSnapshot&) = delete;
+	UiDrawSnapshot& operator=(const UiDrawSnapshot&) = delete;
+
+	void Capture(const ImDrawData& source);
+
+	// Null until something is captured
+	ImDrawData* GetDrawData() { return drawData.Valid ? &drawData : nullptr; }
+
+private:
+	ImDrawData drawData;
+	std::vector<std::unique_ptr<ImDrawList>> lists;
+};
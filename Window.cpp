@@ -38,8 +38,9 @@ namespace Window
 		bool hasFocus = false;
 		bool isMinimized = false;
 		
-		// Function pointer to call
-		// when the window resizes
+		// Function pointers to call
+		// before and after the window resizes
+		void (*onBeforeResize)() = 0;
 		void (*onResize)() = 0;
 
 		// Basic FPS tracking
@@ -66,6 +67,8 @@ bool Window::IsMinimized() { return isMinimized; }
 // height          - Desired height of the window
 // titleBarText    - Window's title bar text
 // statsInTitleBar - Want debug stats (like FPS) in title bar?
+// beforeResizeCallback - The function to call before the size and
+//                   swap chain change, e.g. to idle a render thread
 // resizeCallback  - The function to call when the window resizes
 // --------------------------------------------------------
 HRESULT Window::Create(
@@ -74,6 +77,7 @@ HRESULT Window::Create(
 	unsigned int height, 
 	std::wstring titleBarText,
 	bool statsInTitleBar,
+	void (*beforeResizeCallback)(),
 	void (*resizeCallback)())
 {
 	// Verify
@@ -85,6 +89,7 @@ HRESULT Window::Create(
 	windowHeight = height;
 	windowTitle = titleBarText;
 	windowStats = statsInTitleBar;
+	onBeforeResize = beforeResizeCallback;
 	onResize = resizeCallback;
 
 	// Start window creation by filling out the
@@ -297,6 +302,11 @@ LRESULT Window::ProcessMessage(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lPara
 		isMinimized = wParam == SIZE_MINIMIZED;
 		if (isMinimized)
 			return 0;
+
+		// Nothing else may be using the size or the swap chain
+		// while they change
+		if (onBeforeResize)
+			onBeforeResize();
 		
 		// Save the new client area dimensions.
 		windowWidth = LOWORD(lParam);
@@ -20,6 +20,7 @@ namespace Window
 		unsigned int height,
 		std::wstring titleBarText,
 		bool statsInTitleBar,
+		void (*beforeResizeCallback)(),
 		void (*resizeCallback)());
 	void UpdateStats(float totalTime);
 	void Quit();